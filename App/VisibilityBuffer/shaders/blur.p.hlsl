@@ -8,18 +8,45 @@ struct PSInput
 };
 
 ConstantBuffer<BlurCB>	cbBlur			: register(b0);
+ConstantBuffer<ShadowCB>	cbShadow		: register(b1);
 Texture2D				texColor		: register(t0);
 SamplerState			samLinearClamp	: register(s0);
 
 
+// the shadow map is an atlas of cascades.
+// taps are clamped to the cascade tile of the pixel, half a texel inside,
+// so that the bilinear filter never reads texels of a neighbouring cascade.
+void GetTapClampRect(float2 uv, out float2 uvMin, out float2 uvMax)
+{
+	float2 texSize;
+	texColor.GetDimensions(texSize.x, texSize.y);
+	float2 halfTexel = 0.5 / texSize;
+
+	uvMin = halfTexel;
+	uvMax = 1.0 - halfTexel;
+	for (uint i = 0; i < cbShadow.cascadeCount; i++)
+	{
+		float4 rect = cbShadow.cascadeAtlasRect[i];
+		if (all(uv >= rect.xy) && all(uv < rect.xy + rect.zw))
+		{
+			uvMin = rect.xy + halfTexel;
+			uvMax = rect.xy + rect.zw - halfTexel;
+			break;
+		}
+	}
+}
+
 float4 main(PSInput In)	: SV_TARGET0
 {
+	float2 uvMin, uvMax;
+	GetTapClampRect(In.uv, uvMin, uvMax);
+
 	const float kKernels[4] = {cbBlur.kernel0.y, cbBlur.kernel0.z, cbBlur.kernel0.w, cbBlur.kernel1.x};
-	float4 ret = texColor.SampleLevel(samLinearClamp, In.uv, 0) * cbBlur.kernel0.x;
+	float4 ret = texColor.SampleLevel(samLinearClamp, clamp(In.uv, uvMin, uvMax), 0) * cbBlur.kernel0.x;
 	for (int i = 1; i <= 4; i++)
 	{
-		ret += texColor.SampleLevel(samLinearClamp, In.uv + (float)i * cbBlur.offset, 0) * kKernels[i - 1];
-		ret += texColor.SampleLevel(samLinearClamp, In.uv - (float)i * cbBlur.offset, 0) * kKernels[i - 1];
+		ret += texColor.SampleLevel(samLinearClamp, clamp(In.uv + (float)i * cbBlur.offset, uvMin, uvMax), 0) * kKernels[i - 1];
+		ret += texColor.SampleLevel(samLinearClamp, clamp(In.uv - (float)i * cbBlur.offset, uvMin, uvMax), 0) * kKernels[i - 1];
 	}
 	return ret;
 }
@@ -1,6 +1,8 @@
 #ifndef CBUFFER_HLSLI
 #define CBUFFER_HLSLI
 
+#include "constant_defs.h"
+
 #ifdef USE_IN_CPP
 #	define		float4x4		DirectX::XMFLOAT4X4
 #	define		float4			DirectX::XMFLOAT4
@@ -44,6 +46,11 @@ struct ShadowCB
 	float4x4	mtxWorldToProj;
 	float2		exponent;
 	float		constBias;
+	uint		cascadeCount;
+	float4		atlasRect;			// xy : uv offset, zw : uv scale of this cascade in the atlas.
+	float4x4	mtxCascadeWorldToProj[SHADOW_CASCADE_MAX];
+	float4		cascadeAtlasRect[SHADOW_CASCADE_MAX];
+	float4x4	mtxWorldToVirtual;	// world to virtual shadow map clip space.
 };
 
 struct MeshCB
@@ -122,6 +129,7 @@ struct MeshletCullCB
 	uint	meshletStartIndex;
 	uint	meshletCount;
 	uint	localMeshletIndex;
+	uint	maskedListCapacity;	// draw call capacity of a masked draw list. 0 : masked draw lists are disabled.
 };
 
 struct RestirCB
@@ -182,6 +190,7 @@ struct InstanceData
 	float4x4	mtxBoxTransform;
 	float4x4	mtxLocalToWorld;
 	float4x4	mtxWorldToLocal;
+	uint		flags;		// INSTANCE_FLAG_xxx
 };
 
 struct SubmeshData
@@ -192,6 +201,8 @@ struct SubmeshData
 	uint	tangentOffset;
 	uint	uvOffset;
 	uint	indexOffset;
+	uint	meshletOffset;	// first meshlet of this submesh in MeshletData.
+	uint	flags;			// SUBMESH_FLAG_xxx
 };
 
 struct MeshletData
@@ -202,6 +213,7 @@ struct MeshletData
 	uint	meshletPackedPrimOffset;
 	uint	meshletVertexIndexCount;
 	uint	meshletVertexIndexOffset;
+	uint	alphaClass;		// MESHLET_ALPHA_xxx
 };
 
 struct DrawCallData
@@ -210,6 +222,15 @@ struct DrawCallData
 	uint	meshletIndex;
 };
 
+// draw call range of an instance for DRAWCALL_PREFIX_TABLE.
+// sorted by argStart.
+struct DrawCallRange
+{
+	uint	argStart;
+	uint	instanceIndex;
+	uint	meshletStart;
+};
+
 struct MaterialData
 {
 	uint	colorTexIndex;
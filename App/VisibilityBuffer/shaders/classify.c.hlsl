@@ -1,6 +1,7 @@
 #include "constant_defs.h"
 #include "cbuffer.hlsli"
 #include "visibility_buffer.hlsli"
+#include "material_mask.hlsli"
 
 ConstantBuffer<SceneCB>			cbScene				: register(b0);
 ConstantBuffer<TileCB>			cbTile				: register(b1);
@@ -8,13 +9,48 @@ ConstantBuffer<TileCB>			cbTile				: register(b1);
 Texture2D<uint>					texVis				: register(t0);
 StructuredBuffer<SubmeshData>	rSubmeshData		: register(t1);
 StructuredBuffer<MeshletData>	rMeshletData		: register(t2);
-StructuredBuffer<DrawCallData>	rDrawCallData		: register(t3);
+StructuredBuffer<DrawCallSource>	rDrawCallData		: register(t3);
 Texture2D<float>				texDepth			: register(t4);
 
-RWByteAddressBuffer				rwDrawArg			: register(u0);
-RWByteAddressBuffer				rwTileIndex			: register(u1);
+RWByteAddressBuffer				rwDrawArg			: register(u0); // materialMax
+RWByteAddressBuffer				rwTileIndex			: register(u1); // tileMax * listStride, compacted per material
+RWStructuredBuffer<uint>		rwTileMaterialList	: register(u2); // tileMax * listStride, sparse material list per tile
+RWStructuredBuffer<uint>		rwTileMaterialCount	: register(u3); // tileMax
+RWStructuredBuffer<uint>		rwTileOffset		: register(u4); // materialMax
+RWStructuredBuffer<uint>		rwTileFill			: register(u5); // materialMax
 
-groupshared uint shMaterialFlag[CLASSIFY_MATERIAL_CHUNK_MAX];
+// material tile counts to offsets.
+#define SCAN_LOAD_INPUT(index)			rwDrawArg.Load((index) * 16 + 4)
+#define SCAN_STORE_OUTPUT(index, value)	rwTileOffset[index] = value
+#define PREFIX_SCAN_STATUS_REGISTER		u6
+#define PREFIX_SCAN_COUNTER_REGISTER	u7
+#include "prefix_sum.hlsli"
+
+#define CLASSIFY_THREADS (CLASSIFY_THREAD_WIDTH * CLASSIFY_THREAD_WIDTH)
+
+groupshared uint shTileMaterialCount;
+
+// a tile can't have more materials than pixels.
+uint GetTileListStride()
+{
+	return min(cbTile.materialMax, CLASSIFY_TILE_MATERIAL_MAX);
+}
+
+[numthreads(32, 1, 1)]
+void InitCS(uint dtid : SV_DispatchThreadID)
+{
+	uint matIndex = dtid;
+	if (matIndex < cbTile.materialMax)
+	{
+		uint argAddr = matIndex * 16;
+		rwDrawArg.Store(argAddr + 0, 6);
+		rwDrawArg.Store(argAddr + 4, 0);
+		rwDrawArg.Store(argAddr + 8, 0);
+		rwDrawArg.Store(argAddr + 12, 0);
+		rwTileFill[matIndex] = 0;
+	}
+	InitScanStatus(dtid, (cbTile.materialMax + PREFIX_SCAN_BLOCK_SIZE - 1) / PREFIX_SCAN_BLOCK_SIZE);
+}
 
 void ClassifyPixel(uint2 pos)
 {
@@ -22,17 +58,14 @@ void ClassifyPixel(uint2 pos)
 	{
 		float depth = texDepth[pos];
 		[branch]
-		if (depth < 1.0)
+		if (depth > 0.0)
 		{
 			uint drawCallIndex, primID;
 			DecodeVisibility(texVis[pos], drawCallIndex, primID);
-			DrawCallData dc = rDrawCallData[drawCallIndex];
+			DrawCallData dc = LoadDrawCallData(rDrawCallData, drawCallIndex);
 			MeshletData ml = rMeshletData[dc.meshletIndex];
 			SubmeshData sm = rSubmeshData[ml.submeshIndex];
-			uint index = sm.materialIndex / 32;
-			uint bit = sm.materialIndex % 32;
-			uint orig;
-			InterlockedOr(shMaterialFlag[index], 0x1 << bit, orig);
+			MarkMaterial(sm.materialIndex);
 		}
 	}
 }
@@ -41,10 +74,13 @@ void ClassifyPixel(uint2 pos)
 void main(
 	uint3 gid : SV_GroupID,
 	uint3 gtid : SV_GroupThreadID,
-	uint3 did : SV_DispatchThreadID)
+	uint gidx : SV_GroupIndex)
 {
-	const uint kMatChunkIndex = gtid.y * CLASSIFY_THREAD_WIDTH + gtid.x;
-	shMaterialFlag[kMatChunkIndex] = 0x0;
+	ClearMaterialMask(gidx, CLASSIFY_THREADS, cbTile.materialMax);
+	if (gidx == 0)
+	{
+		shTileMaterialCount = 0;
+	}
 	
 	// sync
 	GroupMemoryBarrierWithGroupSync();
@@ -62,24 +98,60 @@ void main(
 	// sync
 	GroupMemoryBarrierWithGroupSync();
 
-	// compute tile draw args.
-	if (shMaterialFlag[kMatChunkIndex] != 0)
+	// store sparse material list of this tile.
+	uint tileNo = gid.y * cbTile.numX + gid.x;
+	uint listBase = tileNo * GetTileListStride();
+	for (uint maskIndex = gidx; maskIndex < CLASSIFY_CHUNK_MASK_MAX; maskIndex += CLASSIFY_THREADS)
 	{
-		const uint kMatBaseIndex = kMatChunkIndex * 32;
-		uint bits = shMaterialFlag[kMatChunkIndex];
-		while (bits != 0)
+		uint chunkBits = shChunkMask[maskIndex];
+		while (chunkBits != 0)
 		{
-			uint firstBit = firstbitlow(bits);
-			uint matIndex = kMatBaseIndex + firstBit;
-			bits &= ~(0x1 << firstBit);
+			uint chunkIndex = maskIndex * 32 + firstbitlow(chunkBits);
+			chunkBits &= chunkBits - 1;
 
-			uint arg_addr = matIndex * 16;
-			uint store_addr = 0;
-			rwDrawArg.InterlockedAdd(arg_addr + 4, 1, store_addr);
+			uint bits = shMaterialMask[chunkIndex];
+			uint storeIndex;
+			InterlockedAdd(shTileMaterialCount, countbits(bits), storeIndex);
+			while (bits != 0)
+			{
+				uint matIndex = chunkIndex * 32 + firstbitlow(bits);
+				bits &= bits - 1;
 
-			uint tile_no = gid.y * cbTile.numX + gid.x;
-			store_addr = ((matIndex * cbTile.tileMax) + store_addr) * 4;
-			rwTileIndex.Store(store_addr, tile_no);
+				rwDrawArg.InterlockedAdd(matIndex * 16 + 4, 1);
+				rwTileMaterialList[listBase + storeIndex] = matIndex;
+				storeIndex++;
+			}
 		}
 	}
-}
\ No newline at end of file
+
+	// sync
+	GroupMemoryBarrierWithGroupSync();
+
+	if (gidx == 0)
+	{
+		rwTileMaterialCount[tileNo] = shTileMaterialCount;
+	}
+}
+
+// exclusive scan of tile counts per material.
+[numthreads(PREFIX_SCAN_BLOCK_SIZE, 1, 1)]
+void ScanCS(uint gtid : SV_GroupThreadID)
+{
+	PrefixScan(gtid, cbTile.materialMax, false);
+}
+
+// scatter sparse tile lists into per-material tile lists.
+[numthreads(CLASSIFY_THREADS, 1, 1)]
+void ScatterCS(uint3 gid : SV_GroupID, uint gtid : SV_GroupThreadID)
+{
+	uint tileNo = gid.y * cbTile.numX + gid.x;
+	uint listBase = tileNo * GetTileListStride();
+	uint count = rwTileMaterialCount[tileNo];
+	for (uint i = gtid; i < count; i += CLASSIFY_THREADS)
+	{
+		uint matIndex = rwTileMaterialList[listBase + i];
+		uint slot;
+		InterlockedAdd(rwTileFill[matIndex], 1, slot);
+		rwTileIndex.Store((rwTileOffset[matIndex] + slot) * 4, tileNo);
+	}
+}
@@ -3,13 +3,72 @@
 
 #define CLASSIFY_TILE_WIDTH (64)
 #define CLASSIFY_THREAD_WIDTH (16)
-#define CLASSIFY_MATERIAL_CHUNK_MAX (256)
+// tiles mark materials in a two-level bitmask. (chunk mask -> material mask per 32 materials)
+#define CLASSIFY_MATERIAL_CHUNK_MAX (2048)
 #define CLASSIFY_MATERIAL_MAX (CLASSIFY_MATERIAL_CHUNK_MAX * 32)
+#define CLASSIFY_CHUNK_MASK_MAX (CLASSIFY_MATERIAL_CHUNK_MAX / 32)
 #define CLASSIFY_DEPTH_RANGE CLASSIFY_MATERIAL_MAX
+// capacity of the sparse material list per classify tile.
+#define CLASSIFY_TILE_MATERIAL_MAX (CLASSIFY_TILE_WIDTH * CLASSIFY_TILE_WIDTH)
 
 #define TILE_THREADS_WIDTH  8
 #define PIXEL_QUAD_WIDTH    2
 #define TILE_PIXEL_WIDTH    (TILE_THREADS_WIDTH * PIXEL_QUAD_WIDTH)
+// capacity of the sparse material list per binning tile.
+#define TILE_BIN_MATERIAL_MAX (TILE_PIXEL_WIDTH * TILE_PIXEL_WIDTH)
+
+// 1 : use 24 bytes quantized meshlet bounds instead of 64 bytes float bounds.
+#define MESHLET_BOUND_COMPACT (0)
+
+// meshlet culling dispatch.
+// draw calls are laid out as (group.y * MESHLET_CULL_MAX_GROUP_X + group.x) * MESHLET_CULL_GROUP_SIZE + thread.
+#define MESHLET_CULL_GROUP_SIZE (32)
+#define MESHLET_CULL_MAX_GROUP_X (65535)
+
+// 1 : resolve draw call index with per-instance range table (binary search) instead of per-meshlet DrawCallData.
+#define DRAWCALL_PREFIX_TABLE (0)
+
+// SubmeshData.flags
+#define SUBMESH_FLAG_MASKED (0x1)
+#define SUBMESH_FLAG_DOUBLE_SIDED (0x2)
+
+// InstanceData.flags
+// instances hidden by the software occlusion are skipped in the main view culling. (shadows are not affected)
+#define INSTANCE_FLAG_OCCLUDED (0x1)
+
+// masked draw lists for the bindless masked path.
+// visible masked draw calls of all instances are appended to list 0 (backface culling) or list 1 (double sided).
+// meshlets baked as MESHLET_ALPHA_OPAQUE go to list 2 and 3 in the same order, and are drawn without alpha test.
+#define MASKED_DRAW_LIST_COUNT (4)
+
+// MeshletData.alphaClass. per-meshlet classification of masked submeshes baked offline.
+#define MESHLET_ALPHA_MIXED (0)
+#define MESHLET_ALPHA_OPAQUE (1)
+#define MESHLET_ALPHA_TRANSPARENT (2)
+
+// cascaded shadow map.
+// cascades are packed in the shadow map as a 2x2 atlas.
+#define SHADOW_CASCADE_MAX (4)
+
+// virtual shadow map.
+// a single virtual map covering the whole scene is split into pages,
+// and only pages requested by visible pixels are allocated in the physical pool.
+#define VSM_VIRTUAL_SIZE (16384)
+#define VSM_PAGE_SIZE (128)
+#define VSM_PAGE_COUNT_X (VSM_VIRTUAL_SIZE / VSM_PAGE_SIZE)
+#define VSM_PHYSICAL_PAGE_COUNT_X (32)
+// each physical page slot keeps a guard band of the neighbor virtual texels around the page,
+// so the shadow filter kernel never reads texels of other pages.
+#define VSM_PAGE_GUARD (4)
+#define VSM_PHYSICAL_PAGE_STRIDE (VSM_PAGE_SIZE + VSM_PAGE_GUARD * 2)
+#define VSM_PHYSICAL_SIZE (VSM_PHYSICAL_PAGE_COUNT_X * VSM_PHYSICAL_PAGE_STRIDE)
+// page table entry : physical page index | VSM_PAGE_VALID_BIT, 0 if the page is not rendered yet.
+#define VSM_PAGE_VALID_BIT (0x80000000)
+
+// prefix scan.
+// one thread group scans PREFIX_SCAN_BLOCK_SIZE items, and each block has a look-back status of PREFIX_SCAN_STATUS_STRIDE bytes.
+#define PREFIX_SCAN_BLOCK_SIZE (256)
+#define PREFIX_SCAN_STATUS_STRIDE (24)
 
 #endif // CONSTANT_DEFS_H
 //  EOF
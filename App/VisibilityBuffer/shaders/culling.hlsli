@@ -1,6 +1,8 @@
 #ifndef CULLING_HLSLI
 #define CULLING_HLSLI
 
+#include "constant_defs.h"
+
 // meshlet bounding data structure.
 struct MeshletBound
 {
@@ -12,6 +14,66 @@ struct MeshletBound
 	uint		pad[3];
 };	// struct MeshletBound
 
+// compact meshlet bounding data structure. (24 bytes)
+// see meshlet_bound.h for the bit layout.
+struct MeshletBoundCompact
+{
+	uint4		data0;
+	uint2		data1;
+};	// struct MeshletBoundCompact
+
+float DecodeBoxCoord(uint q)
+{
+	return (float)q / 65535.0 * 2.0 - 1.0;
+}
+
+float3 DecodeOctahedralAxis(uint qx, uint qy)
+{
+	float2 e = float2(qx, qy) / 255.0 * 2.0 - 1.0;
+	float3 v = float3(e, 1.0 - abs(e.x) - abs(e.y));
+	if (v.z < 0.0)
+	{
+		v.xy = (1.0 - abs(e.yx)) * (step(0.0, e) * 2.0 - 1.0);
+	}
+	return normalize(v);
+}
+
+// decode compact bound to local space bound.
+MeshletBound DecodeMeshletBound(in MeshletBoundCompact bound, in float4x4 mtxBoxTransform)
+{
+	float3 boxMin = float3(DecodeBoxCoord(bound.data0.x & 0xffff), DecodeBoxCoord(bound.data0.x >> 16), DecodeBoxCoord(bound.data0.y & 0xffff));
+	float3 boxMax = float3(DecodeBoxCoord(bound.data0.y >> 16), DecodeBoxCoord(bound.data0.z & 0xffff), DecodeBoxCoord(bound.data0.z >> 16));
+	float3 boxApex = float3(DecodeBoxCoord(bound.data0.w & 0xffff), DecodeBoxCoord(bound.data0.w >> 16), DecodeBoxCoord(bound.data1.x & 0xffff));
+
+	// box space aabb to local space aabb.
+	float3 center = mul(mtxBoxTransform, float4((boxMin + boxMax) * 0.5, 1)).xyz;
+	float3 extent = mul(abs((float3x3)mtxBoxTransform), (boxMax - boxMin) * 0.5);
+
+	uint cutoff = bound.data1.y & 0xff;
+
+	MeshletBound ret = (MeshletBound)0;
+	ret.aabbMin = center - extent;
+	ret.aabbMax = center + extent;
+	ret.coneApex = mul(mtxBoxTransform, float4(boxApex, 1)).xyz;
+	ret.coneAxis = DecodeOctahedralAxis((bound.data1.x >> 16) & 0xff, bound.data1.x >> 24);
+	ret.coneCutoff = (cutoff == 0xff) ? 2.0 : (float)cutoff / 254.0;
+	return ret;
+}
+
+#if MESHLET_BOUND_COMPACT
+typedef MeshletBoundCompact MeshletBoundData;
+MeshletBound LoadMeshletBound(in MeshletBoundCompact bound, in float4x4 mtxBoxTransform)
+{
+	return DecodeMeshletBound(bound, mtxBoxTransform);
+}
+#else
+typedef MeshletBound MeshletBoundData;
+MeshletBound LoadMeshletBound(in MeshletBound bound, in float4x4 mtxBoxTransform)
+{
+	return bound;
+}
+#endif
+
 // test cull by frustum.
 //   true : this meshlet is invisible.
 //   false : this meshlet is visible.
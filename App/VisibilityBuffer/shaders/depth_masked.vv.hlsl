@@ -1,4 +1,5 @@
 #include "cbuffer.hlsli"
+#include "visibility_buffer.hlsli"
 
 struct VSInput
 {
@@ -12,14 +13,20 @@ struct VSOutput
 	float2	texcoord	: TEXCOORD0;
 };
 
-ConstantBuffer<SceneCB>		cbScene			: register(b0);
-ConstantBuffer<MeshCB>		cbMesh			: register(b1);
+ConstantBuffer<SceneCB>			cbScene			: register(b0);
+ConstantBuffer<VisibilityCB>	cbVisibility	: register(b0, space1);
+
+// the instance is resolved from the draw call index in the root constant. (same as mesh.vv.hlsl)
+StructuredBuffer<InstanceData>		rInstanceData	: register(t0);
+StructuredBuffer<DrawCallSource>	rDrawCallData	: register(t1);
 
 VSOutput main(const VSInput In)
 {
 	VSOutput Out = (VSOutput)0;
 
-	float4x4 mtxLocalToProj = mul(cbScene.mtxWorldToProj, mul(cbMesh.mtxLocalToWorld, cbMesh.mtxBoxTransform));
+	DrawCallData dc = LoadDrawCallData(rDrawCallData, cbVisibility.drawCallIndex);
+	InstanceData instance = rInstanceData[dc.instanceIndex];
+	float4x4 mtxLocalToProj = mul(cbScene.mtxWorldToProj, mul(instance.mtxLocalToWorld, instance.mtxBoxTransform));
 
 	Out.position = mul(mtxLocalToProj, float4(In.position, 1));
 	Out.texcoord = In.texcoord;
@@ -10,25 +10,30 @@ Texture2D							texGBufferA			: register(t0);
 Texture2D							texGBufferB			: register(t1);
 Texture2D							texGBufferC			: register(t2);
 Texture2D<float>					texDepth			: register(t3);
-#if SHADOW_TYPE == 0
-Texture2D<float>					texShadowDepth		: register(t4);
-#else
+#if SHADOW_TYPE == 1
 Texture2D							texShadowExp		: register(t4);
+#else
+Texture2D<float>					texShadowDepth		: register(t4);
+#endif
+#if SHADOW_TYPE == 2
+ByteAddressBuffer					bufVsmPageTable		: register(t5);
+Texture2D<float>					texCascadeDepth		: register(t6);
 #endif
 
-#if SHADOW_TYPE == 0
-SamplerComparisonState				samShadow			: register(s0);
-#else
+#if SHADOW_TYPE == 1
 SamplerState						samLinearClamp		: register(s0);
+#else
+SamplerComparisonState				samShadow			: register(s0);
 #endif
 
 RWTexture2D<float4>					rwOutput			: register(u0);
 
-#if SHADOW_TYPE == 0
-float Shadow(float4 shadowClipPos)
+// margin from the cascade edge to keep the filter kernel in the cascade.
+static const float kCascadeMarginTexels = 4.0;
+
+#if SHADOW_TYPE != 1
+float ShadowPCF(Texture2D<float> texDepthMap, float2 shadowUV, float depth)
 {
-	float3 shadowProjPos = shadowClipPos.xyz / shadowClipPos.w;
-	float2 shadowUV = shadowProjPos.xy * float2(0.5, -0.5) + 0.5;
 	static const int kKernelLevel = 2;
 	static const int kKernelWidth = kKernelLevel * 2 + 1;
 	float shadow = 0;
@@ -38,12 +43,28 @@ float Shadow(float4 shadowClipPos)
 		[unroll]
 		for (int j = -kKernelLevel; j <= kKernelLevel; j++)
 		{
-			shadow += texShadowDepth.SampleCmpLevelZero(samShadow, shadowUV, shadowProjPos.z + cbShadow.constBias, int2(i, j)).r;
+			shadow += texDepthMap.SampleCmpLevelZero(samShadow, shadowUV, depth + cbShadow.constBias, int2(i, j)).r;
 		}
 	}
 	return shadow / (float)(kKernelWidth * kKernelWidth);
 }
-#else
+#endif
+
+#if SHADOW_TYPE == 0
+float2 GetShadowMapSize()
+{
+	float2 size;
+	texShadowDepth.GetDimensions(size.x, size.y);
+	return size;
+}
+
+float Shadow(float4 shadowClipPos, float4 atlasRect)
+{
+	float3 shadowProjPos = shadowClipPos.xyz / shadowClipPos.w;
+	float2 shadowUV = atlasRect.xy + (shadowProjPos.xy * float2(0.5, -0.5) + 0.5) * atlasRect.zw;
+	return ShadowPCF(texShadowDepth, shadowUV, shadowProjPos.z);
+}
+#elif SHADOW_TYPE == 1
 float Chebyshev(float2 moments, float depth)
 {
 	const float kVarianceMin = 0.0;
@@ -61,10 +82,17 @@ float Chebyshev(float2 moments, float depth)
 	return saturate((p_max - kLightBleedCoeff) / (1.0 - kLightBleedCoeff));
 }
 
-float Shadow(float4 shadowClipPos)
+float2 GetShadowMapSize()
+{
+	float2 size;
+	texShadowExp.GetDimensions(size.x, size.y);
+	return size;
+}
+
+float Shadow(float4 shadowClipPos, float4 atlasRect)
 {
 	float3 shadowProjPos = shadowClipPos.xyz / shadowClipPos.w;
-	float2 shadowUV = shadowProjPos.xy * float2(0.5, -0.5) + 0.5;
+	float2 shadowUV = atlasRect.xy + (shadowProjPos.xy * float2(0.5, -0.5) + 0.5) * atlasRect.zw;
 	float depth = 1.0 - shadowProjPos.z;
 
 	depth -= cbShadow.constBias;
@@ -78,6 +106,48 @@ float Shadow(float4 shadowClipPos)
 	float negShadow = Chebyshev(moments.zw, n);
 	return min(posShadow, negShadow);
 }
+#else
+// cascaded shadow map rendered every frame as the fallback of the virtual shadow map.
+float2 GetShadowMapSize()
+{
+	float2 size;
+	texCascadeDepth.GetDimensions(size.x, size.y);
+	return size;
+}
+
+float Shadow(float4 shadowClipPos, float4 atlasRect)
+{
+	float3 shadowProjPos = shadowClipPos.xyz / shadowClipPos.w;
+	float2 shadowUV = atlasRect.xy + (shadowProjPos.xy * float2(0.5, -0.5) + 0.5) * atlasRect.zw;
+	return ShadowPCF(texCascadeDepth, shadowUV, shadowProjPos.z);
+}
+
+// returns false if the page is not rendered yet.
+bool VirtualShadow(float3 worldPos, out float shadow)
+{
+	shadow = 1.0;
+	float4 vsmPos = mul(cbShadow.mtxWorldToVirtual, float4(worldPos, 1));
+	float2 vsmUV = vsmPos.xy * float2(0.5, -0.5) + 0.5;
+	if (any(vsmUV < 0.0) || any(vsmUV >= 1.0))
+	{
+		return false;
+	}
+
+	float2 pagePos = vsmUV * VSM_PAGE_COUNT_X;
+	uint2 page = (uint2)pagePos;
+	uint entry = bufVsmPageTable.Load((page.y * VSM_PAGE_COUNT_X + page.x) * 4);
+	if ((entry & VSM_PAGE_VALID_BIT) == 0)
+	{
+		return false;
+	}
+
+	// the guard band around the page holds the neighbor texels, so the filter kernel can cross the page border.
+	uint physicalPage = entry & ~VSM_PAGE_VALID_BIT;
+	float2 physicalOrigin = float2(physicalPage % VSM_PHYSICAL_PAGE_COUNT_X, physicalPage / VSM_PHYSICAL_PAGE_COUNT_X) * VSM_PHYSICAL_PAGE_STRIDE + VSM_PAGE_GUARD;
+	float2 shadowUV = (physicalOrigin + frac(pagePos) * VSM_PAGE_SIZE) / VSM_PHYSICAL_SIZE;
+	shadow = ShadowPCF(texShadowDepth, shadowUV, vsmPos.z);
+	return true;
+}
 #endif
 
 float3 Lighting(uint2 pixelPos, float depth)
@@ -95,8 +165,28 @@ float3 Lighting(uint2 pixelPos, float depth)
 	worldPos.xyz /= worldPos.w;
 
 	// get shadow.
-	float4 shadowClipPos = mul(cbShadow.mtxWorldToProj, float4(worldPos.xyz, 1));
-	float shadow = Shadow(shadowClipPos);
+	float shadow = 1.0;
+#if SHADOW_TYPE == 2
+	// pages which are not rendered yet fall back to the cascaded shadow map.
+	if (!VirtualShadow(worldPos.xyz, shadow))
+#endif
+	{
+		// use the first cascade which contains the position with the margin.
+		// positions out of all cascades are beyond the shadow distance and not shadowed.
+		float2 shadowMapSize = GetShadowMapSize();
+		for (uint cascadeIndex = 0; cascadeIndex < cbShadow.cascadeCount; cascadeIndex++)
+		{
+			float4 atlasRect = cbShadow.cascadeAtlasRect[cascadeIndex];
+			float4 shadowClipPos = mul(cbShadow.mtxCascadeWorldToProj[cascadeIndex], float4(worldPos.xyz, 1));
+			float2 cascadeUV = shadowClipPos.xy * float2(0.5, -0.5) + 0.5;
+			float2 margin = kCascadeMarginTexels / (atlasRect.zw * shadowMapSize);
+			if (all(cascadeUV >= margin) && all(cascadeUV <= 1.0 - margin))
+			{
+				shadow = Shadow(shadowClipPos, atlasRect);
+				break;
+			}
+		}
+	}
 
 	// apply light.
 	float3 viewDirInWS = normalize(cbScene.eyePosition.xyz - worldPos.xyz);
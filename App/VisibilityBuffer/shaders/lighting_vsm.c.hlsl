@@ -0,0 +1,2 @@
+#define SHADOW_TYPE 2
+#include "lighting.c.hlsl"
@@ -0,0 +1,47 @@
+#include "cbuffer.hlsli"
+#include "visibility_buffer.hlsli"
+
+struct PSInput
+{
+	float4					position		: SV_POSITION;
+	float2					texcoord		: TEXCOORD0;
+	nointerpolation uint	materialIndex	: MATERIAL_INDEX;
+};
+
+ConstantBuffer<VisibilityCB>	cbVisibility	: register(b0, space1);
+
+StructuredBuffer<MaterialData>	rMaterialData	: register(t0);
+SamplerState					samLinearWrap	: register(s0);
+
+Texture2D						texMaterial[]	: register(t0, space32);
+
+void AlphaTest(in PSInput In)
+{
+	// a wave can cover triangles of different materials.
+	MaterialData mat = rMaterialData[In.materialIndex];
+	float opacity = texMaterial[NonUniformResourceIndex(mat.colorTexIndex)].Sample(samLinearWrap, In.texcoord).a;
+	if (opacity < 0.333)
+	{
+		discard;
+	}
+}
+
+uint VisibilityPS(PSInput In, uint primID : SV_PrimitiveID) : SV_Target0
+{
+	AlphaTest(In);
+
+	return EncodeVisibility(cbVisibility.drawCallIndex, primID);
+}
+
+// for meshlets baked as MESHLET_ALPHA_OPAQUE. all samples pass the alpha test.
+uint VisibilityOpaquePS(PSInput In, uint primID : SV_PrimitiveID) : SV_Target0
+{
+	return EncodeVisibility(cbVisibility.drawCallIndex, primID);
+}
+
+void DepthPS(PSInput In)
+{
+	AlphaTest(In);
+}
+
+//	EOF
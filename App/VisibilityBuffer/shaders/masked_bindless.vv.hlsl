@@ -0,0 +1,44 @@
+#include "cbuffer.hlsli"
+#include "visibility_buffer.hlsli"
+
+struct VSOutput
+{
+	float4					position		: SV_POSITION;
+	float2					texcoord		: TEXCOORD0;
+	nointerpolation uint	materialIndex	: MATERIAL_INDEX;
+};
+
+ConstantBuffer<SceneCB>			cbScene			: register(b0);
+ConstantBuffer<VisibilityCB>	cbVisibility	: register(b0, space1);
+
+StructuredBuffer<InstanceData>		rInstanceData	: register(t0);
+StructuredBuffer<DrawCallSource>	rDrawCallData	: register(t1);
+StructuredBuffer<SubmeshData>		rSubmeshData	: register(t2);
+StructuredBuffer<MeshletData>		rMeshletData	: register(t3);
+ByteAddressBuffer					rVertexBuffer	: register(t4);
+ByteAddressBuffer					rIndexBuffer	: register(t5);
+
+// masked draw calls of all instances are drawn with one pipeline and no vertex/index buffers.
+// the vertex is pulled from the global buffers with the meshlet of the draw call in the root constant,
+// and the material is passed to the pixel shader to fetch the texture from the bindless array.
+VSOutput main(uint vertexID : SV_VertexID)
+{
+	VSOutput Out = (VSOutput)0;
+
+	DrawCallData dc = LoadDrawCallData(rDrawCallData, cbVisibility.drawCallIndex);
+	InstanceData instance = rInstanceData[dc.instanceIndex];
+	MeshletData mlData = rMeshletData[dc.meshletIndex];
+	SubmeshData smData = rSubmeshData[mlData.submeshIndex];
+	float4x4 mtxLocalToProj = mul(cbScene.mtxWorldToProj, mul(instance.mtxLocalToWorld, instance.mtxBoxTransform));
+
+	uint index = rIndexBuffer.Load(mlData.indexOffset + vertexID * 4);
+	float3 position = GetVertexPosition(rVertexBuffer, smData, index);
+
+	Out.position = mul(mtxLocalToProj, float4(position, 1));
+	Out.texcoord = GetVertexTexcoord(rVertexBuffer, smData, index);
+	Out.materialIndex = smData.materialIndex;
+
+	return Out;
+}
+
+//	EOF
@@ -2,6 +2,13 @@
 #include "cbuffer.hlsli"
 #include "visibility_buffer.hlsli"
 #include "vrs.hlsli"
+#include "material_mask.hlsli"
+
+// TILE_BINNING : compile the tiled binning entries. (material_binning_tile.c.hlsl)
+// each side includes prefix_sum.hlsli with its own buffers.
+#ifndef TILE_BINNING
+#define TILE_BINNING 0
+#endif
 
 struct BinningCB
 {
@@ -14,16 +21,25 @@ ConstantBuffer<BinningCB>       cbBinning           : register(b0);
 Texture2D<uint>					texVis				: register(t0);
 StructuredBuffer<SubmeshData>	rSubmeshData		: register(t1);
 StructuredBuffer<MeshletData>	rMeshletData		: register(t2);
-StructuredBuffer<DrawCallData>	rDrawCallData		: register(t3);
+StructuredBuffer<DrawCallSource>	rDrawCallData		: register(t3);
 Texture2D<float>				texDepth			: register(t4);
 Texture2D<uint>					texVRS      		: register(t5);
 
+#define ARG_STRIDE (3 * 4)
+
+#if !TILE_BINNING
 RWStructuredBuffer<uint>  		rwCount 			: register(u0);
 RWStructuredBuffer<uint>		rwOffset 			: register(u1);
 RWByteAddressBuffer             rwIndirectArg       : register(u2);
 RWStructuredBuffer<uint>        rwPixBuffer         : register(u3);
 
-#define ARG_STRIDE (3 * 4)
+// material counts to offsets.
+#define SCAN_LOAD_INPUT(index)          rwCount[index]
+#define SCAN_STORE_OUTPUT(index, value) rwOffset[index] = value
+#define PREFIX_SCAN_STATUS_REGISTER     u4
+#define PREFIX_SCAN_COUNTER_REGISTER    u5
+#include "prefix_sum.hlsli"
+#endif
 
 
 bool IsValidPixelByVRS(uint2 pixelPos, out uint vrsType)
@@ -36,6 +52,7 @@ bool IsValidPixelByVRS(uint2 pixelPos, out uint vrsType)
     return true;
 }
 
+#if !TILE_BINNING
 [numthreads(32, 1, 1)]
 void InitCountCS(uint dtid : SV_DispatchThreadID)
 {
@@ -46,6 +63,7 @@ void InitCountCS(uint dtid : SV_DispatchThreadID)
         rwIndirectArg.Store(dtid * ARG_STRIDE + 4, 1);
         rwIndirectArg.Store(dtid * ARG_STRIDE + 8, 1);
     }
+    InitScanStatus(dtid, (cbBinning.numMaterials + PREFIX_SCAN_BLOCK_SIZE - 1) / PREFIX_SCAN_BLOCK_SIZE);
 }
 
 #define MAX_MATERIAL 32 * 1024 / 4
@@ -83,11 +101,15 @@ void CountCS(uint2 dtid : SV_DispatchThreadID, uint2 gtid : SV_GroupThreadID)
         {
             uint drawCallIndex, primID;
             DecodeVisibility(texVis[pixelPos], drawCallIndex, primID);
-            DrawCallData dc = rDrawCallData[drawCallIndex];
+            DrawCallData dc = LoadDrawCallData(rDrawCallData, drawCallIndex);
             MeshletData ml = rMeshletData[dc.meshletIndex];
             SubmeshData sm = rSubmeshData[ml.submeshIndex];
             uint materialNo = sm.materialIndex;
-            InterlockedAdd(sMaterialCount[materialNo], 1);
+            // materials beyond the groupshared array count directly.
+            if (materialNo < MAX_MATERIAL)
+                InterlockedAdd(sMaterialCount[materialNo], 1);
+            else
+                InterlockedAdd(rwCount[materialNo], 1);
         }
     }
     GroupMemoryBarrierWithGroupSync();
@@ -112,7 +134,7 @@ void CountCS(uint2 dtid : SV_DispatchThreadID, uint2 gtid : SV_GroupThreadID)
         {
             uint drawCallIndex, primID;
             DecodeVisibility(texVis[pixelPos], drawCallIndex, primID);
-            DrawCallData dc = rDrawCallData[drawCallIndex];
+            DrawCallData dc = LoadDrawCallData(rDrawCallData, drawCallIndex);
             MeshletData ml = rMeshletData[dc.meshletIndex];
             SubmeshData sm = rSubmeshData[ml.submeshIndex];
             uint materialNo = sm.materialIndex;
@@ -128,12 +150,11 @@ void CountCS(uint2 dtid : SV_DispatchThreadID, uint2 gtid : SV_GroupThreadID)
 #endif
 }
 
-[numthreads(32, 1, 1)]
-void CountSumCS(uint dtid : SV_DispatchThreadID)
+// exclusive scan of material counts in a single dispatch.
+[numthreads(PREFIX_SCAN_BLOCK_SIZE, 1, 1)]
+void CountSumCS(uint gtid : SV_GroupThreadID)
 {
-    if (dtid < cbBinning.numMaterials)
-    {
-    }
+    PrefixScan(gtid, cbBinning.numMaterials, false);
 }
 
 [numthreads(TILE_X, TILE_Y, 1)]
@@ -149,7 +170,7 @@ void BinningCS(uint2 dtid : SV_DispatchThreadID, uint2 gtid : SV_GroupThreadID)
         {
             uint drawCallIndex, primID;
             DecodeVisibility(texVis[pixelPos], drawCallIndex, primID);
-            DrawCallData dc = rDrawCallData[drawCallIndex];
+            DrawCallData dc = LoadDrawCallData(rDrawCallData, drawCallIndex);
             MeshletData ml = rMeshletData[dc.meshletIndex];
             SubmeshData sm = rSubmeshData[ml.submeshIndex];
             uint matIndex = sm.materialIndex;
@@ -178,7 +199,7 @@ void BinningCS(uint2 dtid : SV_DispatchThreadID, uint2 gtid : SV_GroupThreadID)
             
             uint drawCallIndex, primID;
             DecodeVisibility(texVis[pixelPos], drawCallIndex, primID);
-            DrawCallData dc = rDrawCallData[drawCallIndex];
+            DrawCallData dc = LoadDrawCallData(rDrawCallData, drawCallIndex);
             MeshletData ml = rMeshletData[dc.meshletIndex];
             SubmeshData sm = rSubmeshData[ml.submeshIndex];
             materialNo = sm.materialIndex;
@@ -215,7 +236,9 @@ void FinalizeCS(uint dtid : SV_DispatchThreadID)
         rwIndirectArg.Store(dtid * ARG_STRIDE, cnt);
     }
 }
+#endif
 
+#if TILE_BINNING
 // Tiled binnning.
 struct TileBinningCB
 {
@@ -230,48 +253,68 @@ ConstantBuffer<TileBinningCB>   cbTileBinning       : register(b0);
 RWStructuredBuffer<uint>  		rwMaterialIndex		: register(u0); // resolutionX * resolutionY
 RWStructuredBuffer<uint>		rwPixelInfo			: register(u1); // resolutionX * resolutionY
 RWStructuredBuffer<uint>        rwPixelInTiles      : register(u2); // tileMax
-RWStructuredBuffer<uint>        rwTileIndex         : register(u3); // tileMax * materialMax
+RWStructuredBuffer<uint>        rwTileIndex         : register(u3); // tileMax * listStride, compacted per material
 RWByteAddressBuffer             rwTileIndirectArg   : register(u4); // materialMax
+RWStructuredBuffer<uint>        rwTileOffset        : register(u5); // materialMax
+RWStructuredBuffer<uint>        rwTileMaterialList  : register(u6); // tileMax * listStride, sparse material list per tile
+RWStructuredBuffer<uint>        rwTileMaterialCount : register(u7); // tileMax
+RWStructuredBuffer<uint>        rwTileFill          : register(u8); // materialMax
+
+// material tile counts to offsets.
+#define SCAN_LOAD_INPUT(index)          rwTileIndirectArg.Load((index) * ARG_STRIDE)
+#define SCAN_STORE_OUTPUT(index, value) rwTileOffset[index] = value
+#define PREFIX_SCAN_STATUS_REGISTER     u9
+#define PREFIX_SCAN_COUNTER_REGISTER    u10
+#include "prefix_sum.hlsli"
 
-groupshared uint shMaterialFlag[CLASSIFY_MATERIAL_CHUNK_MAX];
 groupshared uint shPixelCount;
+groupshared uint shTileMaterialCount;
+
+// a tile can't have more materials than pixels.
+uint GetTileListStride()
+{
+    return min(cbTileBinning.numMaterials, TILE_BIN_MATERIAL_MAX);
+}
 
 void ProcessPixel(uint2 LeftTop, uint StoreBaseIndex)
 {
-    // TODO: Software VRS.
-    if (true)
+    // software VRS.
+    // only representative pixels are binned, and the gbuffer pass broadcasts them to the coarse block.
+    uint quadVrsType = GetVRSTypeFromImage(texVRS, LeftTop);
+    bool4 quadValid;
+    for (int i = 0; i < PIXEL_QUAD_WIDTH * PIXEL_QUAD_WIDTH; ++i)
     {
-        for (int y = 0; y < PIXEL_QUAD_WIDTH; ++y)
+        uint2 pixelPos = LeftTop + uint2(i % PIXEL_QUAD_WIDTH, i / PIXEL_QUAD_WIDTH);
+        quadValid[i] = all(pixelPos < cbTileBinning.screenSize) && texDepth[pixelPos] > 0.0;
+    }
+
+    for (int y = 0; y < PIXEL_QUAD_WIDTH; ++y)
+    {
+        for (int x = 0; x < PIXEL_QUAD_WIDTH; ++x)
         {
-            for (int x = 0; x < PIXEL_QUAD_WIDTH; ++x)
+            uint2 pixelPos = LeftTop + uint2(x, y);
+            [branch]
+            if (quadValid[y * PIXEL_QUAD_WIDTH + x])
             {
-                uint2 pixelPos = LeftTop + uint2(x, y);
+                uint vrsType = GetSoftwareVRSPixelType(quadVrsType, uint2(x, y), quadValid);
                 [branch]
-                if (all(pixelPos < cbTileBinning.screenSize))
+                if (vrsType != VRS_INVALID)
                 {
-                    float depth = texDepth[pixelPos];
-                    [branch]
-                    if (depth > 0.0)
-                    {
-                        uint storeIndex;
-                        InterlockedAdd(shPixelCount, 1, storeIndex);
-                        storeIndex += StoreBaseIndex;
-                        
-                        uint drawCallIndex, primID;
-                        DecodeVisibility(texVis[pixelPos], drawCallIndex, primID);
-                        DrawCallData dc = rDrawCallData[drawCallIndex];
-                        MeshletData ml = rMeshletData[dc.meshletIndex];
-                        SubmeshData sm = rSubmeshData[ml.submeshIndex];
-                        uint materialNo = sm.materialIndex;
-
-                        rwMaterialIndex[storeIndex] = materialNo;
-                        rwPixelInfo[storeIndex] = EncodePixelPos(pixelPos, 0);
-
-                        uint chunkIndex = materialNo / 32;
-                        uint chunkBit = materialNo % 32;
-                        uint orig;
-                        InterlockedOr(shMaterialFlag[chunkIndex], 0x1 << chunkBit, orig);
-                    }
+                    uint storeIndex;
+                    InterlockedAdd(shPixelCount, 1, storeIndex);
+                    storeIndex += StoreBaseIndex;
+                    
+                    uint drawCallIndex, primID;
+                    DecodeVisibility(texVis[pixelPos], drawCallIndex, primID);
+                    DrawCallData dc = LoadDrawCallData(rDrawCallData, drawCallIndex);
+                    MeshletData ml = rMeshletData[dc.meshletIndex];
+                    SubmeshData sm = rSubmeshData[ml.submeshIndex];
+                    uint materialNo = sm.materialIndex;
+
+                    rwMaterialIndex[storeIndex] = materialNo;
+                    rwPixelInfo[storeIndex] = EncodePixelPos(pixelPos, vrsType);
+
+                    MarkMaterial(materialNo);
                 }
             }
         }
@@ -284,7 +327,9 @@ void InitBinningTileCS(uint dtid : SV_DispatchThreadID)
     if (dtid < cbTileBinning.numMaterials)
     {
         rwTileIndirectArg.Store3(dtid * ARG_STRIDE, uint3(0, 1, 1));
+        rwTileFill[dtid] = 0;
     }
+    InitScanStatus(dtid, (cbTileBinning.numMaterials + PREFIX_SCAN_BLOCK_SIZE - 1) / PREFIX_SCAN_BLOCK_SIZE);
 }
 
 [numthreads(TILE_THREADS_WIDTH, TILE_THREADS_WIDTH, 1)]
@@ -292,14 +337,11 @@ void BinningTileCS(uint2 gid : SV_GroupID, uint2 gtid : SV_GroupThreadID, uint g
 {
     // clear shared memory.
     const uint kMaxThreads = TILE_THREADS_WIDTH * TILE_THREADS_WIDTH;
-    uint chunkIndex = gidx;
-    for (; chunkIndex < CLASSIFY_MATERIAL_CHUNK_MAX; chunkIndex += kMaxThreads)
-    {
-        shMaterialFlag[chunkIndex] = 0;
-    }
+    ClearMaterialMask(gidx, kMaxThreads, cbTileBinning.numMaterials);
     if (gidx == 0)
     {
         shPixelCount = 0;
+        shTileMaterialCount = 0;
     }
     GroupMemoryBarrierWithGroupSync();
 
@@ -309,32 +351,63 @@ void BinningTileCS(uint2 gid : SV_GroupID, uint2 gtid : SV_GroupThreadID, uint g
     ProcessPixel(LeftTop, TileIndex * TILE_PIXEL_WIDTH * TILE_PIXEL_WIDTH);
     GroupMemoryBarrierWithGroupSync();
 
-    // compute tile draw args.
-    chunkIndex = gidx;
-    for (; chunkIndex < CLASSIFY_MATERIAL_CHUNK_MAX; chunkIndex += kMaxThreads)
+    // store sparse material list of this tile, and count tiles per material.
+    // walk only non-empty chunks.
+    uint listBase = TileIndex * GetTileListStride();
+    for (uint maskIndex = gidx; maskIndex < CLASSIFY_CHUNK_MASK_MAX; maskIndex += kMaxThreads)
     {
-        if (shMaterialFlag[chunkIndex] != 0)
+        uint chunkBits = shChunkMask[maskIndex];
+        while (chunkBits != 0)
         {
+            uint chunkIndex = maskIndex * 32 + firstbitlow(chunkBits);
+            chunkBits &= chunkBits - 1;
+
             const uint kMatBaseIndex = chunkIndex * 32;
-            uint bits = shMaterialFlag[chunkIndex];
+            uint bits = shMaterialMask[chunkIndex];
+            uint storeIndex;
+            InterlockedAdd(shTileMaterialCount, countbits(bits), storeIndex);
             while (bits != 0)
             {
                 uint firstBit = firstbitlow(bits);
                 uint matIndex = kMatBaseIndex + firstBit;
                 bits &= ~(0x1 << firstBit);
 
-                uint argAddr = matIndex * ARG_STRIDE;
-                uint storeCount = 0;
-                rwTileIndirectArg.InterlockedAdd(argAddr, 1, storeCount);
-
-                uint storeAddr = ((matIndex * cbTileBinning.tileMax) + storeCount);
-                rwTileIndex[storeAddr] = TileIndex;
+                rwTileIndirectArg.InterlockedAdd(matIndex * ARG_STRIDE, 1);
+                rwTileMaterialList[listBase + storeIndex] = matIndex;
+                storeIndex++;
             }
         }
     }
-    // store pixel count in tile.
+    GroupMemoryBarrierWithGroupSync();
+
+    // store pixel and material count in tile.
     if (gidx == 0)
     {
         rwPixelInTiles[TileIndex] = shPixelCount;
+        rwTileMaterialCount[TileIndex] = shTileMaterialCount;
+    }
+}
+
+// exclusive scan of tile counts per material.
+[numthreads(PREFIX_SCAN_BLOCK_SIZE, 1, 1)]
+void BinningTileScanCS(uint gtid : SV_GroupThreadID)
+{
+    PrefixScan(gtid, cbTileBinning.numMaterials, false);
+}
+
+// scatter sparse tile lists into per-material tile lists.
+[numthreads(TILE_THREADS_WIDTH * TILE_THREADS_WIDTH, 1, 1)]
+void BinningTileScatterCS(uint2 gid : SV_GroupID, uint gidx : SV_GroupIndex)
+{
+    uint TileIndex = gid.y * cbTileBinning.tileCount.x + gid.x;
+    uint listBase = TileIndex * GetTileListStride();
+    uint count = rwTileMaterialCount[TileIndex];
+    for (uint i = gidx; i < count; i += TILE_THREADS_WIDTH * TILE_THREADS_WIDTH)
+    {
+        uint matIndex = rwTileMaterialList[listBase + i];
+        uint slot;
+        InterlockedAdd(rwTileFill[matIndex], 1, slot);
+        rwTileIndex[rwTileOffset[matIndex] + slot] = TileIndex;
     }
 }
+#endif
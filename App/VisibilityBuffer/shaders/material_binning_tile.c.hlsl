@@ -0,0 +1,4 @@
+#define TILE_BINNING 1
+#include "material_binning.c.hlsl"
+
+//	EOF
@@ -17,7 +17,7 @@ struct PSOutput
 Texture2D<uint>					texVis				: register(t0);
 StructuredBuffer<SubmeshData>	rSubmeshData		: register(t1);
 StructuredBuffer<MeshletData>	rMeshletData		: register(t2);
-StructuredBuffer<DrawCallData>	rDrawCallData		: register(t3);
+StructuredBuffer<DrawCallSource>	rDrawCallData		: register(t3);
 Texture2D<float>				texDepth			: register(t4);
 
 PSOutput main(PSInput In)
@@ -35,7 +35,7 @@ PSOutput main(PSInput In)
 	{
 		uint drawCallIndex, primID;
 		DecodeVisibility(texVis[pixelPos], drawCallIndex, primID);
-		DrawCallData dc = rDrawCallData[drawCallIndex];
+		DrawCallData dc = LoadDrawCallData(rDrawCallData, drawCallIndex);
 		MeshletData ml = rMeshletData[dc.meshletIndex];
 		SubmeshData sm = rSubmeshData[ml.submeshIndex];
 		Out.depth = (float)sm.materialIndex / (float)CLASSIFY_DEPTH_RANGE;
@@ -14,7 +14,7 @@ ByteAddressBuffer				rIndexBuffer	: register(t2);
 StructuredBuffer<InstanceData>	rInstanceData	: register(t3);
 StructuredBuffer<SubmeshData>	rSubmeshData	: register(t4);
 StructuredBuffer<MeshletData>	rMeshletData	: register(t5);
-StructuredBuffer<DrawCallData>	rDrawCallData	: register(t6);
+StructuredBuffer<DrawCallSource>	rDrawCallData	: register(t6);
 Texture2D<float>				texDepth		: register(t7);
 StructuredBuffer<uint>			rCount			: register(t8);
 StructuredBuffer<uint>			rOffset			: register(t9);
@@ -42,7 +42,7 @@ VertexAttr ComputeVertexAttribute(in uint2 pos, in uint vrsType, out InstanceDat
 	DecodeVisibility(vis, drawCallIndex, triIndex);
 
 	// get triangle indices.
-	DrawCallData dcData = rDrawCallData[drawCallIndex];
+	DrawCallData dcData = LoadDrawCallData(rDrawCallData, drawCallIndex);
 	InstanceData inData = rInstanceData[dcData.instanceIndex];
 	MeshletData mlData = rMeshletData[dcData.meshletIndex];
 	SubmeshData smData = rSubmeshData[mlData.submeshIndex];
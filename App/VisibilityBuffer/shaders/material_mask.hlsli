@@ -0,0 +1,43 @@
+#ifndef MATERIAL_MASK_HLSLI
+#define MATERIAL_MASK_HLSLI
+
+#include "constant_defs.h"
+
+// two-level material bitmask in groupshared memory.
+// the chunk mask has a bit per 32 materials, and the material mask of a chunk is meaningful only if its chunk bit is set.
+// walking the chunk mask first skips empty chunks, so the cost depends on the materials in the tile, not on the scene.
+groupshared uint shChunkMask[CLASSIFY_CHUNK_MASK_MAX];
+groupshared uint shMaterialMask[CLASSIFY_MATERIAL_CHUNK_MAX];
+
+uint GetMaterialChunkCount(uint numMaterials)
+{
+	return min((numMaterials + 31) / 32, CLASSIFY_MATERIAL_CHUNK_MAX);
+}
+
+void ClearMaterialMask(uint threadIndex, uint numThreads, uint numMaterials)
+{
+	uint numChunks = GetMaterialChunkCount(numMaterials);
+	for (uint i = threadIndex; i < numChunks; i += numThreads)
+	{
+		shMaterialMask[i] = 0;
+	}
+	for (uint j = threadIndex; j < CLASSIFY_CHUNK_MASK_MAX; j += numThreads)
+	{
+		shChunkMask[j] = 0;
+	}
+}
+
+void MarkMaterial(uint materialIndex)
+{
+	uint chunkIndex = materialIndex / 32;
+	uint orig;
+	InterlockedOr(shMaterialMask[chunkIndex], 0x1 << (materialIndex % 32), orig);
+	// only the first material of a chunk touches the chunk mask.
+	[branch]
+	if (orig == 0)
+	{
+		InterlockedOr(shChunkMask[chunkIndex / 32], 0x1 << (chunkIndex % 32));
+	}
+}
+
+#endif // MATERIAL_MASK_HLSLI
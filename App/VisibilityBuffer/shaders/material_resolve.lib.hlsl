@@ -18,7 +18,7 @@ ByteAddressBuffer				rIndexBuffer	: register(t2);
 StructuredBuffer<InstanceData>	rInstanceData	: register(t3);
 StructuredBuffer<SubmeshData>	rSubmeshData	: register(t4);
 StructuredBuffer<MeshletData>	rMeshletData	: register(t5);
-StructuredBuffer<DrawCallData>	rDrawCallData	: register(t6);
+StructuredBuffer<DrawCallSource>	rDrawCallData	: register(t6);
 Texture2D<float>				texDepth		: register(t7);
 StructuredBuffer<MaterialData>	rMaterialData	: register(t8);
 Texture2D						texDetail		: register(t9);
@@ -62,7 +62,7 @@ void DistributeMaterialNode(
 	}
 	uint drawCallIndex, primID;
 	DecodeVisibility(texVis[pixelPos], drawCallIndex, primID);
-	DrawCallData dc = rDrawCallData[drawCallIndex];
+	DrawCallData dc = LoadDrawCallData(rDrawCallData, drawCallIndex);
 	MeshletData ml = rMeshletData[dc.meshletIndex];
 	SubmeshData sm = rSubmeshData[ml.submeshIndex];
 	MaterialData mat = rMaterialData[sm.materialIndex];
@@ -84,7 +84,7 @@ VertexAttr ComputeVertexAttribute(in uint2 pos, out InstanceData OutInstance)
 	DecodeVisibility(vis, drawCallIndex, triIndex);
 
 	// get triangle indices.
-	DrawCallData dcData = rDrawCallData[drawCallIndex];
+	DrawCallData dcData = LoadDrawCallData(rDrawCallData, drawCallIndex);
 	InstanceData inData = rInstanceData[dcData.instanceIndex];
 	MeshletData mlData = rMeshletData[dcData.meshletIndex];
 	SubmeshData smData = rSubmeshData[mlData.submeshIndex];
@@ -1,8 +1,9 @@
-#include "constant_defs.h"
+﻿#include "constant_defs.h"
 #include "cbuffer.hlsli"
 #include "surface_gradient.hlsli"
 #include "visibility_buffer.hlsli"
 #include "math.hlsli"
+#include "vrs.hlsli"
 
 struct TileBinningCB
 {
@@ -23,7 +24,7 @@ ByteAddressBuffer				rIndexBuffer	: register(t2);
 StructuredBuffer<InstanceData>	rInstanceData	: register(t3);
 StructuredBuffer<SubmeshData>	rSubmeshData	: register(t4);
 StructuredBuffer<MeshletData>	rMeshletData	: register(t5);
-StructuredBuffer<DrawCallData>	rDrawCallData	: register(t6);
+StructuredBuffer<DrawCallSource>	rDrawCallData	: register(t6);
 Texture2D<float>				texDepth		: register(t7);
 StructuredBuffer<uint>			rMaterialIndex	: register(t8);
 StructuredBuffer<uint>			rPixelInfo		: register(t9);
@@ -34,6 +35,7 @@ Texture2D						texNormal		: register(t13);
 Texture2D						texORM			: register(t14);
 Texture2D						texEmissive		: register(t15);
 Texture2D						texDetail		: register(t16);
+StructuredBuffer<uint>			rTileOffset		: register(t17);
 
 SamplerState		samLinearWrap	: register(s0);
 
@@ -44,7 +46,7 @@ RWTexture2D<float4>	rwORM			: register(u3);
 RWTexture2D<float4>	rwNormal		: register(u4);
 
 
-VertexAttr ComputeVertexAttribute(in uint2 pos, out InstanceData OutInstance)
+VertexAttr ComputeVertexAttribute(in uint2 pos, in uint vrsType, out InstanceData OutInstance)
 {
 	// get visibility.
 	uint vis = texVis[pos];
@@ -52,7 +54,7 @@ VertexAttr ComputeVertexAttribute(in uint2 pos, out InstanceData OutInstance)
 	DecodeVisibility(vis, drawCallIndex, triIndex);
 
 	// get triangle indices.
-	DrawCallData dcData = rDrawCallData[drawCallIndex];
+	DrawCallData dcData = LoadDrawCallData(rDrawCallData, drawCallIndex);
 	InstanceData inData = rInstanceData[dcData.instanceIndex];
 	MeshletData mlData = rMeshletData[dcData.meshletIndex];
 	SubmeshData smData = rSubmeshData[mlData.submeshIndex];
@@ -61,17 +63,22 @@ VertexAttr ComputeVertexAttribute(in uint2 pos, out InstanceData OutInstance)
 	// barycentric type.
 	const uint kBaryCalcType = 1;
 
+	// coarse pixel center for software VRS.
+	float2 fpos = float2(pos);
+	if (vrsType & VRS_2x1) fpos.x += 0.5;
+	if (vrsType & VRS_1x2) fpos.y += 0.5;
+
 	VertexAttr attr;
 	if (kBaryCalcType == 0)
 	{
 		attr = GetVertexAttrFromRay(
-			rVertexBuffer, inData, smData, vertexIndices, (float2)pos,
+			rVertexBuffer, inData, smData, vertexIndices, fpos,
 			cbScene.mtxWorldToProj, cbScene.screenSize, cbScene.eyePosition);
 	}
 	else if(kBaryCalcType == 1)
 	{
 		attr = GetVertexAttrPerspectiveCorrect(
-			rVertexBuffer, inData, smData, vertexIndices, (float2)pos + 0.5,
+			rVertexBuffer, inData, smData, vertexIndices, fpos + 0.5,
 			cbScene.mtxWorldToProj, cbScene.screenSize);
 	}
 
@@ -91,12 +98,36 @@ void FeedbackMiplevel(in uint2 pos, in VertexAttr attr, in uint matIndex)
 	}
 }
 
+void WriteGBuffer(uint2 pixelPos, uint vrsType, float3 emissive, float4 bc, float3 orm, float3 normalInWS)
+{
+	// broadcast to the coarse block of software VRS.
+	// background pixels in the block are not written.
+	float4 normal = float4(normalInWS * 0.5 + 0.5, 1);
+	for (uint i = 0; i < 4; i++)
+	{
+		uint2 offset = uint2(i & 0x1, i >> 1);
+		if (offset.x > 0 && !(vrsType & VRS_2x1))
+			continue;
+		if (offset.y > 0 && !(vrsType & VRS_1x2))
+			continue;
+
+		uint2 pos = pixelPos + offset;
+		if (i > 0 && texDepth[pos] <= 0.0)
+			continue;
+
+		rwAccum[pos] = float4(emissive, 0);
+		rwColor[pos] = bc;
+		rwORM[pos] = float4(orm, 1);
+		rwNormal[pos] = normal;
+	}
+}
+
 [numthreads(TILE_PIXEL_WIDTH * TILE_PIXEL_WIDTH, 1, 1)]
 void StandardCS(uint gid : SV_GroupID, uint gtid : SV_GroupThreadID)
 {
 	const uint kMaxPixelsInTile = TILE_PIXEL_WIDTH * TILE_PIXEL_WIDTH;
 	uint matIndex = cbMaterialIndex.materialIndex;
-	uint tileIndex = rTileIndex[matIndex * cbTileBinning.tileMax + gid];
+	uint tileIndex = rTileIndex[rTileOffset[matIndex] + gid];
 	if (gtid >= rPixelInTiles[tileIndex])
 		return;
 	if (matIndex != rMaterialIndex[tileIndex * kMaxPixelsInTile + gtid])
@@ -109,7 +140,7 @@ void StandardCS(uint gid : SV_GroupID, uint gtid : SV_GroupThreadID)
 
 	// compute vertex attributes.
 	InstanceData inData;
-	VertexAttr attr = ComputeVertexAttribute(pixelPos, inData);
+	VertexAttr attr = ComputeVertexAttribute(pixelPos, vrsType, inData);
 
 	// feedback maplevel.
 	FeedbackMiplevel(pixelPos, attr, matIndex);
@@ -155,10 +186,7 @@ void StandardCS(uint gid : SV_GroupID, uint gtid : SV_GroupThreadID)
 		normalInWS = ConvertVectorTangetToWorld(normalInTS, T, B, N);
 	}
 	
-	rwAccum[pixelPos] = float4(emissive, 0);
-	rwColor[pixelPos] = float4(bc, 1);
-	rwORM[pixelPos] = float4(orm, 1);
-	rwNormal[pixelPos] = float4(normalInWS * 0.5 + 0.5, 1);
+	WriteGBuffer(pixelPos, vrsType, emissive, float4(bc, 1), orm, normalInWS);
 }
 
 [numthreads(TILE_PIXEL_WIDTH * TILE_PIXEL_WIDTH, 1, 1)]
@@ -166,7 +194,7 @@ void TriplanarCS(uint gid : SV_GroupID, uint gtid : SV_GroupThreadID)
 {
 	const uint kMaxPixelsInTile = TILE_PIXEL_WIDTH * TILE_PIXEL_WIDTH;
 	uint matIndex = cbMaterialIndex.materialIndex;
-	uint tileIndex = rTileIndex[matIndex * cbTileBinning.tileMax + gid];
+	uint tileIndex = rTileIndex[rTileOffset[matIndex] + gid];
 	if (gtid >= rPixelInTiles[tileIndex])
 		return;
 	if (matIndex != rMaterialIndex[tileIndex * kMaxPixelsInTile + gtid])
@@ -179,7 +207,7 @@ void TriplanarCS(uint gid : SV_GroupID, uint gtid : SV_GroupThreadID)
 
 	// compute vertex attributes.
 	InstanceData inData;
-	VertexAttr attr = ComputeVertexAttribute(pixelPos, inData);
+	VertexAttr attr = ComputeVertexAttribute(pixelPos, vrsType, inData);
 
 	float4 bc = float4(0.5, 0.5, 0.5, 1.0);
 	float3 orm = float3(1.0, 0.5, 0.0);
@@ -221,8 +249,5 @@ void TriplanarCS(uint gid : SV_GroupID, uint gtid : SV_GroupThreadID)
 		normalInWS = normalize(normalX.zyx * weights.x + normalY.xzy * weights.y + normalZ.xyz * weights.z);
 	}
 
-	rwAccum[pixelPos] = float4(emissive, 0);
-	rwColor[pixelPos] = bc;
-	rwORM[pixelPos] = float4(orm, 1);
-	rwNormal[pixelPos] = float4(normalInWS * 0.5 + 0.5, 1);
+	WriteGBuffer(pixelPos, vrsType, emissive, bc, orm, normalInWS);
 }
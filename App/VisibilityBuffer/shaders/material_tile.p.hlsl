@@ -18,7 +18,7 @@ ByteAddressBuffer				rIndexBuffer	: register(t2);
 StructuredBuffer<InstanceData>	rInstanceData	: register(t3);
 StructuredBuffer<SubmeshData>	rSubmeshData	: register(t4);
 StructuredBuffer<MeshletData>	rMeshletData	: register(t5);
-StructuredBuffer<DrawCallData>	rDrawCallData	: register(t6);
+StructuredBuffer<DrawCallSource>	rDrawCallData	: register(t6);
 Texture2D<float>				texDepth		: register(t7);
 Texture2D						texColor		: register(t8);
 Texture2D						texNormal		: register(t9);
@@ -50,7 +50,7 @@ PSOutput main(PSInput In)
 	DecodeVisibility(vis, drawCallIndex, triIndex);
 
 	// get triangle indices.
-	DrawCallData dcData = rDrawCallData[drawCallIndex];
+	DrawCallData dcData = LoadDrawCallData(rDrawCallData, drawCallIndex);
 	InstanceData inData = rInstanceData[dcData.instanceIndex];
 	MeshletData mlData = rMeshletData[dcData.meshletIndex];
 	SubmeshData smData = rSubmeshData[mlData.submeshIndex];
@@ -11,12 +11,13 @@ ConstantBuffer<TileCB>			cbTile		: register(b1);
 ConstantBuffer<MaterialTileCB>	cbMatTile	: register(b2);
 
 ByteAddressBuffer				rTileIndex	: register(t0);
+StructuredBuffer<uint>			rTileOffset	: register(t1);
 
 VSOutput main(uint instanceID : SV_InstanceID, uint vertexID : SV_VertexID)
 {
 	VSOutput Out = (VSOutput)0;
 
-	uint addr = cbMatTile.materialIndex * cbTile.tileMax + instanceID;
+	uint addr = rTileOffset[cbMatTile.materialIndex] + instanceID;
 	uint tileIndex = rTileIndex.Load(addr * 4);
 	uint tileX = tileIndex % cbTile.numX;
 	uint tileY = tileIndex / cbTile.numX;
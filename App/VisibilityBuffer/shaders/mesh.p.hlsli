@@ -8,10 +8,11 @@
 
 struct PSInput
 {
-	float4	position	: SV_POSITION;
-	float3	normal		: NORMAL;
-	float4	tangent		: TANGENT;
-	float2	uv			: TEXCOORD0;
+	float4					position		: SV_POSITION;
+	float3					normal			: NORMAL;
+	float4					tangent			: TANGENT;
+	float2					uv				: TEXCOORD0;
+	nointerpolation uint	materialIndex	: MATERIAL_INDEX;
 };
 
 struct PSOutput
@@ -24,7 +25,6 @@ struct PSOutput
 
 ConstantBuffer<SceneCB>		cbScene			: register(b0);
 ConstantBuffer<DetailCB>	cbDetail		: register(b1);
-ConstantBuffer<MaterialTileCB>	cbMaterialTile	: register(b0, space1);
 
 Texture2D			texColor		: register(t0);
 Texture2D			texNormal		: register(t1);
@@ -57,7 +57,7 @@ PSOutput main(PSInput In)
 	uint neededMiplevel = uint(ComputeMiplevelPS(In.uv, 4096));
 	if (all(TilePos == cbScene.feedbackIndex))
 	{
-		rwFeedback[TileIndex] = uint2(cbMaterialTile.materialIndex, neededMiplevel);
+		rwFeedback[TileIndex] = uint2(In.materialIndex, neededMiplevel);
 	}
 	
 	float3 T, B, N;
@@ -1,4 +1,5 @@
 #include "cbuffer.hlsli"
+#include "visibility_buffer.hlsli"
 
 struct VSInput
 {
@@ -10,26 +11,38 @@ struct VSInput
 
 struct VSOutput
 {
-	float4	position	: SV_POSITION;
-	float3	normal		: NORMAL;
-	float4	tangent		: TANGENT;
-	float2	uv			: TEXCOORD;
+	float4					position		: SV_POSITION;
+	float3					normal			: NORMAL;
+	float4					tangent			: TANGENT;
+	float2					uv				: TEXCOORD;
+	nointerpolation uint	materialIndex	: MATERIAL_INDEX;
 };
 
-ConstantBuffer<SceneCB>		cbScene			: register(b0);
-ConstantBuffer<MeshCB>		cbMesh			: register(b1);
+ConstantBuffer<SceneCB>			cbScene			: register(b0);
+ConstantBuffer<VisibilityCB>	cbVisibility	: register(b0, space1);
+
+// the instance is resolved from the draw call index in the root constant,
+// so draws of all instances with the same mesh and material are drawn with one ExecuteIndirect.
+// the material is passed to the pixel shader for the miplevel feedback.
+StructuredBuffer<InstanceData>		rInstanceData	: register(t0);
+StructuredBuffer<DrawCallSource>	rDrawCallData	: register(t1);
+StructuredBuffer<SubmeshData>		rSubmeshData	: register(t2);
+StructuredBuffer<MeshletData>		rMeshletData	: register(t3);
 
 VSOutput main(const VSInput In)
 {
 	VSOutput Out = (VSOutput)0;
 
-	float4x4 mtxLocalToProj = mul(cbScene.mtxWorldToProj, mul(cbMesh.mtxLocalToWorld, cbMesh.mtxBoxTransform));
+	DrawCallData dc = LoadDrawCallData(rDrawCallData, cbVisibility.drawCallIndex);
+	InstanceData instance = rInstanceData[dc.instanceIndex];
+	float4x4 mtxLocalToProj = mul(cbScene.mtxWorldToProj, mul(instance.mtxLocalToWorld, instance.mtxBoxTransform));
 
 	Out.position = mul(mtxLocalToProj, float4(In.position, 1));
-	Out.normal = normalize(mul((float3x3)cbMesh.mtxLocalToWorld, In.normal));
-	Out.tangent.xyz = normalize(mul((float3x3)cbMesh.mtxLocalToWorld, In.tangent.xyz));
+	Out.normal = normalize(mul((float3x3)instance.mtxLocalToWorld, In.normal));
+	Out.tangent.xyz = normalize(mul((float3x3)instance.mtxLocalToWorld, In.tangent.xyz));
 	Out.tangent.w = In.tangent.w;
 	Out.uv = In.uv;
+	Out.materialIndex = rSubmeshData[rMeshletData[dc.meshletIndex].submeshIndex].materialIndex;
 
 	return Out;
 }
@@ -0,0 +1,53 @@
+#include "cbuffer.hlsli"
+#include "visibility_buffer.hlsli"
+
+// gather the inputs of the meshlet alpha baker (meshlet_alpha.h) for the CPU.
+// mesh texcoords and texture texels only exist on the GPU after loading,
+// so they are copied into plain buffers here and read back.
+
+cbuffer cbBake : register(b0)
+{
+	uint	cbIndexOffset;	// bytes in the global index buffer.
+	uint	cbUVOffset;		// bytes in the global vertex buffer.
+	uint	cbIndexCount;
+	uint	cbRowPitch;		// texel row pitch in uint. (4 texels per uint)
+}
+
+ByteAddressBuffer		rVertexBuffer	: register(t0);
+ByteAddressBuffer		rIndexBuffer	: register(t1);
+Texture2D				texBaseColor	: register(t2);
+RWByteAddressBuffer		rwOutput		: register(u0);
+
+// write the texcoord of each index of the submesh. (de-indexed, 8 bytes per index)
+[numthreads(64, 1, 1)]
+void TexcoordCS(uint3 did : SV_DispatchThreadID)
+{
+	if (did.x >= cbIndexCount)
+		return;
+
+	uint index = rIndexBuffer.Load(cbIndexOffset + did.x * 4);
+	float2 uv = GetVertexTexcoord(rVertexBuffer, cbUVOffset, index);
+	rwOutput.Store2(did.x * 8, asuint(uv));
+}
+
+// write the 8bit alpha of the top mip. (4 texels per uint, rows are cbRowPitch uints)
+[numthreads(8, 8, 1)]
+void TexelCS(uint3 did : SV_DispatchThreadID)
+{
+	uint width, height;
+	texBaseColor.GetDimensions(width, height);
+	if (did.x >= cbRowPitch || did.y >= height)
+		return;
+
+	uint packed = 0;
+	[unroll]
+	for (uint i = 0; i < 4; i++)
+	{
+		uint x = min(did.x * 4 + i, width - 1);
+		float alpha = texBaseColor.Load(int3(x, did.y, 0)).a;
+		packed |= ((uint)(saturate(alpha) * 255.0 + 0.5)) << (i * 8);
+	}
+	rwOutput.Store((did.y * cbRowPitch + did.x) * 4, packed);
+}
+
+//	EOF
@@ -1,39 +1,222 @@
 #include "cbuffer.hlsli"
 #include "culling.hlsli"
+#include "visibility_buffer.hlsli"
 
+// 0 : frustum and backface culling only.
+// 1 : 1st pass of the occlusion culling. test with the previous frame's HiZ.
+// 2 : 2nd pass of the occlusion culling. retest the draw calls rejected by HiZ in the 1st pass.
+#ifndef OCC_PASS_INDEX
+#define OCC_PASS_INDEX 0
+#endif
+
+// 0 : main view.
+// 1 : shadow map. frustum culling with the shadow caster planes only.
+// 2 : shadow map. frustum culling and HiZ culling with the previous frame's shadow HiZ.
+// cbShadow is the constant of the cascade to cull, and
+// cbFrustum holds the planes of its camera frustum slice extruded along the light direction.
+#ifndef SHADOW_CULL
+#define SHADOW_CULL 0
+#endif
+
+#if SHADOW_CULL != 0
+ConstantBuffer<ShadowCB>		cbShadow		: register(b0);
+#else
 ConstantBuffer<SceneCB>			cbScene			: register(b0);
+#endif
 ConstantBuffer<FrustumCB>		cbFrustum		: register(b1);
-ConstantBuffer<MeshCB>			cbMesh			: register(b2);
-ConstantBuffer<MeshletCullCB>	cbMeshletCull	: register(b3);
+ConstantBuffer<MeshletCullCB>	cbMeshletCull	: register(b2);
+
+StructuredBuffer<InstanceData>		rInstanceData	: register(t0);
+StructuredBuffer<DrawCallSource>	rDrawCallData	: register(t1);
+StructuredBuffer<MeshletBoundData>	rMeshletBounds	: register(t2);
+StructuredBuffer<SubmeshData>		rSubmeshData	: register(t3);
+StructuredBuffer<MeshletData>		rMeshletData	: register(t4);
+ByteAddressBuffer					rIndirectArgs	: register(t5);
 
-StructuredBuffer<MeshletBound>	rMeshletBounds	: register(t0);
+#if OCC_PASS_INDEX != 0 || SHADOW_CULL == 2
+Texture2D<float>					rHiZ			: register(t6);
+#endif
+#if OCC_PASS_INDEX == 2
+ByteAddressBuffer					rDrawFlags		: register(t7);
+#endif
+#if SHADOW_CULL == 0
+// start of the draw list of each submesh, indexed by the first draw call of the submesh.
+StructuredBuffer<uint>				rDrawBuckets	: register(t8);
+#endif
 
-RWByteAddressBuffer				rwIndirectArgs	: register(u0);
+RWByteAddressBuffer				rwCompactArgs	: register(u0);
+RWByteAddressBuffer				rwDrawCounts	: register(u1);
+#if OCC_PASS_INDEX == 1
+RWByteAddressBuffer				rwDrawFlags		: register(u2);
+#endif
+#if SHADOW_CULL == 0
+RWByteAddressBuffer				rwMaskedArgs	: register(u3);
+RWByteAddressBuffer				rwMaskedCounts	: register(u4);
+#endif
+
+#if OCC_PASS_INDEX != 0
+// same test as visibility_mesh.a.hlsl.
+// meshlets crossing the near plane are not culled.
+bool IsHiZCull(in MeshletBound bound, in float4x4 mtxLocalToWorld)
+{
+	float4x4 mtxLocalToProj = mul(cbScene.mtxWorldToProj, mtxLocalToWorld);
+	float3 aabbMin, aabbMax;
+	if (ToScreenAABB(bound, mtxLocalToProj, cbScene.nearFar.x, cbScene.nearFar.y, aabbMin, aabbMax))
+	{
+		return false;
+	}
+	return IsOcclusionCull(aabbMin, aabbMax, cbScene.screenSize * 0.5, rHiZ, 5);
+}
+#endif
+
+#if SHADOW_CULL == 2
+// the light projection is orthographic, so w is always 1 and no meshlet crosses the near plane.
+bool IsShadowHiZCull(in MeshletBound bound, in float4x4 mtxLocalToWorld)
+{
+	float4x4 mtxLocalToProj = mul(cbShadow.mtxWorldToProj, mtxLocalToWorld);
+	float3 aabbMin, aabbMax;
+	ToScreenAABB(bound, mtxLocalToProj, 0.0, 0.0, aabbMin, aabbMax);
 
-[numthreads(32, 1, 1)]
+	// the shadow HiZ covers the whole cascade atlas.
+	aabbMin.xy = cbShadow.atlasRect.xy + aabbMin.xy * cbShadow.atlasRect.zw;
+	aabbMax.xy = cbShadow.atlasRect.xy + aabbMax.xy * cbShadow.atlasRect.zw;
+
+	uint hizWidth, hizHeight;
+	rHiZ.GetDimensions(hizWidth, hizHeight);
+	return IsOcclusionCull(aabbMin, aabbMax, float2(hizWidth, hizHeight), rHiZ, 5);
+}
+#endif
+
+// one thread per draw call of all instances.
+// cbMeshletCull.meshletCount is the draw call count.
+// visible draw calls are appended to the draw list of their submesh in rwCompactArgs,
+// and the count is stored at the start of the list in rwDrawCounts.
+// for the main view, the submeshes of all instances with the same mesh and material share one list (rDrawBuckets),
+// so the list is drawn with one ExecuteIndirect. shadow maps use a list per submesh of each instance.
+// the order in a list is not deterministic.
+// in the 1st occlusion pass, rwDrawFlags is 0 only for draw calls rejected by HiZ.
+// the 2nd pass retests only these draw calls with the current HiZ.
+// for the main view, visible masked draw calls are also appended to the masked draw lists of all instances
+// when cbMeshletCull.maskedListCapacity is not 0.
+// meshlets baked as fully transparent are dropped in all passes.
+[numthreads(MESHLET_CULL_GROUP_SIZE, 1, 1)]
 void main(uint3 did : SV_DispatchThreadID)
 {
 	const uint kDrawIndexedInstancedByteSize = 20;
 	const uint kRootConstByteSize = 4;
 	const uint kIndirectArgsByteSize = kRootConstByteSize + kDrawIndexedInstancedByteSize;
-	
-	if (did.x < cbMeshletCull.meshletCount)
+	const uint kDrawInstancedByteSize = 16;
+	const uint kMaskedArgsByteSize = kRootConstByteSize + kDrawInstancedByteSize;
+
+	uint drawCallIndex = did.y * (MESHLET_CULL_MAX_GROUP_X * MESHLET_CULL_GROUP_SIZE) + did.x;
+	if (drawCallIndex < cbMeshletCull.meshletCount)
 	{
-		uint meshletIndex = did.x + cbMeshletCull.meshletStartIndex;
-		uint argAddress = meshletIndex * kIndirectArgsByteSize;
-		uint rootConstAddress = argAddress;
-		argAddress += kRootConstByteSize;
+		uint argAddress = drawCallIndex * kIndirectArgsByteSize + kRootConstByteSize;
 
-		if (!IsFrustumCull(rMeshletBounds[did.x], cbFrustum.frustumPlanes, cbMesh.mtxLocalToWorld)
-			&& !IsBackfaceCull(rMeshletBounds[did.x], cbScene.eyePosition.xyz, cbMesh.mtxLocalToWorld))
+		// skip empty args. (removed instances)
+		uint4 drawArgs = rIndirectArgs.Load4(argAddress);
+		if (drawArgs.x == 0)
 		{
-			// root constant.
-			rwIndirectArgs.Store(rootConstAddress, meshletIndex);
+#if OCC_PASS_INDEX == 1
+			rwDrawFlags.Store(drawCallIndex * 4, 1);
+#endif
+			return;
+		}
+#if OCC_PASS_INDEX == 2
+		if (rDrawFlags.Load(drawCallIndex * 4) != 0)
+		{
+			return;
+		}
+#endif
+
+		DrawCallData dc = LoadDrawCallData(rDrawCallData, drawCallIndex);
+		MeshletData mlData = rMeshletData[dc.meshletIndex];
+
+		// skip meshlets whose texels are all discarded by the alpha test.
+		if (mlData.alphaClass == MESHLET_ALPHA_TRANSPARENT)
+		{
+#if OCC_PASS_INDEX == 1
+			rwDrawFlags.Store(drawCallIndex * 4, 1);
+#endif
+			return;
+		}
+
+		InstanceData instance = rInstanceData[dc.instanceIndex];
+#if SHADOW_CULL == 0
+		if (instance.flags & INSTANCE_FLAG_OCCLUDED)
+		{
+#if OCC_PASS_INDEX == 1
+			rwDrawFlags.Store(drawCallIndex * 4, 1);
+#endif
+			return;
+		}
+#endif
+
+		MeshletBound bound = LoadMeshletBound(rMeshletBounds[dc.meshletIndex], instance.mtxBoxTransform);
+		bool visible = false;
+#if SHADOW_CULL != 0
+		// no backface culling. the shadow map is rendered without face culling.
+		visible = !IsFrustumCull(bound, cbFrustum.frustumPlanes, instance.mtxLocalToWorld);
+#if SHADOW_CULL == 2
+		visible = visible && !IsShadowHiZCull(bound, instance.mtxLocalToWorld);
+#endif
+#elif OCC_PASS_INDEX == 0
+		visible = !IsFrustumCull(bound, cbFrustum.frustumPlanes, instance.mtxLocalToWorld)
+			&& !IsBackfaceCull(bound, cbScene.eyePosition.xyz, instance.mtxLocalToWorld);
+#elif OCC_PASS_INDEX == 1
+		bool nonOccCull = false;
+		if (!IsFrustumCull(bound, cbFrustum.frustumPlanes, instance.mtxLocalToWorld)
+			&& !IsBackfaceCull(bound, cbScene.eyePosition.xyz, instance.mtxLocalToWorld))
+		{
+			visible = !IsHiZCull(bound, instance.mtxLocalToWorld);
 		}
 		else
 		{
-			// disable meshlet.
-			rwIndirectArgs.Store(argAddress, 0);
+			nonOccCull = true;
+		}
+
+		rwDrawFlags.Store(drawCallIndex * 4, (visible || nonOccCull) ? 1 : 0);
+#else
+		visible = !IsHiZCull(bound, instance.mtxLocalToWorld);
+#endif
+		if (visible)
+		{
+			// first draw call of the submesh.
+			uint submeshIndex = mlData.submeshIndex;
+			uint segmentStart = drawCallIndex - (dc.meshletIndex - rSubmeshData[submeshIndex].meshletOffset);
+#if SHADOW_CULL == 0
+			uint listStart = rDrawBuckets[segmentStart];
+#else
+			uint listStart = segmentStart;
+#endif
+
+			// append.
+			uint slot;
+			rwDrawCounts.InterlockedAdd(listStart * 4, 1, slot);
+			uint dstAddress = (listStart + slot) * kIndirectArgsByteSize;
+
+			// root constant.
+			rwCompactArgs.Store(dstAddress, drawCallIndex);
+			// draw indexed args.
+			rwCompactArgs.Store4(dstAddress + kRootConstByteSize, drawArgs);
+			rwCompactArgs.Store(dstAddress + kRootConstByteSize + 16, rIndirectArgs.Load(argAddress + 16));
+
+#if SHADOW_CULL == 0
+			uint submeshFlags = rSubmeshData[submeshIndex].flags;
+			if (cbMeshletCull.maskedListCapacity > 0 && (submeshFlags & SUBMESH_FLAG_MASKED))
+			{
+				uint listIndex = (submeshFlags & SUBMESH_FLAG_DOUBLE_SIDED) ? 1 : 0;
+				listIndex += (mlData.alphaClass == MESHLET_ALPHA_OPAQUE) ? 2 : 0;
+				uint maskedSlot;
+				rwMaskedCounts.InterlockedAdd(listIndex * 4, 1, maskedSlot);
+				uint maskedAddress = (listIndex * cbMeshletCull.maskedListCapacity + maskedSlot) * kMaskedArgsByteSize;
+
+				// root constant.
+				rwMaskedArgs.Store(maskedAddress, drawCallIndex);
+				// draw instanced args. vertices are pulled with the meshlet indices in the vertex shader.
+				rwMaskedArgs.Store4(maskedAddress + kRootConstByteSize, uint4(drawArgs.x, 1, 0, 0));
+			}
+#endif
 		}
 	}
-}
\ No newline at end of file
+}
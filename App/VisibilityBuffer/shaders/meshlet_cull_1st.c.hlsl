@@ -0,0 +1,4 @@
+#define OCC_PASS_INDEX 1
+#include "meshlet_cull.c.hlsl"
+
+//	EOF
@@ -0,0 +1,4 @@
+#define OCC_PASS_INDEX 2
+#include "meshlet_cull.c.hlsl"
+
+//	EOF
@@ -0,0 +1,4 @@
+#define SHADOW_CULL 2
+#include "meshlet_cull.c.hlsl"
+
+//	EOF
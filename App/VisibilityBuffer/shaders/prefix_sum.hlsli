@@ -0,0 +1,263 @@
+#ifndef PREFIX_SUM_HLSLI
+#define PREFIX_SUM_HLSLI
+
+#include "constant_defs.h"
+
+// Single-pass prefix scan with decoupled look-back.
+// Each thread group takes its block index from an atomic counter, so a block only waits for blocks that already started.
+// A block publishes its own sum first and then looks back over the previous blocks until it finds an inclusive prefix.
+//
+// The includer defines before including this file
+//   PREFIX_SCAN_STATUS_REGISTER     : register of the look-back status buffer. (one per block)
+//   PREFIX_SCAN_COUNTER_REGISTER    : register of the block counter buffer. (one element)
+//   SCAN_LOAD_INPUT(index)          : returns ScanValue.
+//   SCAN_STORE_OUTPUT(index, value)
+//   SCAN_LOAD_KEY(index)            : returns uint. (SCAN_SEGMENTED only)
+//
+// SCAN_U64       : 64bit values.
+// SCAN_SEGMENTED : the scan restarts at items whose key differs from the previous item.
+//
+// Wave size must be 16 or more, so that all wave sums in a block are scanned by one wave.
+
+#ifndef SCAN_U64
+#define SCAN_U64 0
+#endif
+#ifndef SCAN_SEGMENTED
+#define SCAN_SEGMENTED 0
+#endif
+
+#if SCAN_U64
+typedef uint64_t ScanValue;
+uint2 PackScanValue(ScanValue v)
+{
+    return uint2((uint)v, (uint)(v >> 32));
+}
+ScanValue UnpackScanValue(uint2 v)
+{
+    return (uint64_t)v.x | ((uint64_t)v.y << 32);
+}
+#else
+typedef uint ScanValue;
+uint2 PackScanValue(ScanValue v)
+{
+    return uint2(v, 0);
+}
+ScanValue UnpackScanValue(uint2 v)
+{
+    return v.x;
+}
+#endif
+
+#define SCAN_STATE_NONE         0
+#define SCAN_STATE_AGGREGATE    1   // aggregate is valid.
+#define SCAN_STATE_PREFIX       2   // inclusive is valid.
+
+// aggregate and inclusive are separate fields, so a reader never mixes up the two values while the state is upgraded.
+struct PrefixScanStatus
+{
+    uint2   aggregate;      // sum of this block. (sum after the last segment head if the block has one)
+    uint2   inclusive;      // sum up to the end of this block.
+    uint    state;
+    uint    pad;
+};
+
+globallycoherent RWStructuredBuffer<PrefixScanStatus>	rwScanStatus	: register(PREFIX_SCAN_STATUS_REGISTER);
+RWStructuredBuffer<uint>								rwScanCounter	: register(PREFIX_SCAN_COUNTER_REGISTER);
+
+#define SCAN_MAX_WAVES (PREFIX_SCAN_BLOCK_SIZE / 16)
+
+groupshared ScanValue   gsScanWaveSums[SCAN_MAX_WAVES];
+groupshared ScanValue   gsScanAggregate;
+groupshared ScanValue   gsScanCarry;
+groupshared uint        gsScanBlockIndex;
+groupshared uint        gsScanHasHead;
+#if SCAN_SEGMENTED
+groupshared ScanValue   gsScanExclusive[PREFIX_SCAN_BLOCK_SIZE];
+groupshared int         gsScanWaveHeads[SCAN_MAX_WAVES];
+#endif
+
+// clear the look-back status. dispatch at least numBlocks threads before the scan.
+void InitScanStatus(uint dtid, uint numBlocks)
+{
+    if (dtid == 0)
+    {
+        rwScanCounter[0] = 0;
+    }
+    if (dtid < numBlocks)
+    {
+        PrefixScanStatus status = (PrefixScanStatus)0;
+        rwScanStatus[dtid] = status;
+    }
+}
+
+void PublishScanStatus(uint blockIndex, ScanValue value, uint state)
+{
+    if (state == SCAN_STATE_PREFIX)
+    {
+        rwScanStatus[blockIndex].inclusive = PackScanValue(value);
+    }
+    else
+    {
+        rwScanStatus[blockIndex].aggregate = PackScanValue(value);
+    }
+    DeviceMemoryBarrier();
+    rwScanStatus[blockIndex].state = state;
+}
+
+// sum of all items before blockIndex. (after the last segment head for segmented scan)
+ScanValue LookBack(uint blockIndex)
+{
+    ScanValue carry = 0;
+    int look = (int)blockIndex - 1;
+    [loop]
+    while (look >= 0)
+    {
+        uint state = rwScanStatus[look].state;
+        if (state == SCAN_STATE_NONE)
+        {
+            // spin lock.
+            continue;
+        }
+        DeviceMemoryBarrier();
+        if (state == SCAN_STATE_PREFIX)
+        {
+            carry += UnpackScanValue(rwScanStatus[look].inclusive);
+            break;
+        }
+        carry += UnpackScanValue(rwScanStatus[look].aggregate);
+        look--;
+    }
+    return carry;
+}
+
+// scan PREFIX_SCAN_BLOCK_SIZE items per group.
+// dispatch (numItems + PREFIX_SCAN_BLOCK_SIZE - 1) / PREFIX_SCAN_BLOCK_SIZE groups of PREFIX_SCAN_BLOCK_SIZE threads.
+void PrefixScan(uint gtid, uint numItems, bool bInclusive)
+{
+    if (gtid == 0)
+    {
+        uint oldValue;
+        InterlockedAdd(rwScanCounter[0], 1, oldValue);
+        gsScanBlockIndex = oldValue;
+    }
+    GroupMemoryBarrierWithGroupSync();
+
+    uint blockIndex = gsScanBlockIndex;
+    uint index = blockIndex * PREFIX_SCAN_BLOCK_SIZE + gtid;
+    bool bValid = index < numItems;
+    ScanValue value = bValid ? SCAN_LOAD_INPUT(index) : 0;
+
+    uint laneCount = WaveGetLaneCount();
+    uint laneIndex = WaveGetLaneIndex();
+    uint waveIndex = gtid / laneCount;
+    uint numWaves = PREFIX_SCAN_BLOCK_SIZE / laneCount;
+
+    // scan in wave.
+    ScanValue wavePrefix = WavePrefixSum(value);
+    ScanValue waveSum = WaveActiveSum(value);
+    if (laneIndex == 0)
+    {
+        gsScanWaveSums[waveIndex] = waveSum;
+    }
+#if SCAN_SEGMENTED
+    // segment heads in wave.
+    bool bHead = bValid && (index == 0 || SCAN_LOAD_KEY(index) != SCAN_LOAD_KEY(index - 1));
+    uint4 headMask = WaveActiveBallot(bHead);
+    int waveHead = -1;
+    for (int c = (int)(laneIndex / 32); c >= 0; c--)
+    {
+        uint bits = headMask[c];
+        if (c == (int)(laneIndex / 32))
+        {
+            bits &= (2u << (laneIndex % 32)) - 1;
+        }
+        if (bits != 0)
+        {
+            waveHead = c * 32 + firstbithigh(bits);
+            break;
+        }
+    }
+    if (laneIndex == laneCount - 1)
+    {
+        gsScanWaveHeads[waveIndex] = (waveHead >= 0) ? (int)(waveIndex * laneCount) + waveHead : -1;
+    }
+    if (waveHead >= 0)
+    {
+        waveHead += waveIndex * laneCount;
+    }
+#endif
+    GroupMemoryBarrierWithGroupSync();
+
+    // scan wave sums.
+    if (waveIndex == 0)
+    {
+        ScanValue s = (laneIndex < numWaves) ? gsScanWaveSums[laneIndex] : 0;
+        ScanValue ps = WavePrefixSum(s);
+        if (laneIndex < numWaves)
+        {
+            gsScanWaveSums[laneIndex] = ps;
+        }
+    }
+    GroupMemoryBarrierWithGroupSync();
+
+    ScanValue exclusive = gsScanWaveSums[waveIndex] + wavePrefix;
+
+#if SCAN_SEGMENTED
+    gsScanExclusive[gtid] = exclusive;
+
+    // the nearest head in previous waves.
+    int head = waveHead;
+    for (int w = (int)waveIndex - 1; head < 0 && w >= 0; w--)
+    {
+        head = gsScanWaveHeads[w];
+    }
+    GroupMemoryBarrierWithGroupSync();
+
+    bool bInSegment = head >= 0;
+    if (bInSegment)
+    {
+        exclusive -= gsScanExclusive[head];
+    }
+#else
+    bool bInSegment = false;
+#endif
+
+    if (gtid == PREFIX_SCAN_BLOCK_SIZE - 1)
+    {
+        gsScanAggregate = exclusive + value;
+        gsScanHasHead = bInSegment ? 1 : 0;
+    }
+    GroupMemoryBarrierWithGroupSync();
+
+    // decoupled look-back.
+    if (gtid == 0)
+    {
+        ScanValue aggregate = gsScanAggregate;
+        bool bHasHead = gsScanHasHead != 0;
+        // the inclusive prefix of a block with a segment head does not depend on previous blocks.
+        bool bPrefixReady = blockIndex == 0 || bHasHead;
+        PublishScanStatus(blockIndex, aggregate, bPrefixReady ? SCAN_STATE_PREFIX : SCAN_STATE_AGGREGATE);
+
+        ScanValue carry = LookBack(blockIndex);
+        if (!bPrefixReady)
+        {
+            PublishScanStatus(blockIndex, carry + aggregate, SCAN_STATE_PREFIX);
+        }
+        gsScanCarry = carry;
+    }
+    GroupMemoryBarrierWithGroupSync();
+
+    // output.
+    if (bValid)
+    {
+        ScanValue result = exclusive + (bInSegment ? 0 : gsScanCarry);
+        if (bInclusive)
+        {
+            result += value;
+        }
+        SCAN_STORE_OUTPUT(index, result);
+    }
+}
+
+#endif // PREFIX_SUM_HLSLI
+//  EOF
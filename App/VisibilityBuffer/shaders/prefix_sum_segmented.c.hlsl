@@ -0,0 +1,2 @@
+#define SCAN_SEGMENTED 1
+#include "prefix_sum.c.hlsl"
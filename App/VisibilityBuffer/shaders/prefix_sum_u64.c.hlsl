@@ -0,0 +1,2 @@
+#define SCAN_U64 1
+#include "prefix_sum.c.hlsl"
@@ -1,4 +1,5 @@
 #include "cbuffer.hlsli"
+#include "visibility_buffer.hlsli"
 
 struct VSInput
 {
@@ -15,18 +16,24 @@ struct VSOutput
 	float3	posInWS		: POS_IN_WS;
 };
 
-ConstantBuffer<SceneCB>		cbScene			: register(b0);
-ConstantBuffer<MeshCB>		cbMesh			: register(b1);
+ConstantBuffer<SceneCB>			cbScene			: register(b0);
+ConstantBuffer<VisibilityCB>	cbVisibility	: register(b0, space1);
+
+// the instance is resolved from the draw call index in the root constant. (same as mesh.vv.hlsl)
+StructuredBuffer<InstanceData>		rInstanceData	: register(t0);
+StructuredBuffer<DrawCallSource>	rDrawCallData	: register(t1);
 
 VSOutput main(const VSInput In)
 {
 	VSOutput Out = (VSOutput)0;
 
-	float4x4 mtxLocalToProj = mul(cbScene.mtxWorldToProj, mul(cbMesh.mtxLocalToWorld, cbMesh.mtxBoxTransform));
+	DrawCallData dc = LoadDrawCallData(rDrawCallData, cbVisibility.drawCallIndex);
+	InstanceData instance = rInstanceData[dc.instanceIndex];
+	float4x4 mtxLocalToProj = mul(cbScene.mtxWorldToProj, mul(instance.mtxLocalToWorld, instance.mtxBoxTransform));
 
 	Out.position = mul(mtxLocalToProj, float4(In.position, 1));
-	Out.normal = normalize(mul((float3x3)cbMesh.mtxLocalToWorld, In.normal));
-	Out.posInWS = mul(cbMesh.mtxLocalToWorld, float4(In.position, 1)).xyz;
+	Out.normal = normalize(mul((float3x3)instance.mtxLocalToWorld, In.normal));
+	Out.posInWS = mul(instance.mtxLocalToWorld, float4(In.position, 1)).xyz;
 
 	return Out;
 }
@@ -1,9 +1,48 @@
 #ifndef VISIBILITY_BUFFER_HLSLI
 #define VISIBILITY_BUFFER_HLSLI
 
+#include "constant_defs.h"
 #include "cbuffer.hlsli"
 #include "math.hlsli"
 
+#if DRAWCALL_PREFIX_TABLE
+typedef DrawCallRange	DrawCallSource;
+#else
+typedef DrawCallData	DrawCallSource;
+#endif
+
+// resolve instance and meshlet from draw call index.
+DrawCallData LoadDrawCallData(in StructuredBuffer<DrawCallSource> rDrawCallSource, in uint DrawCallIndex)
+{
+#if DRAWCALL_PREFIX_TABLE
+	// binary search the last range with argStart <= DrawCallIndex.
+	uint count, stride;
+	rDrawCallSource.GetDimensions(count, stride);
+	uint lo = 0;
+	uint hi = count;
+	while (hi - lo > 1)
+	{
+		uint mid = (lo + hi) / 2;
+		if (rDrawCallSource[mid].argStart <= DrawCallIndex)
+		{
+			lo = mid;
+		}
+		else
+		{
+			hi = mid;
+		}
+	}
+	DrawCallRange range = rDrawCallSource[lo];
+
+	DrawCallData ret;
+	ret.instanceIndex = range.instanceIndex;
+	ret.meshletIndex = range.meshletStart + (DrawCallIndex - range.argStart);
+	return ret;
+#else
+	return rDrawCallSource[DrawCallIndex];
+#endif
+}
+
 uint EncodeVisibility(in uint DrawCallIndex, in uint PrimID)
 {
 	return ((DrawCallIndex & 0xffffff) << 8) | (PrimID & 0xff); 
@@ -11,7 +11,7 @@ ConstantBuffer<FrustumCB>		cbFrustum		: register(b1);
 ConstantBuffer<MeshCB>			cbMesh			: register(b2);
 ConstantBuffer<MeshletCullCB>	cbMeshletCull	: register(b3);
 
-StructuredBuffer<MeshletBound>	rMeshletBounds	: register(t0);
+StructuredBuffer<MeshletBoundData>	rMeshletBounds	: register(t0);
 Texture2D<float>				rHiZ			: register(t1);
 ByteAddressBuffer				rDrawFlags		: register(t2);
 
@@ -28,7 +28,7 @@ void main(uint gtid : SV_GroupThreadID, uint gid : SV_GroupID, uint dtid : SV_Di
 	uint globalMeshletIndex = meshletIndex + cbMeshletCull.meshletStartIndex;
 	if (dtid < cbMeshletCull.meshletCount)
 	{
-		MeshletBound bound = rMeshletBounds[meshletIndex];
+		MeshletBound bound = LoadMeshletBound(rMeshletBounds[meshletIndex], cbMesh.mtxBoxTransform);
 		
 #if  OCC_PASS_INDEX == 1
 		if (!IsFrustumCull(bound, cbFrustum.frustumPlanes, cbMesh.mtxLocalToWorld)
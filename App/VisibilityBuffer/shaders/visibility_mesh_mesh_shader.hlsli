@@ -28,7 +28,7 @@ ByteAddressBuffer				rVertexBuffer	: register(t0);
 ByteAddressBuffer				rIndexBuffer	: register(t1);
 StructuredBuffer<SubmeshData>	rSubmeshData	: register(t2);
 StructuredBuffer<MeshletData>	rMeshletData	: register(t3);
-StructuredBuffer<DrawCallData>	rDrawCallData	: register(t4);
+StructuredBuffer<DrawCallSource>	rDrawCallData	: register(t4);
 
 bool BackFaceCull(float3 ClipPos0, float3 ClipPos1, float3 ClipPos2)
 {
@@ -59,7 +59,7 @@ void main(
 )
 {
 	uint globalMeshletIndex = payload.MeshletIndices[gid];
-	DrawCallData dcData = rDrawCallData[globalMeshletIndex];
+	DrawCallData dcData = LoadDrawCallData(rDrawCallData, globalMeshletIndex);
 	MeshletData mlData = rMeshletData[dcData.meshletIndex];
 	SubmeshData smData = rSubmeshData[mlData.submeshIndex];
 	uint vcount = mlData.meshletVertexIndexCount;
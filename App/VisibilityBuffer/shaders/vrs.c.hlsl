@@ -14,7 +14,7 @@ Texture2D<uint>					texVis				: register(t1);
 Texture2D<float>				texDepth			: register(t2);
 StructuredBuffer<SubmeshData>	rSubmeshData		: register(t3);
 StructuredBuffer<MeshletData>	rMeshletData		: register(t4);
-StructuredBuffer<DrawCallData>	rDrawCallData		: register(t5);
+StructuredBuffer<DrawCallSource>	rDrawCallData		: register(t5);
 
 // reprojection
 Texture2D<uint>                 texPrevOutput       : register(t0);
@@ -36,7 +36,7 @@ int GetMaterialID(uint vis, float depth)
     
     uint drawCallIndex, primID;
     DecodeVisibility(vis, drawCallIndex, primID);
-    DrawCallData dc = rDrawCallData[drawCallIndex];
+    DrawCallData dc = LoadDrawCallData(rDrawCallData, drawCallIndex);
     MeshletData ml = rMeshletData[dc.meshletIndex];
     SubmeshData sm = rSubmeshData[ml.submeshIndex];
     return sm.materialIndex;
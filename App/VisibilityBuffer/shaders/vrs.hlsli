@@ -24,4 +24,16 @@ uint GetVRSTypeFromImage(Texture2D<uint> tex, uint2 fullScreenPixelPos)
     return vrsValue == VRS_INVALID ? VRS_1x1 : vrsValue;
 }
 
+// software VRS in a 2x2 pixel quad. a quad has a single VRS value.
+// the top-left pixel of each coarse block shades the whole block, and a pixel whose representative is background shades itself.
+// returns VRS_INVALID if the pixel is shaded by its representative.
+uint GetSoftwareVRSPixelType(uint quadVrsType, uint2 posInQuad, bool4 quadValid)
+{
+    uint2 rep = posInQuad;
+    if (quadVrsType & VRS_2x1) rep.x = 0;
+    if (quadVrsType & VRS_1x2) rep.y = 0;
+    if (all(rep == posInQuad)) return quadVrsType;
+    return quadValid[rep.y * 2 + rep.x] ? VRS_INVALID : VRS_1x1;
+}
+
 #endif
@@ -0,0 +1,50 @@
+#include "cbuffer.hlsli"
+
+ConstantBuffer<SceneCB>				cbScene				: register(b0);
+ConstantBuffer<ShadowCB>			cbShadow			: register(b1);
+
+Texture2D<float>					texDepth			: register(t0);
+
+RWByteAddressBuffer					rwPageRequest		: register(u0);
+
+[numthreads(8, 8, 1)]
+void main(
+	uint3 gid : SV_GroupID,
+	uint3 gtid : SV_GroupThreadID,
+	uint3 did : SV_DispatchThreadID)
+{
+	uint2 pixelPos = did.xy;
+	if (any(pixelPos >= (uint2)cbScene.screenSize))
+	{
+		return;
+	}
+
+	float depth = texDepth[pixelPos];
+	if (depth <= 0.0)
+	{
+		return;
+	}
+
+	// get world position.
+	float2 screenPos = ((float2)pixelPos + 0.5) / cbScene.screenSize;
+	float2 clipSpacePos = screenPos * float2(2, -2) + float2(-1, 1);
+	float4 worldPos = mul(cbScene.mtxProjToWorld, float4(clipSpacePos, depth, 1));
+	worldPos.xyz /= worldPos.w;
+
+	// get virtual page.
+	float4 vsmPos = mul(cbShadow.mtxWorldToVirtual, float4(worldPos.xyz, 1));
+	float2 vsmUV = vsmPos.xy * float2(0.5, -0.5) + 0.5;
+	if (any(vsmUV < 0.0) || any(vsmUV >= 1.0))
+	{
+		return;
+	}
+	uint2 page = (uint2)(vsmUV * VSM_PAGE_COUNT_X);
+	uint pageIndex = page.y * VSM_PAGE_COUNT_X + page.x;
+
+	// neighbor pixels usually request the same page, so issue one atomic per wave in that case.
+	if (WaveActiveAllEqual(pageIndex) && !WaveIsFirstLane())
+	{
+		return;
+	}
+	rwPageRequest.InterlockedOr((pageIndex / 32) * 4, 0x1u << (pageIndex % 32));
+}
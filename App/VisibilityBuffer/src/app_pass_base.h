@@ -1,6 +1,7 @@
 ﻿#pragma once
 
 #include "sl12/render_graph.h"
+#include <chrono>
 
 struct RenderPassSetupDesc;
 
@@ -8,15 +9,21 @@ enum class AppPassType
 {
 	MeshletArgCopy,
 	MeshletCulling,
+	MeshletCulling2nd,
 	ClearMiplevel,
 	FeedbackMiplevel,
 	DepthPre,
 	GBuffer,
 	MotionVector,
 	VisibilityVs,
+	VisibilityVs2nd,
 	VisibilityMs1st,
 	VisibilityMs2nd,
+	ShadowCulling,
+	ShadowCacheCopy,
 	ShadowMap,
+	ShadowHiZ,
+	VirtualShadowRequest,
 	ShadowExp,
 	ShadowBlurX,
 	ShadowBlurY,
@@ -74,8 +81,23 @@ public:
 		return AppPassType::Invalid;
 	}
 
+	// 設定値のみを保持すること
+	// レンダーグラフのシミュレーションでも一時的に設定を差し替えるので、履歴などの状態は変更しない
 	virtual void SetPassSettings(const RenderPassSetupDesc& desc)
 	{}
+	// レンダーグラフを作り直した時のみ呼ばれる
+	// 前フレームの結果を使うパスは、ここで履歴を破棄する
+	virtual void ResetHistory()
+	{}
+
+	// 他のパスと共有する状態を更新するCPU処理 (ルートシグネチャの作り直しなど)
+	// PrepareExecuteの前に、直列に呼ばれる
+	virtual void PrepareSerial(const sl12::RenderPassID& ID)
+	{}
+	// コマンドリストを使わないCPU処理 (描画リストの作成など)
+	// コマンドの記録前に、他のパスと並列に呼ばれる
+	virtual void PrepareExecute(const sl12::RenderPassID& ID)
+	{}
 
 protected:
 	sl12::Device* pDevice_;
@@ -83,4 +105,50 @@ protected:
 	class Scene* pScene_;
 };
 
+//----
+// コマンド記録のCPU時間を計測するラッパー
+// レンダーグラフにはこちらを登録し、処理は元のパスに転送する
+class AppPassRecorder : public sl12::IRenderPass
+{
+public:
+	AppPassRecorder(AppPassBase* pPass)
+		: pPass_(pPass)
+	{}
+	virtual ~AppPassRecorder() {}
+
+	virtual std::vector<sl12::TransientResource> GetInputResources(const sl12::RenderPassID& ID) const override
+	{
+		return pPass_->GetInputResources(ID);
+	}
+	virtual std::vector<sl12::TransientResource> GetOutputResources(const sl12::RenderPassID& ID) const override
+	{
+		return pPass_->GetOutputResources(ID);
+	}
+	virtual sl12::HardwareQueue::Value GetExecuteQueue() const
+	{
+		return pPass_->GetExecuteQueue();
+	}
+	virtual void Execute(sl12::CommandList* pCmdList, sl12::TransientResourceManager* pResManager, const sl12::RenderPassID& ID) override
+	{
+		auto start = std::chrono::high_resolution_clock::now();
+		pPass_->Execute(pCmdList, pResManager, ID);
+		auto end = std::chrono::high_resolution_clock::now();
+		recordMicroSec_ += std::chrono::duration<double, std::micro>(end - start).count();
+	}
+
+	// 直近のLoadCommandで記録にかかった時間
+	double GetRecordMicroSec() const
+	{
+		return recordMicroSec_;
+	}
+	void ResetRecordMicroSec()
+	{
+		recordMicroSec_ = 0.0;
+	}
+
+private:
+	AppPassBase*	pPass_;
+	double			recordMicroSec_ = 0.0;
+};
+
 //	EOF
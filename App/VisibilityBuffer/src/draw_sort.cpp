@@ -0,0 +1,80 @@
+﻿#include "draw_sort.h"
+
+#include <algorithm>
+
+
+//----
+sl12::u64 MakeDrawSortKey(sl12::u32 psoIndex, sl12::u32 materialIndex, sl12::u32 meshIndex, sl12::u32 instanceIndex)
+{
+	return ((sl12::u64)(psoIndex & 0xf) << 60)
+		| ((sl12::u64)(materialIndex & 0xfffff) << 40)
+		| ((sl12::u64)(meshIndex & 0xfffff) << 20)
+		| (sl12::u64)(instanceIndex & 0xfffff);
+}
+
+//----
+void SortDrawItems(DrawSortItem* pItems, size_t count)
+{
+	// 引数バッファの位置は元の順番で増えていくので、キーが等しい場合は元の順番になる
+	std::sort(pItems, pItems + count, [](const DrawSortItem& a, const DrawSortItem& b)
+		{
+			return (a.key != b.key) ? (a.key < b.key) : (a.argIndex < b.argIndex);
+		});
+}
+
+//----
+sl12::u32 GetDrawStateChange(const DrawSortItem* pPrev, const DrawSortItem& curr, bool bInstanceDescriptor)
+{
+	if (!pPrev)
+	{
+		return kDrawStatePso | kDrawStateDescriptor | kDrawStateVertexBuffer;
+	}
+
+	sl12::u32 ret = 0;
+	if (pPrev->psoIndex != curr.psoIndex)
+	{
+		ret |= kDrawStatePso;
+	}
+	if (pPrev->materialIndex != curr.materialIndex || (bInstanceDescriptor && pPrev->instanceIndex != curr.instanceIndex))
+	{
+		ret |= kDrawStateDescriptor;
+	}
+	if (pPrev->meshIndex != curr.meshIndex || pPrev->vertexLayout != curr.vertexLayout)
+	{
+		ret |= kDrawStateVertexBuffer;
+	}
+	return ret;
+}
+
+//----
+void AddDrawStateChange(sl12::u32 changeFlags, DrawStateStats& stats)
+{
+	stats.psoChanges += (changeFlags & kDrawStatePso) ? 1 : 0;
+	stats.descriptorChanges += (changeFlags & kDrawStateDescriptor) ? 1 : 0;
+	stats.vertexBufferChanges += (changeFlags & kDrawStateVertexBuffer) ? 1 : 0;
+	stats.executeCount++;
+}
+
+//----
+void AddDrawStateStats(const DrawStateStats& src, DrawStateStats& dst)
+{
+	dst.psoChanges += src.psoChanges;
+	dst.descriptorChanges += src.descriptorChanges;
+	dst.vertexBufferChanges += src.vertexBufferChanges;
+	dst.executeCount += src.executeCount;
+}
+
+//----
+DrawStateStats CountDrawStateChanges(const DrawSortItem* pItems, size_t count, bool bInstanceDescriptor)
+{
+	DrawStateStats stats;
+	const DrawSortItem* pPrev = nullptr;
+	for (size_t i = 0; i < count; i++)
+	{
+		AddDrawStateChange(GetDrawStateChange(pPrev, pItems[i], bInstanceDescriptor), stats);
+		pPrev = pItems + i;
+	}
+	return stats;
+}
+
+//	EOF
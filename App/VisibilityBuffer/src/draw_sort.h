@@ -0,0 +1,58 @@
+﻿#pragma once
+
+#include "sl12/types.h"
+#include <vector>
+
+
+//----
+// ソートキーによる描画順の構築
+// インスタンス順ではなく、パイプライン → マテリアル → メッシュ → インスタンスの順に並べて
+// パイプラインとディスクリプタの切り替えを減らす
+// D3D12に依存しないので、アプリケーション外でも実行できる
+
+// 1回のExecuteIndirect (MeshletResourceの描画リスト単位の描画範囲)
+struct DrawSortItem
+{
+	sl12::u64	key = 0;
+	sl12::u32	psoIndex = 0;
+	sl12::u32	materialIndex = 0;		// ディスクリプタに影響しない場合は全て同じ値にする
+	sl12::u32	meshIndex = 0;			// 頂点バッファ、インデックスバッファの単位
+	sl12::u32	vertexLayout = 0;		// 頂点バッファの数が異なるパイプラインは別の値にする
+	sl12::u32	instanceIndex = 0;
+	sl12::u32	argIndex = 0;			// 引数バッファとカウントバッファの先頭
+	sl12::u32	argCount = 0;			// 最大描画数
+};	// struct DrawSortItem
+
+// ソートキー (pso:4bit, material:20bit, mesh:20bit, instance:20bit)
+sl12::u64 MakeDrawSortKey(sl12::u32 psoIndex, sl12::u32 materialIndex, sl12::u32 meshIndex, sl12::u32 instanceIndex);
+
+// キーでソートする
+// キーが等しい描画は元の順番を保つ
+// 作業用のメモリを確保しないように、安定ソートではなくキーと引数バッファの位置で並べる
+void SortDrawItems(DrawSortItem* pItems, size_t count);
+
+// 直前の描画から変更が必要なステート
+static const sl12::u32 kDrawStatePso = 0x01;
+static const sl12::u32 kDrawStateDescriptor = 0x02;
+static const sl12::u32 kDrawStateVertexBuffer = 0x04;
+
+// bInstanceDescriptorはインスタンスごとの定数バッファをディスクリプタで設定する場合にtrue
+// pPrevがnullptrなら全て変更する
+sl12::u32 GetDrawStateChange(const DrawSortItem* pPrev, const DrawSortItem& curr, bool bInstanceDescriptor);
+
+// 1フレームのステート変更数
+struct DrawStateStats
+{
+	sl12::u32	psoChanges = 0;
+	sl12::u32	descriptorChanges = 0;
+	sl12::u32	vertexBufferChanges = 0;
+	sl12::u32	executeCount = 0;
+};	// struct DrawStateStats
+
+void AddDrawStateChange(sl12::u32 changeFlags, DrawStateStats& stats);
+void AddDrawStateStats(const DrawStateStats& src, DrawStateStats& dst);
+
+// 並び順のままで描画した場合のステート変更数
+DrawStateStats CountDrawStateChanges(const DrawSortItem* pItems, size_t count, bool bInstanceDescriptor);
+
+//	EOF
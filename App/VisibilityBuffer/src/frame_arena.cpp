@@ -0,0 +1,325 @@
+﻿#include "frame_arena.h"
+
+#include <algorithm>
+#include <cassert>
+#include <execution>
+#include <iterator>
+#include <malloc.h>
+#include <new>
+#include <numeric>
+
+
+//----
+FrameArena::FrameArena(size_t initialSize)
+{
+	capacity_ = std::max<size_t>(initialSize, kFrameArenaBlockAlignment);
+	pBlock_ = static_cast<sl12::u8*>(::operator new(capacity_, std::align_val_t(kFrameArenaBlockAlignment)));
+}
+
+//----
+FrameArena::~FrameArena()
+{
+	Reset();
+	::operator delete(pBlock_, std::align_val_t(kFrameArenaBlockAlignment));
+}
+
+//----
+void* FrameArena::Allocate(size_t size, size_t alignment)
+{
+	assert(alignment > 0 && alignment <= kFrameArenaBlockAlignment && (alignment & (alignment - 1)) == 0);
+	size = std::max<size_t>(size, 1);
+
+	if (bEnable_)
+	{
+		// 他のスレッドと競合した場合はオフセットを読み直してやり直す
+		size_t offset = offset_.load(std::memory_order_relaxed);
+		while (true)
+		{
+			size_t aligned = (offset + alignment - 1) & ~(alignment - 1);
+			size_t next = aligned + size;
+			if (next > capacity_)
+			{
+				break;
+			}
+			if (offset_.compare_exchange_weak(offset, next, std::memory_order_relaxed))
+			{
+				return pBlock_ + aligned;
+			}
+		}
+	}
+	return AllocateOverflow(size, alignment);
+}
+
+//----
+void* FrameArena::AllocateOverflow(size_t size, size_t alignment)
+{
+	std::lock_guard<std::mutex> lock(overflowMutex_);
+	void* p = ::operator new(size, std::align_val_t(kFrameArenaBlockAlignment));
+	overflowBlocks_.push_back(p);
+	overflowSize_ += size;
+	return p;
+}
+
+//----
+void FrameArena::Reset()
+{
+	size_t used = std::min(offset_.load(std::memory_order_relaxed), capacity_) + overflowSize_;
+	lastUsedSize_ = used;
+	lastOverflowCount_ = (sl12::u32)overflowBlocks_.size();
+
+	for (auto p : overflowBlocks_)
+	{
+		::operator delete(p, std::align_val_t(kFrameArenaBlockAlignment));
+	}
+	overflowBlocks_.clear();
+	overflowSize_ = 0;
+
+	// 容量が足りなかった場合は、次のフレームから1つのブロックに収まるように広げる
+	if (bEnable_ && used > capacity_)
+	{
+		size_t newCapacity = capacity_;
+		while (newCapacity < used)
+		{
+			newCapacity *= 2;
+		}
+		::operator delete(pBlock_, std::align_val_t(kFrameArenaBlockAlignment));
+		pBlock_ = static_cast<sl12::u8*>(::operator new(newCapacity, std::align_val_t(kFrameArenaBlockAlignment)));
+		capacity_ = newCapacity;
+	}
+	offset_.store(0, std::memory_order_relaxed);
+}
+
+
+//----
+#if HEAP_ALLOC_COUNTER
+namespace
+{
+	std::atomic<sl12::u64>		s_HeapAllocCount{0};
+	thread_local sl12::u64		s_ThreadHeapAllocCount = 0;
+}
+
+void* operator new(size_t size)
+{
+	s_HeapAllocCount.fetch_add(1, std::memory_order_relaxed);
+	s_ThreadHeapAllocCount++;
+	void* p = malloc(size > 0 ? size : 1);
+	if (!p)
+	{
+		throw std::bad_alloc();
+	}
+	return p;
+}
+void* operator new[](size_t size)
+{
+	return operator new(size);
+}
+void operator delete(void* p) noexcept
+{
+	free(p);
+}
+void operator delete[](void* p) noexcept
+{
+	operator delete(p);
+}
+void operator delete(void* p, size_t size) noexcept
+{
+	operator delete(p);
+}
+void operator delete[](void* p, size_t size) noexcept
+{
+	operator delete(p);
+}
+
+void* operator new(size_t size, std::align_val_t alignment)
+{
+	s_HeapAllocCount.fetch_add(1, std::memory_order_relaxed);
+	s_ThreadHeapAllocCount++;
+	void* p = _aligned_malloc(size > 0 ? size : 1, (size_t)alignment);
+	if (!p)
+	{
+		throw std::bad_alloc();
+	}
+	return p;
+}
+void* operator new[](size_t size, std::align_val_t alignment)
+{
+	return operator new(size, alignment);
+}
+void operator delete(void* p, std::align_val_t alignment) noexcept
+{
+	_aligned_free(p);
+}
+void operator delete[](void* p, std::align_val_t alignment) noexcept
+{
+	operator delete(p, alignment);
+}
+void operator delete(void* p, size_t size, std::align_val_t alignment) noexcept
+{
+	operator delete(p, alignment);
+}
+void operator delete[](void* p, size_t size, std::align_val_t alignment) noexcept
+{
+	operator delete(p, alignment);
+}
+
+sl12::u64 GetHeapAllocCount(bool bCurrentThread)
+{
+	return bCurrentThread ? s_ThreadHeapAllocCount : s_HeapAllocCount.load(std::memory_order_relaxed);
+}
+#else
+sl12::u64 GetHeapAllocCount(bool bCurrentThread)
+{
+	return 0;
+}
+#endif
+
+
+//----
+sl12::u32 ValidateFrameArena()
+{
+	sl12::u32 errorCount = 0;
+
+	// アライメントと容量超え
+	{
+		FrameArena arena(256);
+		const size_t kAlignments[] = {1, 4, 8, 16, 64};
+		std::vector<std::pair<sl12::u8*, size_t>> blocks;
+		for (sl12::u32 i = 0; i < 20; i++)
+		{
+			size_t alignment = kAlignments[i % std::size(kAlignments)];
+			size_t size = 7 + i * 3;
+			auto p = static_cast<sl12::u8*>(arena.Allocate(size, alignment));
+			if (((size_t)p & (alignment - 1)) != 0)
+			{
+				errorCount++;
+			}
+			memset(p, (int)i, size);
+			blocks.push_back(std::make_pair(p, size));
+		}
+		for (sl12::u32 i = 0; i < (sl12::u32)blocks.size(); i++)
+		{
+			for (size_t j = 0; j < blocks[i].second; j++)
+			{
+				if (blocks[i].first[j] != (sl12::u8)i)
+				{
+					errorCount++;
+					break;
+				}
+			}
+		}
+		arena.Reset();
+		if (arena.GetLastOverflowCount() == 0 || arena.GetCapacity() < arena.GetLastUsedSize())
+		{
+			errorCount++;
+		}
+
+		// 広げた後は同じ確保がヒープを使わない
+		for (sl12::u32 i = 0; i < 20; i++)
+		{
+			arena.Allocate(7 + i * 3, kAlignments[i % std::size(kAlignments)]);
+		}
+		arena.Reset();
+		if (arena.GetLastOverflowCount() != 0)
+		{
+			errorCount++;
+		}
+	}
+
+	// 無効時は全てヒープから確保する
+	{
+		FrameArena arena(1024);
+		arena.SetEnable(false);
+		for (sl12::u32 i = 0; i < 10; i++)
+		{
+			arena.Allocate(16, 16);
+		}
+		arena.Reset();
+		if (arena.GetLastOverflowCount() != 10 || arena.GetCapacity() != 1024)
+		{
+			errorCount++;
+		}
+	}
+
+	// 並列確保で領域が重ならない
+	{
+		const sl12::u32 kTaskCount = 64;
+		const sl12::u32 kAllocCount = 100;
+		FrameArena arena(kTaskCount * kAllocCount * 16);
+		std::vector<sl12::u32> tasks(kTaskCount);
+		std::iota(tasks.begin(), tasks.end(), 0);
+		std::vector<FrameSpan<sl12::u32>> spans(kTaskCount * kAllocCount);
+		std::for_each(std::execution::par, tasks.begin(), tasks.end(), [&](sl12::u32 task)
+			{
+				for (sl12::u32 i = 0; i < kAllocCount; i++)
+				{
+					// 一部は容量を超える
+					auto span = arena.AllocSpan<sl12::u32>(1 + (task + i) % 7);
+					for (auto&& v : span)
+					{
+						v = task * kAllocCount + i;
+					}
+					spans[task * kAllocCount + i] = span;
+				}
+			});
+		for (sl12::u32 i = 0; i < (sl12::u32)spans.size(); i++)
+		{
+			for (auto v : spans[i])
+			{
+				if (v != i)
+				{
+					errorCount++;
+					break;
+				}
+			}
+		}
+		arena.Reset();
+	}
+
+	// コンテナ
+	{
+		FrameArena arena(1024);
+		FrameVector<sl12::u32> member;
+		auto Build = [&]()
+		{
+			FrameVector<sl12::u32> values{FrameArenaAllocator<sl12::u32>(&arena)};
+			FrameHashMap<sl12::u32, sl12::u32> indices{FrameArenaAllocator<std::pair<const sl12::u32, sl12::u32>>(&arena)};
+			for (sl12::u32 i = 0; i < 1000; i++)
+			{
+				values.push_back(i);
+				indices[i % 100] = i;
+			}
+			member = std::move(values);
+			return indices.size() == 100;
+		};
+		if (!Build())
+		{
+			errorCount++;
+		}
+		arena.Reset();
+
+		// 2フレーム目はアリーナに収まるので、ヒープから確保しない
+		// 他のスレッドの確保を含めないように、このスレッドの回数で比較する
+		sl12::u64 allocCount = GetHeapAllocCount(true);
+		if (!Build())
+		{
+			errorCount++;
+		}
+		if (GetHeapAllocCount(true) != allocCount)
+		{
+			errorCount++;
+		}
+		if (member.get_allocator().GetArena() != &arena || member.size() != 1000 || member[999] != 999)
+		{
+			errorCount++;
+		}
+		arena.Reset();
+		if (arena.GetLastOverflowCount() != 0)
+		{
+			errorCount++;
+		}
+	}
+
+	return errorCount;
+}
+
+//	EOF
@@ -0,0 +1,223 @@
+﻿#pragma once
+
+#include "sl12/types.h"
+#include <atomic>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+
+//----
+// フレーム単位のバンプアロケータ
+// 確保はオフセットを進めるだけで、個別の解放はしない
+// 確保したメモリは次のReset()まで有効で、Reset()はフレームの先頭で呼ぶ
+// Allocate()はスレッドセーフ (パスのPrepareExecuteから並列に呼ばれる)
+// D3D12に依存しないので、アプリケーション外でも実行できる
+
+// ブロックのアライメント (確保要求のアライメントはこれ以下)
+static const size_t kFrameArenaBlockAlignment = 64;
+
+template <typename T> class FrameSpan;
+
+class FrameArena
+{
+public:
+	FrameArena(size_t initialSize = 1024 * 1024);
+	~FrameArena();
+
+	// 容量を超えた確保は個別のブロックをヒープから確保し、次のReset()で容量を広げる
+	void* Allocate(size_t size, size_t alignment);
+
+	// 確保したメモリを全て破棄する
+	// 他のスレッドから確保中に呼んではいけない
+	void Reset();
+
+	// 無効な場合は全ての確保をヒープから行う (比較用、解放はReset()でまとめて行う)
+	void SetEnable(bool bEnable)
+	{
+		bEnable_ = bEnable;
+	}
+	bool IsEnable() const
+	{
+		return bEnable_;
+	}
+
+	template <typename T>
+	FrameSpan<T> AllocSpan(size_t count);
+	template <typename T>
+	FrameSpan<T> CopySpan(const T* pSrc, size_t count);
+
+	size_t GetCapacity() const
+	{
+		return capacity_;
+	}
+	// 直前のフレームの使用量 (ヒープから確保したブロックを含む)
+	size_t GetLastUsedSize() const
+	{
+		return lastUsedSize_;
+	}
+	// 直前のフレームでヒープから確保したブロック数
+	sl12::u32 GetLastOverflowCount() const
+	{
+		return lastOverflowCount_;
+	}
+
+private:
+	void* AllocateOverflow(size_t size, size_t alignment);
+
+private:
+	sl12::u8*					pBlock_ = nullptr;
+	size_t						capacity_ = 0;
+	std::atomic<size_t>			offset_{0};
+
+	std::mutex					overflowMutex_;
+	std::vector<void*>			overflowBlocks_;
+	size_t						overflowSize_ = 0;
+
+	bool						bEnable_ = true;
+	size_t						lastUsedSize_ = 0;
+	sl12::u32					lastOverflowCount_ = 0;
+};	// class FrameArena
+
+//----
+// アリーナのメモリを指す固定長の配列
+// 要素のデストラクタは呼ばないので、トリビアルに破棄できる型のみ使う
+template <typename T>
+class FrameSpan
+{
+public:
+	FrameSpan() {}
+	FrameSpan(T* pData, size_t count)
+		: pData_(pData), count_(count)
+	{}
+
+	T* data() const { return pData_; }
+	size_t size() const { return count_; }
+	bool empty() const { return count_ == 0; }
+	T* begin() const { return pData_; }
+	T* end() const { return pData_ + count_; }
+	T& operator[](size_t index) const { return pData_[index]; }
+
+private:
+	T*		pData_ = nullptr;
+	size_t	count_ = 0;
+};	// class FrameSpan
+
+template <typename T>
+FrameSpan<T> FrameArena::AllocSpan(size_t count)
+{
+	static_assert(std::is_trivially_destructible<T>::value, "FrameSpan requires trivially destructible type.");
+	static_assert(alignof(T) <= kFrameArenaBlockAlignment, "FrameSpan alignment is too large.");
+	if (count == 0)
+	{
+		return FrameSpan<T>();
+	}
+	T* p = static_cast<T*>(Allocate(sizeof(T) * count, alignof(T)));
+	for (size_t i = 0; i < count; i++)
+	{
+		new(p + i) T();
+	}
+	return FrameSpan<T>(p, count);
+}
+
+template <typename T>
+FrameSpan<T> FrameArena::CopySpan(const T* pSrc, size_t count)
+{
+	static_assert(std::is_trivially_copyable<T>::value, "FrameSpan copy requires trivially copyable type.");
+	auto ret = AllocSpan<T>(count);
+	if (count > 0)
+	{
+		memcpy(ret.data(), pSrc, sizeof(T) * count);
+	}
+	return ret;
+}
+
+//----
+// STLコンテナ用のアロケータ
+// アリーナのメモリは解放しない
+// アリーナがnullptrの場合は通常のヒープを使う (デフォルト構築したメンバ変数など)
+// ムーブ代入でアロケータも移るので、アリーナで構築したコンテナをメンバ変数にムーブできる
+template <typename T>
+class FrameArenaAllocator
+{
+public:
+	typedef T value_type;
+	typedef std::true_type propagate_on_container_copy_assignment;
+	typedef std::true_type propagate_on_container_move_assignment;
+	typedef std::true_type propagate_on_container_swap;
+
+	FrameArenaAllocator() noexcept {}
+	FrameArenaAllocator(FrameArena* pArena) noexcept
+		: pArena_(pArena)
+	{}
+	template <typename U>
+	FrameArenaAllocator(const FrameArenaAllocator<U>& rhs) noexcept
+		: pArena_(rhs.GetArena())
+	{}
+
+	T* allocate(size_t n)
+	{
+		static_assert(alignof(T) <= kFrameArenaBlockAlignment, "FrameArenaAllocator alignment is too large.");
+		if (pArena_)
+		{
+			return static_cast<T*>(pArena_->Allocate(sizeof(T) * n, alignof(T)));
+		}
+		return static_cast<T*>(::operator new(sizeof(T) * n));
+	}
+	void deallocate(T* p, size_t n) noexcept
+	{
+		if (!pArena_)
+		{
+			::operator delete(p);
+		}
+	}
+
+	FrameArena* GetArena() const noexcept
+	{
+		return pArena_;
+	}
+
+private:
+	FrameArena*		pArena_ = nullptr;
+};	// class FrameArenaAllocator
+
+template <typename T, typename U>
+bool operator==(const FrameArenaAllocator<T>& a, const FrameArenaAllocator<U>& b) noexcept
+{
+	return a.GetArena() == b.GetArena();
+}
+template <typename T, typename U>
+bool operator!=(const FrameArenaAllocator<T>& a, const FrameArenaAllocator<U>& b) noexcept
+{
+	return a.GetArena() != b.GetArena();
+}
+
+// アリーナで確保するコンテナ
+// フレームをまたいで保持する場合は、Reset()の後に要素を参照しないこと
+template <typename T>
+using FrameVector = std::vector<T, FrameArenaAllocator<T>>;
+template <typename Key, typename Value>
+using FrameHashMap = std::unordered_map<Key, Value, std::hash<Key>, std::equal_to<Key>, FrameArenaAllocator<std::pair<const Key, Value>>>;
+
+//----
+// ヒープ確保回数 (グローバルなoperator newを置き換えて数える)
+// bCurrentThreadがfalseならプロセス全体、trueなら呼び出したスレッドのみ
+// HEAP_ALLOC_COUNTER が0の場合は常に0を返す
+// 全てのnew/deleteを置き換えるので、デフォルトではDebugビルドのみ有効にする
+#ifndef HEAP_ALLOC_COUNTER
+#	if defined(_DEBUG)
+#		define HEAP_ALLOC_COUNTER (1)
+#	else
+#		define HEAP_ALLOC_COUNTER (0)
+#	endif
+#endif
+
+sl12::u64 GetHeapAllocCount(bool bCurrentThread = false);
+
+// 容量超え、リセット、並列確保、コンテナでの利用を検証する
+// 戻り値は失敗したケース数
+sl12::u32 ValidateFrameArena();
+
+//	EOF
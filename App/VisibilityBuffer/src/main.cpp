@@ -16,6 +16,7 @@ int WINAPI WinMain(HINSTANCE hInstance, HINSTANCE, LPSTR, int nCmdShow)
 	std::string appShaderDir = "";
 	std::string sysShaderInclDir = "";
 	int meshType = 3;
+	int meshGridWidth = 32;
 	int screenWidth = kDisplayWidth;
 	int screenHeight = kDisplayHeight;
 
@@ -39,6 +40,11 @@ int WINAPI WinMain(HINSTANCE hInstance, HINSTANCE, LPSTR, int nCmdShow)
 			{
 				meshType = std::stoi(szArglist[++i]);
 			}
+			else if (!lstrcmpW(szArglist[i], L"-grid"))
+			{
+				// -mesh 0 のインスタンス数は grid x grid
+				meshGridWidth = std::stoi(szArglist[++i]);
+			}
 			else if (!lstrcmpW(szArglist[i], L"-res"))
 			{
 				std::wstring str = szArglist[++i];
@@ -61,7 +67,7 @@ int WINAPI WinMain(HINSTANCE hInstance, HINSTANCE, LPSTR, int nCmdShow)
 		}
 	}
 
-	SampleApplication app(hInstance, nCmdShow, screenWidth, screenHeight, ColorSpace, homeDir, meshType, appShaderDir, sysShaderInclDir);
+	SampleApplication app(hInstance, nCmdShow, screenWidth, screenHeight, ColorSpace, homeDir, meshType, meshGridWidth, appShaderDir, sysShaderInclDir);
 
 	return app.Run();
 }
@@ -0,0 +1,476 @@
+﻿#include "material_classify.h"
+
+#include "sl12/string_util.h"
+#include <algorithm>
+#include <fstream>
+#include <random>
+
+
+namespace
+{
+	static const sl12::u32 kClassifyDumpMagic = 0x44434256;	// 'VBCD'
+
+	sl12::u32 GetDumpMaterial(const ClassifyDump& dump, sl12::u32 x, sl12::u32 y, sl12::u32 numMaterials)
+	{
+		sl12::u32 index = y * dump.width + x;
+		// 背景はreverse-Zで0
+		if (!(dump.depth[index] > 0.0f))
+		{
+			return ~0u;
+		}
+		sl12::u32 drawCallIndex = (dump.visibility[index] >> 8) & 0xffffff;
+		if (drawCallIndex >= dump.drawCallMaterials.size())
+		{
+			return ~0u;
+		}
+		sl12::u32 materialIndex = dump.drawCallMaterials[drawCallIndex];
+		return materialIndex < numMaterials ? materialIndex : ~0u;
+	}
+
+	bool SetupClassifyResult(const ClassifyDump& dump, sl12::u32 numMaterials, ClassifyResult& outResult)
+	{
+		if (numMaterials > CLASSIFY_MATERIAL_MAX)
+		{
+			sl12::ConsolePrint("Error: too many materials for classify. (%d > %d)\n", numMaterials, CLASSIFY_MATERIAL_MAX);
+			return false;
+		}
+		outResult.numX = (dump.width + CLASSIFY_TILE_WIDTH - 1) / CLASSIFY_TILE_WIDTH;
+		outResult.numY = (dump.height + CLASSIFY_TILE_WIDTH - 1) / CLASSIFY_TILE_WIDTH;
+		outResult.numMaterials = numMaterials;
+		outResult.listStride = std::min<sl12::u32>(numMaterials, CLASSIFY_TILE_MATERIAL_MAX);
+		sl12::u32 numTiles = outResult.numX * outResult.numY;
+		outResult.tileMaterialCount.assign(numTiles, 0);
+		outResult.tileMaterialList.assign(numTiles * outResult.listStride, 0);
+		outResult.materialTileCount.assign(numMaterials, 0);
+		outResult.materialTileOffset.assign(numMaterials, 0);
+		outResult.materialTileIndex.clear();
+		return true;
+	}
+
+	// ScanCSとScatterCSに相当する
+	void CompactClassifyResult(ClassifyResult& result)
+	{
+		sl12::u32 offset = 0;
+		for (sl12::u32 mat = 0; mat < result.numMaterials; mat++)
+		{
+			result.materialTileOffset[mat] = offset;
+			offset += result.materialTileCount[mat];
+		}
+
+		std::vector<sl12::u32> fill(result.numMaterials, 0);
+		result.materialTileIndex.assign(offset, 0);
+		sl12::u32 numTiles = result.numX * result.numY;
+		for (sl12::u32 tileNo = 0; tileNo < numTiles; tileNo++)
+		{
+			const sl12::u32* list = result.tileMaterialList.data() + tileNo * result.listStride;
+			for (sl12::u32 i = 0; i < result.tileMaterialCount[tileNo]; i++)
+			{
+				sl12::u32 mat = list[i];
+				result.materialTileIndex[result.materialTileOffset[mat] + fill[mat]++] = tileNo;
+			}
+		}
+	}
+
+	void MakeRandomClassifyDump(std::mt19937& rnd, sl12::u32 width, sl12::u32 height, sl12::u32 numDrawCalls, sl12::u32 numMaterials, sl12::u32 bgRate, ClassifyDump& outDump)
+	{
+		outDump.width = width;
+		outDump.height = height;
+		outDump.drawCallMaterials.resize(numDrawCalls);
+		for (auto&& m : outDump.drawCallMaterials)
+		{
+			m = rnd() % numMaterials;
+		}
+
+		// 16x16のブロック毎に主なDrawCallを決めて、タイル内のマテリアルに偏りを持たせる
+		sl12::u32 blockX = (width + 15) / 16;
+		std::vector<sl12::u32> blockDrawCalls(blockX * ((height + 15) / 16));
+		for (auto&& dc : blockDrawCalls)
+		{
+			dc = rnd() % numDrawCalls;
+		}
+		outDump.visibility.resize(width * height);
+		outDump.depth.resize(width * height);
+		for (sl12::u32 y = 0; y < height; y++)
+		{
+			for (sl12::u32 x = 0; x < width; x++)
+			{
+				sl12::u32 index = y * width + x;
+				sl12::u32 dc = (rnd() % 4 == 0) ? rnd() % numDrawCalls : blockDrawCalls[(y / 16) * blockX + x / 16];
+				outDump.visibility[index] = (dc << 8) | (rnd() & 0xff);
+				outDump.depth[index] = (rnd() % 8 < bgRate) ? 0.0f : 0.5f;
+			}
+		}
+	}
+}
+
+//----
+bool SaveClassifyDump(const std::string& filename, const ClassifyDump& dump)
+{
+	std::ofstream ofs(filename, std::ios::binary);
+	if (!ofs)
+	{
+		sl12::ConsolePrint("Error: failed to open classify dump file. (%s)\n", filename.c_str());
+		return false;
+	}
+
+	sl12::u32 header[] = {kClassifyDumpMagic, dump.width, dump.height, (sl12::u32)dump.drawCallMaterials.size()};
+	ofs.write((const char*)header, sizeof(header));
+	ofs.write((const char*)dump.visibility.data(), sizeof(sl12::u32) * dump.visibility.size());
+	ofs.write((const char*)dump.depth.data(), sizeof(float) * dump.depth.size());
+	ofs.write((const char*)dump.drawCallMaterials.data(), sizeof(sl12::u32) * dump.drawCallMaterials.size());
+	return true;
+}
+
+//----
+bool LoadClassifyDump(const std::string& filename, ClassifyDump& outDump)
+{
+	std::ifstream ifs(filename, std::ios::binary);
+	if (!ifs)
+	{
+		return false;
+	}
+
+	sl12::u32 header[4];
+	ifs.read((char*)header, sizeof(header));
+	if (!ifs || header[0] != kClassifyDumpMagic)
+	{
+		sl12::ConsolePrint("Error: invalid classify dump file. (%s)\n", filename.c_str());
+		return false;
+	}
+
+	outDump.width = header[1];
+	outDump.height = header[2];
+	outDump.visibility.resize(outDump.width * outDump.height);
+	outDump.depth.resize(outDump.width * outDump.height);
+	outDump.drawCallMaterials.resize(header[3]);
+	ifs.read((char*)outDump.visibility.data(), sizeof(sl12::u32) * outDump.visibility.size());
+	ifs.read((char*)outDump.depth.data(), sizeof(float) * outDump.depth.size());
+	ifs.read((char*)outDump.drawCallMaterials.data(), sizeof(sl12::u32) * outDump.drawCallMaterials.size());
+	if (!ifs)
+	{
+		sl12::ConsolePrint("Error: classify dump file is truncated. (%s)\n", filename.c_str());
+		return false;
+	}
+	return true;
+}
+
+//----
+bool ClassifyTilesReference(const ClassifyDump& dump, sl12::u32 numMaterials, ClassifyResult& outResult)
+{
+	if (!SetupClassifyResult(dump, numMaterials, outResult))
+	{
+		return false;
+	}
+
+	sl12::u32 numChunks = (numMaterials + 31) / 32;
+	std::vector<sl12::u32> chunkMask(CLASSIFY_CHUNK_MASK_MAX);
+	std::vector<sl12::u32> materialMask(CLASSIFY_MATERIAL_CHUNK_MAX);
+	for (sl12::u32 ty = 0; ty < outResult.numY; ty++)
+	{
+		for (sl12::u32 tx = 0; tx < outResult.numX; tx++)
+		{
+			// 使用するチャンクだけクリアする
+			std::fill(chunkMask.begin(), chunkMask.end(), 0);
+			std::fill(materialMask.begin(), materialMask.begin() + numChunks, 0);
+
+			sl12::u32 endX = std::min(dump.width, (tx + 1) * CLASSIFY_TILE_WIDTH);
+			sl12::u32 endY = std::min(dump.height, (ty + 1) * CLASSIFY_TILE_WIDTH);
+			for (sl12::u32 y = ty * CLASSIFY_TILE_WIDTH; y < endY; y++)
+			{
+				for (sl12::u32 x = tx * CLASSIFY_TILE_WIDTH; x < endX; x++)
+				{
+					sl12::u32 mat = GetDumpMaterial(dump, x, y, numMaterials);
+					if (mat == ~0u)
+					{
+						continue;
+					}
+					sl12::u32 chunkIndex = mat / 32;
+					sl12::u32 orig = materialMask[chunkIndex];
+					materialMask[chunkIndex] |= 0x1 << (mat % 32);
+					if (orig == 0)
+					{
+						chunkMask[chunkIndex / 32] |= 0x1 << (chunkIndex % 32);
+					}
+				}
+			}
+
+			// チャンクのマスクから空でないチャンクだけ走査する
+			sl12::u32 tileNo = ty * outResult.numX + tx;
+			sl12::u32* list = outResult.tileMaterialList.data() + tileNo * outResult.listStride;
+			sl12::u32& count = outResult.tileMaterialCount[tileNo];
+			for (sl12::u32 maskIndex = 0; maskIndex < CLASSIFY_CHUNK_MASK_MAX; maskIndex++)
+			{
+				sl12::u32 chunkBits = chunkMask[maskIndex];
+				for (sl12::u32 chunkBit = 0; chunkBits != 0; chunkBit++, chunkBits >>= 1)
+				{
+					if (!(chunkBits & 0x1))
+					{
+						continue;
+					}
+
+					sl12::u32 chunkIndex = maskIndex * 32 + chunkBit;
+					sl12::u32 bits = materialMask[chunkIndex];
+					for (sl12::u32 bit = 0; bit < 32; bit++)
+					{
+						if (bits & (0x1 << bit))
+						{
+							sl12::u32 mat = chunkIndex * 32 + bit;
+							list[count++] = mat;
+							outResult.materialTileCount[mat]++;
+						}
+					}
+				}
+			}
+		}
+	}
+
+	CompactClassifyResult(outResult);
+	return true;
+}
+
+//----
+bool ClassifyTilesFlat(const ClassifyDump& dump, sl12::u32 numMaterials, ClassifyResult& outResult)
+{
+	if (!SetupClassifyResult(dump, numMaterials, outResult))
+	{
+		return false;
+	}
+
+	std::vector<bool> flags(numMaterials);
+	for (sl12::u32 ty = 0; ty < outResult.numY; ty++)
+	{
+		for (sl12::u32 tx = 0; tx < outResult.numX; tx++)
+		{
+			std::fill(flags.begin(), flags.end(), false);
+			sl12::u32 endX = std::min(dump.width, (tx + 1) * CLASSIFY_TILE_WIDTH);
+			sl12::u32 endY = std::min(dump.height, (ty + 1) * CLASSIFY_TILE_WIDTH);
+			for (sl12::u32 y = ty * CLASSIFY_TILE_WIDTH; y < endY; y++)
+			{
+				for (sl12::u32 x = tx * CLASSIFY_TILE_WIDTH; x < endX; x++)
+				{
+					sl12::u32 mat = GetDumpMaterial(dump, x, y, numMaterials);
+					if (mat != ~0u)
+					{
+						flags[mat] = true;
+					}
+				}
+			}
+
+			sl12::u32 tileNo = ty * outResult.numX + tx;
+			sl12::u32* list = outResult.tileMaterialList.data() + tileNo * outResult.listStride;
+			for (sl12::u32 mat = 0; mat < numMaterials; mat++)
+			{
+				if (flags[mat])
+				{
+					list[outResult.tileMaterialCount[tileNo]++] = mat;
+					outResult.materialTileCount[mat]++;
+				}
+			}
+		}
+	}
+
+	CompactClassifyResult(outResult);
+	return true;
+}
+
+//----
+sl12::u32 CompareClassifyResult(const ClassifyResult& a, const ClassifyResult& b)
+{
+	if (a.numX != b.numX || a.numY != b.numY || a.numMaterials != b.numMaterials)
+	{
+		return 1;
+	}
+
+	sl12::u32 errorCount = 0;
+	sl12::u32 numTiles = a.numX * a.numY;
+	for (sl12::u32 tileNo = 0; tileNo < numTiles; tileNo++)
+	{
+		if (a.tileMaterialCount[tileNo] != b.tileMaterialCount[tileNo])
+		{
+			errorCount++;
+			continue;
+		}
+		std::vector<sl12::u32> listA(a.tileMaterialList.begin() + tileNo * a.listStride, a.tileMaterialList.begin() + tileNo * a.listStride + a.tileMaterialCount[tileNo]);
+		std::vector<sl12::u32> listB(b.tileMaterialList.begin() + tileNo * b.listStride, b.tileMaterialList.begin() + tileNo * b.listStride + b.tileMaterialCount[tileNo]);
+		std::sort(listA.begin(), listA.end());
+		std::sort(listB.begin(), listB.end());
+		if (listA != listB)
+		{
+			errorCount++;
+		}
+	}
+
+	for (sl12::u32 mat = 0; mat < a.numMaterials; mat++)
+	{
+		if (a.materialTileCount[mat] != b.materialTileCount[mat] || a.materialTileOffset[mat] != b.materialTileOffset[mat])
+		{
+			errorCount++;
+			continue;
+		}
+		auto beginA = a.materialTileIndex.begin() + a.materialTileOffset[mat];
+		auto beginB = b.materialTileIndex.begin() + b.materialTileOffset[mat];
+		std::vector<sl12::u32> tilesA(beginA, beginA + a.materialTileCount[mat]);
+		std::vector<sl12::u32> tilesB(beginB, beginB + b.materialTileCount[mat]);
+		std::sort(tilesA.begin(), tilesA.end());
+		std::sort(tilesB.begin(), tilesB.end());
+		if (tilesA != tilesB)
+		{
+			errorCount++;
+		}
+	}
+	return errorCount;
+}
+
+//----
+ClassifyMemoryStats CalcClassifyMemoryStats(const ClassifyResult& result)
+{
+	ClassifyMemoryStats stats;
+	sl12::u64 numTiles = result.numX * result.numY;
+	stats.denseBytes = numTiles * result.numMaterials * sizeof(sl12::u32);
+	stats.sparseBytes = (numTiles * result.listStride + result.numMaterials) * sizeof(sl12::u32);
+	stats.usedBytes = (result.materialTileIndex.size() + result.numMaterials) * sizeof(sl12::u32);
+	for (auto&& count : result.tileMaterialCount)
+	{
+		stats.maxTileMaterials = std::max(stats.maxTileMaterials, count);
+	}
+	return stats;
+}
+
+//----
+ClassifyValidation ValidateClassifyGpuResult(const ClassifyDump& dump, sl12::u32 numMaterials, const ClassifyGpuResult& gpu)
+{
+	ClassifyValidation ret;
+	ClassifyResult reference, result;
+	if (!ClassifyTilesReference(dump, numMaterials, reference) || !SetupClassifyResult(dump, numMaterials, result))
+	{
+		ret.layoutErrors++;
+		return ret;
+	}
+	ret.memory = CalcClassifyMemoryStats(reference);
+
+	// タイルごとのリスト
+	sl12::u32 numTiles = result.numX * result.numY;
+	for (sl12::u32 tileNo = 0; tileNo < numTiles; tileNo++)
+	{
+		sl12::u32 count = gpu.pTileMaterialCount[tileNo];
+		if (count > result.listStride)
+		{
+			ret.layoutErrors++;
+			continue;
+		}
+		const sl12::u32* src = gpu.pTileMaterialList + tileNo * result.listStride;
+		sl12::u32* dst = result.tileMaterialList.data() + tileNo * result.listStride;
+		for (sl12::u32 i = 0; i < count; i++)
+		{
+			if (src[i] >= numMaterials)
+			{
+				ret.layoutErrors++;
+			}
+			dst[i] = src[i];
+		}
+		result.tileMaterialCount[tileNo] = count;
+	}
+
+	// マテリアルごとのタイルリストは、描画引数のタイル数を詰めて並べる
+	// オフセットが壊れているとリストを比較できない
+	sl12::u32 offsetErrors = 0;
+	sl12::u64 total = 0;
+	for (sl12::u32 mat = 0; mat < numMaterials; mat++)
+	{
+		const sl12::u32* args = gpu.pDrawArgs + mat * 4;
+		if (args[0] != 6 || gpu.pMaterialTileOffset[mat] != total)
+		{
+			offsetErrors++;
+		}
+		result.materialTileCount[mat] = args[1];
+		result.materialTileOffset[mat] = (sl12::u32)total;
+		total += args[1];
+	}
+	if (total > gpu.tileIndexCapacity)
+	{
+		offsetErrors++;
+	}
+	if (offsetErrors > 0)
+	{
+		ret.layoutErrors += offsetErrors;
+		return ret;
+	}
+	result.materialTileIndex.assign(gpu.pMaterialTileIndex, gpu.pMaterialTileIndex + total);
+	ret.entryCount = (sl12::u32)total;
+
+	ret.mismatchCount = CompareClassifyResult(result, reference);
+	return ret;
+}
+
+//----
+sl12::u32 ValidateMaterialClassify(const std::string& dumpFile, ClassifyMemoryStats* outStats)
+{
+	struct Case
+	{
+		sl12::u32	width, height;
+		sl12::u32	numDrawCalls;
+		sl12::u32	numMaterials;
+	};
+	const Case kCases[] = {
+		{ 100,  60,    16,    37},
+		{ 333, 200,   512,  8192},
+		{ 640, 360,  4096, 20000},
+		{ 640, 360, 16384, CLASSIFY_MATERIAL_MAX},
+	};
+
+	std::mt19937 rnd(0x9abc);
+	sl12::u32 errorCount = 0;
+	ClassifyResult hierarchical, flat;
+	for (auto&& c : kCases)
+	{
+		for (sl12::u32 bgRate = 0; bgRate <= 4; bgRate += 4)
+		{
+			ClassifyDump dump;
+			MakeRandomClassifyDump(rnd, c.width, c.height, c.numDrawCalls, c.numMaterials, bgRate, dump);
+			if (!ClassifyTilesReference(dump, c.numMaterials, hierarchical) || !ClassifyTilesFlat(dump, c.numMaterials, flat))
+			{
+				errorCount++;
+				continue;
+			}
+			errorCount += CompareClassifyResult(hierarchical, flat);
+		}
+	}
+
+	// 上限を超えるマテリアル数は失敗しなければならない
+	{
+		ClassifyDump dump;
+		MakeRandomClassifyDump(rnd, 64, 64, 4, 4, 0, dump);
+		ClassifyResult over;
+		if (ClassifyTilesReference(dump, CLASSIFY_MATERIAL_MAX + 1, over))
+		{
+			errorCount++;
+		}
+	}
+
+	// ダンプしたバッファ
+	ClassifyDump dump;
+	if (!dumpFile.empty() && LoadClassifyDump(dumpFile, dump))
+	{
+		sl12::u32 numMaterials = 0;
+		for (auto&& m : dump.drawCallMaterials)
+		{
+			numMaterials = std::max(numMaterials, m + 1);
+		}
+		if (ClassifyTilesReference(dump, numMaterials, hierarchical) && ClassifyTilesFlat(dump, numMaterials, flat))
+		{
+			errorCount += CompareClassifyResult(hierarchical, flat);
+		}
+		else
+		{
+			errorCount++;
+		}
+	}
+
+	if (outStats)
+	{
+		*outStats = CalcClassifyMemoryStats(hierarchical);
+	}
+	return errorCount;
+}
+
+//	EOF
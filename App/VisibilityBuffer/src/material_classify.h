@@ -0,0 +1,98 @@
+﻿#pragma once
+
+#include "sl12/types.h"
+#include <string>
+#include <vector>
+
+#include "../shaders/constant_defs.h"
+
+
+//----
+// Classifyのリファレンス実装 (classify.c.hlsl と material_mask.hlsli のモデル)
+// D3D12に依存しないので、ダンプしたVisibility/Depthバッファに対してアプリケーション外でも実行できる
+
+// ダンプしたバッファ
+// visibility, depthはwidth * height、drawCallMaterialsはDrawCallのインデックスからマテリアルのインデックスを引くテーブル
+struct ClassifyDump
+{
+	sl12::u32				width = 0;
+	sl12::u32				height = 0;
+	std::vector<sl12::u32>	visibility;
+	std::vector<float>		depth;
+	std::vector<sl12::u32>	drawCallMaterials;
+};	// struct ClassifyDump
+
+bool SaveClassifyDump(const std::string& filename, const ClassifyDump& dump);
+bool LoadClassifyDump(const std::string& filename, ClassifyDump& outDump);
+
+// 分類結果
+//   tileMaterialList : タイル毎のマテリアルリスト (tileNo * listStride から tileMaterialCount[tileNo] 個)
+//   materialTileIndex : マテリアル毎に詰めたタイルのリスト (materialTileOffset[mat] から materialTileCount[mat] 個)
+struct ClassifyResult
+{
+	sl12::u32				numX = 0;
+	sl12::u32				numY = 0;
+	sl12::u32				numMaterials = 0;
+	sl12::u32				listStride = 0;
+	std::vector<sl12::u32>	tileMaterialCount;
+	std::vector<sl12::u32>	tileMaterialList;
+	std::vector<sl12::u32>	materialTileCount;
+	std::vector<sl12::u32>	materialTileOffset;
+	std::vector<sl12::u32>	materialTileIndex;
+};	// struct ClassifyResult
+
+// 2段階のマスクで分類する
+// マテリアル数がCLASSIFY_MATERIAL_MAXを超える場合はfalseを返す
+bool ClassifyTilesReference(const ClassifyDump& dump, sl12::u32 numMaterials, ClassifyResult& outResult);
+
+// 全マテリアルを走査する分類 (検証用)
+bool ClassifyTilesFlat(const ClassifyDump& dump, sl12::u32 numMaterials, ClassifyResult& outResult);
+
+// 2つの分類結果を比較する
+// GPUのリストの順番は不定なので、リストはソートしてから比較する
+// 戻り値は一致しなかったタイルとマテリアルの数
+sl12::u32 CompareClassifyResult(const ClassifyResult& a, const ClassifyResult& b);
+
+// タイルのインデックスバッファのメモリ量
+//   denseBytes : マテリアル数 * タイル数の密なバッファ (以前の実装)
+//   sparseBytes : 確保するバッファ (タイル数 * タイル内の最大マテリアル数 + オフセット)
+//   usedBytes : 実際に使用される量 (エントリ数 + オフセット)
+struct ClassifyMemoryStats
+{
+	sl12::u64	denseBytes = 0;
+	sl12::u64	sparseBytes = 0;
+	sl12::u64	usedBytes = 0;
+	sl12::u32	maxTileMaterials = 0;
+};	// struct ClassifyMemoryStats
+
+ClassifyMemoryStats CalcClassifyMemoryStats(const ClassifyResult& result);
+
+// ClassifyPass から読み戻したGPUの分類結果 (レイアウトはGPUのバッファのまま)
+struct ClassifyGpuResult
+{
+	const sl12::u32*	pTileMaterialCount = nullptr;	// タイル数
+	const sl12::u32*	pTileMaterialList = nullptr;	// タイル数 * listStride
+	const sl12::u32*	pDrawArgs = nullptr;			// マテリアル数 * D3D12_DRAW_ARGUMENTS (InstanceCountがタイル数)
+	const sl12::u32*	pMaterialTileOffset = nullptr;	// マテリアル数
+	const sl12::u32*	pMaterialTileIndex = nullptr;	// tileIndexCapacity
+	sl12::u64			tileIndexCapacity = 0;
+};	// struct ClassifyGpuResult
+
+struct ClassifyValidation
+{
+	sl12::u32			layoutErrors = 0;		// 範囲外を指すリストやオフセット、描画引数の不整合
+	sl12::u32			mismatchCount = 0;		// CPUの分類と一致しなかったタイルとマテリアルの数
+	sl12::u32			entryCount = 0;			// マテリアルごとのタイルリストのエントリ数
+	ClassifyMemoryStats	memory;					// 読み戻したフレームのメモリ量
+};	// struct ClassifyValidation
+
+// GPUの分類結果を、同じフレームのVisibility/Depthバッファに対する ClassifyTilesReference の結果と比較する
+ClassifyValidation ValidateClassifyGpuResult(const ClassifyDump& dump, sl12::u32 numMaterials, const ClassifyGpuResult& gpu);
+
+// ランダムなシーンで2段階のマスクの分類を全マテリアルの走査と比較する
+// 8192を超えるマテリアル数も検証する
+// dumpFileのダンプが読み込めた場合はそれも検証し、outStatsにそのメモリ量を返す (読み込めない場合は最後のランダムなシーン)
+// 戻り値は失敗した数
+sl12::u32 ValidateMaterialClassify(const std::string& dumpFile, ClassifyMemoryStats* outStats);
+
+//	EOF
@@ -0,0 +1,543 @@
+﻿#include "meshlet_alpha.h"
+
+#include "sl12/string_util.h"
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <random>
+
+
+namespace
+{
+	static const sl12::u32 kMeshletAlphaMagic = 0x414d4256;	// 'VBMA'
+
+	// 閾値以上になる最小のアルファ値 (256なら不透明なテクセルはない)
+	sl12::u32 GetOpaqueMinAlpha(float threshold)
+	{
+		sl12::u32 ret = 0;
+		while (ret < 256 && (float)ret / 255.0f < threshold)
+		{
+			ret++;
+		}
+		return ret;
+	}
+
+	// 集めたテクセルの状態
+	struct AlphaCoverage
+	{
+		bool	bOpaque = false;
+		bool	bTransparent = false;
+
+		void Add(sl12::u32 alpha, sl12::u32 opaqueMin)
+		{
+			if (alpha >= opaqueMin)
+				bOpaque = true;
+			else
+				bTransparent = true;
+		}
+		bool IsMixed() const
+		{
+			return bOpaque && bTransparent;
+		}
+	};	// struct AlphaCoverage
+
+	sl12::u32 WrapTexel(int v, sl12::u32 size)
+	{
+		int m = v % (int)size;
+		return (sl12::u32)((m < 0) ? m + (int)size : m);
+	}
+
+	// テクセル空間の三角形 (p = uv * size - 0.5)
+	// テクセル(i, j)のバイリニアの重みが正になるのは p が開区間 (i-1, i+1) x (j-1, j+1) にある場合なので、
+	// 三角形とこの開いた正方形の交差を分離軸で判定する
+	// x, y軸は走査範囲で判定済みなので、辺の法線のみ調べる
+	struct TexelTriangle
+	{
+		float	minX, minY, maxX, maxY;
+		float	normals[3][2];
+		float	triMin[3], triMax[3];
+		bool	bValidNormal[3];
+
+		void Setup(const float (&p)[3][2])
+		{
+			minX = std::min({p[0][0], p[1][0], p[2][0]});
+			maxX = std::max({p[0][0], p[1][0], p[2][0]});
+			minY = std::min({p[0][1], p[1][1], p[2][1]});
+			maxY = std::max({p[0][1], p[1][1], p[2][1]});
+			for (int e = 0; e < 3; e++)
+			{
+				const float* a = p[e];
+				const float* b = p[(e + 1) % 3];
+				normals[e][0] = b[1] - a[1];
+				normals[e][1] = a[0] - b[0];
+				// 縮退した辺は分離軸にならない
+				bValidNormal[e] = (normals[e][0] != 0.0f || normals[e][1] != 0.0f);
+				triMin[e] = triMax[e] = normals[e][0] * p[0][0] + normals[e][1] * p[0][1];
+				for (int v = 1; v < 3; v++)
+				{
+					float d = normals[e][0] * p[v][0] + normals[e][1] * p[v][1];
+					triMin[e] = std::min(triMin[e], d);
+					triMax[e] = std::max(triMax[e], d);
+				}
+			}
+		}
+
+		bool IsOverlap(int i, int j) const
+		{
+			for (int e = 0; e < 3; e++)
+			{
+				if (!bValidNormal[e])
+					continue;
+				float c = normals[e][0] * (float)i + normals[e][1] * (float)j;
+				float r = std::abs(normals[e][0]) + std::abs(normals[e][1]);
+				if (triMax[e] <= c - r || triMin[e] >= c + r)
+				{
+					return false;
+				}
+			}
+			return true;
+		}
+	};	// struct TexelTriangle
+
+	// 1ミップの三角形の判定
+	// 戻り値がfalseの場合はUVが不正
+	bool GatherTriangleCoverage(const MeshletAlphaImage::Level& level, const DirectX::XMFLOAT2 (&uv)[3], sl12::u32 opaqueMin, AlphaCoverage& coverage)
+	{
+		float p[3][2];
+		for (int v = 0; v < 3; v++)
+		{
+			p[v][0] = uv[v].x * (float)level.width - 0.5f;
+			p[v][1] = uv[v].y * (float)level.height - 0.5f;
+			if (!std::isfinite(p[v][0]) || !std::isfinite(p[v][1]))
+			{
+				return false;
+			}
+		}
+		TexelTriangle tri;
+		tri.Setup(p);
+
+		// 重みが正になりうるテクセルの範囲
+		double iMin = std::floor((double)tri.minX - 1.0) + 1.0;
+		double iMax = std::ceil((double)tri.maxX + 1.0) - 1.0;
+		double jMin = std::floor((double)tri.minY - 1.0) + 1.0;
+		double jMax = std::ceil((double)tri.maxY + 1.0) - 1.0;
+		// テクスチャを一周する場合は全ての列(行)を対象にする
+		// 同じテクセルが複数回現れるので分離軸の判定は行わない (保守的になる)
+		bool bWrapX = (iMax - iMin + 1.0) >= (double)level.width;
+		bool bWrapY = (jMax - jMin + 1.0) >= (double)level.height;
+		if (bWrapX)
+		{
+			iMin = 0.0;
+			iMax = (double)level.width - 1.0;
+		}
+		if (bWrapY)
+		{
+			jMin = 0.0;
+			jMax = (double)level.height - 1.0;
+		}
+		// 範囲がintに収まらない大きなUVは不正とみなす
+		const double kLimit = 1 << 30;
+		if (std::abs(iMin) > kLimit || std::abs(iMax) > kLimit || std::abs(jMin) > kLimit || std::abs(jMax) > kLimit)
+		{
+			return false;
+		}
+
+		for (int j = (int)jMin; j <= (int)jMax; j++)
+		{
+			const sl12::u8* pRow = level.alpha.data() + WrapTexel(j, level.height) * level.width;
+			for (int i = (int)iMin; i <= (int)iMax; i++)
+			{
+				if (!bWrapX && !bWrapY && !tri.IsOverlap(i, j))
+				{
+					continue;
+				}
+				coverage.Add(pRow[WrapTexel(i, level.width)], opaqueMin);
+				if (coverage.IsMixed())
+				{
+					return true;
+				}
+			}
+		}
+		return true;
+	}
+
+	// 検証用のバイリニアサンプル (Wrap)
+	float SampleBilinear(const MeshletAlphaImage::Level& level, float u, float v)
+	{
+		float px = u * (float)level.width - 0.5f;
+		float py = v * (float)level.height - 0.5f;
+		float fx0 = std::floor(px), fy0 = std::floor(py);
+		float fx = px - fx0, fy = py - fy0;
+		int x0 = (int)fx0, y0 = (int)fy0;
+		auto Fetch = [&](int x, int y)
+		{
+			return (float)level.alpha[WrapTexel(y, level.height) * level.width + WrapTexel(x, level.width)] / 255.0f;
+		};
+		float top = Fetch(x0, y0) * (1.0f - fx) + Fetch(x0 + 1, y0) * fx;
+		float bottom = Fetch(x0, y0 + 1) * (1.0f - fx) + Fetch(x0 + 1, y0 + 1) * fx;
+		return top * (1.0f - fy) + bottom * fy;
+	}
+
+	// 1レベルの画像
+	MeshletAlphaImage MakeSingleLevelImage(sl12::u32 width, sl12::u32 height, const std::vector<sl12::u8>& alpha)
+	{
+		MeshletAlphaImage image;
+		image.levels.resize(1);
+		image.levels[0].width = width;
+		image.levels[0].height = height;
+		image.levels[0].alpha = alpha;
+		return image;
+	}
+
+	// テクセル空間の座標からUVを求める
+	DirectX::XMFLOAT2 TexelToUV(const MeshletAlphaImage& image, float px, float py)
+	{
+		return DirectX::XMFLOAT2((px + 0.5f) / (float)image.levels[0].width, (py + 0.5f) / (float)image.levels[0].height);
+	}
+
+	sl12::u32 ClassifyTexelTriangle(const MeshletAlphaImage& image, float x0, float y0, float x1, float y1, float x2, float y2)
+	{
+		DirectX::XMFLOAT2 uv[] = {TexelToUV(image, x0, y0), TexelToUV(image, x1, y1), TexelToUV(image, x2, y2)};
+		sl12::u32 indices[] = {0, 1, 2};
+		return ClassifyMeshletAlpha(image, uv, indices, 3);
+	}
+}
+
+//----
+void InitMeshletAlphaImage(sl12::u32 width, sl12::u32 height, const sl12::u8* pAlpha, sl12::u32 levelCount, MeshletAlphaImage& outImage)
+{
+	outImage.levels.clear();
+	if (width == 0 || height == 0 || levelCount == 0)
+	{
+		return;
+	}
+
+	outImage.levels.resize(1);
+	outImage.levels[0].width = width;
+	outImage.levels[0].height = height;
+	outImage.levels[0].alpha.assign(pAlpha, pAlpha + width * height);
+	while (outImage.levels.size() < levelCount)
+	{
+		const auto& src = outImage.levels.back();
+		if (src.width == 1 && src.height == 1)
+		{
+			break;
+		}
+
+		MeshletAlphaImage::Level dst;
+		dst.width = std::max(src.width / 2, 1u);
+		dst.height = std::max(src.height / 2, 1u);
+		dst.alpha.resize(dst.width * dst.height);
+		for (sl12::u32 y = 0; y < dst.height; y++)
+		{
+			sl12::u32 y0 = std::min(y * 2, src.height - 1), y1 = std::min(y * 2 + 1, src.height - 1);
+			for (sl12::u32 x = 0; x < dst.width; x++)
+			{
+				sl12::u32 x0 = std::min(x * 2, src.width - 1), x1 = std::min(x * 2 + 1, src.width - 1);
+				sl12::u32 sum = src.alpha[y0 * src.width + x0] + src.alpha[y0 * src.width + x1]
+					+ src.alpha[y1 * src.width + x0] + src.alpha[y1 * src.width + x1];
+				dst.alpha[y * dst.width + x] = (sl12::u8)((sum + 2) / 4);
+			}
+		}
+		outImage.levels.push_back(std::move(dst));
+	}
+}
+
+//----
+sl12::u32 ClassifyMeshletAlpha(const MeshletAlphaImage& image, const DirectX::XMFLOAT2* pTexcoords,
+	const sl12::u32* pIndices, sl12::u32 indexCount, float threshold)
+{
+	if (image.levels.empty() || indexCount < 3)
+	{
+		return MESHLET_ALPHA_MIXED;
+	}
+
+	sl12::u32 opaqueMin = GetOpaqueMinAlpha(threshold);
+	AlphaCoverage coverage;
+	for (auto&& level : image.levels)
+	{
+		for (sl12::u32 i = 0; i + 2 < indexCount; i += 3)
+		{
+			DirectX::XMFLOAT2 uv[] = {pTexcoords[pIndices[i + 0]], pTexcoords[pIndices[i + 1]], pTexcoords[pIndices[i + 2]]};
+			if (!GatherTriangleCoverage(level, uv, opaqueMin, coverage))
+			{
+				return MESHLET_ALPHA_MIXED;
+			}
+			if (coverage.IsMixed())
+			{
+				return MESHLET_ALPHA_MIXED;
+			}
+		}
+	}
+
+	if (coverage.bOpaque)
+		return MESHLET_ALPHA_OPAQUE;
+	if (coverage.bTransparent)
+		return MESHLET_ALPHA_TRANSPARENT;
+	return MESHLET_ALPHA_MIXED;
+}
+
+//----
+void BakeMeshletAlpha(const MeshletAlphaImage& image, const DirectX::XMFLOAT2* pTexcoords, const sl12::u32* pIndices,
+	const std::vector<MeshletAlphaRange>& meshlets, float threshold, std::vector<sl12::u8>& outClasses)
+{
+	outClasses.resize(meshlets.size());
+	for (size_t i = 0; i < meshlets.size(); i++)
+	{
+		outClasses[i] = (sl12::u8)ClassifyMeshletAlpha(image, pTexcoords, pIndices + meshlets[i].indexOffset, meshlets[i].indexCount, threshold);
+	}
+}
+
+//----
+bool SaveMeshletAlphaBake(const std::string& filename, const MeshletAlphaBake& bake)
+{
+	std::ofstream ofs(filename, std::ios::binary);
+	if (!ofs)
+	{
+		sl12::ConsolePrint("Error: failed to open meshlet alpha file. (%s)\n", filename.c_str());
+		return false;
+	}
+
+	sl12::u32 header[] = {kMeshletAlphaMagic, (sl12::u32)bake.submeshClasses.size()};
+	ofs.write((const char*)header, sizeof(header));
+	for (auto&& classes : bake.submeshClasses)
+	{
+		sl12::u32 count = (sl12::u32)classes.size();
+		ofs.write((const char*)&count, sizeof(count));
+		ofs.write((const char*)classes.data(), classes.size());
+	}
+	return true;
+}
+
+//----
+bool LoadMeshletAlphaBake(const std::string& filename, MeshletAlphaBake& outBake)
+{
+	std::ifstream ifs(filename, std::ios::binary);
+	if (!ifs)
+	{
+		return false;
+	}
+
+	sl12::u32 header[2];
+	ifs.read((char*)header, sizeof(header));
+	if (!ifs || header[0] != kMeshletAlphaMagic)
+	{
+		sl12::ConsolePrint("Error: invalid meshlet alpha file. (%s)\n", filename.c_str());
+		return false;
+	}
+
+	outBake.submeshClasses.resize(header[1]);
+	for (auto&& classes : outBake.submeshClasses)
+	{
+		sl12::u32 count = 0;
+		ifs.read((char*)&count, sizeof(count));
+		if (!ifs)
+		{
+			break;
+		}
+		classes.resize(count);
+		ifs.read((char*)classes.data(), count);
+	}
+	if (!ifs)
+	{
+		sl12::ConsolePrint("Error: meshlet alpha file is truncated. (%s)\n", filename.c_str());
+		return false;
+	}
+	return true;
+}
+
+//----
+sl12::u32 ValidateMeshletAlphaBake()
+{
+	sl12::u32 errorCount = 0;
+	auto Check = [&](sl12::u32 result, sl12::u32 expected, const char* name)
+	{
+		if (result != expected)
+		{
+			sl12::ConsolePrint("Error: meshlet alpha validation failed. (%s : %u, expected %u)\n", name, result, expected);
+			errorCount++;
+		}
+	};
+
+	// 一様なテクスチャ
+	{
+		const sl12::u32 kSize = 16;
+		const sl12::u8 kValues[] = {255, 0, 84, 85};
+		const sl12::u32 kExpected[] = {MESHLET_ALPHA_OPAQUE, MESHLET_ALPHA_TRANSPARENT, MESHLET_ALPHA_TRANSPARENT, MESHLET_ALPHA_OPAQUE};
+		for (int i = 0; i < 4; i++)
+		{
+			std::vector<sl12::u8> alpha(kSize * kSize, kValues[i]);
+			MeshletAlphaImage image;
+			InitMeshletAlphaImage(kSize, kSize, alpha.data(), 0xffffffff, image);
+			Check(ClassifyTexelTriangle(image, 1.0f, 1.0f, 40.0f, 3.0f, -7.0f, 12.0f), kExpected[i], "uniform");
+		}
+	}
+
+	// 左半分が不透明、右半分が透明 (1レベル)
+	{
+		const sl12::u32 kSize = 16;
+		std::vector<sl12::u8> alpha(kSize * kSize);
+		for (sl12::u32 y = 0; y < kSize; y++)
+			for (sl12::u32 x = 0; x < kSize; x++)
+				alpha[y * kSize + x] = (x < kSize / 2) ? 255 : 0;
+		MeshletAlphaImage image = MakeSingleLevelImage(kSize, kSize, alpha);
+
+		// x = 7.0 ではテクセル8の重みは0
+		Check(ClassifyTexelTriangle(image, 1.0f, 2.0f, 7.0f, 2.0f, 7.0f, 12.0f), MESHLET_ALPHA_OPAQUE, "split boundary");
+		Check(ClassifyTexelTriangle(image, 1.0f, 2.0f, 7.25f, 2.0f, 7.0f, 12.0f), MESHLET_ALPHA_MIXED, "split cross");
+		Check(ClassifyTexelTriangle(image, 8.0f, 2.0f, 14.5f, 2.0f, 14.5f, 12.0f), MESHLET_ALPHA_TRANSPARENT, "split transparent");
+		// Wrapで左端の列が混ざる
+		Check(ClassifyTexelTriangle(image, 8.0f, 2.0f, 15.25f, 2.0f, 14.5f, 12.0f), MESHLET_ALPHA_MIXED, "split wrap");
+		// 負のUV (テクスチャ3周分ずらす)
+		Check(ClassifyTexelTriangle(image, 1.0f - 48.0f, 2.0f - 48.0f, 7.0f - 48.0f, 2.0f - 48.0f, 7.0f - 48.0f, 12.0f - 48.0f), MESHLET_ALPHA_OPAQUE, "negative uv");
+		// 境界の辺の外側の頂点 (斜めの辺で正方形に触れない)
+		Check(ClassifyTexelTriangle(image, 1.0f, 2.0f, 6.0f, 2.0f, 9.0f, 12.0f), MESHLET_ALPHA_MIXED, "split diagonal");
+		// テクスチャより大きい三角形
+		Check(ClassifyTexelTriangle(image, -20.0f, -20.0f, 60.0f, -20.0f, -20.0f, 60.0f), MESHLET_ALPHA_MIXED, "large");
+		// バウンディングボックスには入るが、斜めの辺の外側にある透明なテクセル
+		{
+			std::vector<sl12::u8> hole(kSize * kSize, 255);
+			hole[11 * kSize + 8] = 0;
+			MeshletAlphaImage holeImage = MakeSingleLevelImage(kSize, kSize, hole);
+			Check(ClassifyTexelTriangle(holeImage, 1.0f, 2.0f, 7.5f, 2.0f, 1.0f, 12.0f), MESHLET_ALPHA_OPAQUE, "diagonal edge");
+			Check(ClassifyTexelTriangle(holeImage, 1.0f, 2.0f, 7.5f, 2.0f, 7.5f, 12.0f), MESHLET_ALPHA_MIXED, "diagonal edge cross");
+		}
+		// テクセル中心の点 (縮退した三角形)
+		{
+			std::vector<sl12::u8> dot(kSize * kSize, 0);
+			dot[3 * kSize + 3] = 255;
+			MeshletAlphaImage dotImage = MakeSingleLevelImage(kSize, kSize, dot);
+			Check(ClassifyTexelTriangle(dotImage, 3.0f, 3.0f, 3.0f, 3.0f, 3.0f, 3.0f), MESHLET_ALPHA_OPAQUE, "point");
+			Check(ClassifyTexelTriangle(dotImage, 3.0f, 3.0f, 3.5f, 3.0f, 3.25f, 3.0f), MESHLET_ALPHA_MIXED, "line");
+		}
+	}
+
+	// ミップ0では不透明でも、縮小したミップで透明な領域が混ざれば混在
+	{
+		const sl12::u32 kSize = 16;
+		std::vector<sl12::u8> alpha(kSize * kSize);
+		for (sl12::u32 y = 0; y < kSize; y++)
+			for (sl12::u32 x = 0; x < kSize; x++)
+				alpha[y * kSize + x] = (x < kSize / 2) ? 255 : 0;
+		MeshletAlphaImage image;
+		InitMeshletAlphaImage(kSize, kSize, alpha.data(), 2, image);
+		Check(ClassifyTexelTriangle(image, 1.0f, 2.0f, 7.0f, 2.0f, 7.0f, 12.0f), MESHLET_ALPHA_MIXED, "mip");
+		Check(ClassifyTexelTriangle(image, 2.0f, 2.0f, 5.0f, 2.0f, 5.0f, 12.0f), MESHLET_ALPHA_OPAQUE, "mip inside");
+	}
+
+	// ランダムな三角形をバイリニアのスーパーサンプリングと比較する
+	// 分類は保守的なので、不透明/透明と判定したものだけを調べる
+	{
+		std::mt19937 rnd(0x4d41);
+		std::uniform_real_distribution<float> dist01(0.0f, 1.0f);
+		const sl12::u32 kSize = 64;
+		sl12::u32 classCount[3] = {};
+		for (int tex = 0; tex < 4; tex++)
+		{
+			// 8x8ブロック単位の不透明/透明に、ブロック内のノイズを加える
+			std::vector<sl12::u8> alpha(kSize * kSize);
+			std::vector<bool> blockOpaque((kSize / 8) * (kSize / 8));
+			for (size_t b = 0; b < blockOpaque.size(); b++)
+				blockOpaque[b] = (rnd() % 2) == 0;
+			for (sl12::u32 y = 0; y < kSize; y++)
+			{
+				for (sl12::u32 x = 0; x < kSize; x++)
+				{
+					bool opaque = blockOpaque[(y / 8) * (kSize / 8) + x / 8];
+					alpha[y * kSize + x] = (sl12::u8)(opaque ? 85 + rnd() % 171 : rnd() % 85);
+				}
+			}
+			MeshletAlphaImage image;
+			InitMeshletAlphaImage(kSize, kSize, alpha.data(), 1 + tex % 3, image);
+
+			for (int t = 0; t < 2000; t++)
+			{
+				DirectX::XMFLOAT2 uv[3];
+				float cx = dist01(rnd) * 4.0f - 2.0f, cy = dist01(rnd) * 4.0f - 2.0f;
+				float extent = (t % 4 == 0) ? 0.1f : 0.03f;
+				for (auto&& v : uv)
+				{
+					v.x = cx + (dist01(rnd) * 2.0f - 1.0f) * extent;
+					v.y = cy + (dist01(rnd) * 2.0f - 1.0f) * extent;
+				}
+				sl12::u32 indices[] = {0, 1, 2};
+				sl12::u32 cls = ClassifyMeshletAlpha(image, uv, indices, 3);
+				classCount[cls]++;
+				if (cls == MESHLET_ALPHA_MIXED)
+				{
+					continue;
+				}
+
+				bool bFailed = false;
+				for (int s = 0; s < 256 && !bFailed; s++)
+				{
+					// 頂点と辺上のサンプルも含める
+					float b0 = dist01(rnd), b1 = dist01(rnd);
+					if (s < 3)
+					{
+						b0 = (s == 0) ? 1.0f : 0.0f;
+						b1 = (s == 1) ? 1.0f : 0.0f;
+					}
+					else if (b0 + b1 > 1.0f)
+					{
+						b0 = 1.0f - b0;
+						b1 = 1.0f - b1;
+					}
+					float b2 = std::max(1.0f - b0 - b1, 0.0f);
+					float u = uv[0].x * b0 + uv[1].x * b1 + uv[2].x * b2;
+					float v = uv[0].y * b0 + uv[1].y * b1 + uv[2].y * b2;
+					for (auto&& level : image.levels)
+					{
+						bool opaque = SampleBilinear(level, u, v) >= kMeshletAlphaThreshold;
+						if (opaque != (cls == MESHLET_ALPHA_OPAQUE))
+						{
+							bFailed = true;
+							break;
+						}
+					}
+				}
+				if (bFailed)
+				{
+					sl12::ConsolePrint("Error: meshlet alpha validation failed. (random triangle %d of texture %d)\n", t, tex);
+					errorCount++;
+				}
+			}
+		}
+		// 全て混在になるような判定は検証にならない
+		if (classCount[MESHLET_ALPHA_OPAQUE] == 0 || classCount[MESHLET_ALPHA_TRANSPARENT] == 0)
+		{
+			sl12::ConsolePrint("Error: meshlet alpha validation failed. (random triangles are not classified)\n");
+			errorCount++;
+		}
+	}
+
+	// メッシュレット単位のベイク
+	{
+		const sl12::u32 kSize = 16;
+		std::vector<sl12::u8> alpha(kSize * kSize);
+		for (sl12::u32 y = 0; y < kSize; y++)
+			for (sl12::u32 x = 0; x < kSize; x++)
+				alpha[y * kSize + x] = (x < kSize / 2) ? 255 : 0;
+		MeshletAlphaImage image = MakeSingleLevelImage(kSize, kSize, alpha);
+
+		std::vector<DirectX::XMFLOAT2> uvs = {
+			TexelToUV(image, 1.0f, 1.0f), TexelToUV(image, 6.0f, 1.0f), TexelToUV(image, 1.0f, 6.0f), TexelToUV(image, 6.0f, 6.0f),
+			TexelToUV(image, 9.0f, 1.0f), TexelToUV(image, 14.0f, 1.0f), TexelToUV(image, 9.0f, 6.0f), TexelToUV(image, 14.0f, 6.0f),
+		};
+		std::vector<sl12::u32> indices = {
+			0, 1, 2, 2, 1, 3,		// 不透明
+			4, 5, 6, 6, 5, 7,		// 透明
+			0, 1, 2, 4, 5, 6,		// 混在
+		};
+		std::vector<MeshletAlphaRange> meshlets = {{0, 6}, {6, 6}, {12, 6}};
+		std::vector<sl12::u8> classes;
+		BakeMeshletAlpha(image, uvs.data(), indices.data(), meshlets, kMeshletAlphaThreshold, classes);
+		Check(classes[0], MESHLET_ALPHA_OPAQUE, "bake opaque");
+		Check(classes[1], MESHLET_ALPHA_TRANSPARENT, "bake transparent");
+		Check(classes[2], MESHLET_ALPHA_MIXED, "bake mixed");
+	}
+
+	return errorCount;
+}
+
+//	EOF
@@ -0,0 +1,77 @@
+﻿#pragma once
+
+#include "sl12/types.h"
+#include <DirectXMath.h>
+#include <string>
+#include <vector>
+
+#include "../shaders/constant_defs.h"
+
+
+//----
+// メッシュレット単位のアルファ分類 (オフラインベイク)
+// マスクマテリアルのメッシュレットのUVをベースカラーのアルファに対してラスタライズし、
+// 完全に不透明 (アルファテスト不要)、完全に透明 (描画不要)、混在の3つに分類する
+// D3D12に依存しないので、アプリケーション外でも実行できる
+
+// シェーダのアルファテストと同じ閾値 (alpha < 0.333 でdiscard)
+static const float kMeshletAlphaThreshold = 0.333f;
+
+// アルファ画像
+// levelsはミップ0から2x2の平均で縮小したミップチェーン
+// 遠距離で使われる小さいミップは分類に含めない (含めると、ほぼ全てのメッシュレットが混在になる)
+static const sl12::u32 kMeshletAlphaBakeLevels = 4;
+struct MeshletAlphaImage
+{
+	struct Level
+	{
+		sl12::u32				width = 0;
+		sl12::u32				height = 0;
+		std::vector<sl12::u8>	alpha;
+	};
+	std::vector<Level>	levels;
+};	// struct MeshletAlphaImage
+
+// ミップ0のアルファからlevelCount段 (最大で1x1まで) のミップチェーンを生成する
+void InitMeshletAlphaImage(sl12::u32 width, sl12::u32 height, const sl12::u8* pAlpha, sl12::u32 levelCount, MeshletAlphaImage& outImage);
+
+// 三角形リストの分類
+// 戻り値はMESHLET_ALPHA_xxx
+// バイリニア(Wrap)で重みが正になるテクセルを全ミップで集め、全てがthreshold以上なら不透明、全てが未満なら透明とする
+// 三角形内のサンプルは集めたテクセルの凸結合なので、分類は保守的 (判定できなければ混在)
+sl12::u32 ClassifyMeshletAlpha(const MeshletAlphaImage& image, const DirectX::XMFLOAT2* pTexcoords,
+	const sl12::u32* pIndices, sl12::u32 indexCount, float threshold = kMeshletAlphaThreshold);
+
+// メッシュレットのインデックス範囲
+struct MeshletAlphaRange
+{
+	sl12::u32	indexOffset;
+	sl12::u32	indexCount;
+};	// struct MeshletAlphaRange
+
+// サブメッシュの全メッシュレットを分類する
+// pIndicesはサブメッシュのインデックスバッファ、pTexcoordsはそのインデックスで参照するUV
+void BakeMeshletAlpha(const MeshletAlphaImage& image, const DirectX::XMFLOAT2* pTexcoords, const sl12::u32* pIndices,
+	const std::vector<MeshletAlphaRange>& meshlets, float threshold, std::vector<sl12::u8>& outClasses);
+
+// メッシュ単位のベイク結果
+// submeshClassesはResourceItemMeshのサブメッシュインデックス順 (マスクでないサブメッシュは空)
+struct MeshletAlphaBake
+{
+	std::vector<std::vector<sl12::u8>>	submeshClasses;
+};	// struct MeshletAlphaBake
+
+// メッシュファイルと同じ場所に "<mesh file>.malpha" で保存する
+// ベイクはアプリケーションから実行する (Scene::RecordMeshletAlphaBake)
+bool SaveMeshletAlphaBake(const std::string& filename, const MeshletAlphaBake& bake);
+bool LoadMeshletAlphaBake(const std::string& filename, MeshletAlphaBake& outBake);
+
+// 合成テクスチャで分類を検証する
+//   ・一様な不透明/透明テクスチャ
+//   ・境界ちょうどの三角形 (バイリニアの重みが0になるテクセルは含まない)
+//   ・Wrapと負のUV、テクスチャより大きい三角形
+//   ・ランダムな三角形をスーパーサンプリングしたバイリニアと比較 (不透明/透明の判定が誤っていないこと)
+// 戻り値は失敗したケース数
+sl12::u32 ValidateMeshletAlphaBake();
+
+//	EOF
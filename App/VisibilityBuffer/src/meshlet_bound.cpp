@@ -0,0 +1,374 @@
+﻿#include "meshlet_bound.h"
+
+#include "sl12/string_util.h"
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <random>
+
+
+namespace
+{
+	static const float		kBoxQuantScale = 65535.0f;
+	static const float		kOctQuantScale = 255.0f;
+	static const float		kCutoffQuantScale = 254.0f;
+	static const sl12::u32	kCutoffDisabled = 0xff;
+
+	// 16bit -> Box空間([-1, 1])
+	float DecodeBoxCoord(sl12::u32 q)
+	{
+		return (float)q / kBoxQuantScale * 2.0f - 1.0f;
+	}
+	float ToBoxQuant(float v)
+	{
+		return (v * 0.5f + 0.5f) * kBoxQuantScale;
+	}
+	sl12::u32 QuantizeBoxFloor(float v)
+	{
+		return (sl12::u32)std::clamp(std::floor(ToBoxQuant(v)), 0.0f, kBoxQuantScale);
+	}
+	sl12::u32 QuantizeBoxCeil(float v)
+	{
+		return (sl12::u32)std::clamp(std::ceil(ToBoxQuant(v)), 0.0f, kBoxQuantScale);
+	}
+	sl12::u32 QuantizeBoxNearest(float v)
+	{
+		return (sl12::u32)std::clamp(std::round(ToBoxQuant(v)), 0.0f, kBoxQuantScale);
+	}
+
+	// octahedral encoding.
+	DirectX::XMFLOAT2 EncodeOctahedral(const DirectX::XMFLOAT3& n)
+	{
+		float l1 = std::abs(n.x) + std::abs(n.y) + std::abs(n.z);
+		DirectX::XMFLOAT2 ret(n.x / l1, n.y / l1);
+		if (n.z < 0.0f)
+		{
+			float x = ret.x, y = ret.y;
+			ret.x = (1.0f - std::abs(y)) * (x >= 0.0f ? 1.0f : -1.0f);
+			ret.y = (1.0f - std::abs(x)) * (y >= 0.0f ? 1.0f : -1.0f);
+		}
+		return ret;
+	}
+	DirectX::XMFLOAT3 DecodeOctahedral(sl12::u32 qx, sl12::u32 qy)
+	{
+		float x = (float)qx / kOctQuantScale * 2.0f - 1.0f;
+		float y = (float)qy / kOctQuantScale * 2.0f - 1.0f;
+		float z = 1.0f - std::abs(x) - std::abs(y);
+		if (z < 0.0f)
+		{
+			float tx = x, ty = y;
+			x = (1.0f - std::abs(ty)) * (tx >= 0.0f ? 1.0f : -1.0f);
+			y = (1.0f - std::abs(tx)) * (ty >= 0.0f ? 1.0f : -1.0f);
+		}
+		DirectX::XMFLOAT3 ret;
+		DirectX::XMStoreFloat3(&ret, DirectX::XMVector3Normalize(DirectX::XMVectorSet(x, y, z, 0.0f)));
+		return ret;
+	}
+
+	float DecodeCutoff(sl12::u32 q)
+	{
+		// 無効なconeは絶対にcullingされない値にする
+		return (q == kCutoffDisabled) ? 2.0f : (float)q / kCutoffQuantScale;
+	}
+
+	// culling.hlsli の IsBackfaceCull と同じ判定 (ローカル空間)
+	bool IsBackfaceCull(const MeshletBound& bound, DirectX::FXMVECTOR camPos)
+	{
+		DirectX::XMVECTOR apex = DirectX::XMLoadFloat3(&bound.coneApex);
+		DirectX::XMVECTOR axis = DirectX::XMVector3Normalize(DirectX::XMLoadFloat3(&bound.coneAxis));
+		DirectX::XMVECTOR dir = DirectX::XMVector3Normalize(DirectX::XMVectorSubtract(apex, camPos));
+		return DirectX::XMVectorGetX(DirectX::XMVector3Dot(dir, axis)) >= bound.coneCutoff;
+	}
+
+	// coneの判定に使う半角 (90度以上は90度に制限する)
+	float GetConeHalfAngle(float cutoff)
+	{
+		return std::acos(std::clamp(cutoff, 0.0f, 1.0f));
+	}
+}
+
+//----
+MeshletBound DecodeMeshletBound(const MeshletBoundCompact& bound, const DirectX::XMFLOAT4X4& mtxBoxToLocal)
+{
+	const sl12::u32* d = bound.data;
+	DirectX::XMFLOAT3 boxMin(DecodeBoxCoord(d[0] & 0xffff), DecodeBoxCoord(d[0] >> 16), DecodeBoxCoord(d[1] & 0xffff));
+	DirectX::XMFLOAT3 boxMax(DecodeBoxCoord(d[1] >> 16), DecodeBoxCoord(d[2] & 0xffff), DecodeBoxCoord(d[2] >> 16));
+	DirectX::XMFLOAT3 boxApex(DecodeBoxCoord(d[3] & 0xffff), DecodeBoxCoord(d[3] >> 16), DecodeBoxCoord(d[4] & 0xffff));
+
+	// Box空間のAABBをローカル空間のAABBに変換する
+	// center/extentで変換するので、Box変換に回転が入っていても保守的になる
+	DirectX::XMMATRIX m = DirectX::XMLoadFloat4x4(&mtxBoxToLocal);
+	DirectX::XMVECTOR bmin = DirectX::XMLoadFloat3(&boxMin);
+	DirectX::XMVECTOR bmax = DirectX::XMLoadFloat3(&boxMax);
+	DirectX::XMVECTOR center = DirectX::XMVectorScale(DirectX::XMVectorAdd(bmin, bmax), 0.5f);
+	DirectX::XMVECTOR extent = DirectX::XMVectorScale(DirectX::XMVectorSubtract(bmax, bmin), 0.5f);
+	DirectX::XMMATRIX absM;
+	absM.r[0] = DirectX::XMVectorAbs(m.r[0]);
+	absM.r[1] = DirectX::XMVectorAbs(m.r[1]);
+	absM.r[2] = DirectX::XMVectorAbs(m.r[2]);
+	absM.r[3] = DirectX::XMVectorZero();
+	center = DirectX::XMVector3Transform(center, m);
+	extent = DirectX::XMVector3TransformNormal(extent, absM);
+
+	MeshletBound ret{};
+	DirectX::XMStoreFloat3(&ret.aabbMin, DirectX::XMVectorSubtract(center, extent));
+	DirectX::XMStoreFloat3(&ret.aabbMax, DirectX::XMVectorAdd(center, extent));
+	DirectX::XMStoreFloat3(&ret.coneApex, DirectX::XMVector3Transform(DirectX::XMLoadFloat3(&boxApex), m));
+	ret.coneAxis = DecodeOctahedral((d[4] >> 16) & 0xff, d[4] >> 24);
+	ret.coneCutoff = DecodeCutoff(d[5] & 0xff);
+	return ret;
+}
+
+//----
+MeshletBoundCompact EncodeMeshletBound(const MeshletBound& bound, const DirectX::XMFLOAT4X4& mtxBoxToLocal)
+{
+	DirectX::XMMATRIX m = DirectX::XMLoadFloat4x4(&mtxBoxToLocal);
+	DirectX::XMMATRIX mInv = DirectX::XMMatrixInverse(nullptr, m);
+
+	MeshletBoundCompact ret{};
+	sl12::u32* d = ret.data;
+
+	// AABB.
+	{
+		// ローカル空間のAABBをBox空間に変換
+		DirectX::XMVECTOR boxMin = DirectX::XMVectorReplicate(FLT_MAX);
+		DirectX::XMVECTOR boxMax = DirectX::XMVectorReplicate(-FLT_MAX);
+		for (int i = 0; i < 8; i++)
+		{
+			DirectX::XMVECTOR p = DirectX::XMVectorSet(
+				(i & 0x01) ? bound.aabbMax.x : bound.aabbMin.x,
+				(i & 0x02) ? bound.aabbMax.y : bound.aabbMin.y,
+				(i & 0x04) ? bound.aabbMax.z : bound.aabbMin.z,
+				1.0f);
+			p = DirectX::XMVector3Transform(p, mInv);
+			boxMin = DirectX::XMVectorMin(boxMin, p);
+			boxMax = DirectX::XMVectorMax(boxMax, p);
+		}
+		DirectX::XMFLOAT3 bmin, bmax;
+		DirectX::XMStoreFloat3(&bmin, boxMin);
+		DirectX::XMStoreFloat3(&bmax, boxMax);
+
+		sl12::u32 qmin[3] = { QuantizeBoxFloor(bmin.x), QuantizeBoxFloor(bmin.y), QuantizeBoxFloor(bmin.z) };
+		sl12::u32 qmax[3] = { QuantizeBoxCeil(bmax.x), QuantizeBoxCeil(bmax.y), QuantizeBoxCeil(bmax.z) };
+
+		// 逆変換の誤差で元のAABBを含まない場合は1段階ずつ広げる
+		for (int retry = 0; retry < 4; retry++)
+		{
+			d[0] = qmin[0] | (qmin[1] << 16);
+			d[1] = qmin[2] | (qmax[0] << 16);
+			d[2] = qmax[1] | (qmax[2] << 16);
+
+			MeshletBound decoded = DecodeMeshletBound(ret, mtxBoxToLocal);
+			if (decoded.aabbMin.x <= bound.aabbMin.x && decoded.aabbMin.y <= bound.aabbMin.y && decoded.aabbMin.z <= bound.aabbMin.z
+				&& decoded.aabbMax.x >= bound.aabbMax.x && decoded.aabbMax.y >= bound.aabbMax.y && decoded.aabbMax.z >= bound.aabbMax.z)
+			{
+				break;
+			}
+			for (int i = 0; i < 3; i++)
+			{
+				qmin[i] = (qmin[i] > 0) ? qmin[i] - 1 : 0;
+				qmax[i] = (qmax[i] < 0xffff) ? qmax[i] + 1 : 0xffff;
+			}
+		}
+	}
+
+	// cone.
+	// 量子化後のculling領域(apex'から-axis'方向に開いた半角theta'のcone)が
+	// 元のculling領域に含まれるように、半角を狭めてapexを-axis方向にずらす
+	d[4] = 0;
+	d[5] = kCutoffDisabled;
+	DirectX::XMVECTOR axis = DirectX::XMLoadFloat3(&bound.coneAxis);
+	float axisLen = DirectX::XMVectorGetX(DirectX::XMVector3Length(axis));
+	float theta = GetConeHalfAngle(bound.coneCutoff);
+	if (bound.coneCutoff < 1.0f && axisLen > 1e-6f && theta > 1e-3f)
+	{
+		axis = DirectX::XMVectorScale(axis, 1.0f / axisLen);
+		DirectX::XMFLOAT3 n;
+		DirectX::XMStoreFloat3(&n, axis);
+
+		// axisは近傍4点から誤差最小のものを選ぶ
+		DirectX::XMFLOAT2 oct = EncodeOctahedral(n);
+		float ox = (oct.x * 0.5f + 0.5f) * kOctQuantScale;
+		float oy = (oct.y * 0.5f + 0.5f) * kOctQuantScale;
+		sl12::u32 bestX = 0, bestY = 0;
+		float bestDot = -2.0f;
+		for (int i = 0; i < 4; i++)
+		{
+			sl12::u32 qx = (sl12::u32)std::clamp((i & 0x01) ? std::ceil(ox) : std::floor(ox), 0.0f, kOctQuantScale);
+			sl12::u32 qy = (sl12::u32)std::clamp((i & 0x02) ? std::ceil(oy) : std::floor(oy), 0.0f, kOctQuantScale);
+			DirectX::XMFLOAT3 dn = DecodeOctahedral(qx, qy);
+			float dt = DirectX::XMVectorGetX(DirectX::XMVector3Dot(axis, DirectX::XMLoadFloat3(&dn)));
+			if (dt > bestDot)
+			{
+				bestDot = dt;
+				bestX = qx;
+				bestY = qy;
+			}
+		}
+		float delta = std::acos(std::min(bestDot, 1.0f));
+
+		// 半角はaxisの誤差分とシェーダとの演算誤差分を狭める
+		const float kAngleMargin = 1e-3f;
+		float thetaQ = theta - delta - kAngleMargin;
+		sl12::u32 cutoffQ = thetaQ > 0.0f ? (sl12::u32)std::ceil(std::cos(thetaQ) * kCutoffQuantScale) : kCutoffDisabled;
+
+		if (cutoffQ <= (sl12::u32)kCutoffQuantScale)
+		{
+			// apexの量子化誤差(ローカル空間)の上限
+			float cellErr = 0.0f;
+			for (int i = 0; i < 3; i++)
+			{
+				cellErr += DirectX::XMVectorGetX(DirectX::XMVector3Length(m.r[i]));
+			}
+			cellErr /= kBoxQuantScale;
+
+			// 誤差球が元のculling領域に収まる距離だけapexをずらす
+			DirectX::XMVECTOR apex = DirectX::XMLoadFloat3(&bound.coneApex);
+			float cosTheta = std::cos(theta);
+			float shift = cellErr / std::sin(theta) * 2.0f;
+			for (int retry = 0; retry < 4; retry++, shift *= 2.0f)
+			{
+				DirectX::XMVECTOR target = DirectX::XMVectorSubtract(apex, DirectX::XMVectorScale(axis, shift));
+				DirectX::XMFLOAT3 boxApex;
+				DirectX::XMStoreFloat3(&boxApex, DirectX::XMVector3Transform(target, mInv));
+				if (std::abs(boxApex.x) > 1.0f || std::abs(boxApex.y) > 1.0f || std::abs(boxApex.z) > 1.0f)
+				{
+					// Box範囲外のapexは表現できないのでconeを無効にする
+					break;
+				}
+
+				sl12::u32 qx = QuantizeBoxNearest(boxApex.x);
+				sl12::u32 qy = QuantizeBoxNearest(boxApex.y);
+				sl12::u32 qz = QuantizeBoxNearest(boxApex.z);
+				DirectX::XMFLOAT3 decodedApex(DecodeBoxCoord(qx), DecodeBoxCoord(qy), DecodeBoxCoord(qz));
+				DirectX::XMVECTOR w = DirectX::XMVectorSubtract(apex, DirectX::XMVector3Transform(DirectX::XMLoadFloat3(&decodedApex), m));
+				float wDotN = DirectX::XMVectorGetX(DirectX::XMVector3Dot(w, axis));
+				float wLen = DirectX::XMVectorGetX(DirectX::XMVector3Length(w));
+				if (wDotN >= cosTheta * wLen)
+				{
+					d[3] = qx | (qy << 16);
+					d[4] = qz | (bestX << 16) | (bestY << 24);
+					d[5] = cutoffQ;
+					break;
+				}
+			}
+		}
+	}
+
+	return ret;
+}
+
+//----
+bool ValidateMeshletBound(const MeshletBound& bound, const MeshletBoundCompact& compact, const DirectX::XMFLOAT4X4& mtxBoxToLocal)
+{
+	MeshletBound decoded = DecodeMeshletBound(compact, mtxBoxToLocal);
+
+	// AABBは元のAABBを包含していること
+	if (decoded.aabbMin.x > bound.aabbMin.x || decoded.aabbMin.y > bound.aabbMin.y || decoded.aabbMin.z > bound.aabbMin.z
+		|| decoded.aabbMax.x < bound.aabbMax.x || decoded.aabbMax.y < bound.aabbMax.y || decoded.aabbMax.z < bound.aabbMax.z)
+	{
+		return false;
+	}
+
+	// 無効なconeは常に保守的
+	if (decoded.coneCutoff > 1.0f)
+	{
+		return true;
+	}
+	if (bound.coneCutoff >= 1.0f)
+	{
+		return false;
+	}
+
+	// culling領域の包含関係を確認
+	//   axis'の誤差 + theta' <= theta
+	//   apex - apex' が元のcone内
+	DirectX::XMVECTOR axis = DirectX::XMVector3Normalize(DirectX::XMLoadFloat3(&bound.coneAxis));
+	DirectX::XMVECTOR axisQ = DirectX::XMVector3Normalize(DirectX::XMLoadFloat3(&decoded.coneAxis));
+	float theta = GetConeHalfAngle(bound.coneCutoff);
+	float thetaQ = std::acos(std::clamp(decoded.coneCutoff, -1.0f, 1.0f));
+	float delta = std::acos(std::min(DirectX::XMVectorGetX(DirectX::XMVector3Dot(axis, axisQ)), 1.0f));
+	if (delta + thetaQ > theta)
+	{
+		return false;
+	}
+	DirectX::XMVECTOR apex = DirectX::XMLoadFloat3(&bound.coneApex);
+	DirectX::XMVECTOR apexQ = DirectX::XMLoadFloat3(&decoded.coneApex);
+	DirectX::XMVECTOR w = DirectX::XMVectorSubtract(apex, apexQ);
+	if (DirectX::XMVectorGetX(DirectX::XMVector3Dot(w, axis)) < std::cos(theta) * DirectX::XMVectorGetX(DirectX::XMVector3Length(w)))
+	{
+		return false;
+	}
+
+	// compact版でcullingされるカメラ位置をサンプリングして、float版でもcullingされることを確認
+	std::mt19937 rnd(0x5eed);
+	std::uniform_real_distribution<float> dist01(0.0f, 1.0f);
+	DirectX::XMVECTOR up = std::abs(DirectX::XMVectorGetZ(axisQ)) < 0.9f ? DirectX::XMVectorSet(0, 0, 1, 0) : DirectX::XMVectorSet(1, 0, 0, 0);
+	DirectX::XMVECTOR tangent = DirectX::XMVector3Normalize(DirectX::XMVector3Cross(up, axisQ));
+	DirectX::XMVECTOR bitangent = DirectX::XMVector3Cross(axisQ, tangent);
+	float radius = DirectX::XMVectorGetX(DirectX::XMVector3Length(DirectX::XMVectorSubtract(DirectX::XMLoadFloat3(&bound.aabbMax), DirectX::XMLoadFloat3(&bound.aabbMin))));
+	for (int i = 0; i < 32; i++)
+	{
+		float cosT = 1.0f - dist01(rnd) * (1.0f - decoded.coneCutoff);
+		float sinT = std::sqrt(std::max(1.0f - cosT * cosT, 0.0f));
+		float phi = dist01(rnd) * DirectX::XM_2PI;
+		DirectX::XMVECTOR dir = DirectX::XMVectorAdd(
+			DirectX::XMVectorScale(axisQ, cosT),
+			DirectX::XMVectorAdd(DirectX::XMVectorScale(tangent, sinT * std::cos(phi)), DirectX::XMVectorScale(bitangent, sinT * std::sin(phi))));
+		DirectX::XMVECTOR camPos = DirectX::XMVectorSubtract(apexQ, DirectX::XMVectorScale(dir, radius * (0.1f + dist01(rnd) * 10.0f)));
+		if (IsBackfaceCull(decoded, camPos) && !IsBackfaceCull(bound, camPos))
+		{
+			return false;
+		}
+	}
+
+	return true;
+}
+
+//----
+sl12::u32 ValidateMeshletBounds(const sl12::ResourceItemMesh* resMesh, sl12::u32* pMeshletCount)
+{
+	const DirectX::XMFLOAT4X4& mtxBoxToLocal = resMesh->GetMtxBoxToLocal();
+	sl12::u32 errorCount = 0;
+	sl12::u32 meshletCount = 0;
+	for (auto&& submesh : resMesh->GetSubmeshes())
+	{
+		for (auto&& meshlet : submesh.meshlets)
+		{
+			MeshletBound bound{};
+			bound.aabbMin = meshlet.boundingInfo.box.aabbMin;
+			bound.aabbMax = meshlet.boundingInfo.box.aabbMax;
+			bound.coneAxis = meshlet.boundingInfo.cone.axis;
+			bound.coneApex = meshlet.boundingInfo.cone.apex;
+			bound.coneCutoff = meshlet.boundingInfo.cone.cutoff;
+			if (!ValidateMeshletBound(bound, EncodeMeshletBound(bound, mtxBoxToLocal), mtxBoxToLocal))
+			{
+				errorCount++;
+			}
+			meshletCount++;
+		}
+	}
+	if (pMeshletCount)
+	{
+		*pMeshletCount = meshletCount;
+	}
+	return errorCount;
+}
+
+//----
+void StoreMeshletBoundData(MeshletBoundData* pDst, const MeshletBound& bound, const DirectX::XMFLOAT4X4& mtxBoxToLocal)
+{
+#if MESHLET_BOUND_COMPACT
+	*pDst = EncodeMeshletBound(bound, mtxBoxToLocal);
+#	ifdef _DEBUG
+	if (!ValidateMeshletBound(bound, *pDst, mtxBoxToLocal))
+	{
+		sl12::ConsolePrint("Warning: compact meshlet bound is not conservative.\n");
+	}
+#	endif
+#else
+	*pDst = bound;
+#endif
+}
+
+//	EOF
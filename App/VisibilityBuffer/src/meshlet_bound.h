@@ -0,0 +1,58 @@
+﻿#pragma once
+
+#include "sl12/resource_mesh.h"
+#include <DirectXMath.h>
+
+#include "../shaders/constant_defs.h"
+
+//----
+// culling.hlsli の MeshletBound と同じレイアウト
+struct MeshletBound
+{
+	DirectX::XMFLOAT3		aabbMin;
+	DirectX::XMFLOAT3		aabbMax;
+	DirectX::XMFLOAT3		coneApex;
+	DirectX::XMFLOAT3		coneAxis;
+	float					coneCutoff;
+	sl12::u32				pad[3];
+};	// struct MeshletBound
+
+//----
+// culling.hlsli の MeshletBoundCompact と同じレイアウト (24 bytes)
+//   data[0] : aabbMin.x | aabbMin.y << 16
+//   data[1] : aabbMin.z | aabbMax.x << 16
+//   data[2] : aabbMax.y | aabbMax.z << 16
+//   data[3] : coneApex.x | coneApex.y << 16
+//   data[4] : coneApex.z | coneAxis.oct.x << 16 | coneAxis.oct.y << 24
+//   data[5] : coneCutoff (8bit)
+// AABBとconeApexはBox空間([-1, 1])で16bit量子化、coneAxisはローカル空間の8bit octahedral
+struct MeshletBoundCompact
+{
+	sl12::u32				data[6];
+};	// struct MeshletBoundCompact
+
+#if MESHLET_BOUND_COMPACT
+typedef MeshletBoundCompact	MeshletBoundData;
+#else
+typedef MeshletBound		MeshletBoundData;
+#endif
+
+//----
+// float版のboundを量子化する
+// 量子化後のboundはfloat版より必ず緩い判定になる (float版で残るmeshletはcompact版でも残る)
+MeshletBoundCompact EncodeMeshletBound(const MeshletBound& bound, const DirectX::XMFLOAT4X4& mtxBoxToLocal);
+
+// culling.hlsli の DecodeMeshletBound と同じ計算でローカル空間のboundに戻す
+MeshletBound DecodeMeshletBound(const MeshletBoundCompact& bound, const DirectX::XMFLOAT4X4& mtxBoxToLocal);
+
+// compact版がfloat版より多くcullingしないことを検証する
+bool ValidateMeshletBound(const MeshletBound& bound, const MeshletBoundCompact& compact, const DirectX::XMFLOAT4X4& mtxBoxToLocal);
+
+// メッシュの全meshletをエンコード、デコードして、保守的でないmeshletの数を返す
+// MESHLET_BOUND_COMPACT の設定に関係なく実行できる
+sl12::u32 ValidateMeshletBounds(const sl12::ResourceItemMesh* resMesh, sl12::u32* pMeshletCount = nullptr);
+
+// MESHLET_BOUND_COMPACT の設定に合わせてGPUに送るboundを書き込む
+void StoreMeshletBoundData(MeshletBoundData* pDst, const MeshletBound& bound, const DirectX::XMFLOAT4X4& mtxBoxToLocal);
+
+//	EOF
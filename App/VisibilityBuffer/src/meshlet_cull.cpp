@@ -0,0 +1,729 @@
+﻿#include "meshlet_cull.h"
+
+#include "pass/render_resource_settings.h"
+#include "sl12/string_util.h"
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <cstring>
+
+#define USE_IN_CPP
+#include "../shaders/cbuffer.hlsli"
+
+
+namespace
+{
+	// HLSLの mul(m, float4(v, 1)).xyz と同じ計算
+	DirectX::XMFLOAT3 TransformPoint(const DirectX::XMFLOAT4X4& m, const DirectX::XMFLOAT3& v)
+	{
+		return DirectX::XMFLOAT3(
+			v.x * m._11 + v.y * m._21 + v.z * m._31 + m._41,
+			v.x * m._12 + v.y * m._22 + v.z * m._32 + m._42,
+			v.x * m._13 + v.y * m._23 + v.z * m._33 + m._43);
+	}
+	// HLSLの mul((float3x3)m, v) と同じ計算
+	DirectX::XMFLOAT3 TransformVector(const DirectX::XMFLOAT4X4& m, const DirectX::XMFLOAT3& v)
+	{
+		return DirectX::XMFLOAT3(
+			v.x * m._11 + v.y * m._21 + v.z * m._31,
+			v.x * m._12 + v.y * m._22 + v.z * m._32,
+			v.x * m._13 + v.y * m._23 + v.z * m._33);
+	}
+	// HLSLの mul(m, float4(v, 1)) と同じ計算
+	DirectX::XMFLOAT4 TransformPoint4(const DirectX::XMFLOAT4X4& m, const DirectX::XMFLOAT3& v)
+	{
+		return DirectX::XMFLOAT4(
+			v.x * m._11 + v.y * m._21 + v.z * m._31 + m._41,
+			v.x * m._12 + v.y * m._22 + v.z * m._32 + m._42,
+			v.x * m._13 + v.y * m._23 + v.z * m._33 + m._43,
+			v.x * m._14 + v.y * m._24 + v.z * m._34 + m._44);
+	}
+	float Dot(const DirectX::XMFLOAT3& a, const DirectX::XMFLOAT3& b)
+	{
+		return a.x * b.x + a.y * b.y + a.z * b.z;
+	}
+	DirectX::XMFLOAT3 Normalize(const DirectX::XMFLOAT3& v)
+	{
+		float s = 1.0f / std::sqrt(Dot(v, v));
+		return DirectX::XMFLOAT3(v.x * s, v.y * s, v.z * s);
+	}
+
+	// culling.hlsli の LoadMeshletBound
+	MeshletBound LoadMeshletBound(const MeshletBoundData& bound, const DirectX::XMFLOAT4X4& mtxBoxTransform)
+	{
+#if MESHLET_BOUND_COMPACT
+		return DecodeMeshletBound(bound, mtxBoxTransform);
+#else
+		return bound;
+#endif
+	}
+
+	// visibility_buffer.hlsli の LoadDrawCallData
+	DrawCallData LoadDrawCallData(const DrawCallSource* pDrawCalls, sl12::u32 count, sl12::u32 drawCallIndex)
+	{
+#if DRAWCALL_PREFIX_TABLE
+		return DecodeDrawCallRange(pDrawCalls, count, drawCallIndex);
+#else
+		return pDrawCalls[drawCallIndex];
+#endif
+	}
+
+	// culling.hlsli の IsFrustumCull
+	bool IsFrustumCull(const MeshletBound& meshlet, const DirectX::XMFLOAT4 frustumPlanes[6], const DirectX::XMFLOAT4X4& mtxLocalToWorld)
+	{
+		DirectX::XMFLOAT3 points[8];
+		for (int pointID = 0; pointID < 8; pointID++)
+		{
+			DirectX::XMFLOAT3 p(
+				(pointID & 0x04) ? meshlet.aabbMax.x : meshlet.aabbMin.x,
+				(pointID & 0x02) ? meshlet.aabbMax.y : meshlet.aabbMin.y,
+				(pointID & 0x01) ? meshlet.aabbMax.z : meshlet.aabbMin.z);
+			points[pointID] = TransformPoint(mtxLocalToWorld, p);
+		}
+
+		for (int planeID = 0; planeID < 6; planeID++)
+		{
+			DirectX::XMFLOAT3 plane_normal(frustumPlanes[planeID].x, frustumPlanes[planeID].y, frustumPlanes[planeID].z);
+			float plane_constant = frustumPlanes[planeID].w;
+
+			bool inside = false;
+			for (int pointID = 0; pointID < 8; pointID++)
+			{
+				if (Dot(plane_normal, points[pointID]) + plane_constant >= 0.0f)
+				{
+					inside = true;
+					break;
+				}
+			}
+
+			if (!inside)
+			{
+				return true;
+			}
+		}
+
+		return false;
+	}
+
+	// culling.hlsli の IsBackfaceCull
+	bool IsBackfaceCull(const MeshletBound& meshlet, const DirectX::XMFLOAT3& camPos, const DirectX::XMFLOAT4X4& mtxLocalToWorld)
+	{
+		DirectX::XMFLOAT3 coneApex = TransformPoint(mtxLocalToWorld, meshlet.coneApex);
+		DirectX::XMFLOAT3 coneAxis = Normalize(TransformVector(mtxLocalToWorld, meshlet.coneAxis));
+		DirectX::XMFLOAT3 dir = Normalize(DirectX::XMFLOAT3(coneApex.x - camPos.x, coneApex.y - camPos.y, coneApex.z - camPos.z));
+		return Dot(dir, coneAxis) >= meshlet.coneCutoff;
+	}
+
+	// culling.hlsli の ToScreenAABB
+	bool ToScreenAABB(const MeshletBound& meshlet, const DirectX::XMFLOAT4X4& mtxLocalToProj, float nearZ, DirectX::XMFLOAT3& aabbMin, DirectX::XMFLOAT3& aabbMax)
+	{
+		float minZ = 0.0f;
+		for (int pointID = 0; pointID < 8; pointID++)
+		{
+			DirectX::XMFLOAT3 p(
+				(pointID & 0x04) ? meshlet.aabbMax.x : meshlet.aabbMin.x,
+				(pointID & 0x02) ? meshlet.aabbMax.y : meshlet.aabbMin.y,
+				(pointID & 0x01) ? meshlet.aabbMax.z : meshlet.aabbMin.z);
+			DirectX::XMFLOAT4 pp = TransformPoint4(mtxLocalToProj, p);
+			DirectX::XMFLOAT3 sp(
+				(pp.x / pp.w) * 0.5f + 0.5f,
+				(pp.y / pp.w) * -0.5f + 0.5f,
+				pp.z / pp.w);
+			if (pointID == 0)
+			{
+				aabbMin = aabbMax = sp;
+				minZ = pp.w;
+			}
+			else
+			{
+				aabbMin = DirectX::XMFLOAT3(std::min(aabbMin.x, sp.x), std::min(aabbMin.y, sp.y), std::min(aabbMin.z, sp.z));
+				aabbMax = DirectX::XMFLOAT3(std::max(aabbMax.x, sp.x), std::max(aabbMax.y, sp.y), std::max(aabbMax.z, sp.z));
+				minZ = std::min(minZ, pp.w);
+			}
+		}
+		if (minZ <= nearZ)
+			return true;
+
+		aabbMin.x = std::clamp(aabbMin.x, 0.0f, 1.0f);
+		aabbMin.y = std::clamp(aabbMin.y, 0.0f, 1.0f);
+		aabbMin.z = std::min(aabbMin.z, 1.0f);
+		aabbMax.x = std::clamp(aabbMax.x, 0.0f, 1.0f);
+		aabbMax.y = std::clamp(aabbMax.y, 0.0f, 1.0f);
+		aabbMax.z = std::min(aabbMax.z, 1.0f);
+		return false;
+	}
+
+	// Texture2D::Load と同じく、範囲外は0を返す
+	float LoadHiZ(const MeshletCullHiZ& hiz, sl12::u32 x, sl12::u32 y, sl12::u32 mip)
+	{
+		if (mip >= (sl12::u32)hiz.mips.size())
+		{
+			return 0.0f;
+		}
+		sl12::u32 w = std::max(hiz.width >> mip, 1u);
+		sl12::u32 h = std::max(hiz.height >> mip, 1u);
+		if (x >= w || y >= h)
+		{
+			return 0.0f;
+		}
+		return hiz.mips[mip][y * w + x];
+	}
+
+	sl12::u32 FirstBitHigh(sl12::u32 v)
+	{
+		sl12::u32 ret = 0;
+		while (v >>= 1)
+		{
+			ret++;
+		}
+		return ret;
+	}
+
+	// culling.hlsli の IsOcclusionCull
+	bool IsOcclusionCull(const DirectX::XMFLOAT3& aabbMin, const DirectX::XMFLOAT3& aabbMax, const DirectX::XMFLOAT2& hizSize, const MeshletCullHiZ& hiz, sl12::u32 mipLevel)
+	{
+		float rect[4] = {aabbMin.x * hizSize.x, aabbMin.y * hizSize.y, aabbMax.x * hizSize.x, aabbMax.y * hizSize.y};
+		sl12::u32 numTexel = (sl12::u32)std::min(rect[2] - rect[0], rect[3] - rect[1]) + 1;
+		sl12::u32 desiredMip = std::min(FirstBitHigh(numTexel), mipLevel);
+
+		float levelScale = 1.0f / std::exp2((float)desiredMip);
+		float left = aabbMin.x * hizSize.x * levelScale;
+		float top = aabbMin.y * hizSize.y * levelScale;
+		float right = aabbMax.x * hizSize.x * levelScale;
+		float bottom = aabbMax.y * hizSize.y * levelScale;
+		sl12::u32 startX = (sl12::u32)left;
+		sl12::u32 startY = (sl12::u32)top;
+		sl12::u32 endX = (sl12::u32)right + ((right - std::floor(right)) > 0.0f ? 1 : 0);
+		sl12::u32 endY = (sl12::u32)bottom + ((bottom - std::floor(bottom)) > 0.0f ? 1 : 0);
+		float rectZ = aabbMax.z;
+
+		float texelFarZ = 1.0f;
+		for (sl12::u32 y = startY; y <= endY; y++)
+		{
+			for (sl12::u32 x = startX; x <= endX; x++)
+			{
+				texelFarZ = std::min(texelFarZ, LoadHiZ(hiz, x, y, desiredMip));
+			}
+		}
+		const float kEpsilon = 1e-7f;
+		return texelFarZ < 1.0f && rectZ <= (texelFarZ - kEpsilon);
+	}
+
+	// meshlet_cull.c.hlsl の IsHiZCull
+	bool IsHiZCull(const MeshletCullInput& input, const MeshletCullHiZ& hiz, const MeshletBound& bound, const DirectX::XMFLOAT4X4& mtxLocalToWorld)
+	{
+		DirectX::XMFLOAT4X4 mtxLocalToProj;
+		DirectX::XMStoreFloat4x4(&mtxLocalToProj, DirectX::XMMatrixMultiply(DirectX::XMLoadFloat4x4(&mtxLocalToWorld), DirectX::XMLoadFloat4x4(&input.mtxWorldToProj)));
+
+		DirectX::XMFLOAT3 aabbMin, aabbMax;
+		if (ToScreenAABB(bound, mtxLocalToProj, input.nearFar.x, aabbMin, aabbMax))
+		{
+			return false;
+		}
+		DirectX::XMFLOAT2 hizSize(input.screenSize.x * 0.5f, input.screenSize.y * 0.5f);
+		return IsOcclusionCull(aabbMin, aabbMax, hizSize, hiz, 5);
+	}
+
+	// meshlet_cull.c.hlsl の IsShadowHiZCull
+	// 平行投影なのでwは常に1で、ニアクリップをまたぐことはない
+	bool IsShadowHiZCull(const MeshletCullInput& input, const MeshletCullHiZ& hiz, const MeshletBound& bound, const DirectX::XMFLOAT4X4& mtxLocalToWorld)
+	{
+		DirectX::XMFLOAT4X4 mtxLocalToProj;
+		DirectX::XMStoreFloat4x4(&mtxLocalToProj, DirectX::XMMatrixMultiply(DirectX::XMLoadFloat4x4(&mtxLocalToWorld), DirectX::XMLoadFloat4x4(&input.mtxWorldToProj)));
+
+		DirectX::XMFLOAT3 aabbMin, aabbMax;
+		ToScreenAABB(bound, mtxLocalToProj, 0.0f, aabbMin, aabbMax);
+		DirectX::XMFLOAT2 hizSize((float)hiz.width, (float)hiz.height);
+		return IsOcclusionCull(aabbMin, aabbMax, hizSize, hiz, 5);
+	}
+
+	// origin + dir * t (t >= 0) が全ての面の内側に入る区間があるか
+	bool IsRayInFrustum(const DirectX::XMFLOAT3& origin, const DirectX::XMFLOAT3& dir, const DirectX::XMFLOAT4 planes[6])
+	{
+		float tMin = 0.0f, tMax = FLT_MAX;
+		for (int planeID = 0; planeID < 6; planeID++)
+		{
+			DirectX::XMFLOAT3 plane_normal(planes[planeID].x, planes[planeID].y, planes[planeID].z);
+			float d = Dot(plane_normal, origin) + planes[planeID].w;
+			float k = Dot(plane_normal, dir);
+			if (k == 0.0f)
+			{
+				if (d < 0.0f)
+				{
+					return false;
+				}
+			}
+			else if (k > 0.0f)
+			{
+				tMin = std::max(tMin, -d / k);
+			}
+			else
+			{
+				tMax = std::min(tMax, -d / k);
+			}
+		}
+		return tMin <= tMax;
+	}
+
+	const sl12::u32* GetArg(const sl12::u8* pArgTop, sl12::u32 drawCallIndex)
+	{
+		return (const sl12::u32*)(pArgTop + drawCallIndex * kIndirectArgsBufferStride);
+	}
+	bool IsVisible(const std::vector<sl12::u32>& visibleBits, sl12::u32 drawCallIndex)
+	{
+		return (visibleBits[drawCallIndex / 32] & (0x01 << (drawCallIndex % 32))) != 0;
+	}
+
+	sl12::u32 CountBits(sl12::u32 bits)
+	{
+		sl12::u32 count = 0;
+		for (; bits != 0; bits &= bits - 1)
+		{
+			count++;
+		}
+		return count;
+	}
+
+	// 空の引数 (IndexCountPerInstanceが0) と、アルファテストで全て破棄されるメッシュレットは描画しない
+	bool IsSkipDrawCall(const MeshletCullInput& input, sl12::u32 drawCallIndex)
+	{
+		if (GetArg(input.pIndirectArgs, drawCallIndex)[1] == 0)
+		{
+			return true;
+		}
+		DrawCallData dc = LoadDrawCallData(input.pDrawCalls, input.drawCallSourceCount, drawCallIndex);
+		return input.pMeshlets[dc.meshletIndex].alphaClass == MESHLET_ALPHA_TRANSPARENT;
+	}
+
+	// ドローコールが属するサブメッシュの先頭のドローコール
+	sl12::u32 GetSegmentStart(const MeshletCullInput& input, sl12::u32 drawCallIndex)
+	{
+		DrawCallData dc = LoadDrawCallData(input.pDrawCalls, input.drawCallSourceCount, drawCallIndex);
+		sl12::u32 submeshIndex = input.pMeshlets[dc.meshletIndex].submeshIndex;
+		return drawCallIndex - (dc.meshletIndex - input.pSubmeshes[submeshIndex].meshletOffset);
+	}
+
+	// 詰めた引数の描画リストの先頭 (描画数の位置)
+	// メインビューは同じメッシュとマテリアルのサブメッシュが全インスタンスで1つのリストを共有する
+	sl12::u32 GetListStart(const MeshletCullInput& input, sl12::u32 drawCallIndex)
+	{
+		sl12::u32 segmentStart = GetSegmentStart(input, drawCallIndex);
+		return input.pDrawBuckets ? input.pDrawBuckets[segmentStart] : segmentStart;
+	}
+
+	// ソフトウェアオクルージョンで隠れたインスタンスはメインビューのカリングで描画しない (シャドウは対象外)
+	bool IsOccludedInstance(const InstanceData& instance)
+	{
+		return (instance.flags & INSTANCE_FLAG_OCCLUDED) != 0;
+	}
+
+	// 詰めた引数のroot constant (元のドローコール) から可視ビットを復元する
+	// 引数が自分の描画リストの範囲外にあるか、同じドローコールが2回現れたらfalse
+	bool GatherCompactedVisibleBits(const MeshletCullInput& input, const sl12::u8* pCompactArgs, const sl12::u32* pCounts, std::vector<sl12::u32>& outVisibleBits)
+	{
+		outVisibleBits.assign((input.drawCallCount + 31) / 32, 0);
+		for (sl12::u32 listStart = 0; listStart < input.drawCallCount; listStart++)
+		{
+			if (pCounts[listStart] > input.drawCallCount - listStart)
+			{
+				sl12::ConsolePrint("Error: compacted draw count overflow. (list %d : %d)\n", listStart, pCounts[listStart]);
+				return false;
+			}
+			for (sl12::u32 slot = 0; slot < pCounts[listStart]; slot++)
+			{
+				sl12::u32 drawCallIndex = GetArg(pCompactArgs, listStart + slot)[0];
+				if (drawCallIndex >= input.drawCallCount
+					|| GetListStart(input, drawCallIndex) != listStart
+					|| IsVisible(outVisibleBits, drawCallIndex))
+				{
+					sl12::ConsolePrint("Error: compacted draw call is invalid. (list %d, slot %d : %d)\n", listStart, slot, drawCallIndex);
+					return false;
+				}
+				outVisibleBits[drawCallIndex / 32] |= 0x01 << (drawCallIndex % 32);
+			}
+		}
+		return true;
+	}
+}
+
+//----
+void MeshletCullData::SetupInput(MeshletCullInput& outInput) const
+{
+	outInput.pInstances = (const InstanceData*)instances.data();
+	outInput.pDrawCalls = (const DrawCallSource*)drawCalls.data();
+	outInput.drawCallSourceCount = drawCallSourceCount;
+	outInput.pBounds = (const MeshletBoundData*)bounds.data();
+	outInput.pSubmeshes = (const SubmeshData*)submeshes.data();
+	outInput.pMeshlets = (const MeshletData*)meshlets.data();
+	outInput.pIndirectArgs = indirectArgs.data();
+	outInput.pDrawBuckets = drawBuckets.empty() ? nullptr : (const sl12::u32*)drawBuckets.data();
+	outInput.drawCallCount = drawCallCount;
+}
+
+//----
+DrawCallData LoadMeshletCullDrawCall(const MeshletCullInput& input, sl12::u32 drawCallIndex)
+{
+	return LoadDrawCallData(input.pDrawCalls, input.drawCallSourceCount, drawCallIndex);
+}
+
+//----
+MeshletBound LoadMeshletCullBound(const MeshletCullInput& input, const DrawCallData& dc)
+{
+	return LoadMeshletBound(input.pBounds[dc.meshletIndex], input.pInstances[dc.instanceIndex].mtxBoxTransform);
+}
+
+//----
+bool IsOcclusionCullReference(const DirectX::XMFLOAT3& aabbMin, const DirectX::XMFLOAT3& aabbMax, const DirectX::XMFLOAT2& hizSize, const MeshletCullHiZ& hiz, sl12::u32 mipLevel)
+{
+	return IsOcclusionCull(aabbMin, aabbMax, hizSize, hiz, mipLevel);
+}
+
+//----
+void GetMeshletCullDispatchSize(sl12::u32 drawCallCount, UINT& groupX, UINT& groupY)
+{
+	sl12::u32 groups = (drawCallCount + MESHLET_CULL_GROUP_SIZE - 1) / MESHLET_CULL_GROUP_SIZE;
+	groupX = std::min(groups, (sl12::u32)MESHLET_CULL_MAX_GROUP_X);
+	groupY = (groups + MESHLET_CULL_MAX_GROUP_X - 1) / MESHLET_CULL_MAX_GROUP_X;
+}
+
+//----
+sl12::u32 CullMeshletsReference(const MeshletCullInput& input, std::vector<sl12::u32>& outVisibleBits)
+{
+	outVisibleBits.assign((input.drawCallCount + 31) / 32, 0);
+
+	sl12::u32 visibleCount = 0;
+	for (sl12::u32 drawCallIndex = 0; drawCallIndex < input.drawCallCount; drawCallIndex++)
+	{
+		if (IsSkipDrawCall(input, drawCallIndex))
+		{
+			continue;
+		}
+
+		DrawCallData dc = LoadDrawCallData(input.pDrawCalls, input.drawCallSourceCount, drawCallIndex);
+		const InstanceData& instance = input.pInstances[dc.instanceIndex];
+		if (IsOccludedInstance(instance))
+		{
+			continue;
+		}
+
+		MeshletBound bound = LoadMeshletBound(input.pBounds[dc.meshletIndex], instance.mtxBoxTransform);
+		if (!IsFrustumCull(bound, input.frustumPlanes, instance.mtxLocalToWorld)
+			&& !IsBackfaceCull(bound, input.eyePosition, instance.mtxLocalToWorld))
+		{
+			outVisibleBits[drawCallIndex / 32] |= 0x01 << (drawCallIndex % 32);
+			visibleCount++;
+		}
+	}
+	return visibleCount;
+}
+
+//----
+bool ValidateMeshletCompaction(const MeshletCullInput& input, const std::vector<sl12::u32>& visibleBits, const sl12::u8* pCompactArgs, const sl12::u32* pCounts, bool bStrictOrder)
+{
+	// 0埋め方式で描画されるドローコールを描画リストごとに集める
+	std::vector<std::vector<sl12::u32>> expected(input.drawCallCount);
+	for (sl12::u32 drawCallIndex = 0; drawCallIndex < input.drawCallCount; drawCallIndex++)
+	{
+		if (IsSkipDrawCall(input, drawCallIndex) || !IsVisible(visibleBits, drawCallIndex))
+		{
+			continue;
+		}
+		expected[GetListStart(input, drawCallIndex)].push_back(drawCallIndex);
+	}
+
+	for (sl12::u32 listStart = 0; listStart < input.drawCallCount; listStart++)
+	{
+		auto&& drawCalls = expected[listStart];
+		if (pCounts[listStart] != (sl12::u32)drawCalls.size())
+		{
+			sl12::ConsolePrint("Error: compacted draw count mismatch. (list %d : %d/%d)\n",
+				listStart, pCounts[listStart], (int)drawCalls.size());
+			return false;
+		}
+
+		// 描画される引数のroot constantが元のドローコールを指し、引数が一致すること
+		std::vector<sl12::u32> actual;
+		for (sl12::u32 slot = 0; slot < pCounts[listStart]; slot++)
+		{
+			const sl12::u32* pArg = GetArg(pCompactArgs, listStart + slot);
+			sl12::u32 drawCallIndex = pArg[0];
+			if (drawCallIndex >= input.drawCallCount
+				|| memcmp(pArg + 1, GetArg(input.pIndirectArgs, drawCallIndex) + 1, kIndirectArgsBufferStride - sizeof(sl12::u32)) != 0)
+			{
+				sl12::ConsolePrint("Error: compacted draw args mismatch. (list %d, slot %d)\n", listStart, slot);
+				return false;
+			}
+			actual.push_back(drawCallIndex);
+		}
+		if (!bStrictOrder)
+		{
+			std::sort(actual.begin(), actual.end());
+		}
+		if (actual != drawCalls)
+		{
+			sl12::ConsolePrint("Error: compacted draw calls mismatch. (list %d)\n", listStart);
+			return false;
+		}
+	}
+
+	return true;
+}
+
+//----
+MeshletCullValidation ValidateMeshletCullGpuResult(const MeshletCullInput& input, const MeshletCullGpuResult& gpu)
+{
+	MeshletCullValidation ret;
+
+	std::vector<sl12::u32> referenceBits;
+	ret.referenceCount = CullMeshletsReference(input, referenceBits);
+
+	// オクルージョンカリングしない場合は1st passのみ
+	bool bOcclusion = gpu.pCompactArgs[1] != nullptr;
+	std::vector<sl12::u32> gpuBits[2];
+	for (int phase = 0; phase < (bOcclusion ? 2 : 1); phase++)
+	{
+		if (!GatherCompactedVisibleBits(input, gpu.pCompactArgs[phase], gpu.pCounts[phase], gpuBits[phase]))
+		{
+			ret.compactErrors++;
+			return ret;
+		}
+		for (auto bits : gpuBits[phase])
+		{
+			ret.visibleCount[phase] += CountBits(bits);
+		}
+		if (!ValidateMeshletCompaction(input, gpuBits[phase], gpu.pCompactArgs[phase], gpu.pCounts[phase], false))
+		{
+			ret.compactErrors++;
+		}
+	}
+
+	// HiZは読み戻さないので、オクルージョンカリングでは可視なドローコールがCPUの判定に含まれることだけ確認する
+	for (sl12::u32 i = 0; i < (sl12::u32)referenceBits.size(); i++)
+	{
+		sl12::u32 gpuVisible = gpuBits[0][i] | (bOcclusion ? gpuBits[1][i] : 0);
+		sl12::u32 diff = bOcclusion ? (gpuVisible & ~referenceBits[i]) : (gpuVisible ^ referenceBits[i]);
+		ret.mismatchCount += CountBits(diff);
+	}
+	if (!bOcclusion || !gpu.pDrawFlags)
+	{
+		return ret;
+	}
+
+	// DrawFlagが0になるのは、視錐台・背面カリングを通って1st passで描画されなかったドローコールだけ
+	std::vector<sl12::u32> expectedFlags(input.drawCallCount, 1);
+	for (sl12::u32 drawCallIndex = 0; drawCallIndex < input.drawCallCount; drawCallIndex++)
+	{
+		if (!IsSkipDrawCall(input, drawCallIndex) && IsVisible(referenceBits, drawCallIndex) && !IsVisible(gpuBits[0], drawCallIndex))
+		{
+			expectedFlags[drawCallIndex] = 0;
+		}
+	}
+	if (!ValidateMeshletDrawFlags(expectedFlags, gpu.pDrawFlags, input.drawCallCount))
+	{
+		ret.drawFlagErrors++;
+	}
+
+	// HiZなしの2nd passはDrawFlagが0のドローコールを全て描画するので、GPUの2nd passの結果はその部分集合になる
+	std::vector<sl12::u32> gpuFlags(gpu.pDrawFlags, gpu.pDrawFlags + input.drawCallCount);
+	std::vector<sl12::u32> candidateBits;
+	CullMeshletsOcclusion2ndReference(input, MeshletCullHiZ(), gpuFlags, candidateBits);
+	for (sl12::u32 i = 0; i < (sl12::u32)candidateBits.size(); i++)
+	{
+		ret.phaseErrors += CountBits(gpuBits[1][i] & (~candidateBits[i] | gpuBits[0][i]));
+	}
+	if (ret.phaseErrors > 0)
+	{
+		sl12::ConsolePrint("Error: 2nd pass draws %d draw calls not rejected by 1st pass.\n", ret.phaseErrors);
+	}
+
+	return ret;
+}
+
+//----
+sl12::u32 CullMeshletsOcclusion1stReference(const MeshletCullInput& input, const MeshletCullHiZ& prevHiZ, std::vector<sl12::u32>& outVisibleBits, std::vector<sl12::u32>& outDrawFlags)
+{
+	outVisibleBits.assign((input.drawCallCount + 31) / 32, 0);
+	outDrawFlags.assign(input.drawCallCount, 0);
+
+	sl12::u32 visibleCount = 0;
+	for (sl12::u32 drawCallIndex = 0; drawCallIndex < input.drawCallCount; drawCallIndex++)
+	{
+		// 空の引数と透明なメッシュレットは2nd passでもテストしない
+		if (IsSkipDrawCall(input, drawCallIndex))
+		{
+			outDrawFlags[drawCallIndex] = 1;
+			continue;
+		}
+
+		DrawCallData dc = LoadDrawCallData(input.pDrawCalls, input.drawCallSourceCount, drawCallIndex);
+		const InstanceData& instance = input.pInstances[dc.instanceIndex];
+		if (IsOccludedInstance(instance))
+		{
+			outDrawFlags[drawCallIndex] = 1;
+			continue;
+		}
+
+		MeshletBound bound = LoadMeshletBound(input.pBounds[dc.meshletIndex], instance.mtxBoxTransform);
+		bool visible = false;
+		bool nonOccCull = false;
+		if (!IsFrustumCull(bound, input.frustumPlanes, instance.mtxLocalToWorld)
+			&& !IsBackfaceCull(bound, input.eyePosition, instance.mtxLocalToWorld))
+		{
+			visible = !IsHiZCull(input, prevHiZ, bound, instance.mtxLocalToWorld);
+		}
+		else
+		{
+			nonOccCull = true;
+		}
+
+		outDrawFlags[drawCallIndex] = (visible || nonOccCull) ? 1 : 0;
+		if (visible)
+		{
+			outVisibleBits[drawCallIndex / 32] |= 0x01 << (drawCallIndex % 32);
+			visibleCount++;
+		}
+	}
+	return visibleCount;
+}
+
+//----
+sl12::u32 CullMeshletsOcclusion2ndReference(const MeshletCullInput& input, const MeshletCullHiZ& hiz, const std::vector<sl12::u32>& drawFlags, std::vector<sl12::u32>& outVisibleBits)
+{
+	outVisibleBits.assign((input.drawCallCount + 31) / 32, 0);
+
+	sl12::u32 visibleCount = 0;
+	for (sl12::u32 drawCallIndex = 0; drawCallIndex < input.drawCallCount; drawCallIndex++)
+	{
+		if (IsSkipDrawCall(input, drawCallIndex) || drawFlags[drawCallIndex] != 0)
+		{
+			continue;
+		}
+
+		DrawCallData dc = LoadDrawCallData(input.pDrawCalls, input.drawCallSourceCount, drawCallIndex);
+		const InstanceData& instance = input.pInstances[dc.instanceIndex];
+
+		MeshletBound bound = LoadMeshletBound(input.pBounds[dc.meshletIndex], instance.mtxBoxTransform);
+		if (!IsHiZCull(input, hiz, bound, instance.mtxLocalToWorld))
+		{
+			outVisibleBits[drawCallIndex / 32] |= 0x01 << (drawCallIndex % 32);
+			visibleCount++;
+		}
+	}
+	return visibleCount;
+}
+
+//----
+bool ValidateMeshletDrawFlags(const std::vector<sl12::u32>& expected, const sl12::u32* pDrawFlags, sl12::u32 drawCallCount)
+{
+	for (sl12::u32 drawCallIndex = 0; drawCallIndex < drawCallCount; drawCallIndex++)
+	{
+		if (expected[drawCallIndex] != pDrawFlags[drawCallIndex])
+		{
+			sl12::ConsolePrint("Error: draw flag mismatch. (drawcall %d : %d/%d)\n",
+				drawCallIndex, pDrawFlags[drawCallIndex], expected[drawCallIndex]);
+			return false;
+		}
+	}
+	return true;
+}
+
+//----
+void CalcShadowCasterPlanes(const DirectX::XMFLOAT4 cameraPlanes[6], const DirectX::XMFLOAT3& lightDir, DirectX::XMFLOAT4 outPlanes[6])
+{
+	for (int planeID = 0; planeID < 6; planeID++)
+	{
+		// 光の進行方向で面からの距離が減るなら、面の外側のキャスターの影は外側に留まる
+		DirectX::XMFLOAT3 plane_normal(cameraPlanes[planeID].x, cameraPlanes[planeID].y, cameraPlanes[planeID].z);
+		if (Dot(plane_normal, lightDir) <= 0.0f)
+		{
+			outPlanes[planeID] = cameraPlanes[planeID];
+		}
+		else
+		{
+			outPlanes[planeID] = DirectX::XMFLOAT4(0.0f, 0.0f, 0.0f, 1.0f);
+		}
+	}
+}
+
+//----
+sl12::u32 CullMeshletsShadowReference(const MeshletCullInput& input, const MeshletCullHiZ* pHiZ, std::vector<sl12::u32>& outVisibleBits)
+{
+	outVisibleBits.assign((input.drawCallCount + 31) / 32, 0);
+
+	// GPU側も履歴がない場合は視錐台カリングのみのシェーダを使う
+	bool bOcclusion = pHiZ && !pHiZ->mips.empty();
+
+	sl12::u32 visibleCount = 0;
+	for (sl12::u32 drawCallIndex = 0; drawCallIndex < input.drawCallCount; drawCallIndex++)
+	{
+		if (IsSkipDrawCall(input, drawCallIndex))
+		{
+			continue;
+		}
+
+		DrawCallData dc = LoadDrawCallData(input.pDrawCalls, input.drawCallSourceCount, drawCallIndex);
+		const InstanceData& instance = input.pInstances[dc.instanceIndex];
+
+		// シャドウマップは両面描画なので背面カリングしない
+		MeshletBound bound = LoadMeshletBound(input.pBounds[dc.meshletIndex], instance.mtxBoxTransform);
+		bool visible = !IsFrustumCull(bound, input.frustumPlanes, instance.mtxLocalToWorld);
+		if (visible && bOcclusion)
+		{
+			visible = !IsShadowHiZCull(input, *pHiZ, bound, instance.mtxLocalToWorld);
+		}
+		if (visible)
+		{
+			outVisibleBits[drawCallIndex / 32] |= 0x01 << (drawCallIndex % 32);
+			visibleCount++;
+		}
+	}
+	return visibleCount;
+}
+
+//----
+sl12::u32 ValidateShadowCullConservative(const MeshletCullInput& input, const DirectX::XMFLOAT4 cameraPlanes[6], const DirectX::XMFLOAT3& lightDir, const std::vector<sl12::u32>& visibleBits)
+{
+	sl12::u32 errorCount = 0;
+	for (sl12::u32 drawCallIndex = 0; drawCallIndex < input.drawCallCount; drawCallIndex++)
+	{
+		if (IsSkipDrawCall(input, drawCallIndex) || IsVisible(visibleBits, drawCallIndex))
+		{
+			continue;
+		}
+
+		DrawCallData dc = LoadDrawCallData(input.pDrawCalls, input.drawCallSourceCount, drawCallIndex);
+		const InstanceData& instance = input.pInstances[dc.instanceIndex];
+		MeshletBound bound = LoadMeshletBound(input.pBounds[dc.meshletIndex], instance.mtxBoxTransform);
+
+		// AABBの8頂点と中心
+		DirectX::XMFLOAT3 points[9];
+		for (int pointID = 0; pointID < 8; pointID++)
+		{
+			DirectX::XMFLOAT3 p(
+				(pointID & 0x04) ? bound.aabbMax.x : bound.aabbMin.x,
+				(pointID & 0x02) ? bound.aabbMax.y : bound.aabbMin.y,
+				(pointID & 0x01) ? bound.aabbMax.z : bound.aabbMin.z);
+			points[pointID] = TransformPoint(instance.mtxLocalToWorld, p);
+		}
+		points[8] = TransformPoint(instance.mtxLocalToWorld, DirectX::XMFLOAT3(
+			(bound.aabbMin.x + bound.aabbMax.x) * 0.5f,
+			(bound.aabbMin.y + bound.aabbMax.y) * 0.5f,
+			(bound.aabbMin.z + bound.aabbMax.z) * 0.5f));
+
+		for (auto&& p : points)
+		{
+			if (IsRayInFrustum(p, lightDir, cameraPlanes))
+			{
+				if (errorCount == 0)
+				{
+					sl12::ConsolePrint("Error: shadow caster culled but its shadow reaches the view. (drawcall %d)\n", drawCallIndex);
+				}
+				errorCount++;
+				break;
+			}
+		}
+	}
+	return errorCount;
+}
+
+//	EOF
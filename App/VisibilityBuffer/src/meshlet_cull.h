@@ -0,0 +1,138 @@
+﻿#pragma once
+
+#include "meshlet_resource.h"
+#include <vector>
+
+
+//----
+// meshlet_cull.c.hlsl の入力
+// GPUに送るバッファと同じ内容をCPU側で用意する
+struct MeshletCullInput
+{
+	const InstanceData*		pInstances = nullptr;
+	const DrawCallSource*	pDrawCalls = nullptr;
+	sl12::u32				drawCallSourceCount = 0;	// pDrawCallsの要素数
+	const MeshletBoundData*	pBounds = nullptr;			// MeshletDataと同じ配置
+	const SubmeshData*		pSubmeshes = nullptr;
+	const MeshletData*		pMeshlets = nullptr;
+	const sl12::u8*			pIndirectArgs = nullptr;	// カリング前のIndirectArg
+	const sl12::u32*		pDrawBuckets = nullptr;		// メインビューの描画リストの先頭 (nullptrならサブメッシュごとのリスト)
+	sl12::u32				drawCallCount = 0;
+	DirectX::XMFLOAT4		frustumPlanes[6];
+	DirectX::XMFLOAT3		eyePosition;
+	// オクルージョンカリング用 (SceneCBと同じ値)
+	DirectX::XMFLOAT4X4		mtxWorldToProj;
+	DirectX::XMFLOAT2		screenSize;
+	DirectX::XMFLOAT2		nearFar;
+};	// struct MeshletCullInput
+
+//----
+// HiZPass の出力と同じ内容のHiZ
+// mips[i] はミップレベルiの先頭で、行の詰め物はなし
+// mipsが空の場合はHiZの履歴がない最初のフレームと同じ扱い (オクルージョンカリングしない)
+struct MeshletCullHiZ
+{
+	sl12::u32					width = 0;		// ミップレベル0のサイズ
+	sl12::u32					height = 0;
+	std::vector<const float*>	mips;
+};	// struct MeshletCullHiZ
+
+//----
+// CPUカリング用のシーンバッファのコピー
+// MeshletResource::GatherCullData で永続バッファと同じ内容を取得する
+struct MeshletCullData
+{
+	std::vector<sl12::u8>	instances;		// InstanceData
+	std::vector<sl12::u8>	drawCalls;		// DrawCallSource
+	std::vector<sl12::u8>	bounds;			// MeshletBoundData
+	std::vector<sl12::u8>	submeshes;		// SubmeshData
+	std::vector<sl12::u8>	meshlets;		// MeshletData
+	std::vector<sl12::u8>	indirectArgs;
+	std::vector<sl12::u8>	drawBuckets;	// u32
+	sl12::u32				drawCallSourceCount = 0;
+	sl12::u32				drawCallCount = 0;
+
+	// バッファ部分を設定する (カメラの値は呼び出し側で設定する)
+	void SetupInput(MeshletCullInput& outInput) const;
+};	// struct MeshletCullData
+
+// meshlet_cull.c.hlsl のDispatchサイズ
+void GetMeshletCullDispatchSize(sl12::u32 drawCallCount, UINT& groupX, UINT& groupY);
+
+// visibility_buffer.hlsli の LoadDrawCallData と culling.hlsli の LoadMeshletBound
+DrawCallData LoadMeshletCullDrawCall(const MeshletCullInput& input, sl12::u32 drawCallIndex);
+MeshletBound LoadMeshletCullBound(const MeshletCullInput& input, const DrawCallData& dc);
+
+// culling.hlsli の IsOcclusionCull
+// aabbMin/aabbMaxは ToScreenAABB の出力 (xyは[0, 1]のスクリーン座標)
+bool IsOcclusionCullReference(const DirectX::XMFLOAT3& aabbMin, const DirectX::XMFLOAT3& aabbMax, const DirectX::XMFLOAT2& hizSize, const MeshletCullHiZ& hiz, sl12::u32 mipLevel);
+
+// meshlet_cull.c.hlsl と同じ判定で可視なドローコールのビットを立てる
+//   outVisibleBits[index / 32] & (1 << (index % 32))
+// IndirectArgが空のドローコール(削除済みインスタンス)とソフトウェアオクルージョンで隠れたインスタンスは不可視として扱う
+// 戻り値は可視なドローコール数
+// 演算順序はシェーダに合わせているが、GPUのrsqrt精度の差で判定境界上のメッシュレットは結果が異なる可能性がある
+sl12::u32 CullMeshletsReference(const MeshletCullInput& input, std::vector<sl12::u32>& outVisibleBits);
+
+// コンパクションの結果を、従来の0埋め方式 (不可視のIndexCountPerInstanceを0にする) と比較する
+// 描画リストごとの描画数と、描画される引数が一致することを確認する
+// GPUは描画リスト内の順序が不定なので、bStrictOrderがfalseの場合は順序を比較しない
+bool ValidateMeshletCompaction(const MeshletCullInput& input, const std::vector<sl12::u32>& visibleBits, const sl12::u8* pCompactArgs, const sl12::u32* pCounts, bool bStrictOrder);
+
+// MeshletCullingPass から読み戻したGPUのカリング結果
+struct MeshletCullGpuResult
+{
+	const sl12::u8*		pCompactArgs[2] = {};	// [0]:1st pass, [1]:2nd pass (オクルージョンカリングしない場合はnullptr)
+	const sl12::u32*	pCounts[2] = {};
+	const sl12::u32*	pDrawFlags = nullptr;	// kDrawFlagID (オクルージョンカリングしない場合はnullptr)
+};	// struct MeshletCullGpuResult
+
+struct MeshletCullValidation
+{
+	sl12::u32	compactErrors = 0;		// 詰めた引数と描画数の不整合
+	sl12::u32	drawFlagErrors = 0;		// DrawFlagと1st passの結果の不整合
+	sl12::u32	phaseErrors = 0;		// 2nd passで1st passの可視か、DrawFlagが0でないドローコールを描画した
+	sl12::u32	visibleCount[2] = {};	// GPUで可視なドローコール数
+	sl12::u32	referenceCount = 0;		// CPUの視錐台・背面カリングで可視なドローコール数
+	sl12::u32	mismatchCount = 0;		// 視錐台・背面カリングの判定がCPUと異なるドローコール数
+};	// struct MeshletCullValidation
+
+// GPUのカリング結果を検証する
+// 詰めた引数のroot constantから可視ビットを復元し、ValidateMeshletCompaction で描画数と引数を確認する
+// 判定境界上のメッシュレットはrsqrt精度の差で結果が変わりうるので、CPUとの判定の差はエラーとは別に数える
+// オクルージョンカリングでは、DrawFlagを ValidateMeshletDrawFlags で、2nd passの結果をHiZなしの CullMeshletsOcclusion2ndReference で確認する
+// HiZは読み戻さないので、HiZの判定そのものは比較しない
+MeshletCullValidation ValidateMeshletCullGpuResult(const MeshletCullInput& input, const MeshletCullGpuResult& gpu);
+
+// meshlet_cull_1st.c.hlsl と同じ判定で、前フレームのHiZを使って可視なドローコールのビットを立てる
+//   outDrawFlags : kDrawFlagID と同じ内容 (HiZでカリングされたドローコールだけ0)
+// 戻り値は可視なドローコール数
+sl12::u32 CullMeshletsOcclusion1stReference(const MeshletCullInput& input, const MeshletCullHiZ& prevHiZ, std::vector<sl12::u32>& outVisibleBits, std::vector<sl12::u32>& outDrawFlags);
+
+// meshlet_cull_2nd.c.hlsl と同じ判定で、1st passでHiZカリングされたドローコールを現在のHiZで再テストする
+// 1st passと2nd passの可視ビットは重ならない
+// 戻り値は可視なドローコール数
+sl12::u32 CullMeshletsOcclusion2ndReference(const MeshletCullInput& input, const MeshletCullHiZ& hiz, const std::vector<sl12::u32>& drawFlags, std::vector<sl12::u32>& outVisibleBits);
+
+// GPUが出力した kDrawFlagID の内容をCPUの判定と比較する
+// 各パスの描画引数は ValidateMeshletCompaction でパスごとの可視ビットと比較する
+bool ValidateMeshletDrawFlags(const std::vector<sl12::u32>& expected, const sl12::u32* pDrawFlags, sl12::u32 drawCallCount);
+
+// シャドウキャスター用の視錐台平面
+// ライトの進行方向(lightDir)に沿って距離が増える面は、外側のキャスターの影が視錐台に入りうるので常に内側になる面に置き換える
+void CalcShadowCasterPlanes(const DirectX::XMFLOAT4 cameraPlanes[6], const DirectX::XMFLOAT3& lightDir, DirectX::XMFLOAT4 outPlanes[6]);
+
+// meshlet_cull_shadow.c.hlsl / meshlet_cull_shadow_occ.c.hlsl と同じ判定で可視なドローコールのビットを立てる
+//   input.frustumPlanes : CalcShadowCasterPlanes の出力
+//   input.mtxWorldToProj : ShadowCBの行列
+// pHiZがnullか履歴がない場合は視錐台カリングのみ
+// 戻り値は可視なドローコール数
+sl12::u32 CullMeshletsShadowReference(const MeshletCullInput& input, const MeshletCullHiZ* pHiZ, std::vector<sl12::u32>& outVisibleBits);
+
+// シャドウの視錐台カリングが保守的であることを検証する
+// カリングされたドローコールのAABBの頂点と中心からライト方向にレイを飛ばし、カメラの視錐台に入るものを数える
+// visibleBitsはHiZなしの CullMeshletsShadowReference の結果を渡す
+// 戻り値は誤ってカリングされたドローコール数 (0なら保守的)
+sl12::u32 ValidateShadowCullConservative(const MeshletCullInput& input, const DirectX::XMFLOAT4 cameraPlanes[6], const DirectX::XMFLOAT3& lightDir, const std::vector<sl12::u32>& visibleBits);
+
+//	EOF
@@ -0,0 +1,527 @@
+﻿#include "meshlet_cull_simd.h"
+
+#include "pass/render_resource_settings.h"
+#include <algorithm>
+#include <cfloat>
+#include <chrono>
+#include <execution>
+#include <thread>
+#if defined(_M_X64)
+#include <immintrin.h>
+#include <intrin.h>
+#endif
+
+#define USE_IN_CPP
+#include "../shaders/cbuffer.hlsli"
+
+
+namespace
+{
+	// 1インスタンスのシーンでも並列化できるように、ドローコール範囲を分割する
+	static const sl12::u32 kMaxRunDrawCalls = 1024;
+
+	//----
+	// 4レーン (DirectXMathのXMVECTOR、SSE2/NEON)
+	struct Lanes4
+	{
+		typedef DirectX::XMVECTOR V;
+		static const sl12::u32 kCount = 4;
+
+		static V Load(const float* p) { return DirectX::XMLoadFloat4(reinterpret_cast<const DirectX::XMFLOAT4*>(p)); }
+		static void Store(float* p, V v) { DirectX::XMStoreFloat4(reinterpret_cast<DirectX::XMFLOAT4*>(p), v); }
+		static V Replicate(float v) { return DirectX::XMVectorReplicate(v); }
+		static V Zero() { return DirectX::XMVectorZero(); }
+		static V One() { return DirectX::XMVectorSplatOne(); }
+		static V True() { return DirectX::XMVectorTrueInt(); }
+		static V Add(V a, V b) { return DirectX::XMVectorAdd(a, b); }
+		static V Sub(V a, V b) { return DirectX::XMVectorSubtract(a, b); }
+		static V Mul(V a, V b) { return DirectX::XMVectorMultiply(a, b); }
+		static V MulAdd(V a, V b, V c) { return DirectX::XMVectorMultiplyAdd(a, b, c); }
+		static V Div(V a, V b) { return DirectX::XMVectorDivide(a, b); }
+		static V Sqrt(V v) { return DirectX::XMVectorSqrt(v); }
+		static V Min(V a, V b) { return DirectX::XMVectorMin(a, b); }
+		static V Max(V a, V b) { return DirectX::XMVectorMax(a, b); }
+		static V Clamp(V v, V lo, V hi) { return DirectX::XMVectorClamp(v, lo, hi); }
+		static V Less(V a, V b) { return DirectX::XMVectorLess(a, b); }
+		static V LessEq(V a, V b) { return DirectX::XMVectorLessOrEqual(a, b); }
+		static V GreaterEq(V a, V b) { return DirectX::XMVectorGreaterOrEqual(a, b); }
+		static V And(V a, V b) { return DirectX::XMVectorAndInt(a, b); }
+		// レーンごとの判定結果をビットに詰める
+		static sl12::u32 Mask(V v)
+		{
+			sl12::u32 m[4];
+			DirectX::XMStoreInt4(m, v);
+			return (m[0] ? 0x01 : 0) | (m[1] ? 0x02 : 0) | (m[2] ? 0x04 : 0) | (m[3] ? 0x08 : 0);
+		}
+		static void End() {}
+	};	// struct Lanes4
+
+#if defined(_M_X64)
+	//----
+	// 8レーン (AVX)
+	// 浮動小数点演算のみなのでAVX2の整数命令は使わない
+	// 4レーン版と結果を合わせるため、FMAは使わずに乗算と加算を分ける (XMVectorMultiplyAddのSSE実装と同じ)
+	struct Lanes8
+	{
+		typedef __m256 V;
+		static const sl12::u32 kCount = 8;
+
+		static V Load(const float* p) { return _mm256_loadu_ps(p); }
+		static void Store(float* p, V v) { _mm256_storeu_ps(p, v); }
+		static V Replicate(float v) { return _mm256_set1_ps(v); }
+		static V Zero() { return _mm256_setzero_ps(); }
+		static V One() { return _mm256_set1_ps(1.0f); }
+		static V True() { return _mm256_castsi256_ps(_mm256_set1_epi32(-1)); }
+		static V Add(V a, V b) { return _mm256_add_ps(a, b); }
+		static V Sub(V a, V b) { return _mm256_sub_ps(a, b); }
+		static V Mul(V a, V b) { return _mm256_mul_ps(a, b); }
+		static V MulAdd(V a, V b, V c) { return _mm256_add_ps(_mm256_mul_ps(a, b), c); }
+		static V Div(V a, V b) { return _mm256_div_ps(a, b); }
+		static V Sqrt(V v) { return _mm256_sqrt_ps(v); }
+		static V Min(V a, V b) { return _mm256_min_ps(a, b); }
+		static V Max(V a, V b) { return _mm256_max_ps(a, b); }
+		static V Clamp(V v, V lo, V hi) { return _mm256_min_ps(hi, _mm256_max_ps(lo, v)); }
+		static V Less(V a, V b) { return _mm256_cmp_ps(a, b, _CMP_LT_OQ); }
+		static V LessEq(V a, V b) { return _mm256_cmp_ps(a, b, _CMP_LE_OQ); }
+		static V GreaterEq(V a, V b) { return _mm256_cmp_ps(a, b, _CMP_GE_OQ); }
+		static V And(V a, V b) { return _mm256_and_ps(a, b); }
+		static sl12::u32 Mask(V v) { return (sl12::u32)_mm256_movemask_ps(v); }
+		// SSEの命令に戻る前にYMMレジスタの上位をクリアする
+		static void End() { _mm256_zeroupper(); }
+	};	// struct Lanes8
+#endif
+
+	// 8レーン版はCPUとOSがAVXに対応している場合のみ使う
+	bool IsAvxSupported()
+	{
+#if defined(_M_X64)
+		int info[4];
+		__cpuid(info, 1);
+		bool bOsxsave = (info[2] & (0x01 << 27)) != 0;
+		bool bAvx = (info[2] & (0x01 << 28)) != 0;
+		if (!bOsxsave || !bAvx)
+		{
+			return false;
+		}
+		// OSがYMMレジスタを保存するか
+		return (_xgetbv(0) & 0x06) == 0x06;
+#else
+		return false;
+#endif
+	}
+
+	// 同じインスタンスの連続したドローコール (空の引数は含まない)
+	struct InstanceRun
+	{
+		sl12::u32	drawCallStart;
+		sl12::u32	drawCallCount;
+		sl12::u32	instanceIndex;
+	};
+
+	// インスタンス単位の定数
+	// 平面と行列は要素ごとに全レーンへ複製しておく
+	template <typename L>
+	struct InstanceContext
+	{
+		typename L::V	localPlanes[6][4];		// ローカル空間のフラスタム平面
+		typename L::V	mtxLocalToWorld[4][4];
+		typename L::V	mtxLocalToProj[4][4];
+	};
+
+	// レーン数分のメッシュレットバウンド (SoA)
+	template <typename L>
+	struct BoundLanes
+	{
+		typename L::V	aabbMin[3];
+		typename L::V	aabbMax[3];
+		typename L::V	coneApex[3];
+		typename L::V	coneAxis[3];
+		typename L::V	coneCutoff;
+	};
+
+	std::vector<InstanceRun> BuildInstanceRuns(const MeshletCullInput& input)
+	{
+		std::vector<InstanceRun> runs;
+		bool bContinue = false;
+		for (sl12::u32 drawCallIndex = 0; drawCallIndex < input.drawCallCount; drawCallIndex++)
+		{
+			// IndexCountPerInstanceが0なら空の引数 (削除済みインスタンス)
+			const sl12::u32* pArg = (const sl12::u32*)(input.pIndirectArgs + drawCallIndex * kIndirectArgsBufferStride);
+			if (pArg[1] == 0)
+			{
+				bContinue = false;
+				continue;
+			}
+
+			// アルファテストで全て破棄されるメッシュレットも描画しない
+			DrawCallData dc = LoadMeshletCullDrawCall(input, drawCallIndex);
+			if (input.pMeshlets[dc.meshletIndex].alphaClass == MESHLET_ALPHA_TRANSPARENT)
+			{
+				bContinue = false;
+				continue;
+			}
+
+			// ソフトウェアオクルージョンで隠れたインスタンスはメインビューでは描画しない
+			sl12::u32 instanceIndex = dc.instanceIndex;
+			if (input.pInstances[instanceIndex].flags & INSTANCE_FLAG_OCCLUDED)
+			{
+				bContinue = false;
+				continue;
+			}
+
+			if (!bContinue || runs.back().instanceIndex != instanceIndex || runs.back().drawCallCount >= kMaxRunDrawCalls)
+			{
+				runs.push_back({drawCallIndex, 0, instanceIndex});
+			}
+			runs.back().drawCallCount++;
+			bContinue = true;
+		}
+		return runs;
+	}
+
+	template <typename L>
+	void SetupInstanceContext(const MeshletCullInput& input, const InstanceData& instance, InstanceContext<L>& outContext)
+	{
+		DirectX::XMMATRIX mtxLocalToWorld = DirectX::XMLoadFloat4x4(&instance.mtxLocalToWorld);
+		DirectX::XMFLOAT4X4 mtxLocalToProj;
+		DirectX::XMStoreFloat4x4(&mtxLocalToProj, mtxLocalToWorld * DirectX::XMLoadFloat4x4(&input.mtxWorldToProj));
+		for (int r = 0; r < 4; r++)
+		{
+			for (int c = 0; c < 4; c++)
+			{
+				outContext.mtxLocalToWorld[r][c] = L::Replicate(instance.mtxLocalToWorld.m[r][c]);
+				outContext.mtxLocalToProj[r][c] = L::Replicate(mtxLocalToProj.m[r][c]);
+			}
+		}
+
+		// dot(plane, p * M) = dot(M * plane, p)
+		DirectX::XMMATRIX mtxT = DirectX::XMMatrixTranspose(mtxLocalToWorld);
+		for (int i = 0; i < 6; i++)
+		{
+			DirectX::XMFLOAT4 plane;
+			DirectX::XMStoreFloat4(&plane, DirectX::XMVector4Transform(DirectX::XMLoadFloat4(&input.frustumPlanes[i]), mtxT));
+			outContext.localPlanes[i][0] = L::Replicate(plane.x);
+			outContext.localPlanes[i][1] = L::Replicate(plane.y);
+			outContext.localPlanes[i][2] = L::Replicate(plane.z);
+			outContext.localPlanes[i][3] = L::Replicate(plane.w);
+		}
+	}
+
+	// p * m の各成分 (SoA)
+	template <typename L>
+	void TransformLanes(const typename L::V m[4][4], const typename L::V p[3], bool bTranslate, typename L::V out[4], int outCount)
+	{
+		for (int c = 0; c < outCount; c++)
+		{
+			typename L::V r = bTranslate ? m[3][c] : L::Zero();
+			r = L::MulAdd(p[2], m[2][c], r);
+			r = L::MulAdd(p[1], m[1][c], r);
+			r = L::MulAdd(p[0], m[0][c], r);
+			out[c] = r;
+		}
+	}
+
+	template <typename L>
+	typename L::V DotLanes(const typename L::V a[3], const typename L::V b[3])
+	{
+		typename L::V r = L::Mul(a[0], b[0]);
+		r = L::MulAdd(a[1], b[1], r);
+		return L::MulAdd(a[2], b[2], r);
+	}
+
+	template <typename L>
+	void NormalizeLanes(typename L::V v[3])
+	{
+		typename L::V s = L::Div(L::One(), L::Sqrt(DotLanes<L>(v, v)));
+		for (int i = 0; i < 3; i++)
+		{
+			v[i] = L::Mul(v[i], s);
+		}
+	}
+
+	// culling.hlsli の IsFrustumCull
+	// AABBの頂点のうち平面の法線方向に最も遠い頂点だけをテストする
+	template <typename L>
+	typename L::V FrustumVisibleLanes(const InstanceContext<L>& context, const BoundLanes<L>& bound)
+	{
+		typename L::V visible = L::True();
+		for (int i = 0; i < 6; i++)
+		{
+			const typename L::V* plane = context.localPlanes[i];
+			typename L::V d = plane[3];
+			for (int axis = 0; axis < 3; axis++)
+			{
+				typename L::V a = L::Mul(plane[axis], bound.aabbMin[axis]);
+				typename L::V b = L::Mul(plane[axis], bound.aabbMax[axis]);
+				d = L::Add(d, L::Max(a, b));
+			}
+			visible = L::And(visible, L::GreaterEq(d, L::Zero()));
+		}
+		return visible;
+	}
+
+	// culling.hlsli の IsBackfaceCull
+	template <typename L>
+	typename L::V BackfaceVisibleLanes(const InstanceContext<L>& context, const BoundLanes<L>& bound, const DirectX::XMFLOAT3& camPos)
+	{
+		typename L::V apex[4], axis[4];
+		TransformLanes<L>(context.mtxLocalToWorld, bound.coneApex, true, apex, 3);
+		TransformLanes<L>(context.mtxLocalToWorld, bound.coneAxis, false, axis, 3);
+		NormalizeLanes<L>(axis);
+
+		typename L::V dir[3] = {
+			L::Sub(apex[0], L::Replicate(camPos.x)),
+			L::Sub(apex[1], L::Replicate(camPos.y)),
+			L::Sub(apex[2], L::Replicate(camPos.z)),
+		};
+		NormalizeLanes<L>(dir);
+		return L::Less(DotLanes<L>(dir, axis), bound.coneCutoff);
+	}
+
+	// culling.hlsli の ToScreenAABB
+	// 戻り値はnear面と交差するレーン
+	template <typename L>
+	typename L::V ScreenAABBLanes(const InstanceContext<L>& context, const BoundLanes<L>& bound, float nearZ, typename L::V aabbMin[3], typename L::V aabbMax[3])
+	{
+		typename L::V minW = L::Replicate(FLT_MAX);
+		for (int pointID = 0; pointID < 8; pointID++)
+		{
+			typename L::V p[3] = {
+				(pointID & 0x04) ? bound.aabbMax[0] : bound.aabbMin[0],
+				(pointID & 0x02) ? bound.aabbMax[1] : bound.aabbMin[1],
+				(pointID & 0x01) ? bound.aabbMax[2] : bound.aabbMin[2],
+			};
+			typename L::V clip[4];
+			TransformLanes<L>(context.mtxLocalToProj, p, true, clip, 4);
+
+			typename L::V invW = L::Div(L::One(), clip[3]);
+			typename L::V sp[3] = {
+				L::MulAdd(L::Mul(clip[0], invW), L::Replicate(0.5f), L::Replicate(0.5f)),
+				L::MulAdd(L::Mul(clip[1], invW), L::Replicate(-0.5f), L::Replicate(0.5f)),
+				L::Mul(clip[2], invW),
+			};
+			for (int i = 0; i < 3; i++)
+			{
+				aabbMin[i] = (pointID == 0) ? sp[i] : L::Min(aabbMin[i], sp[i]);
+				aabbMax[i] = (pointID == 0) ? sp[i] : L::Max(aabbMax[i], sp[i]);
+			}
+			minW = L::Min(minW, clip[3]);
+		}
+
+		typename L::V zero = L::Zero(), one = L::One();
+		for (int i = 0; i < 2; i++)
+		{
+			aabbMin[i] = L::Clamp(aabbMin[i], zero, one);
+			aabbMax[i] = L::Clamp(aabbMax[i], zero, one);
+		}
+		aabbMin[2] = L::Min(aabbMin[2], one);
+		aabbMax[2] = L::Min(aabbMax[2], one);
+		return L::LessEq(minW, L::Replicate(nearZ));
+	}
+
+	template <typename L>
+	void CullRun(const MeshletCullInput& input, const MeshletCullHiZ* pHiZ, const InstanceRun& run, sl12::u8* pVisible)
+	{
+		const sl12::u32 kLaneCount = L::kCount;
+
+		InstanceContext<L> context;
+		SetupInstanceContext<L>(input, input.pInstances[run.instanceIndex], context);
+		DirectX::XMFLOAT2 hizSize(input.screenSize.x * 0.5f, input.screenSize.y * 0.5f);
+
+		for (sl12::u32 base = 0; base < run.drawCallCount; base += kLaneCount)
+		{
+			// レーン数分のバウンドを読み込んでSoAに並べ替える
+			// 範囲外のレーンは最後のドローコールのバウンドで埋めて、結果を捨てる
+			float soa[13][kLaneCount];
+			for (sl12::u32 lane = 0; lane < kLaneCount; lane++)
+			{
+				sl12::u32 index = std::min(base + lane, run.drawCallCount - 1);
+				MeshletBound bound = LoadMeshletCullBound(input, LoadMeshletCullDrawCall(input, run.drawCallStart + index));
+				for (int i = 0; i < 3; i++)
+				{
+					soa[0 + i][lane] = (&bound.aabbMin.x)[i];
+					soa[3 + i][lane] = (&bound.aabbMax.x)[i];
+					soa[6 + i][lane] = (&bound.coneApex.x)[i];
+					soa[9 + i][lane] = (&bound.coneAxis.x)[i];
+				}
+				soa[12][lane] = bound.coneCutoff;
+			}
+
+			BoundLanes<L> lanes;
+			for (int i = 0; i < 3; i++)
+			{
+				lanes.aabbMin[i] = L::Load(soa[0 + i]);
+				lanes.aabbMax[i] = L::Load(soa[3 + i]);
+				lanes.coneApex[i] = L::Load(soa[6 + i]);
+				lanes.coneAxis[i] = L::Load(soa[9 + i]);
+			}
+			lanes.coneCutoff = L::Load(soa[12]);
+
+			typename L::V visible = FrustumVisibleLanes<L>(context, lanes);
+			visible = L::And(visible, BackfaceVisibleLanes<L>(context, lanes, input.eyePosition));
+			sl12::u32 visibleMask = L::Mask(visible);
+
+			if (pHiZ && visibleMask)
+			{
+				// HiZのテクセル範囲はレーンごとに異なるので、スクリーンAABBまでをSIMDで計算する
+				typename L::V aabbMin[3], aabbMax[3];
+				sl12::u32 nearMask = L::Mask(ScreenAABBLanes<L>(context, lanes, input.nearFar.x, aabbMin, aabbMax));
+
+				float minLanes[3][kLaneCount], maxLanes[3][kLaneCount];
+				for (int i = 0; i < 3; i++)
+				{
+					L::Store(minLanes[i], aabbMin[i]);
+					L::Store(maxLanes[i], aabbMax[i]);
+				}
+
+				for (sl12::u32 lane = 0; lane < kLaneCount; lane++)
+				{
+					sl12::u32 bit = 0x01 << lane;
+					if (!(visibleMask & bit) || (nearMask & bit))
+					{
+						continue;
+					}
+					DirectX::XMFLOAT3 laneMin(minLanes[0][lane], minLanes[1][lane], minLanes[2][lane]);
+					DirectX::XMFLOAT3 laneMax(maxLanes[0][lane], maxLanes[1][lane], maxLanes[2][lane]);
+					if (IsOcclusionCullReference(laneMin, laneMax, hizSize, *pHiZ, 5))
+					{
+						visibleMask &= ~bit;
+					}
+				}
+			}
+
+			for (sl12::u32 lane = 0; lane < kLaneCount && base + lane < run.drawCallCount; lane++)
+			{
+				pVisible[run.drawCallStart + base + lane] = (visibleMask >> lane) & 0x01;
+			}
+		}
+		L::End();
+	}
+
+	template <typename L>
+	void CullRuns(const MeshletCullInput& input, const MeshletCullHiZ* pHiZ, const std::vector<InstanceRun>& runs, bool bParallel, sl12::u8* pVisible)
+	{
+		auto CullFunc = [&](const InstanceRun& run)
+		{
+			CullRun<L>(input, pHiZ, run, pVisible);
+		};
+		if (bParallel)
+		{
+			std::for_each(std::execution::par, runs.begin(), runs.end(), CullFunc);
+		}
+		else
+		{
+			std::for_each(runs.begin(), runs.end(), CullFunc);
+		}
+	}
+
+	bool IsVisibleBit(const std::vector<sl12::u32>& visibleBits, sl12::u32 drawCallIndex)
+	{
+		return (visibleBits[drawCallIndex / 32] & (0x01 << (drawCallIndex % 32))) != 0;
+	}
+
+	sl12::u32 CullMeshletsScalar(const MeshletCullInput& input, const MeshletCullHiZ* pHiZ, std::vector<sl12::u32>& outVisibleBits)
+	{
+		if (pHiZ)
+		{
+			std::vector<sl12::u32> drawFlags;
+			return CullMeshletsOcclusion1stReference(input, *pHiZ, outVisibleBits, drawFlags);
+		}
+		return CullMeshletsReference(input, outVisibleBits);
+	}
+}
+
+//----
+sl12::u32 GetMeshletCullSimdLaneCount()
+{
+	static const bool kAvxSupported = IsAvxSupported();
+	return kAvxSupported ? 8 : 4;
+}
+
+//----
+sl12::u32 CullMeshletsSimd(const MeshletCullInput& input, const MeshletCullHiZ* pHiZ, bool bParallel, std::vector<sl12::u32>& outVisibleBits, sl12::u32 laneCount)
+{
+	std::vector<InstanceRun> runs = BuildInstanceRuns(input);
+
+	// ビット単位の書き込みはスレッド間で競合するので、ドローコールごとのバイトに書き込んでから詰める
+	std::vector<sl12::u8> visible(input.drawCallCount, 0);
+#if defined(_M_X64)
+	if (laneCount != 4 && GetMeshletCullSimdLaneCount() == 8)
+	{
+		CullRuns<Lanes8>(input, pHiZ, runs, bParallel, visible.data());
+	}
+	else
+#endif
+	{
+		CullRuns<Lanes4>(input, pHiZ, runs, bParallel, visible.data());
+	}
+
+	outVisibleBits.assign((input.drawCallCount + 31) / 32, 0);
+	sl12::u32 visibleCount = 0;
+	for (sl12::u32 drawCallIndex = 0; drawCallIndex < input.drawCallCount; drawCallIndex++)
+	{
+		if (visible[drawCallIndex])
+		{
+			outVisibleBits[drawCallIndex / 32] |= 0x01 << (drawCallIndex % 32);
+			visibleCount++;
+		}
+	}
+	return visibleCount;
+}
+
+//----
+sl12::u32 CompareMeshletCullSimd(const MeshletCullInput& input, const MeshletCullHiZ* pHiZ, sl12::u32 laneCount)
+{
+	std::vector<sl12::u32> simdBits, scalarBits;
+	CullMeshletsSimd(input, pHiZ, true, simdBits, laneCount);
+	CullMeshletsScalar(input, pHiZ, scalarBits);
+
+	sl12::u32 mismatchCount = 0;
+	for (sl12::u32 drawCallIndex = 0; drawCallIndex < input.drawCallCount; drawCallIndex++)
+	{
+		if (IsVisibleBit(simdBits, drawCallIndex) != IsVisibleBit(scalarBits, drawCallIndex))
+		{
+			mismatchCount++;
+		}
+	}
+	return mismatchCount;
+}
+
+//----
+MeshletCullBenchmarkResult RunMeshletCullBenchmark(const MeshletCullInput& input, const MeshletCullHiZ* pHiZ, sl12::u32 iterations)
+{
+	MeshletCullBenchmarkResult ret;
+	ret.drawCallCount = input.drawCallCount;
+	ret.threadCount = std::max(std::thread::hardware_concurrency(), 1u);
+	ret.laneCount = GetMeshletCullSimdLaneCount();
+	if (input.drawCallCount == 0 || iterations == 0)
+	{
+		return ret;
+	}
+
+	auto Measure = [&](auto func)
+	{
+		std::vector<sl12::u32> bits;
+		auto start = std::chrono::high_resolution_clock::now();
+		for (sl12::u32 i = 0; i < iterations; i++)
+		{
+			func(bits);
+		}
+		auto end = std::chrono::high_resolution_clock::now();
+		double sec = std::chrono::duration<double>(end - start).count();
+		return (sec > 0.0) ? (double)input.drawCallCount * iterations / sec : 0.0;
+	};
+
+	ret.scalarRate = Measure([&](std::vector<sl12::u32>& bits) { CullMeshletsScalar(input, pHiZ, bits); });
+	ret.simdRate = Measure([&](std::vector<sl12::u32>& bits) { CullMeshletsSimd(input, pHiZ, false, bits, 4); });
+	ret.mismatchCount = CompareMeshletCullSimd(input, pHiZ, 4);
+	if (ret.laneCount == 8)
+	{
+		ret.simdWideRate = Measure([&](std::vector<sl12::u32>& bits) { CullMeshletsSimd(input, pHiZ, false, bits, 8); });
+		ret.mismatchCount += CompareMeshletCullSimd(input, pHiZ, 8);
+	}
+	ret.simdParallelRate = Measure([&](std::vector<sl12::u32>& bits) { CullMeshletsSimd(input, pHiZ, true, bits, ret.laneCount); });
+	return ret;
+}
+
+//	EOF
@@ -0,0 +1,47 @@
+﻿#pragma once
+
+#include "meshlet_cull.h"
+
+
+//----
+// culling.hlsli のカリングのCPU版
+// GPUカリングの検証と計測用で、結果は描画には使わない (描画は常に MeshletCullingPass の出力を使う)
+// CPU駆動の描画モードは未実装で、CPUの結果からIndirectArgを作る経路はない
+// メッシュレットをSoAでまとめて処理する
+//   4レーン : DirectXMathのXMVECTOR (SSE2/NEON)
+//   8レーン : AVX (x64でCPUとOSが対応している場合のみ)
+// インスタンスごとのドローコール範囲を単位に並列化する
+// 判定はスカラー版 (CullMeshletsReference / CullMeshletsOcclusion1stReference) と同じ
+//   pHiZがnullptrの場合はフラスタムと背面カリングのみ
+//   pHiZを指定した場合はさらにHiZでオクルージョンカリングする
+// フラスタムカリングはローカル空間に変換した平面で行うため、判定境界上のメッシュレットはスカラー版と一致しない可能性がある
+// laneCountは4か8で、0なら使える最大のレーン数 (8が使えない場合は4)
+// 戻り値は可視なドローコール数
+sl12::u32 CullMeshletsSimd(const MeshletCullInput& input, const MeshletCullHiZ* pHiZ, bool bParallel, std::vector<sl12::u32>& outVisibleBits, sl12::u32 laneCount = 0);
+
+// この環境で使える最大のレーン数 (4か8)
+sl12::u32 GetMeshletCullSimdLaneCount();
+
+// CullMeshletsSimdとスカラー版の結果が一致しないドローコール数
+sl12::u32 CompareMeshletCullSimd(const MeshletCullInput& input, const MeshletCullHiZ* pHiZ, sl12::u32 laneCount = 0);
+
+//----
+// CPUカリングの計測結果
+// レートは1秒あたりに処理したドローコール(メッシュレット)数
+// 現在のシーンでの参考値で、CPU駆動の描画パスの性能を表すものではない
+// アプリ内で読み込んだシーンに対して計測する (単体のベンチマークはない)
+struct MeshletCullBenchmarkResult
+{
+	sl12::u32	drawCallCount = 0;
+	sl12::u32	threadCount = 0;
+	sl12::u32	laneCount = 0;				// 使える最大のレーン数
+	double		scalarRate = 0.0;			// スカラー版、1スレッド
+	double		simdRate = 0.0;				// 4レーン版、1スレッド
+	double		simdWideRate = 0.0;			// 8レーン版、1スレッド (使えない場合は0)
+	double		simdParallelRate = 0.0;		// 最大レーン数の版、全スレッド
+	sl12::u32	mismatchCount = 0;			// SIMD版とスカラー版で判定が異なるドローコール数 (4レーン版と8レーン版の合計)
+};	// struct MeshletCullBenchmarkResult
+
+MeshletCullBenchmarkResult RunMeshletCullBenchmark(const MeshletCullInput& input, const MeshletCullHiZ* pHiZ, sl12::u32 iterations);
+
+//	EOF
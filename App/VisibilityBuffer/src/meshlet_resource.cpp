@@ -1,4 +1,7 @@
 ﻿#include "meshlet_resource.h"
+#include "meshlet_alpha.h"
+#include "meshlet_bound.h"
+#include "meshlet_cull.h"
 #include "shader_types.h"
 #include "sl12/resource_texture.h"
 #include "sl12/descriptor_set.h"
@@ -12,6 +15,11 @@
 
 #define NOMINMAX
 #include <windowsx.h>
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <execution>
+#include <iterator>
 #include <memory>
 #include <random>
 
@@ -21,15 +29,20 @@
 
 namespace
 {
-	struct MeshletBound
-	{
-		DirectX::XMFLOAT3		aabbMin;
-		DirectX::XMFLOAT3		aabbMax;
-		DirectX::XMFLOAT3		coneApex;
-		DirectX::XMFLOAT3		coneAxis;
-		float					coneCutoff;
-		sl12::u32				pad[3];
-	};	// struct MeshletBound
+	// 未使用の範囲はどの描画コールよりも後ろに並ぶようにする
+	static const sl12::u32 kInvalidArgStart = 0xffffffff;
+
+	// BufferTypeごとの要素サイズ
+	static const size_t kTableStrides[] = {
+		kIndirectArgsBufferStride,
+		sizeof(InstanceData),
+		sizeof(SubmeshData),
+		sizeof(MeshletData),
+		sizeof(DrawCallSource),
+		sizeof(MeshletBoundData),
+		sizeof(sl12::u32),
+	};
+	static_assert(ARRAYSIZE(kTableStrides) == MeshletResource::BufferType::Max, "stride table mismatch.");
 }
 
 
@@ -40,19 +53,154 @@ MeshletResource::MeshletResource()
 MeshletResource::~MeshletResource()
 {
 	worldMaterials_.clear();
+	worldMaterialIndices_.clear();
+	meshResOrder_.clear();
 	meshInstanceInfos_.clear();
-	meshletIndirectArgUpload_.Reset();
-	instanceUpload_.Reset();
-	submeshUpload_.Reset();
-	meshletUpload_.Reset();
-	drawcallUpload_.Reset();
+	drawBuckets_.clear();
+	for (auto&& t : cpuTables_)
+	{
+		t.clear();
+	}
+	drawCountClearUpload_.Reset();
+	for (auto&& b : stagingBuffers_)
+	{
+		b.Reset();
+	}
+	meshletBoundsSRVs_.clear();
+	for (auto&& b : sceneBufferSRVs_)
+	{
+		b.Reset();
+	}
+	for (auto&& b : sceneBuffers_)
+	{
+		b.Reset();
+	}
+}
+
+DrawCallData DecodeDrawCallRange(const DrawCallRange* pRanges, sl12::u32 rangeCount, sl12::u32 drawCallIndex)
+{
+	// argStart <= drawCallIndex となる最後の範囲を二分探索
+	sl12::u32 lo = 0;
+	sl12::u32 hi = rangeCount;
+	while (hi - lo > 1)
+	{
+		sl12::u32 mid = (lo + hi) / 2;
+		if (pRanges[mid].argStart <= drawCallIndex)
+		{
+			lo = mid;
+		}
+		else
+		{
+			hi = mid;
+		}
+	}
+	const DrawCallRange& range = pRanges[lo];
+
+	DrawCallData ret;
+	ret.instanceIndex = range.instanceIndex;
+	ret.meshletIndex = range.meshletStart + (drawCallIndex - range.argStart);
+	return ret;
 }
 
+void RangeAllocator::Reset(sl12::u32 capacity, sl12::u32 used)
+{
+	assert(used <= capacity);
+	freeBlocks_.clear();
+	capacity_ = capacity;
+	usedCount_ = used;
+	if (used < capacity)
+	{
+		freeBlocks_[used] = capacity - used;
+	}
+}
+
+void RangeAllocator::Grow(sl12::u32 newCapacity)
+{
+	if (newCapacity <= capacity_)
+	{
+		return;
+	}
+	sl12::u32 oldCapacity = capacity_;
+	sl12::u32 added = newCapacity - oldCapacity;
+	capacity_ = newCapacity;
+	// 増えた領域を確保済み扱いにしてから解放し、末尾の空き領域と結合させる
+	usedCount_ += added;
+	Free(oldCapacity, added);
+}
+
+sl12::u32 RangeAllocator::Allocate(sl12::u32 count)
+{
+	if (count == 0)
+	{
+		return 0;
+	}
+
+	// first fit.
+	for (auto it = freeBlocks_.begin(); it != freeBlocks_.end(); ++it)
+	{
+		if (it->second >= count)
+		{
+			sl12::u32 offset = it->first;
+			sl12::u32 remain = it->second - count;
+			freeBlocks_.erase(it);
+			if (remain > 0)
+			{
+				freeBlocks_[offset + count] = remain;
+			}
+			usedCount_ += count;
+			return offset;
+		}
+	}
+	return kInvalidOffset;
+}
+
+void RangeAllocator::Free(sl12::u32 offset, sl12::u32 count)
+{
+	if (count == 0)
+	{
+		return;
+	}
+	assert(offset + count <= capacity_);
+	assert(count <= usedCount_);
+	usedCount_ -= count;
+
+	// 後ろの空き領域と結合
+	auto next = freeBlocks_.lower_bound(offset);
+	if (next != freeBlocks_.end() && next->first == offset + count)
+	{
+		count += next->second;
+		next = freeBlocks_.erase(next);
+	}
+	// 前の空き領域と結合
+	if (next != freeBlocks_.begin())
+	{
+		auto prev = std::prev(next);
+		assert(prev->first + prev->second <= offset);
+		if (prev->first + prev->second == offset)
+		{
+			prev->second += count;
+			return;
+		}
+	}
+	freeBlocks_[offset] = count;
+}
+
+
 void MeshletResource::CreateResources(sl12::Device* pDev, const std::vector<std::shared_ptr<sl12::SceneMesh>>& meshes)
 {
+	sl12::CpuTimer startTime = sl12::CpuTimer::CurrentTime();
+
+	pDevice_ = pDev;
 	worldMaterials_.clear();
+	worldMaterialIndices_.clear();
 	meshResInfos_.clear();
+	meshResOrder_.clear();
 	meshInstanceInfos_.clear();
+	instanceIndices_.clear();
+	meshletBoundsSRVs_.clear();
+	drawBuckets_.clear();
+	occludedInstanceCount_ = 0;
+	ClearDirtyRanges();
 
 	// メッシュリソースごとの情報を収集する
 	for (auto&& mesh : meshes)
@@ -60,403 +208,1315 @@ void MeshletResource::CreateResources(sl12::Device* pDev, const std::vector<std:
 		auto resMesh = mesh->GetParentResource();
 		if (meshResInfos_.find(resMesh) == meshResInfos_.end())
 		{
-			MeshResInfo resInfo = {};
-			resInfo.resMesh = resMesh;
-
-			// マテリアルごとにSubmeshをOpaque/Masked/Translucentに分ける
-			std::vector<sl12::u32> opaqueSubmesh, maskedSubmesh, xluSubmesh;
-			auto&& submeshes = resMesh->GetSubmeshes();
-			auto&& materials = resMesh->GetMaterials();
-			sl12::u32 submeshIndex = 0;
-			for (auto&& submesh : submeshes)
-			{
-				auto&& material = materials[submesh.materialIndex];
-				if (material.blendType == sl12::ResourceMeshMaterialBlendType::Opaque)
-				{
-					opaqueSubmesh.push_back(submeshIndex);
-				}
-				else if (material.blendType == sl12::ResourceMeshMaterialBlendType::Masked)
-				{
-					maskedSubmesh.push_back(submeshIndex);
-				}
-				else
-				{
-					xluSubmesh.push_back(submeshIndex);
-				}
-				submeshIndex++;
-
-				// World Materialは不透明・半透明関係なく登録
-				auto it = std::find_if(
-					worldMaterials_.begin(), worldMaterials_.end(),
-					[&material](const WorldMaterial& rhs) { return rhs.pResMaterial == &material; });
-				if (it == worldMaterials_.end())
-				{
-					WorldMaterial mat;
-					mat.pResMaterial = &material;
-					mat.texHandles.push_back(mat.pResMaterial->baseColorTex);
-					mat.texHandles.push_back(mat.pResMaterial->normalTex);
-					mat.texHandles.push_back(mat.pResMaterial->ormTex);
-					worldMaterials_.push_back(mat);
-				}
-			}
-
-			// サブメッシュ情報、及びワールド全体のマテリアルリストを収集する関数
-			auto GatherSubmeshInfo = [&](const std::vector<sl12::u32>& submeshIndices, int type)
-			{
-				for (auto index : submeshIndices)
-				{
-					auto&& submesh = submeshes[index];
-					auto&& material = materials[submesh.materialIndex];
-
-					auto it = std::find_if(
-						worldMaterials_.begin(), worldMaterials_.end(),
-						[&material](const WorldMaterial& rhs) { return rhs.pResMaterial == &material; });
-					sl12::u32 worldMatIndex = (sl12::u32)std::distance(worldMaterials_.begin(), it);
-
-					SubmeshInfo submeshInfo = {};
-					submeshInfo.submeshIndex = index;
-					submeshInfo.materialIndex = worldMatIndex;
-					
-					resInfo.meshletCount[type] += static_cast<sl12::u32>(submesh.meshlets.size());
-					resInfo.nonXluSubmeshInfos.push_back(submeshInfo);
-				}
-				resInfo.submeshCount[type] = (sl12::u32)submeshIndices.size();
-			};
-			// Opaqueの収集
-			GatherSubmeshInfo(opaqueSubmesh, 0);
-			// Maskedの収集
-			GatherSubmeshInfo(maskedSubmesh, 1);
-
-			// 半透明サブメッシュリストのコピー
-			resInfo.xluSubmeshIndices = xluSubmesh;
-
-			// 登録
-			meshResInfos_[resMesh] = resInfo;
+			RegisterMeshResource(resMesh);
 		}
 	}
 	
 	// メッシュインスタンスごとの情報を収集する
 	sl12::u32 argCount = 0;
+	meshInstanceInfos_.reserve(meshes.size());
+	instanceIndices_.reserve(meshes.size());
 	for (auto&& mesh : meshes)
 	{
-		auto resMesh = mesh->GetParentResource();
+		auto&& resInfo = meshResInfos_[mesh->GetParentResource()];
 		
 		MeshInstanceInfo meshInfo = {};
 		meshInfo.meshInstance = mesh;
+		meshInfo.pMesh = mesh.get();
+		meshInfo.resMesh = mesh->GetParentResource();
 		meshInfo.argIndex[0] = argCount;
-		meshInfo.argIndex[1] = argCount + meshResInfos_[resMesh].meshletCount[0];
+		meshInfo.argIndex[1] = argCount + resInfo.meshletCount[0];
 
+		instanceIndices_[mesh.get()] = (sl12::u32)meshInstanceInfos_.size();
 		meshInstanceInfos_.push_back(meshInfo);
 
-		argCount += meshResInfos_[resMesh].meshletCount[0] + meshResInfos_[resMesh].meshletCount[1];
+		argCount += resInfo.meshletCount[0] + resInfo.meshletCount[1];
 	}
+	allocators_[BufferType::IndirectArg].Reset(argCount, argCount);
+	allocators_[BufferType::Instance].Reset((sl12::u32)meshInstanceInfos_.size(), (sl12::u32)meshInstanceInfos_.size());
 
-	// DrawIndirectArgのアップロードバッファ生成
+	// DrawIndirectArgのテーブル生成
 	{
-		meshletIndirectArgUpload_ = sl12::MakeUnique<sl12::Buffer>(pDev);
-
-		sl12::BufferDesc desc{};
-		desc.stride = kIndirectArgsBufferStride;
-		desc.size = desc.stride * argCount + 4/* overflow support. */;
-		desc.usage = sl12::ResourceUsage::Unknown;
-		desc.heap = sl12::BufferHeap::Dynamic;
-		desc.initialState = D3D12_RESOURCE_STATE_COMMON;
-		meshletIndirectArgUpload_->Initialize(pDev, desc);
+		cpuTables_[BufferType::IndirectArg].assign(kIndirectArgsBufferStride * argCount + 4/* overflow support. */, 0);
 
-		sl12::u32* p = (sl12::u32*)meshletIndirectArgUpload_->Map();
-		sl12::u32 index = 0;
-		for (auto&& meshInfo : meshInstanceInfos_)
-		{
-			auto resMesh = meshInfo.meshInstance.lock()->GetParentResource();
-			const MeshResInfo& resInfo = meshResInfos_[resMesh];
-			auto&& submeshes = resMesh->GetSubmeshes();
-
-			for (auto&& submeshInfo : resInfo.nonXluSubmeshInfos)
+		// インスタンスごとの書き込み先はargIndexで確定しているので並列に埋める
+		sl12::u8* pArgTop = GetTable<sl12::u8>(BufferType::IndirectArg);
+		std::for_each(std::execution::par, meshInstanceInfos_.begin(), meshInstanceInfos_.end(),
+			[&](const MeshInstanceInfo& meshInfo)
 			{
-				auto&& submesh = submeshes[submeshInfo.submeshIndex];
-				UINT StartIndexLocation = (UINT)(submesh.indexOffsetBytes / sl12::ResourceItemMesh::GetIndexStride());
-				int BaseVertexLocation = (int)(submesh.positionOffsetBytes / sl12::ResourceItemMesh::GetPositionStride());
-
-				for (auto&& meshlet : submesh.meshlets)
-				{
-					*p++ = index;
-
-					D3D12_DRAW_INDEXED_ARGUMENTS* arg = (D3D12_DRAW_INDEXED_ARGUMENTS*)p;
-					arg->IndexCountPerInstance = meshlet.indexCount;
-					arg->InstanceCount = 1;
-					arg->StartIndexLocation = StartIndexLocation + meshlet.indexOffset;
-					arg->BaseVertexLocation = BaseVertexLocation;
-					arg->StartInstanceLocation = 0;
-					
-					p = (sl12::u32*)(arg + 1);
-					index++;
-				}
-			}
-		}
-		meshletIndirectArgUpload_->Unmap();
+				WriteIndirectArgs(pArgTop, meshInfo);
+			});
+		CreateSceneBuffer(BufferType::IndirectArg);
 	}
+	CreateDrawCountClearBuffer(argCount);
 
-	// メッシュレットバウンズバッファ生成
-	CreateMeshletBoundsResources(pDev);
-	
-	// VisibilityBuffer用のアップロードバッファ生成
+	// 描画リストの先頭テーブル
+	// 内容はUpdateDrawBucketsで書き込む
+	cpuTables_[BufferType::DrawBucket].assign(sizeof(sl12::u32) * argCount, 0);
+	CreateSceneBuffer(BufferType::DrawBucket);
+	bDrawBucketDirty_ = true;
+
+	// VisibilityBuffer用のテーブル生成
+	// メッシュレットバウンズもここで生成する
 	CreateVisibilityResources(pDev);
 
 	// WorkGraph用のアップロードバッファ生成
 	CreateWorkGraphResources(pDev);
+
+	sl12::CpuTimer elapsed = sl12::CpuTimer::CurrentTime() - startTime;
+	sl12::ConsolePrint("MeshletResource: %d instances, %d meshlet args, %d materials (%f ms)\n",
+		(int)meshInstanceInfos_.size(), (int)argCount, (int)worldMaterials_.size(), elapsed.ToSecond() * 1000.0f);
+
+	// 描画コールテーブルのメモリ使用量比較
+	float perMeshletMB = (float)(sizeof(DrawCallData) * argCount) / (1024.0f * 1024.0f);
+	float rangeMB = (float)(sizeof(DrawCallRange) * drawCallRanges_.size()) / (1024.0f * 1024.0f);
+	sl12::ConsolePrint("MeshletResource: draw call table %f MB (per meshlet), %f MB (range) [%s]\n",
+		perMeshletMB, rangeMB, DRAWCALL_PREFIX_TABLE ? "range" : "per meshlet");
 }
 
-void MeshletResource::CreateMeshletBoundsResources(sl12::Device* pDev)
+MeshResInfo& MeshletResource::RegisterMeshResource(const sl12::ResourceItemMesh* resMesh)
 {
-	for (auto&& resInfo : meshResInfos_)
+	MeshResInfo resInfo = {};
+	resInfo.resMesh = resMesh;
+
+	// マテリアルごとにSubmeshをOpaque/Masked/Translucentに分ける
+	std::vector<sl12::u32> opaqueSubmesh, maskedSubmesh, xluSubmesh;
+	auto&& submeshes = resMesh->GetSubmeshes();
+	auto&& materials = resMesh->GetMaterials();
+	sl12::u32 submeshIndex = 0;
+	for (auto&& submesh : submeshes)
 	{
-		auto resMesh = resInfo.first;
-		auto&& submeshes = resMesh->GetSubmeshes();
+		auto&& material = materials[submesh.materialIndex];
+		if (material.blendType == sl12::ResourceMeshMaterialBlendType::Opaque)
+		{
+			opaqueSubmesh.push_back(submeshIndex);
+		}
+		else if (material.blendType == sl12::ResourceMeshMaterialBlendType::Masked)
+		{
+			maskedSubmesh.push_back(submeshIndex);
+		}
+		else
+		{
+			xluSubmesh.push_back(submeshIndex);
+		}
+		submeshIndex++;
 
-		sl12::u32 meshletTotal = resInfo.second.meshletCount[0] + resInfo.second.meshletCount[1];
+		// World Materialは不透明・半透明関係なく登録
+		if (worldMaterialIndices_.find(&material) == worldMaterialIndices_.end())
+		{
+			WorldMaterial mat;
+			mat.pResMaterial = &material;
+			mat.texHandles.push_back(mat.pResMaterial->baseColorTex);
+			mat.texHandles.push_back(mat.pResMaterial->normalTex);
+			mat.texHandles.push_back(mat.pResMaterial->ormTex);
+			worldMaterialIndices_[&material] = (sl12::u32)worldMaterials_.size();
+			worldMaterials_.push_back(mat);
+		}
+	}
 
-		// create buffers.
-		UniqueHandle<sl12::Buffer> B = sl12::MakeUnique<sl12::Buffer>(pDev);
-		UniqueHandle<sl12::Buffer> U = sl12::MakeUnique<sl12::Buffer>(pDev);
-		UniqueHandle<sl12::BufferView> BV = sl12::MakeUnique<sl12::BufferView>(pDev);
-		
-		sl12::BufferDesc desc{};
-		desc.heap = sl12::BufferHeap::Default;
-		desc.stride = sizeof(MeshletBound);
-		desc.size = desc.stride * meshletTotal;
-		desc.usage = sl12::ResourceUsage::ShaderResource;
-		desc.initialState = D3D12_RESOURCE_STATE_COMMON;
+	// サブメッシュ情報、及びワールド全体のマテリアルリストを収集する関数
+	auto GatherSubmeshInfo = [&](const std::vector<sl12::u32>& submeshIndices, int type)
+	{
+		for (auto index : submeshIndices)
+		{
+			auto&& submesh = submeshes[index];
+			auto&& material = materials[submesh.materialIndex];
+
+			SubmeshInfo submeshInfo = {};
+			submeshInfo.submeshIndex = index;
+			submeshInfo.materialIndex = worldMaterialIndices_[&material];
+			
+			resInfo.meshletCount[type] += static_cast<sl12::u32>(submesh.meshlets.size());
+			resInfo.nonXluSubmeshInfos.push_back(submeshInfo);
+		}
+		resInfo.submeshCount[type] = (sl12::u32)submeshIndices.size();
+	};
+	// Opaqueの収集
+	GatherSubmeshInfo(opaqueSubmesh, 0);
+	// Maskedの収集
+	GatherSubmeshInfo(maskedSubmesh, 1);
 
-		B->Initialize(pDev, desc);
-		BV->Initialize(pDev, &B, 0, 0, (sl12::u32)desc.stride);
+	// 半透明サブメッシュリストのコピー
+	resInfo.xluSubmeshIndices = xluSubmesh;
 
-		desc.heap = sl12::BufferHeap::Dynamic;
-		U->Initialize(pDev, desc);
+	LoadMeshletAlphaClasses(resMesh, resInfo);
+
+	// 登録
+	auto&& ret = meshResInfos_[resMesh];
+	ret = std::move(resInfo);
+	meshResOrder_.push_back(resMesh);
+	return ret;
+}
+
+void MeshletResource::LoadMeshletAlphaClasses(const sl12::ResourceItemMesh* resMesh, MeshResInfo& resInfo)
+{
+	// オフラインでベイクしたメッシュレットのアルファ分類
+	// ファイルがなければ全て混在 (従来通りアルファテストで描画)
+	resInfo.meshletAlphaClasses.clear();
+	resInfo.meshletAlphaClasses.resize(resInfo.nonXluSubmeshInfos.size());
+	resInfo.submeshAlphaClassMasks.assign(resInfo.nonXluSubmeshInfos.size(), 0);
+	MeshletAlphaBake bake;
+	std::string bakeFile = resMesh->GetFilePath() + ".malpha";
+	if (!LoadMeshletAlphaBake(bakeFile, bake))
+	{
+		return;
+	}
+
+	auto&& submeshes = resMesh->GetSubmeshes();
+	auto&& materials = resMesh->GetMaterials();
+	if (bake.submeshClasses.size() != submeshes.size())
+	{
+		sl12::ConsolePrint("Error: meshlet alpha file does not match the mesh. (%s)\n", bakeFile.c_str());
+		return;
+	}
+	for (size_t i = 0; i < resInfo.nonXluSubmeshInfos.size(); i++)
+	{
+		sl12::u32 submeshIndex = resInfo.nonXluSubmeshInfos[i].submeshIndex;
+		auto&& submesh = submeshes[submeshIndex];
+		auto&& classes = bake.submeshClasses[submeshIndex];
+		// マスクのサブメッシュのみ適用する
+		if (materials[submesh.materialIndex].blendType != sl12::ResourceMeshMaterialBlendType::Masked || classes.empty())
+		{
+			continue;
+		}
+		if (classes.size() != submesh.meshlets.size())
+		{
+			sl12::ConsolePrint("Error: meshlet alpha file does not match the mesh. (%s)\n", bakeFile.c_str());
+			continue;
+		}
+		for (auto c : classes)
+		{
+			resInfo.submeshAlphaClassMasks[i] |= (sl12::u8)(0x1 << c);
+		}
+		resInfo.meshletAlphaClasses[i] = std::move(classes);
+	}
+}
+
+bool MeshletResource::IsAlphaTestRequired(const MeshResInfo& resInfo, sl12::u32 nonXluIndex)
+{
+	sl12::u8 mask = resInfo.submeshAlphaClassMasks[nonXluIndex];
+	return (mask == 0) || (mask & (0x1 << MESHLET_ALPHA_MIXED));
+}
 
-		// fill upload buffer.
-		MeshletBound* pBound = static_cast<MeshletBound*>(U->Map());
-		for (auto&& info : resInfo.second.nonXluSubmeshInfos)
+bool MeshletResource::IsSubmeshAlphaOpaque(const sl12::ResourceItemMesh* resMesh, sl12::u32 submeshIndex) const
+{
+	auto resInfo = GetMeshResInfo(resMesh);
+	if (!resInfo)
+	{
+		return false;
+	}
+	for (size_t i = 0; i < resInfo->nonXluSubmeshInfos.size(); i++)
+	{
+		if (resInfo->nonXluSubmeshInfos[i].submeshIndex == submeshIndex)
 		{
-			auto&& submesh = submeshes[info.submeshIndex];
-			for (auto&& meshlet : submesh.meshlets)
+			return resInfo->submeshAlphaClassMasks[i] == (0x1 << MESHLET_ALPHA_OPAQUE);
+		}
+	}
+	return false;
+}
+
+void MeshletResource::ReloadMeshletAlphaClasses(const sl12::ResourceItemMesh* resMesh)
+{
+	auto it = meshResInfos_.find(resMesh);
+	if (it == meshResInfos_.end())
+	{
+		return;
+	}
+	auto&& resInfo = it->second;
+	LoadMeshletAlphaClasses(resMesh, resInfo);
+
+	// 分類はMeshletDataのみに影響するので、このメッシュリソースのメッシュレット範囲だけ転送し直す
+	sl12::u32 meshletCount = resInfo.meshletCount[0] + resInfo.meshletCount[1];
+	if (meshletCount == 0 || resInfo.meshletDataOffsets.empty())
+	{
+		return;
+	}
+	WriteMeshResourceData(GetTable<SubmeshData>(BufferType::Submesh), GetTable<MeshletData>(BufferType::Meshlet), resMesh, resInfo);
+	MarkDirty(BufferType::Meshlet, resInfo.meshletDataOffsets[0], meshletCount);
+}
+
+MeshletResource::MeshletAlphaStats MeshletResource::GetMeshletAlphaStats() const
+{
+	MeshletAlphaStats stats;
+	for (auto&& it : meshResInfos_)
+	{
+		for (auto&& classes : it.second.meshletAlphaClasses)
+		{
+			for (auto c : classes)
 			{
-				pBound->aabbMin = meshlet.boundingInfo.box.aabbMin;
-				pBound->aabbMax = meshlet.boundingInfo.box.aabbMax;
-				pBound->coneAxis = meshlet.boundingInfo.cone.axis;
-				pBound->coneApex = meshlet.boundingInfo.cone.apex;
-				pBound->coneCutoff = meshlet.boundingInfo.cone.cutoff;
-				pBound++;
+				if (c == MESHLET_ALPHA_OPAQUE)
+					stats.opaque++;
+				else if (c == MESHLET_ALPHA_TRANSPARENT)
+					stats.transparent++;
+				else
+					stats.mixed++;
 			}
 		}
-		U->Unmap();
+	}
+	return stats;
+}
 
-		// マップに登録
-		meshletBoundsUploads_[resMesh] = std::move(U);
-		meshletBoundsBuffers_[resMesh] = std::move(B);
-		meshletBoundsSRVs_[resMesh] = std::move(BV);
+void MeshletResource::CreateMeshletBoundsView(const sl12::ResourceItemMesh* resMesh, const MeshResInfo& resInfo)
+{
+	// 全体バッファのうち、このメッシュリソースのメッシュレット範囲を参照する
+	// メッシュレットを持たない、もしくは配置が未確定の場合は無効なビューにならないよう先頭の1要素を参照させる
+	sl12::u32 first = 0;
+	sl12::u32 count = 1;
+	sl12::u32 meshletTotal = resInfo.meshletCount[0] + resInfo.meshletCount[1];
+	if (meshletTotal > 0 && !resInfo.meshletDataOffsets.empty())
+	{
+		first = resInfo.meshletDataOffsets[0];
+		count = meshletTotal;
 	}
+
+	UniqueHandle<sl12::BufferView> BV = sl12::MakeUnique<sl12::BufferView>(pDevice_);
+	BV->Initialize(pDevice_, &sceneBuffers_[BufferType::MeshletBound], first, count, (sl12::u32)sizeof(MeshletBoundData));
+	meshletBoundsSRVs_[resMesh] = std::move(BV);
 }
 
-int MeshletResource::GetWorldMaterialIndex(const sl12::ResourceItemMesh::Material* mat)
+int MeshletResource::GetWorldMaterialIndex(const sl12::ResourceItemMesh::Material* mat) const
 {
-	auto it = std::find_if(
-		worldMaterials_.begin(), worldMaterials_.end(),
-		[mat](const WorldMaterial& rhs) { return rhs.pResMaterial == mat; });
-	if (it == worldMaterials_.end())
+	auto it = worldMaterialIndices_.find(mat);
+	if (it == worldMaterialIndices_.end())
 	{
 		return -1;
 	}
-	auto index = std::distance(worldMaterials_.begin(), it);
-	return (int)index;
+	return (int)it->second;
+}
+
+void MeshletResource::LayoutVisibilityResources()
+{
+	// メッシュリソースごとのSubmeshData/MeshletDataの配置を決める
+	// 登録順に配置するので、同じシーンなら実行ごとに同じ配置になる
+	sl12::u32 submeshCount = 0;
+	sl12::u32 meshletCount = 0;
+	for (auto resMesh : meshResOrder_)
+	{
+		auto&& info = meshResInfos_.find(resMesh)->second;
+
+		info.submeshDataOffset = submeshCount;
+		submeshCount += (sl12::u32)info.nonXluSubmeshInfos.size();
+
+		auto&& submeshes = resMesh->GetSubmeshes();
+		info.meshletDataOffsets.clear();
+		for (auto& submeshInfo : info.nonXluSubmeshInfos)
+		{
+			info.meshletDataOffsets.push_back(meshletCount);
+			meshletCount += (sl12::u32)submeshes[submeshInfo.submeshIndex].meshlets.size();
+		}
+	}
+	allocators_[BufferType::Submesh].Reset(submeshCount, submeshCount);
+	allocators_[BufferType::Meshlet].Reset(meshletCount, meshletCount);
+	allocators_[BufferType::MeshletBound].Reset(meshletCount, meshletCount);
+
+	// インスタンスごとの描画コール範囲
+	// 一括生成ではインスタンス順にargIndexを割り当てているので、そのまま昇順になる
+	drawCallRanges_.clear();
+	drawCallRanges_.reserve(meshInstanceInfos_.size());
+	for (auto&& meshInfo : meshInstanceInfos_)
+	{
+		const MeshResInfo& resInfo = meshResInfos_.find(meshInfo.resMesh)->second;
+		if (resInfo.meshletCount[0] + resInfo.meshletCount[1] > 0)
+		{
+			DrawCallRange range;
+			range.argStart = meshInfo.argIndex[0];
+			range.instanceIndex = (sl12::u32)(&meshInfo - meshInstanceInfos_.data());
+			range.meshletStart = resInfo.meshletDataOffsets[0];
+			drawCallRanges_.push_back(range);
+		}
+	}
+
+#if DRAWCALL_PREFIX_TABLE
+	// 描画コールはインスタンスごとの範囲のみ
+	sl12::u32 drawCallCount = (sl12::u32)drawCallRanges_.size();
+#else
+	// 描画コールはIndirectArgと同じ配置
+	sl12::u32 drawCallCount = allocators_[BufferType::IndirectArg].GetCapacity();
+#endif
+	allocators_[BufferType::DrawCall].Reset(drawCallCount, drawCallCount);
 }
 
 void MeshletResource::CreateVisibilityResources(sl12::Device* pDev)
 {
-	struct Data
+	LayoutVisibilityResources();
+
+	std::vector<const MeshResInfo*> resInfoList;
+	resInfoList.reserve(meshResOrder_.size());
+	for (auto resMesh : meshResOrder_)
+	{
+		resInfoList.push_back(&meshResInfos_.find(resMesh)->second);
+	}
+	sl12::u32 submeshCount = allocators_[BufferType::Submesh].GetCapacity();
+	sl12::u32 meshletCount = allocators_[BufferType::Meshlet].GetCapacity();
+	sl12::u32 drawCallCount = allocators_[BufferType::DrawCall].GetCapacity();
+
+	// CPUテーブルの確保
+	cpuTables_[BufferType::Instance].assign(sizeof(InstanceData) * meshInstanceInfos_.size(), 0);
+	cpuTables_[BufferType::Submesh].assign(sizeof(SubmeshData) * submeshCount, 0);
+	cpuTables_[BufferType::Meshlet].assign(sizeof(MeshletData) * meshletCount, 0);
+	cpuTables_[BufferType::DrawCall].assign(sizeof(DrawCallSource) * drawCallCount, 0);
+	cpuTables_[BufferType::MeshletBound].assign(sizeof(MeshletBoundData) * meshletCount, 0);
+
+	InstanceData* instanceData = GetTable<InstanceData>(BufferType::Instance);
+	SubmeshData* submeshData = GetTable<SubmeshData>(BufferType::Submesh);
+	MeshletData* meshletData = GetTable<MeshletData>(BufferType::Meshlet);
+	DrawCallSource* drawcallData = GetTable<DrawCallSource>(BufferType::DrawCall);
+	MeshletBoundData* boundData = GetTable<MeshletBoundData>(BufferType::MeshletBound);
+
+	// メッシュリソースごとのテーブルを更新
+	// 書き込み先のオフセットは事前に確定しているので、メッシュリソース単位で並列に処理する
+	std::for_each(std::execution::par, resInfoList.begin(), resInfoList.end(),
+		[&](const MeshResInfo* resInfo)
+		{
+			WriteMeshResourceData(submeshData, meshletData, resInfo->resMesh, *resInfo);
+			WriteMeshletBounds(boundData, resInfo->resMesh, *resInfo);
+		});
+	// メッシュインスタンスごとのテーブルを更新
+	// 描画コールの書き込み先はargIndexと一致する
+	std::for_each(std::execution::par, meshInstanceInfos_.begin(), meshInstanceInfos_.end(),
+		[&](const MeshInstanceInfo& meshInfo)
+		{
+			sl12::u32 instanceIndex = (sl12::u32)(&meshInfo - meshInstanceInfos_.data());
+			WriteInstanceData(instanceData, instanceIndex);
+#if !DRAWCALL_PREFIX_TABLE
+			WriteDrawCallData(drawcallData, instanceIndex);
+#endif
+		});
+#if DRAWCALL_PREFIX_TABLE
+	if (!drawCallRanges_.empty())
+	{
+		memcpy(drawcallData, drawCallRanges_.data(), sizeof(DrawCallRange) * drawCallRanges_.size());
+	}
+#endif
+
+	// 永続バッファ生成
+	CreateSceneBuffer(BufferType::Instance);
+	CreateSceneBuffer(BufferType::Submesh);
+	CreateSceneBuffer(BufferType::Meshlet);
+	CreateSceneBuffer(BufferType::DrawCall);
+	CreateSceneBuffer(BufferType::MeshletBound);
+
+#if defined(_DEBUG)
+	ValidateDrawCallRanges();
+#endif
+}
+
+void MeshletResource::CreateSceneBuffer(BufferType type)
+{
+	sl12::BufferDesc desc{};
+	desc.stride = kTableStrides[type];
+	// 空のシーンでもSRVを生成できるよう、最低1要素分は確保する
+	desc.size = std::max(cpuTables_[type].size(), desc.stride);
+	desc.heap = sl12::BufferHeap::Default;
+	desc.usage = sl12::ResourceUsage::ShaderResource;
+	desc.initialState = D3D12_RESOURCE_STATE_COMMON;
+
+	sceneBuffers_[type] = sl12::MakeUnique<sl12::Buffer>(pDevice_);
+	sceneBuffers_[type]->Initialize(pDevice_, desc);
+	// IndirectArgは要素の途中に描画引数があるのでByteAddressで参照する
+	sl12::u32 viewStride = (type == BufferType::IndirectArg) ? 0 : (sl12::u32)desc.stride;
+	sceneBufferSRVs_[type] = sl12::MakeUnique<sl12::BufferView>(pDevice_);
+	sceneBufferSRVs_[type]->Initialize(pDevice_, &sceneBuffers_[type], 0, 0, viewStride);
+
+	// 作り直したバッファは次の転送で全体をコピーする
+	bNeedFullUpload_[type] = true;
+
+	// メッシュリソースごとのビューも作り直す
+	if (type == BufferType::MeshletBound)
 	{
-		std::map<const sl12::ResourceItemMesh*, sl12::u32> meshMap;
-		std::vector<const sl12::ResourceItemMesh*> meshList;
-		std::vector<sl12::u32> submeshOffsets;
-		std::vector<sl12::u32> meshletOffsets;
-		sl12::u32 meshCount = 0;
-		sl12::u32 submeshCount = 0;
-		sl12::u32 meshletCount = 0;
-		sl12::u32 drawCallCount = 0;
-	};
+		for (auto resMesh : meshResOrder_)
+		{
+			CreateMeshletBoundsView(resMesh, meshResInfos_.find(resMesh)->second);
+		}
+	}
+}
+
+void MeshletResource::WriteIndirectArgs(sl12::u8* pArgTop, const MeshInstanceInfo& info) const
+{
+	auto resMesh = info.resMesh;
+	const MeshResInfo& resInfo = meshResInfos_.find(resMesh)->second;
+	auto&& submeshes = resMesh->GetSubmeshes();
 
-	// メッシュリソース、及びインスタンスの各種情報を統合する
-	Data data;
-	for (auto&& resInfo : meshResInfos_)
+	sl12::u32 index = info.argIndex[0];
+	sl12::u32* p = (sl12::u32*)(pArgTop + kIndirectArgsBufferStride * index);
+	for (auto&& submeshInfo : resInfo.nonXluSubmeshInfos)
 	{
-		auto resMesh = resInfo.first;
-		data.meshMap[resMesh] = data.meshCount++;
-		data.meshList.push_back(resMesh);
-		data.submeshOffsets.push_back(data.submeshCount);
-		data.submeshCount += (sl12::u32)resInfo.second.nonXluSubmeshInfos.size();
+		auto&& submesh = submeshes[submeshInfo.submeshIndex];
+		UINT StartIndexLocation = (UINT)(submesh.indexOffsetBytes / sl12::ResourceItemMesh::GetIndexStride());
+		int BaseVertexLocation = (int)(submesh.positionOffsetBytes / sl12::ResourceItemMesh::GetPositionStride());
 
+		for (auto&& meshlet : submesh.meshlets)
+		{
+			*p++ = index;
+
+			D3D12_DRAW_INDEXED_ARGUMENTS* arg = (D3D12_DRAW_INDEXED_ARGUMENTS*)p;
+			arg->IndexCountPerInstance = meshlet.indexCount;
+			arg->InstanceCount = 1;
+			arg->StartIndexLocation = StartIndexLocation + meshlet.indexOffset;
+			arg->BaseVertexLocation = BaseVertexLocation;
+			arg->StartInstanceLocation = 0;
+		
+			p = (sl12::u32*)(arg + 1);
+			index++;
+		}
+	}
+}
+
+void MeshletResource::WriteInstanceData(InstanceData* pInstanceTop, sl12::u32 instanceIndex) const
+{
+	auto&& meshInfo = meshInstanceInfos_[instanceIndex];
+	auto mesh = meshInfo.meshInstance.lock();
+	auto resMesh = meshInfo.resMesh;
+	// メッシュはRemoveInstance()で登録を解除してから破棄すること
+	assert(mesh);
+	if (!mesh)
+	{
+		return;
+	}
+
+	StoreInstanceData(pInstanceTop + instanceIndex, mesh->GetMtxLocalToWorld(), resMesh);
+	pInstanceTop[instanceIndex].flags = meshInfo.bOccluded ? INSTANCE_FLAG_OCCLUDED : 0;
+}
+
+void MeshletResource::StoreInstanceData(InstanceData* pInstance, const DirectX::XMFLOAT4X4& mtxLocalToWorld, const sl12::ResourceItemMesh* resMesh)
+{
+	// set mesh constant.
+	DirectX::XMMATRIX l2w = DirectX::XMLoadFloat4x4(&mtxLocalToWorld);
+	DirectX::XMMATRIX w2l = DirectX::XMMatrixInverse(nullptr, l2w);
+	pInstance->mtxBoxTransform = resMesh->GetMtxBoxToLocal();
+	pInstance->mtxLocalToWorld = mtxLocalToWorld;
+	DirectX::XMStoreFloat4x4(&pInstance->mtxWorldToLocal, w2l);
+	pInstance->flags = 0;
+}
+
+void MeshletResource::WriteDrawCallData(DrawCallData* pDrawCallTop, sl12::u32 instanceIndex) const
+{
+	auto&& meshInfo = meshInstanceInfos_[instanceIndex];
+	auto resMesh = meshInfo.resMesh;
+	const MeshResInfo& resInfo = meshResInfos_.find(resMesh)->second;
+
+	DrawCallData* pDrawCall = pDrawCallTop + meshInfo.argIndex[0];
+	auto&& submeshes = resMesh->GetSubmeshes();
+	sl12::u32 submesh_count = (sl12::u32)resInfo.nonXluSubmeshInfos.size();
+	for (sl12::u32 i = 0; i < submesh_count; i++)
+	{
+		auto&& submesh = submeshes[resInfo.nonXluSubmeshInfos[i].submeshIndex];
+		auto meshletOffset = resInfo.meshletDataOffsets[i];
+		sl12::u32 meshlet_count = (sl12::u32)submesh.meshlets.size();
+		for (sl12::u32 j = 0; j < meshlet_count; j++)
+		{
+			pDrawCall->instanceIndex = instanceIndex;
+			pDrawCall->meshletIndex = meshletOffset + j;
+			pDrawCall++;
+		}
+	}
+}
+
+void MeshletResource::WriteMeshResourceData(SubmeshData* pSubmeshTop, MeshletData* pMeshletTop, const sl12::ResourceItemMesh* resMesh, const MeshResInfo& resInfo) const
+{
+	auto&& submeshes = resMesh->GetSubmeshes();
+	sl12::u32 submeshTotal = resInfo.submeshDataOffset;
+	SubmeshData* pSubmesh = pSubmeshTop + submeshTotal;
+	sl12::u32 submesh_count = (sl12::u32)resInfo.nonXluSubmeshInfos.size();
+	for (sl12::u32 i = 0; i < submesh_count; i++)
+	{
+		auto&& submeshInfo = resInfo.nonXluSubmeshInfos[i];
+		auto&& submesh = submeshes[submeshInfo.submeshIndex];
+		sl12::u32 submeshIndexOffset = (sl12::u32)(resMesh->GetIndexHandle().offset + submesh.indexOffsetBytes);
+		pSubmesh->materialIndex = submeshInfo.materialIndex;
+		pSubmesh->posOffset = (sl12::u32)(resMesh->GetPositionHandle().offset + submesh.positionOffsetBytes);
+		pSubmesh->normalOffset = (sl12::u32)(resMesh->GetNormalHandle().offset + submesh.normalOffsetBytes);
+		pSubmesh->tangentOffset = (sl12::u32)(resMesh->GetTangentHandle().offset + submesh.tangentOffsetBytes);
+		pSubmesh->uvOffset = (sl12::u32)(resMesh->GetTexcoordHandle().offset + submesh.texcoordOffsetBytes);
+		pSubmesh->indexOffset = submeshIndexOffset;
+		pSubmesh->meshletOffset = resInfo.meshletDataOffsets[i];
+		pSubmesh->flags = 0;
+		auto material = worldMaterials_[submeshInfo.materialIndex].pResMaterial;
+		if (material->blendType == sl12::ResourceMeshMaterialBlendType::Masked)
+		{
+			pSubmesh->flags |= SUBMESH_FLAG_MASKED;
+		}
+		if (material->cullMode == sl12::ResourceMeshMaterialCullMode::None)
+		{
+			pSubmesh->flags |= SUBMESH_FLAG_DOUBLE_SIDED;
+		}
+		pSubmesh++;
+
+		MeshletData* pMeshlet = pMeshletTop + resInfo.meshletDataOffsets[i];
+		auto&& alphaClasses = resInfo.meshletAlphaClasses[i];
+		sl12::u32 meshletIndex = 0;
+		sl12::u32 submeshPackedPrimOffset = (sl12::u32)(resMesh->GetMeshletPackedPrimHandle().offset + submesh.meshletPackedPrimOffsetBytes);
+		sl12::u32 submeshVertexIndexOffset = (sl12::u32)(resMesh->GetMeshletVertexIndexHandle().offset + submesh.meshletVertexIndexOffsetBytes);
+		for (auto&& meshlet : submesh.meshlets)
+		{
+			pMeshlet->submeshIndex = submeshTotal;
+			pMeshlet->indexOffset = submeshIndexOffset + meshlet.indexOffset * (sl12::u32)sl12::ResourceItemMesh::GetIndexStride();
+			pMeshlet->meshletPackedPrimCount = meshlet.primitiveCount;
+			pMeshlet->meshletPackedPrimOffset = submeshPackedPrimOffset + meshlet.primitiveOffset * (sl12::u32)sizeof(sl12::u32);
+			pMeshlet->meshletVertexIndexCount = meshlet.vertexIndexCount;
+			pMeshlet->meshletVertexIndexOffset = submeshVertexIndexOffset + meshlet.vertexIndexOffset * (sl12::u32)sl12::ResourceItemMesh::GetIndexStride();
+			pMeshlet->alphaClass = alphaClasses.empty() ? MESHLET_ALPHA_MIXED : alphaClasses[meshletIndex];
+			pMeshlet++;
+			meshletIndex++;
+		}
+
+		submeshTotal++;
+	}
+}
+
+void MeshletResource::WriteMeshletBounds(MeshletBoundData* pBoundTop, const sl12::ResourceItemMesh* resMesh, const MeshResInfo& resInfo) const
+{
+	if (resInfo.meshletDataOffsets.empty())
+	{
+		return;
+	}
+
+	// メッシュリソースのメッシュレットはMeshletDataと同じく連続して配置される
+	auto&& submeshes = resMesh->GetSubmeshes();
+	const DirectX::XMFLOAT4X4& mtxBoxToLocal = resMesh->GetMtxBoxToLocal();
+	MeshletBoundData* pBound = pBoundTop + resInfo.meshletDataOffsets[0];
+	for (auto&& info : resInfo.nonXluSubmeshInfos)
+	{
+		auto&& submesh = submeshes[info.submeshIndex];
+		for (auto&& meshlet : submesh.meshlets)
+		{
+			MeshletBound bound{};
+			bound.aabbMin = meshlet.boundingInfo.box.aabbMin;
+			bound.aabbMax = meshlet.boundingInfo.box.aabbMax;
+			bound.coneAxis = meshlet.boundingInfo.cone.axis;
+			bound.coneApex = meshlet.boundingInfo.cone.apex;
+			bound.coneCutoff = meshlet.boundingInfo.cone.cutoff;
+			StoreMeshletBoundData(pBound, bound, mtxBoxToLocal);
+			pBound++;
+		}
+	}
+}
+
+sl12::u32 MeshletResource::FindDrawCallRange(sl12::u32 argStart) const
+{
+	auto it = std::lower_bound(drawCallRanges_.begin(), drawCallRanges_.end(), argStart,
+		[](const DrawCallRange& range, sl12::u32 value)
+		{
+			return range.argStart < value;
+		});
+	assert(it != drawCallRanges_.end() && it->argStart == argStart);
+	return (sl12::u32)(it - drawCallRanges_.begin());
+}
+
+void MeshletResource::WriteDrawCallRanges(sl12::u32 first, sl12::u32 last)
+{
+#if DRAWCALL_PREFIX_TABLE
+	// 範囲外の要素は無効値で埋める
+	DrawCallRange* pRange = GetTable<DrawCallRange>(BufferType::DrawCall);
+	for (sl12::u32 i = first; i < last; i++)
+	{
+		if (i < drawCallRanges_.size())
+		{
+			pRange[i] = drawCallRanges_[i];
+		}
+		else
+		{
+			pRange[i].argStart = kInvalidArgStart;
+			pRange[i].instanceIndex = 0;
+			pRange[i].meshletStart = 0;
+		}
+	}
+	MarkDirty(BufferType::DrawCall, first, last - first);
+#endif
+}
+
+bool MeshletResource::ValidateDrawCallRanges() const
+{
+	// 全描画コールについて、範囲テーブルから求めた結果がDrawCallDataと一致するか確認する
+	bool bSuccess = true;
+	sl12::u32 instanceIndex = 0;
+	for (auto&& meshInfo : meshInstanceInfos_)
+	{
+		auto resMesh = meshInfo.resMesh;
+		const MeshResInfo& resInfo = meshResInfos_.find(resMesh)->second;
 		auto&& submeshes = resMesh->GetSubmeshes();
-		for (auto& submeshInfo : resInfo.second.nonXluSubmeshInfos)
+
+		sl12::u32 drawCallIndex = meshInfo.argIndex[0];
+		sl12::u32 submesh_count = (sl12::u32)resInfo.nonXluSubmeshInfos.size();
+		for (sl12::u32 i = 0; i < submesh_count && bSuccess; i++)
 		{
-			data.meshletOffsets.push_back(data.meshletCount);
-			data.meshletCount += (sl12::u32)submeshes[submeshInfo.submeshIndex].meshlets.size();
+			sl12::u32 meshlet_count = (sl12::u32)submeshes[resInfo.nonXluSubmeshInfos[i].submeshIndex].meshlets.size();
+			for (sl12::u32 j = 0; j < meshlet_count; j++, drawCallIndex++)
+			{
+				DrawCallData dc = DecodeDrawCallRange(drawCallRanges_.data(), (sl12::u32)drawCallRanges_.size(), drawCallIndex);
+				if (dc.instanceIndex != instanceIndex || dc.meshletIndex != resInfo.meshletDataOffsets[i] + j)
+				{
+					sl12::ConsolePrint("Error: draw call range mismatch. (drawcall %d : instance %d/%d, meshlet %d/%d)\n",
+						drawCallIndex, dc.instanceIndex, instanceIndex, dc.meshletIndex, resInfo.meshletDataOffsets[i] + j);
+					bSuccess = false;
+					break;
+				}
+			}
 		}
+		instanceIndex++;
+	}
+	assert(bSuccess);
+	return bSuccess;
+}
+
+MeshletResource::TableBuildBenchmarkResult MeshletResource::RunTableBuildBenchmark(const sl12::ResourceItemMesh* resMesh, sl12::u32 instanceCount, sl12::u64 memoryLimit)
+{
+	TableBuildBenchmarkResult result;
+	result.instanceCount = instanceCount;
+
+	// デバイスを持たないMeshletResourceに、CreateResourcesと同じ手順でテーブルを構築する
+	MeshletResource res;
+	auto&& resInfo = res.RegisterMeshResource(resMesh);
+	sl12::u64 argPerInstance = resInfo.meshletCount[0] + resInfo.meshletCount[1];
+	sl12::u64 argCount = argPerInstance * instanceCount;
+#if DRAWCALL_PREFIX_TABLE
+	sl12::u64 drawCallCount = (argPerInstance > 0) ? instanceCount : 0;
+#else
+	sl12::u64 drawCallCount = argCount;
+#endif
+	result.tableBytes = kIndirectArgsBufferStride * argCount + sizeof(InstanceData) * instanceCount + sizeof(DrawCallSource) * drawCallCount;
+	if (argCount > 0xffffffff || result.tableBytes > memoryLimit)
+	{
+		result.bSkipped = true;
+		return result;
+	}
+	result.argCount = (sl12::u32)argCount;
+
+	sl12::CpuTimer startTime = sl12::CpuTimer::CurrentTime();
+
+	// インスタンスの登録
+	// SceneMeshは生成しないので、登録のキーには参照しないダミーのアドレスを使う
+	res.meshInstanceInfos_.reserve(instanceCount);
+	res.instanceIndices_.reserve(instanceCount);
+	for (sl12::u32 i = 0; i < instanceCount; i++)
+	{
+		MeshInstanceInfo meshInfo = {};
+		meshInfo.pMesh = reinterpret_cast<const sl12::SceneMesh*>((uintptr_t)(i + 1) * sizeof(void*));
+		meshInfo.resMesh = resMesh;
+		meshInfo.argIndex[0] = (sl12::u32)(argPerInstance * i);
+		meshInfo.argIndex[1] = meshInfo.argIndex[0] + resInfo.meshletCount[0];
+		res.instanceIndices_[meshInfo.pMesh] = i;
+		res.meshInstanceInfos_.push_back(meshInfo);
+	}
+	res.allocators_[BufferType::IndirectArg].Reset(result.argCount, result.argCount);
+	res.allocators_[BufferType::Instance].Reset(instanceCount, instanceCount);
+	res.LayoutVisibilityResources();
+
+	sl12::CpuTimer layoutTime = sl12::CpuTimer::CurrentTime();
+
+	// テーブルの書き込み
+	// アップロードバッファの代わりにCPUメモリに書き込む
+	std::vector<sl12::u8> args(kIndirectArgsBufferStride * argCount);
+	std::vector<InstanceData> instances(instanceCount);
+	std::vector<SubmeshData> submeshes(res.allocators_[BufferType::Submesh].GetCapacity());
+	std::vector<MeshletData> meshlets(res.allocators_[BufferType::Meshlet].GetCapacity());
+	std::vector<MeshletBoundData> bounds(res.allocators_[BufferType::MeshletBound].GetCapacity());
+	std::vector<DrawCallSource> drawCalls(res.allocators_[BufferType::DrawCall].GetCapacity());
+
+	res.WriteMeshResourceData(submeshes.data(), meshlets.data(), resMesh, resInfo);
+	res.WriteMeshletBounds(bounds.data(), resMesh, resInfo);
+	const sl12::u32 kGridWidth = std::max((sl12::u32)std::sqrt((double)instanceCount), 1u);
+	std::for_each(std::execution::par, res.meshInstanceInfos_.begin(), res.meshInstanceInfos_.end(),
+		[&](const MeshInstanceInfo& meshInfo)
+		{
+			sl12::u32 instanceIndex = (sl12::u32)(&meshInfo - res.meshInstanceInfos_.data());
+			res.WriteIndirectArgs(args.data(), meshInfo);
+
+			DirectX::XMFLOAT4X4 mtx;
+			DirectX::XMStoreFloat4x4(&mtx, DirectX::XMMatrixTranslation((float)(instanceIndex % kGridWidth), 0.0f, (float)(instanceIndex / kGridWidth)));
+			StoreInstanceData(&instances[instanceIndex], mtx, resMesh);
+#if !DRAWCALL_PREFIX_TABLE
+			res.WriteDrawCallData(drawCalls.data(), instanceIndex);
+#endif
+		});
+#if DRAWCALL_PREFIX_TABLE
+	if (!res.drawCallRanges_.empty())
+	{
+		memcpy(drawCalls.data(), res.drawCallRanges_.data(), sizeof(DrawCallRange) * res.drawCallRanges_.size());
+	}
+#endif
+
+	sl12::CpuTimer endTime = sl12::CpuTimer::CurrentTime();
+	result.registerMs = (layoutTime - startTime).ToSecond() * 1000.0f;
+	result.fillMs = (endTime - layoutTime).ToSecond() * 1000.0f;
+	return result;
+}
+
+void MeshletResource::ResizeTable(BufferType type, sl12::u32 capacity)
+{
+	// 既存の内容を引き継ぎ、拡張した領域はクリアしておく
+	// 範囲テーブルの空き要素は二分探索で末尾に来るよう無効値で埋める
+	auto&& table = cpuTables_[type];
+	size_t newSize = kTableStrides[type] * capacity;
+	if (type == BufferType::IndirectArg)
+	{
+		newSize += 4/* overflow support. */;
 	}
-	for (auto&& instanceInfo : meshInstanceInfos_)
+	sl12::u8 clearValue = (type == BufferType::DrawCall && DRAWCALL_PREFIX_TABLE) ? 0xff : 0;
+	table.resize(newSize, clearValue);
+
+	// 永続バッファも同じサイズで作り直す
+	// 古いバッファの破棄はデバイスに任せる
+	CreateSceneBuffer(type);
+	if (type == BufferType::IndirectArg)
 	{
-		auto resMesh = instanceInfo.meshInstance.lock()->GetParentResource();
-		const MeshResInfo& resInfo = meshResInfos_[resMesh];
-		data.drawCallCount += resInfo.meshletCount[0] + resInfo.meshletCount[1];
+		CreateDrawCountClearBuffer(capacity);
 	}
+}
 
-	// バッファ生成
-	instanceUpload_ = sl12::MakeUnique<sl12::Buffer>(pDev);
-	submeshUpload_ = sl12::MakeUnique<sl12::Buffer>(pDev);
-	meshletUpload_ = sl12::MakeUnique<sl12::Buffer>(pDev);
-	drawcallUpload_ = sl12::MakeUnique<sl12::Buffer>(pDev);
+void MeshletResource::CreateDrawCountClearBuffer(sl12::u32 capacity)
+{
+	sl12::BufferDesc desc{};
+	desc.stride = sizeof(sl12::u32);
+	// マスクの描画リストのクリアにも使う
+	desc.size = desc.stride * std::max(capacity, (sl12::u32)MASKED_DRAW_LIST_COUNT);
+	desc.usage = sl12::ResourceUsage::Unknown;
+	desc.heap = sl12::BufferHeap::Dynamic;
+	desc.initialState = D3D12_RESOURCE_STATE_COMMON;
+
+	// 古いバッファの破棄はデバイスに任せる
+	drawCountClearUpload_ = sl12::MakeUnique<sl12::Buffer>(pDevice_);
+	drawCountClearUpload_->Initialize(pDevice_, desc);
+	memset(drawCountClearUpload_->Map(), 0, desc.size);
+	drawCountClearUpload_->Unmap();
+}
 
+sl12::u32 MeshletResource::AllocateRange(BufferType type, sl12::u32 count)
+{
+	auto&& allocator = allocators_[type];
+	sl12::u32 offset = allocator.Allocate(count);
+	if (offset == RangeAllocator::kInvalidOffset)
 	{
-		sl12::BufferDesc desc;
-		desc.InitializeStructured(sizeof(InstanceData), meshInstanceInfos_.size(), sl12::ResourceUsage::Unknown, sl12::BufferHeap::Dynamic);
-		instanceUpload_->Initialize(pDev, desc);
+		// 空きがなければ倍々で拡張する
+		sl12::u32 capacity = allocator.GetCapacity();
+		sl12::u32 newCapacity = std::max(std::max(allocator.GetUsedCount() + count, capacity * 2), 64u);
+		allocator.Grow(newCapacity);
+		ResizeTable(type, newCapacity);
+		if (type == BufferType::Meshlet)
+		{
+			// メッシュレットバウンズはMeshletと同じ配置なので一緒に拡張する
+			allocators_[BufferType::MeshletBound].Grow(newCapacity);
+			ResizeTable(BufferType::MeshletBound, newCapacity);
+		}
+#if !DRAWCALL_PREFIX_TABLE
+		if (type == BufferType::IndirectArg)
+		{
+			// 描画コールはIndirectArgと同じ配置なので一緒に拡張する
+			allocators_[BufferType::DrawCall].Grow(newCapacity);
+			ResizeTable(BufferType::DrawCall, newCapacity);
+		}
+#endif
+		if (type == BufferType::IndirectArg)
+		{
+			// 描画リストの先頭テーブルもIndirectArgと同じ配置
+			ResizeTable(BufferType::DrawBucket, newCapacity);
+		}
+		offset = allocator.Allocate(count);
+		assert(offset != RangeAllocator::kInvalidOffset);
 	}
+	return offset;
+}
+
+void MeshletResource::MarkDirty(BufferType type, sl12::u32 offset, sl12::u32 count)
+{
+	static const size_t kMaxDirtyRanges = 256;
+
+	if (count == 0)
 	{
-		sl12::BufferDesc desc;
-		desc.InitializeStructured(sizeof(SubmeshData), data.submeshCount, sl12::ResourceUsage::Unknown, sl12::BufferHeap::Dynamic);
-		submeshUpload_->Initialize(pDev, desc);
+		return;
 	}
+
+	auto&& ranges = dirtyRanges_[type];
+	if (!ranges.empty())
 	{
-		sl12::BufferDesc desc;
-		desc.InitializeStructured(sizeof(MeshletData), data.meshletCount, sl12::ResourceUsage::Unknown, sl12::BufferHeap::Dynamic);
-		meshletUpload_->Initialize(pDev, desc);
+		// 直前の範囲と隣接、もしくは重なっていれば結合
+		auto&& last = ranges.back();
+		if (offset <= last.offset + last.count && last.offset <= offset + count)
+		{
+			sl12::u32 end = std::max(last.offset + last.count, offset + count);
+			last.offset = std::min(last.offset, offset);
+			last.count = end - last.offset;
+			return;
+		}
 	}
+	if (ranges.size() >= kMaxDirtyRanges)
 	{
-		sl12::BufferDesc desc;
-		desc.InitializeStructured(sizeof(DrawCallData), data.drawCallCount, sl12::ResourceUsage::Unknown, sl12::BufferHeap::Dynamic);
-		drawcallUpload_->Initialize(pDev, desc);
+		// 範囲が多くなりすぎたら全体を包含する1つの範囲にまとめる
+		sl12::u32 begin = offset, end = offset + count;
+		for (auto&& r : ranges)
+		{
+			begin = std::min(begin, r.offset);
+			end = std::max(end, r.offset + r.count);
+		}
+		ranges.clear();
+		ranges.push_back({begin, end - begin});
+		return;
 	}
+	ranges.push_back({offset, count});
+}
 
-	// アップロードバッファの更新
-	InstanceData* instanceData = (InstanceData*)instanceUpload_->Map();
-	SubmeshData* submeshData = (SubmeshData*)submeshUpload_->Map();
-	MeshletData* meshletData = (MeshletData*)meshletUpload_->Map();
-	DrawCallData* drawcallData = (DrawCallData*)drawcallUpload_->Map();
+void MeshletResource::ClearDirtyRanges()
+{
+	for (auto&& ranges : dirtyRanges_)
+	{
+		ranges.clear();
+	}
+}
+
+sl12::u32 MeshletResource::AddInstance(const std::shared_ptr<sl12::SceneMesh>& mesh)
+{
+	assert(pDevice_ != nullptr);
 
-	// メッシュリソースごとのアップロードバッファを更新
-	sl12::u32 submeshTotal = 0;
-	for (auto resMesh : data.meshList)
 	{
-		auto meshInfo = std::find_if(meshInstanceInfos_.begin(), meshInstanceInfos_.end(),
-			[resMesh](const MeshInstanceInfo& rhs) { return rhs.meshInstance.lock()->GetParentResource() == resMesh; });
-		assert(meshInfo != meshInstanceInfos_.end());
-		const MeshResInfo& resInfo = meshResInfos_[resMesh];
+		auto it = instanceIndices_.find(mesh.get());
+		if (it != instanceIndices_.end())
+		{
+			return it->second;
+		}
+	}
+
+	// 初出のメッシュリソースはサブメッシュ、メッシュレット情報を登録する
+	auto resMesh = mesh->GetParentResource();
+	if (meshResInfos_.find(resMesh) == meshResInfos_.end())
+	{
+		size_t materialCount = worldMaterials_.size();
+		auto&& resInfo = RegisterMeshResource(resMesh);
+
 		auto&& submeshes = resMesh->GetSubmeshes();
+		sl12::u32 submeshCount = (sl12::u32)resInfo.nonXluSubmeshInfos.size();
+		sl12::u32 meshletCount = resInfo.meshletCount[0] + resInfo.meshletCount[1];
+		resInfo.submeshDataOffset = AllocateRange(BufferType::Submesh, submeshCount);
+		sl12::u32 meshletOffset = AllocateRange(BufferType::Meshlet, meshletCount);
+		resInfo.meshletDataOffsets.clear();
 		for (auto&& submeshInfo : resInfo.nonXluSubmeshInfos)
 		{
-			auto&& submesh = submeshes[submeshInfo.submeshIndex];
-			sl12::u32 submeshIndexOffset = (sl12::u32)(resMesh->GetIndexHandle().offset + submesh.indexOffsetBytes);
-			submeshData->materialIndex = GetWorldMaterialIndex(&resMesh->GetMaterials()[submesh.materialIndex]);
-			submeshData->posOffset = (sl12::u32)(resMesh->GetPositionHandle().offset + submesh.positionOffsetBytes);
-			submeshData->normalOffset = (sl12::u32)(resMesh->GetNormalHandle().offset + submesh.normalOffsetBytes);
-			submeshData->tangentOffset = (sl12::u32)(resMesh->GetTangentHandle().offset + submesh.tangentOffsetBytes);
-			submeshData->uvOffset = (sl12::u32)(resMesh->GetTexcoordHandle().offset + submesh.texcoordOffsetBytes);
-			submeshData->indexOffset = submeshIndexOffset;
-			submeshData++;
-
-			sl12::u32 submeshPackedPrimOffset = (sl12::u32)(resMesh->GetMeshletPackedPrimHandle().offset + submesh.meshletPackedPrimOffsetBytes);
-			sl12::u32 submeshVertexIndexOffset = (sl12::u32)(resMesh->GetMeshletVertexIndexHandle().offset + submesh.meshletVertexIndexOffsetBytes);
-			for (auto&& meshlet : submesh.meshlets)
+			resInfo.meshletDataOffsets.push_back(meshletOffset);
+			meshletOffset += (sl12::u32)submeshes[submeshInfo.submeshIndex].meshlets.size();
+		}
+
+		WriteMeshResourceData(GetTable<SubmeshData>(BufferType::Submesh), GetTable<MeshletData>(BufferType::Meshlet), resMesh, resInfo);
+		WriteMeshletBounds(GetTable<MeshletBoundData>(BufferType::MeshletBound), resMesh, resInfo);
+		MarkDirty(BufferType::Submesh, resInfo.submeshDataOffset, submeshCount);
+		if (submeshCount > 0)
+		{
+			MarkDirty(BufferType::Meshlet, resInfo.meshletDataOffsets[0], meshletCount);
+			MarkDirty(BufferType::MeshletBound, resInfo.meshletDataOffsets[0], meshletCount);
+		}
+
+		CreateMeshletBoundsView(resMesh, resInfo);
+
+		// マテリアルが増えた場合はマテリアルデータを作り直す
+		if (worldMaterials_.size() != materialCount)
+		{
+			CreateWorkGraphResources(pDevice_);
+		}
+	}
+	auto&& resInfo = meshResInfos_[resMesh];
+
+	// インスタンスの登録
+	// Instanceは常に詰めて配置するので、確保位置は末尾になる
+	sl12::u32 argCount = resInfo.meshletCount[0] + resInfo.meshletCount[1];
+	sl12::u32 instanceIndex = (sl12::u32)meshInstanceInfos_.size();
+	sl12::u32 instanceOffset = AllocateRange(BufferType::Instance, 1);
+	assert(instanceOffset == instanceIndex);
+
+	MeshInstanceInfo meshInfo = {};
+	meshInfo.meshInstance = mesh;
+	meshInfo.pMesh = mesh.get();
+	meshInfo.resMesh = resMesh;
+	meshInfo.argIndex[0] = AllocateRange(BufferType::IndirectArg, argCount);
+	meshInfo.argIndex[1] = meshInfo.argIndex[0] + resInfo.meshletCount[0];
+	instanceIndices_[mesh.get()] = instanceIndex;
+	meshInstanceInfos_.push_back(meshInfo);
+
+	// 描画コール範囲の登録
+	// argStart昇順を維持するので、挿入位置以降が更新範囲になる
+	if (argCount > 0)
+	{
+		DrawCallRange range;
+		range.argStart = meshInfo.argIndex[0];
+		range.instanceIndex = instanceIndex;
+		range.meshletStart = resInfo.meshletDataOffsets[0];
+		auto it = std::lower_bound(drawCallRanges_.begin(), drawCallRanges_.end(), range.argStart,
+			[](const DrawCallRange& r, sl12::u32 value)
 			{
-				meshletData->submeshIndex = submeshTotal;
-				meshletData->indexOffset = submeshIndexOffset + meshlet.indexOffset * (sl12::u32)sl12::ResourceItemMesh::GetIndexStride();
-				meshletData->meshletPackedPrimCount = meshlet.primitiveCount;
-				meshletData->meshletPackedPrimOffset = submeshPackedPrimOffset + meshlet.primitiveOffset * (sl12::u32)sizeof(sl12::u32);
-				meshletData->meshletVertexIndexCount = meshlet.vertexIndexCount;
-				meshletData->meshletVertexIndexOffset = submeshVertexIndexOffset + meshlet.vertexIndexOffset * (sl12::u32)sl12::ResourceItemMesh::GetIndexStride();
-				meshletData++;
-			}
+				return r.argStart < value;
+			});
+		sl12::u32 pos = (sl12::u32)(it - drawCallRanges_.begin());
+		drawCallRanges_.insert(it, range);
+#if DRAWCALL_PREFIX_TABLE
+		AllocateRange(BufferType::DrawCall, 1);
+		WriteDrawCallRanges(pos, (sl12::u32)drawCallRanges_.size());
+#endif
+	}
+
+	// テーブルの更新
+	WriteIndirectArgs(GetTable<sl12::u8>(BufferType::IndirectArg), meshInfo);
+	WriteInstanceData(GetTable<InstanceData>(BufferType::Instance), instanceIndex);
+	MarkDirty(BufferType::IndirectArg, meshInfo.argIndex[0], argCount);
+	MarkDirty(BufferType::Instance, instanceIndex, 1);
+#if !DRAWCALL_PREFIX_TABLE
+	WriteDrawCallData(GetTable<DrawCallData>(BufferType::DrawCall), instanceIndex);
+	MarkDirty(BufferType::DrawCall, meshInfo.argIndex[0], argCount);
+#endif
+	bDrawBucketDirty_ = true;
+
+	return instanceIndex;
+}
 
-			submeshTotal++;
+bool MeshletResource::RemoveInstance(const sl12::SceneMesh* mesh)
+{
+	auto it = instanceIndices_.find(mesh);
+	if (it == instanceIndices_.end())
+	{
+		return false;
+	}
+	sl12::u32 instanceIndex = it->second;
+	instanceIndices_.erase(it);
+
+	// 描画引数の領域を解放
+	// 解放した領域は描画されないよう0クリアしておく
+	auto&& meshInfo = meshInstanceInfos_[instanceIndex];
+	auto&& resInfo = meshResInfos_[meshInfo.resMesh];
+	sl12::u32 argCount = resInfo.meshletCount[0] + resInfo.meshletCount[1];
+	if (meshInfo.bOccluded)
+	{
+		occludedInstanceCount_--;
+	}
+	{
+		sl12::u8* pArgTop = GetTable<sl12::u8>(BufferType::IndirectArg);
+		memset(pArgTop + kIndirectArgsBufferStride * meshInfo.argIndex[0], 0, kIndirectArgsBufferStride * argCount);
+	}
+	MarkDirty(BufferType::IndirectArg, meshInfo.argIndex[0], argCount);
+	allocators_[BufferType::IndirectArg].Free(meshInfo.argIndex[0], argCount);
+
+	// 描画コール範囲の削除
+	sl12::u32 rangeCount = (sl12::u32)drawCallRanges_.size();
+	sl12::u32 rangeFirst = rangeCount;
+	if (argCount > 0)
+	{
+		rangeFirst = FindDrawCallRange(meshInfo.argIndex[0]);
+		drawCallRanges_.erase(drawCallRanges_.begin() + rangeFirst);
+	}
+
+	// 末尾のインスタンスを削除位置に移動する
+	sl12::u32 lastIndex = (sl12::u32)meshInstanceInfos_.size() - 1;
+	if (instanceIndex != lastIndex)
+	{
+		meshInstanceInfos_[instanceIndex] = meshInstanceInfos_[lastIndex];
+		auto&& movedInfo = meshInstanceInfos_[instanceIndex];
+		auto&& movedResInfo = meshResInfos_[movedInfo.resMesh];
+		sl12::u32 movedArgCount = movedResInfo.meshletCount[0] + movedResInfo.meshletCount[1];
+		instanceIndices_[movedInfo.pMesh] = instanceIndex;
+
+		// 移動したインスタンスの描画コールはinstanceIndexが変わるので書き直す
+		WriteInstanceData(GetTable<InstanceData>(BufferType::Instance), instanceIndex);
+		MarkDirty(BufferType::Instance, instanceIndex, 1);
+		if (movedArgCount > 0)
+		{
+			sl12::u32 pos = FindDrawCallRange(movedInfo.argIndex[0]);
+			drawCallRanges_[pos].instanceIndex = instanceIndex;
+			rangeFirst = std::min(rangeFirst, pos);
 		}
+#if !DRAWCALL_PREFIX_TABLE
+		WriteDrawCallData(GetTable<DrawCallData>(BufferType::DrawCall), instanceIndex);
+		MarkDirty(BufferType::DrawCall, movedInfo.argIndex[0], movedArgCount);
+#endif
 	}
-	// メッシュインスタンスごとのアップロードバッファを更新
-	sl12::u32 instanceIndex = 0;
+	meshInstanceInfos_.pop_back();
+	allocators_[BufferType::Instance].Free(lastIndex, 1);
+
+#if DRAWCALL_PREFIX_TABLE
+	// 削除位置以降を詰め直し、空いた末尾は無効値にする
+	if (rangeFirst < rangeCount)
+	{
+		WriteDrawCallRanges(rangeFirst, rangeCount);
+	}
+	if (argCount > 0)
+	{
+		allocators_[BufferType::DrawCall].Free(rangeCount - 1, 1);
+	}
+#endif
+	bDrawBucketDirty_ = true;
+
+	return true;
+}
+
+bool MeshletResource::UpdateTransform(const sl12::SceneMesh* mesh)
+{
+	auto it = instanceIndices_.find(mesh);
+	if (it == instanceIndices_.end())
+	{
+		return false;
+	}
+
+	WriteInstanceData(GetTable<InstanceData>(BufferType::Instance), it->second);
+	MarkDirty(BufferType::Instance, it->second, 1);
+
+	return true;
+}
+
+void MeshletResource::SetInstanceOccluded(sl12::u32 instanceIndex, bool bOccluded)
+{
+	if (instanceIndex >= meshInstanceInfos_.size())
+	{
+		return;
+	}
+	auto&& meshInfo = meshInstanceInfos_[instanceIndex];
+	if (meshInfo.bOccluded == bOccluded)
+	{
+		return;
+	}
+	meshInfo.bOccluded = bOccluded;
+	if (bOccluded)
+	{
+		occludedInstanceCount_++;
+	}
+	else
+	{
+		occludedInstanceCount_--;
+	}
+
+	// 行列は変わらないのでフラグのみ書き換える
+	GetTable<InstanceData>(BufferType::Instance)[instanceIndex].flags = bOccluded ? INSTANCE_FLAG_OCCLUDED : 0;
+	MarkDirty(BufferType::Instance, instanceIndex, 1);
+}
+
+void MeshletResource::ClearInstanceOcclusion()
+{
+	// 隠れたインスタンスがなければ走査しない
+	if (occludedInstanceCount_ == 0)
+	{
+		return;
+	}
+	for (sl12::u32 i = 0; i < (sl12::u32)meshInstanceInfos_.size() && occludedInstanceCount_ > 0; i++)
+	{
+		SetInstanceOccluded(i, false);
+	}
+}
+
+void MeshletResource::UpdateDrawBuckets()
+{
+	if (!bDrawBucketDirty_)
+	{
+		return;
+	}
+	bDrawBucketDirty_ = false;
+
+	// メッシュリソースごとのインスタンス数
+	std::unordered_map<const sl12::ResourceItemMesh*, sl12::u32> instanceCounts;
 	for (auto&& meshInfo : meshInstanceInfos_)
 	{
-		auto mesh = meshInfo.meshInstance.lock();
-		auto resMesh = mesh->GetParentResource();
-		auto meshIndex = data.meshMap[resMesh];
-		auto submeshOffset = data.submeshOffsets[meshIndex];
-		const MeshResInfo& resInfo = meshResInfos_[resMesh];
-		
-		// set mesh constant.
-		DirectX::XMMATRIX l2w = DirectX::XMLoadFloat4x4(&mesh->GetMtxLocalToWorld());
-		DirectX::XMMATRIX w2l = DirectX::XMMatrixInverse(nullptr, l2w);
-		instanceData->mtxBoxTransform = mesh->GetParentResource()->GetMtxBoxToLocal();
-		instanceData->mtxLocalToWorld = mesh->GetMtxLocalToWorld();
-		DirectX::XMStoreFloat4x4(&instanceData->mtxWorldToLocal, w2l);
-		instanceData++;
+		instanceCounts[meshInfo.resMesh]++;
+	}
 
+	// 同じメッシュリソースとマテリアルのサブメッシュを1つの描画リストにまとめる
+	// インスタンスのないメッシュリソースのリストは空になる
+	drawBuckets_.clear();
+	for (auto resMesh : meshResOrder_)
+	{
+		auto&& resInfo = meshResInfos_.find(resMesh)->second;
 		auto&& submeshes = resMesh->GetSubmeshes();
+		auto countIt = instanceCounts.find(resMesh);
+		sl12::u32 instanceCount = (countIt == instanceCounts.end()) ? 0 : countIt->second;
+		size_t firstBucket = drawBuckets_.size();
 		sl12::u32 submesh_count = (sl12::u32)resInfo.nonXluSubmeshInfos.size();
+		resInfo.drawBucketIndices.resize(submesh_count);
 		for (sl12::u32 i = 0; i < submesh_count; i++)
 		{
-			auto&& submesh = submeshes[resInfo.nonXluSubmeshInfos[i].submeshIndex];
-			auto meshletOffset = data.meshletOffsets[submeshOffset + i];
-			sl12::u32 meshlet_count = (sl12::u32)submesh.meshlets.size();
-			for (sl12::u32 j = 0; j < meshlet_count; j++)
+			auto&& submeshInfo = resInfo.nonXluSubmeshInfos[i];
+			size_t bucketIndex = firstBucket;
+			while (bucketIndex < drawBuckets_.size() && drawBuckets_[bucketIndex].materialIndex != submeshInfo.materialIndex)
 			{
-				drawcallData->instanceIndex = instanceIndex;
-				drawcallData->meshletIndex = meshletOffset + j;
-				drawcallData++;
+				bucketIndex++;
 			}
+			if (bucketIndex == drawBuckets_.size())
+			{
+				DrawBucket bucket;
+				bucket.resMesh = resMesh;
+				bucket.materialIndex = submeshInfo.materialIndex;
+				bucket.argStart = 0;
+				bucket.argCount = 0;
+				drawBuckets_.push_back(bucket);
+			}
+			drawBuckets_[bucketIndex].argCount += (sl12::u32)submeshes[submeshInfo.submeshIndex].meshlets.size() * instanceCount;
+			resInfo.drawBucketIndices[i] = (sl12::u32)bucketIndex;
 		}
+	}
 
-		instanceIndex++;
+	// 先頭から詰めて配置する
+	// リストの合計は使用中のドローコール数なので、IndirectArgの容量に収まる
+	sl12::u32 argStart = 0;
+	for (auto&& bucket : drawBuckets_)
+	{
+		bucket.argStart = argStart;
+		argStart += bucket.argCount;
 	}
+	assert(argStart <= GetDrawCallCapacity());
 
-	instanceUpload_->Unmap();
-	submeshUpload_->Unmap();
-	meshletUpload_->Unmap();
-	drawcallUpload_->Unmap();
+	// サブメッシュの先頭のドローコール位置に描画リストの先頭を書き込む
+	sl12::u32* pTable = GetTable<sl12::u32>(BufferType::DrawBucket);
+	for (auto&& meshInfo : meshInstanceInfos_)
+	{
+		auto&& resInfo = meshResInfos_.find(meshInfo.resMesh)->second;
+		auto&& submeshes = meshInfo.resMesh->GetSubmeshes();
+		sl12::u32 segmentStart = meshInfo.argIndex[0];
+		sl12::u32 submesh_count = (sl12::u32)resInfo.nonXluSubmeshInfos.size();
+		for (sl12::u32 i = 0; i < submesh_count; i++)
+		{
+			sl12::u32 meshletCount = (sl12::u32)submeshes[resInfo.nonXluSubmeshInfos[i].submeshIndex].meshlets.size();
+			if (meshletCount > 0)
+			{
+				pTable[segmentStart] = drawBuckets_[resInfo.drawBucketIndices[i]].argStart;
+			}
+			segmentStart += meshletCount;
+		}
+	}
+	MarkDirty(BufferType::DrawBucket, 0, GetDrawCallCapacity());
 }
 
-void MeshletResource::CopyMeshletBounds(sl12::CommandList* pCmdList)
+void MeshletResource::ClearDrawCounts(sl12::CommandList* pCmdList, sl12::Buffer* pDst)
 {
-	for (auto&& upload : meshletBoundsUploads_)
+	pCmdList->GetLatestCommandList()->CopyResource(pDst->GetResourceDep(), drawCountClearUpload_->GetResourceDep());
+	uploadStats_.clearBytes += drawCountClearUpload_->GetBufferDesc().size;
+}
+
+void MeshletResource::ClearMaskedDrawCounts(sl12::CommandList* pCmdList, sl12::Buffer* pDst)
+{
+	const UINT64 kSize = sizeof(sl12::u32) * MASKED_DRAW_LIST_COUNT;
+	pCmdList->GetLatestCommandList()->CopyBufferRegion(pDst->GetResourceDep(), 0, drawCountClearUpload_->GetResourceDep(), 0, kSize);
+	uploadStats_.clearBytes += kSize;
+}
+
+void MeshletResource::GatherCullData(MeshletCullData& outData)
+{
+	outData.indirectArgs = cpuTables_[BufferType::IndirectArg];
+	outData.instances = cpuTables_[BufferType::Instance];
+	outData.submeshes = cpuTables_[BufferType::Submesh];
+	outData.meshlets = cpuTables_[BufferType::Meshlet];
+	outData.drawCalls = cpuTables_[BufferType::DrawCall];
+	outData.bounds = cpuTables_[BufferType::MeshletBound];
+	outData.drawBuckets = cpuTables_[BufferType::DrawBucket];
+
+	outData.drawCallSourceCount = (sl12::u32)(outData.drawCalls.size() / sizeof(DrawCallSource));
+	outData.drawCallCount = GetDrawCallCapacity();
+}
+
+void MeshletResource::UploadSceneBuffers(sl12::CommandList* pCmdList, sl12::u64 frameIndex)
+{
+	// このフレームで転送するサイズ
+	UINT64 totalSize = 0;
+	for (int type = 0; type < BufferType::Max; type++)
+	{
+		if (!sceneBuffers_[type].IsValid())
+		{
+			continue;
+		}
+		if (bNeedFullUpload_[type])
+		{
+			totalSize += cpuTables_[type].size();
+		}
+		else
+		{
+			for (auto&& range : dirtyRanges_[type])
+			{
+				totalSize += kTableStrides[type] * range.count;
+			}
+		}
+	}
+	if (totalSize == 0)
 	{
-		auto resMesh = upload.first;
-		pCmdList->GetLatestCommandList()->CopyResource(meshletBoundsBuffers_[resMesh]->GetResourceDep(), upload.second->GetResourceDep());
+		ClearDirtyRanges();
+		return;
 	}
-	meshletBoundsUploads_.clear();
+
+	// フレームごとのステージングバッファに詰めてからコピーする
+	// 直前のフレームのコピーはGPUで実行中の可能性があるが、kStagingBufferCountフレーム前のコピーは完了している
+	auto&& staging = stagingBuffers_[frameIndex % kStagingBufferCount];
+	if (!staging.IsValid() || staging->GetBufferDesc().size < totalSize)
+	{
+		sl12::BufferDesc desc{};
+		desc.stride = 0;
+		desc.size = totalSize;
+		desc.usage = sl12::ResourceUsage::Unknown;
+		desc.heap = sl12::BufferHeap::Dynamic;
+		desc.initialState = D3D12_RESOURCE_STATE_COMMON;
+
+		// 古いバッファの破棄はデバイスに任せる
+		staging = sl12::MakeUnique<sl12::Buffer>(pDevice_);
+		staging->Initialize(pDevice_, desc);
+	}
+
+	sl12::u8* pStaging = (sl12::u8*)staging->Map();
+	UINT64 stagingOffset = 0;
+	auto CopyRange = [&](int type, UINT64 offset, UINT64 size)
+	{
+		memcpy(pStaging + stagingOffset, cpuTables_[type].data() + offset, size);
+		pCmdList->GetLatestCommandList()->CopyBufferRegion(sceneBuffers_[type]->GetResourceDep(), offset, staging->GetResourceDep(), stagingOffset, size);
+		stagingOffset += size;
+	};
+	for (int type = 0; type < BufferType::Max; type++)
+	{
+		if (!sceneBuffers_[type].IsValid())
+		{
+			continue;
+		}
+
+		UINT64 bytes = 0;
+		if (bNeedFullUpload_[type])
+		{
+			bytes = cpuTables_[type].size();
+			if (bytes > 0)
+			{
+				CopyRange(type, 0, bytes);
+			}
+			bNeedFullUpload_[type] = false;
+		}
+		else
+		{
+			// 更新範囲のみコピー
+			UINT64 stride = kTableStrides[type];
+			for (auto&& range : dirtyRanges_[type])
+			{
+				CopyRange(type, stride * range.offset, stride * range.count);
+				bytes += stride * range.count;
+			}
+		}
+		uploadStats_.sceneBytes += bytes;
+	}
+	staging->Unmap();
+
+	ClearDirtyRanges();
 }
 
 void MeshletResource::UpdateBindlessTextures(sl12::Device* pDev)
 {
-	bindlessTextures_.clear();
-	bindlessTextures_.push_back(pDev->GetDummyTextureView(sl12::DummyTex::Black)->GetDescInfo().cpuHandle);
-	bindlessTextures_.push_back(pDev->GetDummyTextureView(sl12::DummyTex::FlatNormal)->GetDescInfo().cpuHandle);
+	auto&& bindlessTextures = bindlessTextureArrays_[0];
+	bindlessTextures.clear();
+	bindlessTextures.push_back(pDev->GetDummyTextureView(sl12::DummyTex::Black)->GetDescInfo().cpuHandle);
+	bindlessTextures.push_back(pDev->GetDummyTextureView(sl12::DummyTex::FlatNormal)->GetDescInfo().cpuHandle);
 	for (auto&& mat : worldMaterials_)
 	{
 		// each textures.
 		auto resTex = mat.pResMaterial->baseColorTex.GetItem<sl12::ResourceItemTextureBase>();
 		if (resTex)
 		{
-			bindlessTextures_.push_back(const_cast<sl12::ResourceItemTextureBase*>(resTex)->GetTextureView().GetDescInfo().cpuHandle);
+			bindlessTextures.push_back(const_cast<sl12::ResourceItemTextureBase*>(resTex)->GetTextureView().GetDescInfo().cpuHandle);
 		}
 		resTex = mat.pResMaterial->normalTex.GetItem<sl12::ResourceItemTextureBase>();
 		if (resTex)
 		{
-			bindlessTextures_.push_back(const_cast<sl12::ResourceItemTextureBase*>(resTex)->GetTextureView().GetDescInfo().cpuHandle);
+			bindlessTextures.push_back(const_cast<sl12::ResourceItemTextureBase*>(resTex)->GetTextureView().GetDescInfo().cpuHandle);
 		}
 		resTex = mat.pResMaterial->ormTex.GetItem<sl12::ResourceItemTextureBase>();
 		if (resTex)
 		{
-			bindlessTextures_.push_back(const_cast<sl12::ResourceItemTextureBase*>(resTex)->GetTextureView().GetDescInfo().cpuHandle);
+			bindlessTextures.push_back(const_cast<sl12::ResourceItemTextureBase*>(resTex)->GetTextureView().GetDescInfo().cpuHandle);
 		}
 		resTex = mat.pResMaterial->emissiveTex.GetItem<sl12::ResourceItemTextureBase>();
 		if (resTex)
 		{
-			bindlessTextures_.push_back(const_cast<sl12::ResourceItemTextureBase*>(resTex)->GetTextureView().GetDescInfo().cpuHandle);
+			bindlessTextures.push_back(const_cast<sl12::ResourceItemTextureBase*>(resTex)->GetTextureView().GetDescInfo().cpuHandle);
 		}
 	}
 }
@@ -474,9 +1534,10 @@ void MeshletResource::CreateWorkGraphResources(sl12::Device* pDev)
 	materialDataUpload_->Initialize(pDev, desc);
 
 	MaterialData* data = static_cast<MaterialData*>(materialDataUpload_->Map());
-	bindlessTextures_.clear();
-	bindlessTextures_.push_back(pDev->GetDummyTextureView(sl12::DummyTex::Black)->GetDescInfo().cpuHandle);
-	bindlessTextures_.push_back(pDev->GetDummyTextureView(sl12::DummyTex::FlatNormal)->GetDescInfo().cpuHandle);
+	auto&& bindlessTextures = bindlessTextureArrays_[0];
+	bindlessTextures.clear();
+	bindlessTextures.push_back(pDev->GetDummyTextureView(sl12::DummyTex::Black)->GetDescInfo().cpuHandle);
+	bindlessTextures.push_back(pDev->GetDummyTextureView(sl12::DummyTex::FlatNormal)->GetDescInfo().cpuHandle);
 	for (auto&& mat : worldMaterials_)
 	{
 		data->shaderIndex = 0;
@@ -487,26 +1548,26 @@ void MeshletResource::CreateWorkGraphResources(sl12::Device* pDev)
 		auto resTex = mat.pResMaterial->baseColorTex.GetItem<sl12::ResourceItemTextureBase>();
 		if (resTex)
 		{
-			data->colorTexIndex = (UINT)bindlessTextures_.size();
-			bindlessTextures_.push_back(const_cast<sl12::ResourceItemTextureBase*>(resTex)->GetTextureView().GetDescInfo().cpuHandle);
+			data->colorTexIndex = (UINT)bindlessTextures.size();
+			bindlessTextures.push_back(const_cast<sl12::ResourceItemTextureBase*>(resTex)->GetTextureView().GetDescInfo().cpuHandle);
 		}
 		resTex = mat.pResMaterial->normalTex.GetItem<sl12::ResourceItemTextureBase>();
 		if (resTex)
 		{
-			data->normalTexIndex = (UINT)bindlessTextures_.size();
-			bindlessTextures_.push_back(const_cast<sl12::ResourceItemTextureBase*>(resTex)->GetTextureView().GetDescInfo().cpuHandle);
+			data->normalTexIndex = (UINT)bindlessTextures.size();
+			bindlessTextures.push_back(const_cast<sl12::ResourceItemTextureBase*>(resTex)->GetTextureView().GetDescInfo().cpuHandle);
 		}
 		resTex = mat.pResMaterial->ormTex.GetItem<sl12::ResourceItemTextureBase>();
 		if (resTex)
 		{
-			data->ormTexIndex = (UINT)bindlessTextures_.size();
-			bindlessTextures_.push_back(const_cast<sl12::ResourceItemTextureBase*>(resTex)->GetTextureView().GetDescInfo().cpuHandle);
+			data->ormTexIndex = (UINT)bindlessTextures.size();
+			bindlessTextures.push_back(const_cast<sl12::ResourceItemTextureBase*>(resTex)->GetTextureView().GetDescInfo().cpuHandle);
 		}
 		resTex = mat.pResMaterial->emissiveTex.GetItem<sl12::ResourceItemTextureBase>();
 		if (resTex)
 		{
-			data->emissiveTexIndex = (UINT)bindlessTextures_.size();
-			bindlessTextures_.push_back(const_cast<sl12::ResourceItemTextureBase*>(resTex)->GetTextureView().GetDescInfo().cpuHandle);
+			data->emissiveTexIndex = (UINT)bindlessTextures.size();
+			bindlessTextures.push_back(const_cast<sl12::ResourceItemTextureBase*>(resTex)->GetTextureView().GetDescInfo().cpuHandle);
 		}
 		data++;
 	}
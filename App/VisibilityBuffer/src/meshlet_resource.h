@@ -1,7 +1,9 @@
 ﻿#pragma once
 
+#include <map>
 #include <memory>
 #include <queue>
+#include <unordered_map>
 #include <vector>
 
 #include "app_pass_base.h"
@@ -23,8 +25,24 @@
 #include "sl12/timestamp.h"
 #include "sl12/work_graph.h"
 
+#include "meshlet_bound.h"
+
 template <typename T> using UniqueHandle = sl12::UniqueHandle<T>;
 
+struct InstanceData;
+struct SubmeshData;
+struct MeshletData;
+struct DrawCallData;
+struct DrawCallRange;
+struct MeshletCullData;
+
+// ドローコールバッファの要素
+#if DRAWCALL_PREFIX_TABLE
+typedef DrawCallRange	DrawCallSource;
+#else
+typedef DrawCallData	DrawCallSource;
+#endif
+
 //----
 struct WorldMaterial
 {
@@ -65,7 +83,11 @@ struct SubmeshInfo
 struct MeshInstanceInfo
 {
 	std::weak_ptr<sl12::SceneMesh>	meshInstance;
+	// 登録時に保持しておき、meshInstanceが破棄されていても参照できるようにする
+	const sl12::SceneMesh*			pMesh;		// instanceIndices_のキー
+	const sl12::ResourceItemMesh*	resMesh;
 	sl12::u32						argIndex[2]; // 0:opaque, 1:masked
+	bool							bOccluded;	// ソフトウェアオクルージョンで隠れている (InstanceData.flagsに反映する)
 };	// struct MeshInstanceInfo
 
 //----
@@ -76,19 +98,176 @@ struct MeshResInfo
 	sl12::u32						meshletCount[2];	// 0:opaque, 1:masked
 	std::vector<SubmeshInfo>		nonXluSubmeshInfos;	// 非半透明（Opaque & Masked）のサブメッシュ情報
 	std::vector<sl12::u32>			xluSubmeshIndices;	// 半透明サブメッシュのインデックス
+	sl12::u32						submeshDataOffset;	// SubmeshDataバッファ内の先頭
+	std::vector<sl12::u32>			meshletDataOffsets;	// nonXluSubmeshInfosごとのMeshletDataバッファ内の先頭
+	std::vector<std::vector<sl12::u8>>	meshletAlphaClasses;	// nonXluSubmeshInfosごとのMESHLET_ALPHA_xxx (ベイクのないサブメッシュは空)
+	std::vector<sl12::u8>			submeshAlphaClassMasks;	// nonXluSubmeshInfosごとの含まれるMESHLET_ALPHA_xxxのビット (ベイクのないサブメッシュは0)
+	std::vector<sl12::u32>			drawBucketIndices;	// nonXluSubmeshInfosごとの描画リストのインデックス
 };
 
+//----
+// メインビューの描画リスト
+// 同じメッシュリソースとマテリアルのサブメッシュは全インスタンスで1つのリストに詰め、1回のExecuteIndirectで描画する
+// 頂点バッファとインデックスバッファはメッシュリソース単位なので、メッシュリソースをまたいではまとめない
+struct DrawBucket
+{
+	const sl12::ResourceItemMesh*	resMesh;
+	sl12::u32						materialIndex;	// worldMaterials_のインデックス
+	sl12::u32						argStart;		// 引数バッファとカウントバッファの先頭
+	sl12::u32						argCount;		// 最大描画数 (全インスタンスのメッシュレット数の合計)
+};	// struct DrawBucket
+
+//----
+// 要素単位の連続領域サブアロケータ
+// 空き領域は先頭オフセット順に保持し、解放時に隣接領域と結合する
+class RangeAllocator
+{
+public:
+	static const sl12::u32 kInvalidOffset = 0xffffffff;
+
+	// [0, used) を確保済み、[used, capacity) を空きとして初期化
+	void Reset(sl12::u32 capacity, sl12::u32 used);
+	// 容量を拡張し、増えた分を空きに追加
+	void Grow(sl12::u32 newCapacity);
+
+	sl12::u32 Allocate(sl12::u32 count);
+	void Free(sl12::u32 offset, sl12::u32 count);
+
+	sl12::u32 GetCapacity() const
+	{
+		return capacity_;
+	}
+	sl12::u32 GetUsedCount() const
+	{
+		return usedCount_;
+	}
+
+private:
+	std::map<sl12::u32, sl12::u32>	freeBlocks_;	// offset -> count
+	sl12::u32						capacity_ = 0;
+	sl12::u32						usedCount_ = 0;
+};	// class RangeAllocator
+
+//----
+struct DirtyRange
+{
+	sl12::u32	offset;
+	sl12::u32	count;
+};	// struct DirtyRange
+
+//----
+// DRAWCALL_PREFIX_TABLE の描画コール解決 (visibility_buffer.hlsli の LoadDrawCallData と同じ処理)
+// pRangesはargStart昇順
+DrawCallData DecodeDrawCallRange(const DrawCallRange* pRanges, sl12::u32 rangeCount, sl12::u32 drawCallIndex);
+
 //----
 class MeshletResource
 {
+public:
+	enum BufferType
+	{
+		IndirectArg,
+		Instance,
+		Submesh,
+		Meshlet,
+		DrawCall,
+		MeshletBound,	// Meshletと同じ配置
+		DrawBucket,		// IndirectArgと同じ配置
+
+		Max
+	};
+
 public:
 	MeshletResource();
 	~MeshletResource();
 
 	void CreateResources(sl12::Device* pDev, const std::vector<std::shared_ptr<sl12::SceneMesh>>& meshes);
 
-	void CopyMeshletBounds(sl12::CommandList* pCmdList);
+	// インスタンス単位の更新
+	// 変更はそのインスタンスのメッシュレット数に比例するコストで済む
+	// インスタンスの削除は末尾のインスタンスを削除位置に移動するので、呼び出し側も同じ順序を維持すること
+	sl12::u32 AddInstance(const std::shared_ptr<sl12::SceneMesh>& mesh);
+	bool RemoveInstance(const sl12::SceneMesh* mesh);
+	bool UpdateTransform(const sl12::SceneMesh* mesh);
+	int GetInstanceIndex(const sl12::SceneMesh* mesh) const
+	{
+		auto it = instanceIndices_.find(mesh);
+		return (it == instanceIndices_.end()) ? -1 : (int)it->second;
+	}
+
+	// ソフトウェアオクルージョンの結果をインスタンスのフラグに反映する
+	// 変化したインスタンスのみ更新範囲になる
+	void SetInstanceOccluded(sl12::u32 instanceIndex, bool bOccluded);
+	void ClearInstanceOcclusion();
+
+	// インスタンスの追加/削除があれば描画リストを作り直す
+	// パスのPrepareExecuteが参照するので、並列実行の前に呼ぶこと
+	void UpdateDrawBuckets();
+	const std::vector<DrawBucket>& GetDrawBuckets() const
+	{
+		return drawBuckets_;
+	}
+
+	// 前回のClearDirtyRanges以降に更新された要素範囲
+	const std::vector<DirtyRange>& GetDirtyRanges(BufferType type) const
+	{
+		return dirtyRanges_[type];
+	}
+	void ClearDirtyRanges();
+
+	// ドローコール(=IndirectArg)バッファの要素数
+	// 削除されたインスタンスの領域も含む
+	sl12::u32 GetDrawCallCapacity() const
+	{
+		return allocators_[BufferType::IndirectArg].GetCapacity();
+	}
+
+	// コンパクションの描画数バッファを0クリアする
+	void ClearDrawCounts(sl12::CommandList* pCmdList, sl12::Buffer* pDst);
+	// マスクの描画リストの描画数バッファ (MASKED_DRAW_LIST_COUNT要素) を0クリアする
+	void ClearMaskedDrawCounts(sl12::CommandList* pCmdList, sl12::Buffer* pDst);
+	// 全テーブルの永続バッファに、フレームごとのステージングバッファ経由で更新範囲のみ転送する
+	// 1フレームに1回だけ呼ぶこと
+	void UploadSceneBuffers(sl12::CommandList* pCmdList, sl12::u64 frameIndex);
+
+	// CPUカリング用にCPUテーブルの内容をコピーする
+	// テーブル全体をコピーするので、毎フレームの使用は想定していない
+	void GatherCullData(MeshletCullData& outData);
+
+	// 転送量の統計
+	// ResetUploadStatsから次のResetUploadStatsまでの合計
+	struct UploadStats
+	{
+		sl12::u64	sceneBytes = 0;		// シーンバッファ (メッシュレットバウンズを含む)
+		sl12::u64	clearBytes = 0;		// 描画数のクリア (GPU内のコピー)
+	};
+	const UploadStats& GetUploadStats() const
+	{
+		return uploadStats_;
+	}
+	void ResetUploadStats()
+	{
+		uploadStats_ = UploadStats();
+	}
+
+	// ベイクしたメッシュレットのアルファ分類の統計 (メッシュリソース単位、インスタンス数は考慮しない)
+	struct MeshletAlphaStats
+	{
+		sl12::u32	opaque = 0;
+		sl12::u32	transparent = 0;
+		sl12::u32	mixed = 0;
+	};
+	MeshletAlphaStats GetMeshletAlphaStats() const;
+	// ベイクし直した "<mesh file>.malpha" を読み込み、MeshletDataに反映する
+	void ReloadMeshletAlphaClasses(const sl12::ResourceItemMesh* resMesh);
+	// ラスタライズでアルファテストが必要か (nonXluIndexはnonXluSubmeshInfosのインデックス)
+	// 全て破棄されるメッシュレットはカリングで除かれるので、混在するメッシュレットがなければ不要
+	static bool IsAlphaTestRequired(const MeshResInfo& resInfo, sl12::u32 nonXluIndex);
+	// サブメッシュのメッシュレットが全て不透明にベイクされているか (submeshIndexはメッシュリソースのサブメッシュ)
+	// レイトレーシングはメッシュレット単位で除けないので、全て不透明の場合のみエニーヒットを省略できる
+	bool IsSubmeshAlphaOpaque(const sl12::ResourceItemMesh* resMesh, sl12::u32 submeshIndex) const;
 
+	// パスの並列実行の前に、直列に呼ぶこと
 	void UpdateBindlessTextures(sl12::Device* pDev);
 
 	const std::vector<WorldMaterial>& GetWorldMaterials() const
@@ -109,26 +288,48 @@ public:
 		return meshInstanceInfos_;
 	}
 
-	const sl12::Buffer* GetMeshletIndirectArgUpload() const
+	// メッシュレットの描画引数の永続バッファ
+	// 更新範囲のみ転送され、カリングからは読み込みのみ行う
+	const sl12::Buffer* GetMeshletIndirectArgBuffer() const
+	{
+		return &sceneBuffers_[BufferType::IndirectArg];
+	}
+	const sl12::BufferView* GetIndirectArgSRV() const
+	{
+		return &sceneBufferSRVs_[BufferType::IndirectArg];
+	}
+	const sl12::Buffer* GetDrawCountClearUpload() const
+	{
+		return &drawCountClearUpload_;
+	}
+	const sl12::BufferView* GetInstanceSRV() const
+	{
+		return &sceneBufferSRVs_[BufferType::Instance];
+	}
+	const sl12::BufferView* GetSubmeshSRV() const
 	{
-		return &meshletIndirectArgUpload_;
+		return &sceneBufferSRVs_[BufferType::Submesh];
 	}
-	const sl12::Buffer* GetInstanceUpload() const
+	const sl12::BufferView* GetMeshletSRV() const
 	{
-		return &instanceUpload_;
+		return &sceneBufferSRVs_[BufferType::Meshlet];
 	}
-	const sl12::Buffer* GetSubmeshUpload() const
+	const sl12::BufferView* GetDrawCallSRV() const
 	{
-		return &submeshUpload_;
+		return &sceneBufferSRVs_[BufferType::DrawCall];
 	}
-	const sl12::Buffer* GetMeshletUpload() const
+	// サブメッシュの先頭のドローコール位置から描画リストの先頭を引くテーブル
+	const sl12::BufferView* GetDrawBucketSRV() const
 	{
-		return &meshletUpload_;
+		return &sceneBufferSRVs_[BufferType::DrawBucket];
 	}
-	const sl12::Buffer* GetDrawCallUpload() const
+	// 全メッシュリソースのメッシュレットバウンズ
+	// インデックスはDrawCallDataのmeshletIndexと同じ
+	const sl12::BufferView* GetMeshletBoundSRV() const
 	{
-		return &drawcallUpload_;
+		return &sceneBufferSRVs_[BufferType::MeshletBound];
 	}
+	// メッシュリソース単位のメッシュレットバウンズ (全体バッファの部分ビュー)
 	const sl12::BufferView* GetMeshletBoundsSRV(const sl12::ResourceItemMesh* resMesh) const
 	{
 		auto it = meshletBoundsSRVs_.find(resMesh);
@@ -138,51 +339,116 @@ public:
 		}
 		return &it->second;
 	}
-	const std::vector<D3D12_CPU_DESCRIPTOR_HANDLE>& GetBindlessTextures() const
+	// ルートシグネチャのバインドレス配列の形式 (配列は1つ) で保持して、描画時にコピーしない
+	const std::vector<std::vector<D3D12_CPU_DESCRIPTOR_HANDLE>>& GetBindlessTextureArrays() const
 	{
-		return bindlessTextures_;
+		return bindlessTextureArrays_;
 	}
 	const sl12::Buffer* GetMaterialDataUpload() const
 	{
 		return &materialDataUpload_;
 	}
 
+	// 描画コール範囲テーブルとインスタンスの登録内容が一致するか確認する
+	bool ValidateDrawCallRanges() const;
+
+	// アップロードテーブル構築のベンチマーク結果
+	struct TableBuildBenchmarkResult
+	{
+		sl12::u32	instanceCount = 0;
+		sl12::u32	argCount = 0;
+		sl12::u64	tableBytes = 0;
+		float		registerMs = 0.0f;	// インスタンス登録と配置の決定
+		float		fillMs = 0.0f;		// テーブルの書き込み
+		bool		bSkipped = false;	// メモリ上限を超えるので計測しなかった
+	};
+	// resMeshをinstanceCount個並べたシーンのテーブルをCPUメモリ上に構築し、時間を計測する
+	// デバイスもSceneMeshも使わないので、GPUバッファのサイズ上限に関係なく計測できる
+	static TableBuildBenchmarkResult RunTableBuildBenchmark(const sl12::ResourceItemMesh* resMesh, sl12::u32 instanceCount, sl12::u64 memoryLimit);
+
 private:
-	void CreateMeshletBoundsResources(sl12::Device* pDev);
-	int GetWorldMaterialIndex(const sl12::ResourceItemMesh::Material* mat);
+	MeshResInfo& RegisterMeshResource(const sl12::ResourceItemMesh* resMesh);
+	void LoadMeshletAlphaClasses(const sl12::ResourceItemMesh* resMesh, MeshResInfo& resInfo);
+	void CreateMeshletBoundsView(const sl12::ResourceItemMesh* resMesh, const MeshResInfo& resInfo);
+	int GetWorldMaterialIndex(const sl12::ResourceItemMesh::Material* mat) const;
+	void LayoutVisibilityResources();
 	void CreateVisibilityResources(sl12::Device* pDev);
 	void CreateWorkGraphResources(sl12::Device* pDev);
+
+	template <typename T>
+	T* GetTable(BufferType type)
+	{
+		return reinterpret_cast<T*>(cpuTables_[type].data());
+	}
+	void ResizeTable(BufferType type, sl12::u32 capacity);
+	void CreateSceneBuffer(BufferType type);
+	void CreateDrawCountClearBuffer(sl12::u32 capacity);
+	sl12::u32 AllocateRange(BufferType type, sl12::u32 count);
+	void MarkDirty(BufferType type, sl12::u32 offset, sl12::u32 count);
+
+	void WriteIndirectArgs(sl12::u8* pArgTop, const MeshInstanceInfo& info) const;
+	void WriteInstanceData(InstanceData* pInstanceTop, sl12::u32 instanceIndex) const;
+	static void StoreInstanceData(InstanceData* pInstance, const DirectX::XMFLOAT4X4& mtxLocalToWorld, const sl12::ResourceItemMesh* resMesh);
+	void WriteDrawCallData(DrawCallData* pDrawCallTop, sl12::u32 instanceIndex) const;
+	void WriteMeshResourceData(SubmeshData* pSubmeshTop, MeshletData* pMeshletTop, const sl12::ResourceItemMesh* resMesh, const MeshResInfo& resInfo) const;
+	void WriteMeshletBounds(MeshletBoundData* pBoundTop, const sl12::ResourceItemMesh* resMesh, const MeshResInfo& resInfo) const;
+	sl12::u32 FindDrawCallRange(sl12::u32 argStart) const;
+	void WriteDrawCallRanges(sl12::u32 first, sl12::u32 last);
 	
 private:
+	sl12::Device*						pDevice_ = nullptr;
 	bool								bNeedCopy = false;
 	std::vector<WorldMaterial>			worldMaterials_;
-	std::map<const sl12::ResourceItemMesh*, MeshResInfo>	meshResInfos_;
+	std::unordered_map<const sl12::ResourceItemMesh::Material*, sl12::u32>	worldMaterialIndices_;	// マテリアル→worldMaterials_のインデックス
+	std::unordered_map<const sl12::ResourceItemMesh*, MeshResInfo>			meshResInfos_;
+	// meshResInfos_の登録順
+	// テーブルの配置を実行ごとに変えないよう、配置はこの順で行う
+	std::vector<const sl12::ResourceItemMesh*>	meshResOrder_;
 	std::vector<MeshInstanceInfo>		meshInstanceInfos_;
+	std::unordered_map<const sl12::SceneMesh*, sl12::u32>	instanceIndices_;	// SceneMesh→meshInstanceInfos_のインデックス
+
+	// 各バッファの領域管理と更新範囲
+	// DrawCallはIndirectArgと同じ配置なので、IndirectArgのアロケータを共有する
+	// Instanceは常に詰めて配置するので、容量管理のみに使用する
+	RangeAllocator						allocators_[BufferType::Max];
+	std::vector<DirtyRange>				dirtyRanges_[BufferType::Max];
+	// インスタンスごとの描画コール範囲 (argStart昇順)
+	// DRAWCALL_PREFIX_TABLE が有効な場合、ドローコールバッファの内容になる
+	std::vector<DrawCallRange>			drawCallRanges_;
 
-	// MeshletのDrawIndirect引数バッファ
-	// メッシュインスタンスのOpaque/MaskedのMeshletの数だけ生成
-	UniqueHandle<sl12::Buffer>			meshletIndirectArgUpload_;
-	// メッシュインスタンスバッファ
-	// メッシュインスタンスの行列など、インスタンスに関わる情報を持つ
-	UniqueHandle<sl12::Buffer>			instanceUpload_;
-	// サブメッシュバッファ
-	// ResMeshが持つサブメッシュデータの合計数
-	// 同一ResMeshを持つインスタンスは1つにまとめる
-	UniqueHandle<sl12::Buffer>			submeshUpload_;
-	// メッシュレットバッファ
-	// サブメッシュバッファに保存したサブメッシュが持つメッシュレットの合計数
-	UniqueHandle<sl12::Buffer>			meshletUpload_;
-	// ドローコールバッファ
-	// メッシュインスタンスのOpaque/Maskedのメッシュレットの合計数
-	// ResMeshごとではなく、インスタンスごとであることに注意
-	UniqueHandle<sl12::Buffer>			drawcallUpload_;
-	// メッシュレットバウンズバッファ
-	// メッシュリソースごとのメッシュレットバウンズのリスト
-	std::map<const sl12::ResourceItemMesh*, UniqueHandle<sl12::Buffer>>		meshletBoundsUploads_;
-	std::map<const sl12::ResourceItemMesh*, UniqueHandle<sl12::Buffer>>		meshletBoundsBuffers_;
+	// BufferTypeごとのCPUテーブル
+	// 追加/削除/移動はCPUテーブルのみを書き換え、UploadSceneBuffersで永続バッファに転送する
+	// GPUが参照中のバッファをCPUから書き換えないようにするため
+	//   IndirectArg  : メッシュインスタンスのOpaque/MaskedのMeshletの数だけのDrawIndirect引数
+	//   Instance     : メッシュインスタンスの行列など、インスタンスに関わる情報
+	//   Submesh      : ResMeshが持つサブメッシュデータの合計数 (同一ResMeshを持つインスタンスは1つにまとめる)
+	//   Meshlet      : サブメッシュが持つメッシュレットの合計数
+	//   DrawCall     : メッシュインスタンスのOpaque/Maskedのメッシュレットの合計数 (インスタンスごと)
+	//   MeshletBound : Meshletと同じ配置で、全メッシュリソースのバウンズ
+	//   DrawBucket   : IndirectArgと同じ配置で、サブメッシュの先頭の位置に描画リストの先頭を格納する
+	std::vector<sl12::u8>				cpuTables_[BufferType::Max];
+	// メインビューの描画リスト (meshResOrder_、サブメッシュの順)
+	std::vector<DrawBucket>				drawBuckets_;
+	bool								bDrawBucketDirty_ = false;
+	sl12::u32							occludedInstanceCount_ = 0;
+	// コンパクション後の描画数バッファのクリア用
+	// メインビューは描画リストの先頭、シャドウはサブメッシュの先頭のIndirectArgの位置に描画数を格納する
+	UniqueHandle<sl12::Buffer>			drawCountClearUpload_;
+	// 全テーブルの永続バッファ
+	// CPUテーブルと同じサイズで、更新範囲のみコピーする
+	UniqueHandle<sl12::Buffer>			sceneBuffers_[BufferType::Max];
+	UniqueHandle<sl12::BufferView>		sceneBufferSRVs_[BufferType::Max];
+	// 転送用のステージングバッファ
+	// フレームの描画完了は次のフレームの終わりで待つので、2フレーム分あれば前のフレームのコピーと重ならない
+	static const int					kStagingBufferCount = 2;
+	UniqueHandle<sl12::Buffer>			stagingBuffers_[kStagingBufferCount];
+	bool								bNeedFullUpload_[BufferType::Max] = {};
+	UploadStats							uploadStats_;
+	// メッシュリソースごとのメッシュレットバウンズのビュー
+	// 永続バッファを作り直した場合は全て作り直す
 	std::map<const sl12::ResourceItemMesh*, UniqueHandle<sl12::BufferView>>	meshletBoundsSRVs_;
 	// WorkGraph関連データ
-	std::vector<D3D12_CPU_DESCRIPTOR_HANDLE>	bindlessTextures_;
+	std::vector<std::vector<D3D12_CPU_DESCRIPTOR_HANDLE>>	bindlessTextureArrays_ = std::vector<std::vector<D3D12_CPU_DESCRIPTOR_HANDLE>>(1);
 	UniqueHandle<sl12::Buffer>					materialDataUpload_;
 };
 
@@ -1,12 +1,16 @@
 ﻿#include "gbuffer_pass.h"
 #include "render_resource_settings.h"
 #include "../shader_types.h"
+#include "../meshlet_cull.h"
 
 #include "sl12/descriptor_set.h"
 
 #define USE_IN_CPP
 #include "../../shaders/cbuffer.hlsli"
 
+#include <chrono>
+#include <unordered_map>
+
 
 namespace
 {
@@ -40,18 +44,51 @@ std::vector<sl12::TransientResource> MeshletArgCopyPass::GetInputResources(const
 std::vector<sl12::TransientResource> MeshletArgCopyPass::GetOutputResources(const sl12::RenderPassID& ID) const
 {
 	auto pMR = pScene_->GetMeshletResource();
-	auto pUpload = pMR->GetMeshletIndirectArgUpload();
 
+	// 描画引数はMeshletResourceの永続バッファを直接参照するので、ここでは描画数のクリアのみ行う
 	std::vector<sl12::TransientResource> ret;
+	ret.reserve(4 + shadowCascadeCount_);
 
-	sl12::TransientResource arg(kMeshletIndirectArgID, sl12::TransientState::CopyDst);
+	sl12::TransientResource count(kMeshletDrawCountID, sl12::TransientState::CopyDst);
 
-	arg.desc.bIsTexture = false;
-	arg.desc.bufferDesc = pUpload->GetBufferDesc();
-	arg.desc.bufferDesc.heap = sl12::BufferHeap::Default;
-	arg.desc.bufferDesc.usage = sl12::ResourceUsage::UnorderedAccess;
+	count.desc.bIsTexture = false;
+	count.desc.bufferDesc = pMR->GetDrawCountClearUpload()->GetBufferDesc();
+	count.desc.bufferDesc.heap = sl12::BufferHeap::Default;
+	count.desc.bufferDesc.usage = sl12::ResourceUsage::UnorderedAccess;
 
-	ret.push_back(arg);
+	ret.push_back(count);
+
+	if (bOcclusionCulling_)
+	{
+		// 2nd passの描画数もここでクリアする
+		sl12::TransientResource count2nd(kMeshletDrawCount2ndID, sl12::TransientState::CopyDst);
+		count2nd.desc = count.desc;
+		ret.push_back(count2nd);
+	}
+	if (bShadowCulling_)
+	{
+		// シャドウの描画数もここでクリアする
+		for (int i = 0; i < shadowCascadeCount_; i++)
+		{
+			sl12::TransientResource countShadow(kShadowDrawCountIDs[i], sl12::TransientState::CopyDst);
+			countShadow.desc = count.desc;
+			ret.push_back(countShadow);
+		}
+	}
+	if (bMaskedDrawList_)
+	{
+		// マスクの描画リストの描画数もここでクリアする
+		sl12::TransientResource maskedCount(kMaskedDrawCountID, sl12::TransientState::CopyDst);
+		maskedCount.desc.bIsTexture = false;
+		maskedCount.desc.bufferDesc.InitializeByteAddress(sizeof(sl12::u32) * MASKED_DRAW_LIST_COUNT, sl12::ResourceUsage::UnorderedAccess);
+		ret.push_back(maskedCount);
+		if (bOcclusionCulling_)
+		{
+			sl12::TransientResource maskedCount2nd(kMaskedDrawCount2ndID, sl12::TransientState::CopyDst);
+			maskedCount2nd.desc = maskedCount.desc;
+			ret.push_back(maskedCount2nd);
+		}
+	}
 	return ret;
 }
 
@@ -59,15 +96,35 @@ void MeshletArgCopyPass::Execute(sl12::CommandList* pCmdList, sl12::TransientRes
 {
 	GPU_MARKER(pCmdList, 0, "MeshletArgCopyPass");
 
-	auto pArgRes = pResManager->GetRenderGraphResource(kMeshletIndirectArgID);
+	auto pCountRes = pResManager->GetRenderGraphResource(kMeshletDrawCountID);
 
 	auto pMR = pScene_->GetMeshletResource();
-	auto pUpload = pMR->GetMeshletIndirectArgUpload();
 
-	// copy bounds.
-	pMR->CopyMeshletBounds(pCmdList);
-	// copy indirect arg buffer.
-	pCmdList->GetLatestCommandList()->CopyResource(pArgRes->pBuffer->GetResourceDep(), pUpload->GetResourceDep());
+	// clear draw count buffer.
+	pMR->ClearDrawCounts(pCmdList, pCountRes->pBuffer);
+	if (bOcclusionCulling_)
+	{
+		auto pCount2ndRes = pResManager->GetRenderGraphResource(kMeshletDrawCount2ndID);
+		pMR->ClearDrawCounts(pCmdList, pCount2ndRes->pBuffer);
+	}
+	if (bShadowCulling_)
+	{
+		for (int i = 0; i < shadowCascadeCount_; i++)
+		{
+			auto pCountShadowRes = pResManager->GetRenderGraphResource(kShadowDrawCountIDs[i]);
+			pMR->ClearDrawCounts(pCmdList, pCountShadowRes->pBuffer);
+		}
+	}
+	if (bMaskedDrawList_)
+	{
+		auto pMaskedCountRes = pResManager->GetRenderGraphResource(kMaskedDrawCountID);
+		pMR->ClearMaskedDrawCounts(pCmdList, pMaskedCountRes->pBuffer);
+		if (bOcclusionCulling_)
+		{
+			auto pMaskedCount2ndRes = pResManager->GetRenderGraphResource(kMaskedDrawCount2ndID);
+			pMR->ClearMaskedDrawCounts(pCmdList, pMaskedCount2ndRes->pBuffer);
+		}
+	}
 }
 
 
@@ -75,19 +132,27 @@ void MeshletArgCopyPass::Execute(sl12::CommandList* pCmdList, sl12::TransientRes
 MeshletCullingPass::MeshletCullingPass(sl12::Device* pDev, RenderSystem* pRenderSys, Scene* pScene)
 	: AppPassBase(pDev, pRenderSys, pScene)
 {
-	rs_ = sl12::MakeUnique<sl12::RootSignature>(pDev);
-	pso_ = sl12::MakeUnique<sl12::ComputePipelineState>(pDev);
-	
-	// init root signature.
-	rs_->Initialize(pDev, pRenderSys->GetShader(ShaderName::MeshletCullC));
+	const ShaderName kShaders[] = {
+		ShaderName::MeshletCullC,
+		ShaderName::MeshletCull1stC,
+		ShaderName::MeshletCull2ndC,
+	};
+	static_assert(ARRAYSIZE(kShaders) == ECullType::Max, "shader count mismatch.");
 
-	// init pipeline state.
+	for (int i = 0; i < ECullType::Max; i++)
 	{
+		rs_[i] = sl12::MakeUnique<sl12::RootSignature>(pDev);
+		pso_[i] = sl12::MakeUnique<sl12::ComputePipelineState>(pDev);
+
+		// init root signature.
+		rs_[i]->Initialize(pDev, pRenderSys->GetShader(kShaders[i]));
+
+		// init pipeline state.
 		sl12::ComputePipelineStateDesc desc{};
-		desc.pRootSignature = &rs_;
-		desc.pCS = pRenderSys->GetShader(ShaderName::MeshletCullC);
+		desc.pRootSignature = &rs_[i];
+		desc.pCS = pRenderSys->GetShader(kShaders[i]);
 
-		if (!pso_->Initialize(pDev, desc))
+		if (!pso_[i]->Initialize(pDev, desc))
 		{
 			sl12::ConsolePrint("Error: failed to init meshlet cull pso.");
 		}
@@ -96,82 +161,194 @@ MeshletCullingPass::MeshletCullingPass(sl12::Device* pDev, RenderSystem* pRender
 
 MeshletCullingPass::~MeshletCullingPass()
 {
-	pso_.Reset();
-	rs_.Reset();
+	for (int i = 0; i < ECullType::Max; i++)
+	{
+		pso_[i].Reset();
+		rs_[i].Reset();
+	}
 }
 
 std::vector<sl12::TransientResource> MeshletCullingPass::GetInputResources(const sl12::RenderPassID& ID) const
 {
+	bool b2nd = ID == kMeshletCulling2ndPass;
+
 	std::vector<sl12::TransientResource> ret;
+	ret.reserve(2);
+	if (bOcclusionCulling_)
+	{
+		// 1st passは前フレームのHiZ、2nd passは1st passの深度から作ったHiZでテストする
+		ret.push_back(sl12::TransientResource(sl12::TransientResourceID(kHiZID, b2nd ? 0 : 1), sl12::TransientState::ShaderResource));
+		if (b2nd)
+		{
+			ret.push_back(sl12::TransientResource(kDrawFlagID, sl12::TransientState::ShaderResource));
+		}
+	}
 	return ret;
 }
 
 std::vector<sl12::TransientResource> MeshletCullingPass::GetOutputResources(const sl12::RenderPassID& ID) const
 {
+	bool b2nd = ID == kMeshletCulling2ndPass;
+
 	auto pMR = pScene_->GetMeshletResource();
-	auto pUpload = pMR->GetMeshletIndirectArgUpload();
+	auto pArgBuffer = pMR->GetMeshletIndirectArgBuffer();
 
 	std::vector<sl12::TransientResource> ret;
+	ret.reserve(5);
 
-	sl12::TransientResource arg(kMeshletIndirectArgID, sl12::TransientState::UnorderedAccess);
+	// 可視なメッシュレットの引数を描画リストごとに詰めて出力する
+	sl12::TransientResource arg(b2nd ? kMeshletCompactArg2ndID : kMeshletCompactArgID, sl12::TransientState::UnorderedAccess);
+	sl12::TransientResource count(b2nd ? kMeshletDrawCount2ndID : kMeshletDrawCountID, sl12::TransientState::UnorderedAccess);
 
 	arg.desc.bIsTexture = false;
 	arg.desc.bufferDesc.heap = sl12::BufferHeap::Default;
-	arg.desc.bufferDesc.size = pUpload->GetBufferDesc().size;
-	arg.desc.bufferDesc.stride = pUpload->GetBufferDesc().stride;
+	arg.desc.bufferDesc.size = pArgBuffer->GetBufferDesc().size;
+	arg.desc.bufferDesc.stride = pArgBuffer->GetBufferDesc().stride;
 	arg.desc.bufferDesc.usage = sl12::ResourceUsage::UnorderedAccess;
 
+	count.desc.bIsTexture = false;
+	count.desc.bufferDesc = pMR->GetDrawCountClearUpload()->GetBufferDesc();
+	count.desc.bufferDesc.heap = sl12::BufferHeap::Default;
+	count.desc.bufferDesc.usage = sl12::ResourceUsage::UnorderedAccess;
+
 	ret.push_back(arg);
+	ret.push_back(count);
+
+	if (bOcclusionCulling_ && !b2nd)
+	{
+		sl12::TransientResource flag(kDrawFlagID, sl12::TransientState::UnorderedAccess);
+		// フラグはIndirectArgのインデックスで参照されるので、空き領域も含めた容量分確保する
+		size_t totalMeshlets = pMR->GetDrawCallCapacity();
+		flag.desc.bIsTexture = false;
+		flag.desc.bufferDesc.InitializeByteAddress(totalMeshlets * 4, 0);
+		ret.push_back(flag);
+	}
+	if (bMaskedDrawList_)
+	{
+		// マスクのドローコールは全インスタンスで1つの描画リストにも詰める
+		// リストごとに全ドローコール分の容量を確保する
+		sl12::TransientResource maskedArg(b2nd ? kMaskedDrawArg2ndID : kMaskedDrawArgID, sl12::TransientState::UnorderedAccess);
+		sl12::TransientResource maskedCount(b2nd ? kMaskedDrawCount2ndID : kMaskedDrawCountID, sl12::TransientState::UnorderedAccess);
+		size_t totalMeshlets = pMR->GetDrawCallCapacity();
+		maskedArg.desc.bIsTexture = false;
+		maskedArg.desc.bufferDesc.InitializeByteAddress(kMaskedDrawArgsStride * totalMeshlets * MASKED_DRAW_LIST_COUNT, sl12::ResourceUsage::UnorderedAccess);
+		maskedCount.desc.bIsTexture = false;
+		maskedCount.desc.bufferDesc.InitializeByteAddress(sizeof(sl12::u32) * MASKED_DRAW_LIST_COUNT, sl12::ResourceUsage::UnorderedAccess);
+		ret.push_back(maskedArg);
+		ret.push_back(maskedCount);
+	}
 	return ret;
 }
 
 void MeshletCullingPass::Execute(sl12::CommandList* pCmdList, sl12::TransientResourceManager* pResManager, const sl12::RenderPassID& ID)
 {
-	GPU_MARKER(pCmdList, 0, "MeshletCullingPass");
+	bool b2nd = ID == kMeshletCulling2ndPass;
+	ECullType type = !bOcclusionCulling_ ? ECullType::FrustumOnly : (b2nd ? ECullType::Occlusion2nd : ECullType::Occlusion1st);
+
+	GPU_MARKER(pCmdList, 0, b2nd ? "MeshletCulling2ndPass" : "MeshletCullingPass");
 
-	auto pArgRes = pResManager->GetRenderGraphResource(kMeshletIndirectArgID);
-	auto pArgUAV = pResManager->CreateOrGetUnorderedAccessBufferView(pArgRes, 0, 0, 0, 0);
+	auto pCompactRes = pResManager->GetRenderGraphResource(b2nd ? kMeshletCompactArg2ndID : kMeshletCompactArgID);
+	auto pCountRes = pResManager->GetRenderGraphResource(b2nd ? kMeshletDrawCount2ndID : kMeshletDrawCountID);
+	auto pCompactUAV = pResManager->CreateOrGetUnorderedAccessBufferView(pCompactRes, 0, 0, 0, 0);
+	auto pCountUAV = pResManager->CreateOrGetUnorderedAccessBufferView(pCountRes, 0, 0, 0, 0);
+
+	auto&& cbvMan = pRenderSystem_->GetCbvManager();
+	auto pMR = pScene_->GetMeshletResource();
+
+	// create cull constant.
+	// 全インスタンスのドローコールを1回のDispatchで処理する
+	sl12::u32 drawCallCount = pMR->GetDrawCallCapacity();
+	if (drawCallCount == 0)
+	{
+		return;
+	}
+	MeshletCullCB cb;
+	cb.argStartAddress = 0;
+	cb.meshletStartIndex = 0;
+	cb.meshletCount = drawCallCount;
+	cb.localMeshletIndex = 0;
+	cb.maskedListCapacity = bMaskedDrawList_ ? drawCallCount : 0;
+	sl12::CbvHandle hCB = cbvMan->GetTemporal(&cb, sizeof(cb));
+
+	// マスクの描画リストを使わない場合もUAVは必要なので、パス内のダミーを設定する
+	sl12::UnorderedAccessView* pMaskedArgUAV = nullptr;
+	sl12::UnorderedAccessView* pMaskedCountUAV = nullptr;
+	if (bMaskedDrawList_)
+	{
+		auto pMaskedArgRes = pResManager->GetRenderGraphResource(b2nd ? kMaskedDrawArg2ndID : kMaskedDrawArgID);
+		auto pMaskedCountRes = pResManager->GetRenderGraphResource(b2nd ? kMaskedDrawCount2ndID : kMaskedDrawCountID);
+		pMaskedArgUAV = pResManager->CreateOrGetUnorderedAccessBufferView(pMaskedArgRes, 0, 0, 0, 0);
+		pMaskedCountUAV = pResManager->CreateOrGetUnorderedAccessBufferView(pMaskedCountRes, 0, 0, 0, 0);
+	}
+	else
+	{
+		sl12::TransientResourceDesc dummyDesc;
+		dummyDesc.bIsTexture = false;
+		dummyDesc.bufferDesc.InitializeByteAddress(kMaskedDrawArgsStride * MASKED_DRAW_LIST_COUNT, sl12::ResourceUsage::UnorderedAccess);
+		auto pDummyRes = pResManager->CreatePassOnlyResource(dummyDesc);
+		pMaskedArgUAV = pMaskedCountUAV = pResManager->CreateOrGetUnorderedAccessBufferView(pDummyRes, 0, 0, 0, 0);
+	}
 
 	// set descriptors.
 	sl12::DescriptorSet descSet;
 	descSet.Reset();
 	descSet.SetCsCbv(0, pScene_->GetTemporalCBs().hSceneCB.GetCBV()->GetDescInfo().cpuHandle);
 	descSet.SetCsCbv(1, pScene_->GetTemporalCBs().hFrustumCB.GetCBV()->GetDescInfo().cpuHandle);
-	descSet.SetCsUav(0, pArgUAV->GetDescInfo().cpuHandle);
-
-	auto&& cbvMan = pRenderSystem_->GetCbvManager();
-	auto pMR = pScene_->GetMeshletResource();
-	auto&& instances = pMR->GetMeshInstanceInfos();
-	sl12::u32 meshletTotal = 0;
-	sl12::u32 instanceIndex = 0;
-	for (auto&& instance : instances)
+	descSet.SetCsCbv(2, hCB.GetCBV()->GetDescInfo().cpuHandle);
+	descSet.SetCsSrv(0, pMR->GetInstanceSRV()->GetDescInfo().cpuHandle);
+	descSet.SetCsSrv(1, pMR->GetDrawCallSRV()->GetDescInfo().cpuHandle);
+	descSet.SetCsSrv(2, pMR->GetMeshletBoundSRV()->GetDescInfo().cpuHandle);
+	descSet.SetCsSrv(3, pMR->GetSubmeshSRV()->GetDescInfo().cpuHandle);
+	descSet.SetCsSrv(4, pMR->GetMeshletSRV()->GetDescInfo().cpuHandle);
+	descSet.SetCsSrv(5, pMR->GetIndirectArgSRV()->GetDescInfo().cpuHandle);
+	descSet.SetCsSrv(8, pMR->GetDrawBucketSRV()->GetDescInfo().cpuHandle);
+	descSet.SetCsUav(0, pCompactUAV->GetDescInfo().cpuHandle);
+	descSet.SetCsUav(1, pCountUAV->GetDescInfo().cpuHandle);
+	descSet.SetCsUav(3, pMaskedArgUAV->GetDescInfo().cpuHandle);
+	descSet.SetCsUav(4, pMaskedCountUAV->GetDescInfo().cpuHandle);
+	if (type != ECullType::FrustumOnly)
 	{
-		auto resMesh = instance.meshInstance.lock()->GetParentResource();
-		auto resInfo = pMR->GetMeshResInfo(resMesh);
-		
-		// set mesh constant.
-		descSet.SetCsCbv(2, pScene_->GetTemporalCBs().hMeshCBs[instanceIndex].GetCBV()->GetDescInfo().cpuHandle);
-
-		// create cull constant.
-		sl12::u32 meshletCnt = resInfo->meshletCount[0] + resInfo->meshletCount[1];
-		MeshletCullCB cb;
-		cb.meshletCount = meshletCnt;
-		cb.meshletStartIndex = meshletTotal;
-		cb.argStartAddress = meshletTotal * kIndirectArgsBufferStride;
-		sl12::CbvHandle hCB = cbvMan->GetTemporal(&cb, sizeof(cb));
-		descSet.SetCsCbv(3, hCB.GetCBV()->GetDescInfo().cpuHandle);
-		
-		const sl12::BufferView* meshletBV = pMR->GetMeshletBoundsSRV(resMesh);
-		descSet.SetCsSrv(0, meshletBV->GetDescInfo().cpuHandle);
+		// 最初のフレームはHiZの履歴がないので、オクルージョンカリングしない
+		auto pHiZRes = pResManager->GetRenderGraphResource(sl12::TransientResourceID(kHiZID, b2nd ? 0 : 1));
+		if (pHiZRes)
+		{
+			auto pHiZSRV = pResManager->CreateOrGetTextureView(pHiZRes);
+			descSet.SetCsSrv(6, pHiZSRV->GetDescInfo().cpuHandle);
+		}
+		else
+		{
+			auto black = pDevice_->GetDummyTextureView(sl12::DummyTex::Black);
+			descSet.SetCsSrv(6, black->GetDescInfo().cpuHandle);
+		}
+
+		auto pDrawFlagRes = pResManager->GetRenderGraphResource(kDrawFlagID);
+		if (b2nd)
+		{
+			auto pDrawFlagSRV = pResManager->CreateOrGetBufferView(pDrawFlagRes, 0, 0, 0);
+			descSet.SetCsSrv(7, pDrawFlagSRV->GetDescInfo().cpuHandle);
+		}
+		else
+		{
+			auto pDrawFlagUAV = pResManager->CreateOrGetUnorderedAccessBufferView(pDrawFlagRes, 0, 0, 0, 0);
+			descSet.SetCsUav(2, pDrawFlagUAV->GetDescInfo().cpuHandle);
+		}
+	}
 
-		pCmdList->GetLatestCommandList()->SetPipelineState(pso_->GetPSO());
-		pCmdList->SetComputeRootSignatureAndDescriptorSet(&rs_, &descSet);
+	// set pipeline.
+	pCmdList->GetLatestCommandList()->SetPipelineState(pso_[type]->GetPSO());
+	pCmdList->SetComputeRootSignatureAndDescriptorSet(&rs_[type], &descSet);
 
-		UINT t = (meshletCnt + 32 - 1) / 32;
-		pCmdList->GetLatestCommandList()->Dispatch(t, 1, 1);
-		
-		instanceIndex++;
-		meshletTotal += meshletCnt;
+	// dispatch.
+	UINT groupX, groupY;
+	GetMeshletCullDispatchSize(drawCallCount, groupX, groupY);
+	pCmdList->GetLatestCommandList()->Dispatch(groupX, groupY, 1);
+
+	// 検証用にカリング結果を読み戻す
+	if (pScene_->IsMeshletCullReadbackRequested())
+	{
+		// DrawFlagは1st passの出力
+		sl12::Buffer* pDrawFlag = (type == ECullType::Occlusion1st) ? pResManager->GetRenderGraphResource(kDrawFlagID)->pBuffer : nullptr;
+		pScene_->ReadbackMeshletCull(pCmdList, b2nd, pCompactRes->pBuffer, pCountRes->pBuffer, pDrawFlag, drawCallCount);
 	}
 }
 
@@ -188,8 +365,9 @@ DepthPrePass::DepthPrePass(sl12::Device* pDev, RenderSystem* pRenderSys, Scene*
 	psoMaskedDS_ = sl12::MakeUnique<sl12::GraphicsPipelineState>(pDev);
 	
 	// init root signature.
-	rsOpaque_->Initialize(pDev, pRenderSys->GetShader(ShaderName::DepthOpaqueVV), nullptr, nullptr, nullptr, nullptr);
-	rsMasked_->Initialize(pDev, pRenderSys->GetShader(ShaderName::DepthMaskedVV), pRenderSys->GetShader(ShaderName::DepthMaskedP), nullptr, nullptr, nullptr);
+	// ルート定数はドローコールのインデックス
+	rsOpaque_->Initialize(pDev, pRenderSys->GetShader(ShaderName::DepthOpaqueVV), nullptr, nullptr, nullptr, nullptr, 1);
+	rsMasked_->Initialize(pDev, pRenderSys->GetShader(ShaderName::DepthMaskedVV), pRenderSys->GetShader(ShaderName::DepthMaskedP), nullptr, nullptr, nullptr, 1);
 
 	// init pipeline state.
 	{
@@ -278,14 +456,127 @@ DepthPrePass::DepthPrePass(sl12::Device* pDev, RenderSystem* pRenderSys, Scene*
 	}
 
 	// init indirect executer.
+	// ルート定数を含むコマンドシグネチャはルートシグネチャごとに作る
 	indirectExec_ = sl12::MakeUnique<sl12::IndirectExecuter>(pDev);
-	bool bIndirectExecuterSucceeded = indirectExec_->Initialize(pDev, sl12::IndirectType::DrawIndexed, kIndirectArgsBufferStride);
+	indirectExecMasked_ = sl12::MakeUnique<sl12::IndirectExecuter>(pDev);
+	bool bIndirectExecuterSucceeded = indirectExec_->InitializeWithConstants(pDev, sl12::IndirectType::DrawIndexed, kIndirectArgsBufferStride, &rsOpaque_);
+	bIndirectExecuterSucceeded &= indirectExecMasked_->InitializeWithConstants(pDev, sl12::IndirectType::DrawIndexed, kIndirectArgsBufferStride, &rsMasked_);
 	assert(bIndirectExecuterSucceeded);
+
+	// init bindless objects.
+	{
+		sl12::u32 maxResources = 0;
+		for (auto mesh : pScene->GetSceneMeshes())
+		{
+			maxResources += (sl12::u32)(mesh->GetParentResource()->GetMaterials().size() * 4);
+		}
+		maxResources += 32;	// add buffer.
+		InitBindless(maxResources);
+	}
+}
+
+void DepthPrePass::InitBindless(sl12::u32 maxResources)
+{
+	// 古いオブジェクトはDeviceの破棄キューで遅延解放されるので、GPUが使用中でも作り直してよい
+	rsBindless_ = sl12::MakeUnique<sl12::RootSignature>(pDevice_);
+	psoBindless_ = sl12::MakeUnique<sl12::GraphicsPipelineState>(pDevice_);
+	psoBindlessDS_ = sl12::MakeUnique<sl12::GraphicsPipelineState>(pDevice_);
+	psoBindlessOpaque_ = sl12::MakeUnique<sl12::GraphicsPipelineState>(pDevice_);
+	psoBindlessOpaqueDS_ = sl12::MakeUnique<sl12::GraphicsPipelineState>(pDevice_);
+	indirectExecBindless_ = sl12::MakeUnique<sl12::IndirectExecuter>(pDevice_);
+
+	// init root signature.
+	{
+		sl12::RootBindlessInfo info;
+		info.index_ = 0;
+		info.space_ = 32;
+		info.maxResources_ = maxResources;
+		rsBindless_->InitializeWithBindless(pDevice_, pRenderSystem_->GetShader(ShaderName::MaskedBindlessVV), pRenderSystem_->GetShader(ShaderName::MaskedBindlessDepthP), nullptr, nullptr, nullptr, &info, 1, 1);
+	}
+	bindlessMaxResources_ = maxResources;
+
+	// init pipeline state.
+	{
+		// 頂点はシェーダでグローバルバッファから読むので、入力レイアウトはなし
+		sl12::GraphicsPipelineStateDesc desc{};
+		desc.pRootSignature = &rsBindless_;
+		desc.pVS = pRenderSystem_->GetShader(ShaderName::MaskedBindlessVV);
+		desc.pPS = pRenderSystem_->GetShader(ShaderName::MaskedBindlessDepthP);
+
+		desc.blend.sampleMask = UINT_MAX;
+		desc.blend.rtDesc[0].isBlendEnable = false;
+		desc.blend.rtDesc[0].writeMask = 0xf;
+
+		desc.rasterizer.cullMode = D3D12_CULL_MODE_BACK;
+		desc.rasterizer.fillMode = D3D12_FILL_MODE_SOLID;
+		desc.rasterizer.isDepthClipEnable = true;
+		desc.rasterizer.isFrontCCW = true;
+
+		desc.depthStencil.isDepthEnable = true;
+		desc.depthStencil.isDepthWriteEnable = true;
+		desc.depthStencil.depthFunc = D3D12_COMPARISON_FUNC_GREATER_EQUAL;
+
+		desc.primTopology = D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
+		desc.numRTVs = 0;
+		desc.dsvFormat = kDepthFormat;
+		desc.multisampleCount = 1;
+
+		if (!psoBindless_->Initialize(pDevice_, desc))
+		{
+			sl12::ConsolePrint("Error: failed to init depth bindless masked pso.");
+		}
+
+		desc.rasterizer.cullMode = D3D12_CULL_MODE_NONE;
+		
+		if (!psoBindlessDS_->Initialize(pDevice_, desc))
+		{
+			sl12::ConsolePrint("Error: failed to init depth bindless masked doublesided pso.");
+		}
+
+		// アルファテストしないのでピクセルシェーダは不要
+		desc.pPS = nullptr;
+		desc.rasterizer.cullMode = D3D12_CULL_MODE_BACK;
+
+		if (!psoBindlessOpaque_->Initialize(pDevice_, desc))
+		{
+			sl12::ConsolePrint("Error: failed to init depth bindless masked opaque pso.");
+		}
+
+		desc.rasterizer.cullMode = D3D12_CULL_MODE_NONE;
+
+		if (!psoBindlessOpaqueDS_->Initialize(pDevice_, desc))
+		{
+			sl12::ConsolePrint("Error: failed to init depth bindless masked opaque doublesided pso.");
+		}
+	}
+
+	// init indirect executer.
+	// バインドレス版はルート定数でドローコールを渡す
+	bool bIndirectExecuterSucceeded = indirectExecBindless_->InitializeWithConstants(pDevice_, sl12::IndirectType::Draw, kMaskedDrawArgsStride, &rsBindless_);
+	assert(bIndirectExecuterSucceeded);
+}
+
+void DepthPrePass::UpdateBindless()
+{
+	// インスタンス追加でワールドマテリアルが増えると、バインドレステクスチャがルートシグネチャの上限を超えるので作り直す
+	auto materialCount = pScene_->GetMeshletResource()->GetWorldMaterials().size();
+	sl12::u32 maxResources = (sl12::u32)(materialCount * 4) + 32;	// 4 textures per material + add buffer.
+	if (maxResources > bindlessMaxResources_)
+	{
+		InitBindless(maxResources);
+	}
 }
 
 DepthPrePass::~DepthPrePass()
 {
+	indirectExecBindless_.Reset();
+	psoBindless_.Reset();
+	psoBindlessDS_.Reset();
+	psoBindlessOpaque_.Reset();
+	psoBindlessOpaqueDS_.Reset();
+	rsBindless_.Reset();
 	indirectExec_.Reset();
+	indirectExecMasked_.Reset();
 	psoOpaque_.Reset();
 	psoOpaqueDS_.Reset();
 	psoMasked_.Reset();
@@ -294,11 +585,27 @@ DepthPrePass::~DepthPrePass()
 	rsMasked_.Reset();
 }
 
+void DepthPrePass::PrepareSerial(const sl12::RenderPassID& ID)
+{
+	// 作り直した古いオブジェクトはDeviceの破棄キューに積まれるので、並列実行中には行わない
+	if (bMaskedDrawList_)
+	{
+		UpdateBindless();
+	}
+}
+
 std::vector<sl12::TransientResource> DepthPrePass::GetInputResources(const sl12::RenderPassID& ID) const
 {
 	std::vector<sl12::TransientResource> ret;
+	ret.reserve(4);
 
-	ret.push_back(sl12::TransientResource(kMeshletIndirectArgID, sl12::TransientState::IndirectArgument));
+	ret.push_back(sl12::TransientResource(kMeshletCompactArgID, sl12::TransientState::IndirectArgument));
+	ret.push_back(sl12::TransientResource(kMeshletDrawCountID, sl12::TransientState::IndirectArgument));
+	if (bMaskedDrawList_)
+	{
+		ret.push_back(sl12::TransientResource(kMaskedDrawArgID, sl12::TransientState::IndirectArgument));
+		ret.push_back(sl12::TransientResource(kMaskedDrawCountID, sl12::TransientState::IndirectArgument));
+	}
 	
 	return ret;
 }
@@ -324,9 +631,26 @@ void DepthPrePass::Execute(sl12::CommandList* pCmdList, sl12::TransientResourceM
 {
 	GPU_MARKER(pCmdList, 0, "DepthPrePass");
 
-	auto pIndirectRes = pResManager->GetRenderGraphResource(kMeshletIndirectArgID);
+	auto pIndirectRes = pResManager->GetRenderGraphResource(kMeshletCompactArgID);
+	auto pCountRes = pResManager->GetRenderGraphResource(kMeshletDrawCountID);
 	auto pDepthRes = pResManager->GetRenderGraphResource(kDepthBufferID);
 	auto pDepthDSV = pResManager->CreateOrGetDepthStencilView(pDepthRes);
+	auto pMR = pScene_->GetMeshletResource();
+
+	// copy material data for bindless masked draw.
+	sl12::BufferView* pMaterialDataSRV = nullptr;
+	if (bMaskedDrawList_)
+	{
+		const sl12::Buffer* pMaterialDataUpload = pMR->GetMaterialDataUpload();
+		sl12::TransientResourceDesc matResDesc;
+		matResDesc.bIsTexture = false;
+		matResDesc.bufferDesc = pMaterialDataUpload->GetBufferDesc();
+		matResDesc.bufferDesc.heap = sl12::BufferHeap::Default;
+		matResDesc.bufferDesc.usage = sl12::ResourceUsage::ShaderResource;
+		auto pMaterialDataRes = pResManager->CreatePassOnlyResource(matResDesc);
+		pMaterialDataSRV = pResManager->CreateOrGetBufferView(pMaterialDataRes, 0, 0, (sl12::u32)pMaterialDataRes->pBuffer->GetBufferDesc().stride);
+		pCmdList->GetLatestCommandList()->CopyResource(pMaterialDataRes->pBuffer->GetResourceDep(), pMaterialDataUpload->GetResourceDep());
+	}
 	
 	// clear depth.
 	D3D12_CPU_DESCRIPTOR_HANDLE dsv = pDepthDSV->GetDescInfo().cpuHandle;
@@ -351,6 +675,9 @@ void DepthPrePass::Execute(sl12::CommandList* pCmdList, sl12::TransientResourceM
 	rect.bottom = pScene_->GetScreenHeight();
 	pCmdList->GetLatestCommandList()->RSSetScissorRects(1, &rect);
 
+	auto recordStart = std::chrono::high_resolution_clock::now();
+	sl12::u32 executeCount = 0;
+
 	// set descriptors.
 	auto detail_res = const_cast<sl12::ResourceItemTextureBase*>(pScene_->GetDetailTexHandle().GetItem<sl12::ResourceItemTextureBase>());
 	sl12::DescriptorSet dsOpaque, dsMasked;
@@ -359,109 +686,162 @@ void DepthPrePass::Execute(sl12::CommandList* pCmdList, sl12::TransientResourceM
 	dsMasked.Reset();
 	dsMasked.SetVsCbv(0, pScene_->GetTemporalCBs().hSceneCB.GetCBV()->GetDescInfo().cpuHandle);
 	dsMasked.SetPsSampler(0, pRenderSystem_->GetLinearWrapSampler()->GetDescInfo().cpuHandle);
+	// インスタンスのデータはルート定数のドローコールから引く
+	dsOpaque.SetVsSrv(0, pMR->GetInstanceSRV()->GetDescInfo().cpuHandle);
+	dsOpaque.SetVsSrv(1, pMR->GetDrawCallSRV()->GetDescInfo().cpuHandle);
+	dsMasked.SetVsSrv(0, pMR->GetInstanceSRV()->GetDescInfo().cpuHandle);
+	dsMasked.SetVsSrv(1, pMR->GetDrawCallSRV()->GetDescInfo().cpuHandle);
 
 	sl12::GraphicsPipelineState* NowPSO = nullptr;
-	sl12::RootSignature* NowRS = nullptr;
+	const sl12::ResourceItemMesh* NowMesh = nullptr;
 	
 	// draw meshes.
-	auto pMR = pScene_->GetMeshletResource();
-	auto&& instances = pMR->GetMeshInstanceInfos();
+	// 同じメッシュとマテリアルのサブメッシュは全インスタンスで1つの描画リストに詰められるので、描画リスト単位で描画する
+	auto&& buckets = pMR->GetDrawBuckets();
 	auto&& materials = pMR->GetWorldMaterials();
-	sl12::u32 meshIndex = 0;
-	sl12::u32 meshletTotal = 0;
-	for (auto&& instance : instances)
+	for (auto&& bucket : buckets)
 	{
-		auto resMesh = instance.meshInstance.lock()->GetParentResource();
-		auto resInfo = pMR->GetMeshResInfo(resMesh);
-		
-		// set mesh constant.
-		dsOpaque.SetVsCbv(1, pScene_->GetTemporalCBs().hMeshCBs[meshIndex].GetCBV()->GetDescInfo().cpuHandle);
-		dsMasked.SetVsCbv(1, pScene_->GetTemporalCBs().hMeshCBs[meshIndex].GetCBV()->GetDescInfo().cpuHandle);
-
-		// set vertex buffer.
-		const D3D12_VERTEX_BUFFER_VIEW vbvs[] = {
-			sl12::MeshManager::CreateVertexView(resMesh->GetPositionHandle(), 0, 0, sl12::ResourceItemMesh::GetPositionStride()),
-			sl12::MeshManager::CreateVertexView(resMesh->GetTexcoordHandle(), 0, 0, sl12::ResourceItemMesh::GetTexcoordStride()),
-		};
-		pCmdList->GetLatestCommandList()->IASetVertexBuffers(0, ARRAYSIZE(vbvs), vbvs);
+		if (bucket.argCount == 0)
+		{
+			continue;
+		}
 
-		// set index buffer.
-		auto ibv = sl12::MeshManager::CreateIndexView(resMesh->GetIndexHandle(), 0, 0, sl12::ResourceItemMesh::GetIndexStride());
-		pCmdList->GetLatestCommandList()->IASetIndexBuffer(&ibv);
+		auto&& material = materials[bucket.materialIndex].pResMaterial;
 
-		auto&& submeshes = resMesh->GetSubmeshes();
-		auto submesh_count = resInfo->nonXluSubmeshInfos.size();
-		for (int i = 0; i < submesh_count; i++)
+		// マスクはカリングで全インスタンスの描画リストに詰められる
+		if (bMaskedDrawList_ && material->blendType == sl12::ResourceMeshMaterialBlendType::Masked)
 		{
-			auto&& submeshInfo = resInfo->nonXluSubmeshInfos[i];
-			auto&& submesh = submeshes[submeshInfo.submeshIndex];
-			auto&& material = materials[submeshInfo.materialIndex].pResMaterial;
-			sl12::u32 meshletCnt = (sl12::u32)submesh.meshlets.size();
-
-			// select pso.
-			sl12::GraphicsPipelineState* pso = nullptr;
-			sl12::RootSignature* NowRS = nullptr;
-			sl12::DescriptorSet* NowDS = nullptr;
-			bool isSetTex = false;
-			switch (material->blendType)
+			continue;
+		}
+
+		// select pso.
+		sl12::GraphicsPipelineState* pso = nullptr;
+		sl12::RootSignature* NowRS = nullptr;
+		sl12::DescriptorSet* NowDS = nullptr;
+		sl12::IndirectExecuter* NowExec = nullptr;
+		bool isSetTex = false;
+		switch (material->blendType)
+		{
+		case sl12::ResourceMeshMaterialBlendType::Masked:
+			if (material->cullMode == sl12::ResourceMeshMaterialCullMode::Back)
 			{
-			case sl12::ResourceMeshMaterialBlendType::Masked:
-				if (material->cullMode == sl12::ResourceMeshMaterialCullMode::Back)
-				{
-					pso = &psoMasked_;
-				}
-				else
-				{
-					pso = &psoMaskedDS_;
-				}
-				NowRS = &rsMasked_;
-				NowDS = &dsMasked;
-				isSetTex = true;
-				break;
-			case sl12::ResourceMeshMaterialBlendType::Translucent:
-			default:
-				if (material->cullMode == sl12::ResourceMeshMaterialCullMode::Back)
-				{
-					pso = &psoOpaque_;
-				}
-				else
-				{
-					pso = &psoOpaqueDS_;
-				}
-				NowRS = &rsOpaque_;
-				NowDS = &dsOpaque;
-				break;
+				pso = &psoMasked_;
 			}
-
-			if (NowPSO != pso)
+			else
 			{
-				// set pipeline.
-				pCmdList->GetLatestCommandList()->SetPipelineState(pso->GetPSO());
-				pCmdList->GetLatestCommandList()->IASetPrimitiveTopology(D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
-				NowPSO = pso;
+				pso = &psoMaskedDS_;
 			}
-			
-			if (isSetTex)
+			NowRS = &rsMasked_;
+			NowDS = &dsMasked;
+			NowExec = &indirectExecMasked_;
+			isSetTex = true;
+			break;
+		case sl12::ResourceMeshMaterialBlendType::Translucent:
+		default:
+			if (material->cullMode == sl12::ResourceMeshMaterialCullMode::Back)
 			{
-				auto bc_tex_view = GetTextureView(material->baseColorTex, pDevice_->GetDummyTextureView(sl12::DummyTex::Black));
-				NowDS->SetPsSrv(0, bc_tex_view->GetDescInfo().cpuHandle);
+				pso = &psoOpaque_;
+			}
+			else
+			{
+				pso = &psoOpaqueDS_;
 			}
+			NowRS = &rsOpaque_;
+			NowDS = &dsOpaque;
+			NowExec = &indirectExec_;
+			break;
+		}
 
-			pCmdList->SetGraphicsRootSignatureAndDescriptorSet(NowRS, NowDS);
+		if (NowPSO != pso)
+		{
+			// set pipeline.
+			pCmdList->GetLatestCommandList()->SetPipelineState(pso->GetPSO());
+			pCmdList->GetLatestCommandList()->IASetPrimitiveTopology(D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
+			NowPSO = pso;
+		}
 
-			pCmdList->GetLatestCommandList()->ExecuteIndirect(
-				indirectExec_->GetCommandSignature(),			// command signature
-				meshletCnt,										// max command count
-				pIndirectRes->pBuffer->GetResourceDep(),		// argument buffer
-				indirectExec_->GetStride() * meshletTotal + 4,	// argument buffer offset
-				nullptr,										// count buffer
-				0);								// count buffer offset
-
-			meshletTotal += meshletCnt;
+		if (NowMesh != bucket.resMesh)
+		{
+			// set vertex buffer.
+			auto resMesh = bucket.resMesh;
+			const D3D12_VERTEX_BUFFER_VIEW vbvs[] = {
+				sl12::MeshManager::CreateVertexView(resMesh->GetPositionHandle(), 0, 0, sl12::ResourceItemMesh::GetPositionStride()),
+				sl12::MeshManager::CreateVertexView(resMesh->GetTexcoordHandle(), 0, 0, sl12::ResourceItemMesh::GetTexcoordStride()),
+			};
+			pCmdList->GetLatestCommandList()->IASetVertexBuffers(0, ARRAYSIZE(vbvs), vbvs);
+
+			// set index buffer.
+			auto ibv = sl12::MeshManager::CreateIndexView(resMesh->GetIndexHandle(), 0, 0, sl12::ResourceItemMesh::GetIndexStride());
+			pCmdList->GetLatestCommandList()->IASetIndexBuffer(&ibv);
+			NowMesh = resMesh;
+		}
+		
+		if (isSetTex)
+		{
+			auto bc_tex_view = GetTextureView(material->baseColorTex, pDevice_->GetDummyTextureView(sl12::DummyTex::Black));
+			NowDS->SetPsSrv(0, bc_tex_view->GetDescInfo().cpuHandle);
 		}
 
-		meshIndex++;
+		pCmdList->SetGraphicsRootSignatureAndDescriptorSet(NowRS, NowDS);
+
+		pCmdList->GetLatestCommandList()->ExecuteIndirect(
+			NowExec->GetCommandSignature(),					// command signature
+			bucket.argCount,								// max command count
+			pIndirectRes->pBuffer->GetResourceDep(),		// argument buffer
+			NowExec->GetStride() * bucket.argStart,			// argument buffer offset
+			pCountRes->pBuffer->GetResourceDep(),			// count buffer
+			sizeof(sl12::u32) * bucket.argStart);			// count buffer offset
+		executeCount++;
 	}
+
+	// draw masked meshlets of all instances.
+	// 裏面カリングと両面、それぞれアルファテストの有無で4回のExecuteIndirectで描画する
+	if (bMaskedDrawList_)
+	{
+		auto pMaskedArgRes = pResManager->GetRenderGraphResource(kMaskedDrawArgID);
+		auto pMaskedCountRes = pResManager->GetRenderGraphResource(kMaskedDrawCountID);
+		auto&& meshMan = pRenderSystem_->GetMeshManager();
+
+		sl12::DescriptorSet descSet;
+		descSet.Reset();
+		descSet.SetVsCbv(0, pScene_->GetTemporalCBs().hSceneCB.GetCBV()->GetDescInfo().cpuHandle);
+		descSet.SetVsSrv(0, pMR->GetInstanceSRV()->GetDescInfo().cpuHandle);
+		descSet.SetVsSrv(1, pMR->GetDrawCallSRV()->GetDescInfo().cpuHandle);
+		descSet.SetVsSrv(2, pMR->GetSubmeshSRV()->GetDescInfo().cpuHandle);
+		descSet.SetVsSrv(3, pMR->GetMeshletSRV()->GetDescInfo().cpuHandle);
+		descSet.SetVsSrv(4, meshMan->GetVertexBufferSRV()->GetDescInfo().cpuHandle);
+		descSet.SetVsSrv(5, meshMan->GetIndexBufferSRV()->GetDescInfo().cpuHandle);
+		descSet.SetPsSrv(0, pMaterialDataSRV->GetDescInfo().cpuHandle);
+		descSet.SetPsSampler(0, pRenderSystem_->GetLinearWrapSampler()->GetDescInfo().cpuHandle);
+
+		pCmdList->SetGraphicsRootSignatureAndDescriptorSet(&rsBindless_, &descSet, &pMR->GetBindlessTextureArrays());
+
+		sl12::GraphicsPipelineState* psoBindlessList[] = {
+			&psoBindless_,
+			&psoBindlessDS_,
+			&psoBindlessOpaque_,
+			&psoBindlessOpaqueDS_,
+		};
+		static_assert(ARRAYSIZE(psoBindlessList) == MASKED_DRAW_LIST_COUNT, "masked draw list count mismatch.");
+		sl12::u32 listCapacity = pMR->GetDrawCallCapacity();
+		for (sl12::u32 list = 0; list < MASKED_DRAW_LIST_COUNT; list++)
+		{
+			pCmdList->GetLatestCommandList()->SetPipelineState(psoBindlessList[list]->GetPSO());
+			pCmdList->GetLatestCommandList()->IASetPrimitiveTopology(D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
+
+			pCmdList->GetLatestCommandList()->ExecuteIndirect(
+				indirectExecBindless_->GetCommandSignature(),			// command signature
+				listCapacity,											// max command count
+				pMaskedArgRes->pBuffer->GetResourceDep(),				// argument buffer
+				indirectExecBindless_->GetStride() * listCapacity * list,	// argument buffer offset
+				pMaskedCountRes->pBuffer->GetResourceDep(),				// count buffer
+				sizeof(sl12::u32) * list);								// count buffer offset
+			executeCount++;
+		}
+	}
+	auto recordEnd = std::chrono::high_resolution_clock::now();
+	double recordMicroSec = (double)std::chrono::duration_cast<std::chrono::microseconds>(recordEnd - recordStart).count();
+	pScene_->GetDrawRecordStats().depthPre.Add(recordMicroSec, executeCount, true);
 }
 
 
@@ -589,7 +969,8 @@ GBufferPass::GBufferPass(sl12::Device* pDev, RenderSystem* pRenderSys, Scene* pS
 	}
 
 	// init indirect executer.
-	bool bIndirectExecuterSucceeded = indirectExec_->Initialize(pDev, sl12::IndirectType::DrawIndexed, kIndirectArgsBufferStride);
+	// ルート定数にドローコールのインデックスを設定し、頂点シェーダでインスタンスとマテリアルを引く
+	bool bIndirectExecuterSucceeded = indirectExec_->InitializeWithConstants(pDev, sl12::IndirectType::DrawIndexed, kIndirectArgsBufferStride, &rs_);
 	assert(bIndirectExecuterSucceeded);
 }
 
@@ -607,8 +988,10 @@ GBufferPass::~GBufferPass()
 std::vector<sl12::TransientResource> GBufferPass::GetInputResources(const sl12::RenderPassID& ID) const
 {
 	std::vector<sl12::TransientResource> ret;
+	ret.reserve(2);
 
-	ret.push_back(sl12::TransientResource(kMeshletIndirectArgID, sl12::TransientState::IndirectArgument));
+	ret.push_back(sl12::TransientResource(kMeshletCompactArgID, sl12::TransientState::IndirectArgument));
+	ret.push_back(sl12::TransientResource(kMeshletDrawCountID, sl12::TransientState::IndirectArgument));
 	
 	return ret;
 }
@@ -616,6 +999,7 @@ std::vector<sl12::TransientResource> GBufferPass::GetInputResources(const sl12::
 std::vector<sl12::TransientResource> GBufferPass::GetOutputResources(const sl12::RenderPassID& ID) const
 {
 	std::vector<sl12::TransientResource> ret;
+	ret.reserve(6);
 
 	sl12::TransientResource accum(kLightAccumID, sl12::TransientState::RenderTarget);
 	sl12::TransientResource ga(kGBufferAID, sl12::TransientState::RenderTarget);
@@ -654,11 +1038,108 @@ std::vector<sl12::TransientResource> GBufferPass::GetOutputResources(const sl12:
 	return ret;
 }
 
+void GBufferPass::PrepareExecute(const sl12::RenderPassID& ID)
+{
+	BuildDrawItems();
+}
+
+void GBufferPass::BuildDrawItems()
+{
+	// build draw items.
+	// 同じメッシュとマテリアルのサブメッシュは全インスタンスで1つの描画リストに詰められるので、描画リスト単位で描画する
+	// パイプラインとマテリアルでソートして、パイプラインとテクスチャの切り替えを減らす
+	auto pMR = pScene_->GetMeshletResource();
+	auto&& buckets = pMR->GetDrawBuckets();
+	auto&& materials = pMR->GetWorldMaterials();
+	auto pArena = &pScene_->GetFrameArena();
+	FrameVector<DrawSortItem> items{FrameArenaAllocator<DrawSortItem>(pArena)};
+	FrameVector<const sl12::ResourceItemMesh*> meshes{FrameArenaAllocator<const sl12::ResourceItemMesh*>(pArena)};
+	items.reserve(drawItems_.size());
+	meshes.reserve(drawMeshes_.size());
+	auto pSphereMesh = pScene_->GetSphereMeshHandle().IsValid() ? pScene_->GetSphereMeshHandle().GetItem<sl12::ResourceItemMesh>() : nullptr;
+	// select pso.
+	auto SetupItem = [&](DrawSortItem& item, const sl12::ResourceItemMesh* resMesh, sl12::u32 materialIndex)
+	{
+		auto&& material = materials[materialIndex].pResMaterial;
+		bool bBackCull = material->cullMode == sl12::ResourceMeshMaterialCullMode::Back;
+		if (resMesh == pSphereMesh)
+		{
+			item.psoIndex = 4;
+		}
+		else if (material->blendType == sl12::ResourceMeshMaterialBlendType::Masked)
+		{
+			item.psoIndex = bBackCull ? 2 : 3;
+		}
+		else
+		{
+			item.psoIndex = bBackCull ? 0 : 1;
+		}
+		item.materialIndex = materialIndex;
+	};
+	// 描画リストはメッシュリソース順に並んでいる
+	for (auto&& bucket : buckets)
+	{
+		if (meshes.empty() || meshes.back() != bucket.resMesh)
+		{
+			meshes.push_back(bucket.resMesh);
+		}
+		if (bucket.argCount == 0)
+		{
+			continue;
+		}
+
+		DrawSortItem item;
+		SetupItem(item, bucket.resMesh, bucket.materialIndex);
+		item.meshIndex = (sl12::u32)meshes.size() - 1;
+		item.instanceIndex = 0;
+		item.argIndex = bucket.argStart;
+		item.argCount = bucket.argCount;
+		item.key = MakeDrawSortKey(item.psoIndex, item.materialIndex, item.meshIndex, item.instanceIndex);
+		items.push_back(item);
+	}
+	SortDrawItems(items.data(), items.size());
+
+	// 比較用に、インスタンス順にサブメッシュごとに描画した場合のステート変更数を数える
+	// メッシュの定数バッファはディスクリプタで設定していたので、インスタンスが変わるとディスクリプタも変わる
+	DrawStateStats instanceOrderStats;
+	{
+		auto&& instances = pMR->GetMeshInstanceInfos();
+		DrawSortItem prev, curr;
+		const sl12::ResourceItemMesh* prevMesh = nullptr;
+		sl12::u32 meshIndex = 0;
+		sl12::u32 instanceIndex = 0;
+		for (auto&& instance : instances)
+		{
+			if (prevMesh && prevMesh != instance.resMesh)
+			{
+				meshIndex++;
+			}
+			auto resInfo = pMR->GetMeshResInfo(instance.resMesh);
+			for (auto&& submeshInfo : resInfo->nonXluSubmeshInfos)
+			{
+				SetupItem(curr, instance.resMesh, submeshInfo.materialIndex);
+				curr.meshIndex = meshIndex;
+				curr.instanceIndex = instanceIndex;
+				AddDrawStateChange(GetDrawStateChange(prevMesh ? &prev : nullptr, curr, true), instanceOrderStats);
+				prev = curr;
+				prevMesh = instance.resMesh;
+			}
+			instanceIndex++;
+		}
+	}
+
+	drawItems_ = std::move(items);
+	drawMeshes_ = std::move(meshes);
+	drawInstanceOrderStats_ = instanceOrderStats;
+	drawItemsFrame_ = pScene_->GetFrameIndex();
+}
+
 void GBufferPass::Execute(sl12::CommandList* pCmdList, sl12::TransientResourceManager* pResManager, const sl12::RenderPassID& ID)
 {
 	GPU_MARKER(pCmdList, 0, "GBufferPass");
 
-	auto pIndirectRes = pResManager->GetRenderGraphResource(kMeshletIndirectArgID);
+	auto pIndirectRes = pResManager->GetRenderGraphResource(kMeshletCompactArgID);
+	auto pCountRes = pResManager->GetRenderGraphResource(kMeshletDrawCountID);
 	auto pAccumRes = pResManager->GetRenderGraphResource(kLightAccumID);
 	auto pGbARes = pResManager->GetRenderGraphResource(kGBufferAID);
 	auto pGbBRes = pResManager->GetRenderGraphResource(kGBufferBID);
@@ -702,9 +1183,14 @@ void GBufferPass::Execute(sl12::CommandList* pCmdList, sl12::TransientResourceMa
 	
 	// set descriptors.
 	auto detail_res = const_cast<sl12::ResourceItemTextureBase*>(pScene_->GetDetailTexHandle().GetItem<sl12::ResourceItemTextureBase>());
+	auto pMR = pScene_->GetMeshletResource();
 	sl12::DescriptorSet descSet;
 	descSet.Reset();
 	descSet.SetVsCbv(0, TempCB.hSceneCB.GetCBV()->GetDescInfo().cpuHandle);
+	descSet.SetVsSrv(0, pMR->GetInstanceSRV()->GetDescInfo().cpuHandle);
+	descSet.SetVsSrv(1, pMR->GetDrawCallSRV()->GetDescInfo().cpuHandle);
+	descSet.SetVsSrv(2, pMR->GetSubmeshSRV()->GetDescInfo().cpuHandle);
+	descSet.SetVsSrv(3, pMR->GetMeshletSRV()->GetDescInfo().cpuHandle);
 	descSet.SetPsCbv(0, TempCB.hSceneCB.GetCBV()->GetDescInfo().cpuHandle);
 	descSet.SetPsCbv(1, TempCB.hDetailCB.GetCBV()->GetDescInfo().cpuHandle);
 	// if (detailType_ != 3)
@@ -719,88 +1205,61 @@ void GBufferPass::Execute(sl12::CommandList* pCmdList, sl12::TransientResourceMa
 	descSet.SetPsSampler(0, pRenderSystem_->GetLinearWrapSampler()->GetDescInfo().cpuHandle);
 	descSet.SetPsUav(0, pMipUAV->GetDescInfo().cpuHandle);
 
-	sl12::GraphicsPipelineState* NowPSO = nullptr;
+	// build draw items.
+	// 通常はPrepareExecuteで他のパスと並列に作成済み
+	if (drawItemsFrame_ != pScene_->GetFrameIndex())
+	{
+		BuildDrawItems();
+	}
+	auto&& materials = pMR->GetWorldMaterials();
+	auto&& items = drawItems_;
+	auto&& meshes = drawMeshes_;
+	DrawStateStats instanceOrderStats = drawInstanceOrderStats_;
 
 	// draw meshes.
-	auto pMR = pScene_->GetMeshletResource();
-	auto&& instances = pMR->GetMeshInstanceInfos();
-	auto&& materials = pMR->GetWorldMaterials();
-	sl12::u32 meshIndex = 0;
-	sl12::u32 meshletTotal = 0;
-	for (auto&& instance : instances)
+	// インスタンスのデータはルート定数のドローコールから引くので、ディスクリプタはマテリアルが変わるときだけ設定する
+	sl12::GraphicsPipelineState* psoList[] = {
+		&psoMeshOpaque_,
+		&psoMeshOpaqueDS_,
+		&psoMeshMasked_,
+		&psoMeshMaskedDS_,
+		&psoTriplanar_,
+	};
+	DrawStateStats sortedStats;
+	const DrawSortItem* pPrev = nullptr;
+	for (auto&& item : items)
 	{
-		// select pso.
-		auto resMesh = instance.meshInstance.lock()->GetParentResource();
-		auto resInfo = pMR->GetMeshResInfo(resMesh);
-		
-		// set mesh constant.
-		descSet.SetVsCbv(1, TempCB.hMeshCBs[meshIndex].GetCBV()->GetDescInfo().cpuHandle);
-
-		// set vertex buffer.
-		const D3D12_VERTEX_BUFFER_VIEW vbvs[] = {
-			sl12::MeshManager::CreateVertexView(resMesh->GetPositionHandle(), 0, 0, sl12::ResourceItemMesh::GetPositionStride()),
-			sl12::MeshManager::CreateVertexView(resMesh->GetNormalHandle(), 0, 0, sl12::ResourceItemMesh::GetNormalStride()),
-			sl12::MeshManager::CreateVertexView(resMesh->GetTangentHandle(), 0, 0, sl12::ResourceItemMesh::GetTangentStride()),
-			sl12::MeshManager::CreateVertexView(resMesh->GetTexcoordHandle(), 0, 0, sl12::ResourceItemMesh::GetTexcoordStride()),
-		};
-		pCmdList->GetLatestCommandList()->IASetVertexBuffers(0, ARRAYSIZE(vbvs), vbvs);
+		sl12::u32 change = GetDrawStateChange(pPrev, item, false);
 
-		// set index buffer.
-		auto ibv = sl12::MeshManager::CreateIndexView(resMesh->GetIndexHandle(), 0, 0, sl12::ResourceItemMesh::GetIndexStride());
-		pCmdList->GetLatestCommandList()->IASetIndexBuffer(&ibv);
-
-		auto&& submeshes = resMesh->GetSubmeshes();
-		auto submesh_count = resInfo->nonXluSubmeshInfos.size();
-		for (int i = 0; i < submesh_count; i++)
+		// set pipeline.
+		if (change & kDrawStatePso)
 		{
-			auto&& submeshInfo = resInfo->nonXluSubmeshInfos[i];
-			auto&& submesh = submeshes[submeshInfo.submeshIndex];
-			auto&& material = materials[submeshInfo.materialIndex].pResMaterial;
-			sl12::u32 meshletCnt = (sl12::u32)submesh.meshlets.size();
-
-			// select pso.
-			sl12::GraphicsPipelineState* pso = nullptr;
-			if (pScene_->GetSphereMeshHandle().IsValid() && resMesh == pScene_->GetSphereMeshHandle().GetItem<sl12::ResourceItemMesh>())
-			{
-				pso = &psoTriplanar_;
-			}
-			else
-			{
-				switch (material->blendType)
-				{
-				case sl12::ResourceMeshMaterialBlendType::Masked:
-					if (material->cullMode == sl12::ResourceMeshMaterialCullMode::Back)
-					{
-						pso = &psoMeshMasked_;
-					}
-					else
-					{
-						pso = &psoMeshMaskedDS_;
-					}
-					break;
-				default:
-					if (material->cullMode == sl12::ResourceMeshMaterialCullMode::Back)
-					{
-						pso = &psoMeshOpaque_;
-					}
-					else
-					{
-						pso = &psoMeshOpaqueDS_;
-					}
-					break;
-				}
-			}
+			pCmdList->GetLatestCommandList()->SetPipelineState(psoList[item.psoIndex]->GetPSO());
+			pCmdList->GetLatestCommandList()->IASetPrimitiveTopology(D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
+		}
 
-			if (NowPSO != pso)
-			{
-				// set pipeline.
-				pCmdList->GetLatestCommandList()->SetPipelineState(pso->GetPSO());
-				pCmdList->GetLatestCommandList()->IASetPrimitiveTopology(D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
-				NowPSO = pso;
-			}
+		// set vertex buffer and index buffer.
+		if (change & kDrawStateVertexBuffer)
+		{
+			auto resMesh = meshes[item.meshIndex];
+			const D3D12_VERTEX_BUFFER_VIEW vbvs[] = {
+				sl12::MeshManager::CreateVertexView(resMesh->GetPositionHandle(), 0, 0, sl12::ResourceItemMesh::GetPositionStride()),
+				sl12::MeshManager::CreateVertexView(resMesh->GetNormalHandle(), 0, 0, sl12::ResourceItemMesh::GetNormalStride()),
+				sl12::MeshManager::CreateVertexView(resMesh->GetTangentHandle(), 0, 0, sl12::ResourceItemMesh::GetTangentStride()),
+				sl12::MeshManager::CreateVertexView(resMesh->GetTexcoordHandle(), 0, 0, sl12::ResourceItemMesh::GetTexcoordStride()),
+			};
+			pCmdList->GetLatestCommandList()->IASetVertexBuffers(0, ARRAYSIZE(vbvs), vbvs);
+
+			auto ibv = sl12::MeshManager::CreateIndexView(resMesh->GetIndexHandle(), 0, 0, sl12::ResourceItemMesh::GetIndexStride());
+			pCmdList->GetLatestCommandList()->IASetIndexBuffer(&ibv);
+		}
 
-			if (pso != &psoTriplanar_)
+		// set descriptors.
+		if (change & kDrawStateDescriptor)
+		{
+			if (item.psoIndex != 4)
 			{
+				auto&& material = materials[item.materialIndex].pResMaterial;
 				auto bc_tex_view = GetTextureView(material->baseColorTex, pDevice_->GetDummyTextureView(sl12::DummyTex::Black));
 				auto nm_tex_view = GetTextureView(material->normalTex, pDevice_->GetDummyTextureView(sl12::DummyTex::FlatNormal));
 				auto orm_tex_view = GetTextureView(material->ormTex, pDevice_->GetDummyTextureView(sl12::DummyTex::Black));
@@ -818,21 +1277,23 @@ void GBufferPass::Execute(sl12::CommandList* pCmdList, sl12::TransientResourceMa
 			}
 
 			pCmdList->SetGraphicsRootSignatureAndDescriptorSet(&rs_, &descSet);
-			pCmdList->GetLatestCommandList()->SetGraphicsRoot32BitConstant(rs_->GetRootConstantIndex(), (UINT)submeshInfo.materialIndex, 0);
-
-			pCmdList->GetLatestCommandList()->ExecuteIndirect(
-				indirectExec_->GetCommandSignature(),			// command signature
-				meshletCnt,										// max command count
-				pIndirectRes->pBuffer->GetResourceDep(),		// argument buffer
-				indirectExec_->GetStride() * meshletTotal + 4,	// argument buffer offset
-				nullptr,										// count buffer
-				0);								// count buffer offset
-
-			meshletTotal += meshletCnt;
 		}
 
-		meshIndex++;
+		pCmdList->GetLatestCommandList()->ExecuteIndirect(
+			indirectExec_->GetCommandSignature(),			// command signature
+			item.argCount,									// max command count
+			pIndirectRes->pBuffer->GetResourceDep(),		// argument buffer
+			indirectExec_->GetStride() * item.argIndex,		// argument buffer offset
+			pCountRes->pBuffer->GetResourceDep(),			// count buffer
+			sizeof(sl12::u32) * item.argIndex);				// count buffer offset
+
+		AddDrawStateChange(change, sortedStats);
+		pPrev = &item;
 	}
+
+	auto&& stats = pScene_->GetDrawSortStats();
+	stats.gbufferInstanceOrder = instanceOrderStats;
+	stats.gbufferSorted = sortedStats;
 }
 
 
@@ -991,6 +1452,7 @@ std::vector<sl12::TransientResource> XluPass::GetInputResources(const sl12::Rend
 std::vector<sl12::TransientResource> XluPass::GetOutputResources(const sl12::RenderPassID& ID) const
 {
 	std::vector<sl12::TransientResource> ret;
+	ret.reserve(2);
 
 	sl12::TransientResource accum(kLightAccumID, sl12::TransientState::RenderTarget);
 	sl12::TransientResource depth(kDepthBufferID, sl12::TransientState::DepthStencil);
@@ -1055,82 +1517,115 @@ void XluPass::Execute(sl12::CommandList* pCmdList, sl12::TransientResourceManage
 	descSet.SetPsSampler(1, pRenderSystem_->GetEnvSampler()->GetDescInfo().cpuHandle);
 
 	sl12::GraphicsPipelineState* NowPSO = nullptr;
+	const sl12::ResourceItemMesh* NowMesh = nullptr;
+	sl12::u32 NowMeshIndex = ~0u;
 
 	// draw meshes.
-	auto pMR = pScene_->GetMeshletResource();
-	auto&& instances = pMR->GetMeshInstanceInfos();
-	auto&& materials = pMR->GetWorldMaterials();
-	sl12::u32 meshIndex = 0;
-	for (auto&& instance : instances)
+	if (drawItemsFrame_ != pScene_->GetFrameIndex())
 	{
-		auto resMesh = instance.meshInstance.lock()->GetParentResource();
-		auto resInfo = pMR->GetMeshResInfo(resMesh);
-
-		// set mesh constant.
-		descSet.SetVsCbv(1, TempCB.hMeshCBs[meshIndex].GetCBV()->GetDescInfo().cpuHandle);
-
-		// set vertex buffer.
-		const D3D12_VERTEX_BUFFER_VIEW vbvs[] = {
-			sl12::MeshManager::CreateVertexView(resMesh->GetPositionHandle(), 0, 0, sl12::ResourceItemMesh::GetPositionStride()),
-			sl12::MeshManager::CreateVertexView(resMesh->GetNormalHandle(), 0, 0, sl12::ResourceItemMesh::GetNormalStride()),
-			sl12::MeshManager::CreateVertexView(resMesh->GetTangentHandle(), 0, 0, sl12::ResourceItemMesh::GetTangentStride()),
-			sl12::MeshManager::CreateVertexView(resMesh->GetTexcoordHandle(), 0, 0, sl12::ResourceItemMesh::GetTexcoordStride()),
-		};
-		pCmdList->GetLatestCommandList()->IASetVertexBuffers(0, ARRAYSIZE(vbvs), vbvs);
+		BuildDrawItems();
+	}
+	for (auto&& item : drawItems_)
+	{
+		if (NowMeshIndex != item.meshIndex)
+		{
+			// set mesh constant.
+			descSet.SetVsCbv(1, TempCB.hMeshCBs[item.meshIndex].GetCBV()->GetDescInfo().cpuHandle);
+			NowMeshIndex = item.meshIndex;
+		}
 
-		// set index buffer.
-		auto ibv = sl12::MeshManager::CreateIndexView(resMesh->GetIndexHandle(), 0, 0, sl12::ResourceItemMesh::GetIndexStride());
-		pCmdList->GetLatestCommandList()->IASetIndexBuffer(&ibv);
+		auto resMesh = item.resMesh;
+		if (NowMesh != resMesh)
+		{
+			// set vertex buffer.
+			const D3D12_VERTEX_BUFFER_VIEW vbvs[] = {
+				sl12::MeshManager::CreateVertexView(resMesh->GetPositionHandle(), 0, 0, sl12::ResourceItemMesh::GetPositionStride()),
+				sl12::MeshManager::CreateVertexView(resMesh->GetNormalHandle(), 0, 0, sl12::ResourceItemMesh::GetNormalStride()),
+				sl12::MeshManager::CreateVertexView(resMesh->GetTangentHandle(), 0, 0, sl12::ResourceItemMesh::GetTangentStride()),
+				sl12::MeshManager::CreateVertexView(resMesh->GetTexcoordHandle(), 0, 0, sl12::ResourceItemMesh::GetTexcoordStride()),
+			};
+			pCmdList->GetLatestCommandList()->IASetVertexBuffers(0, ARRAYSIZE(vbvs), vbvs);
+
+			// set index buffer.
+			auto ibv = sl12::MeshManager::CreateIndexView(resMesh->GetIndexHandle(), 0, 0, sl12::ResourceItemMesh::GetIndexStride());
+			pCmdList->GetLatestCommandList()->IASetIndexBuffer(&ibv);
+			NowMesh = resMesh;
+		}
 
-		auto&& submeshes = resMesh->GetSubmeshes();
-		for (auto submeshIndex : resInfo->xluSubmeshIndices)
+		// select pso.
+		sl12::GraphicsPipelineState* pso = item.bDoubleSided ? &psoMeshDS_ : &psoMesh_;
+		if (NowPSO != pso)
 		{
-			auto&& submesh = submeshes[submeshIndex];
-			auto&& material = &resMesh->GetMaterials()[submesh.materialIndex];
-			sl12::u32 meshletCnt = (sl12::u32)submesh.meshlets.size();
+			// set pipeline.
+			pCmdList->GetLatestCommandList()->SetPipelineState(pso->GetPSO());
+			pCmdList->GetLatestCommandList()->IASetPrimitiveTopology(D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
+			NowPSO = pso;
+		}
 
-			// select pso.
-			sl12::GraphicsPipelineState* pso = nullptr;
-			if (material->cullMode == sl12::ResourceMeshMaterialCullMode::Back)
-			{
-				pso = &psoMesh_;
-			}
-			else
-			{
-				pso = &psoMeshDS_;
-			}
+		descSet.SetPsSrv(0, item.textures[0]);
+		descSet.SetPsSrv(1, item.textures[1]);
+		descSet.SetPsSrv(2, item.textures[2]);
+		descSet.SetPsSrv(3, item.textures[3]);
 
-			if (NowPSO != pso)
-			{
-				// set pipeline.
-				pCmdList->GetLatestCommandList()->SetPipelineState(pso->GetPSO());
-				pCmdList->GetLatestCommandList()->IASetPrimitiveTopology(D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
-				NowPSO = pso;
-			}
+		pCmdList->SetGraphicsRootSignatureAndDescriptorSet(&rs_, &descSet);
 
-			auto bc_tex_view = GetTextureView(material->baseColorTex, pDevice_->GetDummyTextureView(sl12::DummyTex::Black));
-			auto nm_tex_view = GetTextureView(material->normalTex, pDevice_->GetDummyTextureView(sl12::DummyTex::FlatNormal));
-			auto orm_tex_view = GetTextureView(material->ormTex, pDevice_->GetDummyTextureView(sl12::DummyTex::Black));
-			auto emm_tex_view = GetTextureView(material->emissiveTex, pDevice_->GetDummyTextureView(sl12::DummyTex::Black));
+		auto&& submesh = resMesh->GetSubmeshes()[item.submeshIndex];
+		UINT StartIndexLocation = (UINT)(submesh.indexOffsetBytes / sl12::ResourceItemMesh::GetIndexStride());
+		int BaseVertexLocation = (int)(submesh.positionOffsetBytes / sl12::ResourceItemMesh::GetPositionStride());
+		for (auto&& meshlet : submesh.meshlets)
+		{
+			pCmdList->GetLatestCommandList()->DrawIndexedInstanced(
+				meshlet.indexCount, 1, StartIndexLocation + meshlet.indexOffset, BaseVertexLocation, 0);
+		}
+	}
+}
 
-			descSet.SetPsSrv(0, bc_tex_view->GetDescInfo().cpuHandle);
-			descSet.SetPsSrv(1, nm_tex_view->GetDescInfo().cpuHandle);
-			descSet.SetPsSrv(2, orm_tex_view->GetDescInfo().cpuHandle);
-			descSet.SetPsSrv(3, emm_tex_view->GetDescInfo().cpuHandle);
+void XluPass::PrepareExecute(const sl12::RenderPassID& ID)
+{
+	BuildDrawItems();
+}
 
-			pCmdList->SetGraphicsRootSignatureAndDescriptorSet(&rs_, &descSet);
+void XluPass::BuildDrawItems()
+{
+	// サブメッシュごとのパイプラインとテクスチャを先に決めておく
+	auto pMR = pScene_->GetMeshletResource();
+	auto&& instances = pMR->GetMeshInstanceInfos();
+	FrameVector<DrawItem> items{FrameArenaAllocator<DrawItem>(&pScene_->GetFrameArena())};
+	items.reserve(drawItems_.size());
+	sl12::u32 meshIndex = 0;
+	for (auto&& instance : instances)
+	{
+		// ソフトウェアオクルージョンで隠れたインスタンスは描画しない
+		if (pScene_->IsSoftwareOccluded(meshIndex))
+		{
+			meshIndex++;
+			continue;
+		}
 
-			UINT StartIndexLocation = (UINT)(submesh.indexOffsetBytes / sl12::ResourceItemMesh::GetIndexStride());
-			int BaseVertexLocation = (int)(submesh.positionOffsetBytes / sl12::ResourceItemMesh::GetPositionStride());
-			for (auto&& meshlet : submesh.meshlets)
-			{
-				pCmdList->GetLatestCommandList()->DrawIndexedInstanced(
-					meshlet.indexCount, 1, StartIndexLocation + meshlet.indexOffset, BaseVertexLocation, 0);
-			}
+		auto resMesh = instance.resMesh;
+		auto resInfo = pMR->GetMeshResInfo(resMesh);
+		auto&& submeshes = resMesh->GetSubmeshes();
+		for (auto submeshIndex : resInfo->xluSubmeshIndices)
+		{
+			auto&& material = &resMesh->GetMaterials()[submeshes[submeshIndex].materialIndex];
+
+			DrawItem item;
+			item.resMesh = resMesh;
+			item.meshIndex = meshIndex;
+			item.submeshIndex = submeshIndex;
+			item.bDoubleSided = material->cullMode != sl12::ResourceMeshMaterialCullMode::Back;
+			item.textures[0] = GetTextureView(material->baseColorTex, pDevice_->GetDummyTextureView(sl12::DummyTex::Black))->GetDescInfo().cpuHandle;
+			item.textures[1] = GetTextureView(material->normalTex, pDevice_->GetDummyTextureView(sl12::DummyTex::FlatNormal))->GetDescInfo().cpuHandle;
+			item.textures[2] = GetTextureView(material->ormTex, pDevice_->GetDummyTextureView(sl12::DummyTex::Black))->GetDescInfo().cpuHandle;
+			item.textures[3] = GetTextureView(material->emissiveTex, pDevice_->GetDummyTextureView(sl12::DummyTex::Black))->GetDescInfo().cpuHandle;
+			items.push_back(item);
 		}
 
 		meshIndex++;
 	}
+
+	drawItems_ = std::move(items);
+	drawItemsFrame_ = pScene_->GetFrameIndex();
 }
 
 //	EOF
@@ -15,6 +15,14 @@ public:
 		return AppPassType::MeshletArgCopy;
 	}
 
+	virtual void SetPassSettings(const RenderPassSetupDesc& desc)
+	{
+		bOcclusionCulling_ = desc.bUseVisibilityBuffer && !desc.bUseMeshShader && desc.bUseOcclusionCulling;
+		bShadowCulling_ = desc.bUseShadowCulling && !desc.bUseVirtualShadow;
+		shadowCascadeCount_ = desc.shadowCascadeCount;
+		bMaskedDrawList_ = desc.bUseBindlessMasked && (!desc.bUseVisibilityBuffer || !desc.bUseMeshShader);
+	}
+
 	virtual std::vector<sl12::TransientResource> GetInputResources(const sl12::RenderPassID& ID) const override;
 	virtual std::vector<sl12::TransientResource> GetOutputResources(const sl12::RenderPassID& ID) const override;
 	virtual sl12::HardwareQueue::Value GetExecuteQueue() const
@@ -24,10 +32,22 @@ public:
 	virtual void Execute(sl12::CommandList* pCmdList, sl12::TransientResourceManager* pResManager, const sl12::RenderPassID& ID) override;
 
 private:
+	bool bOcclusionCulling_ = false;
+	bool bShadowCulling_ = false;
+	int shadowCascadeCount_ = 1;
+	bool bMaskedDrawList_ = false;
 };
 
 class MeshletCullingPass : public AppPassBase
 {
+	enum ECullType
+	{
+		FrustumOnly,
+		Occlusion1st,
+		Occlusion2nd,
+		Max
+	};
+
 public:
 	MeshletCullingPass(sl12::Device* pDev, RenderSystem* pRenderSys, Scene* pScene);
 	virtual ~MeshletCullingPass();
@@ -37,6 +57,12 @@ public:
 		return AppPassType::MeshletCulling;
 	}
 
+	virtual void SetPassSettings(const RenderPassSetupDesc& desc)
+	{
+		bOcclusionCulling_ = desc.bUseVisibilityBuffer && !desc.bUseMeshShader && desc.bUseOcclusionCulling;
+		bMaskedDrawList_ = desc.bUseBindlessMasked && (!desc.bUseVisibilityBuffer || !desc.bUseMeshShader);
+	}
+
 	virtual std::vector<sl12::TransientResource> GetInputResources(const sl12::RenderPassID& ID) const override;
 	virtual std::vector<sl12::TransientResource> GetOutputResources(const sl12::RenderPassID& ID) const override;
 	virtual sl12::HardwareQueue::Value GetExecuteQueue() const
@@ -46,8 +72,10 @@ public:
 	virtual void Execute(sl12::CommandList* pCmdList, sl12::TransientResourceManager* pResManager, const sl12::RenderPassID& ID) override;
 
 private:
-	sl12::UniqueHandle<sl12::RootSignature> rs_;
-	sl12::UniqueHandle<sl12::ComputePipelineState> pso_;
+	sl12::UniqueHandle<sl12::RootSignature> rs_[ECullType::Max];
+	sl12::UniqueHandle<sl12::ComputePipelineState> pso_[ECullType::Max];
+	bool bOcclusionCulling_ = false;
+	bool bMaskedDrawList_ = false;
 };
 
 class DepthPrePass : public AppPassBase
@@ -61,6 +89,11 @@ public:
 		return AppPassType::DepthPre;
 	}
 
+	virtual void SetPassSettings(const RenderPassSetupDesc& desc)
+	{
+		bMaskedDrawList_ = desc.bUseBindlessMasked;
+	}
+
 	virtual std::vector<sl12::TransientResource> GetInputResources(const sl12::RenderPassID& ID) const override;
 	virtual std::vector<sl12::TransientResource> GetOutputResources(const sl12::RenderPassID& ID) const override;
 	virtual sl12::HardwareQueue::Value GetExecuteQueue() const
@@ -68,11 +101,20 @@ public:
 		return sl12::HardwareQueue::Graphics;
 	}
 	virtual void Execute(sl12::CommandList* pCmdList, sl12::TransientResourceManager* pResManager, const sl12::RenderPassID& ID) override;
+	virtual void PrepareSerial(const sl12::RenderPassID& ID) override;
+
+private:
+	void InitBindless(sl12::u32 maxResources);
+	void UpdateBindless();
 
 private:
-	sl12::UniqueHandle<sl12::RootSignature> rsOpaque_, rsMasked_;
+	sl12::UniqueHandle<sl12::RootSignature> rsOpaque_, rsMasked_, rsBindless_;
 	sl12::UniqueHandle<sl12::GraphicsPipelineState> psoOpaque_, psoOpaqueDS_, psoMasked_, psoMaskedDS_;
-	UniqueHandle<sl12::IndirectExecuter> indirectExec_;
+	sl12::UniqueHandle<sl12::GraphicsPipelineState> psoBindless_, psoBindlessDS_;
+	sl12::UniqueHandle<sl12::GraphicsPipelineState> psoBindlessOpaque_, psoBindlessOpaqueDS_;	// MESHLET_ALPHA_OPAQUEのメッシュレット用
+	UniqueHandle<sl12::IndirectExecuter> indirectExec_, indirectExecMasked_, indirectExecBindless_;
+	sl12::u32 bindlessMaxResources_ = 0;	// rsBindless_のバインドレステクスチャ上限
+	bool bMaskedDrawList_ = false;
 };
 
 class GBufferPass : public AppPassBase
@@ -93,11 +135,22 @@ public:
 		return sl12::HardwareQueue::Graphics;
 	}
 	virtual void Execute(sl12::CommandList* pCmdList, sl12::TransientResourceManager* pResManager, const sl12::RenderPassID& ID) override;
+	virtual void PrepareExecute(const sl12::RenderPassID& ID) override;
+
+private:
+	void BuildDrawItems();
 
 private:
 	sl12::UniqueHandle<sl12::RootSignature> rs_;
 	sl12::UniqueHandle<sl12::GraphicsPipelineState> psoMeshOpaque_, psoMeshOpaqueDS_, psoMeshMasked_, psoMeshMaskedDS_, psoTriplanar_;
 	UniqueHandle<sl12::IndirectExecuter> indirectExec_;
+
+	// ソート済みの描画リスト
+	// フレームアリーナで確保するので、作成したフレームのみ有効
+	FrameVector<DrawSortItem> drawItems_;
+	FrameVector<const sl12::ResourceItemMesh*> drawMeshes_;
+	DrawStateStats drawInstanceOrderStats_;
+	sl12::u64 drawItemsFrame_ = ~0ull;		// 作成したフレーム
 };
 
 class MotionVectorPass : public AppPassBase
@@ -142,10 +195,28 @@ public:
 		return sl12::HardwareQueue::Graphics;
 	}
 	virtual void Execute(sl12::CommandList* pCmdList, sl12::TransientResourceManager* pResManager, const sl12::RenderPassID& ID) override;
+	virtual void PrepareExecute(const sl12::RenderPassID& ID) override;
+
+private:
+	void BuildDrawItems();
 
 private:
+	// 半透明のサブメッシュ
+	struct DrawItem
+	{
+		const sl12::ResourceItemMesh*	resMesh;
+		sl12::u32						meshIndex;		// hMeshCBsのインデックス
+		sl12::u32						submeshIndex;
+		bool							bDoubleSided;
+		D3D12_CPU_DESCRIPTOR_HANDLE		textures[4];	// baseColor, normal, orm, emissive
+	};	// struct DrawItem
+
 	sl12::UniqueHandle<sl12::RootSignature> rs_;
 	sl12::UniqueHandle<sl12::GraphicsPipelineState> psoMesh_, psoMeshDS_;
+
+	// フレームアリーナで確保するので、作成したフレームのみ有効
+	FrameVector<DrawItem> drawItems_;
+	sl12::u64 drawItemsFrame_ = ~0ull;		// 作成したフレーム
 };
 
 //	EOF
@@ -37,6 +37,7 @@ DeinterleavePass::~DeinterleavePass()
 std::vector<sl12::TransientResource> DeinterleavePass::GetInputResources(const sl12::RenderPassID& ID) const
 {
 	std::vector<sl12::TransientResource> ret;
+	ret.reserve(3);
 	ret.push_back(sl12::TransientResource(kGBufferCID, sl12::TransientState::ShaderResource));
 	ret.push_back(sl12::TransientResource(kDepthBufferID, sl12::TransientState::ShaderResource));
 	ret.push_back(sl12::TransientResource(kLightAccumHistoryID, sl12::TransientState::ShaderResource));
@@ -46,6 +47,7 @@ std::vector<sl12::TransientResource> DeinterleavePass::GetInputResources(const s
 std::vector<sl12::TransientResource> DeinterleavePass::GetOutputResources(const sl12::RenderPassID& ID) const
 {
 	std::vector<sl12::TransientResource> ret;
+	ret.reserve(3);
 	sl12::TransientResource diDepth(kDeinterleaveDepthID, sl12::TransientState::UnorderedAccess);
 	sl12::TransientResource diNormal(kDeinterleaveNormalID, sl12::TransientState::UnorderedAccess);
 	sl12::TransientResource diAccum(kDeinterleaveAccumID, sl12::TransientState::UnorderedAccess);
@@ -176,6 +178,7 @@ ScreenSpaceAOPass::~ScreenSpaceAOPass()
 std::vector<sl12::TransientResource> ScreenSpaceAOPass::GetInputResources(const sl12::RenderPassID& ID) const
 {
 	std::vector<sl12::TransientResource> ret;
+	ret.reserve(8);
 	if (type_ == 2)
 	{
 		if (bNeedDeinterleave_)
@@ -202,6 +205,7 @@ std::vector<sl12::TransientResource> ScreenSpaceAOPass::GetInputResources(const
 std::vector<sl12::TransientResource> ScreenSpaceAOPass::GetOutputResources(const sl12::RenderPassID& ID) const
 {
 	std::vector<sl12::TransientResource> ret;
+	ret.reserve(2);
 	sl12::TransientResource ssao(kSsaoID, sl12::TransientState::UnorderedAccess);
 	sl12::TransientResource ssgi(kSsgiID, sl12::TransientState::UnorderedAccess);
 
@@ -321,6 +325,7 @@ DenoisePass::~DenoisePass()
 std::vector<sl12::TransientResource> DenoisePass::GetInputResources(const sl12::RenderPassID& ID) const
 {
 	std::vector<sl12::TransientResource> ret;
+	ret.reserve(6);
 	ret.push_back(sl12::TransientResource(kDepthBufferID, sl12::TransientState::ShaderResource));
 	ret.push_back(sl12::TransientResource(kDepthHistoryID, sl12::TransientState::ShaderResource));
 	ret.push_back(sl12::TransientResource(kSsaoID, sl12::TransientState::ShaderResource));
@@ -336,6 +341,7 @@ std::vector<sl12::TransientResource> DenoisePass::GetInputResources(const sl12::
 std::vector<sl12::TransientResource> DenoisePass::GetOutputResources(const sl12::RenderPassID& ID) const
 {
 	std::vector<sl12::TransientResource> ret;
+	ret.reserve(2);
 	sl12::TransientResource ao(kDenoiseAOID, sl12::TransientState::UnorderedAccess);
 	sl12::TransientResource gi(kDenoiseGIID, sl12::TransientState::UnorderedAccess);
 
@@ -439,6 +445,7 @@ IndirectLightPass::~IndirectLightPass()
 std::vector<sl12::TransientResource> IndirectLightPass::GetInputResources(const sl12::RenderPassID& ID) const
 {
 	std::vector<sl12::TransientResource> ret;
+	ret.reserve(6);
 	ret.push_back(sl12::TransientResource(kGBufferAID, sl12::TransientState::ShaderResource));
 	ret.push_back(sl12::TransientResource(kGBufferBID, sl12::TransientState::ShaderResource));
 	ret.push_back(sl12::TransientResource(kGBufferCID, sl12::TransientState::ShaderResource));
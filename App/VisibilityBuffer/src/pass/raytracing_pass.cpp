@@ -421,6 +421,7 @@ ProbeTracePass::~ProbeTracePass()
 std::vector<sl12::TransientResource> ProbeTracePass::GetInputResources(const sl12::RenderPassID& ID) const
 {
 	std::vector<sl12::TransientResource> ret;
+	ret.reserve(2);
 	ret.push_back(sl12::TransientResource(kBuildBvhDummy, sl12::TransientState::ShaderResource));
 	ret.push_back(sl12::TransientResource(kReadyRtxgiDummy, sl12::TransientState::ShaderResource));
 	return ret;
@@ -577,6 +578,7 @@ ApplyRtxgiPass::~ApplyRtxgiPass()
 std::vector<sl12::TransientResource> ApplyRtxgiPass::GetInputResources(const sl12::RenderPassID& ID) const
 {
 	std::vector<sl12::TransientResource> ret;
+	ret.reserve(3);
 	ret.push_back(sl12::TransientResource(kGBufferCID, sl12::TransientState::ShaderResource));
 	ret.push_back(sl12::TransientResource(kDepthBufferID, sl12::TransientState::ShaderResource));
 	ret.push_back(sl12::TransientResource(kRTDummyResultID, sl12::TransientState::ShaderResource));
@@ -693,6 +695,7 @@ MonteCarloGIPass::~MonteCarloGIPass()
 std::vector<sl12::TransientResource> MonteCarloGIPass::GetInputResources(const sl12::RenderPassID& ID) const
 {
 	std::vector<sl12::TransientResource> ret;
+	ret.reserve(3);
 	ret.push_back(sl12::TransientResource(kGBufferCID, sl12::TransientState::ShaderResource));
 	ret.push_back(sl12::TransientResource(kDepthBufferID, sl12::TransientState::ShaderResource));
 	ret.push_back(sl12::TransientResource(kBuildBvhDummy, sl12::TransientState::ShaderResource));
@@ -835,6 +838,7 @@ InitialSamplePass::~InitialSamplePass()
 std::vector<sl12::TransientResource> InitialSamplePass::GetInputResources(const sl12::RenderPassID& ID) const
 {
 	std::vector<sl12::TransientResource> ret;
+	ret.reserve(6);
 	ret.push_back(sl12::TransientResource(kGBufferCID, sl12::TransientState::ShaderResource));
 	ret.push_back(sl12::TransientResource(kDepthBufferID, sl12::TransientState::ShaderResource));
 	ret.push_back(sl12::TransientResource(kMotionVectorID, sl12::TransientState::ShaderResource));
@@ -971,6 +975,7 @@ SpatialReusePass::~SpatialReusePass()
 std::vector<sl12::TransientResource> SpatialReusePass::GetInputResources(const sl12::RenderPassID& ID) const
 {
 	std::vector<sl12::TransientResource> ret;
+	ret.reserve(3);
 	ret.push_back(sl12::TransientResource(kGBufferCID, sl12::TransientState::ShaderResource));
 	ret.push_back(sl12::TransientResource(kDepthBufferID, sl12::TransientState::ShaderResource));
 	ret.push_back(sl12::TransientResource(kInitialSampleReservoirRawID, sl12::TransientState::ShaderResource));
@@ -1148,6 +1153,7 @@ RayTracingDenoisePass::~RayTracingDenoisePass()
 std::vector<sl12::TransientResource> RayTracingDenoisePass::GetInputResources(const sl12::RenderPassID& ID) const
 {
 	std::vector<sl12::TransientResource> ret;
+	ret.reserve(6);
 	ret.push_back(sl12::TransientResource(kDepthBufferID, sl12::TransientState::ShaderResource));
 	ret.push_back(sl12::TransientResource(kDepthHistoryID, sl12::TransientState::ShaderResource));
 	ret.push_back(sl12::TransientResource(kGBufferCID, sl12::TransientState::ShaderResource));
@@ -1160,6 +1166,7 @@ std::vector<sl12::TransientResource> RayTracingDenoisePass::GetInputResources(co
 std::vector<sl12::TransientResource> RayTracingDenoisePass::GetOutputResources(const sl12::RenderPassID& ID) const
 {
 	std::vector<sl12::TransientResource> ret;
+	ret.reserve(5);
 	sl12::TransientResource gi(kDenoiseGIID, sl12::TransientState::UnorderedAccess);
 	sl12::TransientResource moments(kSvgfMomentID, sl12::TransientState::UnorderedAccess);
 	sl12::TransientResource prepassGI(kSvgfPrepassID, sl12::TransientState::UnorderedAccess);
@@ -1351,6 +1358,7 @@ std::vector<sl12::TransientResource> DebugDdgiPass::GetInputResources(const sl12
 std::vector<sl12::TransientResource> DebugDdgiPass::GetOutputResources(const sl12::RenderPassID& ID) const
 {
 	std::vector<sl12::TransientResource> ret;
+	ret.reserve(2);
 
 	sl12::TransientResource accum(kLightAccumID, sl12::TransientState::RenderTarget);
 	sl12::TransientResource depth(kDepthBufferID, sl12::TransientState::DepthStencil);
@@ -209,7 +209,7 @@ public:
 		return AppPassType::InitialSample;
 	}
 
-	virtual void SetPassSettings(const RenderPassSetupDesc& desc) override
+	virtual void ResetHistory() override
 	{
 		bInitialFrame_ = true;
 	}
@@ -11,7 +11,27 @@ static const sl12::TransientResourceID	kDepthHistoryID(kDepthBufferID, 1);
 static const sl12::TransientResourceID	kShadowMapID("ShadowMap");
 static const sl12::TransientResourceID	kShadowExpID("ShadowExp");
 static const sl12::TransientResourceID	kShadowBlurID("ShadowBlur");
-static const sl12::TransientResourceID	kMeshletIndirectArgID("MeshletIndirectArg");
+static const sl12::TransientResourceID	kShadowHiZID("ShadowHiZ");
+static const sl12::TransientResourceID	kShadowCompactArgIDs[] = {
+	sl12::TransientResourceID("ShadowCompactArg0"),
+	sl12::TransientResourceID("ShadowCompactArg1"),
+	sl12::TransientResourceID("ShadowCompactArg2"),
+	sl12::TransientResourceID("ShadowCompactArg3"),
+};
+static const sl12::TransientResourceID	kShadowDrawCountIDs[] = {
+	sl12::TransientResourceID("ShadowDrawCount0"),
+	sl12::TransientResourceID("ShadowDrawCount1"),
+	sl12::TransientResourceID("ShadowDrawCount2"),
+	sl12::TransientResourceID("ShadowDrawCount3"),
+};
+static const sl12::TransientResourceID	kMeshletCompactArgID("MeshletCompactArg");
+static const sl12::TransientResourceID	kMeshletDrawCountID("MeshletDrawCount");
+static const sl12::TransientResourceID	kMeshletCompactArg2ndID("MeshletCompactArg2nd");
+static const sl12::TransientResourceID	kMeshletDrawCount2ndID("MeshletDrawCount2nd");
+static const sl12::TransientResourceID	kMaskedDrawArgID("MaskedDrawArg");
+static const sl12::TransientResourceID	kMaskedDrawCountID("MaskedDrawCount");
+static const sl12::TransientResourceID	kMaskedDrawArg2ndID("MaskedDrawArg2nd");
+static const sl12::TransientResourceID	kMaskedDrawCount2ndID("MaskedDrawCount2nd");
 static const sl12::TransientResourceID	kMiplevelFeedbackID("MiplevelFeedback");
 static const sl12::TransientResourceID	kLightAccumID("LightAccum");
 static const sl12::TransientResourceID	kWaterLightAccumID("WaterLightAccum");
@@ -46,12 +66,9 @@ static const sl12::TransientResourceID  kInitialSampleReservoirRawID("InitialSam
 static const sl12::TransientResourceID  kInitialSampleReservoirID("InitialSampleReservoir");
 static const sl12::TransientResourceID  kReSTIRGIID("ReSTIRGI");
 
-static const sl12::TransientResourceID	kInstanceBufferID("InstanceBuffer");
-static const sl12::TransientResourceID	kSubmeshBufferID("SubmeshBuffer");
-static const sl12::TransientResourceID	kMeshletBufferID("MeshletBuffer");
-static const sl12::TransientResourceID	kDrawCallBufferID("DrawCallBuffer");
 static const sl12::TransientResourceID	kTileArgBufferID("TileArgBuffer");
 static const sl12::TransientResourceID	kTileIndexBufferID("TileIndexBuffer");
+static const sl12::TransientResourceID	kTileOffsetBufferID("TileOffsetBuffer");
 static const sl12::TransientResourceID	kBinningArgBufferID("BinningArgBuffer");
 static const sl12::TransientResourceID	kBinningCountBufferID("BinningCountBuffer");
 static const sl12::TransientResourceID	kBinningOffsetBufferID("BinningOffsetBuffer");
@@ -60,16 +77,22 @@ static const sl12::TransientResourceID	kTileBinMaterialIndexID("TileBinMaterialI
 static const sl12::TransientResourceID	kTileBinPixelInfoID("TileBinPixelInfo");
 static const sl12::TransientResourceID	kTileBinPixelsInTileID("TileBinPixelsInTile");
 static const sl12::TransientResourceID	kTileBinTileIndexID("TileBinTileIndex");
+static const sl12::TransientResourceID	kTileBinTileOffsetID("TileBinTileOffset");
 static const sl12::TransientResourceID	kTileBinArgBufferID("TileBinArgBuffer");
 
 static const sl12::RenderPassID kMeshletArgCopyPass("MeshletArgCopyPass");
 static const sl12::RenderPassID kMeshletCullingPass("MeshletCullingPass");
+static const sl12::RenderPassID kMeshletCulling2ndPass("MeshletCulling2ndPass");
 static const sl12::RenderPassID kClearMiplevelPass("ClearMiplevelPass");
 static const sl12::RenderPassID kFeedbackMiplevelPass("FeedbackMiplevelPass");
 static const sl12::RenderPassID kDepthPrePass("DepthPrePass");
 static const sl12::RenderPassID kGBufferPass("GBufferPass");
 static const sl12::RenderPassID kMotionVectorPass("MotionVectorPass");
+static const sl12::RenderPassID kShadowCullingPass("ShadowCullingPass");
+static const sl12::RenderPassID kShadowCacheCopyPass("ShadowCacheCopyPass");
 static const sl12::RenderPassID kShadowMapPass("ShadowMapPass");
+static const sl12::RenderPassID kShadowHiZPass("ShadowHiZPass");
+static const sl12::RenderPassID kVirtualShadowRequestPass("VirtualShadowRequestPass");
 static const sl12::RenderPassID kShadowExpPass("ShadowExpPass");
 static const sl12::RenderPassID kShadowBlurXPass("ShadowBlurXPass");
 static const sl12::RenderPassID kShadowBlurYPass("ShadowBlurYPass");
@@ -83,6 +106,7 @@ static const sl12::RenderPassID kDenoisePass("DenoisePass");
 static const sl12::RenderPassID kIndirectLightPass("IndirectLightPass");
 static const sl12::RenderPassID kBufferReadyPass("BufferReadyPass");
 static const sl12::RenderPassID kVisibilityVsPass("VisibilityVsPass");
+static const sl12::RenderPassID kVisibilityVs2ndPass("VisibilityVs2ndPass");
 static const sl12::RenderPassID kVisibilityMs1stPass("VisibilityMs1stPass");
 static const sl12::RenderPassID kVisibilityMs2ndPass("VisibilityMs2ndPass");
 static const sl12::RenderPassID kMaterialDepthPass("MaterialDepthPass");
@@ -111,6 +135,7 @@ static const sl12::u32 kHiZMiplevels = 6;
 static const sl12::u32 kWaterMiplevels = 5;
 
 static const sl12::u32 kIndirectArgsBufferStride = 4 + sizeof(D3D12_DRAW_INDEXED_ARGUMENTS); // root constant + draw indexed args.
+static const sl12::u32 kMaskedDrawArgsStride = 4 + sizeof(D3D12_DRAW_ARGUMENTS); // root constant + draw args.
 
 
 //	EOF
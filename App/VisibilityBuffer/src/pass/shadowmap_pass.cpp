@@ -1,9 +1,14 @@
 ﻿#include "shadowmap_pass.h"
 #include "render_resource_settings.h"
 #include "../shader_types.h"
+#include "../meshlet_cull.h"
+#include "../shadow_cascade.h"
 
 #include "sl12/descriptor_set.h"
 
+#define USE_IN_CPP
+#include "../../shaders/cbuffer.hlsli"
+
 
 namespace
 {
@@ -18,6 +23,215 @@ namespace
 	}
 }
 
+//----------------
+ShadowCullingPass::ShadowCullingPass(sl12::Device* pDev, RenderSystem* pRenderSys, Scene* pScene)
+	: AppPassBase(pDev, pRenderSys, pScene)
+{
+	const ShaderName kShaders[] = {
+		ShaderName::MeshletCullShadowC,
+		ShaderName::MeshletCullShadowOccC,
+	};
+	static_assert(ARRAYSIZE(kShaders) == ECullType::Max, "shader count mismatch.");
+
+	for (int i = 0; i < ECullType::Max; i++)
+	{
+		rs_[i] = sl12::MakeUnique<sl12::RootSignature>(pDev);
+		pso_[i] = sl12::MakeUnique<sl12::ComputePipelineState>(pDev);
+
+		// init root signature.
+		rs_[i]->Initialize(pDev, pRenderSys->GetShader(kShaders[i]));
+
+		// init pipeline state.
+		sl12::ComputePipelineStateDesc desc{};
+		desc.pRootSignature = &rs_[i];
+		desc.pCS = pRenderSys->GetShader(kShaders[i]);
+
+		if (!pso_[i]->Initialize(pDev, desc))
+		{
+			sl12::ConsolePrint("Error: failed to init shadow cull pso.");
+		}
+	}
+}
+
+ShadowCullingPass::~ShadowCullingPass()
+{
+	for (int i = 0; i < ECullType::Max; i++)
+	{
+		pso_[i].Reset();
+		rs_[i].Reset();
+	}
+}
+
+std::vector<sl12::TransientResource> ShadowCullingPass::GetInputResources(const sl12::RenderPassID& ID) const
+{
+	std::vector<sl12::TransientResource> ret;
+	ret.reserve(1);
+	if (bOcclusionCulling_)
+	{
+		// 前フレームのシャドウマップから作ったHiZでテストする
+		ret.push_back(sl12::TransientResource(sl12::TransientResourceID(kShadowHiZID, 1), sl12::TransientState::ShaderResource));
+	}
+	return ret;
+}
+
+std::vector<sl12::TransientResource> ShadowCullingPass::GetOutputResources(const sl12::RenderPassID& ID) const
+{
+	auto pMR = pScene_->GetMeshletResource();
+	auto pArgBuffer = pMR->GetMeshletIndirectArgBuffer();
+
+	std::vector<sl12::TransientResource> ret;
+	ret.reserve(cascadeCount_ * 2);
+
+	// メインビューと同じく、可視なメッシュレットの引数をサブメッシュごとに詰めて出力する
+	// カスケードごとに別のバッファに出力する
+	for (int i = 0; i < cascadeCount_; i++)
+	{
+		sl12::TransientResource arg(kShadowCompactArgIDs[i], sl12::TransientState::UnorderedAccess);
+		sl12::TransientResource count(kShadowDrawCountIDs[i], sl12::TransientState::UnorderedAccess);
+
+		arg.desc.bIsTexture = false;
+		arg.desc.bufferDesc.heap = sl12::BufferHeap::Default;
+		arg.desc.bufferDesc.size = pArgBuffer->GetBufferDesc().size;
+		arg.desc.bufferDesc.stride = pArgBuffer->GetBufferDesc().stride;
+		arg.desc.bufferDesc.usage = sl12::ResourceUsage::UnorderedAccess;
+
+		count.desc.bIsTexture = false;
+		count.desc.bufferDesc = pMR->GetDrawCountClearUpload()->GetBufferDesc();
+		count.desc.bufferDesc.heap = sl12::BufferHeap::Default;
+		count.desc.bufferDesc.usage = sl12::ResourceUsage::UnorderedAccess;
+
+		ret.push_back(arg);
+		ret.push_back(count);
+	}
+	return ret;
+}
+
+void ShadowCullingPass::Execute(sl12::CommandList* pCmdList, sl12::TransientResourceManager* pResManager, const sl12::RenderPassID& ID)
+{
+	GPU_MARKER(pCmdList, 0, "ShadowCullingPass");
+
+	auto&& cbvMan = pRenderSystem_->GetCbvManager();
+	auto pMR = pScene_->GetMeshletResource();
+
+	// create cull constant.
+	sl12::u32 drawCallCount = pMR->GetDrawCallCapacity();
+	if (drawCallCount == 0)
+	{
+		return;
+	}
+	MeshletCullCB cb;
+	cb.argStartAddress = 0;
+	cb.meshletStartIndex = 0;
+	cb.meshletCount = drawCallCount;
+	cb.localMeshletIndex = 0;
+	cb.maskedListCapacity = 0;
+	sl12::CbvHandle hCB = cbvMan->GetTemporal(&cb, sizeof(cb));
+
+	// 前フレームのシャドウHiZはアトラス全体で1枚
+	auto pHiZRes = bOcclusionCulling_ ? pResManager->GetRenderGraphResource(sl12::TransientResourceID(kShadowHiZID, 1)) : nullptr;
+	auto pHiZSRV = pHiZRes ? pResManager->CreateOrGetTextureView(pHiZRes) : nullptr;
+
+	UINT groupX, groupY;
+	GetMeshletCullDispatchSize(drawCallCount, groupX, groupY);
+
+	for (int cascade = 0; cascade < cascadeCount_; cascade++)
+	{
+		// 再利用するカスケードは描画しないのでカリングも不要
+		if (pScene_->IsShadowCascadeCached(cascade))
+		{
+			continue;
+		}
+
+		auto pCompactRes = pResManager->GetRenderGraphResource(kShadowCompactArgIDs[cascade]);
+		auto pCountRes = pResManager->GetRenderGraphResource(kShadowDrawCountIDs[cascade]);
+		auto pCompactUAV = pResManager->CreateOrGetUnorderedAccessBufferView(pCompactRes, 0, 0, 0, 0);
+		auto pCountUAV = pResManager->CreateOrGetUnorderedAccessBufferView(pCountRes, 0, 0, 0, 0);
+
+		// set descriptors.
+		sl12::DescriptorSet descSet;
+		descSet.Reset();
+		descSet.SetCsCbv(0, pScene_->GetTemporalCBs().hShadowCascadeCBs[cascade].GetCBV()->GetDescInfo().cpuHandle);
+		descSet.SetCsCbv(1, pScene_->GetTemporalCBs().hShadowFrustumCBs[cascade].GetCBV()->GetDescInfo().cpuHandle);
+		descSet.SetCsCbv(2, hCB.GetCBV()->GetDescInfo().cpuHandle);
+		descSet.SetCsSrv(0, pMR->GetInstanceSRV()->GetDescInfo().cpuHandle);
+		descSet.SetCsSrv(1, pMR->GetDrawCallSRV()->GetDescInfo().cpuHandle);
+		descSet.SetCsSrv(2, pMR->GetMeshletBoundSRV()->GetDescInfo().cpuHandle);
+		descSet.SetCsSrv(3, pMR->GetSubmeshSRV()->GetDescInfo().cpuHandle);
+		descSet.SetCsSrv(4, pMR->GetMeshletSRV()->GetDescInfo().cpuHandle);
+		descSet.SetCsSrv(5, pMR->GetIndirectArgSRV()->GetDescInfo().cpuHandle);
+		descSet.SetCsUav(0, pCompactUAV->GetDescInfo().cpuHandle);
+		descSet.SetCsUav(1, pCountUAV->GetDescInfo().cpuHandle);
+
+		// 履歴がない、またはライト行列やシャドウキャスターが変わったカスケードは視錐台カリングのみ行う
+		ECullType type = ECullType::FrustumOnly;
+		if (pHiZSRV && pScene_->IsShadowHistoryValid(cascade))
+		{
+			descSet.SetCsSrv(6, pHiZSRV->GetDescInfo().cpuHandle);
+			type = ECullType::Occlusion;
+		}
+
+		// set pipeline.
+		pCmdList->GetLatestCommandList()->SetPipelineState(pso_[type]->GetPSO());
+		pCmdList->SetComputeRootSignatureAndDescriptorSet(&rs_[type], &descSet);
+
+		// dispatch.
+		pCmdList->GetLatestCommandList()->Dispatch(groupX, groupY, 1);
+	}
+}
+
+
+//----------------
+ShadowCacheCopyPass::ShadowCacheCopyPass(sl12::Device* pDev, RenderSystem* pRenderSys, Scene* pScene)
+	: AppPassBase(pDev, pRenderSys, pScene)
+{}
+
+ShadowCacheCopyPass::~ShadowCacheCopyPass()
+{}
+
+std::vector<sl12::TransientResource> ShadowCacheCopyPass::GetInputResources(const sl12::RenderPassID& ID) const
+{
+	std::vector<sl12::TransientResource> ret;
+	ret.push_back(sl12::TransientResource(sl12::TransientResourceID(kShadowMapID, 1), sl12::TransientState::CopySrc));
+	return ret;
+}
+
+std::vector<sl12::TransientResource> ShadowCacheCopyPass::GetOutputResources(const sl12::RenderPassID& ID) const
+{
+	std::vector<sl12::TransientResource> ret;
+	sl12::TransientResource depth(kShadowMapID, sl12::TransientState::CopyDst);
+
+	// ShadowMapPassと同じ設定にする
+	depth.desc.bIsTexture = true;
+	depth.desc.textureDesc.Initialize2D(kShadowMapFormat, kShadowMapSize, kShadowMapSize, 1, 1, 0);
+	depth.desc.textureDesc.clearDepth = 0.0f;
+	depth.desc.historyFrame = 1;
+
+	ret.push_back(depth);
+	return ret;
+}
+
+void ShadowCacheCopyPass::Execute(sl12::CommandList* pCmdList, sl12::TransientResourceManager* pResManager, const sl12::RenderPassID& ID)
+{
+	GPU_MARKER(pCmdList, 0, "ShadowCacheCopyPass");
+
+	auto&& stats = pScene_->GetShadowCacheStats();
+	if (stats.reusedCascades == 0)
+	{
+		return;
+	}
+
+	// 深度フォーマットは部分コピーができないので全体をコピーし、再描画するカスケードはShadowMapPassでクリアする
+	auto pHistoryRes = pResManager->GetRenderGraphResource(sl12::TransientResourceID(kShadowMapID, 1));
+	auto pShadowMapRes = pResManager->GetRenderGraphResource(kShadowMapID);
+	if (pHistoryRes)
+	{
+		pCmdList->GetLatestCommandList()->CopyResource(
+			pShadowMapRes->pTexture->GetResourceDep(),
+			pHistoryRes->pTexture->GetResourceDep());
+	}
+}
+
+
 //----------------
 ShadowMapPass::ShadowMapPass(sl12::Device* pDev, RenderSystem* pRenderSys, Scene* pScene)
 	: AppPassBase(pDev, pRenderSys, pScene)
@@ -104,10 +318,35 @@ ShadowMapPass::ShadowMapPass(sl12::Device* pDev, RenderSystem* pRenderSys, Scene
 			sl12::ConsolePrint("Error: failed to init shadow depth masked pso.");
 		}
 	}
+
+	// ルート定数はシャドウでは使わないので、DrawIndexedの引数だけを参照する
+	indirectExec_ = sl12::MakeUnique<sl12::IndirectExecuter>(pDev);
+	bool bIndirectExecuterSucceeded = indirectExec_->Initialize(pDev, sl12::IndirectType::DrawIndexed, kIndirectArgsBufferStride);
+	assert(bIndirectExecuterSucceeded);
+
+	// 仮想シャドウマップのページごとのカリング
+	{
+		rsPageCull_ = sl12::MakeUnique<sl12::RootSignature>(pDev);
+		psoPageCull_ = sl12::MakeUnique<sl12::ComputePipelineState>(pDev);
+
+		rsPageCull_->Initialize(pDev, pRenderSys->GetShader(ShaderName::MeshletCullShadowC));
+
+		sl12::ComputePipelineStateDesc desc{};
+		desc.pRootSignature = &rsPageCull_;
+		desc.pCS = pRenderSys->GetShader(ShaderName::MeshletCullShadowC);
+
+		if (!psoPageCull_->Initialize(pDev, desc))
+		{
+			sl12::ConsolePrint("Error: failed to init virtual shadow page cull pso.");
+		}
+	}
 }
 
 ShadowMapPass::~ShadowMapPass()
 {
+	psoPageCull_.Reset();
+	rsPageCull_.Reset();
+	indirectExec_.Reset();
 	psoOpaque_.Reset();
 	psoMasked_.Reset();
 	rsOpaque_.Reset();
@@ -117,105 +356,144 @@ ShadowMapPass::~ShadowMapPass()
 std::vector<sl12::TransientResource> ShadowMapPass::GetInputResources(const sl12::RenderPassID& ID) const
 {
 	std::vector<sl12::TransientResource> ret;
+	ret.reserve(cascadeCount_ * 2);
+	// 仮想シャドウマップはページごとにこのパスの中でカリングする
+	// 描画引数はMeshletResourceの永続バッファなので、RenderGraphのリソースは不要
+	if (!bVirtual_ && bCulling_)
+	{
+		for (int i = 0; i < cascadeCount_; i++)
+		{
+			ret.push_back(sl12::TransientResource(kShadowCompactArgIDs[i], sl12::TransientState::IndirectArgument));
+			ret.push_back(sl12::TransientResource(kShadowDrawCountIDs[i], sl12::TransientState::IndirectArgument));
+		}
+	}
 	return ret;
 }
 
 std::vector<sl12::TransientResource> ShadowMapPass::GetOutputResources(const sl12::RenderPassID& ID) const
 {
 	std::vector<sl12::TransientResource> ret;
+
+	// 仮想シャドウマップの物理ページのプールはフレームをまたいで保持するので、Sceneが持つ
+	// カスケードシャドウマップは未描画のページの代わりに使う
 	sl12::TransientResource depth(kShadowMapID, sl12::TransientState::DepthStencil);
 
 	depth.desc.bIsTexture = true;
 	depth.desc.textureDesc.Initialize2D(kShadowMapFormat, kShadowMapSize, kShadowMapSize, 1, 1, 0);
 	depth.desc.textureDesc.clearDepth = 0.0f;
+	if (bCache_)
+	{
+		// 次のフレームで再利用する
+		depth.desc.historyFrame = 1;
+	}
 
 	ret.push_back(depth);
 	return ret;
 }
 
-void ShadowMapPass::Execute(sl12::CommandList* pCmdList, sl12::TransientResourceManager* pResManager, const sl12::RenderPassID& ID)
+void ShadowMapPass::PrepareExecute(const sl12::RenderPassID& ID)
 {
-	GPU_MARKER(pCmdList, 0, "ShadowDepthPass");
-
-	auto pShadowMap = pResManager->GetRenderGraphResource(kShadowMapID);
-	auto pShadowMapDSV = pResManager->CreateOrGetDepthStencilView(pShadowMap);
+	if (bCulling_ || bVirtual_)
+	{
+		BuildDrawItems();
+	}
+}
 
-	// clear rt.
-	D3D12_CPU_DESCRIPTOR_HANDLE dsv = pShadowMapDSV->GetDescInfo().cpuHandle;
-	float clearColor[4] = {0.0f, 0.0f, 0.0f, 0.0f};
-	pCmdList->GetLatestCommandList()->ClearDepthStencilView(dsv, D3D12_CLEAR_FLAG_DEPTH, 0.0f, 0, 0, nullptr);
+void ShadowMapPass::BuildDrawItems()
+{
+	// サブメッシュごとのパイプラインとテクスチャを先に決めておく
+	// 全て破棄されるメッシュレットはカリングで除かれるので、混在するメッシュレットがなければアルファテストしない
+	auto pMR = pScene_->GetMeshletResource();
+	auto&& instances = pMR->GetMeshInstanceInfos();
+	auto&& materials = pMR->GetWorldMaterials();
+	FrameVector<DrawItem> items{FrameArenaAllocator<DrawItem>(&pScene_->GetFrameArena())};
+	items.reserve(drawItems_.size());
+	sl12::u32 meshIndex = 0;
+	for (auto&& instance : instances)
+	{
+		auto resMesh = instance.resMesh;
+		auto resInfo = pMR->GetMeshResInfo(resMesh);
+		auto&& submeshes = resMesh->GetSubmeshes();
+		sl12::u32 meshletTotal = instance.argIndex[0];
+		auto submesh_count = resInfo->nonXluSubmeshInfos.size();
+		for (int i = 0; i < submesh_count; i++)
+		{
+			auto&& submeshInfo = resInfo->nonXluSubmeshInfos[i];
+			auto&& material = materials[submeshInfo.materialIndex].pResMaterial;
+			sl12::u32 meshletCnt = (sl12::u32)submeshes[submeshInfo.submeshIndex].meshlets.size();
+			if (meshletCnt > 0)
+			{
+				DrawItem item;
+				item.resMesh = resMesh;
+				item.meshIndex = meshIndex;
+				item.argIndex = meshletTotal;
+				item.argCount = meshletCnt;
+				item.baseColor.ptr = 0;
+				if (material->blendType == sl12::ResourceMeshMaterialBlendType::Masked && MeshletResource::IsAlphaTestRequired(*resInfo, i))
+				{
+					item.baseColor = GetTextureView(material->baseColorTex, pDevice_->GetDummyTextureView(sl12::DummyTex::Black))->GetDescInfo().cpuHandle;
+				}
+				items.push_back(item);
+			}
+			meshletTotal += meshletCnt;
+		}
+		meshIndex++;
+	}
 
-	// set render targets.
-	pCmdList->GetLatestCommandList()->OMSetRenderTargets(0, nullptr, false, &dsv);
+	drawItems_ = std::move(items);
+	drawItemsFrame_ = pScene_->GetFrameIndex();
+}
 
-	// set viewport.
-	D3D12_VIEWPORT vp;
-	vp.TopLeftX = vp.TopLeftY = 0.0f;
-	vp.Width = (float)kShadowMapSize;
-	vp.Height = (float)kShadowMapSize;
-	vp.MinDepth = 0.0f;
-	vp.MaxDepth = 1.0f;
-	pCmdList->GetLatestCommandList()->RSSetViewports(1, &vp);
-
-	// set scissor rect.
-	D3D12_RECT rect;
-	rect.left = rect.top = 0;
-	rect.right = kShadowMapSize;
-	rect.bottom = kShadowMapSize;
-	pCmdList->GetLatestCommandList()->RSSetScissorRects(1, &rect);
+void ShadowMapPass::Execute(sl12::CommandList* pCmdList, sl12::TransientResourceManager* pResManager, const sl12::RenderPassID& ID)
+{
+	GPU_MARKER(pCmdList, 0, "ShadowDepthPass");
 
-	// set descriptors.
 	sl12::DescriptorSet dsOpaque, dsMasked;
-	dsOpaque.Reset();
-	dsOpaque.SetVsCbv(0, pScene_->GetTemporalCBs().hShadowCB.GetCBV()->GetDescInfo().cpuHandle);
-	dsMasked.Reset();
-	dsMasked.SetVsCbv(0, pScene_->GetTemporalCBs().hShadowCB.GetCBV()->GetDescInfo().cpuHandle);
-
 	sl12::GraphicsPipelineState* NowPSO = nullptr;
 
-	// draw meshes.
-	sl12::u32 meshIndex = 0;
-	for (auto&& mesh : pScene_->GetSceneMeshes())
+	// カリング結果をサブメッシュごとにExecuteIndirectで描画する
+	if ((bCulling_ || bVirtual_) && drawItemsFrame_ != pScene_->GetFrameIndex())
 	{
-		// set mesh constant.
-		dsOpaque.SetVsCbv(1, pScene_->GetTemporalCBs().hMeshCBs[meshIndex].GetCBV()->GetDescInfo().cpuHandle);
-		dsMasked.SetVsCbv(1, pScene_->GetTemporalCBs().hMeshCBs[meshIndex].GetCBV()->GetDescInfo().cpuHandle);
-
-		auto meshRes = mesh->GetParentResource();
-
-		// set vertex buffer.
-		const D3D12_VERTEX_BUFFER_VIEW vbvs[] = {
-			sl12::MeshManager::CreateVertexView(meshRes->GetPositionHandle(), 0, 0, sl12::ResourceItemMesh::GetPositionStride()),
-			sl12::MeshManager::CreateVertexView(meshRes->GetTexcoordHandle(), 0, 0, sl12::ResourceItemMesh::GetTexcoordStride()),
-		};
-		pCmdList->GetLatestCommandList()->IASetVertexBuffers(0, ARRAYSIZE(vbvs), vbvs);
-
-		// set index buffer.
-		auto ibv = sl12::MeshManager::CreateIndexView(meshRes->GetIndexHandle(), 0, 0, sl12::ResourceItemMesh::GetIndexStride());
-		pCmdList->GetLatestCommandList()->IASetIndexBuffer(&ibv);
-
-		auto&& submeshes = meshRes->GetSubmeshes();
-		auto submesh_count = submeshes.size();
-		for (int i = 0; i < submesh_count; i++)
+		BuildDrawItems();
+	}
+	auto DrawCulled = [&](sl12::Buffer* pIndirectBuffer, sl12::Buffer* pCountBuffer)
+	{
+		const sl12::ResourceItemMesh* NowMesh = nullptr;
+		sl12::u32 NowMeshIndex = ~0u;
+		for (auto&& item : drawItems_)
 		{
-			auto&& submesh = submeshes[i];
-			auto&& material = meshRes->GetMaterials()[submesh.materialIndex];
+			if (NowMeshIndex != item.meshIndex)
+			{
+				// set mesh constant.
+				dsOpaque.SetVsCbv(1, pScene_->GetTemporalCBs().hMeshCBs[item.meshIndex].GetCBV()->GetDescInfo().cpuHandle);
+				dsMasked.SetVsCbv(1, pScene_->GetTemporalCBs().hMeshCBs[item.meshIndex].GetCBV()->GetDescInfo().cpuHandle);
+				NowMeshIndex = item.meshIndex;
+			}
+
+			if (NowMesh != item.resMesh)
+			{
+				// set vertex buffer.
+				const D3D12_VERTEX_BUFFER_VIEW vbvs[] = {
+					sl12::MeshManager::CreateVertexView(item.resMesh->GetPositionHandle(), 0, 0, sl12::ResourceItemMesh::GetPositionStride()),
+					sl12::MeshManager::CreateVertexView(item.resMesh->GetTexcoordHandle(), 0, 0, sl12::ResourceItemMesh::GetTexcoordStride()),
+				};
+				pCmdList->GetLatestCommandList()->IASetVertexBuffers(0, ARRAYSIZE(vbvs), vbvs);
+
+				// set index buffer.
+				auto ibv = sl12::MeshManager::CreateIndexView(item.resMesh->GetIndexHandle(), 0, 0, sl12::ResourceItemMesh::GetIndexStride());
+				pCmdList->GetLatestCommandList()->IASetIndexBuffer(&ibv);
+				NowMesh = item.resMesh;
+			}
 
 			sl12::GraphicsPipelineState* pso = &psoOpaque_;
 			sl12::RootSignature* rs = &rsOpaque_;
 			sl12::DescriptorSet* ds = &dsOpaque;
-			if (material.blendType == sl12::ResourceMeshMaterialBlendType::Masked)
+			if (item.baseColor.ptr != 0)
 			{
 				pso = &psoMasked_;
 				rs = &rsMasked_;
 				ds = &dsMasked;
-
-				auto bc_tex_view = GetTextureView(material.baseColorTex, pDevice_->GetDummyTextureView(sl12::DummyTex::Black));
-				ds->SetPsSrv(0, bc_tex_view->GetDescInfo().cpuHandle);
-			}
-			else if (material.blendType != sl12::ResourceMeshMaterialBlendType::Opaque)
-			{
-				continue;
+				ds->SetPsSrv(0, item.baseColor);
 			}
 
 			if (NowPSO != pso)
@@ -228,14 +506,367 @@ void ShadowMapPass::Execute(sl12::CommandList* pCmdList, sl12::TransientResource
 
 			pCmdList->SetGraphicsRootSignatureAndDescriptorSet(rs, ds);
 
-			UINT StartIndexLocation = (UINT)(submesh.indexOffsetBytes / sl12::ResourceItemMesh::GetIndexStride());
-			int BaseVertexLocation = (int)(submesh.positionOffsetBytes / sl12::ResourceItemMesh::GetPositionStride());
+			pCmdList->GetLatestCommandList()->ExecuteIndirect(
+				indirectExec_->GetCommandSignature(),				// command signature
+				item.argCount,										// max command count
+				pIndirectBuffer->GetResourceDep(),					// argument buffer
+				indirectExec_->GetStride() * item.argIndex + 4,		// argument buffer offset
+				pCountBuffer->GetResourceDep(),						// count buffer
+				sizeof(sl12::u32) * item.argIndex);					// count buffer offset
+		}
+	};
 
-			pCmdList->GetLatestCommandList()->DrawIndexedInstanced(submesh.indexCount, 1, StartIndexLocation, BaseVertexLocation, 0);
+	// draw meshes.
+	auto DrawAll = [&]()
+	{
+		sl12::u32 meshIndex = 0;
+		for (auto&& mesh : pScene_->GetSceneMeshes())
+		{
+			// set mesh constant.
+			dsOpaque.SetVsCbv(1, pScene_->GetTemporalCBs().hMeshCBs[meshIndex].GetCBV()->GetDescInfo().cpuHandle);
+			dsMasked.SetVsCbv(1, pScene_->GetTemporalCBs().hMeshCBs[meshIndex].GetCBV()->GetDescInfo().cpuHandle);
+
+			auto meshRes = mesh->GetParentResource();
+
+			// set vertex buffer.
+			const D3D12_VERTEX_BUFFER_VIEW vbvs[] = {
+				sl12::MeshManager::CreateVertexView(meshRes->GetPositionHandle(), 0, 0, sl12::ResourceItemMesh::GetPositionStride()),
+				sl12::MeshManager::CreateVertexView(meshRes->GetTexcoordHandle(), 0, 0, sl12::ResourceItemMesh::GetTexcoordStride()),
+			};
+			pCmdList->GetLatestCommandList()->IASetVertexBuffers(0, ARRAYSIZE(vbvs), vbvs);
+
+			// set index buffer.
+			auto ibv = sl12::MeshManager::CreateIndexView(meshRes->GetIndexHandle(), 0, 0, sl12::ResourceItemMesh::GetIndexStride());
+			pCmdList->GetLatestCommandList()->IASetIndexBuffer(&ibv);
+
+			auto&& submeshes = meshRes->GetSubmeshes();
+			auto submesh_count = submeshes.size();
+			for (int i = 0; i < submesh_count; i++)
+			{
+				auto&& submesh = submeshes[i];
+				auto&& material = meshRes->GetMaterials()[submesh.materialIndex];
+
+				sl12::GraphicsPipelineState* pso = &psoOpaque_;
+				sl12::RootSignature* rs = &rsOpaque_;
+				sl12::DescriptorSet* ds = &dsOpaque;
+				if (material.blendType == sl12::ResourceMeshMaterialBlendType::Masked)
+				{
+					pso = &psoMasked_;
+					rs = &rsMasked_;
+					ds = &dsMasked;
+
+					auto bc_tex_view = GetTextureView(material.baseColorTex, pDevice_->GetDummyTextureView(sl12::DummyTex::Black));
+					ds->SetPsSrv(0, bc_tex_view->GetDescInfo().cpuHandle);
+				}
+				else if (material.blendType != sl12::ResourceMeshMaterialBlendType::Opaque)
+				{
+					continue;
+				}
+
+				if (NowPSO != pso)
+				{
+					// set pipeline.
+					pCmdList->GetLatestCommandList()->SetPipelineState(pso->GetPSO());
+					pCmdList->GetLatestCommandList()->IASetPrimitiveTopology(D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
+					NowPSO = pso;
+				}
+
+				pCmdList->SetGraphicsRootSignatureAndDescriptorSet(rs, ds);
+
+				UINT StartIndexLocation = (UINT)(submesh.indexOffsetBytes / sl12::ResourceItemMesh::GetIndexStride());
+				int BaseVertexLocation = (int)(submesh.positionOffsetBytes / sl12::ResourceItemMesh::GetPositionStride());
+
+				pCmdList->GetLatestCommandList()->DrawIndexedInstanced(submesh.indexCount, 1, StartIndexLocation, BaseVertexLocation, 0);
+			}
+
+			meshIndex++;
 		}
+	};
 
-		meshIndex++;
+	// 仮想シャドウマップは描画待ちのページを物理ページのスロットへ描画する
+	auto DrawVirtualPages = [&]()
+	{
+		auto&& pages = pScene_->GetVsmRenderPages();
+		auto pMR = pScene_->GetMeshletResource();
+		sl12::u32 drawCallCount = pMR->GetDrawCallCapacity();
+		if (pages.empty() || drawCallCount == 0)
+		{
+			return;
+		}
+
+		// create cull constant.
+		MeshletCullCB cb;
+		cb.argStartAddress = 0;
+		cb.meshletStartIndex = 0;
+		cb.meshletCount = drawCallCount;
+		cb.localMeshletIndex = 0;
+		cb.maskedListCapacity = 0;
+		sl12::CbvHandle hCB = pRenderSystem_->GetCbvManager()->GetTemporal(&cb, sizeof(cb));
+
+		UINT groupX, groupY;
+		GetMeshletCullDispatchSize(drawCallCount, groupX, groupY);
+
+		auto pPool = pScene_->GetVsmPool();
+		auto pCompactArg = pScene_->GetVsmCompactArg();
+		auto pDrawCount = pScene_->GetVsmDrawCount();
+		D3D12_CPU_DESCRIPTOR_HANDLE dsv = pScene_->GetVsmPoolDSV()->GetDescInfo().cpuHandle;
+
+		// スロットはページの周囲にガードバンドを持つ
+		auto GetPageRect = [](sl12::u32 physicalPage)
+		{
+			D3D12_RECT rect;
+			rect.left = (LONG)((physicalPage % VSM_PHYSICAL_PAGE_COUNT_X) * VSM_PHYSICAL_PAGE_STRIDE);
+			rect.top = (LONG)((physicalPage / VSM_PHYSICAL_PAGE_COUNT_X) * VSM_PHYSICAL_PAGE_STRIDE);
+			rect.right = rect.left + VSM_PHYSICAL_PAGE_STRIDE;
+			rect.bottom = rect.top + VSM_PHYSICAL_PAGE_STRIDE;
+			return rect;
+		};
+
+		pCmdList->TransitionBarrier(pPool, D3D12_RESOURCE_STATE_ALL_SHADER_RESOURCE, D3D12_RESOURCE_STATE_DEPTH_WRITE);
+
+		// 描画するページのスロットをまとめてクリアする
+		auto clearRects = pScene_->GetFrameArena().AllocSpan<D3D12_RECT>(pages.size());
+		for (size_t i = 0; i < pages.size(); i++)
+		{
+			clearRects[i] = GetPageRect(pages[i].physicalPage);
+		}
+		pCmdList->GetLatestCommandList()->ClearDepthStencilView(dsv, D3D12_CLEAR_FLAG_DEPTH, 0.0f, 0, (UINT)clearRects.size(), clearRects.data());
+
+		for (size_t i = 0; i < pages.size(); i++)
+		{
+			auto&& hPageCB = pScene_->GetTemporalCBs().hVsmPageCBs[i];
+			auto&& hFrustumCB = pScene_->GetTemporalCBs().hVsmPageFrustumCBs[i];
+
+			// ページの範囲でメッシュレットをカリングする
+			// カリング結果のバッファは全ページで使い回すので、ページごとにクリアする
+			pCmdList->TransitionBarrier(pDrawCount, D3D12_RESOURCE_STATE_INDIRECT_ARGUMENT, D3D12_RESOURCE_STATE_COPY_DEST);
+			pMR->ClearDrawCounts(pCmdList, pDrawCount);
+			pCmdList->TransitionBarrier(pDrawCount, D3D12_RESOURCE_STATE_COPY_DEST, D3D12_RESOURCE_STATE_UNORDERED_ACCESS);
+			pCmdList->TransitionBarrier(pCompactArg, D3D12_RESOURCE_STATE_INDIRECT_ARGUMENT, D3D12_RESOURCE_STATE_UNORDERED_ACCESS);
+
+			sl12::DescriptorSet descSet;
+			descSet.Reset();
+			descSet.SetCsCbv(0, hPageCB.GetCBV()->GetDescInfo().cpuHandle);
+			descSet.SetCsCbv(1, hFrustumCB.GetCBV()->GetDescInfo().cpuHandle);
+			descSet.SetCsCbv(2, hCB.GetCBV()->GetDescInfo().cpuHandle);
+			descSet.SetCsSrv(0, pMR->GetInstanceSRV()->GetDescInfo().cpuHandle);
+			descSet.SetCsSrv(1, pMR->GetDrawCallSRV()->GetDescInfo().cpuHandle);
+			descSet.SetCsSrv(2, pMR->GetMeshletBoundSRV()->GetDescInfo().cpuHandle);
+			descSet.SetCsSrv(3, pMR->GetSubmeshSRV()->GetDescInfo().cpuHandle);
+			descSet.SetCsSrv(4, pMR->GetMeshletSRV()->GetDescInfo().cpuHandle);
+			descSet.SetCsSrv(5, pMR->GetIndirectArgSRV()->GetDescInfo().cpuHandle);
+			descSet.SetCsUav(0, pScene_->GetVsmCompactArgUAV()->GetDescInfo().cpuHandle);
+			descSet.SetCsUav(1, pScene_->GetVsmDrawCountUAV()->GetDescInfo().cpuHandle);
+
+			pCmdList->GetLatestCommandList()->SetPipelineState(psoPageCull_->GetPSO());
+			pCmdList->SetComputeRootSignatureAndDescriptorSet(&rsPageCull_, &descSet);
+			pCmdList->GetLatestCommandList()->Dispatch(groupX, groupY, 1);
+
+			pCmdList->TransitionBarrier(pCompactArg, D3D12_RESOURCE_STATE_UNORDERED_ACCESS, D3D12_RESOURCE_STATE_INDIRECT_ARGUMENT);
+			pCmdList->TransitionBarrier(pDrawCount, D3D12_RESOURCE_STATE_UNORDERED_ACCESS, D3D12_RESOURCE_STATE_INDIRECT_ARGUMENT);
+
+			// set render targets.
+			pCmdList->GetLatestCommandList()->OMSetRenderTargets(0, nullptr, false, &dsv);
+
+			// set viewport.
+			D3D12_RECT rect = GetPageRect(pages[i].physicalPage);
+			D3D12_VIEWPORT vp;
+			vp.TopLeftX = (float)rect.left;
+			vp.TopLeftY = (float)rect.top;
+			vp.Width = (float)VSM_PHYSICAL_PAGE_STRIDE;
+			vp.Height = (float)VSM_PHYSICAL_PAGE_STRIDE;
+			vp.MinDepth = 0.0f;
+			vp.MaxDepth = 1.0f;
+			pCmdList->GetLatestCommandList()->RSSetViewports(1, &vp);
+
+			// set scissor rect.
+			pCmdList->GetLatestCommandList()->RSSetScissorRects(1, &rect);
+
+			// set descriptors.
+			dsOpaque.Reset();
+			dsOpaque.SetVsCbv(0, hPageCB.GetCBV()->GetDescInfo().cpuHandle);
+			dsMasked.Reset();
+			dsMasked.SetVsCbv(0, hPageCB.GetCBV()->GetDescInfo().cpuHandle);
+
+			// カリングでパイプラインが変わっている
+			NowPSO = nullptr;
+			DrawCulled(pCompactArg, pDrawCount);
+		}
+
+		pCmdList->TransitionBarrier(pPool, D3D12_RESOURCE_STATE_DEPTH_WRITE, D3D12_RESOURCE_STATE_ALL_SHADER_RESOURCE);
+	};
+
+	if (bVirtual_)
+	{
+		DrawVirtualPages();
+
+		// 未描画のページのために、カスケードシャドウマップも描画する
+		NowPSO = nullptr;
+	}
+
+	auto pShadowMap = pResManager->GetRenderGraphResource(kShadowMapID);
+	auto pShadowMapDSV = pResManager->CreateOrGetDepthStencilView(pShadowMap);
+
+	// 再利用するカスケードはShadowCacheCopyPassでコピー済み
+	auto IsCached = [&](int cascadeIndex)
+	{
+		return bCache_ && pScene_->IsShadowCascadeCached(cascadeIndex);
+	};
+
+	// clear rt.
+	D3D12_CPU_DESCRIPTOR_HANDLE dsv = pShadowMapDSV->GetDescInfo().cpuHandle;
+	float clearColor[4] = {0.0f, 0.0f, 0.0f, 0.0f};
+	if (bCache_ && pScene_->GetShadowCacheStats().reusedCascades > 0)
+	{
+		// 再描画するカスケードのタイルのみクリアする
+		D3D12_RECT clearRects[kShadowCascadeMax];
+		UINT clearRectCount = 0;
+		for (int cascade = 0; cascade < cascadeCount_; cascade++)
+		{
+			if (!IsCached(cascade))
+			{
+				auto atlasRect = GetShadowCascadeAtlasRect(cascade, cascadeCount_);
+				auto&& rect = clearRects[clearRectCount++];
+				rect.left = (LONG)(atlasRect.x * (float)kShadowMapSize);
+				rect.top = (LONG)(atlasRect.y * (float)kShadowMapSize);
+				rect.right = rect.left + (LONG)(atlasRect.z * (float)kShadowMapSize);
+				rect.bottom = rect.top + (LONG)(atlasRect.w * (float)kShadowMapSize);
+			}
+		}
+		if (clearRectCount == 0)
+		{
+			return;
+		}
+		pCmdList->GetLatestCommandList()->ClearDepthStencilView(dsv, D3D12_CLEAR_FLAG_DEPTH, 0.0f, 0, clearRectCount, clearRects);
 	}
+	else
+	{
+		pCmdList->GetLatestCommandList()->ClearDepthStencilView(dsv, D3D12_CLEAR_FLAG_DEPTH, 0.0f, 0, 0, nullptr);
+	}
+
+	// set render targets.
+	pCmdList->GetLatestCommandList()->OMSetRenderTargets(0, nullptr, false, &dsv);
+
+	// カスケードごとにアトラスのタイルへ描画する
+	for (int cascade = 0; cascade < cascadeCount_; cascade++)
+	{
+		if (IsCached(cascade))
+		{
+			continue;
+		}
+
+		auto atlasRect = GetShadowCascadeAtlasRect(cascade, cascadeCount_);
+
+		// set viewport.
+		D3D12_VIEWPORT vp;
+		vp.TopLeftX = atlasRect.x * (float)kShadowMapSize;
+		vp.TopLeftY = atlasRect.y * (float)kShadowMapSize;
+		vp.Width = atlasRect.z * (float)kShadowMapSize;
+		vp.Height = atlasRect.w * (float)kShadowMapSize;
+		vp.MinDepth = 0.0f;
+		vp.MaxDepth = 1.0f;
+		pCmdList->GetLatestCommandList()->RSSetViewports(1, &vp);
+
+		// set scissor rect.
+		D3D12_RECT rect;
+		rect.left = (LONG)vp.TopLeftX;
+		rect.top = (LONG)vp.TopLeftY;
+		rect.right = rect.left + (LONG)vp.Width;
+		rect.bottom = rect.top + (LONG)vp.Height;
+		pCmdList->GetLatestCommandList()->RSSetScissorRects(1, &rect);
+
+		// set descriptors.
+		auto&& hShadowCB = pScene_->GetTemporalCBs().hShadowCascadeCBs[cascade];
+		dsOpaque.Reset();
+		dsOpaque.SetVsCbv(0, hShadowCB.GetCBV()->GetDescInfo().cpuHandle);
+		dsMasked.Reset();
+		dsMasked.SetVsCbv(0, hShadowCB.GetCBV()->GetDescInfo().cpuHandle);
+
+		if (bCulling_)
+		{
+			auto pIndirectRes = pResManager->GetRenderGraphResource(kShadowCompactArgIDs[cascade]);
+			auto pCountRes = pResManager->GetRenderGraphResource(kShadowDrawCountIDs[cascade]);
+			DrawCulled(pIndirectRes->pBuffer, pCountRes->pBuffer);
+		}
+		else
+		{
+			DrawAll();
+		}
+	}
+}
+
+
+//----------------
+VirtualShadowRequestPass::VirtualShadowRequestPass(sl12::Device* pDev, RenderSystem* pRenderSys, Scene* pScene)
+	: AppPassBase(pDev, pRenderSys, pScene)
+{
+	rs_ = sl12::MakeUnique<sl12::RootSignature>(pDev);
+	pso_ = sl12::MakeUnique<sl12::ComputePipelineState>(pDev);
+
+	// init root signature.
+	rs_->Initialize(pDev, pRenderSys->GetShader(ShaderName::VsmPageRequestC));
+
+	// init pipeline state.
+	{
+		sl12::ComputePipelineStateDesc desc{};
+		desc.pRootSignature = &rs_;
+		desc.pCS = pRenderSys->GetShader(ShaderName::VsmPageRequestC);
+
+		if (!pso_->Initialize(pDev, desc))
+		{
+			sl12::ConsolePrint("Error: failed to init virtual shadow request pso.");
+		}
+	}
+}
+
+VirtualShadowRequestPass::~VirtualShadowRequestPass()
+{
+	pso_.Reset();
+	rs_.Reset();
+}
+
+std::vector<sl12::TransientResource> VirtualShadowRequestPass::GetInputResources(const sl12::RenderPassID& ID) const
+{
+	std::vector<sl12::TransientResource> ret;
+	ret.push_back(sl12::TransientResource(kDepthBufferID, sl12::TransientState::ShaderResource));
+	return ret;
+}
+
+std::vector<sl12::TransientResource> VirtualShadowRequestPass::GetOutputResources(const sl12::RenderPassID& ID) const
+{
+	std::vector<sl12::TransientResource> ret;
+	return ret;
+}
+
+void VirtualShadowRequestPass::Execute(sl12::CommandList* pCmdList, sl12::TransientResourceManager* pResManager, const sl12::RenderPassID& ID)
+{
+	GPU_MARKER(pCmdList, 0, "VirtualShadowRequestPass");
+
+	auto pDepthRes = pResManager->GetRenderGraphResource(kDepthBufferID);
+	auto pDepthSRV = pResManager->CreateOrGetTextureView(pDepthRes);
+
+	// 要求ビットはフレームの終わりにリードバックする
+	auto pRequestBuffer = pScene_->GetVsmRequestBuffer();
+	pCmdList->TransitionBarrier(pRequestBuffer, D3D12_RESOURCE_STATE_GENERIC_READ, D3D12_RESOURCE_STATE_COPY_DEST);
+	pCmdList->GetLatestCommandList()->CopyResource(pRequestBuffer->GetResourceDep(), pScene_->GetVsmRequestClear()->GetResourceDep());
+	pCmdList->TransitionBarrier(pRequestBuffer, D3D12_RESOURCE_STATE_COPY_DEST, D3D12_RESOURCE_STATE_UNORDERED_ACCESS);
+
+	// set descriptors.
+	sl12::DescriptorSet descSet;
+	descSet.Reset();
+	descSet.SetCsCbv(0, pScene_->GetTemporalCBs().hSceneCB.GetCBV()->GetDescInfo().cpuHandle);
+	descSet.SetCsCbv(1, pScene_->GetTemporalCBs().hShadowCB.GetCBV()->GetDescInfo().cpuHandle);
+	descSet.SetCsSrv(0, pDepthSRV->GetDescInfo().cpuHandle);
+	descSet.SetCsUav(0, pScene_->GetVsmRequestUAV()->GetDescInfo().cpuHandle);
+
+	// set pipeline.
+	pCmdList->GetLatestCommandList()->SetPipelineState(pso_->GetPSO());
+	pCmdList->SetComputeRootSignatureAndDescriptorSet(&rs_, &descSet);
+
+	// dispatch.
+	UINT x = (pScene_->GetScreenWidth() + 7) / 8;
+	UINT y = (pScene_->GetScreenHeight() + 7) / 8;
+	pCmdList->GetLatestCommandList()->Dispatch(x, y, 1);
 }
 
 
@@ -388,6 +1019,7 @@ ShadowExpBlurPass::~ShadowExpBlurPass()
 std::vector<sl12::TransientResource> ShadowExpBlurPass::GetInputResources(const sl12::RenderPassID& ID) const
 {
 	std::vector<sl12::TransientResource> ret;
+	ret.reserve(2);
 	bool bXBlur = ID == "ShadowBlurXPass";
 
 	if (bXBlur)
@@ -433,7 +1065,9 @@ void ShadowExpBlurPass::Execute(sl12::CommandList* pCmdList, sl12::TransientReso
 	// set descriptors.
 	sl12::DescriptorSet descSet;
 	descSet.Reset();
-	descSet.SetPsCbv(0, pScene_->GetTemporalCBs().hBlurXCB.GetCBV()->GetDescInfo().cpuHandle);
+	// タップはカスケードのタイル内にクランプする
+	descSet.SetPsCbv(0, (bXBlur ? pScene_->GetTemporalCBs().hBlurXCB : pScene_->GetTemporalCBs().hBlurYCB).GetCBV()->GetDescInfo().cpuHandle);
+	descSet.SetPsCbv(1, pScene_->GetTemporalCBs().hShadowCB.GetCBV()->GetDescInfo().cpuHandle);
 	descSet.SetPsSrv(0, pBlurSrcSRV->GetDescInfo().cpuHandle);
 	descSet.SetPsSampler(0, pRenderSystem_->GetLinearClampSampler()->GetDescInfo().cpuHandle);
 
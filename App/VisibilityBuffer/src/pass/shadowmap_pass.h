@@ -4,6 +4,65 @@
 #include "../scene.h"
 
 
+class ShadowCullingPass : public AppPassBase
+{
+	enum ECullType
+	{
+		FrustumOnly,
+		Occlusion,
+		Max
+	};
+
+public:
+	ShadowCullingPass(sl12::Device* pDev, RenderSystem* pRenderSys, Scene* pScene);
+	virtual ~ShadowCullingPass();
+
+	virtual AppPassType GetPassType() const override
+	{
+		return AppPassType::ShadowCulling;
+	}
+
+	virtual void SetPassSettings(const RenderPassSetupDesc& desc)
+	{
+		bOcclusionCulling_ = desc.bUseShadowOcclusionCulling;
+		cascadeCount_ = desc.shadowCascadeCount;
+	}
+
+	virtual std::vector<sl12::TransientResource> GetInputResources(const sl12::RenderPassID& ID) const override;
+	virtual std::vector<sl12::TransientResource> GetOutputResources(const sl12::RenderPassID& ID) const override;
+	virtual sl12::HardwareQueue::Value GetExecuteQueue() const
+	{
+		return sl12::HardwareQueue::Compute;
+	}
+	virtual void Execute(sl12::CommandList* pCmdList, sl12::TransientResourceManager* pResManager, const sl12::RenderPassID& ID) override;
+
+private:
+	sl12::UniqueHandle<sl12::RootSignature> rs_[ECullType::Max];
+	sl12::UniqueHandle<sl12::ComputePipelineState> pso_[ECullType::Max];
+	bool bOcclusionCulling_ = false;
+	int cascadeCount_ = 1;
+};
+
+class ShadowCacheCopyPass : public AppPassBase
+{
+public:
+	ShadowCacheCopyPass(sl12::Device* pDev, RenderSystem* pRenderSys, Scene* pScene);
+	virtual ~ShadowCacheCopyPass();
+
+	virtual AppPassType GetPassType() const override
+	{
+		return AppPassType::ShadowCacheCopy;
+	}
+
+	virtual std::vector<sl12::TransientResource> GetInputResources(const sl12::RenderPassID& ID) const override;
+	virtual std::vector<sl12::TransientResource> GetOutputResources(const sl12::RenderPassID& ID) const override;
+	virtual sl12::HardwareQueue::Value GetExecuteQueue() const
+	{
+		return sl12::HardwareQueue::Graphics;
+	}
+	virtual void Execute(sl12::CommandList* pCmdList, sl12::TransientResourceManager* pResManager, const sl12::RenderPassID& ID) override;
+};
+
 class ShadowMapPass : public AppPassBase
 {
 public:
@@ -15,6 +74,14 @@ public:
 		return AppPassType::ShadowMap;
 	}
 
+	virtual void SetPassSettings(const RenderPassSetupDesc& desc)
+	{
+		bCulling_ = desc.bUseShadowCulling && !desc.bUseVirtualShadow;
+		bCache_ = desc.bUseShadowCache && !desc.bUseVirtualShadow;
+		cascadeCount_ = desc.shadowCascadeCount;
+		bVirtual_ = desc.bUseVirtualShadow;
+	}
+
 	virtual std::vector<sl12::TransientResource> GetInputResources(const sl12::RenderPassID& ID) const override;
 	virtual std::vector<sl12::TransientResource> GetOutputResources(const sl12::RenderPassID& ID) const override;
 	virtual sl12::HardwareQueue::Value GetExecuteQueue() const
@@ -22,10 +89,60 @@ public:
 		return sl12::HardwareQueue::Graphics;
 	}
 	virtual void Execute(sl12::CommandList* pCmdList, sl12::TransientResourceManager* pResManager, const sl12::RenderPassID& ID) override;
+	virtual void PrepareExecute(const sl12::RenderPassID& ID) override;
 
 private:
+	void BuildDrawItems();
+
+private:
+	// カリング結果を描画するサブメッシュ
+	struct DrawItem
+	{
+		const sl12::ResourceItemMesh*	resMesh;
+		sl12::u32						meshIndex;		// hMeshCBsのインデックス
+		sl12::u32						argIndex;		// 引数バッファとカウントバッファの先頭
+		sl12::u32						argCount;
+		D3D12_CPU_DESCRIPTOR_HANDLE		baseColor;		// アルファテストしない場合は0
+	};	// struct DrawItem
+
 	sl12::UniqueHandle<sl12::RootSignature> rsOpaque_, rsMasked_;
 	sl12::UniqueHandle<sl12::GraphicsPipelineState> psoOpaque_, psoMasked_;
+	sl12::UniqueHandle<sl12::IndirectExecuter> indirectExec_;
+	sl12::UniqueHandle<sl12::RootSignature> rsPageCull_;
+	sl12::UniqueHandle<sl12::ComputePipelineState> psoPageCull_;
+	bool bCulling_ = false;
+	bool bCache_ = false;
+	int cascadeCount_ = 1;
+	bool bVirtual_ = false;
+
+	// カスケードと仮想シャドウマップのページで使い回すので、フレームごとに1回だけ作る
+	// フレームアリーナで確保するので、作成したフレームのみ有効
+	FrameVector<DrawItem> drawItems_;
+	sl12::u64 drawItemsFrame_ = ~0ull;		// 作成したフレーム
+};
+
+class VirtualShadowRequestPass : public AppPassBase
+{
+public:
+	VirtualShadowRequestPass(sl12::Device* pDev, RenderSystem* pRenderSys, Scene* pScene);
+	virtual ~VirtualShadowRequestPass();
+
+	virtual AppPassType GetPassType() const override
+	{
+		return AppPassType::VirtualShadowRequest;
+	}
+
+	virtual std::vector<sl12::TransientResource> GetInputResources(const sl12::RenderPassID& ID) const override;
+	virtual std::vector<sl12::TransientResource> GetOutputResources(const sl12::RenderPassID& ID) const override;
+	virtual sl12::HardwareQueue::Value GetExecuteQueue() const
+	{
+		return sl12::HardwareQueue::Graphics;
+	}
+	virtual void Execute(sl12::CommandList* pCmdList, sl12::TransientResourceManager* pResManager, const sl12::RenderPassID& ID) override;
+
+private:
+	sl12::UniqueHandle<sl12::RootSignature> rs_;
+	sl12::UniqueHandle<sl12::ComputePipelineState> pso_;
 };
 
 class ShadowExpPass : public AppPassBase
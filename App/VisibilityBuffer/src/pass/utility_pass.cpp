@@ -1,9 +1,12 @@
 ﻿#include "utility_pass.h"
 #include "render_resource_settings.h"
 #include "../shader_types.h"
+#include "../../shaders/constant_defs.h"
 
 #include "sl12/descriptor_set.h"
 
+#include <chrono>
+
 
 //----------------
 ClearMiplevelPass::ClearMiplevelPass(sl12::Device* pDev, RenderSystem* pRenderSys, Scene* pScene)
@@ -164,9 +167,12 @@ LightingPass::LightingPass(sl12::Device* pDev, RenderSystem* pRenderSys, Scene*
 	rs_ = sl12::MakeUnique<sl12::RootSignature>(pDev);
 	psoSM_ = sl12::MakeUnique<sl12::ComputePipelineState>(pDev);
 	psoEVSM_ = sl12::MakeUnique<sl12::ComputePipelineState>(pDev);
+	rsVSM_ = sl12::MakeUnique<sl12::RootSignature>(pDev);
+	psoVSM_ = sl12::MakeUnique<sl12::ComputePipelineState>(pDev);
 
 	// init root signature.
 	rs_->Initialize(pDev, pRenderSys->GetShader(ShaderName::LightingSMC));
+	rsVSM_->Initialize(pDev, pRenderSys->GetShader(ShaderName::LightingVSMC));
 
 	// init pipeline state.
 	{
@@ -189,22 +195,41 @@ LightingPass::LightingPass(sl12::Device* pDev, RenderSystem* pRenderSys, Scene*
 			sl12::ConsolePrint("Error: failed to init lighting evsm pso.");
 		}
 	}
+	{
+		sl12::ComputePipelineStateDesc desc{};
+		desc.pRootSignature = &rsVSM_;
+		desc.pCS = pRenderSys->GetShader(ShaderName::LightingVSMC);
+
+		if (!psoVSM_->Initialize(pDev, desc))
+		{
+			sl12::ConsolePrint("Error: failed to init lighting vsm pso.");
+		}
+	}
 }
 
 LightingPass::~LightingPass()
 {
 	psoSM_.Reset();
 	psoEVSM_.Reset();
+	psoVSM_.Reset();
 	rs_.Reset();
+	rsVSM_.Reset();
 }
 
 std::vector<sl12::TransientResource> LightingPass::GetInputResources(const sl12::RenderPassID& ID) const
 {
 	std::vector<sl12::TransientResource> ret;
+	ret.reserve(5);
 	ret.push_back(sl12::TransientResource(kGBufferAID, sl12::TransientState::ShaderResource));
 	ret.push_back(sl12::TransientResource(kGBufferBID, sl12::TransientState::ShaderResource));
 	ret.push_back(sl12::TransientResource(kGBufferCID, sl12::TransientState::ShaderResource));
-	if (!bEnableShadowExp_)
+	if (bVirtualShadow_)
+	{
+		// 物理ページのプールとページテーブルはSceneが持つ
+		// 未描画のページはカスケードシャドウマップを使う
+		ret.push_back(sl12::TransientResource(kShadowMapID, sl12::TransientState::ShaderResource));
+	}
+	else if (!bEnableShadowExp_)
 	{
 		ret.push_back(sl12::TransientResource(kShadowMapID, sl12::TransientState::ShaderResource));
 	}
@@ -239,13 +264,11 @@ void LightingPass::Execute(sl12::CommandList* pCmdList, sl12::TransientResourceM
 	auto pGBufferB = pResManager->GetRenderGraphResource(kGBufferBID);
 	auto pGBufferC = pResManager->GetRenderGraphResource(kGBufferCID);
 	auto pDepthRes = pResManager->GetRenderGraphResource(kDepthBufferID);
-	auto pShadowRes = pResManager->GetRenderGraphResource(bEnableShadowExp_ ? kShadowExpID : kShadowMapID);
 	auto pAccumRes = pResManager->GetRenderGraphResource(kLightAccumID);
 	auto pGbASRV = pResManager->CreateOrGetTextureView(pGBufferA);
 	auto pGbBSRV = pResManager->CreateOrGetTextureView(pGBufferB);
 	auto pGbCSRV = pResManager->CreateOrGetTextureView(pGBufferC);
 	auto pDepthSRV = pResManager->CreateOrGetTextureView(pDepthRes);
-	auto pShadowSRV = pResManager->CreateOrGetTextureView(pShadowRes);
 	auto pAccumUAV = pResManager->CreateOrGetUnorderedAccessTextureView(pAccumRes);
 
 	// set descriptors.
@@ -258,14 +281,32 @@ void LightingPass::Execute(sl12::CommandList* pCmdList, sl12::TransientResourceM
 	descSet.SetCsSrv(1, pGbBSRV->GetDescInfo().cpuHandle);
 	descSet.SetCsSrv(2, pGbCSRV->GetDescInfo().cpuHandle);
 	descSet.SetCsSrv(3, pDepthSRV->GetDescInfo().cpuHandle);
-	descSet.SetCsSrv(4, pShadowSRV->GetDescInfo().cpuHandle);
 	descSet.SetCsUav(0, pAccumUAV->GetDescInfo().cpuHandle);
-	auto sampler = bEnableShadowExp_ ? pRenderSystem_->GetLinearClampSampler() : pRenderSystem_->GetShadowSampler();
-	descSet.SetCsSampler(0, sampler->GetDescInfo().cpuHandle);
+	if (bVirtualShadow_)
+	{
+		auto pCascadeRes = pResManager->GetRenderGraphResource(kShadowMapID);
+		auto pCascadeSRV = pResManager->CreateOrGetTextureView(pCascadeRes);
+		descSet.SetCsSrv(4, pScene_->GetVsmPoolSRV()->GetDescInfo().cpuHandle);
+		descSet.SetCsSrv(5, pScene_->GetVsmPageTableSRV()->GetDescInfo().cpuHandle);
+		descSet.SetCsSrv(6, pCascadeSRV->GetDescInfo().cpuHandle);
+		descSet.SetCsSampler(0, pRenderSystem_->GetShadowSampler()->GetDescInfo().cpuHandle);
 
-	// set pipeline.
-	pCmdList->GetLatestCommandList()->SetPipelineState(bEnableShadowExp_ ? psoEVSM_->GetPSO() : psoSM_->GetPSO());
-	pCmdList->SetComputeRootSignatureAndDescriptorSet(&rs_, &descSet);
+		// set pipeline.
+		pCmdList->GetLatestCommandList()->SetPipelineState(psoVSM_->GetPSO());
+		pCmdList->SetComputeRootSignatureAndDescriptorSet(&rsVSM_, &descSet);
+	}
+	else
+	{
+		auto pShadowRes = pResManager->GetRenderGraphResource(bEnableShadowExp_ ? kShadowExpID : kShadowMapID);
+		auto pShadowSRV = pResManager->CreateOrGetTextureView(pShadowRes);
+		descSet.SetCsSrv(4, pShadowSRV->GetDescInfo().cpuHandle);
+		auto sampler = bEnableShadowExp_ ? pRenderSystem_->GetLinearClampSampler() : pRenderSystem_->GetShadowSampler();
+		descSet.SetCsSampler(0, sampler->GetDescInfo().cpuHandle);
+
+		// set pipeline.
+		pCmdList->GetLatestCommandList()->SetPipelineState(bEnableShadowExp_ ? psoEVSM_->GetPSO() : psoSM_->GetPSO());
+		pCmdList->SetComputeRootSignatureAndDescriptorSet(&rs_, &descSet);
+	}
 
 	// dispatch.
 	UINT x = (pScene_->GetScreenWidth() + 7) / 8;
@@ -305,18 +346,23 @@ HiZPass::~HiZPass()
 
 std::vector<sl12::TransientResource> HiZPass::GetInputResources(const sl12::RenderPassID& ID) const
 {
+	bool bShadow = ID == kShadowHiZPass;
+
 	std::vector<sl12::TransientResource> ret;
-	ret.push_back(sl12::TransientResource(kDepthBufferID, sl12::TransientState::ShaderResource));
+	ret.push_back(sl12::TransientResource(bShadow ? kShadowMapID : kDepthBufferID, sl12::TransientState::ShaderResource));
 	return ret;
 }
 
 std::vector<sl12::TransientResource> HiZPass::GetOutputResources(const sl12::RenderPassID& ID) const
 {
+	bool bShadow = ID == kShadowHiZPass;
+
 	std::vector<sl12::TransientResource> ret;
-	sl12::TransientResource hiz(kHiZID, sl12::TransientState::UnorderedAccess);
+	sl12::TransientResource hiz(bShadow ? kShadowHiZID : kHiZID, sl12::TransientState::UnorderedAccess);
 
-	sl12::u32 width = pScene_->GetScreenWidth() / 2;
-	sl12::u32 height = pScene_->GetScreenHeight() / 2;
+	// シャドウマップのHiZは次フレームのシャドウカリングで使う
+	sl12::u32 width = (bShadow ? kShadowMapSize : pScene_->GetScreenWidth()) / 2;
+	sl12::u32 height = (bShadow ? kShadowMapSize : pScene_->GetScreenHeight()) / 2;
 	hiz.desc.bIsTexture = true;
 	hiz.desc.textureDesc.Initialize2D(kHiZFormat, width, height, kHiZMiplevels, 1, 0);
 	hiz.desc.historyFrame = 1;
@@ -328,15 +374,17 @@ std::vector<sl12::TransientResource> HiZPass::GetOutputResources(const sl12::Ren
 
 void HiZPass::Execute(sl12::CommandList* pCmdList, sl12::TransientResourceManager* pResManager, const sl12::RenderPassID& ID)
 {
-	GPU_MARKER(pCmdList, 1, "HiZPass");
+	bool bShadow = ID == kShadowHiZPass;
 
-	auto pDepthRes = pResManager->GetRenderGraphResource(kDepthBufferID);
-	auto pHiZRes = pResManager->GetRenderGraphResource(kHiZID);
+	GPU_MARKER(pCmdList, 1, bShadow ? "ShadowHiZPass" : "HiZPass");
+
+	auto pDepthRes = pResManager->GetRenderGraphResource(bShadow ? kShadowMapID : kDepthBufferID);
+	auto pHiZRes = pResManager->GetRenderGraphResource(bShadow ? kShadowHiZID : kHiZID);
 	auto pDepthSRV = pResManager->CreateOrGetTextureView(pDepthRes);
 
 	auto srv = pDepthSRV->GetDescInfo().cpuHandle;
-	auto width = pScene_->GetScreenWidth() >> 2;
-	auto height = pScene_->GetScreenHeight() >> 2;
+	auto width = (bShadow ? kShadowMapSize : pScene_->GetScreenWidth()) >> 2;
+	auto height = (bShadow ? kShadowMapSize : pScene_->GetScreenHeight()) >> 2;
 	sl12::u32 i = 0;
 	while (true)
 	{
@@ -515,12 +563,10 @@ GenerateVrsPass::~GenerateVrsPass()
 std::vector<sl12::TransientResource> GenerateVrsPass::GetInputResources(const sl12::RenderPassID& ID) const
 {
 	std::vector<sl12::TransientResource> ret;
+	ret.reserve(3);
 	ret.push_back(sl12::TransientResource(kLightAccumID, sl12::TransientState::ShaderResource));
 	ret.push_back(sl12::TransientResource(kVisBufferID, sl12::TransientState::ShaderResource));
 	ret.push_back(sl12::TransientResource(kDepthBufferID, sl12::TransientState::ShaderResource));
-	ret.push_back(sl12::TransientResource(kSubmeshBufferID, sl12::TransientState::ShaderResource));
-	ret.push_back(sl12::TransientResource(kMeshletBufferID, sl12::TransientState::ShaderResource));
-	ret.push_back(sl12::TransientResource(kDrawCallBufferID, sl12::TransientState::ShaderResource));
 	return ret;
 }
 
@@ -547,16 +593,13 @@ void GenerateVrsPass::Execute(sl12::CommandList* pCmdList, sl12::TransientResour
 	auto pAccumRes = pResManager->GetRenderGraphResource(kLightAccumID);
 	auto pVisRes = pResManager->GetRenderGraphResource(kVisBufferID);
 	auto pDepthRes = pResManager->GetRenderGraphResource(kDepthBufferID);
-	auto pSubmeshRes = pResManager->GetRenderGraphResource(kSubmeshBufferID);
-	auto pMeshletRes = pResManager->GetRenderGraphResource(kMeshletBufferID);
-	auto pDrawCallRes = pResManager->GetRenderGraphResource(kDrawCallBufferID);
 	auto pVRSRes = pResManager->GetRenderGraphResource(kPrevVrsID);
 	auto pAccumSRV = pResManager->CreateOrGetTextureView(pAccumRes);
 	auto pVisSRV = pResManager->CreateOrGetTextureView(pVisRes);
 	auto pDepthSRV = pResManager->CreateOrGetTextureView(pDepthRes);
-	auto pSubmeshSRV = pResManager->CreateOrGetBufferView(pSubmeshRes, 0, 0, (sl12::u32)pSubmeshRes->pBuffer->GetBufferDesc().stride);
-	auto pMeshletSRV = pResManager->CreateOrGetBufferView(pMeshletRes, 0, 0, (sl12::u32)pMeshletRes->pBuffer->GetBufferDesc().stride);
-	auto pDrawCallSRV = pResManager->CreateOrGetBufferView(pDrawCallRes, 0, 0, (sl12::u32)pDrawCallRes->pBuffer->GetBufferDesc().stride);
+	auto pSubmeshSRV = pScene_->GetMeshletResource()->GetSubmeshSRV();
+	auto pMeshletSRV = pScene_->GetMeshletResource()->GetMeshletSRV();
+	auto pDrawCallSRV = pScene_->GetMeshletResource()->GetDrawCallSRV();
 	auto pVRSUAV = pResManager->CreateOrGetUnorderedAccessTextureView(pVRSRes);
 
 	sl12::u32 width = pScene_->GetScreenWidth();
@@ -630,6 +673,7 @@ ReprojectVrsPass::~ReprojectVrsPass()
 std::vector<sl12::TransientResource> ReprojectVrsPass::GetInputResources(const sl12::RenderPassID& ID) const
 {
 	std::vector<sl12::TransientResource> ret;
+	ret.reserve(3);
 	ret.push_back(sl12::TransientResource(sl12::TransientResourceID(kPrevVrsID, 1), sl12::TransientState::ShaderResource));
 	ret.push_back(sl12::TransientResource(sl12::TransientResourceID(kDepthBufferID, 1), sl12::TransientState::ShaderResource));
 	ret.push_back(sl12::TransientResource(kDepthBufferID, sl12::TransientState::ShaderResource));
@@ -715,12 +759,18 @@ void ReprojectVrsPass::Execute(sl12::CommandList* pCmdList, sl12::TransientResou
 PrefixSumTestPass::PrefixSumTestPass(sl12::Device* pDev, RenderSystem* pRenderSys, Scene* pScene)
 	: AppPassBase(pDev, pRenderSys, pScene)
 {
+	const ShaderName kShaders[] = {
+		ShaderName::PrefixSumC,
+		ShaderName::PrefixSumU64C,
+		ShaderName::PrefixSumSegmentedC,
+	};
+	static_assert(ARRAYSIZE(kShaders) == (int)PrefixScanType::Max, "shader count mismatch.");
+
 	rs_ = sl12::MakeUnique<sl12::RootSignature>(pDev);
 	psoInit_ = sl12::MakeUnique<sl12::ComputePipelineState>(pDev);
-	psoMain_ = sl12::MakeUnique<sl12::ComputePipelineState>(pDev);
 
 	// init root signature.
-	rs_->Initialize(pDev, pRenderSys->GetShader(ShaderName::PrefixSumInitCS));
+	rs_->Initialize(pDev, pRenderSys->GetShader(ShaderName::PrefixSumSegmentedC));
 
 	// init pipeline state.
 	{
@@ -733,12 +783,15 @@ PrefixSumTestPass::PrefixSumTestPass(sl12::Device* pDev, RenderSystem* pRenderSy
 			sl12::ConsolePrint("Error: failed to prefix sum init pso.");
 		}
 	}
+	for (int i = 0; i < (int)PrefixScanType::Max; i++)
 	{
+		psoMain_[i] = sl12::MakeUnique<sl12::ComputePipelineState>(pDev);
+
 		sl12::ComputePipelineStateDesc desc{};
 		desc.pRootSignature = &rs_;
-		desc.pCS = pRenderSys->GetShader(ShaderName::PrefixSumC);
+		desc.pCS = pRenderSys->GetShader(kShaders[i]);
 
-		if (!psoMain_->Initialize(pDev, desc))
+		if (!psoMain_[i]->Initialize(pDev, desc))
 		{
 			sl12::ConsolePrint("Error: failed to prefix sum pso.");
 		}
@@ -747,8 +800,24 @@ PrefixSumTestPass::PrefixSumTestPass(sl12::Device* pDev, RenderSystem* pRenderSy
 
 PrefixSumTestPass::~PrefixSumTestPass()
 {
+	input_.Reset();
+	output_.Reset();
+	keys_.Reset();
+	status_.Reset();
+	counter_.Reset();
+	inputUAV_.Reset();
+	outputUAV_.Reset();
+	statusUAV_.Reset();
+	counterUAV_.Reset();
+	keysSRV_.Reset();
+	readbacks_[0].Reset();
+	readbacks_[1].Reset();
+
 	psoInit_.Reset();
-	psoMain_.Reset();
+	for (auto&& pso : psoMain_)
+	{
+		pso.Reset();
+	}
 	rs_.Reset();
 }
 
@@ -764,125 +833,219 @@ std::vector<sl12::TransientResource> PrefixSumTestPass::GetOutputResources(const
 	return ret;
 }
 
-void PrefixSumTestPass::Execute(sl12::CommandList* pCmdList, sl12::TransientResourceManager* pResManager, const sl12::RenderPassID& ID)
+void PrefixSumTestPass::CreateBuffers(sl12::CommandList* pCmdList)
 {
-	GPU_MARKER(pCmdList, 1, "PrefixSumTest");
-
-	const int kElemCount = 1024;
-	const int kBlockCount = (kElemCount + 255) / 256;
+	const sl12::u32 kSegmentLength = 64;
+
+	sl12::u32 count = elementCount_;
+	sl12::u32 numBlocks = (count + PREFIX_SCAN_BLOCK_SIZE - 1) / PREFIX_SCAN_BLOCK_SIZE;
+	bool bU64 = type_ == PrefixScanType::U64;
+	bool bSegmented = type_ == PrefixScanType::SegmentedU32;
+	sl12::u32 stride = bU64 ? sizeof(sl12::u64) : sizeof(sl12::u32);
+
+	// 入力と期待値
+	std::vector<sl12::u32> values, keys;
+	MakePrefixScanInput(count, count, bSegmented ? kSegmentLength : 0, values, keys);
+	std::vector<sl12::u32> inputData;
+	auto cpuStart = std::chrono::high_resolution_clock::now();
+	if (bU64)
+	{
+		// 上位32bitへの桁上がりが起きる値にする
+		std::vector<sl12::u64> values64(count), result64(count);
+		for (sl12::u32 i = 0; i < count; i++)
+		{
+			values64[i] = (sl12::u64)values[i] << 16;
+		}
+		cpuStart = std::chrono::high_resolution_clock::now();
+		PrefixScanReference(values64.data(), result64.data(), count, bInclusive_);
+		inputData.resize(count * 2);
+		expected_.resize(count * 2);
+		memcpy(inputData.data(), values64.data(), sizeof(sl12::u64) * count);
+		memcpy(expected_.data(), result64.data(), sizeof(sl12::u64) * count);
+	}
+	else
+	{
+		expected_.resize(count);
+		if (bSegmented)
+		{
+			SegmentedPrefixScanReference(keys.data(), values.data(), expected_.data(), count, bInclusive_);
+		}
+		else
+		{
+			PrefixScanReference(values.data(), expected_.data(), count, bInclusive_);
+		}
+		inputData = values;
+	}
+	auto cpuEnd = std::chrono::high_resolution_clock::now();
 
-	UniqueHandle<sl12::Buffer> pInput, pOutput, pStatus, pBlock, pTemp;
-	pInput = sl12::MakeUnique<sl12::Buffer>(pDevice_);
-	pOutput = sl12::MakeUnique<sl12::Buffer>(pDevice_);
-	pStatus = sl12::MakeUnique<sl12::Buffer>(pDevice_);
-	pBlock = sl12::MakeUnique<sl12::Buffer>(pDevice_);
-	pTemp = sl12::MakeUnique<sl12::Buffer>(pDevice_);
+	auto&& stats = pScene_->GetPrefixScanStats();
+	stats = Scene::PrefixScanStats();
+	stats.elementCount = count;
+	stats.cpuMicroSec = (double)std::chrono::duration_cast<std::chrono::microseconds>(cpuEnd - cpuStart).count();
 
+	// create buffers.
+	auto CreateBuffer = [&](sl12::UniqueHandle<sl12::Buffer>& B, size_t elemStride, size_t num, sl12::u32 usage, D3D12_RESOURCE_STATES state)
 	{
 		sl12::BufferDesc desc{};
 		desc.heap = sl12::BufferHeap::Default;
-		desc.size = sizeof(int) * kElemCount;
-		desc.stride = sizeof(int);
-		desc.usage = sl12::ResourceUsage::ShaderResource | sl12::ResourceUsage::UnorderedAccess;
+		desc.size = elemStride * num;
+		desc.stride = elemStride;
+		desc.usage = usage;
+		desc.initialState = state;
+		B = sl12::MakeUnique<sl12::Buffer>(pDevice_);
+		B->Initialize(pDevice_, desc);
+	};
+	auto Upload = [&](sl12::Buffer* pDst, const std::vector<sl12::u32>& data, D3D12_RESOURCE_STATES after)
+	{
+		sl12::BufferDesc desc = pDst->GetBufferDesc();
+		desc.heap = sl12::BufferHeap::Dynamic;
+		desc.usage = sl12::ResourceUsage::Unknown;
 		desc.initialState = D3D12_RESOURCE_STATE_COMMON;
-		pInput->Initialize(pDevice_, desc);
+		sl12::UniqueHandle<sl12::Buffer> UploadB = sl12::MakeUnique<sl12::Buffer>(pDevice_);
+		UploadB->Initialize(pDevice_, desc);
 
-		desc.usage = sl12::ResourceUsage::UnorderedAccess;
-		pOutput->Initialize(pDevice_, desc);
+		void* p = UploadB->Map();
+		memcpy(p, data.data(), sizeof(sl12::u32) * data.size());
+		UploadB->Unmap();
 
-		desc.size = sizeof(int) * 2 * kBlockCount;
-		desc.stride = sizeof(int) * 2;
-		pStatus->Initialize(pDevice_, desc);
+		pCmdList->GetLatestCommandList()->CopyResource(pDst->GetResourceDep(), UploadB->GetResourceDep());
+		pCmdList->TransitionBarrier(pDst, D3D12_RESOURCE_STATE_COPY_DEST, after);
+	};
 
-		desc.size = sizeof(int);
-		desc.stride = sizeof(int);
-		pBlock->Initialize(pDevice_, desc);
+	CreateBuffer(input_, stride, count, sl12::ResourceUsage::UnorderedAccess, D3D12_RESOURCE_STATE_COMMON);
+	CreateBuffer(output_, stride, count, sl12::ResourceUsage::UnorderedAccess, D3D12_RESOURCE_STATE_UNORDERED_ACCESS);
+	CreateBuffer(keys_, sizeof(sl12::u32), count, sl12::ResourceUsage::ShaderResource, D3D12_RESOURCE_STATE_COMMON);
+	CreateBuffer(status_, PREFIX_SCAN_STATUS_STRIDE, numBlocks, sl12::ResourceUsage::UnorderedAccess, D3D12_RESOURCE_STATE_UNORDERED_ACCESS);
+	CreateBuffer(counter_, sizeof(sl12::u32), 1, sl12::ResourceUsage::UnorderedAccess, D3D12_RESOURCE_STATE_UNORDERED_ACCESS);
+	Upload(&input_, inputData, D3D12_RESOURCE_STATE_UNORDERED_ACCESS);
+	Upload(&keys_, keys, D3D12_RESOURCE_STATE_GENERIC_READ);
+
+	inputUAV_ = sl12::MakeUnique<sl12::UnorderedAccessView>(pDevice_);
+	outputUAV_ = sl12::MakeUnique<sl12::UnorderedAccessView>(pDevice_);
+	statusUAV_ = sl12::MakeUnique<sl12::UnorderedAccessView>(pDevice_);
+	counterUAV_ = sl12::MakeUnique<sl12::UnorderedAccessView>(pDevice_);
+	keysSRV_ = sl12::MakeUnique<sl12::BufferView>(pDevice_);
+	inputUAV_->Initialize(pDevice_, &input_, 0, count, stride, 0);
+	outputUAV_->Initialize(pDevice_, &output_, 0, count, stride, 0);
+	statusUAV_->Initialize(pDevice_, &status_, 0, numBlocks, PREFIX_SCAN_STATUS_STRIDE, 0);
+	counterUAV_->Initialize(pDevice_, &counter_, 0, 1, sizeof(sl12::u32), 0);
+	keysSRV_->Initialize(pDevice_, &keys_, 0, count, sizeof(sl12::u32));
+
+	readbacks_[0].Reset();
+	readbacks_[1].Reset();
+
+	bufferCount_ = count;
+	bufferType_ = type_;
+	bBufferInclusive_ = bInclusive_;
+}
 
-		desc.heap = sl12::BufferHeap::Dynamic;
-		desc.size = sizeof(int) * kElemCount;
-		desc.stride = sizeof(int);
-		desc.usage = sl12::ResourceUsage::Unknown;
-		pTemp->Initialize(pDevice_, desc);
-	}
+void PrefixSumTestPass::Execute(sl12::CommandList* pCmdList, sl12::TransientResourceManager* pResManager, const sl12::RenderPassID& ID)
+{
+	GPU_MARKER(pCmdList, 1, "PrefixSumTest");
+
+	// 計測を邪魔しないように、比較は最初の数フレームのみ行う
+	const sl12::u32 kVerifyFrames = 4;
 
+	if (elementCount_ == 0)
 	{
-		std::vector<int> src;
-		std::vector<int> dst;
-		for (int i = 0; i < kElemCount; ++i)
-		{
-			src.push_back(i + 1);
-		}
-		int total = 0;
-		for (int i = 0; i < kElemCount; ++i)
-		{
-			dst.push_back(total);
-			total += src[i];
-		}
-		sl12::ConsolePrint("final result : %d\n", dst[kElemCount - 1]);
+		return;
 	}
-
-	// コピー
+	if (!input_.IsValid() || bufferCount_ != elementCount_ || bufferType_ != type_ || bBufferInclusive_ != bInclusive_)
 	{
-		int* p = (int*)pTemp->Map();
-		for (int i = 0; i < kElemCount; ++i)
-			p[i] = i + 1;
-		pTemp->Unmap();
+		CreateBuffers(pCmdList);
+	}
 
-		pCmdList->GetLatestCommandList()->CopyResource(pInput->GetResourceDep(), pTemp->GetResourceDep());
-		pCmdList->AddTransitionBarrier(&pInput, D3D12_RESOURCE_STATE_COPY_DEST, D3D12_RESOURCE_STATE_UNORDERED_ACCESS);
-		pCmdList->FlushBarriers();
+	sl12::u32 numBlocks = (elementCount_ + PREFIX_SCAN_BLOCK_SIZE - 1) / PREFIX_SCAN_BLOCK_SIZE;
+	auto&& stats = pScene_->GetPrefixScanStats();
+
+	// 2フレーム前の結果を比較する
+	if (readbacks_[1].IsValid())
+	{
+		const sl12::u32* p = static_cast<const sl12::u32*>(readbacks_[0]->Map());
+		for (size_t i = 0; i < expected_.size(); i++)
+		{
+			if (p[i] != expected_[i])
+			{
+				stats.mismatchCount++;
+			}
+		}
+		readbacks_[0]->Unmap();
+		readbacks_[0] = std::move(readbacks_[1]);
+		stats.checkedFrames++;
 	}
 
-	UniqueHandle<sl12::UnorderedAccessView> pInputView, pOutputView, pStatusView, pBlockView;
-	pInputView = sl12::MakeUnique<sl12::UnorderedAccessView>(pDevice_);
-	pOutputView = sl12::MakeUnique<sl12::UnorderedAccessView>(pDevice_);
-	pStatusView = sl12::MakeUnique<sl12::UnorderedAccessView>(pDevice_);
-	pBlockView = sl12::MakeUnique<sl12::UnorderedAccessView>(pDevice_);
-	pInputView->Initialize(pDevice_, &pInput, 0, kElemCount, sizeof(int), 0);
-	pOutputView->Initialize(pDevice_, &pOutput, 0, kElemCount, sizeof(int), 0);
-	pStatusView->Initialize(pDevice_, &pStatus, 0, kBlockCount, sizeof(int) * 2, 0);
-	pBlockView->Initialize(pDevice_, &pBlock, 0, 1, sizeof(int), 0);
-
-	sl12::u32 cb[] = {kElemCount, kBlockCount};
+	sl12::u32 cb[] = {elementCount_, numBlocks, bInclusive_ ? 1u : 0u};
 	sl12::CbvHandle hCB = pRenderSystem_->GetCbvManager()->GetTemporal(cb, sizeof(cb));
 
+	// set descriptors.
+	sl12::DescriptorSet descSet;
+	descSet.Reset();
+	descSet.SetCsCbv(0, hCB.GetCBV()->GetDescInfo().cpuHandle);
+	descSet.SetCsSrv(0, keysSRV_->GetDescInfo().cpuHandle);
+	descSet.SetCsUav(0, inputUAV_->GetDescInfo().cpuHandle);
+	descSet.SetCsUav(1, outputUAV_->GetDescInfo().cpuHandle);
+	descSet.SetCsUav(2, statusUAV_->GetDescInfo().cpuHandle);
+	descSet.SetCsUav(3, counterUAV_->GetDescInfo().cpuHandle);
+
 	// 初期化
 	{
-		// set descriptors.
-		sl12::DescriptorSet descSet;
-		descSet.Reset();
-		descSet.SetCsCbv(0, hCB.GetCBV()->GetDescInfo().cpuHandle);
-		descSet.SetCsUav(2, pStatusView->GetDescInfo().cpuHandle);
-		descSet.SetCsUav(3, pBlockView->GetDescInfo().cpuHandle);
-
 		// set pipeline.
 		pCmdList->GetLatestCommandList()->SetPipelineState(psoInit_->GetPSO());
 		pCmdList->SetComputeRootSignatureAndDescriptorSet(&rs_, &descSet);
 
 		// dispatch.
-		pCmdList->GetLatestCommandList()->Dispatch(kBlockCount, 1, 1);
+		pCmdList->GetLatestCommandList()->Dispatch((numBlocks + 32 - 1) / 32, 1, 1);
 
-		pCmdList->AddUAVBarrier(&pStatus);
+		pCmdList->AddUAVBarrier(&status_);
+		pCmdList->AddUAVBarrier(&counter_);
 		pCmdList->FlushBarriers();
 	}
 
 	// 実行
 	{
-		// set descriptors.
-		sl12::DescriptorSet descSet;
-		descSet.Reset();
-		descSet.SetCsCbv(0, hCB.GetCBV()->GetDescInfo().cpuHandle);
-		descSet.SetCsUav(0, pInputView->GetDescInfo().cpuHandle);
-		descSet.SetCsUav(1, pOutputView->GetDescInfo().cpuHandle);
-		descSet.SetCsUav(2, pStatusView->GetDescInfo().cpuHandle);
-		descSet.SetCsUav(3, pBlockView->GetDescInfo().cpuHandle);
-
 		// set pipeline.
-		pCmdList->GetLatestCommandList()->SetPipelineState(psoMain_->GetPSO());
+		pCmdList->GetLatestCommandList()->SetPipelineState(psoMain_[(int)type_]->GetPSO());
 		pCmdList->SetComputeRootSignatureAndDescriptorSet(&rs_, &descSet);
 
 		// dispatch.
-		pCmdList->GetLatestCommandList()->Dispatch(kBlockCount, 1, 1);
+		pCmdList->GetLatestCommandList()->Dispatch(numBlocks, 1, 1);
+	}
+
+	// readback.
+	if (stats.checkedFrames + (readbacks_[0].IsValid() ? 1 : 0) + (readbacks_[1].IsValid() ? 1 : 0) < kVerifyFrames)
+	{
+		sl12::UniqueHandle<sl12::Buffer> readback = sl12::MakeUnique<sl12::Buffer>(pDevice_);
+		sl12::BufferDesc desc{};
+		desc.heap = sl12::BufferHeap::ReadBack;
+		desc.size = output_->GetBufferDesc().size;
+		desc.usage = sl12::ResourceUsage::Unknown;
+		readback->Initialize(pDevice_, desc);
+		pCmdList->TransitionBarrier(&output_, D3D12_RESOURCE_STATE_UNORDERED_ACCESS, D3D12_RESOURCE_STATE_COPY_SOURCE);
+		pCmdList->GetLatestCommandList()->CopyResource(readback->GetResourceDep(), output_->GetResourceDep());
+		pCmdList->TransitionBarrier(&output_, D3D12_RESOURCE_STATE_COPY_SOURCE, D3D12_RESOURCE_STATE_UNORDERED_ACCESS);
+		if (!readbacks_[0].IsValid())
+		{
+			readbacks_[0] = std::move(readback);
+		}
+		else
+		{
+			readbacks_[1] = std::move(readback);
+		}
+	}
+	else if (readbacks_[0].IsValid() && !readbacks_[1].IsValid())
+	{
+		// 最後のリードバックはここで比較する
+		const sl12::u32* p = static_cast<const sl12::u32*>(readbacks_[0]->Map());
+		for (size_t i = 0; i < expected_.size(); i++)
+		{
+			if (p[i] != expected_[i])
+			{
+				stats.mismatchCount++;
+			}
+		}
+		readbacks_[0]->Unmap();
+		readbacks_[0].Reset();
+		stats.checkedFrames++;
 	}
 }
 
@@ -957,6 +1120,7 @@ DebugPass::~DebugPass()
 std::vector<sl12::TransientResource> DebugPass::GetInputResources(const sl12::RenderPassID& ID) const
 {
 	std::vector<sl12::TransientResource> ret;
+	ret.reserve(3);
 	if (debugMode_ == kDisplayVRSMode)
 	{
 		// VRS
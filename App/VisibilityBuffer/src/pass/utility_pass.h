@@ -74,6 +74,7 @@ public:
 	virtual void SetPassSettings(const RenderPassSetupDesc& desc)
 	{
 		bEnableShadowExp_ = desc.bShadowBlur;
+		bVirtualShadow_ = desc.bUseVirtualShadow;
 	}
 
 	virtual std::vector<sl12::TransientResource> GetInputResources(const sl12::RenderPassID& ID) const override;
@@ -85,9 +86,10 @@ public:
 	virtual void Execute(sl12::CommandList* pCmdList, sl12::TransientResourceManager* pResManager, const sl12::RenderPassID& ID) override;
 
 private:
-	sl12::UniqueHandle<sl12::RootSignature> rs_;
-	sl12::UniqueHandle<sl12::ComputePipelineState> psoSM_, psoEVSM_;
+	sl12::UniqueHandle<sl12::RootSignature> rs_, rsVSM_;
+	sl12::UniqueHandle<sl12::ComputePipelineState> psoSM_, psoEVSM_, psoVSM_;
 	bool bEnableShadowExp_ = false;
+	bool bVirtualShadow_ = false;
 };
 
 //----
@@ -203,6 +205,8 @@ private:
 };
 
 //----
+// プレフィックススキャンのベンチマーク
+// 指定した要素数のスキャンを毎フレーム実行し、最初の数フレームはCPU版と結果を比較する
 class PrefixSumTestPass : public AppPassBase
 {
 public:
@@ -214,6 +218,13 @@ public:
 		return AppPassType::PrefixSumTest;
 	}
 
+	virtual void SetPassSettings(const RenderPassSetupDesc& desc)
+	{
+		elementCount_ = (sl12::u32)desc.prefixScanBenchmarkCount;
+		type_ = (PrefixScanType)desc.prefixScanBenchmarkType;
+		bInclusive_ = desc.bPrefixScanInclusive;
+	}
+
 	virtual std::vector<sl12::TransientResource> GetInputResources(const sl12::RenderPassID& ID) const override;
 	virtual std::vector<sl12::TransientResource> GetOutputResources(const sl12::RenderPassID& ID) const override;
 	virtual sl12::HardwareQueue::Value GetExecuteQueue() const
@@ -221,10 +232,28 @@ public:
 		return sl12::HardwareQueue::Graphics;
 	}
 	virtual void Execute(sl12::CommandList* pCmdList, sl12::TransientResourceManager* pResManager, const sl12::RenderPassID& ID) override;
+
+private:
+	void CreateBuffers(sl12::CommandList* pCmdList);
 	
 private:
 	sl12::UniqueHandle<sl12::RootSignature> rs_;
-	sl12::UniqueHandle<sl12::ComputePipelineState> psoInit_, psoMain_;
+	sl12::UniqueHandle<sl12::ComputePipelineState> psoInit_, psoMain_[(int)PrefixScanType::Max];
+
+	sl12::u32 elementCount_ = 0;
+	PrefixScanType type_ = PrefixScanType::U32;
+	bool bInclusive_ = false;
+
+	// 作成済みのバッファの設定
+	sl12::u32 bufferCount_ = 0;
+	PrefixScanType bufferType_ = PrefixScanType::U32;
+	bool bBufferInclusive_ = false;
+
+	sl12::UniqueHandle<sl12::Buffer> input_, output_, keys_, status_, counter_;
+	sl12::UniqueHandle<sl12::UnorderedAccessView> inputUAV_, outputUAV_, statusUAV_, counterUAV_;
+	sl12::UniqueHandle<sl12::BufferView> keysSRV_;
+	sl12::UniqueHandle<sl12::Buffer> readbacks_[2];
+	std::vector<sl12::u32> expected_;
 };
 
 //----
@@ -11,6 +11,10 @@
 
 #include "../../shaders/cbuffer.hlsli"
 
+#include <algorithm>
+#include <chrono>
+#include <unordered_map>
+
 
 namespace
 {
@@ -69,55 +73,15 @@ void BufferReadyPass::GatherData(Data& OutData) const
 
 std::vector<sl12::TransientResource> BufferReadyPass::GetOutputResources(const sl12::RenderPassID& ID) const
 {
-	auto pMR = pScene_->GetMeshletResource();
-	auto pInstanceUpload = pMR->GetInstanceUpload();
-	auto pSubmeshUpload = pMR->GetSubmeshUpload();
-	auto pMeshletUpload = pMR->GetMeshletUpload();
-	auto pDrawCallUpload = pMR->GetDrawCallUpload();
-	
-	sl12::TransientResource ib(kInstanceBufferID, sl12::TransientState::CopyDst);
-	sl12::TransientResource sb(kSubmeshBufferID, sl12::TransientState::CopyDst);
-	sl12::TransientResource mb(kMeshletBufferID, sl12::TransientState::CopyDst);
-	sl12::TransientResource db(kDrawCallBufferID, sl12::TransientState::CopyDst);
-
-	ib.desc.bIsTexture = false;
-	ib.desc.bufferDesc.InitializeStructured(sizeof(InstanceData), 1, sl12::ResourceUsage::ShaderResource);
-	ib.desc.bufferDesc.size = pInstanceUpload->GetBufferDesc().size;
-	sb.desc.bIsTexture = false;
-	sb.desc.bufferDesc.InitializeStructured(sizeof(SubmeshData), 1, sl12::ResourceUsage::ShaderResource);
-	sb.desc.bufferDesc.size = pSubmeshUpload->GetBufferDesc().size;
-	mb.desc.bIsTexture = false;
-	mb.desc.bufferDesc.InitializeStructured(sizeof(MeshletData), 1, sl12::ResourceUsage::ShaderResource);
-	mb.desc.bufferDesc.size = pMeshletUpload->GetBufferDesc().size;
-	db.desc.bIsTexture = false;
-	db.desc.bufferDesc.InitializeStructured(sizeof(DrawCallData), 1, sl12::ResourceUsage::ShaderResource);
-	db.desc.bufferDesc.size = pDrawCallUpload->GetBufferDesc().size;
-
+	// シーンバッファはMeshletResourceが持つ永続バッファなので、RenderGraphのリソースは不要
 	std::vector<sl12::TransientResource> ret;
-	ret.push_back(ib);
-	ret.push_back(sb);
-	ret.push_back(mb);
-	ret.push_back(db);
 	return ret;
 }
 
 void BufferReadyPass::Execute(sl12::CommandList* pCmdList, sl12::TransientResourceManager* pResManager, const sl12::RenderPassID& ID)
 {
-	auto pMR = pScene_->GetMeshletResource();
-	auto pInstanceUpload = pMR->GetInstanceUpload();
-	auto pSubmeshUpload = pMR->GetSubmeshUpload();
-	auto pMeshletUpload = pMR->GetMeshletUpload();
-	auto pDrawCallUpload = pMR->GetDrawCallUpload();
-
-	// copy commands.
-	auto pIB = pResManager->GetRenderGraphResource(kInstanceBufferID);
-	auto pSB = pResManager->GetRenderGraphResource(kSubmeshBufferID);
-	auto pMB = pResManager->GetRenderGraphResource(kMeshletBufferID);
-	auto pDB = pResManager->GetRenderGraphResource(kDrawCallBufferID);
-	pCmdList->GetLatestCommandList()->CopyBufferRegion(pIB->pBuffer->GetResourceDep(), 0, pInstanceUpload->GetResourceDep(), 0, pInstanceUpload->GetBufferDesc().size);
-	pCmdList->GetLatestCommandList()->CopyBufferRegion(pSB->pBuffer->GetResourceDep(), 0, pSubmeshUpload->GetResourceDep(), 0, pSubmeshUpload->GetBufferDesc().size);
-	pCmdList->GetLatestCommandList()->CopyBufferRegion(pMB->pBuffer->GetResourceDep(), 0, pMeshletUpload->GetResourceDep(), 0, pMeshletUpload->GetBufferDesc().size);
-	pCmdList->GetLatestCommandList()->CopyBufferRegion(pDB->pBuffer->GetResourceDep(), 0, pDrawCallUpload->GetResourceDep(), 0, pDrawCallUpload->GetBufferDesc().size);
+	// copy dirty ranges.
+	pScene_->GetMeshletResource()->UploadSceneBuffers(pCmdList, pScene_->GetFrameIndex());
 }
 
 
@@ -227,10 +191,120 @@ VisibilityVsPass::VisibilityVsPass(sl12::Device* pDev, RenderSystem* pRenderSys,
 	// init indirect executer.
 	bool bIndirectExecuterSucceeded = indirectExec_->InitializeWithConstants(pDev, sl12::IndirectType::DrawIndexed, kIndirectArgsBufferStride, &rs_);
 	assert(bIndirectExecuterSucceeded);
+
+	// init bindless objects.
+	{
+		sl12::u32 maxResources = 0;
+		for (auto mesh : pScene->GetSceneMeshes())
+		{
+			maxResources += (sl12::u32)(mesh->GetParentResource()->GetMaterials().size() * 4);
+		}
+		maxResources += 32;	// add buffer.
+		InitBindless(maxResources);
+	}
+}
+
+void VisibilityVsPass::InitBindless(sl12::u32 maxResources)
+{
+	// 古いオブジェクトはDeviceの破棄キューで遅延解放されるので、GPUが使用中でも作り直してよい
+	rsBindless_ = sl12::MakeUnique<sl12::RootSignature>(pDevice_);
+	psoBindless_ = sl12::MakeUnique<sl12::GraphicsPipelineState>(pDevice_);
+	psoBindlessDS_ = sl12::MakeUnique<sl12::GraphicsPipelineState>(pDevice_);
+	psoBindlessOpaque_ = sl12::MakeUnique<sl12::GraphicsPipelineState>(pDevice_);
+	psoBindlessOpaqueDS_ = sl12::MakeUnique<sl12::GraphicsPipelineState>(pDevice_);
+	indirectExecBindless_ = sl12::MakeUnique<sl12::IndirectExecuter>(pDevice_);
+
+	// init root signature.
+	{
+		sl12::RootBindlessInfo info;
+		info.index_ = 0;
+		info.space_ = 32;
+		info.maxResources_ = maxResources;
+		rsBindless_->InitializeWithBindless(pDevice_, pRenderSystem_->GetShader(ShaderName::MaskedBindlessVV), pRenderSystem_->GetShader(ShaderName::MaskedBindlessVisP), nullptr, nullptr, nullptr, &info, 1, 1);
+	}
+	bindlessMaxResources_ = maxResources;
+
+	// init pipeline state.
+	{
+		// 頂点はシェーダでグローバルバッファから読むので、入力レイアウトはなし
+		sl12::GraphicsPipelineStateDesc desc{};
+		desc.pRootSignature = &rsBindless_;
+		desc.pVS = pRenderSystem_->GetShader(ShaderName::MaskedBindlessVV);
+		desc.pPS = pRenderSystem_->GetShader(ShaderName::MaskedBindlessVisP);
+
+		desc.blend.sampleMask = UINT_MAX;
+		desc.blend.rtDesc[0].isBlendEnable = false;
+		desc.blend.rtDesc[0].writeMask = 0xf;
+
+		desc.rasterizer.cullMode = D3D12_CULL_MODE_BACK;
+		desc.rasterizer.fillMode = D3D12_FILL_MODE_SOLID;
+		desc.rasterizer.isDepthClipEnable = true;
+		desc.rasterizer.isFrontCCW = true;
+
+		desc.depthStencil.isDepthEnable = true;
+		desc.depthStencil.isDepthWriteEnable = true;
+		desc.depthStencil.depthFunc = D3D12_COMPARISON_FUNC_GREATER_EQUAL;
+
+		desc.primTopology = D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
+		desc.numRTVs = 0;
+		desc.rtvFormats[desc.numRTVs++] = kVisibilityFormat;
+		desc.dsvFormat = kDepthFormat;
+		desc.multisampleCount = 1;
+
+		if (!psoBindless_->Initialize(pDevice_, desc))
+		{
+			sl12::ConsolePrint("Error: failed to init visibility bindless masked pso.");
+		}
+
+		desc.rasterizer.cullMode = D3D12_CULL_MODE_NONE;
+		
+		if (!psoBindlessDS_->Initialize(pDevice_, desc))
+		{
+			sl12::ConsolePrint("Error: failed to init visibility bindless masked doublesided pso.");
+		}
+
+		// アルファテストしない
+		desc.pPS = pRenderSystem_->GetShader(ShaderName::MaskedBindlessVisOpaqueP);
+		desc.rasterizer.cullMode = D3D12_CULL_MODE_BACK;
+
+		if (!psoBindlessOpaque_->Initialize(pDevice_, desc))
+		{
+			sl12::ConsolePrint("Error: failed to init visibility bindless masked opaque pso.");
+		}
+
+		desc.rasterizer.cullMode = D3D12_CULL_MODE_NONE;
+
+		if (!psoBindlessOpaqueDS_->Initialize(pDevice_, desc))
+		{
+			sl12::ConsolePrint("Error: failed to init visibility bindless masked opaque doublesided pso.");
+		}
+	}
+
+	// init indirect executer.
+	// バインドレス版はルート定数でドローコールを渡す
+	bool bIndirectExecuterSucceeded = indirectExecBindless_->InitializeWithConstants(pDevice_, sl12::IndirectType::Draw, kMaskedDrawArgsStride, &rsBindless_);
+	assert(bIndirectExecuterSucceeded);
+}
+
+void VisibilityVsPass::UpdateBindless()
+{
+	// インスタンス追加でワールドマテリアルが増えると、バインドレステクスチャがルートシグネチャの上限を超えるので作り直す
+	auto materialCount = pScene_->GetMeshletResource()->GetWorldMaterials().size();
+	sl12::u32 maxResources = (sl12::u32)(materialCount * 4) + 32;	// 4 textures per material + add buffer.
+	if (maxResources > bindlessMaxResources_)
+	{
+		InitBindless(maxResources);
+	}
 }
 
 VisibilityVsPass::~VisibilityVsPass()
 {
+	indirectExecBindless_.Reset();
+	psoBindless_.Reset();
+	psoBindlessDS_.Reset();
+	psoBindlessOpaque_.Reset();
+	psoBindlessOpaqueDS_.Reset();
+	rsBindless_.Reset();
 	indirectExec_.Reset();
 	psoOpaque_.Reset();
 	psoOpaqueDS_.Reset();
@@ -241,9 +315,18 @@ VisibilityVsPass::~VisibilityVsPass()
 
 std::vector<sl12::TransientResource> VisibilityVsPass::GetInputResources(const sl12::RenderPassID& ID) const
 {
+	bool b2nd = ID == kVisibilityVs2ndPass;
+
 	std::vector<sl12::TransientResource> ret;
+	ret.reserve(4);
 
-	ret.push_back(sl12::TransientResource(kMeshletIndirectArgID, sl12::TransientState::IndirectArgument));
+	ret.push_back(sl12::TransientResource(b2nd ? kMeshletCompactArg2ndID : kMeshletCompactArgID, sl12::TransientState::IndirectArgument));
+	ret.push_back(sl12::TransientResource(b2nd ? kMeshletDrawCount2ndID : kMeshletDrawCountID, sl12::TransientState::IndirectArgument));
+	if (bMaskedDrawList_)
+	{
+		ret.push_back(sl12::TransientResource(b2nd ? kMaskedDrawArg2ndID : kMaskedDrawArgID, sl12::TransientState::IndirectArgument));
+		ret.push_back(sl12::TransientResource(b2nd ? kMaskedDrawCount2ndID : kMaskedDrawCountID, sl12::TransientState::IndirectArgument));
+	}
 	
 	return ret;
 }
@@ -251,6 +334,7 @@ std::vector<sl12::TransientResource> VisibilityVsPass::GetInputResources(const s
 std::vector<sl12::TransientResource> VisibilityVsPass::GetOutputResources(const sl12::RenderPassID& ID) const
 {
 	std::vector<sl12::TransientResource> ret;
+	ret.reserve(2);
 
 	sl12::TransientResource vis(kVisBufferID, sl12::TransientState::RenderTarget);
 	sl12::TransientResource depth(kDepthBufferID, sl12::TransientState::DepthStencil);
@@ -270,20 +354,153 @@ std::vector<sl12::TransientResource> VisibilityVsPass::GetOutputResources(const
 	return ret;
 }
 
+void VisibilityVsPass::PrepareSerial(const sl12::RenderPassID& ID)
+{
+	// 作り直した古いオブジェクトはDeviceの破棄キューに積まれるので、並列実行中には行わない
+	if (ID == kVisibilityVsPass && bMaskedDrawList_)
+	{
+		UpdateBindless();
+	}
+}
+
+void VisibilityVsPass::PrepareExecute(const sl12::RenderPassID& ID)
+{
+	if (ID == kVisibilityVsPass)
+	{
+		BuildDrawItems();
+	}
+}
+
+void VisibilityVsPass::BuildDrawItems()
+{
+	auto pMR = pScene_->GetMeshletResource();
+
+	// build draw items.
+	// 描画数は描画リスト (同じメッシュとマテリアルのサブメッシュを全インスタンスでまとめたもの) ごとに出力されるので、
+	// 描画リスト単位の描画をソートキーで並べ替える
+	auto&& buckets = pMR->GetDrawBuckets();
+	auto&& materials = pMR->GetWorldMaterials();
+	// 作業用のコンテナはフレームアリーナから確保する
+	// 描画数は前フレームとほぼ同じなので、前フレームの数だけ先に確保しておく
+	auto pArena = &pScene_->GetFrameArena();
+	FrameVector<DrawSortItem> items{FrameArenaAllocator<DrawSortItem>(pArena)};
+	FrameVector<const sl12::ResourceItemMesh*> meshes{FrameArenaAllocator<const sl12::ResourceItemMesh*>(pArena)};
+	items.reserve(drawItems_.size());
+	meshes.reserve(drawMeshes_.size());
+	// opaqueはマテリアルに依存しないので、全て同じディスクリプタで描画する
+	auto SetupItem = [&](DrawSortItem& item, sl12::u32 materialIndex)
+	{
+		auto material = materials[materialIndex].pResMaterial;
+		item.psoIndex = 0;
+		item.materialIndex = 0;
+		item.vertexLayout = 0;
+		if (material->blendType == sl12::ResourceMeshMaterialBlendType::Masked)
+		{
+			item.psoIndex = material->cullMode == sl12::ResourceMeshMaterialCullMode::None ? 2 : 1;
+			item.materialIndex = materialIndex + 1;
+			item.vertexLayout = 1;
+		}
+	};
+	// 描画リストはメッシュリソース順に並んでいる
+	for (auto&& bucket : buckets)
+	{
+		if (meshes.empty() || meshes.back() != bucket.resMesh)
+		{
+			meshes.push_back(bucket.resMesh);
+		}
+		if (bucket.argCount == 0)
+		{
+			continue;
+		}
+
+		DrawSortItem item;
+		SetupItem(item, bucket.materialIndex);
+		// マスクはカリングで全インスタンスの描画リストに詰められるので、ここでは描画しない
+		if (bMaskedDrawList_ && item.materialIndex > 0)
+		{
+			continue;
+		}
+		item.meshIndex = (sl12::u32)meshes.size() - 1;
+		item.instanceIndex = 0;
+		item.argIndex = bucket.argStart;
+		item.argCount = bucket.argCount;
+		item.key = MakeDrawSortKey(item.psoIndex, item.materialIndex, item.meshIndex, item.instanceIndex);
+		items.push_back(item);
+	}
+	SortDrawItems(items.data(), items.size());
+
+	// 比較用に、インスタンス順にサブメッシュごとに描画した場合のステート変更数を数える
+	// インスタンスごとに定数バッファを設定していた
+	// 直前の描画との比較だけなので、メッシュのインデックスはメッシュリソースが変わるたびに進めればよい
+	DrawStateStats instanceOrderStats;
+	{
+		auto&& instances = pMR->GetMeshInstanceInfos();
+		DrawSortItem prev, curr;
+		const sl12::ResourceItemMesh* prevMesh = nullptr;
+		sl12::u32 meshIndex = 0;
+		sl12::u32 instanceIndex = 0;
+		for (auto&& instance : instances)
+		{
+			if (prevMesh && prevMesh != instance.resMesh)
+			{
+				meshIndex++;
+			}
+			auto resInfo = pMR->GetMeshResInfo(instance.resMesh);
+			for (auto&& submeshInfo : resInfo->nonXluSubmeshInfos)
+			{
+				SetupItem(curr, submeshInfo.materialIndex);
+				curr.meshIndex = meshIndex;
+				curr.instanceIndex = instanceIndex;
+				AddDrawStateChange(GetDrawStateChange(prevMesh ? &prev : nullptr, curr, true), instanceOrderStats);
+				prev = curr;
+				prevMesh = instance.resMesh;
+			}
+			instanceIndex++;
+		}
+	}
+
+	drawItems_ = std::move(items);
+	drawMeshes_ = std::move(meshes);
+	drawInstanceOrderStats_ = instanceOrderStats;
+	drawItemsFrame_ = pScene_->GetFrameIndex();
+}
+
 void VisibilityVsPass::Execute(sl12::CommandList* pCmdList, sl12::TransientResourceManager* pResManager, const sl12::RenderPassID& ID)
 {
-	GPU_MARKER(pCmdList, 0, "VisibilityVsPass");
+	bool b2nd = ID == kVisibilityVs2ndPass;
+
+	GPU_MARKER(pCmdList, 0, b2nd ? "VisibilityVs2ndPass" : "VisibilityVsPass");
 
-	auto pIndirectRes = pResManager->GetRenderGraphResource(kMeshletIndirectArgID);
+	auto pIndirectRes = pResManager->GetRenderGraphResource(b2nd ? kMeshletCompactArg2ndID : kMeshletCompactArgID);
+	auto pCountRes = pResManager->GetRenderGraphResource(b2nd ? kMeshletDrawCount2ndID : kMeshletDrawCountID);
 	auto pVisRes = pResManager->GetRenderGraphResource(kVisBufferID);
 	auto pDepthRes = pResManager->GetRenderGraphResource(kDepthBufferID);
 	auto pVisRTV = pResManager->CreateOrGetRenderTargetView(pVisRes);
 	auto pDepthDSV = pResManager->CreateOrGetDepthStencilView(pDepthRes);
+	auto pMR = pScene_->GetMeshletResource();
+
+	// copy material data for bindless masked draw.
+	sl12::BufferView* pMaterialDataSRV = nullptr;
+	if (bMaskedDrawList_)
+	{
+		const sl12::Buffer* pMaterialDataUpload = pMR->GetMaterialDataUpload();
+		sl12::TransientResourceDesc matResDesc;
+		matResDesc.bIsTexture = false;
+		matResDesc.bufferDesc = pMaterialDataUpload->GetBufferDesc();
+		matResDesc.bufferDesc.heap = sl12::BufferHeap::Default;
+		matResDesc.bufferDesc.usage = sl12::ResourceUsage::ShaderResource;
+		auto pMaterialDataRes = pResManager->CreatePassOnlyResource(matResDesc);
+		pMaterialDataSRV = pResManager->CreateOrGetBufferView(pMaterialDataRes, 0, 0, (sl12::u32)pMaterialDataRes->pBuffer->GetBufferDesc().stride);
+		pCmdList->GetLatestCommandList()->CopyResource(pMaterialDataRes->pBuffer->GetResourceDep(), pMaterialDataUpload->GetResourceDep());
+	}
 	
 	// set render targets.
 	D3D12_CPU_DESCRIPTOR_HANDLE rtv = pVisRTV->GetDescInfo().cpuHandle;
 	D3D12_CPU_DESCRIPTOR_HANDLE dsv = pDepthDSV->GetDescInfo().cpuHandle;
-	pCmdList->GetLatestCommandList()->ClearDepthStencilView(dsv, D3D12_CLEAR_FLAG_DEPTH, 0.0f, 0, 0, nullptr);
+	if (!b2nd)
+	{
+		pCmdList->GetLatestCommandList()->ClearDepthStencilView(dsv, D3D12_CLEAR_FLAG_DEPTH, 0.0f, 0, 0, nullptr);
+	}
 	pCmdList->GetLatestCommandList()->OMSetRenderTargets(1, &rtv, false, &dsv);
 
 	// set viewport.
@@ -303,99 +520,143 @@ void VisibilityVsPass::Execute(sl12::CommandList* pCmdList, sl12::TransientResou
 	pCmdList->GetLatestCommandList()->RSSetScissorRects(1, &rect);
 
 	auto&& TempCB = pScene_->GetTemporalCBs();
+	auto recordStart = std::chrono::high_resolution_clock::now();
 
-	// draw meshes.
-	auto pMR = pScene_->GetMeshletResource();
-	auto&& instances = pMR->GetMeshInstanceInfos();
+	// build draw items.
+	// 通常はPrepareExecuteで他のパスと並列に作成済み (2ndパスは1stパスと共通)
+	if (drawItemsFrame_ != pScene_->GetFrameIndex())
+	{
+		BuildDrawItems();
+	}
 	auto&& materials = pMR->GetWorldMaterials();
-	sl12::u32 meshIndex = 0;
-	sl12::u32 meshletTotal = 0;
-	for (auto&& instance : instances)
+	auto&& items = drawItems_;
+	auto&& meshes = drawMeshes_;
+	DrawStateStats instanceOrderStats = drawInstanceOrderStats_;
+
+	// draw meshes.
+	// インスタンスのデータはルート定数のドローコールから引くので、ディスクリプタはマテリアルが変わるときだけ設定する
+	sl12::GraphicsPipelineState* psoList[] = {
+		&psoOpaque_,
+		&psoMasked_,
+		&psoMaskedDS_,
+	};
+	DrawStateStats sortedStats;
+	const DrawSortItem* pPrev = nullptr;
+	for (auto&& item : items)
 	{
-		// set descriptors.
-		sl12::DescriptorSet descSet;
-		descSet.Reset();
-		descSet.SetVsCbv(0, TempCB.hSceneCB.GetCBV()->GetDescInfo().cpuHandle);
-		descSet.SetPsCbv(0, TempCB.hSceneCB.GetCBV()->GetDescInfo().cpuHandle);
-		descSet.SetVsCbv(1, TempCB.hMeshCBs[meshIndex].GetCBV()->GetDescInfo().cpuHandle);
+		sl12::u32 change = GetDrawStateChange(pPrev, item, false);
 
 		// set pipeline.
-		pCmdList->GetLatestCommandList()->SetPipelineState(psoOpaque_->GetPSO());
-		pCmdList->GetLatestCommandList()->IASetPrimitiveTopology(D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
-
-		auto resMesh = instance.meshInstance.lock()->GetParentResource();
-		auto resInfo = pMR->GetMeshResInfo(resMesh);
-
-		// set vertex buffer.
-		const D3D12_VERTEX_BUFFER_VIEW vbvs[] = {
-			sl12::MeshManager::CreateVertexView(resMesh->GetPositionHandle(), 0, 0, sl12::ResourceItemMesh::GetPositionStride()),
-		};
-		pCmdList->GetLatestCommandList()->IASetVertexBuffers(0, ARRAYSIZE(vbvs), vbvs);
+		if (change & kDrawStatePso)
+		{
+			pCmdList->GetLatestCommandList()->SetPipelineState(psoList[item.psoIndex]->GetPSO());
+			pCmdList->GetLatestCommandList()->IASetPrimitiveTopology(D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
+		}
 
-		// set index buffer.
-		auto ibv = sl12::MeshManager::CreateIndexView(resMesh->GetIndexHandle(), 0, 0, sl12::ResourceItemMesh::GetIndexStride());
-		pCmdList->GetLatestCommandList()->IASetIndexBuffer(&ibv);
+		// set vertex buffer and index buffer.
+		if (change & kDrawStateVertexBuffer)
+		{
+			auto resMesh = meshes[item.meshIndex];
+			const D3D12_VERTEX_BUFFER_VIEW vbvs[] = {
+				sl12::MeshManager::CreateVertexView(resMesh->GetPositionHandle(), 0, 0, sl12::ResourceItemMesh::GetPositionStride()),
+				sl12::MeshManager::CreateVertexView(resMesh->GetTexcoordHandle(), 0, 0, sl12::ResourceItemMesh::GetTexcoordStride()),
+			};
+			pCmdList->GetLatestCommandList()->IASetVertexBuffers(0, item.vertexLayout == 0 ? 1 : ARRAYSIZE(vbvs), vbvs);
+
+			auto ibv = sl12::MeshManager::CreateIndexView(resMesh->GetIndexHandle(), 0, 0, sl12::ResourceItemMesh::GetIndexStride());
+			pCmdList->GetLatestCommandList()->IASetIndexBuffer(&ibv);
+		}
 
-		pCmdList->SetGraphicsRootSignatureAndDescriptorSet(&rs_, &descSet);
+		// set descriptors.
+		if (change & kDrawStateDescriptor)
+		{
+			sl12::DescriptorSet descSet;
+			descSet.Reset();
+			descSet.SetVsCbv(0, TempCB.hSceneCB.GetCBV()->GetDescInfo().cpuHandle);
+			descSet.SetVsSrv(0, pMR->GetInstanceSRV()->GetDescInfo().cpuHandle);
+			descSet.SetVsSrv(1, pMR->GetDrawCallSRV()->GetDescInfo().cpuHandle);
+			descSet.SetPsCbv(0, TempCB.hSceneCB.GetCBV()->GetDescInfo().cpuHandle);
+			if (item.materialIndex > 0)
+			{
+				auto material = materials[item.materialIndex - 1].pResMaterial;
+				auto bc_tex_view = GetTextureView(material->baseColorTex, pDevice_->GetDummyTextureView(sl12::DummyTex::Black));
+				descSet.SetPsSrv(0, bc_tex_view->GetDescInfo().cpuHandle);
+				descSet.SetPsSampler(0, pRenderSystem_->GetLinearWrapSampler()->GetDescInfo().cpuHandle);
+			}
+			pCmdList->SetGraphicsRootSignatureAndDescriptorSet(&rs_, &descSet);
+		}
 
-		// opaque.
 		pCmdList->GetLatestCommandList()->ExecuteIndirect(
 			indirectExec_->GetCommandSignature(),			// command signature
-			resInfo->meshletCount[0],						// max command count
+			item.argCount,									// max command count
 			pIndirectRes->pBuffer->GetResourceDep(),		// argument buffer
-			indirectExec_->GetStride() * meshletTotal,		// argument buffer offset
-			nullptr,										// count buffer
-			0);								// count buffer offset
-		meshletTotal += resInfo->meshletCount[0];
+			indirectExec_->GetStride() * item.argIndex,		// argument buffer offset
+			pCountRes->pBuffer->GetResourceDep(),			// count buffer
+			sizeof(sl12::u32) * item.argIndex);				// count buffer offset
 
-		// masked.
+		AddDrawStateChange(change, sortedStats);
+		pPrev = &item;
+	}
+
+	// draw masked meshlets of all instances.
+	// 裏面カリングと両面、それぞれアルファテストの有無で4回のExecuteIndirectで描画する
+	if (bMaskedDrawList_)
+	{
+		auto pMaskedArgRes = pResManager->GetRenderGraphResource(b2nd ? kMaskedDrawArg2ndID : kMaskedDrawArgID);
+		auto pMaskedCountRes = pResManager->GetRenderGraphResource(b2nd ? kMaskedDrawCount2ndID : kMaskedDrawCountID);
+		auto&& meshMan = pRenderSystem_->GetMeshManager();
+
+		sl12::DescriptorSet descSet;
 		descSet.Reset();
 		descSet.SetVsCbv(0, TempCB.hSceneCB.GetCBV()->GetDescInfo().cpuHandle);
-		descSet.SetPsCbv(0, TempCB.hSceneCB.GetCBV()->GetDescInfo().cpuHandle);
-		descSet.SetVsCbv(1, TempCB.hMeshCBs[meshIndex].GetCBV()->GetDescInfo().cpuHandle);
+		descSet.SetVsSrv(0, pMR->GetInstanceSRV()->GetDescInfo().cpuHandle);
+		descSet.SetVsSrv(1, pMR->GetDrawCallSRV()->GetDescInfo().cpuHandle);
+		descSet.SetVsSrv(2, pMR->GetSubmeshSRV()->GetDescInfo().cpuHandle);
+		descSet.SetVsSrv(3, pMR->GetMeshletSRV()->GetDescInfo().cpuHandle);
+		descSet.SetVsSrv(4, meshMan->GetVertexBufferSRV()->GetDescInfo().cpuHandle);
+		descSet.SetVsSrv(5, meshMan->GetIndexBufferSRV()->GetDescInfo().cpuHandle);
+		descSet.SetPsSrv(0, pMaterialDataSRV->GetDescInfo().cpuHandle);
 		descSet.SetPsSampler(0, pRenderSystem_->GetLinearWrapSampler()->GetDescInfo().cpuHandle);
 
-		// set vertex buffer.
-		const D3D12_VERTEX_BUFFER_VIEW maskedVbvs[] = {
-			sl12::MeshManager::CreateVertexView(resMesh->GetPositionHandle(), 0, 0, sl12::ResourceItemMesh::GetPositionStride()),
-			sl12::MeshManager::CreateVertexView(resMesh->GetTexcoordHandle(), 0, 0, sl12::ResourceItemMesh::GetTexcoordStride()),
-		};
-		pCmdList->GetLatestCommandList()->IASetVertexBuffers(0, ARRAYSIZE(maskedVbvs), maskedVbvs);
+		pCmdList->SetGraphicsRootSignatureAndDescriptorSet(&rsBindless_, &descSet, &pMR->GetBindlessTextureArrays());
 
-		sl12::GraphicsPipelineState* NowPSO = nullptr;
-		auto&& submeshes = resMesh->GetSubmeshes();
-		for (sl12::u32 i = 0; i < resInfo->submeshCount[1]; i++)
+		sl12::GraphicsPipelineState* psoBindlessList[] = {
+			&psoBindless_,
+			&psoBindlessDS_,
+			&psoBindlessOpaque_,
+			&psoBindlessOpaqueDS_,
+		};
+		static_assert(ARRAYSIZE(psoBindlessList) == MASKED_DRAW_LIST_COUNT, "masked draw list count mismatch.");
+		sl12::u32 listCapacity = pMR->GetDrawCallCapacity();
+		for (sl12::u32 list = 0; list < MASKED_DRAW_LIST_COUNT; list++)
 		{
-			sl12::u32 submeshIndex = resInfo->submeshCount[0] + i;
-			auto submeshInfo = resInfo->nonXluSubmeshInfos[submeshIndex];
-			auto material = materials[submeshInfo.materialIndex].pResMaterial;
-
-			auto bc_tex_view = GetTextureView(material->baseColorTex, pDevice_->GetDummyTextureView(sl12::DummyTex::Black));
-			descSet.SetPsSrv(0, bc_tex_view->GetDescInfo().cpuHandle);
-			
-			// set pipeline.
-			sl12::GraphicsPipelineState* pso = material->cullMode == sl12::ResourceMeshMaterialCullMode::None ? &psoMaskedDS_ : &psoMasked_;
-			if (pso != NowPSO)
-			{
-				pCmdList->GetLatestCommandList()->SetPipelineState(pso->GetPSO());
-				pCmdList->GetLatestCommandList()->IASetPrimitiveTopology(D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
-				NowPSO = pso;
-			}
-			pCmdList->SetGraphicsRootSignatureAndDescriptorSet(&rs_, &descSet);
+			pCmdList->GetLatestCommandList()->SetPipelineState(psoBindlessList[list]->GetPSO());
+			pCmdList->GetLatestCommandList()->IASetPrimitiveTopology(D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
 
-			sl12::u32 meshletCnt = (sl12::u32)submeshes[submeshInfo.submeshIndex].meshlets.size();
 			pCmdList->GetLatestCommandList()->ExecuteIndirect(
-				indirectExec_->GetCommandSignature(),			// command signature
-				meshletCnt,										// max command count
-				pIndirectRes->pBuffer->GetResourceDep(),		// argument buffer
-				indirectExec_->GetStride() * meshletTotal,		// argument buffer offset
-				nullptr,										// count buffer
-				0);								// count buffer offset
-			meshletTotal += meshletCnt;
+				indirectExecBindless_->GetCommandSignature(),			// command signature
+				listCapacity,											// max command count
+				pMaskedArgRes->pBuffer->GetResourceDep(),				// argument buffer
+				indirectExecBindless_->GetStride() * listCapacity * list,	// argument buffer offset
+				pMaskedCountRes->pBuffer->GetResourceDep(),				// count buffer
+				sizeof(sl12::u32) * list);								// count buffer offset
+
+			AddDrawStateChange(kDrawStatePso | (list == 0 ? kDrawStateDescriptor : 0), sortedStats);
 		}
+	}
+	auto recordEnd = std::chrono::high_resolution_clock::now();
+	double recordMicroSec = (double)std::chrono::duration_cast<std::chrono::microseconds>(recordEnd - recordStart).count();
 
-		meshIndex++;
+	// 2ndパスは1stパスに加算する
+	auto&& stats = pScene_->GetDrawSortStats();
+	if (!b2nd)
+	{
+		stats.visibilityInstanceOrder = DrawStateStats();
+		stats.visibilitySorted = DrawStateStats();
 	}
+	AddDrawStateStats(instanceOrderStats, stats.visibilityInstanceOrder);
+	AddDrawStateStats(sortedStats, stats.visibilitySorted);
+	pScene_->GetDrawRecordStats().visibility.Add(recordMicroSec, sortedStats.executeCount, !b2nd);
 }
 
 
@@ -511,11 +772,9 @@ std::vector<sl12::TransientResource> VisibilityMsPass::GetInputResources(const s
 	bool b1st = ID == kVisibilityMs1stPass;
 
 	std::vector<sl12::TransientResource> ret;
+	ret.reserve(2);
 	
 	ret.push_back(sl12::TransientResource(sl12::TransientResourceID(kHiZID, b1st ? 1 : 0), sl12::TransientState::ShaderResource));
-	ret.push_back(sl12::TransientResource(kSubmeshBufferID, sl12::TransientState::ShaderResource));
-	ret.push_back(sl12::TransientResource(kMeshletBufferID, sl12::TransientState::ShaderResource));
-	ret.push_back(sl12::TransientResource(kDrawCallBufferID, sl12::TransientState::ShaderResource));
 	if (b1st)
 	{}
 	else
@@ -531,6 +790,7 @@ std::vector<sl12::TransientResource> VisibilityMsPass::GetOutputResources(const
 	bool b1st = ID == kVisibilityMs1stPass;
 
 	std::vector<sl12::TransientResource> ret;
+	ret.reserve(3);
 
 	sl12::TransientResource vis(kVisBufferID, sl12::TransientState::RenderTarget);
 	sl12::TransientResource depth(kDepthBufferID, sl12::TransientState::DepthStencil);
@@ -552,12 +812,8 @@ std::vector<sl12::TransientResource> VisibilityMsPass::GetOutputResources(const
 	if (b1st)
 	{
 		sl12::TransientResource flag(kDrawFlagID, sl12::TransientState::UnorderedAccess);
-		size_t totalMeshlets = 0;
-		for (auto&& instance : pScene_->GetMeshletResource()->GetMeshInstanceInfos())
-		{
-			auto resInfo = pScene_->GetMeshletResource()->GetMeshResInfo(instance.meshInstance.lock()->GetParentResource());
-			totalMeshlets += resInfo->meshletCount[0] + resInfo->meshletCount[1];
-		}
+		// フラグはIndirectArgのインデックスで参照されるので、空き領域も含めた容量分確保する
+		size_t totalMeshlets = pScene_->GetMeshletResource()->GetDrawCallCapacity();
 		flag.desc.bIsTexture = false;
 		flag.desc.bufferDesc.InitializeByteAddress(totalMeshlets * 4, 0);
 		ret.push_back(flag);
@@ -574,16 +830,13 @@ void VisibilityMsPass::Execute(sl12::CommandList* pCmdList, sl12::TransientResou
 	GPU_MARKER(pCmdList, 0, b1st ? "VisibilityMs1stPass" : "VisibilityMs2ndPass");
 
 	auto pHiZRes = pResManager->GetRenderGraphResource(sl12::TransientResourceID(kHiZID, b1st ? 1 : 0));
-	auto pSubmeshRes = pResManager->GetRenderGraphResource(kSubmeshBufferID);
-	auto pMeshletRes = pResManager->GetRenderGraphResource(kMeshletBufferID);
-	auto pDrawCallRes = pResManager->GetRenderGraphResource(kDrawCallBufferID);
 	auto pVisRes = pResManager->GetRenderGraphResource(kVisBufferID);
 	auto pDepthRes = pResManager->GetRenderGraphResource(kDepthBufferID);
 	auto pDrawFlagRes = pResManager->GetRenderGraphResource(kDrawFlagID);
 
-	auto pSubmeshSRV = pResManager->CreateOrGetBufferView(pSubmeshRes, 0, 0, (sl12::u32)pSubmeshRes->pBuffer->GetBufferDesc().stride);
-	auto pMeshletSRV = pResManager->CreateOrGetBufferView(pMeshletRes, 0, 0, (sl12::u32)pMeshletRes->pBuffer->GetBufferDesc().stride);
-	auto pDrawCallSRV = pResManager->CreateOrGetBufferView(pDrawCallRes, 0, 0, (sl12::u32)pDrawCallRes->pBuffer->GetBufferDesc().stride);
+	auto pSubmeshSRV = pScene_->GetMeshletResource()->GetSubmeshSRV();
+	auto pMeshletSRV = pScene_->GetMeshletResource()->GetMeshletSRV();
+	auto pDrawCallSRV = pScene_->GetMeshletResource()->GetDrawCallSRV();
 	auto pVisRTV = pResManager->CreateOrGetRenderTargetView(pVisRes);
 	auto pDepthDSV = pResManager->CreateOrGetDepthStencilView(pDepthRes);
 	
@@ -657,12 +910,19 @@ void VisibilityMsPass::Execute(sl12::CommandList* pCmdList, sl12::TransientResou
 	auto pMR = pScene_->GetMeshletResource();
 	auto&& instances = pMR->GetMeshInstanceInfos();
 	auto&& materials = pMR->GetWorldMaterials();
-	sl12::u32 meshletTotal = 0;
 	sl12::u32 instanceIndex = 0;
 	for (auto&& instance : instances)
 	{
-		auto resMesh = instance.meshInstance.lock()->GetParentResource();
+		// ソフトウェアオクルージョンで隠れたインスタンスは描画しない
+		if (pScene_->IsSoftwareOccluded(instanceIndex))
+		{
+			instanceIndex++;
+			continue;
+		}
+
+		auto resMesh = instance.resMesh;
 		auto resInfo = pMR->GetMeshResInfo(resMesh);
+		sl12::u32 meshletTotal = instance.argIndex[0];
 		
 		const sl12::BufferView* pMeshletBoundSrv = pMR->GetMeshletBoundsSRV(resMesh);
 
@@ -673,6 +933,7 @@ void VisibilityMsPass::Execute(sl12::CommandList* pCmdList, sl12::TransientResou
 		cb.meshletCount = meshletCnt;
 		cb.meshletStartIndex = meshletTotal;
 		cb.localMeshletIndex = 0;
+		cb.maskedListCapacity = 0;
 		cb.argStartAddress = meshletTotal * kIndirectArgsBufferStride;
 		sl12::CbvHandle hCB = cbvMan->GetTemporal(&cb, sizeof(cb));
 
@@ -690,7 +951,6 @@ void VisibilityMsPass::Execute(sl12::CommandList* pCmdList, sl12::TransientResou
 		const UINT kLaneCount = 32;
 		UINT dispatchCnt = (meshletCnt + kLaneCount - 1) / kLaneCount;
 		pCmdList->GetLatestCommandList()->DispatchMesh(dispatchCnt, 1, 1);
-		meshletTotal += meshletCnt;
 
 		// masked.
 		sl12::GraphicsPipelineState* NowPSO = nullptr;
@@ -784,12 +1044,10 @@ MaterialDepthPass::~MaterialDepthPass()
 std::vector<sl12::TransientResource> MaterialDepthPass::GetInputResources(const sl12::RenderPassID& ID) const
 {
 	std::vector<sl12::TransientResource> ret;
+	ret.reserve(2);
 
 	ret.push_back(sl12::TransientResource(kVisBufferID, sl12::TransientState::ShaderResource));
 	ret.push_back(sl12::TransientResource(kDepthBufferID, sl12::TransientState::ShaderResource));
-	ret.push_back(sl12::TransientResource(kSubmeshBufferID, sl12::TransientState::ShaderResource));
-	ret.push_back(sl12::TransientResource(kMeshletBufferID, sl12::TransientState::ShaderResource));
-	ret.push_back(sl12::TransientResource(kDrawCallBufferID, sl12::TransientState::ShaderResource));
 	
 	return ret;
 }
@@ -817,15 +1075,12 @@ void MaterialDepthPass::Execute(sl12::CommandList* pCmdList, sl12::TransientReso
 
 	auto pVisRes = pResManager->GetRenderGraphResource(kVisBufferID);
 	auto pDepthRes = pResManager->GetRenderGraphResource(kDepthBufferID);
-	auto pSubmeshRes = pResManager->GetRenderGraphResource(kSubmeshBufferID);
-	auto pMeshletRes = pResManager->GetRenderGraphResource(kMeshletBufferID);
-	auto pDrawCallRes = pResManager->GetRenderGraphResource(kDrawCallBufferID);
 	auto pMatDepthRes = pResManager->GetRenderGraphResource(kMaterialDepthID);
 	auto pVisSRV = pResManager->CreateOrGetTextureView(pVisRes);
 	auto pDepthSRV = pResManager->CreateOrGetTextureView(pDepthRes);
-	auto pSubmeshSRV = pResManager->CreateOrGetBufferView(pSubmeshRes, 0, 0, (sl12::u32)pSubmeshRes->pBuffer->GetBufferDesc().stride);
-	auto pMeshletSRV = pResManager->CreateOrGetBufferView(pMeshletRes, 0, 0, (sl12::u32)pMeshletRes->pBuffer->GetBufferDesc().stride);
-	auto pDrawCallSRV = pResManager->CreateOrGetBufferView(pDrawCallRes, 0, 0, (sl12::u32)pDrawCallRes->pBuffer->GetBufferDesc().stride);
+	auto pSubmeshSRV = pScene_->GetMeshletResource()->GetSubmeshSRV();
+	auto pMeshletSRV = pScene_->GetMeshletResource()->GetMeshletSRV();
+	auto pDrawCallSRV = pScene_->GetMeshletResource()->GetDrawCallSRV();
 	auto pMatDepthDSV = pResManager->CreateOrGetDepthStencilView(pMatDepthRes);
 	
 	D3D12_CPU_DESCRIPTOR_HANDLE dsv = pMatDepthDSV->GetDescInfo().cpuHandle;
@@ -871,8 +1126,10 @@ ClassifyPass::ClassifyPass(sl12::Device* pDev, RenderSystem* pRenderSys, Scene*
 	: AppPassBase(pDev, pRenderSys, pScene)
 {
 	rs_ = sl12::MakeUnique<sl12::RootSignature>(pDev);
-	psoClear_ = sl12::MakeUnique<sl12::ComputePipelineState>(pDev);
+	psoInit_ = sl12::MakeUnique<sl12::ComputePipelineState>(pDev);
 	psoClassify_ = sl12::MakeUnique<sl12::ComputePipelineState>(pDev);
+	psoScan_ = sl12::MakeUnique<sl12::ComputePipelineState>(pDev);
+	psoScatter_ = sl12::MakeUnique<sl12::ComputePipelineState>(pDev);
 
 	// init root signature.
 	rs_->Initialize(pDev, pRenderSys->GetShader(ShaderName::ClassifyC));
@@ -891,11 +1148,31 @@ ClassifyPass::ClassifyPass(sl12::Device* pDev, RenderSystem* pRenderSys, Scene*
 	{
 		sl12::ComputePipelineStateDesc desc{};
 		desc.pRootSignature = &rs_;
-		desc.pCS = pRenderSys->GetShader(ShaderName::ClearArgC);
+		desc.pCS = pRenderSys->GetShader(ShaderName::ClassifyInitC);
+
+		if (!psoInit_->Initialize(pDevice_, desc))
+		{
+			sl12::ConsolePrint("Error: failed to init classify init pso.");
+		}
+	}
+	{
+		sl12::ComputePipelineStateDesc desc{};
+		desc.pRootSignature = &rs_;
+		desc.pCS = pRenderSys->GetShader(ShaderName::ClassifyScanC);
 
-		if (!psoClear_->Initialize(pDevice_, desc))
+		if (!psoScan_->Initialize(pDevice_, desc))
 		{
-			sl12::ConsolePrint("Error: failed to init clear arg pso.");
+			sl12::ConsolePrint("Error: failed to init classify scan pso.");
+		}
+	}
+	{
+		sl12::ComputePipelineStateDesc desc{};
+		desc.pRootSignature = &rs_;
+		desc.pCS = pRenderSys->GetShader(ShaderName::ClassifyScatterC);
+
+		if (!psoScatter_->Initialize(pDevice_, desc))
+		{
+			sl12::ConsolePrint("Error: failed to init classify scatter pso.");
 		}
 	}
 }
@@ -903,19 +1180,19 @@ ClassifyPass::ClassifyPass(sl12::Device* pDev, RenderSystem* pRenderSys, Scene*
 ClassifyPass::~ClassifyPass()
 {
 	psoClassify_.Reset();
-	psoClear_.Reset();
+	psoInit_.Reset();
+	psoScan_.Reset();
+	psoScatter_.Reset();
 	rs_.Reset();
 }
 
 std::vector<sl12::TransientResource> ClassifyPass::GetInputResources(const sl12::RenderPassID& ID) const
 {
 	std::vector<sl12::TransientResource> ret;
+	ret.reserve(2);
 
 	ret.push_back(sl12::TransientResource(kVisBufferID, sl12::TransientState::ShaderResource));
 	ret.push_back(sl12::TransientResource(kDepthBufferID, sl12::TransientState::ShaderResource));
-	ret.push_back(sl12::TransientResource(kSubmeshBufferID, sl12::TransientState::ShaderResource));
-	ret.push_back(sl12::TransientResource(kMeshletBufferID, sl12::TransientState::ShaderResource));
-	ret.push_back(sl12::TransientResource(kDrawCallBufferID, sl12::TransientState::ShaderResource));
 	
 	return ret;
 }
@@ -923,22 +1200,29 @@ std::vector<sl12::TransientResource> ClassifyPass::GetInputResources(const sl12:
 std::vector<sl12::TransientResource> ClassifyPass::GetOutputResources(const sl12::RenderPassID& ID) const
 {
 	std::vector<sl12::TransientResource> ret;
+	ret.reserve(3);
 
 	sl12::TransientResource arg(kTileArgBufferID, sl12::TransientState::UnorderedAccess);
 	sl12::TransientResource index(kTileIndexBufferID, sl12::TransientState::UnorderedAccess);
+	sl12::TransientResource offset(kTileOffsetBufferID, sl12::TransientState::UnorderedAccess);
 
 	auto&& worldMaterials = pScene_->GetMeshletResource()->GetWorldMaterials();
 	UINT tileXCount = (pScene_->GetScreenWidth() + CLASSIFY_TILE_WIDTH - 1) / CLASSIFY_TILE_WIDTH;
 	UINT tileYCount = (pScene_->GetScreenHeight() + CLASSIFY_TILE_WIDTH - 1) / CLASSIFY_TILE_WIDTH;
 	UINT tileMax = tileXCount * tileYCount;
+	UINT listStride = std::min<UINT>((UINT)worldMaterials.size(), CLASSIFY_TILE_MATERIAL_MAX);
 
+	// マテリアルごとのタイルリストは詰めて格納するので、タイル数 x マテリアル数は不要
 	arg.desc.bIsTexture = false;
 	arg.desc.bufferDesc.InitializeByteAddress(sizeof(D3D12_DRAW_ARGUMENTS) * worldMaterials.size(), 0);
 	index.desc.bIsTexture = false;
-	index.desc.bufferDesc.InitializeByteAddress(sizeof(sl12::u32) * tileMax * worldMaterials.size(), 0);
+	index.desc.bufferDesc.InitializeByteAddress(sizeof(sl12::u32) * tileMax * listStride, 0);
+	offset.desc.bIsTexture = false;
+	offset.desc.bufferDesc.InitializeStructured(sizeof(sl12::u32), worldMaterials.size(), 0);
 
 	ret.push_back(arg);
 	ret.push_back(index);
+	ret.push_back(offset);
 	
 	return ret;
 }
@@ -947,40 +1231,59 @@ void ClassifyPass::Execute(sl12::CommandList* pCmdList, sl12::TransientResourceM
 {
 	GPU_MARKER(pCmdList, 0, "ClassifyPass");
 
+	UINT x = (pScene_->GetScreenWidth() + CLASSIFY_TILE_WIDTH - 1) / CLASSIFY_TILE_WIDTH;
+	UINT y = (pScene_->GetScreenHeight() + CLASSIFY_TILE_WIDTH - 1) / CLASSIFY_TILE_WIDTH;
+	sl12::u32 materialMax = (sl12::u32)pScene_->GetMeshletResource()->GetWorldMaterials().size();
+	sl12::u32 listStride = std::min<sl12::u32>(materialMax, CLASSIFY_TILE_MATERIAL_MAX);
+	sl12::u32 numBlocks = (materialMax + PREFIX_SCAN_BLOCK_SIZE - 1) / PREFIX_SCAN_BLOCK_SIZE;
+	if (materialMax > CLASSIFY_MATERIAL_MAX)
+	{
+		sl12::ConsolePrint("Error: too many materials for classify. (%u > %u)\n", materialMax, CLASSIFY_MATERIAL_MAX);
+		return;
+	}
+
 	auto pVisRes = pResManager->GetRenderGraphResource(kVisBufferID);
 	auto pDepthRes = pResManager->GetRenderGraphResource(kDepthBufferID);
-	auto pSubmeshRes = pResManager->GetRenderGraphResource(kSubmeshBufferID);
-	auto pMeshletRes = pResManager->GetRenderGraphResource(kMeshletBufferID);
-	auto pDrawCallRes = pResManager->GetRenderGraphResource(kDrawCallBufferID);
 	auto pTileArgRes = pResManager->GetRenderGraphResource(kTileArgBufferID);
 	auto pTileIndexRes = pResManager->GetRenderGraphResource(kTileIndexBufferID);
+	auto pTileOffsetRes = pResManager->GetRenderGraphResource(kTileOffsetBufferID);
 	auto pVisSRV = pResManager->CreateOrGetTextureView(pVisRes);
 	auto pDepthSRV = pResManager->CreateOrGetTextureView(pDepthRes);
-	auto pSubmeshSRV = pResManager->CreateOrGetBufferView(pSubmeshRes, 0, 0, (sl12::u32)pSubmeshRes->pBuffer->GetBufferDesc().stride);
-	auto pMeshletSRV = pResManager->CreateOrGetBufferView(pMeshletRes, 0, 0, (sl12::u32)pMeshletRes->pBuffer->GetBufferDesc().stride);
-	auto pDrawCallSRV = pResManager->CreateOrGetBufferView(pDrawCallRes, 0, 0, (sl12::u32)pDrawCallRes->pBuffer->GetBufferDesc().stride);
+	auto pSubmeshSRV = pScene_->GetMeshletResource()->GetSubmeshSRV();
+	auto pMeshletSRV = pScene_->GetMeshletResource()->GetMeshletSRV();
+	auto pDrawCallSRV = pScene_->GetMeshletResource()->GetDrawCallSRV();
 	auto pTileArgUAV = pResManager->CreateOrGetUnorderedAccessBufferView(pTileArgRes, 0, 0, 0, 0);
 	auto pTileIndexUAV = pResManager->CreateOrGetUnorderedAccessBufferView(pTileIndexRes, 0, 0, 0, 0);
+	auto pTileOffsetUAV = pResManager->CreateOrGetUnorderedAccessBufferView(pTileOffsetRes, 0, 0, sizeof(sl12::u32), 0);
 
-	UINT x = (pScene_->GetScreenWidth() + CLASSIFY_TILE_WIDTH - 1) / CLASSIFY_TILE_WIDTH;
-	UINT y = (pScene_->GetScreenHeight() + CLASSIFY_TILE_WIDTH - 1) / CLASSIFY_TILE_WIDTH;
-	sl12::u32 materialMax = (sl12::u32)pScene_->GetMeshletResource()->GetWorldMaterials().size();
+	// pass only resources.
+	// タイルごとの疎なマテリアルリストと、プレフィックススキャンのステータス
+	sl12::TransientResourceDesc ListDesc, CountDesc, FillDesc, StatusDesc, BlockDesc;
+	ListDesc.bIsTexture = false;
+	ListDesc.bufferDesc.InitializeStructured(sizeof(sl12::u32), x * y * listStride, sl12::ResourceUsage::UnorderedAccess);
+	CountDesc.bIsTexture = false;
+	CountDesc.bufferDesc.InitializeStructured(sizeof(sl12::u32), x * y, sl12::ResourceUsage::UnorderedAccess);
+	FillDesc.bIsTexture = false;
+	FillDesc.bufferDesc.InitializeStructured(sizeof(sl12::u32), materialMax, sl12::ResourceUsage::UnorderedAccess);
+	StatusDesc.bIsTexture = false;
+	StatusDesc.bufferDesc.InitializeStructured(PREFIX_SCAN_STATUS_STRIDE, numBlocks, sl12::ResourceUsage::UnorderedAccess);
+	BlockDesc.bIsTexture = false;
+	BlockDesc.bufferDesc.InitializeStructured(sizeof(sl12::u32), 1, sl12::ResourceUsage::UnorderedAccess);
 
-	// set descriptors.
-	sl12::DescriptorSet descSet;
-	descSet.Reset();
-	descSet.SetCsCbv(0, pScene_->GetTemporalCBs().hTileCB.GetCBV()->GetDescInfo().cpuHandle);
-	descSet.SetCsUav(0, pTileArgUAV->GetDescInfo().cpuHandle);
+	auto pListB = pResManager->CreatePassOnlyResource(ListDesc);
+	auto pCountB = pResManager->CreatePassOnlyResource(CountDesc);
+	auto pFillB = pResManager->CreatePassOnlyResource(FillDesc);
+	auto pStatusB = pResManager->CreatePassOnlyResource(StatusDesc);
+	auto pBlockB = pResManager->CreatePassOnlyResource(BlockDesc);
 
-	// set pipeline.
-	pCmdList->GetLatestCommandList()->SetPipelineState(psoClear_->GetPSO());
-	pCmdList->SetComputeRootSignatureAndDescriptorSet(&rs_, &descSet);
+	auto pListUAV = pResManager->CreateOrGetUnorderedAccessBufferView(pListB, 0, 0, sizeof(sl12::u32), 0);
+	auto pCountUAV = pResManager->CreateOrGetUnorderedAccessBufferView(pCountB, 0, 0, sizeof(sl12::u32), 0);
+	auto pFillUAV = pResManager->CreateOrGetUnorderedAccessBufferView(pFillB, 0, 0, sizeof(sl12::u32), 0);
+	auto pStatusUAV = pResManager->CreateOrGetUnorderedAccessBufferView(pStatusB, 0, 0, PREFIX_SCAN_STATUS_STRIDE, 0);
+	auto pBlockUAV = pResManager->CreateOrGetUnorderedAccessBufferView(pBlockB, 0, 0, sizeof(sl12::u32), 0);
 
-	// dispatch.
-	UINT t = (materialMax + 32 - 1) / 32;
-	pCmdList->GetLatestCommandList()->Dispatch(t, 1, 1);
-			
 	// set descriptors.
+	sl12::DescriptorSet descSet;
 	descSet.Reset();
 	descSet.SetCsCbv(0, pScene_->GetTemporalCBs().hSceneCB.GetCBV()->GetDescInfo().cpuHandle);
 	descSet.SetCsCbv(1, pScene_->GetTemporalCBs().hTileCB.GetCBV()->GetDescInfo().cpuHandle);
@@ -991,13 +1294,76 @@ void ClassifyPass::Execute(sl12::CommandList* pCmdList, sl12::TransientResourceM
 	descSet.SetCsSrv(4, pDepthSRV->GetDescInfo().cpuHandle);
 	descSet.SetCsUav(0, pTileArgUAV->GetDescInfo().cpuHandle);
 	descSet.SetCsUav(1, pTileIndexUAV->GetDescInfo().cpuHandle);
+	descSet.SetCsUav(2, pListUAV->GetDescInfo().cpuHandle);
+	descSet.SetCsUav(3, pCountUAV->GetDescInfo().cpuHandle);
+	descSet.SetCsUav(4, pTileOffsetUAV->GetDescInfo().cpuHandle);
+	descSet.SetCsUav(5, pFillUAV->GetDescInfo().cpuHandle);
+	descSet.SetCsUav(6, pStatusUAV->GetDescInfo().cpuHandle);
+	descSet.SetCsUav(7, pBlockUAV->GetDescInfo().cpuHandle);
 
-	// set pipeline.
-	pCmdList->GetLatestCommandList()->SetPipelineState(psoClassify_->GetPSO());
-	pCmdList->SetComputeRootSignatureAndDescriptorSet(&rs_, &descSet);
+	// initialize.
+	{
+		// set pipeline.
+		pCmdList->GetLatestCommandList()->SetPipelineState(psoInit_->GetPSO());
+		pCmdList->SetComputeRootSignatureAndDescriptorSet(&rs_, &descSet);
+
+		// dispatch.
+		// プレフィックススキャンのステータスもここでクリアする
+		UINT t = (materialMax + 32 - 1) / 32;
+		pCmdList->GetLatestCommandList()->Dispatch(t, 1, 1);
+
+		pCmdList->AddUAVBarrier(pTileArgRes->pBuffer);
+		pCmdList->AddUAVBarrier(pFillB->pBuffer);
+		pCmdList->AddUAVBarrier(pStatusB->pBuffer);
+		pCmdList->AddUAVBarrier(pBlockB->pBuffer);
+		pCmdList->FlushBarriers();
+	}
+
+	// classify.
+	{
+		// set pipeline.
+		pCmdList->GetLatestCommandList()->SetPipelineState(psoClassify_->GetPSO());
+		pCmdList->SetComputeRootSignatureAndDescriptorSet(&rs_, &descSet);
+
+		// dispatch.
+		pCmdList->GetLatestCommandList()->Dispatch(x, y, 1);
+
+		pCmdList->AddUAVBarrier(pTileArgRes->pBuffer);
+		pCmdList->AddUAVBarrier(pListB->pBuffer);
+		pCmdList->AddUAVBarrier(pCountB->pBuffer);
+		pCmdList->FlushBarriers();
+	}
+
+	// prefix sum.
+	// マテリアルごとのタイル数をオフセットに変換する
+	{
+		// set pipeline.
+		pCmdList->GetLatestCommandList()->SetPipelineState(psoScan_->GetPSO());
+		pCmdList->SetComputeRootSignatureAndDescriptorSet(&rs_, &descSet);
+
+		// dispatch.
+		pCmdList->GetLatestCommandList()->Dispatch(numBlocks, 1, 1);
+
+		pCmdList->AddUAVBarrier(pTileOffsetRes->pBuffer);
+		pCmdList->FlushBarriers();
+	}
 
-	// dispatch.
-	pCmdList->GetLatestCommandList()->Dispatch(x, y, 1);
+	// scatter.
+	{
+		// set pipeline.
+		pCmdList->GetLatestCommandList()->SetPipelineState(psoScatter_->GetPSO());
+		pCmdList->SetComputeRootSignatureAndDescriptorSet(&rs_, &descSet);
+
+		// dispatch.
+		pCmdList->GetLatestCommandList()->Dispatch(x, y, 1);
+	}
+
+	// 検証用に入力のバッファと分類結果を読み戻す
+	if (pScene_->IsClassifyReadbackRequested())
+	{
+		pScene_->ReadbackClassify(pCmdList, pVisRes->pTexture, pDepthRes->pTexture,
+			pCountB->pBuffer, pListB->pBuffer, pTileArgRes->pBuffer, pTileOffsetRes->pBuffer, pTileIndexRes->pBuffer);
+	}
 }
 
 
@@ -1069,15 +1435,13 @@ MaterialTilePass::~MaterialTilePass()
 std::vector<sl12::TransientResource> MaterialTilePass::GetInputResources(const sl12::RenderPassID& ID) const
 {
 	std::vector<sl12::TransientResource> ret;
+	ret.reserve(5);
 
 	ret.push_back(sl12::TransientResource(kTileArgBufferID, sl12::TransientState::IndirectArgument));
 	ret.push_back(sl12::TransientResource(kTileIndexBufferID, sl12::TransientState::ShaderResource));
+	ret.push_back(sl12::TransientResource(kTileOffsetBufferID, sl12::TransientState::ShaderResource));
 	ret.push_back(sl12::TransientResource(kVisBufferID, sl12::TransientState::ShaderResource));
 	ret.push_back(sl12::TransientResource(kDepthBufferID, sl12::TransientState::ShaderResource));
-	ret.push_back(sl12::TransientResource(kInstanceBufferID, sl12::TransientState::ShaderResource));
-	ret.push_back(sl12::TransientResource(kSubmeshBufferID, sl12::TransientState::ShaderResource));
-	ret.push_back(sl12::TransientResource(kMeshletBufferID, sl12::TransientState::ShaderResource));
-	ret.push_back(sl12::TransientResource(kDrawCallBufferID, sl12::TransientState::ShaderResource));
 	
 	return ret;
 }
@@ -1085,6 +1449,7 @@ std::vector<sl12::TransientResource> MaterialTilePass::GetInputResources(const s
 std::vector<sl12::TransientResource> MaterialTilePass::GetOutputResources(const sl12::RenderPassID& ID) const
 {
 	std::vector<sl12::TransientResource> ret;
+	ret.reserve(6);
 
 	sl12::TransientResource accum(kLightAccumID, sl12::TransientState::RenderTarget);
 	sl12::TransientResource ga(kGBufferAID, sl12::TransientState::RenderTarget);
@@ -1127,12 +1492,9 @@ void MaterialTilePass::Execute(sl12::CommandList* pCmdList, sl12::TransientResou
 
 	auto pTileArgRes = pResManager->GetRenderGraphResource(kTileArgBufferID);
 	auto pTileIndexRes = pResManager->GetRenderGraphResource(kTileIndexBufferID);
+	auto pTileOffsetRes = pResManager->GetRenderGraphResource(kTileOffsetBufferID);
 	auto pVisRes = pResManager->GetRenderGraphResource(kVisBufferID);
 	auto pDepthRes = pResManager->GetRenderGraphResource(kDepthBufferID);
-	auto pInstanceRes = pResManager->GetRenderGraphResource(kInstanceBufferID);
-	auto pSubmeshRes = pResManager->GetRenderGraphResource(kSubmeshBufferID);
-	auto pMeshletRes = pResManager->GetRenderGraphResource(kMeshletBufferID);
-	auto pDrawCallRes = pResManager->GetRenderGraphResource(kDrawCallBufferID);
 	auto pAccumRes = pResManager->GetRenderGraphResource(kLightAccumID);
 	auto pGbARes = pResManager->GetRenderGraphResource(kGBufferAID);
 	auto pGbBRes = pResManager->GetRenderGraphResource(kGBufferBID);
@@ -1141,12 +1503,13 @@ void MaterialTilePass::Execute(sl12::CommandList* pCmdList, sl12::TransientResou
 	auto pMipRes = pResManager->GetRenderGraphResource(kMiplevelFeedbackID);
 
 	auto pTileIndexSRV = pResManager->CreateOrGetBufferView(pTileIndexRes, 0, 0, (sl12::u32)pTileIndexRes->pBuffer->GetBufferDesc().stride);
+	auto pTileOffsetSRV = pResManager->CreateOrGetBufferView(pTileOffsetRes, 0, 0, (sl12::u32)pTileOffsetRes->pBuffer->GetBufferDesc().stride);
 	auto pVisSRV = pResManager->CreateOrGetTextureView(pVisRes);
 	auto pDepthSRV = pResManager->CreateOrGetTextureView(pDepthRes);
-	auto pInstanceSRV = pResManager->CreateOrGetBufferView(pInstanceRes, 0, 0, (sl12::u32)pInstanceRes->pBuffer->GetBufferDesc().stride);
-	auto pSubmeshSRV = pResManager->CreateOrGetBufferView(pSubmeshRes, 0, 0, (sl12::u32)pSubmeshRes->pBuffer->GetBufferDesc().stride);
-	auto pMeshletSRV = pResManager->CreateOrGetBufferView(pMeshletRes, 0, 0, (sl12::u32)pMeshletRes->pBuffer->GetBufferDesc().stride);
-	auto pDrawCallSRV = pResManager->CreateOrGetBufferView(pDrawCallRes, 0, 0, (sl12::u32)pDrawCallRes->pBuffer->GetBufferDesc().stride);
+	auto pInstanceSRV = pScene_->GetMeshletResource()->GetInstanceSRV();
+	auto pSubmeshSRV = pScene_->GetMeshletResource()->GetSubmeshSRV();
+	auto pMeshletSRV = pScene_->GetMeshletResource()->GetMeshletSRV();
+	auto pDrawCallSRV = pScene_->GetMeshletResource()->GetDrawCallSRV();
 	auto pAccumRTV = pResManager->CreateOrGetRenderTargetView(pAccumRes);
 	auto pGbARTV = pResManager->CreateOrGetRenderTargetView(pGbARes);
 	auto pGbBRTV = pResManager->CreateOrGetRenderTargetView(pGbBRes);
@@ -1190,6 +1553,7 @@ void MaterialTilePass::Execute(sl12::CommandList* pCmdList, sl12::TransientResou
 	descSet.SetVsCbv(0, tempCB.hSceneCB.GetCBV()->GetDescInfo().cpuHandle);
 	descSet.SetVsCbv(1, tempCB.hTileCB.GetCBV()->GetDescInfo().cpuHandle);
 	descSet.SetVsSrv(0, pTileIndexSRV->GetDescInfo().cpuHandle);
+	descSet.SetVsSrv(1, pTileOffsetSRV->GetDescInfo().cpuHandle);
 	descSet.SetPsCbv(0, tempCB.hSceneCB.GetCBV()->GetDescInfo().cpuHandle);
 	descSet.SetPsCbv(1, tempCB.hDetailCB.GetCBV()->GetDescInfo().cpuHandle);
 	descSet.SetPsSrv(0, pVisSRV->GetDescInfo().cpuHandle);
@@ -1308,13 +1672,10 @@ MaterialResolvePass::~MaterialResolvePass()
 std::vector<sl12::TransientResource> MaterialResolvePass::GetInputResources(const sl12::RenderPassID& ID) const
 {
 	std::vector<sl12::TransientResource> ret;
+	ret.reserve(2);
 
 	ret.push_back(sl12::TransientResource(kVisBufferID, sl12::TransientState::ShaderResource));
 	ret.push_back(sl12::TransientResource(kDepthBufferID, sl12::TransientState::ShaderResource));
-	ret.push_back(sl12::TransientResource(kInstanceBufferID, sl12::TransientState::ShaderResource));
-	ret.push_back(sl12::TransientResource(kSubmeshBufferID, sl12::TransientState::ShaderResource));
-	ret.push_back(sl12::TransientResource(kMeshletBufferID, sl12::TransientState::ShaderResource));
-	ret.push_back(sl12::TransientResource(kDrawCallBufferID, sl12::TransientState::ShaderResource));
 	
 	return ret;
 }
@@ -1322,6 +1683,7 @@ std::vector<sl12::TransientResource> MaterialResolvePass::GetInputResources(cons
 std::vector<sl12::TransientResource> MaterialResolvePass::GetOutputResources(const sl12::RenderPassID& ID) const
 {
 	std::vector<sl12::TransientResource> ret;
+	ret.reserve(5);
 
 	sl12::TransientResource accum(kLightAccumID, sl12::TransientState::UnorderedAccess);
 	sl12::TransientResource ga(kGBufferAID, sl12::TransientState::UnorderedAccess);
@@ -1361,10 +1723,6 @@ void MaterialResolvePass::Execute(sl12::CommandList* pCmdList, sl12::TransientRe
 	// input.
 	auto pVisRes = pResManager->GetRenderGraphResource(kVisBufferID);
 	auto pDepthRes = pResManager->GetRenderGraphResource(kDepthBufferID);
-	auto pInstanceRes = pResManager->GetRenderGraphResource(kInstanceBufferID);
-	auto pSubmeshRes = pResManager->GetRenderGraphResource(kSubmeshBufferID);
-	auto pMeshletRes = pResManager->GetRenderGraphResource(kMeshletBufferID);
-	auto pDrawCallRes = pResManager->GetRenderGraphResource(kDrawCallBufferID);
 
 	// output.
 	auto pAccumRes = pResManager->GetRenderGraphResource(kLightAccumID);
@@ -1375,10 +1733,10 @@ void MaterialResolvePass::Execute(sl12::CommandList* pCmdList, sl12::TransientRe
 
 	auto pVisSRV = pResManager->CreateOrGetTextureView(pVisRes);
 	auto pDepthSRV = pResManager->CreateOrGetTextureView(pDepthRes);
-	auto pInstanceSRV = pResManager->CreateOrGetBufferView(pInstanceRes, 0, 0, (sl12::u32)pInstanceRes->pBuffer->GetBufferDesc().stride);
-	auto pSubmeshSRV = pResManager->CreateOrGetBufferView(pSubmeshRes, 0, 0, (sl12::u32)pSubmeshRes->pBuffer->GetBufferDesc().stride);
-	auto pMeshletSRV = pResManager->CreateOrGetBufferView(pMeshletRes, 0, 0, (sl12::u32)pMeshletRes->pBuffer->GetBufferDesc().stride);
-	auto pDrawCallSRV = pResManager->CreateOrGetBufferView(pDrawCallRes, 0, 0, (sl12::u32)pDrawCallRes->pBuffer->GetBufferDesc().stride);
+	auto pInstanceSRV = pScene_->GetMeshletResource()->GetInstanceSRV();
+	auto pSubmeshSRV = pScene_->GetMeshletResource()->GetSubmeshSRV();
+	auto pMeshletSRV = pScene_->GetMeshletResource()->GetMeshletSRV();
+	auto pDrawCallSRV = pScene_->GetMeshletResource()->GetDrawCallSRV();
 	auto pAccumUAV = pResManager->CreateOrGetUnorderedAccessTextureView(pAccumRes);
 	auto pGbAUAV = pResManager->CreateOrGetUnorderedAccessTextureView(pGbARes);
 	auto pGbBUAV = pResManager->CreateOrGetUnorderedAccessTextureView(pGbBRes);
@@ -1401,7 +1759,6 @@ void MaterialResolvePass::Execute(sl12::CommandList* pCmdList, sl12::TransientRe
 	auto pMaterialDataRes = pResManager->CreatePassOnlyResource(wgResDesc);
 	auto pMaterialDataSRV = pResManager->CreateOrGetBufferView(pMaterialDataRes, 0, 0, (sl12::u32)pMaterialDataRes->pBuffer->GetBufferDesc().stride);
 	pCmdList->GetLatestCommandList()->CopyResource(pMaterialDataRes->pBuffer->GetResourceDep(), pMaterialDataUpload->GetResourceDep());
-	pMR->UpdateBindlessTextures(pDevice_);
 
 	sl12::DescriptorSet descSet;
 	descSet.Reset();
@@ -1427,9 +1784,7 @@ void MaterialResolvePass::Execute(sl12::CommandList* pCmdList, sl12::TransientRe
 	// set program.
 	wgContext_->SetProgram(pCmdList, D3D12_SET_WORK_GRAPH_FLAG_INITIALIZE);
 
-	std::vector<std::vector<D3D12_CPU_DESCRIPTOR_HANDLE>> bindlessArrays;
-	bindlessArrays.push_back(pMR->GetBindlessTextures());
-	pCmdList->SetComputeRootSignatureAndDescriptorSet(&rs_, &descSet, &bindlessArrays);
+	pCmdList->SetComputeRootSignatureAndDescriptorSet(&rs_, &descSet, &pMR->GetBindlessTextureArrays());
 
 	// dispatch graph.
 	struct DistributeNodeRecord
@@ -1453,8 +1808,6 @@ MaterialComputeBinningPass::MaterialComputeBinningPass(sl12::Device* pDev, Rende
 	psoInit_ = sl12::MakeUnique<sl12::ComputePipelineState>(pDev);
 	psoCount_ = sl12::MakeUnique<sl12::ComputePipelineState>(pDev);
 	psoCountSum_ = sl12::MakeUnique<sl12::ComputePipelineState>(pDev);
-	psoPrefixSumInit_ = sl12::MakeUnique<sl12::ComputePipelineState>(pDev);
-	psoPrefixSum_ = sl12::MakeUnique<sl12::ComputePipelineState>(pDev);
 	psoBinning_ = sl12::MakeUnique<sl12::ComputePipelineState>(pDev);
 	psoFinalize_ = sl12::MakeUnique<sl12::ComputePipelineState>(pDev);
 
@@ -1492,26 +1845,6 @@ MaterialComputeBinningPass::MaterialComputeBinningPass(sl12::Device* pDev, Rende
 			sl12::ConsolePrint("Error: failed to count sum pso.");
 		}
 	}
-	{
-		sl12::ComputePipelineStateDesc desc{};
-		desc.pRootSignature = &rs_;
-		desc.pCS = pRenderSys->GetShader(ShaderName::PrefixSumInitCS);
-
-		if (!psoPrefixSumInit_->Initialize(pDevice_, desc))
-		{
-			sl12::ConsolePrint("Error: failed to init prefix sum pso.");
-		}
-	}
-	{
-		sl12::ComputePipelineStateDesc desc{};
-		desc.pRootSignature = &rs_;
-		desc.pCS = pRenderSys->GetShader(ShaderName::PrefixSumC);
-
-		if (!psoPrefixSum_->Initialize(pDevice_, desc))
-		{
-			sl12::ConsolePrint("Error: failed to prefix sum pso.");
-		}
-	}
 	{
 		sl12::ComputePipelineStateDesc desc{};
 		desc.pRootSignature = &rs_;
@@ -1539,8 +1872,6 @@ MaterialComputeBinningPass::~MaterialComputeBinningPass()
 	psoInit_.Reset();
 	psoCount_.Reset();
 	psoCountSum_.Reset();
-	psoPrefixSumInit_.Reset();
-	psoPrefixSum_.Reset();
 	psoBinning_.Reset();
 	psoFinalize_.Reset();
 	rs_.Reset();
@@ -1549,12 +1880,10 @@ MaterialComputeBinningPass::~MaterialComputeBinningPass()
 std::vector<sl12::TransientResource> MaterialComputeBinningPass::GetInputResources(const sl12::RenderPassID& ID) const
 {
 	std::vector<sl12::TransientResource> ret;
+	ret.reserve(3);
 
 	ret.push_back(sl12::TransientResource(kVisBufferID, sl12::TransientState::ShaderResource));
 	ret.push_back(sl12::TransientResource(kDepthBufferID, sl12::TransientState::ShaderResource));
-	ret.push_back(sl12::TransientResource(kSubmeshBufferID, sl12::TransientState::ShaderResource));
-	ret.push_back(sl12::TransientResource(kMeshletBufferID, sl12::TransientState::ShaderResource));
-	ret.push_back(sl12::TransientResource(kDrawCallBufferID, sl12::TransientState::ShaderResource));
 	if (isVRSEnable_)
 	{
 		ret.push_back(sl12::TransientResource(kCurrVrsID, sl12::TransientState::ShaderResource));
@@ -1566,6 +1895,7 @@ std::vector<sl12::TransientResource> MaterialComputeBinningPass::GetInputResourc
 std::vector<sl12::TransientResource> MaterialComputeBinningPass::GetOutputResources(const sl12::RenderPassID& ID) const
 {
 	std::vector<sl12::TransientResource> ret;
+	ret.reserve(4);
 
 	sl12::TransientResource arg(kBinningArgBufferID, sl12::TransientState::UnorderedAccess);
 	sl12::TransientResource cnt(kBinningCountBufferID, sl12::TransientState::UnorderedAccess);
@@ -1601,16 +1931,13 @@ void MaterialComputeBinningPass::Execute(sl12::CommandList* pCmdList, sl12::Tran
 	// inputs.
 	auto pVisRes = pResManager->GetRenderGraphResource(kVisBufferID);
 	auto pDepthRes = pResManager->GetRenderGraphResource(kDepthBufferID);
-	auto pSubmeshRes = pResManager->GetRenderGraphResource(kSubmeshBufferID);
-	auto pMeshletRes = pResManager->GetRenderGraphResource(kMeshletBufferID);
-	auto pDrawCallRes = pResManager->GetRenderGraphResource(kDrawCallBufferID);
 	auto pCurrVrsRes = pResManager->GetRenderGraphResource(kCurrVrsID);
 
 	auto pVisSRV = pResManager->CreateOrGetTextureView(pVisRes);
 	auto pDepthSRV = pResManager->CreateOrGetTextureView(pDepthRes);
-	auto pSubmeshSRV = pResManager->CreateOrGetBufferView(pSubmeshRes, 0, 0, (sl12::u32)pSubmeshRes->pBuffer->GetBufferDesc().stride);
-	auto pMeshletSRV = pResManager->CreateOrGetBufferView(pMeshletRes, 0, 0, (sl12::u32)pMeshletRes->pBuffer->GetBufferDesc().stride);
-	auto pDrawCallSRV = pResManager->CreateOrGetBufferView(pDrawCallRes, 0, 0, (sl12::u32)pDrawCallRes->pBuffer->GetBufferDesc().stride);
+	auto pSubmeshSRV = pScene_->GetMeshletResource()->GetSubmeshSRV();
+	auto pMeshletSRV = pScene_->GetMeshletResource()->GetMeshletSRV();
+	auto pDrawCallSRV = pScene_->GetMeshletResource()->GetDrawCallSRV();
 	auto pCurrVrsSRV = isVRSEnable_ && pCurrVrsRes ? pResManager->CreateOrGetTextureView(pCurrVrsRes) : pDevice_->GetDummyTextureView(sl12::DummyTex::Black);
 
 	// outputs.
@@ -1627,17 +1954,17 @@ void MaterialComputeBinningPass::Execute(sl12::CommandList* pCmdList, sl12::Tran
 	// pass only resources.
 	auto&& worldMaterials = pScene_->GetMeshletResource()->GetWorldMaterials();
 	size_t numMaterials = worldMaterials.size();
-	size_t numBlocks = (numMaterials + 255) / 256;
+	size_t numBlocks = (numMaterials + PREFIX_SCAN_BLOCK_SIZE - 1) / PREFIX_SCAN_BLOCK_SIZE;
 	sl12::TransientResourceDesc StatusDesc, BlockDesc;
 	StatusDesc.bIsTexture = false;
-	StatusDesc.bufferDesc.InitializeStructured(sizeof(sl12::u32) * 2, numBlocks, sl12::ResourceUsage::UnorderedAccess);
+	StatusDesc.bufferDesc.InitializeStructured(PREFIX_SCAN_STATUS_STRIDE, numBlocks, sl12::ResourceUsage::UnorderedAccess);
 	BlockDesc.bIsTexture = false;
 	BlockDesc.bufferDesc.InitializeStructured(sizeof(sl12::u32), 1, sl12::ResourceUsage::UnorderedAccess);
 	
 	auto pStatusB = pResManager->CreatePassOnlyResource(StatusDesc);
 	auto pBlockB = pResManager->CreatePassOnlyResource(BlockDesc);
 
-	auto pStatusUAV = pResManager->CreateOrGetUnorderedAccessBufferView(pStatusB, 0, 0, sizeof(sl12::u32) * 2, 0);
+	auto pStatusUAV = pResManager->CreateOrGetUnorderedAccessBufferView(pStatusB, 0, 0, PREFIX_SCAN_STATUS_STRIDE, 0);
 	auto pBlockUAV = pResManager->CreateOrGetUnorderedAccessBufferView(pBlockB, 0, 0, sizeof(sl12::u32), 0);
 
 	sl12::u32 screenWidth = pScene_->GetScreenWidth();
@@ -1646,12 +1973,10 @@ void MaterialComputeBinningPass::Execute(sl12::CommandList* pCmdList, sl12::Tran
 	// constant buffers.
 	auto cbvMan = pRenderSystem_->GetCbvManager();
 	sl12::u32 binCBData[3] = {screenWidth, screenHeight, (sl12::u32)numMaterials};
-	sl12::u32 prefixCBData[2] = {(sl12::u32)numMaterials, (sl12::u32)numBlocks};
 	auto binCB = cbvMan->GetTemporal(binCBData, sizeof(binCBData));
-	auto prefixCB = cbvMan->GetTemporal(prefixCBData, sizeof(prefixCBData));
 
 	// set descriptors.
-	sl12::DescriptorSet binDS, prefixDS;
+	sl12::DescriptorSet binDS;
 	binDS.Reset();
 	binDS.SetCsCbv(0, binCB.GetCBV()->GetDescInfo().cpuHandle);
 	binDS.SetCsSrv(0, pVisSRV->GetDescInfo().cpuHandle);
@@ -1664,13 +1989,8 @@ void MaterialComputeBinningPass::Execute(sl12::CommandList* pCmdList, sl12::Tran
 	binDS.SetCsUav(1, pBinOffsetUAV->GetDescInfo().cpuHandle);
 	binDS.SetCsUav(2, pBinArgUAV->GetDescInfo().cpuHandle);
 	binDS.SetCsUav(3, pBinPixUAV->GetDescInfo().cpuHandle);
-
-	prefixDS.Reset();
-	prefixDS.SetCsCbv(0, prefixCB.GetCBV()->GetDescInfo().cpuHandle);
-	prefixDS.SetCsUav(0, pBinCountUAV->GetDescInfo().cpuHandle);
-	prefixDS.SetCsUav(1, pBinOffsetUAV->GetDescInfo().cpuHandle);
-	prefixDS.SetCsUav(2, pStatusUAV->GetDescInfo().cpuHandle);
-	prefixDS.SetCsUav(3, pBlockUAV->GetDescInfo().cpuHandle);
+	binDS.SetCsUav(4, pStatusUAV->GetDescInfo().cpuHandle);
+	binDS.SetCsUav(5, pBlockUAV->GetDescInfo().cpuHandle);
 
 	static const UINT kTileX = 8;
 	static const UINT kTileY = 4;
@@ -1682,10 +2002,13 @@ void MaterialComputeBinningPass::Execute(sl12::CommandList* pCmdList, sl12::Tran
 		pCmdList->SetComputeRootSignatureAndDescriptorSet(&rs_, &binDS);
 
 		// dispatch.
+		// プレフィックススキャンのステータスもここでクリアする
 		UINT t = ((UINT)numMaterials + 32 - 1) / 32;
 		pCmdList->GetLatestCommandList()->Dispatch(t, 1, 1);
 
 		pCmdList->AddUAVBarrier(pBinCountRes->pBuffer);
+		pCmdList->AddUAVBarrier(pStatusB->pBuffer);
+		pCmdList->AddUAVBarrier(pBlockB->pBuffer);
 		pCmdList->FlushBarriers();
 		
 		// set pipeline.
@@ -1699,22 +2022,14 @@ void MaterialComputeBinningPass::Execute(sl12::CommandList* pCmdList, sl12::Tran
 	}
 
 	// prefix sum.
+	// マテリアルごとの画素数をオフセットに変換する
 	{
-		// set pipeline.
-		pCmdList->GetLatestCommandList()->SetPipelineState(psoPrefixSumInit_->GetPSO());
-		pCmdList->SetComputeRootSignatureAndDescriptorSet(&rs_, &prefixDS);
-
-		// dispatch.
-		UINT t = ((UINT)numBlocks + 32 - 1) / 32;
-		pCmdList->GetLatestCommandList()->Dispatch(t, 1, 1);
-
 		pCmdList->AddUAVBarrier(pBinCountRes->pBuffer);
-		pCmdList->AddUAVBarrier(pStatusB->pBuffer);
 		pCmdList->FlushBarriers();
 
 		// set pipeline.
-		pCmdList->GetLatestCommandList()->SetPipelineState(psoPrefixSum_->GetPSO());
-		pCmdList->SetComputeRootSignatureAndDescriptorSet(&rs_, &prefixDS);
+		pCmdList->GetLatestCommandList()->SetPipelineState(psoCountSum_->GetPSO());
+		pCmdList->SetComputeRootSignatureAndDescriptorSet(&rs_, &binDS);
 
 		// dispatch.
 		pCmdList->GetLatestCommandList()->Dispatch((UINT)numBlocks, 1, 1);
@@ -1796,13 +2111,10 @@ MaterialComputeGBufferPass::~MaterialComputeGBufferPass()
 std::vector<sl12::TransientResource> MaterialComputeGBufferPass::GetInputResources(const sl12::RenderPassID& ID) const
 {
 	std::vector<sl12::TransientResource> ret;
+	ret.reserve(6);
 
 	ret.push_back(sl12::TransientResource(kVisBufferID, sl12::TransientState::ShaderResource));
 	ret.push_back(sl12::TransientResource(kDepthBufferID, sl12::TransientState::ShaderResource));
-	ret.push_back(sl12::TransientResource(kInstanceBufferID, sl12::TransientState::ShaderResource));
-	ret.push_back(sl12::TransientResource(kSubmeshBufferID, sl12::TransientState::ShaderResource));
-	ret.push_back(sl12::TransientResource(kMeshletBufferID, sl12::TransientState::ShaderResource));
-	ret.push_back(sl12::TransientResource(kDrawCallBufferID, sl12::TransientState::ShaderResource));
 	ret.push_back(sl12::TransientResource(kBinningArgBufferID, sl12::TransientState::IndirectArgument));
 	ret.push_back(sl12::TransientResource(kBinningCountBufferID, sl12::TransientState::ShaderResource));
 	ret.push_back(sl12::TransientResource(kBinningOffsetBufferID, sl12::TransientState::ShaderResource));
@@ -1814,6 +2126,7 @@ std::vector<sl12::TransientResource> MaterialComputeGBufferPass::GetInputResourc
 std::vector<sl12::TransientResource> MaterialComputeGBufferPass::GetOutputResources(const sl12::RenderPassID& ID) const
 {
 	std::vector<sl12::TransientResource> ret;
+	ret.reserve(5);
 
 	sl12::TransientResource accum(kLightAccumID, sl12::TransientState::UnorderedAccess);
 	sl12::TransientResource ga(kGBufferAID, sl12::TransientState::UnorderedAccess);
@@ -1853,10 +2166,6 @@ void MaterialComputeGBufferPass::Execute(sl12::CommandList* pCmdList, sl12::Tran
 	// inputs.
 	auto pVisRes = pResManager->GetRenderGraphResource(kVisBufferID);
 	auto pDepthRes = pResManager->GetRenderGraphResource(kDepthBufferID);
-	auto pInstanceRes = pResManager->GetRenderGraphResource(kInstanceBufferID);
-	auto pSubmeshRes = pResManager->GetRenderGraphResource(kSubmeshBufferID);
-	auto pMeshletRes = pResManager->GetRenderGraphResource(kMeshletBufferID);
-	auto pDrawCallRes = pResManager->GetRenderGraphResource(kDrawCallBufferID);
 	auto pBinArgRes = pResManager->GetRenderGraphResource(kBinningArgBufferID);
 	auto pBinCountRes = pResManager->GetRenderGraphResource(kBinningCountBufferID);
 	auto pBinOffsetRes = pResManager->GetRenderGraphResource(kBinningOffsetBufferID);
@@ -1864,10 +2173,10 @@ void MaterialComputeGBufferPass::Execute(sl12::CommandList* pCmdList, sl12::Tran
 
 	auto pVisSRV = pResManager->CreateOrGetTextureView(pVisRes);
 	auto pDepthSRV = pResManager->CreateOrGetTextureView(pDepthRes);
-	auto pInstanceSRV = pResManager->CreateOrGetBufferView(pInstanceRes, 0, 0, (sl12::u32)pInstanceRes->pBuffer->GetBufferDesc().stride);
-	auto pSubmeshSRV = pResManager->CreateOrGetBufferView(pSubmeshRes, 0, 0, (sl12::u32)pSubmeshRes->pBuffer->GetBufferDesc().stride);
-	auto pMeshletSRV = pResManager->CreateOrGetBufferView(pMeshletRes, 0, 0, (sl12::u32)pMeshletRes->pBuffer->GetBufferDesc().stride);
-	auto pDrawCallSRV = pResManager->CreateOrGetBufferView(pDrawCallRes, 0, 0, (sl12::u32)pDrawCallRes->pBuffer->GetBufferDesc().stride);
+	auto pInstanceSRV = pScene_->GetMeshletResource()->GetInstanceSRV();
+	auto pSubmeshSRV = pScene_->GetMeshletResource()->GetSubmeshSRV();
+	auto pMeshletSRV = pScene_->GetMeshletResource()->GetMeshletSRV();
+	auto pDrawCallSRV = pScene_->GetMeshletResource()->GetDrawCallSRV();
 	auto pBinCountSRV = pResManager->CreateOrGetBufferView(pBinCountRes, 0, 0, (sl12::u32)pBinCountRes->pBuffer->GetBufferDesc().stride);
 	auto pBinOffsetSRV = pResManager->CreateOrGetBufferView(pBinOffsetRes, 0, 0, (sl12::u32)pBinOffsetRes->pBuffer->GetBufferDesc().stride);
 	auto pBinPixSRV = pResManager->CreateOrGetBufferView(pBinPixRes, 0, 0, (sl12::u32)pBinPixRes->pBuffer->GetBufferDesc().stride);
@@ -1961,6 +2270,8 @@ MaterialTileBinningPass::MaterialTileBinningPass(sl12::Device* pDev, RenderSyste
 	rs_ = sl12::MakeUnique<sl12::RootSignature>(pDev);
 	psoInit_ = sl12::MakeUnique<sl12::ComputePipelineState>(pDev);
 	psoBinning_ = sl12::MakeUnique<sl12::ComputePipelineState>(pDev);
+	psoScan_ = sl12::MakeUnique<sl12::ComputePipelineState>(pDev);
+	psoScatter_ = sl12::MakeUnique<sl12::ComputePipelineState>(pDev);
 
 	// init root signature.
 	rs_->Initialize(pDev, pRenderSys->GetShader(ShaderName::InitBinningTileC));
@@ -1986,24 +2297,48 @@ MaterialTileBinningPass::MaterialTileBinningPass(sl12::Device* pDev, RenderSyste
 			sl12::ConsolePrint("Error: failed to binning tile pso.");
 		}
 	}
+	{
+		sl12::ComputePipelineStateDesc desc{};
+		desc.pRootSignature = &rs_;
+		desc.pCS = pRenderSys->GetShader(ShaderName::BinningTileScanC);
+
+		if (!psoScan_->Initialize(pDevice_, desc))
+		{
+			sl12::ConsolePrint("Error: failed to binning tile scan pso.");
+		}
+	}
+	{
+		sl12::ComputePipelineStateDesc desc{};
+		desc.pRootSignature = &rs_;
+		desc.pCS = pRenderSys->GetShader(ShaderName::BinningTileScatterC);
+
+		if (!psoScatter_->Initialize(pDevice_, desc))
+		{
+			sl12::ConsolePrint("Error: failed to binning tile scatter pso.");
+		}
+	}
 }
 
 MaterialTileBinningPass::~MaterialTileBinningPass()
 {
 	psoInit_.Reset();
 	psoBinning_.Reset();
+	psoScan_.Reset();
+	psoScatter_.Reset();
 	rs_.Reset();
 }
 
 std::vector<sl12::TransientResource> MaterialTileBinningPass::GetInputResources(const sl12::RenderPassID& ID) const
 {
 	std::vector<sl12::TransientResource> ret;
+	ret.reserve(3);
 
 	ret.push_back(sl12::TransientResource(kVisBufferID, sl12::TransientState::ShaderResource));
 	ret.push_back(sl12::TransientResource(kDepthBufferID, sl12::TransientState::ShaderResource));
-	ret.push_back(sl12::TransientResource(kSubmeshBufferID, sl12::TransientState::ShaderResource));
-	ret.push_back(sl12::TransientResource(kMeshletBufferID, sl12::TransientState::ShaderResource));
-	ret.push_back(sl12::TransientResource(kDrawCallBufferID, sl12::TransientState::ShaderResource));
+	if (isVRSEnable_)
+	{
+		ret.push_back(sl12::TransientResource(kCurrVrsID, sl12::TransientState::ShaderResource));
+	}
 	
 	return ret;
 }
@@ -2011,11 +2346,13 @@ std::vector<sl12::TransientResource> MaterialTileBinningPass::GetInputResources(
 std::vector<sl12::TransientResource> MaterialTileBinningPass::GetOutputResources(const sl12::RenderPassID& ID) const
 {
 	std::vector<sl12::TransientResource> ret;
+	ret.reserve(6);
 
 	sl12::TransientResource mat(kTileBinMaterialIndexID, sl12::TransientState::UnorderedAccess);
 	sl12::TransientResource info(kTileBinPixelInfoID, sl12::TransientState::UnorderedAccess);
 	sl12::TransientResource pit(kTileBinPixelsInTileID, sl12::TransientState::UnorderedAccess);
 	sl12::TransientResource tile(kTileBinTileIndexID, sl12::TransientState::UnorderedAccess);
+	sl12::TransientResource offset(kTileBinTileOffsetID, sl12::TransientState::UnorderedAccess);
 	sl12::TransientResource arg(kTileBinArgBufferID, sl12::TransientState::UnorderedAccess);
 
 	auto&& worldMaterials = pScene_->GetMeshletResource()->GetWorldMaterials();
@@ -2025,6 +2362,7 @@ std::vector<sl12::TransientResource> MaterialTileBinningPass::GetOutputResources
 	sl12::u32 tileX = (screenWidth + TILE_PIXEL_WIDTH - 1) / TILE_PIXEL_WIDTH;
 	sl12::u32 tileY = (screenHeight + TILE_PIXEL_WIDTH - 1) / TILE_PIXEL_WIDTH;
 	sl12::u32 tileMax = tileX * tileY;
+	sl12::u32 listStride = std::min<sl12::u32>((sl12::u32)numMaterials, TILE_BIN_MATERIAL_MAX);
 
 	mat.desc.bIsTexture = false;
 	mat.desc.bufferDesc.InitializeStructured(sizeof(sl12::u32), screenWidth * screenHeight, 0);
@@ -2032,8 +2370,11 @@ std::vector<sl12::TransientResource> MaterialTileBinningPass::GetOutputResources
 	info.desc.bufferDesc.InitializeStructured(sizeof(sl12::u32), screenWidth * screenHeight, 0);
 	pit.desc.bIsTexture = false;
 	pit.desc.bufferDesc.InitializeStructured(sizeof(sl12::u32), tileMax, 0);
+	// マテリアルごとのタイルリストは詰めて格納するので、タイル数 x マテリアル数は不要
 	tile.desc.bIsTexture = false;
-	tile.desc.bufferDesc.InitializeStructured(sizeof(sl12::u32), tileMax * numMaterials, 0);
+	tile.desc.bufferDesc.InitializeStructured(sizeof(sl12::u32), tileMax * listStride, 0);
+	offset.desc.bIsTexture = false;
+	offset.desc.bufferDesc.InitializeStructured(sizeof(sl12::u32), numMaterials, 0);
 	arg.desc.bIsTexture = false;
 	arg.desc.bufferDesc.InitializeByteAddress(sizeof(D3D12_DISPATCH_ARGUMENTS) * numMaterials, 0);
 
@@ -2041,6 +2382,7 @@ std::vector<sl12::TransientResource> MaterialTileBinningPass::GetOutputResources
 	ret.push_back(info);
 	ret.push_back(pit);
 	ret.push_back(tile);
+	ret.push_back(offset);
 	ret.push_back(arg);
 	
 	return ret;
@@ -2053,27 +2395,28 @@ void MaterialTileBinningPass::Execute(sl12::CommandList* pCmdList, sl12::Transie
 	// inputs.
 	auto pVisRes = pResManager->GetRenderGraphResource(kVisBufferID);
 	auto pDepthRes = pResManager->GetRenderGraphResource(kDepthBufferID);
-	auto pSubmeshRes = pResManager->GetRenderGraphResource(kSubmeshBufferID);
-	auto pMeshletRes = pResManager->GetRenderGraphResource(kMeshletBufferID);
-	auto pDrawCallRes = pResManager->GetRenderGraphResource(kDrawCallBufferID);
+	auto pCurrVrsRes = pResManager->GetRenderGraphResource(kCurrVrsID);
 
 	auto pVisSRV = pResManager->CreateOrGetTextureView(pVisRes);
 	auto pDepthSRV = pResManager->CreateOrGetTextureView(pDepthRes);
-	auto pSubmeshSRV = pResManager->CreateOrGetBufferView(pSubmeshRes, 0, 0, (sl12::u32)pSubmeshRes->pBuffer->GetBufferDesc().stride);
-	auto pMeshletSRV = pResManager->CreateOrGetBufferView(pMeshletRes, 0, 0, (sl12::u32)pMeshletRes->pBuffer->GetBufferDesc().stride);
-	auto pDrawCallSRV = pResManager->CreateOrGetBufferView(pDrawCallRes, 0, 0, (sl12::u32)pDrawCallRes->pBuffer->GetBufferDesc().stride);
+	auto pSubmeshSRV = pScene_->GetMeshletResource()->GetSubmeshSRV();
+	auto pMeshletSRV = pScene_->GetMeshletResource()->GetMeshletSRV();
+	auto pDrawCallSRV = pScene_->GetMeshletResource()->GetDrawCallSRV();
+	auto pCurrVrsSRV = isVRSEnable_ && pCurrVrsRes ? pResManager->CreateOrGetTextureView(pCurrVrsRes) : pDevice_->GetDummyTextureView(sl12::DummyTex::Black);
 
 	// outputs.
 	auto pMatIndexRes = pResManager->GetRenderGraphResource(kTileBinMaterialIndexID);
 	auto pPixelInfoRes = pResManager->GetRenderGraphResource(kTileBinPixelInfoID);
 	auto pPixlesInTileRes = pResManager->GetRenderGraphResource(kTileBinPixelsInTileID);
 	auto pTileIndexRes = pResManager->GetRenderGraphResource(kTileBinTileIndexID);
+	auto pTileOffsetRes = pResManager->GetRenderGraphResource(kTileBinTileOffsetID);
 	auto pBinArgRes = pResManager->GetRenderGraphResource(kTileBinArgBufferID);
 	
 	auto pMatIndexUAV = pResManager->CreateOrGetUnorderedAccessBufferView(pMatIndexRes, 0, 0, sizeof(sl12::u32), 0);
 	auto pPixelInfoUAV = pResManager->CreateOrGetUnorderedAccessBufferView(pPixelInfoRes, 0, 0, sizeof(sl12::u32), 0);
 	auto pPixlesInTileUAV = pResManager->CreateOrGetUnorderedAccessBufferView(pPixlesInTileRes, 0, 0, sizeof(sl12::u32), 0);
 	auto pTileIndexUAV = pResManager->CreateOrGetUnorderedAccessBufferView(pTileIndexRes, 0, 0, sizeof(sl12::u32), 0);
+	auto pTileOffsetUAV = pResManager->CreateOrGetUnorderedAccessBufferView(pTileOffsetRes, 0, 0, sizeof(sl12::u32), 0);
 	auto pBinArgUAV = pResManager->CreateOrGetUnorderedAccessBufferView(pBinArgRes, 0, 0, 0, 0);
 
 	auto&& worldMaterials = pScene_->GetMeshletResource()->GetWorldMaterials();
@@ -2082,6 +2425,34 @@ void MaterialTileBinningPass::Execute(sl12::CommandList* pCmdList, sl12::Transie
 	sl12::u32 tileX = (screenWidth + TILE_PIXEL_WIDTH - 1) / TILE_PIXEL_WIDTH;
 	sl12::u32 tileY = (screenHeight + TILE_PIXEL_WIDTH - 1) / TILE_PIXEL_WIDTH;
 	sl12::u32 numMaterials = (sl12::u32)worldMaterials.size();
+	sl12::u32 listStride = std::min<sl12::u32>(numMaterials, TILE_BIN_MATERIAL_MAX);
+	sl12::u32 numBlocks = (numMaterials + PREFIX_SCAN_BLOCK_SIZE - 1) / PREFIX_SCAN_BLOCK_SIZE;
+
+	// pass only resources.
+	// タイルごとの疎なマテリアルリストと、プレフィックススキャンのステータス
+	sl12::TransientResourceDesc ListDesc, CountDesc, FillDesc, StatusDesc, BlockDesc;
+	ListDesc.bIsTexture = false;
+	ListDesc.bufferDesc.InitializeStructured(sizeof(sl12::u32), tileX * tileY * listStride, sl12::ResourceUsage::UnorderedAccess);
+	CountDesc.bIsTexture = false;
+	CountDesc.bufferDesc.InitializeStructured(sizeof(sl12::u32), tileX * tileY, sl12::ResourceUsage::UnorderedAccess);
+	FillDesc.bIsTexture = false;
+	FillDesc.bufferDesc.InitializeStructured(sizeof(sl12::u32), numMaterials, sl12::ResourceUsage::UnorderedAccess);
+	StatusDesc.bIsTexture = false;
+	StatusDesc.bufferDesc.InitializeStructured(PREFIX_SCAN_STATUS_STRIDE, numBlocks, sl12::ResourceUsage::UnorderedAccess);
+	BlockDesc.bIsTexture = false;
+	BlockDesc.bufferDesc.InitializeStructured(sizeof(sl12::u32), 1, sl12::ResourceUsage::UnorderedAccess);
+
+	auto pListB = pResManager->CreatePassOnlyResource(ListDesc);
+	auto pCountB = pResManager->CreatePassOnlyResource(CountDesc);
+	auto pFillB = pResManager->CreatePassOnlyResource(FillDesc);
+	auto pStatusB = pResManager->CreatePassOnlyResource(StatusDesc);
+	auto pBlockB = pResManager->CreatePassOnlyResource(BlockDesc);
+
+	auto pListUAV = pResManager->CreateOrGetUnorderedAccessBufferView(pListB, 0, 0, sizeof(sl12::u32), 0);
+	auto pCountUAV = pResManager->CreateOrGetUnorderedAccessBufferView(pCountB, 0, 0, sizeof(sl12::u32), 0);
+	auto pFillUAV = pResManager->CreateOrGetUnorderedAccessBufferView(pFillB, 0, 0, sizeof(sl12::u32), 0);
+	auto pStatusUAV = pResManager->CreateOrGetUnorderedAccessBufferView(pStatusB, 0, 0, PREFIX_SCAN_STATUS_STRIDE, 0);
+	auto pBlockUAV = pResManager->CreateOrGetUnorderedAccessBufferView(pBlockB, 0, 0, sizeof(sl12::u32), 0);
 
 	// constant buffers.
 	struct TileBinningCB
@@ -2104,11 +2475,18 @@ void MaterialTileBinningPass::Execute(sl12::CommandList* pCmdList, sl12::Transie
 	desc.SetCsSrv(2, pMeshletSRV->GetDescInfo().cpuHandle);
 	desc.SetCsSrv(3, pDrawCallSRV->GetDescInfo().cpuHandle);
 	desc.SetCsSrv(4, pDepthSRV->GetDescInfo().cpuHandle);
+	desc.SetCsSrv(5, pCurrVrsSRV->GetDescInfo().cpuHandle);
 	desc.SetCsUav(0, pMatIndexUAV->GetDescInfo().cpuHandle);
 	desc.SetCsUav(1, pPixelInfoUAV->GetDescInfo().cpuHandle);
 	desc.SetCsUav(2, pPixlesInTileUAV->GetDescInfo().cpuHandle);
 	desc.SetCsUav(3, pTileIndexUAV->GetDescInfo().cpuHandle);
 	desc.SetCsUav(4, pBinArgUAV->GetDescInfo().cpuHandle);
+	desc.SetCsUav(5, pTileOffsetUAV->GetDescInfo().cpuHandle);
+	desc.SetCsUav(6, pListUAV->GetDescInfo().cpuHandle);
+	desc.SetCsUav(7, pCountUAV->GetDescInfo().cpuHandle);
+	desc.SetCsUav(8, pFillUAV->GetDescInfo().cpuHandle);
+	desc.SetCsUav(9, pStatusUAV->GetDescInfo().cpuHandle);
+	desc.SetCsUav(10, pBlockUAV->GetDescInfo().cpuHandle);
 
 	// initialize.
 	{
@@ -2117,10 +2495,14 @@ void MaterialTileBinningPass::Execute(sl12::CommandList* pCmdList, sl12::Transie
 		pCmdList->SetComputeRootSignatureAndDescriptorSet(&rs_, &desc);
 
 		// dispatch.
+		// プレフィックススキャンのステータスもここでクリアする
 		UINT t = ((UINT)numMaterials + 32 - 1) / 32;
 		pCmdList->GetLatestCommandList()->Dispatch(t, 1, 1);
 
 		pCmdList->AddUAVBarrier(pBinArgRes->pBuffer);
+		pCmdList->AddUAVBarrier(pFillB->pBuffer);
+		pCmdList->AddUAVBarrier(pStatusB->pBuffer);
+		pCmdList->AddUAVBarrier(pBlockB->pBuffer);
 		pCmdList->FlushBarriers();
 	}
 
@@ -2132,6 +2514,35 @@ void MaterialTileBinningPass::Execute(sl12::CommandList* pCmdList, sl12::Transie
 
 		// dispatch.
 		pCmdList->GetLatestCommandList()->Dispatch(tileX, tileY, 1);
+
+		pCmdList->AddUAVBarrier(pBinArgRes->pBuffer);
+		pCmdList->AddUAVBarrier(pListB->pBuffer);
+		pCmdList->AddUAVBarrier(pCountB->pBuffer);
+		pCmdList->FlushBarriers();
+	}
+
+	// prefix sum.
+	// マテリアルごとのタイル数をオフセットに変換する
+	{
+		// set pipeline.
+		pCmdList->GetLatestCommandList()->SetPipelineState(psoScan_->GetPSO());
+		pCmdList->SetComputeRootSignatureAndDescriptorSet(&rs_, &desc);
+
+		// dispatch.
+		pCmdList->GetLatestCommandList()->Dispatch(numBlocks, 1, 1);
+
+		pCmdList->AddUAVBarrier(pTileOffsetRes->pBuffer);
+		pCmdList->FlushBarriers();
+	}
+
+	// scatter.
+	{
+		// set pipeline.
+		pCmdList->GetLatestCommandList()->SetPipelineState(psoScatter_->GetPSO());
+		pCmdList->SetComputeRootSignatureAndDescriptorSet(&rs_, &desc);
+
+		// dispatch.
+		pCmdList->GetLatestCommandList()->Dispatch(tileX, tileY, 1);
 	}
 }
 
@@ -2184,17 +2595,15 @@ MaterialTileGBufferPass::~MaterialTileGBufferPass()
 std::vector<sl12::TransientResource> MaterialTileGBufferPass::GetInputResources(const sl12::RenderPassID& ID) const
 {
 	std::vector<sl12::TransientResource> ret;
+	ret.reserve(8);
 
 	ret.push_back(sl12::TransientResource(kVisBufferID, sl12::TransientState::ShaderResource));
 	ret.push_back(sl12::TransientResource(kDepthBufferID, sl12::TransientState::ShaderResource));
-	ret.push_back(sl12::TransientResource(kInstanceBufferID, sl12::TransientState::ShaderResource));
-	ret.push_back(sl12::TransientResource(kSubmeshBufferID, sl12::TransientState::ShaderResource));
-	ret.push_back(sl12::TransientResource(kMeshletBufferID, sl12::TransientState::ShaderResource));
-	ret.push_back(sl12::TransientResource(kDrawCallBufferID, sl12::TransientState::ShaderResource));
 	ret.push_back(sl12::TransientResource(kTileBinMaterialIndexID, sl12::TransientState::ShaderResource));
 	ret.push_back(sl12::TransientResource(kTileBinPixelInfoID, sl12::TransientState::ShaderResource));
 	ret.push_back(sl12::TransientResource(kTileBinPixelsInTileID, sl12::TransientState::ShaderResource));
 	ret.push_back(sl12::TransientResource(kTileBinTileIndexID, sl12::TransientState::ShaderResource));
+	ret.push_back(sl12::TransientResource(kTileBinTileOffsetID, sl12::TransientState::ShaderResource));
 	ret.push_back(sl12::TransientResource(kTileBinArgBufferID, sl12::TransientState::IndirectArgument));
 	
 	return ret;
@@ -2203,6 +2612,7 @@ std::vector<sl12::TransientResource> MaterialTileGBufferPass::GetInputResources(
 std::vector<sl12::TransientResource> MaterialTileGBufferPass::GetOutputResources(const sl12::RenderPassID& ID) const
 {
 	std::vector<sl12::TransientResource> ret;
+	ret.reserve(5);
 
 	sl12::TransientResource accum(kLightAccumID, sl12::TransientState::UnorderedAccess);
 	sl12::TransientResource ga(kGBufferAID, sl12::TransientState::UnorderedAccess);
@@ -2242,26 +2652,24 @@ void MaterialTileGBufferPass::Execute(sl12::CommandList* pCmdList, sl12::Transie
 	// inputs.
 	auto pVisRes = pResManager->GetRenderGraphResource(kVisBufferID);
 	auto pDepthRes = pResManager->GetRenderGraphResource(kDepthBufferID);
-	auto pInstanceRes = pResManager->GetRenderGraphResource(kInstanceBufferID);
-	auto pSubmeshRes = pResManager->GetRenderGraphResource(kSubmeshBufferID);
-	auto pMeshletRes = pResManager->GetRenderGraphResource(kMeshletBufferID);
-	auto pDrawCallRes = pResManager->GetRenderGraphResource(kDrawCallBufferID);
 	auto pMatIndexRes = pResManager->GetRenderGraphResource(kTileBinMaterialIndexID);
 	auto pPixelInfoRes = pResManager->GetRenderGraphResource(kTileBinPixelInfoID);
 	auto pPixlesInTileRes = pResManager->GetRenderGraphResource(kTileBinPixelsInTileID);
 	auto pTileIndexRes = pResManager->GetRenderGraphResource(kTileBinTileIndexID);
+	auto pTileOffsetRes = pResManager->GetRenderGraphResource(kTileBinTileOffsetID);
 	auto pBinArgRes = pResManager->GetRenderGraphResource(kTileBinArgBufferID);
 
 	auto pVisSRV = pResManager->CreateOrGetTextureView(pVisRes);
 	auto pDepthSRV = pResManager->CreateOrGetTextureView(pDepthRes);
-	auto pInstanceSRV = pResManager->CreateOrGetBufferView(pInstanceRes, 0, 0, (sl12::u32)pInstanceRes->pBuffer->GetBufferDesc().stride);
-	auto pSubmeshSRV = pResManager->CreateOrGetBufferView(pSubmeshRes, 0, 0, (sl12::u32)pSubmeshRes->pBuffer->GetBufferDesc().stride);
-	auto pMeshletSRV = pResManager->CreateOrGetBufferView(pMeshletRes, 0, 0, (sl12::u32)pMeshletRes->pBuffer->GetBufferDesc().stride);
-	auto pDrawCallSRV = pResManager->CreateOrGetBufferView(pDrawCallRes, 0, 0, (sl12::u32)pDrawCallRes->pBuffer->GetBufferDesc().stride);
+	auto pInstanceSRV = pScene_->GetMeshletResource()->GetInstanceSRV();
+	auto pSubmeshSRV = pScene_->GetMeshletResource()->GetSubmeshSRV();
+	auto pMeshletSRV = pScene_->GetMeshletResource()->GetMeshletSRV();
+	auto pDrawCallSRV = pScene_->GetMeshletResource()->GetDrawCallSRV();
 	auto pMatIndexSRV = pResManager->CreateOrGetBufferView(pMatIndexRes, 0, 0, (sl12::u32)pMatIndexRes->pBuffer->GetBufferDesc().stride);
 	auto pPixelInfoSRV = pResManager->CreateOrGetBufferView(pPixelInfoRes, 0, 0, (sl12::u32)pPixelInfoRes->pBuffer->GetBufferDesc().stride);
 	auto pPixlesInTileSRV = pResManager->CreateOrGetBufferView(pPixlesInTileRes, 0, 0, (sl12::u32)pPixlesInTileRes->pBuffer->GetBufferDesc().stride);
 	auto pTileIndexUAV = pResManager->CreateOrGetBufferView(pTileIndexRes, 0, 0, (sl12::u32)pTileIndexRes->pBuffer->GetBufferDesc().stride);
+	auto pTileOffsetSRV = pResManager->CreateOrGetBufferView(pTileOffsetRes, 0, 0, (sl12::u32)pTileOffsetRes->pBuffer->GetBufferDesc().stride);
 
 	// outputs.
 	auto pAccumRes = pResManager->GetRenderGraphResource(kLightAccumID);
@@ -2318,6 +2726,7 @@ void MaterialTileGBufferPass::Execute(sl12::CommandList* pCmdList, sl12::Transie
 	descSet.SetCsSrv(10, pPixlesInTileSRV->GetDescInfo().cpuHandle);
 	descSet.SetCsSrv(11, pTileIndexUAV->GetDescInfo().cpuHandle);
 	descSet.SetCsSrv(16, detail_res->GetTextureView().GetDescInfo().cpuHandle);
+	descSet.SetCsSrv(17, pTileOffsetSRV->GetDescInfo().cpuHandle);
 	descSet.SetCsSampler(0, pRenderSystem_->GetLinearWrapSampler()->GetDescInfo().cpuHandle);
 	descSet.SetCsUav(0, pMipUAV->GetDescInfo().cpuHandle);
 	descSet.SetCsUav(1, pAccumUAV->GetDescInfo().cpuHandle);
@@ -51,6 +51,11 @@ public:
 		return AppPassType::VisibilityVs;
 	}
 
+	virtual void SetPassSettings(const RenderPassSetupDesc& desc)
+	{
+		bMaskedDrawList_ = desc.bUseBindlessMasked;
+	}
+
 	virtual std::vector<sl12::TransientResource> GetInputResources(const sl12::RenderPassID& ID) const override;
 	virtual std::vector<sl12::TransientResource> GetOutputResources(const sl12::RenderPassID& ID) const override;
 	virtual sl12::HardwareQueue::Value GetExecuteQueue() const
@@ -58,11 +63,29 @@ public:
 		return sl12::HardwareQueue::Graphics;
 	}
 	virtual void Execute(sl12::CommandList* pCmdList, sl12::TransientResourceManager* pResManager, const sl12::RenderPassID& ID) override;
+	virtual void PrepareSerial(const sl12::RenderPassID& ID) override;
+	virtual void PrepareExecute(const sl12::RenderPassID& ID) override;
 	
 private:
-	sl12::UniqueHandle<sl12::RootSignature> rs_;
+	void BuildDrawItems();
+	void InitBindless(sl12::u32 maxResources);
+	void UpdateBindless();
+
+private:
+	sl12::UniqueHandle<sl12::RootSignature> rs_, rsBindless_;
 	sl12::UniqueHandle<sl12::GraphicsPipelineState> psoOpaque_, psoOpaqueDS_, psoMasked_, psoMaskedDS_;
-	UniqueHandle<sl12::IndirectExecuter> indirectExec_;
+	sl12::UniqueHandle<sl12::GraphicsPipelineState> psoBindless_, psoBindlessDS_;
+	sl12::UniqueHandle<sl12::GraphicsPipelineState> psoBindlessOpaque_, psoBindlessOpaqueDS_;	// MESHLET_ALPHA_OPAQUEのメッシュレット用
+	UniqueHandle<sl12::IndirectExecuter> indirectExec_, indirectExecBindless_;
+	sl12::u32 bindlessMaxResources_ = 0;	// rsBindless_のバインドレステクスチャ上限
+	bool bMaskedDrawList_ = false;
+
+	// ソート済みの描画リスト (1stパスと2ndパスで共通)
+	// フレームアリーナで確保するので、作成したフレームのみ有効
+	FrameVector<DrawSortItem> drawItems_;
+	FrameVector<const sl12::ResourceItemMesh*> drawMeshes_;
+	DrawStateStats drawInstanceOrderStats_;
+	sl12::u64 drawItemsFrame_ = ~0ull;		// 作成したフレーム
 };
 
 //----
@@ -146,7 +169,7 @@ public:
 	
 private:
 	sl12::UniqueHandle<sl12::RootSignature> rs_;
-	sl12::UniqueHandle<sl12::ComputePipelineState> psoClear_, psoClassify_;
+	sl12::UniqueHandle<sl12::ComputePipelineState> psoInit_, psoClassify_, psoScan_, psoScatter_;
 };
 
 //----
@@ -228,7 +251,7 @@ public:
 	
 private:
 	sl12::UniqueHandle<sl12::RootSignature> rs_;
-	sl12::UniqueHandle<sl12::ComputePipelineState> psoInit_, psoCount_, psoCountSum_, psoPrefixSumInit_, psoPrefixSum_, psoBinning_, psoFinalize_;
+	sl12::UniqueHandle<sl12::ComputePipelineState> psoInit_, psoCount_, psoCountSum_, psoBinning_, psoFinalize_;
 	bool isVRSEnable_ = false;
 };
 
@@ -270,6 +293,11 @@ public:
 		return AppPassType::MaterialTileBinning;
 	}
 
+	virtual void SetPassSettings(const RenderPassSetupDesc& desc)
+	{
+		isVRSEnable_ = desc.bUseVRS;
+	}
+
 	virtual std::vector<sl12::TransientResource> GetInputResources(const sl12::RenderPassID& ID) const override;
 	virtual std::vector<sl12::TransientResource> GetOutputResources(const sl12::RenderPassID& ID) const override;
 	virtual sl12::HardwareQueue::Value GetExecuteQueue() const
@@ -280,7 +308,8 @@ public:
 	
 private:
 	sl12::UniqueHandle<sl12::RootSignature> rs_;
-	sl12::UniqueHandle<sl12::ComputePipelineState> psoInit_, psoBinning_;
+	sl12::UniqueHandle<sl12::ComputePipelineState> psoInit_, psoBinning_, psoScan_, psoScatter_;
+	bool isVRSEnable_ = false;
 };
 
 //----
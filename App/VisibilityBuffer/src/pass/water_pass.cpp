@@ -17,6 +17,7 @@ WaterLightAccumCopyPass::~WaterLightAccumCopyPass()
 std::vector<sl12::TransientResource> WaterLightAccumCopyPass::GetInputResources(const sl12::RenderPassID& ID) const
 {
 	std::vector<sl12::TransientResource> ret;
+	ret.reserve(2);
 	ret.push_back(sl12::TransientResource(kLightAccumID, sl12::TransientState::CopySrc));
 	ret.push_back(sl12::TransientResource(kDepthBufferID, sl12::TransientState::CopySrc));
 	return ret;
@@ -25,6 +26,7 @@ std::vector<sl12::TransientResource> WaterLightAccumCopyPass::GetInputResources(
 std::vector<sl12::TransientResource> WaterLightAccumCopyPass::GetOutputResources(const sl12::RenderPassID& ID) const
 {
 	std::vector<sl12::TransientResource> ret;
+	ret.reserve(2);
 
 	sl12::TransientResource accum(kWaterLightAccumID, sl12::TransientState::CopyDst);
 	sl12::TransientResource depth(kWaterDepthID, sl12::TransientState::CopyDst);
@@ -85,6 +87,7 @@ WaterMipmapPass::~WaterMipmapPass()
 std::vector<sl12::TransientResource> WaterMipmapPass::GetInputResources(const sl12::RenderPassID& ID) const
 {
 	std::vector<sl12::TransientResource> ret;
+	ret.reserve(2);
 	ret.push_back(sl12::TransientResource(kWaterDepthID, sl12::TransientState::ShaderResource));
 	ret.push_back(sl12::TransientResource(kGBufferCID, sl12::TransientState::ShaderResource));
 	return ret;
@@ -93,6 +96,7 @@ std::vector<sl12::TransientResource> WaterMipmapPass::GetInputResources(const sl
 std::vector<sl12::TransientResource> WaterMipmapPass::GetOutputResources(const sl12::RenderPassID& ID) const
 {
 	std::vector<sl12::TransientResource> ret;
+	ret.reserve(2);
 
 	sl12::u32 width = pScene_->GetScreenWidth();
 	sl12::u32 height = pScene_->GetScreenHeight();
@@ -235,6 +239,7 @@ WaterPass::~WaterPass()
 std::vector<sl12::TransientResource> WaterPass::GetInputResources(const sl12::RenderPassID& ID) const
 {
 	std::vector<sl12::TransientResource> ret;
+	ret.reserve(5);
 	ret.push_back(sl12::TransientResource(kWaterLightAccumID, sl12::TransientState::ShaderResource));
 	if (method_ == 1)
 	{
@@ -252,6 +257,7 @@ std::vector<sl12::TransientResource> WaterPass::GetInputResources(const sl12::Re
 std::vector<sl12::TransientResource> WaterPass::GetOutputResources(const sl12::RenderPassID& ID) const
 {
 	std::vector<sl12::TransientResource> ret;
+	ret.reserve(2);
 
 	sl12::TransientResource accum(kLightAccumID, sl12::TransientState::RenderTarget);
 	sl12::TransientResource depth(kDepthBufferID, sl12::TransientState::DepthStencil);
@@ -0,0 +1,264 @@
+﻿#include "prefix_scan.h"
+
+#include <algorithm>
+#include <random>
+
+
+namespace
+{
+	template <typename T>
+	void PrefixScanT(const T* input, T* output, sl12::u32 count, bool bInclusive)
+	{
+		T sum = 0;
+		for (sl12::u32 i = 0; i < count; i++)
+		{
+			T v = input[i];
+			output[i] = bInclusive ? sum + v : sum;
+			sum += v;
+		}
+	}
+
+	// prefix_sum.hlsli のルックバックのステータス
+	enum ScanState
+	{
+		kScanStateNone,
+		kScanStateAggregate,
+		kScanStatePrefix,
+	};
+
+	struct ScanStatus
+	{
+		sl12::u32	aggregate = 0;
+		sl12::u32	inclusive = 0;
+		ScanState	state = kScanStateNone;
+	};
+}
+
+//----
+void PrefixScanReference(const sl12::u32* input, sl12::u32* output, sl12::u32 count, bool bInclusive)
+{
+	PrefixScanT(input, output, count, bInclusive);
+}
+
+//----
+void PrefixScanReference(const sl12::u64* input, sl12::u64* output, sl12::u32 count, bool bInclusive)
+{
+	PrefixScanT(input, output, count, bInclusive);
+}
+
+//----
+void SegmentedPrefixScanReference(const sl12::u32* keys, const sl12::u32* input, sl12::u32* output, sl12::u32 count, bool bInclusive)
+{
+	sl12::u32 sum = 0;
+	for (sl12::u32 i = 0; i < count; i++)
+	{
+		if (i == 0 || keys[i] != keys[i - 1])
+		{
+			sum = 0;
+		}
+		sl12::u32 v = input[i];
+		output[i] = bInclusive ? sum + v : sum;
+		sum += v;
+	}
+}
+
+//----
+void EmulatePrefixScanBlocks(const sl12::u32* keys, const sl12::u32* input, sl12::u32* output, sl12::u32 count, bool bInclusive,
+	const std::vector<sl12::u32>& blockOrder)
+{
+	const sl12::u32 kBlockSize = PREFIX_SCAN_BLOCK_SIZE;
+	sl12::u32 numBlocks = (count + kBlockSize - 1) / kBlockSize;
+	std::vector<ScanStatus> status(numBlocks);
+
+	// ブロック内の結果 (キャリーを含まない)
+	std::vector<sl12::u32> exclusive(numBlocks * kBlockSize);
+	std::vector<bool> inSegment(numBlocks * kBlockSize);
+
+	auto IsHead = [&](sl12::u32 index)
+	{
+		return keys && index < count && (index == 0 || keys[index] != keys[index - 1]);
+	};
+
+	// 全てのブロックが自身の合計を公開してからルックバックする
+	// blockOrderの後ろにあるブロックほど、前のブロックがAGGREGATEのまま残っている
+	for (auto blockIndex : blockOrder)
+	{
+		sl12::u32 base = blockIndex * kBlockSize;
+
+		// ブロック内の排他スキャン
+		sl12::u32 sum = 0;
+		std::vector<sl12::u32> blockExclusive(kBlockSize);
+		for (sl12::u32 i = 0; i < kBlockSize; i++)
+		{
+			blockExclusive[i] = sum;
+			sum += (base + i < count) ? input[base + i] : 0;
+		}
+
+		// 直近のセグメント先頭からの排他スキャン
+		int head = -1;
+		for (sl12::u32 i = 0; i < kBlockSize; i++)
+		{
+			if (IsHead(base + i))
+			{
+				head = (int)i;
+			}
+			sl12::u32 e = blockExclusive[i];
+			if (head >= 0)
+			{
+				e -= blockExclusive[head];
+			}
+			exclusive[base + i] = e;
+			inSegment[base + i] = head >= 0;
+		}
+
+		sl12::u32 last = base + kBlockSize - 1;
+		sl12::u32 lastValue = (last < count) ? input[last] : 0;
+		sl12::u32 aggregate = exclusive[last] + lastValue;
+		bool bPrefixReady = blockIndex == 0 || inSegment[last];
+		if (bPrefixReady)
+		{
+			status[blockIndex].inclusive = aggregate;
+			status[blockIndex].state = kScanStatePrefix;
+		}
+		else
+		{
+			status[blockIndex].aggregate = aggregate;
+			status[blockIndex].state = kScanStateAggregate;
+		}
+	}
+
+	for (auto blockIndex : blockOrder)
+	{
+		// decoupled look-back.
+		sl12::u32 carry = 0;
+		for (int look = (int)blockIndex - 1; look >= 0; look--)
+		{
+			auto&& s = status[look];
+			if (s.state == kScanStatePrefix)
+			{
+				carry += s.inclusive;
+				break;
+			}
+			carry += s.aggregate;
+		}
+		if (status[blockIndex].state != kScanStatePrefix)
+		{
+			status[blockIndex].inclusive = carry + status[blockIndex].aggregate;
+			status[blockIndex].state = kScanStatePrefix;
+		}
+
+		// output.
+		sl12::u32 base = blockIndex * kBlockSize;
+		sl12::u32 end = std::min(base + kBlockSize, count);
+		for (sl12::u32 i = base; i < end; i++)
+		{
+			sl12::u32 result = exclusive[i] + (inSegment[i] ? 0 : carry);
+			output[i] = bInclusive ? result + input[i] : result;
+		}
+	}
+}
+
+//----
+void MakePrefixScanInput(sl12::u32 count, sl12::u32 seed, sl12::u32 segmentLength, std::vector<sl12::u32>& outValues, std::vector<sl12::u32>& outKeys)
+{
+	std::mt19937 rnd(seed);
+	outValues.resize(count);
+	outKeys.resize(count);
+	sl12::u32 key = 0;
+	for (sl12::u32 i = 0; i < count; i++)
+	{
+		// 大きな値も混ぜて桁あふれを起こす
+		sl12::u32 r = rnd();
+		outValues[i] = (r & 0xf) == 0 ? r : (r & 0xff);
+		if (segmentLength > 0 && rnd() % segmentLength == 0)
+		{
+			key++;
+		}
+		outKeys[i] = key;
+	}
+}
+
+//----
+sl12::u32 ValidatePrefixScan()
+{
+	const sl12::u32 kCounts[] = {
+		1, 255, 256, 257, 1000,
+		PREFIX_SCAN_BLOCK_SIZE * 16 + 3,
+		PREFIX_SCAN_BLOCK_SIZE * 64,
+	};
+	const sl12::u32 kSegmentLengths[] = {0, 1, 7, 300, 5000};
+
+	sl12::u32 errors = 0;
+	std::mt19937 rnd(1234);
+	std::vector<sl12::u32> values, keys, expected, result;
+	for (auto count : kCounts)
+	{
+		sl12::u32 numBlocks = (count + PREFIX_SCAN_BLOCK_SIZE - 1) / PREFIX_SCAN_BLOCK_SIZE;
+		for (auto segmentLength : kSegmentLengths)
+		{
+			MakePrefixScanInput(count, count * 31 + segmentLength, segmentLength, values, keys);
+			const sl12::u32* pKeys = (segmentLength > 0) ? keys.data() : nullptr;
+			expected.resize(count);
+			result.resize(count);
+
+			// 順番通りと、逆順とランダムな順序でブロックを処理する
+			std::vector<sl12::u32> orders[3];
+			for (sl12::u32 i = 0; i < numBlocks; i++)
+			{
+				orders[0].push_back(i);
+			}
+			orders[1].assign(orders[0].rbegin(), orders[0].rend());
+			orders[2] = orders[0];
+			std::shuffle(orders[2].begin(), orders[2].end(), rnd);
+
+			for (int inclusive = 0; inclusive < 2; inclusive++)
+			{
+				if (pKeys)
+				{
+					SegmentedPrefixScanReference(pKeys, values.data(), expected.data(), count, inclusive != 0);
+				}
+				else
+				{
+					PrefixScanReference(values.data(), expected.data(), count, inclusive != 0);
+				}
+				for (auto&& order : orders)
+				{
+					EmulatePrefixScanBlocks(pKeys, values.data(), result.data(), count, inclusive != 0, order);
+					if (result != expected)
+					{
+						errors++;
+					}
+				}
+			}
+		}
+	}
+
+	// 64bitは32bitの下位と一致し、上位に桁上がりする
+	{
+		const sl12::u32 kCount = 4096;
+		std::vector<sl12::u64> values64(kCount), result64(kCount);
+		std::vector<sl12::u32> values32(kCount), result32(kCount);
+		for (sl12::u32 i = 0; i < kCount; i++)
+		{
+			values32[i] = rnd();
+			values64[i] = values32[i];
+		}
+		PrefixScanReference(values64.data(), result64.data(), kCount, true);
+		PrefixScanReference(values32.data(), result32.data(), kCount, true);
+		for (sl12::u32 i = 0; i < kCount; i++)
+		{
+			if ((sl12::u32)result64[i] != result32[i])
+			{
+				errors++;
+				break;
+			}
+		}
+		if ((result64[kCount - 1] >> 32) == 0)
+		{
+			errors++;
+		}
+	}
+	return errors;
+}
+
+//	EOF
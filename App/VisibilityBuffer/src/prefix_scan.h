@@ -0,0 +1,41 @@
+﻿#pragma once
+
+#include "sl12/types.h"
+#include <vector>
+
+#include "../shaders/constant_defs.h"
+
+
+//----
+// プレフィックススキャンのCPU版 (prefix_sum.hlsli のリファレンス)
+// 符号なし整数の加算はオーバーフローも含めて結合的なので、加算順序が異なるGPU版とビット単位で一致する
+// D3D12に依存しないので、アプリケーション外でも実行できる
+
+enum class PrefixScanType
+{
+	U32,
+	U64,
+	SegmentedU32,		// キーが直前の要素と異なる位置でスキャンをやり直す
+
+	Max
+};	// enum class PrefixScanType
+
+void PrefixScanReference(const sl12::u32* input, sl12::u32* output, sl12::u32 count, bool bInclusive);
+void PrefixScanReference(const sl12::u64* input, sl12::u64* output, sl12::u32 count, bool bInclusive);
+void SegmentedPrefixScanReference(const sl12::u32* keys, const sl12::u32* input, sl12::u32* output, sl12::u32 count, bool bInclusive);
+
+// GPU版と同じくPREFIX_SCAN_BLOCK_SIZE単位のブロックに分けて、ブロック内のスキャンとルックバックで計算する
+// ブロックはblockOrderの順に処理し、ルックバックは処理済みのブロックのみを参照する
+// keysがnullptrの場合はセグメントなし
+void EmulatePrefixScanBlocks(const sl12::u32* keys, const sl12::u32* input, sl12::u32* output, sl12::u32 count, bool bInclusive,
+	const std::vector<sl12::u32>& blockOrder);
+
+// ベンチマーク用の入力を作る
+// キーは平均segmentLength個ごとに変わる昇順の値
+void MakePrefixScanInput(sl12::u32 count, sl12::u32 seed, sl12::u32 segmentLength, std::vector<sl12::u32>& outValues, std::vector<sl12::u32>& outKeys);
+
+// 要素数とブロック処理順を変えて、ブロック分割版とリファレンスが一致することを検証する
+// 戻り値は一致しなかったケース数
+sl12::u32 ValidatePrefixScan();
+
+//	EOF
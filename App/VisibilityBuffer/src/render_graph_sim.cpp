@@ -0,0 +1,415 @@
+﻿#include "render_graph_sim.h"
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+
+
+namespace
+{
+	// 実行時間0のパスでもリソースの生存期間が空にならないようにする
+	static const float kMinPassCost = 1e-3f;
+
+	//----
+	// 祖先の集合 (ビット列)
+	struct PassBits
+	{
+		std::vector<sl12::u64>	bits;
+
+		void Init(sl12::u32 count)
+		{
+			bits.assign((count + 63) / 64, 0);
+		}
+		void Set(sl12::u32 index)
+		{
+			bits[index / 64] |= (1ull << (index % 64));
+		}
+		bool Test(sl12::u32 index) const
+		{
+			return (bits[index / 64] & (1ull << (index % 64))) != 0;
+		}
+		void Merge(const PassBits& other)
+		{
+			for (size_t i = 0; i < bits.size(); i++)
+				bits[i] |= other.bits[i];
+		}
+	};	// struct PassBits
+}
+
+//----
+sl12::u32 RenderGraphSimGraph::FindOrAddResource(const std::string& name, sl12::u64 size, bool bPersistent, sl12::u32 heapKind)
+{
+	for (sl12::u32 i = 0; i < (sl12::u32)resources.size(); i++)
+	{
+		if (resources[i].name == name)
+		{
+			resources[i].size = std::max(resources[i].size, size);
+			resources[i].bPersistent |= bPersistent;
+			resources[i].heapKind = std::max(resources[i].heapKind, heapKind);
+			return i;
+		}
+	}
+	RenderGraphSimResource res;
+	res.name = name;
+	res.size = size;
+	res.bPersistent = bPersistent;
+	res.heapKind = heapKind;
+	resources.push_back(res);
+	return (sl12::u32)(resources.size() - 1);
+}
+
+//----
+void SimulateRenderGraph(const RenderGraphSimGraph& graph, RenderGraphSimReport& outReport)
+{
+	outReport = RenderGraphSimReport();
+
+	const sl12::u32 passCount = (sl12::u32)graph.passes.size();
+	const sl12::u32 resCount = (sl12::u32)graph.resources.size();
+
+	// 重複したエッジは1つにまとめる
+	std::vector<std::vector<sl12::u32>> parents(passCount), children(passCount);
+	for (auto&& e : graph.edges)
+	{
+		if (e.first >= passCount || e.second >= passCount)
+			continue;
+		auto&& ch = children[e.first];
+		if (std::find(ch.begin(), ch.end(), e.second) != ch.end())
+			continue;
+		ch.push_back(e.second);
+		parents[e.second].push_back(e.first);
+	}
+
+	// トポロジカルソート
+	// 同じ順位のパスは登録順を保つ
+	{
+		std::vector<sl12::u32> inDegree(passCount);
+		for (sl12::u32 i = 0; i < passCount; i++)
+			inDegree[i] = (sl12::u32)parents[i].size();
+		std::vector<sl12::u32> ready;
+		for (sl12::u32 i = 0; i < passCount; i++)
+		{
+			if (inDegree[i] == 0)
+				ready.push_back(i);
+		}
+		while (!ready.empty())
+		{
+			auto it = std::min_element(ready.begin(), ready.end());
+			sl12::u32 p = *it;
+			ready.erase(it);
+			outReport.order.push_back(p);
+			for (auto c : children[p])
+			{
+				if (--inDegree[c] == 0)
+					ready.push_back(c);
+			}
+		}
+		if (outReport.order.size() != passCount)
+		{
+			outReport = RenderGraphSimReport();
+			outReport.bHasCycle = true;
+			return;
+		}
+	}
+
+	std::vector<float> cost(passCount);
+	for (sl12::u32 i = 0; i < passCount; i++)
+	{
+		cost[i] = std::max(graph.passes[i].cost, kMinPassCost);
+		outReport.serialCost += cost[i];
+	}
+
+	// 祖先の集合とクリティカルパス
+	std::vector<PassBits> ancestors(passCount);
+	std::vector<float> pathCost(passCount, 0.0f);
+	std::vector<sl12::s32> pathPrev(passCount, -1);
+	for (auto p : outReport.order)
+	{
+		ancestors[p].Init(passCount);
+		float best = 0.0f;
+		for (auto parent : parents[p])
+		{
+			ancestors[p].Merge(ancestors[parent]);
+			ancestors[p].Set(parent);
+			if (pathPrev[p] < 0 || pathCost[parent] > best)
+			{
+				best = pathCost[parent];
+				pathPrev[p] = (sl12::s32)parent;
+			}
+		}
+		pathCost[p] = best + cost[p];
+	}
+	if (passCount > 0)
+	{
+		sl12::u32 last = 0;
+		for (sl12::u32 i = 1; i < passCount; i++)
+		{
+			if (pathCost[i] > pathCost[last])
+				last = i;
+		}
+		outReport.criticalPathCost = pathCost[last];
+		for (sl12::s32 p = (sl12::s32)last; p >= 0; p = pathPrev[p])
+			outReport.criticalPath.push_back((sl12::u32)p);
+		std::reverse(outReport.criticalPath.begin(), outReport.criticalPath.end());
+	}
+
+	// キューごとにトポロジカル順で実行する
+	outReport.passStart.assign(passCount, 0.0f);
+	outReport.passFinish.assign(passCount, 0.0f);
+	float queueFree[kRenderGraphSimQueueCount] = {};
+	for (auto p : outReport.order)
+	{
+		sl12::u32 q = std::min(graph.passes[p].queue, kRenderGraphSimQueueCount - 1);
+		float start = queueFree[q];
+		for (auto parent : parents[p])
+			start = std::max(start, outReport.passFinish[parent]);
+		for (auto parent : parents[p])
+		{
+			sl12::u32 pq = std::min(graph.passes[parent].queue, kRenderGraphSimQueueCount - 1);
+			if (pq == q)
+				continue;
+			RenderGraphSimWait wait;
+			wait.parent = parent;
+			wait.child = p;
+			wait.idle = std::max(0.0f, outReport.passFinish[parent] - queueFree[q]);
+			outReport.crossQueueWaits.push_back(wait);
+		}
+		outReport.passStart[p] = start;
+		outReport.passFinish[p] = start + cost[p];
+		queueFree[q] = outReport.passFinish[p];
+		outReport.makespan = std::max(outReport.makespan, outReport.passFinish[p]);
+	}
+	outReport.overlap = outReport.serialCost - outReport.makespan;
+
+	// リソースごとのアクセス
+	std::vector<std::vector<sl12::u32>> writers(resCount), readers(resCount);
+	for (sl12::u32 p = 0; p < passCount; p++)
+	{
+		for (auto r : graph.passes[p].outputs)
+		{
+			if (r < resCount && std::find(writers[r].begin(), writers[r].end(), p) == writers[r].end())
+				writers[r].push_back(p);
+		}
+		for (auto r : graph.passes[p].inputs)
+		{
+			if (r < resCount && std::find(readers[r].begin(), readers[r].end(), p) == readers[r].end())
+				readers[r].push_back(p);
+		}
+	}
+
+	auto IsOrdered = [&](sl12::u32 a, sl12::u32 b)
+	{
+		return ancestors[a].Test(b) || ancestors[b].Test(a);
+	};
+	for (sl12::u32 r = 0; r < resCount; r++)
+	{
+		auto&& w = writers[r];
+		for (size_t i = 0; i < w.size(); i++)
+		{
+			for (size_t j = i + 1; j < w.size(); j++)
+			{
+				if (!IsOrdered(w[i], w[j]))
+					outReport.hazards.push_back({r, w[i], w[j], true});
+			}
+			for (auto rd : readers[r])
+			{
+				if (rd != w[i] && !IsOrdered(w[i], rd))
+					outReport.hazards.push_back({r, w[i], rd, false});
+			}
+		}
+
+		// ヒストリーや外部リソースは前のフレームや外部で書き込まれる
+		if (!graph.resources[r].bPersistent && w.empty())
+		{
+			for (auto rd : readers[r])
+				outReport.missingProducers.push_back(std::make_pair(rd, r));
+		}
+	}
+
+	// トランジェントリソースの生存期間は最初のアクセスの開始から最後のアクセスの終了まで
+	struct Lifetime
+	{
+		float		begin;
+		float		end;
+		sl12::u64	size;
+	};
+	std::vector<Lifetime> lifetimes;
+	outReport.resourceBegin.assign(resCount, 0.0f);
+	outReport.resourceEnd.assign(resCount, 0.0f);
+	for (sl12::u32 r = 0; r < resCount; r++)
+	{
+		if (graph.resources[r].bPersistent)
+			continue;
+		if (writers[r].empty() && readers[r].empty())
+			continue;
+		Lifetime lt = {FLT_MAX, 0.0f, graph.resources[r].size};
+		for (auto p : writers[r])
+		{
+			lt.begin = std::min(lt.begin, outReport.passStart[p]);
+			lt.end = std::max(lt.end, outReport.passFinish[p]);
+		}
+		for (auto p : readers[r])
+		{
+			lt.begin = std::min(lt.begin, outReport.passStart[p]);
+			lt.end = std::max(lt.end, outReport.passFinish[p]);
+		}
+		lifetimes.push_back(lt);
+		outReport.resourceBegin[r] = lt.begin;
+		outReport.resourceEnd[r] = lt.end;
+		outReport.totalTransientMemory += lt.size;
+	}
+	for (auto&& lt : lifetimes)
+	{
+		// 生存期間の開始時点で同時に生存しているリソースの合計
+		sl12::u64 live = 0;
+		for (auto&& other : lifetimes)
+		{
+			if (other.begin <= lt.begin && lt.begin < other.end)
+				live += other.size;
+		}
+		outReport.peakTransientMemory = std::max(outReport.peakTransientMemory, live);
+	}
+}
+
+//----
+sl12::u32 ValidateRenderGraphSim()
+{
+	sl12::u32 errorCount = 0;
+	auto Near = [](float a, float b)
+	{
+		return std::fabs(a - b) < 1e-2f;
+	};
+	auto AddPass = [](RenderGraphSimGraph& g, const char* name, sl12::u32 queue, float cost)
+	{
+		RenderGraphSimPass pass;
+		pass.name = name;
+		pass.queue = queue;
+		pass.cost = cost;
+		g.passes.push_back(pass);
+		return (sl12::u32)(g.passes.size() - 1);
+	};
+
+	// 1キューの直列グラフ
+	{
+		RenderGraphSimGraph g;
+		sl12::u32 a = AddPass(g, "A", 0, 1.0f);
+		sl12::u32 b = AddPass(g, "B", 0, 2.0f);
+		sl12::u32 c = AddPass(g, "C", 0, 3.0f);
+		g.edges.push_back(std::make_pair(a, b));
+		g.edges.push_back(std::make_pair(b, c));
+		RenderGraphSimReport rep;
+		SimulateRenderGraph(g, rep);
+		if (rep.bHasCycle || !Near(rep.criticalPathCost, 6.0f) || rep.criticalPath.size() != 3
+			|| !Near(rep.makespan, 6.0f) || !Near(rep.overlap, 0.0f) || !rep.crossQueueWaits.empty())
+			errorCount++;
+	}
+
+	// GraphicsとComputeの並列実行
+	{
+		RenderGraphSimGraph g;
+		sl12::u32 a = AddPass(g, "A", 0, 2.0f);
+		sl12::u32 b = AddPass(g, "B", 0, 3.0f);
+		sl12::u32 c = AddPass(g, "C", 1, 3.0f);
+		sl12::u32 d = AddPass(g, "D", 0, 1.0f);
+		g.edges.push_back(std::make_pair(a, b));
+		g.edges.push_back(std::make_pair(a, c));
+		g.edges.push_back(std::make_pair(b, d));
+		g.edges.push_back(std::make_pair(c, d));
+		RenderGraphSimReport rep;
+		SimulateRenderGraph(g, rep);
+		if (!Near(rep.serialCost, 9.0f) || !Near(rep.makespan, 6.0f) || !Near(rep.overlap, 3.0f) || !Near(rep.criticalPathCost, 6.0f))
+			errorCount++;
+		if (rep.crossQueueWaits.size() != 2)
+		{
+			errorCount++;
+		}
+		else
+		{
+			for (auto&& w : rep.crossQueueWaits)
+			{
+				if (w.parent == a && w.child == c && !Near(w.idle, 2.0f))
+					errorCount++;
+				if (w.parent == c && w.child == d && !Near(w.idle, 0.0f))
+					errorCount++;
+			}
+		}
+	}
+
+	// 同期されていない読み書き
+	{
+		RenderGraphSimGraph g;
+		sl12::u32 a = AddPass(g, "A", 0, 1.0f);
+		sl12::u32 b = AddPass(g, "B", 1, 1.0f);
+		sl12::u32 c = AddPass(g, "C", 1, 1.0f);
+		sl12::u32 r = g.FindOrAddResource("R", 16, false);
+		g.passes[a].outputs.push_back(r);
+		g.passes[b].inputs.push_back(r);
+		g.passes[c].outputs.push_back(r);
+		RenderGraphSimReport rep;
+		SimulateRenderGraph(g, rep);
+		// A-B, C-B (read), A-C (write)
+		sl12::u32 rwCount = 0, wwCount = 0;
+		for (auto&& h : rep.hazards)
+			(h.bWriteWrite ? wwCount : rwCount)++;
+		if (rwCount != 2 || wwCount != 1)
+			errorCount++;
+
+		g.edges.push_back(std::make_pair(a, b));
+		g.edges.push_back(std::make_pair(b, c));
+		SimulateRenderGraph(g, rep);
+		if (!rep.hazards.empty())
+			errorCount++;
+	}
+
+	// 生成されないリソース
+	{
+		RenderGraphSimGraph g;
+		sl12::u32 a = AddPass(g, "A", 0, 1.0f);
+		g.passes[a].inputs.push_back(g.FindOrAddResource("Missing", 16, false));
+		g.passes[a].inputs.push_back(g.FindOrAddResource("History", 16, true));
+		RenderGraphSimReport rep;
+		SimulateRenderGraph(g, rep);
+		if (rep.missingProducers.size() != 1 || rep.missingProducers[0].first != a)
+			errorCount++;
+	}
+
+	// 循環
+	{
+		RenderGraphSimGraph g;
+		sl12::u32 a = AddPass(g, "A", 0, 1.0f);
+		sl12::u32 b = AddPass(g, "B", 0, 1.0f);
+		g.edges.push_back(std::make_pair(a, b));
+		g.edges.push_back(std::make_pair(b, a));
+		RenderGraphSimReport rep;
+		SimulateRenderGraph(g, rep);
+		if (!rep.bHasCycle)
+			errorCount++;
+	}
+
+	// トランジェントメモリのピーク
+	{
+		RenderGraphSimGraph g;
+		sl12::u32 a = AddPass(g, "A", 0, 1.0f);
+		sl12::u32 b = AddPass(g, "B", 0, 1.0f);
+		sl12::u32 c = AddPass(g, "C", 0, 1.0f);
+		sl12::u32 r1 = g.FindOrAddResource("R1", 100, false);
+		sl12::u32 r2 = g.FindOrAddResource("R2", 200, false);
+		sl12::u32 r3 = g.FindOrAddResource("R3", 50, false);
+		sl12::u32 h = g.FindOrAddResource("H", 1000, true);
+		g.passes[a].outputs.push_back(r1);
+		g.passes[b].inputs.push_back(r1);
+		g.passes[b].outputs.push_back(r2);
+		g.passes[c].inputs.push_back(r2);
+		g.passes[c].outputs.push_back(r3);
+		g.passes[c].outputs.push_back(h);
+		g.edges.push_back(std::make_pair(a, b));
+		g.edges.push_back(std::make_pair(b, c));
+		RenderGraphSimReport rep;
+		SimulateRenderGraph(g, rep);
+		if (rep.peakTransientMemory != 300 || rep.totalTransientMemory != 350)
+			errorCount++;
+	}
+
+	return errorCount;
+}
+
+//	EOF
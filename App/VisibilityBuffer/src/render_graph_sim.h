@@ -0,0 +1,95 @@
+﻿#pragma once
+
+#include "sl12/types.h"
+#include <string>
+#include <vector>
+
+
+//----
+// レンダーグラフのシミュレーション
+// パスの入出力リソースとエッジから、実行順、クリティカルパス、キュー間の待ち、
+// 推定オーバーラップ、トランジェントメモリのピークを求める
+// D3D12に依存しないので、アプリケーション外でも実行できる
+
+static const sl12::u32 kRenderGraphSimQueueCount = 3;	// 0:Graphics, 1:Compute, 2:Copy
+
+// リソースを配置するヒープの種類 (リソースヒープTier1では混在できない)
+static const sl12::u32 kRenderGraphSimHeapBuffer = 0;
+static const sl12::u32 kRenderGraphSimHeapTexture = 1;
+static const sl12::u32 kRenderGraphSimHeapRTDS = 2;
+static const sl12::u32 kRenderGraphSimHeapKindCount = 3;
+
+struct RenderGraphSimResource
+{
+	std::string		name;
+	sl12::u64		size = 0;
+	bool			bPersistent = false;	// ヒストリーや外部リソースはエイリアスされない
+	sl12::u32		heapKind = kRenderGraphSimHeapBuffer;
+};	// struct RenderGraphSimResource
+
+struct RenderGraphSimPass
+{
+	std::string					name;
+	sl12::u32					queue = 0;
+	float						cost = 1.0f;		// 推定実行時間 (単位は任意)
+	std::vector<sl12::u32>		inputs;				// resourcesのインデックス
+	std::vector<sl12::u32>		outputs;
+};	// struct RenderGraphSimPass
+
+struct RenderGraphSimGraph
+{
+	std::vector<RenderGraphSimResource>						resources;
+	std::vector<RenderGraphSimPass>							passes;
+	std::vector<std::pair<sl12::u32, sl12::u32>>			edges;		// parent -> child
+
+	// 名前からリソースを探し、なければ追加する
+	// 同じリソースが複数回登録された場合、サイズとヒープの種類は大きい方を使う
+	sl12::u32 FindOrAddResource(const std::string& name, sl12::u64 size, bool bPersistent, sl12::u32 heapKind = kRenderGraphSimHeapBuffer);
+};	// struct RenderGraphSimGraph
+
+// キュー間の待ち
+struct RenderGraphSimWait
+{
+	sl12::u32	parent = 0;
+	sl12::u32	child = 0;
+	float		idle = 0.0f;		// 子のキューが親を待って空いた時間
+};	// struct RenderGraphSimWait
+
+// 同期されていない同一リソースへのアクセス
+struct RenderGraphSimHazard
+{
+	sl12::u32	resource = 0;
+	sl12::u32	passA = 0;
+	sl12::u32	passB = 0;
+	bool		bWriteWrite = false;
+};	// struct RenderGraphSimHazard
+
+struct RenderGraphSimReport
+{
+	bool								bHasCycle = false;
+	std::vector<sl12::u32>				order;				// トポロジカル順
+	std::vector<sl12::u32>				criticalPath;
+	float								criticalPathCost = 0.0f;
+	float								serialCost = 0.0f;	// 全パスを1キューで実行した場合
+	float								makespan = 0.0f;	// キューごとに順番に実行した場合
+	float								overlap = 0.0f;		// serialCost - makespan
+	std::vector<float>					passStart;
+	std::vector<float>					passFinish;
+	std::vector<RenderGraphSimWait>		crossQueueWaits;
+	std::vector<RenderGraphSimHazard>	hazards;
+	std::vector<std::pair<sl12::u32, sl12::u32>>	missingProducers;	// (pass, resource)
+	std::vector<float>					resourceBegin;		// トランジェントリソースの生存期間 [begin, end)
+	std::vector<float>					resourceEnd;		// 永続リソースと未使用のリソースは空
+	sl12::u64							peakTransientMemory = 0;
+	sl12::u64							totalTransientMemory = 0;	// エイリアスしない場合
+};	// struct RenderGraphSimReport
+
+// グラフをシミュレートする
+// 循環がある場合はbHasCycleをtrueにして、それ以外の結果は空になる
+void SimulateRenderGraph(const RenderGraphSimGraph& graph, RenderGraphSimReport& outReport);
+
+// 合成したグラフでシミュレーションを検証する
+// 戻り値は失敗したケース数
+sl12::u32 ValidateRenderGraphSim();
+
+//	EOF
@@ -145,6 +145,7 @@ bool RTPipelineManager::SetupMaterialHitGroupTable(
 	auto viewDescSize = rtDescMan_->GetViewDescSize();
 	auto samplerDescSize = rtDescMan_->GetSamplerDescSize();
 	auto localHandleStart = rtDescMan_->IncrementLocalHandleStart();
+	auto pMR = pScene->GetMeshletResource();
 	auto FillMeshTable = [&](const sl12::ResourceItemMesh* pMeshItem)
 	{
 		auto&& submeshes = pMeshItem->GetSubmeshes();
@@ -167,7 +168,9 @@ bool RTPipelineManager::SetupMaterialHitGroupTable(
 				ormSrv = &pTexORM->GetTextureView();
 			}
 
-			opaqueTable.push_back(material.blendType == sl12::ResourceMeshMaterialBlendType::Opaque);
+			// メッシュレットが全て不透明にベイクされたマスクのサブメッシュは、エニーヒットなしのヒットグループを使う
+			opaqueTable.push_back(material.blendType == sl12::ResourceMeshMaterialBlendType::Opaque
+				|| (material.blendType == sl12::ResourceMeshMaterialBlendType::Masked && pMR->IsSubmeshAlphaOpaque(pMeshItem, (sl12::u32)i)));
 
 			RtShaderTableLocalRecord table{};
 
@@ -1,5 +1,7 @@
 ﻿#include "sample_application.h"
+#include "meshlet_bound.h"
 #include "shader_types.h"
+#include "software_vrs.h"
 
 #include "sl12/resource_mesh.h"
 #include "sl12/string_util.h"
@@ -12,8 +14,10 @@
 #define NOMINMAX
 #include <windowsx.h>
 #include <algorithm>
+#include <chrono>
 #include <memory>
 #include <random>
+#include <set>
 
 #include "../shaders/constant_defs.h"
 #define USE_IN_CPP
@@ -24,6 +28,7 @@
 namespace
 {
 	static const float kFovY = 90.0f;
+	static const float kNearZ = 0.1f;
 
 	static const char* kResourceDir = "resources";
 	static const char* kShaderDir = "VisibilityBuffer/shaders";
@@ -32,19 +37,23 @@ namespace
 	static const char* kRtxgiShaderDir = "../SampleLib12/ThirdParty/RTXGI-DDGI/rtxgi-sdk/shaders/ddgi";
 	static const char* kShaderPDBDir = "ShaderPDB/";
 
-	static const sl12::u32 kShadowMapSize = 1024;
+	// render_resource_settings.hと合わせる
+	static const sl12::u32 kShadowMapSize = 2048;
+	static_assert(kShadowCascadeMax == SHADOW_CASCADE_MAX, "shadow cascade count mismatch.");
 
 	static const sl12::u32 kIndirectArgsBufferStride = 4 + sizeof(D3D12_DRAW_INDEXED_ARGUMENTS); // root constant + draw indexed args.
 
-	struct MeshletBound
-	{
-		DirectX::XMFLOAT3		aabbMin;
-		DirectX::XMFLOAT3		aabbMax;
-		DirectX::XMFLOAT3		coneApex;
-		DirectX::XMFLOAT3		coneAxis;
-		float					coneCutoff;
-		sl12::u32				pad[3];
-	};	// struct MeshletBound
+	// プレフィックススキャンのベンチマークで計測する要素数
+	static const sl12::u32 kPrefixScanBenchmarkCounts[] = {
+		1 << 10, 1 << 12, 1 << 14, 1 << 16, 1 << 18, 1 << 20, 1 << 22, 1 << 24,
+	};
+
+	// アップロードテーブル構築のベンチマークで計測するインスタンス数
+	static const sl12::u32 kTableBuildBenchmarkCounts[] = {
+		1000, 10000, 100000, 1000000,
+	};
+	// テーブル構築ベンチマークで使うCPUメモリの上限
+	static const sl12::u64 kTableBuildBenchmarkMemoryLimit = 4ull * 1024 * 1024 * 1024;
 
 	std::string CreateTimestampedFilename(const std::string& originalFilename)
 	{
@@ -71,10 +80,11 @@ namespace
 	}
 }
 
-SampleApplication::SampleApplication(HINSTANCE hInstance, int nCmdShow, int screenWidth, int screenHeight, sl12::ColorSpaceType csType, const std::string& homeDir, int meshType, const std::string& appShader, const std::string& sysShader)
+SampleApplication::SampleApplication(HINSTANCE hInstance, int nCmdShow, int screenWidth, int screenHeight, sl12::ColorSpaceType csType, const std::string& homeDir, int meshType, int meshGridWidth, const std::string& appShader, const std::string& sysShader)
 	: Application(hInstance, nCmdShow, screenWidth, screenHeight, csType)
 	, displayWidth_(screenWidth), displayHeight_(screenHeight)
 	, meshType_(meshType)
+	, meshGridWidth_(meshGridWidth)
 {
 	std::filesystem::path p(homeDir);
 	p = std::filesystem::absolute(p);
@@ -162,6 +172,7 @@ bool SampleApplication::Initialize()
 	}
 
 	// create scene meshes.
+	scene_->SetMeshGridWidth(meshGridWidth_);
 	scene_->CreateSceneMeshes(meshType_);
 
 	// create RTXGI component.
@@ -207,7 +218,7 @@ void SampleApplication::SetupConstantBuffers(TemporalCBs& OutCBs)
 	auto cbvMan = renderSys_->GetCbvManager();
 	{
 		DirectX::XMFLOAT3 upVec(0.0f, 1.0f, 0.0f);
-		float Zn = 0.1f;
+		float Zn = kNearZ;
 		auto cp = DirectX::XMLoadFloat3(&cameraPos_);
 		auto dir = DirectX::XMLoadFloat3(&cameraDir_);
 		auto up = DirectX::XMLoadFloat3(&upVec);
@@ -286,65 +297,57 @@ void SampleApplication::SetupConstantBuffers(TemporalCBs& OutCBs)
 		// NOTE: dirF3 is invert light vector.
 		DirectX::XMFLOAT3 lightDir = DirectX::XMFLOAT3(-dirF3.x, -dirF3.y, -dirF3.z);
 
-		auto front = DirectX::XMVectorSet(-dirF3.x, -dirF3.y, -dirF3.z, 0.0f);
-		auto up = DirectX::XMVectorSet(0.0f, 1.0f, 0.0f, 0.0f);
-		auto right = DirectX::XMVector3Cross(front, up);
-		auto lenV = DirectX::XMVector3Length(right);
-		float len;
-		DirectX::XMStoreFloat(&len, lenV);
-		if (len < 1e-4f)
-		{
-			up = DirectX::XMVectorSet(1.0f, 0.0f, 0.0f, 0.0f);
-			right = DirectX::XMVector3Cross(front, up);
-		}
-		right = DirectX::XMVector3Normalize(right);
-		up = DirectX::XMVector3Normalize(DirectX::XMVector3Cross(right, front));
-
 		DirectX::XMFLOAT3 sceneAABBMin, sceneAABBMax;
 		scene_->GetSceneAABB(sceneAABBMin, sceneAABBMax);
-		DirectX::XMVECTOR pnts[] = {
-			DirectX::XMVectorSet(sceneAABBMax.x, sceneAABBMax.y, sceneAABBMax.z, 1.0f),
-			DirectX::XMVectorSet(sceneAABBMax.x, sceneAABBMax.y, sceneAABBMin.z, 1.0f),
-			DirectX::XMVectorSet(sceneAABBMax.x, sceneAABBMin.y, sceneAABBMax.z, 1.0f),
-			DirectX::XMVectorSet(sceneAABBMax.x, sceneAABBMin.y, sceneAABBMin.z, 1.0f),
-			DirectX::XMVectorSet(sceneAABBMin.x, sceneAABBMax.y, sceneAABBMax.z, 1.0f),
-			DirectX::XMVectorSet(sceneAABBMin.x, sceneAABBMax.y, sceneAABBMin.z, 1.0f),
-			DirectX::XMVectorSet(sceneAABBMin.x, sceneAABBMin.y, sceneAABBMax.z, 1.0f),
-			DirectX::XMVectorSet(sceneAABBMin.x, sceneAABBMin.y, sceneAABBMin.z, 1.0f),
-		};
-		DirectX::XMFLOAT3 lsAABBMax(-FLT_MAX, -FLT_MAX, -FLT_MAX), lsAABBMin(FLT_MAX, FLT_MAX, FLT_MAX);
-		for (auto pnt : pnts)
-		{
-			float t;
-			auto v = DirectX::XMVector3Dot(right, pnt);
-			DirectX::XMStoreFloat(&t, v);
-			lsAABBMax.x = std::max(lsAABBMax.x, t);
-			lsAABBMin.x = std::min(lsAABBMin.x, t);
-
-			v = DirectX::XMVector3Dot(up, pnt);
-			DirectX::XMStoreFloat(&t, v);
-			lsAABBMax.y = std::max(lsAABBMax.y, t);
-			lsAABBMin.y = std::min(lsAABBMin.y, t);
-
-			v = DirectX::XMVector3Dot(front, pnt);
-			DirectX::XMStoreFloat(&t, v);
-			lsAABBMax.z = std::max(lsAABBMax.z, t);
-			lsAABBMin.z = std::min(lsAABBMin.z, t);
-		}
-		float width = std::max(lsAABBMax.x - lsAABBMin.x, lsAABBMax.y - lsAABBMin.y);
-		auto cp = DirectX::XMVectorScale(right, (lsAABBMax.x + lsAABBMin.x) * 0.5f);
-		cp = DirectX::XMVectorAdd(DirectX::XMVectorScale(up, (lsAABBMax.y + lsAABBMin.y) * 0.5f), cp);
-		cp = DirectX::XMVectorAdd(DirectX::XMVectorScale(front, lsAABBMin.z), cp);
-		auto mtxWorldToView = DirectX::XMMatrixLookAtRH(cp, DirectX::XMVectorAdd(cp, front), up);
-		auto mtxViewToClip = sl12::MatrixOrthoInverseFovRH(width, width, 0.0f, lsAABBMax.z - lsAABBMin.z);
-		auto mtxWorldToClip = mtxWorldToView * mtxViewToClip;
 
-		ShadowCB cbShadow;
-		DirectX::XMStoreFloat4x4(&cbShadow.mtxWorldToProj, mtxWorldToClip);
+		// カメラの視錐台をシャドウ距離までカスケードに分割し、それぞれのスライスに平行投影を合わせる
+		// 奥行はシーン全体を覆うので、スライスの外のキャスターも描画される
+		sl12::u32 cascadeCount = (sl12::u32)shadowCascadeCount_;
+		sl12::u32 cascadeMapSize = (cascadeCount > 1) ? kShadowMapSize / 2 : kShadowMapSize;
+		DirectX::XMStoreFloat4x4(&shadowCamera_.mtxViewToWorld, DirectX::XMMatrixInverse(nullptr, mtxPrevWorldToView_));
+		shadowCamera_.fovY = DirectX::XMConvertToRadians(kFovY);
+		shadowCamera_.aspect = (float)displayWidth_ / (float)displayHeight_;
+
+		float splits[kShadowCascadeMax + 1];
+		CalcShadowCascadeSplits(cascadeCount, kNearZ, shadowDistance_, shadowSplitLambda_, splits);
+
+		ShadowCB cbShadow{};
 		cbShadow.exponent = DirectX::XMFLOAT2(shadowExponent_, shadowExponent_);
 		cbShadow.constBias = shadowBias_;
+		cbShadow.cascadeCount = cascadeCount;
+		cbShadow.atlasRect = DirectX::XMFLOAT4(0.0f, 0.0f, 1.0f, 1.0f);
+		DirectX::XMFLOAT4X4 mtxWorldToShadows[kShadowCascadeMax];
+		for (sl12::u32 i = 0; i < cascadeCount; i++)
+		{
+			FitShadowCascade(shadowCamera_, splits[i], splits[i + 1], lightDir, sceneAABBMin, sceneAABBMax, cascadeMapSize, shadowCascades_[i]);
+			mtxWorldToShadows[i] = shadowCascades_[i].mtxWorldToClip;
+			cbShadow.mtxCascadeWorldToProj[i] = shadowCascades_[i].mtxWorldToClip;
+			cbShadow.cascadeAtlasRect[i] = GetShadowCascadeAtlasRect(i, cascadeCount);
+		}
+		cbShadow.mtxWorldToProj = mtxWorldToShadows[0];
+
+		// 仮想シャドウマップはカメラに依存せずシーン全体を覆う
+		CalcVirtualShadowProjection(lightDir, sceneAABBMin, sceneAABBMax, cbShadow.mtxWorldToVirtual);
+		mtxWorldToVirtual_ = cbShadow.mtxWorldToVirtual;
 
 		OutCBs.hShadowCB = cbvMan->GetTemporal(&cbShadow, sizeof(cbShadow));
+
+		for (sl12::u32 i = 0; i < cascadeCount; i++)
+		{
+			// シャドウマップ描画とカリングはカスケードの行列とタイルを使う
+			ShadowCB cbCascade = cbShadow;
+			cbCascade.mtxWorldToProj = mtxWorldToShadows[i];
+			cbCascade.atlasRect = cbShadow.cascadeAtlasRect[i];
+			OutCBs.hShadowCascadeCBs[i] = cbvMan->GetTemporal(&cbCascade, sizeof(cbCascade));
+
+			// キャスターはカスケードのスライスをライト方向に伸ばした平面でカリングする
+			FrustumCB cbShadowFrustum;
+			CalcShadowCasterPlanes(shadowCascades_[i].slicePlanes, lightDir, cbShadowFrustum.frustumPlanes);
+			OutCBs.hShadowFrustumCBs[i] = cbvMan->GetTemporal(&cbShadowFrustum, sizeof(cbShadowFrustum));
+		}
+
+		shadowLightDir_ = lightDir;
+		scene_->UpdateShadowHistory(mtxWorldToShadows, cascadeCount, bEnableShadowCache_);
 	}
 	{
 		const float kSigma = 2.0f;
@@ -488,6 +491,42 @@ bool SampleApplication::Execute()
 	sl12::CpuTimer delta = now - currCpuTime_;
 	currCpuTime_ = now;
 
+	// 前フレームのヒープ確保数を記録して、フレームアリーナをリセットする
+	{
+		sl12::u64 heapAllocCount = GetHeapAllocCount();
+		heapAllocsLastFrame_ = heapAllocCount - heapAllocCountPrev_;
+		heapAllocCountPrev_ = heapAllocCount;
+
+		auto&& arena = scene_->GetFrameArena();
+		if (heapAllocBenchFrame_ > 0)
+		{
+			// 前フレームの確保数を、前フレームの設定に加算する
+			int prev = heapAllocBenchFrame_ - 1;
+			if (prev % kHeapAllocBenchFrames >= kHeapAllocBenchWarmup)
+			{
+				heapAllocBenchSums_[prev / kHeapAllocBenchFrames] += heapAllocsLastFrame_;
+			}
+		}
+		if (heapAllocBenchFrame_ >= kHeapAllocBenchFrames * 2)
+		{
+			for (int i = 0; i < 2; i++)
+			{
+				heapAllocBenchResults_[i] = (double)heapAllocBenchSums_[i] / (double)(kHeapAllocBenchFrames - kHeapAllocBenchWarmup);
+			}
+			heapAllocBenchFrame_ = -1;
+		}
+		if (heapAllocBenchFrame_ >= 0)
+		{
+			arena.SetEnable(heapAllocBenchFrame_ >= kHeapAllocBenchFrames);
+			heapAllocBenchFrame_++;
+		}
+		else
+		{
+			arena.SetEnable(bEnableFrameArena_);
+		}
+		arena.Reset();
+	}
+
 	// control camera.
 	ControlCamera(delta.ToSecond());
 
@@ -507,6 +546,11 @@ bool SampleApplication::Execute()
 			{
 				if (ImGui::Checkbox("Mesh Shader for VisRender", &bEnableMeshShader_))
 				{}
+				if (!bEnableMeshShader_)
+				{
+					// メッシュシェーダ版は常にオクルージョンカリングする
+					ImGui::Checkbox("Occlusion Culling for VisRender", &bEnableOcclusionCulling_);
+				}
 
 				static const char* kVisToGBTypes[] = {
 					"Depth & Tile",
@@ -516,6 +560,31 @@ bool SampleApplication::Execute()
 				};
 				ImGui::Combo("Vis to GBuffer", &VisToGBufferType_, kVisToGBTypes, ARRAYSIZE(kVisToGBTypes));
 			}
+
+			// CPUでオクルーダーをラスタライズし、隠れたインスタンスを描画しない
+			// 実験的な機能: オクルーダーが保守的でないため、見えているインスタンスが消えることがある
+			ImGui::Checkbox("Software Occlusion (experimental)", &bEnableSoftwareOcclusion_);
+
+			// ソートキーによる描画順の効果 (インスタンス順 -> ソート後)
+			if (!bEnableVisibilityBuffer_ || !bEnableMeshShader_)
+			{
+				// マスクを全インスタンスで1つの描画リストにまとめ、テクスチャはバインドレスで引く
+				ImGui::Checkbox("Bindless Masked", &bEnableBindlessMasked_);
+
+				auto&& drawStats = scene_->GetDrawSortStats();
+				const DrawStateStats& before = bEnableVisibilityBuffer_ ? drawStats.visibilityInstanceOrder : drawStats.gbufferInstanceOrder;
+				const DrawStateStats& after = bEnableVisibilityBuffer_ ? drawStats.visibilitySorted : drawStats.gbufferSorted;
+				ImGui::Text("  pso changes : %u -> %u", before.psoChanges, after.psoChanges);
+				ImGui::Text("  descriptor changes : %u -> %u", before.descriptorChanges, after.descriptorChanges);
+				ImGui::Text("  vertex buffer changes : %u -> %u", before.vertexBufferChanges, after.vertexBufferChanges);
+				ImGui::Text("  execute indirect : %u", after.executeCount);
+
+				// 描画コマンド記録のCPU時間 (VisibilityBufferはVisibilityVsPass、それ以外はDepthPrePass)
+				auto&& recordStats = scene_->GetDrawRecordStats();
+				auto&& recordTime = bEnableVisibilityBuffer_ ? recordStats.visibility : recordStats.depthPre;
+				ImGui::Text("  draw recording (cpu) : %f (ms)", recordTime.averageMicroSec / 1000.0);
+				ImGui::Text("  draw recording execute indirect : %u", recordTime.executeCount);
+			}
 		}
 
 		// light settings.
@@ -531,7 +600,32 @@ bool SampleApplication::Execute()
 		// shadow settings.
 		if (ImGui::CollapsingHeader("Shadow", ImGuiTreeNodeFlags_None))
 		{
+			ImGui::Checkbox("Virtual Shadow Map", &bEnableVirtualShadow_);
+			if (bEnableVirtualShadow_)
+			{
+				auto&& vsmStats = scene_->GetVsmPageTable().GetStats();
+				ImGui::SliderInt("Page Budget", &vsmPageBudget_, 1, 64);
+				ImGui::Text("  pages requested : %u  resident : %u", vsmStats.requestedPages, vsmStats.residentPages);
+				ImGui::Text("  pages allocated : %u  evicted : %u  overflow : %u", vsmStats.allocatedPages, vsmStats.evictedPages, vsmStats.overflowPages);
+				ImGui::Text("  pages rendered : %u  dirty : %u", vsmStats.renderedPages, vsmStats.dirtyPages);
+			}
 			ImGui::Checkbox("Blur", &evsmBlur_);
+			ImGui::Checkbox("Meshlet Culling", &bEnableShadowCulling_);
+			if (bEnableShadowCulling_)
+			{
+				ImGui::Checkbox("Occlusion Culling", &bEnableShadowOcclusion_);
+			}
+			ImGui::Checkbox("Static Cache", &bEnableShadowCache_);
+			if (bEnableShadowCache_)
+			{
+				auto&& cacheStats = scene_->GetShadowCacheStats();
+				ImGui::Text("  cascades rendered : %u  reused : %u", cacheStats.renderedCascades, cacheStats.reusedCascades);
+				ImGui::Text("  frames rendered : %llu  reused : %llu", cacheStats.renderedFrames, cacheStats.reusedFrames);
+				ImGui::Text("  caster hash : %016llx", cacheStats.casterHash);
+			}
+			ImGui::SliderInt("Cascade Count", &shadowCascadeCount_, 1, kShadowCascadeMax);
+			ImGui::SliderFloat("Split Lambda", &shadowSplitLambda_, 0.0f, 1.0f);
+			ImGui::SliderFloat("Shadow Distance", &shadowDistance_, 500.0f, 20000.0f);
 			ImGui::SliderFloat("Exponent", &shadowExponent_, 0.1f, 50.0f);
 			ImGui::SliderFloat("Constant Bias", &shadowBias_, 0.001f, 0.02f);
 		}
@@ -721,6 +815,329 @@ bool SampleApplication::Execute()
 				device_.GetTextureStreamAllocator()->SetPoolLimitSize(kPoolLimits[poolSizeSelect_]);
 			}
 			ImGui::Text("Heaps : %lld (MB)", device_.GetTextureStreamAllocator()->GetCurrentHeapSize() / 1024 / 1024);
+
+			// 現在のシーンでCPUカリングを計測する
+			// CPUカリングは検証用で、描画には使わない
+			if (ImGui::Button("CPU Cull Benchmark"))
+			{
+				MeshletCullData cullData;
+				scene_->GetMeshletResource()->GatherCullData(cullData);
+
+				MeshletCullInput input;
+				cullData.SetupInput(input);
+				sl12::CalcFrustumPlanes(mtxPrevWorldToClip_, true, true, input.frustumPlanes);
+				input.eyePosition = cameraPos_;
+				DirectX::XMStoreFloat4x4(&input.mtxWorldToProj, mtxPrevWorldToClip_);
+				input.screenSize = DirectX::XMFLOAT2((float)displayWidth_, (float)displayHeight_);
+				input.nearFar = DirectX::XMFLOAT2(kNearZ, 0.0f);
+				cpuCullResult_ = RunMeshletCullBenchmark(input, nullptr, 16);
+			}
+			// シーン先頭のメッシュを1k～1M個並べたときのテーブル構築時間を計測する
+			if (ImGui::Button("Table Build Benchmark"))
+			{
+				auto resMesh = scene_->GetSceneMeshes().front()->GetParentResource();
+				tableBuildResults_.clear();
+				for (auto count : kTableBuildBenchmarkCounts)
+				{
+					auto result = MeshletResource::RunTableBuildBenchmark(resMesh, count, kTableBuildBenchmarkMemoryLimit);
+					if (result.bSkipped)
+					{
+						sl12::ConsolePrint("TableBuild: %u instances skipped (%.1f MB)\n", count, result.tableBytes / (1024.0 * 1024.0));
+					}
+					else
+					{
+						sl12::ConsolePrint("TableBuild: %u instances, %u args : register %f (ms), fill %f (ms), %.1f MB\n",
+							count, result.argCount, result.registerMs, result.fillMs, result.tableBytes / (1024.0 * 1024.0));
+					}
+					tableBuildResults_.push_back(result);
+				}
+			}
+			for (auto&& result : tableBuildResults_)
+			{
+				if (result.bSkipped)
+				{
+					ImGui::Text("  %7u : skipped (%.1f MB)", result.instanceCount, result.tableBytes / (1024.0 * 1024.0));
+				}
+				else
+				{
+					ImGui::Text("  %7u : register %f (ms), fill %f (ms)", result.instanceCount, result.registerMs, result.fillMs);
+				}
+			}
+			// シーンの全meshletでcompact版のboundが保守的であることを確認する
+			if (ImGui::Button("Validate Meshlet Bound"))
+			{
+				std::set<const sl12::ResourceItemMesh*> resMeshes;
+				for (auto&& mesh : scene_->GetSceneMeshes())
+				{
+					resMeshes.insert(mesh->GetParentResource());
+				}
+				meshletBoundErrors_ = 0;
+				meshletBoundCount_ = 0;
+				for (auto resMesh : resMeshes)
+				{
+					sl12::u32 count = 0;
+					meshletBoundErrors_ += (int)ValidateMeshletBounds(resMesh, &count);
+					meshletBoundCount_ += count;
+				}
+			}
+			if (meshletBoundErrors_ >= 0)
+			{
+				ImGui::Text("  meshlet bound errors : %d / %u", meshletBoundErrors_, meshletBoundCount_);
+			}
+			// GPUのメッシュレットカリング結果を読み戻して検証する
+			if (ImGui::Button("Validate Meshlet Cull") && meshletCullValidateStep_ < 0)
+			{
+				scene_->RequestMeshletCullReadback();
+				meshletCullValidateStep_ = 0;
+			}
+			if (meshletCullErrors_ >= 0)
+			{
+				auto&& v = meshletCullValidation_;
+				ImGui::Text("  visible : %u + %u (cpu %u), mismatch : %u", v.visibleCount[0], v.visibleCount[1], v.referenceCount, v.mismatchCount);
+				ImGui::Text("  compact errors : %u", v.compactErrors);
+				ImGui::Text("  draw flag errors : %u, 2nd pass errors : %u", v.drawFlagErrors, v.phaseErrors);
+			}
+			// 実行時のインスタンス追加/削除/移動
+			// 追加するインスタンスは直前のメッシュを複製して、X方向に並べる
+			if (ImGui::Button("Add Instance"))
+			{
+				auto src = debugInstances_.empty() ? scene_->GetSceneMeshes().back() : debugInstances_.back().mesh;
+				auto resMesh = src->GetParentResource();
+				auto&& box = resMesh->GetBoundingInfo().box;
+				DirectX::XMVECTOR size = DirectX::XMVector3TransformNormal(
+					DirectX::XMVectorSubtract(DirectX::XMLoadFloat3(&box.aabbMax), DirectX::XMLoadFloat3(&box.aabbMin)),
+					DirectX::XMLoadFloat4x4(&src->GetMtxLocalToWorld()));
+				float worldSize = DirectX::XMVectorGetX(DirectX::XMVector3Length(size));
+
+				DebugInstance inst;
+				inst.mtxBase = debugInstances_.empty() ? src->GetMtxLocalToWorld() : debugInstances_.back().mtxBase;
+				inst.mtxBase._41 += worldSize * 1.5f;
+				inst.amplitude = worldSize * 0.5f;
+				inst.mesh = std::make_shared<sl12::SceneMesh>(&device_, resMesh);
+				inst.mesh->SetMtxLocalToWorld(inst.mtxBase);
+				scene_->AddSceneMesh(inst.mesh);
+				debugInstances_.push_back(inst);
+				instanceEditErrors_ = scene_->GetMeshletResource()->ValidateDrawCallRanges() ? 0 : 1;
+			}
+			ImGui::SameLine();
+			if (ImGui::Button("Remove Instance") && !debugInstances_.empty())
+			{
+				instanceEditErrors_ = scene_->RemoveSceneMesh(debugInstances_.back().mesh) ? 0 : 1;
+				debugInstances_.pop_back();
+				instanceEditErrors_ += scene_->GetMeshletResource()->ValidateDrawCallRanges() ? 0 : 1;
+			}
+			ImGui::SameLine();
+			ImGui::Checkbox("Move Instances", &bMoveDebugInstances_);
+			if (bMoveDebugInstances_)
+			{
+				debugInstanceTime_ += delta.ToSecond();
+				for (size_t i = 0; i < debugInstances_.size(); i++)
+				{
+					auto&& inst = debugInstances_[i];
+					DirectX::XMFLOAT4X4 mtx = inst.mtxBase;
+					mtx._42 += std::sin(debugInstanceTime_ + (float)i) * inst.amplitude;
+					scene_->UpdateSceneMeshTransform(inst.mesh, mtx);
+				}
+			}
+			if (instanceEditErrors_ >= 0)
+			{
+				ImGui::Text("  added instances : %d, errors : %d", (int)debugInstances_.size(), instanceEditErrors_);
+			}
+			// シャドウの視錐台カリングをCPUで実行し、保守的であることを確認する
+			// 結果は全カスケードの合計
+			if (ImGui::Button("Validate Shadow Cull"))
+			{
+				MeshletCullData cullData;
+				scene_->GetMeshletResource()->GatherCullData(cullData);
+
+				shadowCullVisible_ = shadowCullTotal_ = shadowCullErrors_ = 0;
+				for (int i = 0; i < shadowCascadeCount_; i++)
+				{
+					auto&& cascade = shadowCascades_[i];
+
+					MeshletCullInput input;
+					cullData.SetupInput(input);
+					CalcShadowCasterPlanes(cascade.slicePlanes, shadowLightDir_, input.frustumPlanes);
+					input.mtxWorldToProj = cascade.mtxWorldToClip;
+
+					std::vector<sl12::u32> visibleBits;
+					shadowCullVisible_ += CullMeshletsShadowReference(input, nullptr, visibleBits);
+					shadowCullTotal_ += input.drawCallCount;
+					shadowCullErrors_ += ValidateShadowCullConservative(input, cascade.slicePlanes, shadowLightDir_, visibleBits);
+				}
+			}
+			if (shadowCullTotal_ > 0)
+			{
+				ImGui::Text("  shadow visible : %u / %u", shadowCullVisible_, shadowCullTotal_);
+				ImGui::Text("  shadow errors  : %u", shadowCullErrors_);
+			}
+			// カメラのテクセル未満の移動と回転でカスケードが揺れないことを確認する
+			if (ImGui::Button("Validate Cascade Stability"))
+			{
+				DirectX::XMFLOAT3 sceneAABBMin, sceneAABBMax;
+				scene_->GetSceneAABB(sceneAABBMin, sceneAABBMax);
+				sl12::u32 cascadeMapSize = (shadowCascadeCount_ > 1) ? kShadowMapSize / 2 : kShadowMapSize;
+
+				shadowCascadeStabilityErrors_ = 0;
+				for (int i = 0; i < shadowCascadeCount_; i++)
+				{
+					auto&& cascade = shadowCascades_[i];
+					shadowCascadeStabilityErrors_ += (int)ValidateShadowCascadeStability(shadowCamera_, cascade.splitNear, cascade.splitFar, shadowLightDir_,
+						sceneAABBMin, sceneAABBMax, cascadeMapSize);
+				}
+			}
+			if (shadowCascadeStabilityErrors_ >= 0)
+			{
+				ImGui::Text("  cascade errors : %d", shadowCascadeStabilityErrors_);
+			}
+			// 移動するカメラで仮想シャドウマップのページテーブルをシミュレーションする
+			// 物理ページが足りる場合と足りない場合の両方を確認する
+			if (ImGui::Button("Validate Virtual Shadow"))
+			{
+				vsmSimulationErrors_ = (int)(SimulateVirtualShadowMap(120, 1024, 16) + SimulateVirtualShadowMap(120, 64, 16));
+			}
+			if (vsmSimulationErrors_ >= 0)
+			{
+				ImGui::Text("  virtual shadow errors : %d", vsmSimulationErrors_);
+			}
+			// ブロックの処理順を変えてプレフィックススキャンのlook-backを検証する
+			if (ImGui::Button("Validate Prefix Scan"))
+			{
+				prefixScanErrors_ = (int)ValidatePrefixScan();
+			}
+			if (prefixScanErrors_ >= 0)
+			{
+				ImGui::Text("  prefix scan errors : %d", prefixScanErrors_);
+			}
+			// タイルビニングのソフトウェアVRSで、全ピクセルがちょうど1回書き込まれることを確認する
+			if (ImGui::Button("Validate Software VRS"))
+			{
+				softwareVrsErrors_ = (int)ValidateSoftwareVrs();
+			}
+			if (softwareVrsErrors_ >= 0)
+			{
+				ImGui::Text("  software vrs errors : %d", softwareVrsErrors_);
+			}
+			// classify_dump.binがあればダンプしたバッファも検証する
+			if (ImGui::Button("Validate Material Classify"))
+			{
+				materialClassifyErrors_ = (int)ValidateMaterialClassify("classify_dump.bin", &materialClassifyStats_);
+			}
+			if (materialClassifyErrors_ >= 0)
+			{
+				ImGui::Text("  material classify errors : %d", materialClassifyErrors_);
+				ImGui::Text("  tile index : dense %.2f MB, sparse %.2f MB, used %.2f MB",
+					(float)materialClassifyStats_.denseBytes / (1024.0f * 1024.0f),
+					(float)materialClassifyStats_.sparseBytes / (1024.0f * 1024.0f),
+					(float)materialClassifyStats_.usedBytes / (1024.0f * 1024.0f));
+				ImGui::Text("  max materials per tile : %d", materialClassifyStats_.maxTileMaterials);
+			}
+			// GPUの分類結果を読み戻して検証し、入力のバッファをclassify_dump.binに保存する
+			if (ImGui::Button("Validate GPU Classify") && classifyValidateStep_ < 0)
+			{
+				scene_->RequestClassifyReadback();
+				classifyValidateStep_ = 0;
+			}
+			if (gpuClassifyErrors_ >= 0)
+			{
+				auto&& v = classifyValidation_;
+				ImGui::Text("  gpu classify errors : layout %u, mismatch %u", v.layoutErrors, v.mismatchCount);
+				ImGui::Text("  tile index : dense %.2f MB, sparse %.2f MB, used %.2f MB (%u entries)",
+					(float)v.memory.denseBytes / (1024.0f * 1024.0f),
+					(float)v.memory.sparseBytes / (1024.0f * 1024.0f),
+					(float)v.memory.usedBytes / (1024.0f * 1024.0f),
+					v.entryCount);
+			}
+			// 合成テクスチャでメッシュレットのアルファ分類を検証する
+			if (ImGui::Button("Validate Meshlet Alpha"))
+			{
+				meshletAlphaErrors_ = (int)ValidateMeshletAlphaBake();
+			}
+			if (meshletAlphaErrors_ >= 0)
+			{
+				ImGui::Text("  meshlet alpha errors : %d", meshletAlphaErrors_);
+			}
+			// シーンのマスクのメッシュレットを分類して "<mesh file>.malpha" を書き出す
+			if (ImGui::Button("Bake Meshlet Alpha") && !bMeshletAlphaBaking_)
+			{
+				scene_->RequestMeshletAlphaBake();
+				bMeshletAlphaBaking_ = true;
+				meshletAlphaBakeCount_ = -1;
+			}
+			if (bMeshletAlphaBaking_)
+			{
+				ImGui::Text("  baking meshlet alpha...");
+			}
+			else if (meshletAlphaBakeCount_ >= 0)
+			{
+				ImGui::Text("  baked meshlet alpha files : %d", meshletAlphaBakeCount_);
+			}
+			{
+				// 読み込んだベイク結果 (マスクのメッシュレット)
+				auto alphaStats = scene_->GetMeshletResource()->GetMeshletAlphaStats();
+				ImGui::Text("  baked meshlet alpha : opaque %u, transparent %u, mixed %u", alphaStats.opaque, alphaStats.transparent, alphaStats.mixed);
+			}
+			// 合成したグラフでレンダーグラフのシミュレーションを検証する
+			if (ImGui::Button("Validate Render Graph Sim"))
+			{
+				renderGraphSimErrors_ = (int)ValidateRenderGraphSim();
+			}
+			if (renderGraphSimErrors_ >= 0)
+			{
+				ImGui::Text("  render graph sim errors : %d", renderGraphSimErrors_);
+			}
+			// 要素数を変えながらGPUのプレフィックススキャンを計測する
+			static const char* kPrefixScanTypes[] = {
+				"U32",
+				"U64",
+				"Segmented U32",
+			};
+			ImGui::Combo("Prefix Scan Type", &prefixScanType_, kPrefixScanTypes, ARRAYSIZE(kPrefixScanTypes));
+			ImGui::Checkbox("Prefix Scan Inclusive", &bPrefixScanInclusive_);
+			if (prefixScanStep_ < 0)
+			{
+				if (ImGui::Button("Prefix Scan Benchmark"))
+				{
+					prefixScanStep_ = 0;
+					prefixScanFrame_ = 0;
+					prefixScanTimeSum_ = 0.0;
+					prefixScanResults_.clear();
+				}
+			}
+			else
+			{
+				ImGui::Text("Prefix Scan Benchmark : %d / %d", prefixScanStep_, (int)ARRAYSIZE(kPrefixScanBenchmarkCounts));
+			}
+			for (auto&& result : prefixScanResults_)
+			{
+				ImGui::Text("  %8u : %f (ms) %.1f (M/s) cpu %f (ms) mismatch %u / %u",
+					result.elementCount, result.gpuMilliSec, (double)result.elementCount / result.gpuMilliSec / 1000.0,
+					result.cpuMicroSec / 1000.0, result.mismatchCount, result.checkedFrames);
+			}
+			if (bEnableSoftwareOcclusion_)
+			{
+				auto&& swStats = scene_->GetSoftwareOcclusionBuffer()->GetStats();
+				ImGui::Text("SW Occlusion : %f (ms)", scene_->GetSoftwareOcclusionMicroSec() / 1000.0);
+				ImGui::Text("  occluders  : %u (%u tris)", swStats.occluderCount, swStats.triangleCount);
+				ImGui::Text("  culled     : %u / %u", swStats.culledCount, swStats.testCount);
+				if (ImGui::Button("Dump Occlusion Depth"))
+				{
+					scene_->GetSoftwareOcclusionBuffer()->DumpDepth(CreateTimestampedFilename("OcclusionDepth.pfm"));
+				}
+			}
+			if (cpuCullResult_.drawCallCount > 0)
+			{
+				ImGui::Text("CPU Cull (validation only)");
+				ImGui::Text("  draw calls : %u (%u threads)", cpuCullResult_.drawCallCount, cpuCullResult_.threadCount);
+				ImGui::Text("  scalar     : %.1f (M/s)", cpuCullResult_.scalarRate / 1000000.0);
+				ImGui::Text("  simd x4    : %.1f (M/s)", cpuCullResult_.simdRate / 1000000.0);
+				if (cpuCullResult_.laneCount == 8)
+				{
+					ImGui::Text("  simd x8    : %.1f (M/s)", cpuCullResult_.simdWideRate / 1000000.0);
+				}
+				ImGui::Text("  simd par   : %.1f (M/s, %.1f per core)", cpuCullResult_.simdParallelRate / 1000000.0, cpuCullResult_.simdParallelRate / 1000000.0 / (double)cpuCullResult_.threadCount);
+				ImGui::Text("  mismatch   : %u", cpuCullResult_.mismatchCount);
+			}
 		}
 
 		// gpu performance.
@@ -757,6 +1174,124 @@ bool SampleApplication::Execute()
 		auto heapStatistics = scene_->GetRenderGraph()->GetHeapStatistics();
 		if (ImGui::CollapsingHeader("Render Graph", ImGuiTreeNodeFlags_DefaultOpen))
 		{
+			// 設定と解像度が変わらなければコンパイルを省略する
+			ImGui::Checkbox("Compile Cache", &bEnableRenderGraphCache_);
+			auto&& compileStats = scene_->GetRenderGraphCompileStats();
+			ImGui::Text("  compile : %f (ms), count %lld", compileStats.lastCompileMicroSec / 1000.0, compileStats.compileCount);
+			ImGui::Text("  cache hit : %f (ms), count %lld", compileStats.lastHitMicroSec / 1000.0, compileStats.hitCount);
+			// 描画リストの作成などをパス間で並列に行う
+			ImGui::Checkbox("Parallel Prepare", &bEnableParallelPrepare_);
+			auto&& recordStats = scene_->GetPassRecordStats();
+			double prepareSum = 0.0, recordSum = 0.0;
+			for (auto&& time : recordStats.passes)
+			{
+				prepareSum += time.prepareMicroSec;
+				recordSum += time.recordMicroSec;
+			}
+			ImGui::Text("  prepare : %f (ms), sum %f (ms)", recordStats.prepareWallMicroSec / 1000.0, prepareSum / 1000.0);
+			ImGui::Text("  record : %f (ms), passes %f (ms)", recordStats.recordWallMicroSec / 1000.0, recordSum / 1000.0);
+			if (ImGui::TreeNode("Pass CPU Times"))
+			{
+				for (auto&& time : recordStats.passes)
+				{
+					ImGui::Text("%s : prepare %f (ms), record %f (ms)", time.name.c_str(), time.prepareMicroSec / 1000.0, time.recordMicroSec / 1000.0);
+				}
+				ImGui::TreePop();
+			}
+			// パスの作業用メモリをフレームアリーナから確保する
+			ImGui::Checkbox("Frame Arena", &bEnableFrameArena_);
+			auto&& frameArena = scene_->GetFrameArena();
+#if HEAP_ALLOC_COUNTER
+			ImGui::Text("  heap allocs : %lld / frame (all threads)", heapAllocsLastFrame_);
+#else
+			ImGui::Text("  heap allocs : disabled (HEAP_ALLOC_COUNTER)");
+#endif
+			ImGui::Text("  arena : used %.2f / %.2f (KB), overflow %u", frameArena.GetLastUsedSize() / 1024.0, frameArena.GetCapacity() / 1024.0, frameArena.GetLastOverflowCount());
+			// アリーナの無効と有効を同じフレーム数ずつ計測する
+			if (heapAllocBenchFrame_ < 0)
+			{
+				if (ImGui::Button("Heap Alloc Benchmark"))
+				{
+					heapAllocBenchFrame_ = 0;
+					heapAllocBenchSums_[0] = heapAllocBenchSums_[1] = 0;
+				}
+			}
+			else
+			{
+				ImGui::Text("Heap Alloc Benchmark : %d / %d", heapAllocBenchFrame_, kHeapAllocBenchFrames * 2);
+			}
+			ImGui::SameLine();
+			if (ImGui::Button("Validate Frame Arena"))
+			{
+				frameArenaErrors_ = (int)ValidateFrameArena();
+			}
+			if (heapAllocBenchResults_[0] >= 0.0)
+			{
+				ImGui::Text("  heap allocs avg : arena off %.1f, arena on %.1f / frame", heapAllocBenchResults_[0], heapAllocBenchResults_[1]);
+			}
+			if (frameArenaErrors_ >= 0)
+			{
+				ImGui::Text("  frame arena errors : %d", frameArenaErrors_);
+			}
+			// 全ての設定の組み合わせでグラフをシミュレートする
+			// パスのコストは現在のGPU計測値 (us)、計測されていないパスは1
+			if (renderGraphSimIndex_ < 0)
+			{
+				if (ImGui::Button("Simulate All Setups"))
+				{
+					renderGraphSimIndex_ = 0;
+					renderGraphSimSummary_ = RenderGraphSimSummary();
+					renderGraphSimCosts_.clear();
+					auto pSimPerf = scene_->GetRenderGraph()->GetPerformanceResult();
+					for (auto queue : {sl12::HardwareQueue::Graphics, sl12::HardwareQueue::Compute})
+					{
+						auto&& perf = pSimPerf[queue];
+						for (size_t i = 0; i < perf.passNames.size(); i++)
+						{
+							renderGraphSimCosts_[perf.passNames[i]] = (float)perf.passMicroSecTimes[i];
+						}
+					}
+				}
+			}
+			else
+			{
+				ImGui::Text("Simulate All Setups : %d / %u", renderGraphSimIndex_, GetRenderPassSetupCombinationCount());
+			}
+			if (renderGraphSimSummary_.simulatedCount > 0)
+			{
+				auto&& sim = renderGraphSimSummary_;
+				ImGui::Text("  setups : %u (cycle %u, hazard %u, missing producer %u)",
+					sim.simulatedCount, sim.cycleCount, sim.hazardSetupCount, sim.missingProducerSetupCount);
+				ImGui::Text("  critical path : max %.1f", sim.maxCriticalPath);
+				ImGui::Text("  overlap : min %.1f, max %.1f", sim.minOverlap, sim.maxOverlap);
+				ImGui::Text("  cross queue waits : max %u", sim.maxCrossQueueWaits);
+				ImGui::Text("  peak transient : max %.2f (MB)", (double)sim.maxPeakTransientMemory / 1024.0 / 1024.0);
+				ImGui::Text("  aliased (tier1) : first fit avg %.2f max %.2f (MB), best fit avg %.2f max %.2f (MB)",
+					(double)sim.sumFirstFit / (double)sim.simulatedCount / 1024.0 / 1024.0, (double)sim.maxFirstFit / 1024.0 / 1024.0,
+					(double)sim.sumBestFit / (double)sim.simulatedCount / 1024.0 / 1024.0, (double)sim.maxBestFit / 1024.0 / 1024.0);
+			}
+			// 現在の設定でトランジェントリソースの配置を比較し、トレースを保存する
+			if (ImGui::Button("Transient Alias Report"))
+			{
+				bTransientAliasReport_ = true;
+			}
+			ImGui::SameLine();
+			if (ImGui::Button("Validate Transient Alias"))
+			{
+				transientAliasErrors_ = (int)ValidateTransientAlias("transient_trace.bin");
+			}
+			for (int tier = 0; tier < 2; tier++)
+			{
+				auto&& alias = transientAliasReports_[tier];
+				if (alias.resourceCount == 0)
+					continue;
+				ImGui::Text("  tier%d : first fit %.2f, best fit %.2f, lower bound %.2f (MB)", tier + 1,
+					(double)alias.firstFit / 1024.0 / 1024.0, (double)alias.bestFit / 1024.0 / 1024.0, (double)alias.lowerBound / 1024.0 / 1024.0);
+			}
+			if (transientAliasErrors_ >= 0)
+			{
+				ImGui::Text("  transient alias errors : %d", transientAliasErrors_);
+			}
 			ImGui::Text("RT/DS");
 			ImGui::Text("  total : %f (MB)", heapStatistics.placedRTDSTextures.totalSize / 1024.0f / 1024.0f);
 			ImGui::Text("  alloc : %f (MB)", heapStatistics.placedRTDSTextures.allocatedSize / 1024.0f / 1024.0f);
@@ -767,10 +1302,186 @@ bool SampleApplication::Execute()
 			ImGui::Text("  alloc : %f (MB)", heapStatistics.placedTextures.allocatedSize / 1024.0f / 1024.0f);
 			ImGui::Text("  free  : %f (MB)", heapStatistics.placedTextures.freeSize / 1024.0f / 1024.0f);
 			ImGui::Text("  over  : %f (MB)", heapStatistics.placedTextures.overlappedSize / 1024.0f / 1024.0f);
+
+			// 前フレームでMeshletResourceから転送した量
+			auto&& uploadStats = scene_->GetMeshletResource()->GetUploadStats();
+			ImGui::Text("Upload");
+			ImGui::Text("  scene : %lld (B)", uploadStats.sceneBytes);
+			ImGui::Text("  clear : %lld (B)", uploadStats.clearBytes);
 		}
+		scene_->GetMeshletResource()->ResetUploadStats();
 	}
 	ImGui::Render();
 
+	// GPU meshlet culling validation.
+	if (meshletCullValidateStep_ == 1)
+	{
+		auto pReadback = scene_->GetMeshletCullReadback();
+		if (pReadback)
+		{
+			meshletCullErrors_ = -1;
+			if (!pReadback->args[0].IsValid())
+			{
+				sl12::ConsolePrint("Error: meshlet culling pass is not executed.\n");
+			}
+			else if (pReadback->drawCallCount != meshletCullValidateData_.drawCallCount)
+			{
+				sl12::ConsolePrint("Error: draw call count is changed while meshlet cull readback.\n");
+			}
+			else
+			{
+				MeshletCullGpuResult gpu;
+				for (int phase = 0; phase < 2; phase++)
+				{
+					if (pReadback->args[phase].IsValid())
+					{
+						gpu.pCompactArgs[phase] = static_cast<const sl12::u8*>(pReadback->args[phase]->Map());
+						gpu.pCounts[phase] = static_cast<const sl12::u32*>(pReadback->counts[phase]->Map());
+					}
+				}
+				if (pReadback->drawFlags.IsValid())
+				{
+					gpu.pDrawFlags = static_cast<const sl12::u32*>(pReadback->drawFlags->Map());
+				}
+
+				meshletCullValidateData_.SetupInput(meshletCullValidateInput_);
+				meshletCullValidation_ = ValidateMeshletCullGpuResult(meshletCullValidateInput_, gpu);
+				meshletCullErrors_ = (int)(meshletCullValidation_.compactErrors + meshletCullValidation_.drawFlagErrors + meshletCullValidation_.phaseErrors);
+
+				for (int phase = 0; phase < 2; phase++)
+				{
+					if (pReadback->args[phase].IsValid())
+					{
+						pReadback->args[phase]->Unmap();
+						pReadback->counts[phase]->Unmap();
+					}
+				}
+				if (pReadback->drawFlags.IsValid())
+				{
+					pReadback->drawFlags->Unmap();
+				}
+			}
+			scene_->ReleaseMeshletCullReadback();
+			meshletCullValidateStep_ = -1;
+		}
+	}
+
+	// GPU material classify validation.
+	if (classifyValidateStep_ == 1)
+	{
+		auto pReadback = scene_->GetClassifyReadback();
+		if (pReadback)
+		{
+			gpuClassifyErrors_ = -1;
+			if (!pReadback->visibility.IsValid())
+			{
+				sl12::ConsolePrint("Error: classify pass is not executed.\n");
+			}
+			else
+			{
+				// DrawCallからマテリアルを引くテーブル
+				MeshletCullInput input;
+				classifyValidateData_.SetupInput(input);
+				ClassifyDump dump;
+				dump.width = pReadback->width;
+				dump.height = pReadback->height;
+				dump.drawCallMaterials.resize(input.drawCallCount);
+				for (sl12::u32 i = 0; i < input.drawCallCount; i++)
+				{
+					auto dc = LoadMeshletCullDrawCall(input, i);
+					dump.drawCallMaterials[i] = input.pSubmeshes[input.pMeshlets[dc.meshletIndex].submeshIndex].materialIndex;
+				}
+
+				// テクスチャの行のパディングを詰める
+				dump.visibility.resize(dump.width * dump.height);
+				dump.depth.resize(dump.width * dump.height);
+				auto pVis = static_cast<const sl12::u8*>(pReadback->visibility->Map());
+				auto pDepth = static_cast<const sl12::u8*>(pReadback->depth->Map());
+				for (sl12::u32 y = 0; y < dump.height; y++)
+				{
+					memcpy(dump.visibility.data() + y * dump.width, pVis + y * pReadback->visRowPitch, sizeof(sl12::u32) * dump.width);
+					memcpy(dump.depth.data() + y * dump.width, pDepth + y * pReadback->depthRowPitch, sizeof(float) * dump.width);
+				}
+				pReadback->visibility->Unmap();
+				pReadback->depth->Unmap();
+
+				ClassifyGpuResult gpu;
+				gpu.pTileMaterialCount = static_cast<const sl12::u32*>(pReadback->tileMaterialCount->Map());
+				gpu.pTileMaterialList = static_cast<const sl12::u32*>(pReadback->tileMaterialList->Map());
+				gpu.pDrawArgs = static_cast<const sl12::u32*>(pReadback->drawArgs->Map());
+				gpu.pMaterialTileOffset = static_cast<const sl12::u32*>(pReadback->tileOffset->Map());
+				gpu.pMaterialTileIndex = static_cast<const sl12::u32*>(pReadback->tileIndex->Map());
+				gpu.tileIndexCapacity = pReadback->tileIndex->GetBufferDesc().size / sizeof(sl12::u32);
+
+				classifyValidation_ = ValidateClassifyGpuResult(dump, classifyValidateMaterialCount_, gpu);
+				gpuClassifyErrors_ = (int)(classifyValidation_.layoutErrors + classifyValidation_.mismatchCount);
+
+				pReadback->tileMaterialCount->Unmap();
+				pReadback->tileMaterialList->Unmap();
+				pReadback->drawArgs->Unmap();
+				pReadback->tileOffset->Unmap();
+				pReadback->tileIndex->Unmap();
+
+				// "Validate Material Classify" で同じバッファを検証できるようにする
+				SaveClassifyDump("classify_dump.bin", dump);
+			}
+			scene_->ReleaseClassifyReadback();
+			classifyValidateStep_ = -1;
+		}
+	}
+
+	// meshlet alpha bake.
+	if (bMeshletAlphaBaking_)
+	{
+		int count = scene_->FinishMeshletAlphaBake();
+		if (count >= 0)
+		{
+			meshletAlphaBakeCount_ = count;
+			bMeshletAlphaBaking_ = false;
+		}
+	}
+
+	// prefix scan benchmark.
+	// パスの計測結果は数フレーム遅れるので、要素数を変えた直後のフレームは捨てる
+	if (prefixScanStep_ >= 0)
+	{
+		const int kWarmupFrames = 8;
+		const int kMeasureFrames = 60;
+
+		if (prefixScanFrame_ >= kWarmupFrames)
+		{
+			auto&& perf = scene_->GetRenderGraph()->GetPerformanceResult()[sl12::HardwareQueue::Graphics];
+			for (size_t i = 0; i < perf.passNames.size(); i++)
+			{
+				if (perf.passNames[i] == "PrefixSumTest")
+				{
+					prefixScanTimeSum_ += perf.passMicroSecTimes[i];
+					break;
+				}
+			}
+		}
+		prefixScanFrame_++;
+		if (prefixScanFrame_ >= kWarmupFrames + kMeasureFrames)
+		{
+			auto&& stats = scene_->GetPrefixScanStats();
+			PrefixScanBenchmarkResult result{};
+			result.elementCount = kPrefixScanBenchmarkCounts[prefixScanStep_];
+			result.gpuMilliSec = prefixScanTimeSum_ / (double)kMeasureFrames / 1000.0;
+			result.checkedFrames = stats.checkedFrames;
+			result.mismatchCount = stats.mismatchCount;
+			result.cpuMicroSec = stats.cpuMicroSec;
+			prefixScanResults_.push_back(result);
+
+			prefixScanStep_++;
+			prefixScanFrame_ = 0;
+			prefixScanTimeSum_ = 0.0;
+			if (prefixScanStep_ >= (int)ARRAYSIZE(kPrefixScanBenchmarkCounts))
+			{
+				prefixScanStep_ = -1;
+			}
+		}
+	}
+
 	bool bNeedDeinterleave = bIsDeinterleave_ && (ssaoType_ == 2);
 
 	// sync interval.
@@ -782,6 +1493,9 @@ bool SampleApplication::Execute()
 	RenderPassSetupDesc setupDesc{};
 	setupDesc.bUseVisibilityBuffer = bEnableVisibilityBuffer_;
 	setupDesc.bUseMeshShader = bEnableMeshShader_;
+	setupDesc.bUseOcclusionCulling = bEnableOcclusionCulling_;
+	// ソフトウェアオクルージョンの結果はInstanceData.flagsでGPUカリングに反映されるので、マスクの描画リストでも使える
+	setupDesc.bUseBindlessMasked = bEnableBindlessMasked_;
 	setupDesc.visToGBufferType = VisToGBufferType_;
 	setupDesc.ssaoType = ssaoType_;
 	setupDesc.bNeedDeinterleave = bIsDeinterleave_;
@@ -792,10 +1506,129 @@ bool SampleApplication::Execute()
 	setupDesc.raytracingTech = raytracingTech_;
 	setupDesc.atrousIterations = svgfAtrousIterations_;
 	setupDesc.bShadowBlur = evsmBlur_;
+	setupDesc.bUseShadowCulling = bEnableShadowCulling_;
+	setupDesc.bUseShadowOcclusionCulling = bEnableShadowOcclusion_;
+	setupDesc.shadowCascadeCount = shadowCascadeCount_;
+	setupDesc.bUseShadowCache = bEnableShadowCache_;
+	setupDesc.bUseVirtualShadow = bEnableVirtualShadow_;
 	setupDesc.bDebugDdgi = bDebugDdgi_;
 	setupDesc.bUseWater = bEnableWater_;
 	setupDesc.waterMethod = waterMethod_;
 	setupDesc.debugMode = displayMode_;
+	setupDesc.prefixScanBenchmarkCount = (prefixScanStep_ >= 0) ? (int)kPrefixScanBenchmarkCounts[prefixScanStep_] : 0;
+	setupDesc.prefixScanBenchmarkType = prefixScanType_;
+	setupDesc.bPrefixScanInclusive = bPrefixScanInclusive_;
+
+	// render graph simulation.
+	// 組み合わせが多いので、1フレームの処理時間を制限して数フレームに分ける
+	if (renderGraphSimIndex_ >= 0)
+	{
+		const double kSimMicroSecPerFrame = 4000.0;
+		const sl12::u32 kMaxIssueLogs = 16;
+
+		if (renderGraphSimIndex_ == 0)
+		{
+			renderGraphSimBase_ = setupDesc;
+		}
+
+		auto simStart = std::chrono::high_resolution_clock::now();
+		sl12::u32 combinationCount = GetRenderPassSetupCombinationCount();
+		RenderGraphSimGraph graph;
+		RenderGraphSimReport report;
+		while (renderGraphSimIndex_ < (int)combinationCount)
+		{
+			sl12::u32 index = (sl12::u32)renderGraphSimIndex_++;
+			RenderPassSetupDesc desc;
+			if (GetRenderPassSetupCombination(renderGraphSimBase_, index, desc))
+			{
+				scene_->BuildRenderGraphSim(desc, renderGraphSimCosts_, graph);
+				SimulateRenderGraph(graph, report);
+
+				auto&& sim = renderGraphSimSummary_;
+				auto LogIssue = [&](const char* issue, const std::string& resName, const std::string& passA, const std::string& passB)
+				{
+					if (sim.issueLogCount++ >= kMaxIssueLogs)
+						return;
+					sl12::ConsolePrint("Warning: render graph sim %s (%s : %s, %s) [vis %d ms %d occl %d v2g %d vrs %d ssao %d rt %d/%d vsm %d cull %d/%d cache %d blur %d water %d/%d debug %d]\n",
+						issue, resName.c_str(), passA.c_str(), passB.c_str(),
+						desc.bUseVisibilityBuffer, desc.bUseMeshShader, desc.bUseOcclusionCulling, desc.visToGBufferType, desc.bUseVRS,
+						desc.ssaoType, desc.bUseRaytracing, desc.raytracingTech, desc.bUseVirtualShadow,
+						desc.bUseShadowCulling, desc.bUseShadowOcclusionCulling, desc.bUseShadowCache, desc.bShadowBlur,
+						desc.bUseWater, desc.waterMethod, desc.debugMode);
+				};
+
+				if (sim.simulatedCount == 0)
+				{
+					sim.minOverlap = report.overlap;
+					sim.maxOverlap = report.overlap;
+				}
+				sim.simulatedCount++;
+				if (report.bHasCycle)
+				{
+					sim.cycleCount++;
+					LogIssue("cycle", "", "", "");
+				}
+				else
+				{
+					if (!report.hazards.empty())
+					{
+						sim.hazardSetupCount++;
+						auto&& h = report.hazards[0];
+						LogIssue(h.bWriteWrite ? "write-write hazard" : "read-write hazard",
+							graph.resources[h.resource].name, graph.passes[h.passA].name, graph.passes[h.passB].name);
+					}
+					if (!report.missingProducers.empty())
+					{
+						sim.missingProducerSetupCount++;
+						auto&& m = report.missingProducers[0];
+						LogIssue("missing producer", graph.resources[m.second].name, graph.passes[m.first].name, "");
+					}
+					sim.maxCriticalPath = std::max(sim.maxCriticalPath, report.criticalPathCost);
+					sim.minOverlap = std::min(sim.minOverlap, report.overlap);
+					sim.maxOverlap = std::max(sim.maxOverlap, report.overlap);
+					sim.maxCrossQueueWaits = std::max(sim.maxCrossQueueWaits, (sl12::u32)report.crossQueueWaits.size());
+					sim.maxPeakTransientMemory = std::max(sim.maxPeakTransientMemory, report.peakTransientMemory);
+
+					TransientAliasTrace trace;
+					TransientAliasReport alias;
+					BuildTransientAliasTrace(graph, report, trace);
+					ReportTransientAlias(trace, 1, alias);
+					sim.sumFirstFit += alias.firstFit;
+					sim.sumBestFit += alias.bestFit;
+					sim.maxFirstFit = std::max(sim.maxFirstFit, alias.firstFit);
+					sim.maxBestFit = std::max(sim.maxBestFit, alias.bestFit);
+				}
+			}
+
+			auto simNow = std::chrono::high_resolution_clock::now();
+			if (std::chrono::duration<double, std::micro>(simNow - simStart).count() >= kSimMicroSecPerFrame)
+			{
+				break;
+			}
+		}
+		if (renderGraphSimIndex_ >= (int)combinationCount)
+		{
+			renderGraphSimIndex_ = -1;
+		}
+	}
+
+	// transient aliasing report.
+	if (bTransientAliasReport_)
+	{
+		RenderGraphSimGraph graph;
+		RenderGraphSimReport report;
+		TransientAliasTrace trace;
+		scene_->BuildRenderGraphSim(setupDesc, std::map<std::string, float>(), graph);
+		SimulateRenderGraph(graph, report);
+		BuildTransientAliasTrace(graph, report, trace);
+		ReportTransientAlias(trace, 1, transientAliasReports_[0]);
+		ReportTransientAlias(trace, 2, transientAliasReports_[1]);
+		SaveTransientAliasTrace("transient_trace.bin", trace);
+		bTransientAliasReport_ = false;
+	}
+
+	scene_->SetRenderGraphCacheEnable(bEnableRenderGraphCache_);
+	scene_->SetParallelPrepareEnable(bEnableParallelPrepare_);
 	scene_->SetupRenderPass(pSwapchainTarget, setupDesc);
 	scene_->GatherRenderCommands();
 
@@ -813,6 +1646,37 @@ bool SampleApplication::Execute()
 	auto&& TempCB = scene_->GetTemporalCBs();
 	SetupConstantBuffers(TempCB);
 
+	// GPUのカリングと同じフレームの入力を保持する
+	if (meshletCullValidateStep_ == 0)
+	{
+		scene_->GetMeshletResource()->GatherCullData(meshletCullValidateData_);
+		sl12::CalcFrustumPlanes(mtxPrevWorldToClip_, true, true, meshletCullValidateInput_.frustumPlanes);
+		meshletCullValidateInput_.eyePosition = cameraPos_;
+		DirectX::XMStoreFloat4x4(&meshletCullValidateInput_.mtxWorldToProj, mtxPrevWorldToClip_);
+		meshletCullValidateInput_.screenSize = DirectX::XMFLOAT2((float)displayWidth_, (float)displayHeight_);
+		meshletCullValidateInput_.nearFar = DirectX::XMFLOAT2(kNearZ, 0.0f);
+		meshletCullValidateStep_ = 1;
+	}
+
+	// GPUの分類と同じフレームのDrawCallとマテリアル数を保持する
+	if (classifyValidateStep_ == 0)
+	{
+		scene_->GetMeshletResource()->GatherCullData(classifyValidateData_);
+		classifyValidateMaterialCount_ = (sl12::u32)scene_->GetMeshletResource()->GetWorldMaterials().size();
+		classifyValidateStep_ = 1;
+	}
+
+	// software occlusion culling.
+	// SetupConstantBuffers の後なので、mtxPrevWorldToClip_ は現在のフレームの行列
+	if (bEnableSoftwareOcclusion_)
+	{
+		scene_->CullSoftwareOcclusion(mtxPrevWorldToClip_, kNearZ);
+	}
+	else
+	{
+		scene_->ClearSoftwareOcclusion();
+	}
+
 	// create mesh cbuffers.
 	for (auto&& mesh : scene_->GetSceneMeshes())
 	{
@@ -827,6 +1691,15 @@ bool SampleApplication::Execute()
 	// create irradiance map.
 	scene_->CreateIrradianceMap(pFrameStartCmdList);
 
+	// gather meshlet alpha bake inputs.
+	scene_->RecordMeshletAlphaBake(pFrameStartCmdList);
+
+	// update virtual shadow map pages.
+	if (bEnableVirtualShadow_)
+	{
+		scene_->UpdateVirtualShadowMap(pFrameStartCmdList, mtxWorldToVirtual_, (sl12::u32)vsmPageBudget_);
+	}
+
 	frameStartCmdlist_->Close();
 
 	// load render graph command.
@@ -898,6 +1771,12 @@ bool SampleApplication::Execute()
 
 	}
 
+	// virtual shadow page request readback.
+	if (bEnableVirtualShadow_)
+	{
+		scene_->ReadbackVirtualShadowRequests(pFrameEndCmdList);
+	}
+
 	// barrier swapchain.
 	pFrameEndCmdList->TransitionBarrier(device_.GetSwapchain().GetCurrentTexture(kSwapchainBufferOffset), D3D12_RESOURCE_STATE_RENDER_TARGET, D3D12_RESOURCE_STATE_PRESENT);
 
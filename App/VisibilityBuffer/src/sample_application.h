@@ -1,4 +1,8 @@
 ﻿#include "scene.h"
+#include "meshlet_cull_simd.h"
+#include "material_classify.h"
+#include "meshlet_alpha.h"
+#include "transient_alias.h"
 
 #include "sl12/application.h"
 #include "sl12/resource_loader.h"
@@ -35,7 +39,7 @@ class SampleApplication
 	};	// struct NeededMiplevel
 
 public:
-	SampleApplication(HINSTANCE hInstance, int nCmdShow, int screenWidth, int screenHeight, sl12::ColorSpaceType csType, const std::string& homeDir, int meshType, const std::string& appShader, const std::string& sysShader);
+	SampleApplication(HINSTANCE hInstance, int nCmdShow, int screenWidth, int screenHeight, sl12::ColorSpaceType csType, const std::string& homeDir, int meshType, int meshGridWidth, const std::string& appShader, const std::string& sysShader);
 	virtual ~SampleApplication();
 
 	// virtual
@@ -144,6 +148,11 @@ private:
 	// rendering parameters.
 	bool					bEnableVisibilityBuffer_ = false;
 	bool					bEnableMeshShader_ = false;
+	bool					bEnableOcclusionCulling_ = true;
+	bool					bEnableSoftwareOcclusion_ = false;		// 実験的な機能なのでデフォルトは無効
+	bool					bEnableBindlessMasked_ = false;
+	bool					bEnableRenderGraphCache_ = true;
+	bool					bEnableParallelPrepare_ = true;
 	int						VisToGBufferType_ = 0;
 	bool					bEnableWorkGraph_ = false;
 
@@ -158,6 +167,18 @@ private:
 	float					shadowBias_ = 0.001f;
 	float					shadowExponent_ = 10.0f;
 	bool					evsmBlur_ = false;
+	bool					bEnableShadowCulling_ = true;
+	bool					bEnableShadowOcclusion_ = false;
+	bool					bEnableShadowCache_ = true;
+	int						shadowCascadeCount_ = 4;
+	float					shadowSplitLambda_ = 0.7f;
+	float					shadowDistance_ = 5000.0f;
+	ShadowCascadeCamera		shadowCamera_;
+	ShadowCascade			shadowCascades_[kShadowCascadeMax];
+	DirectX::XMFLOAT3		shadowLightDir_;
+	bool					bEnableVirtualShadow_ = false;
+	int						vsmPageBudget_ = 16;
+	DirectX::XMFLOAT4X4		mtxWorldToVirtual_;
 
 	// surface gradient parameters.
 	float					detailTile_ = 3.0f;
@@ -238,9 +259,110 @@ private:
 	float					totalTime_ = 0;
 	float					totalTimeSum_ = 0;
 	int						totalTimeSumCount_ = 0;
+	MeshletCullBenchmarkResult	cpuCullResult_{};
+	std::vector<MeshletResource::TableBuildBenchmarkResult>	tableBuildResults_;
+	sl12::u32				shadowCullVisible_ = 0;
+	sl12::u32				shadowCullTotal_ = 0;
+	sl12::u32				shadowCullErrors_ = 0;
+	int						shadowCascadeStabilityErrors_ = -1;
+	int						meshletBoundErrors_ = -1;
+	sl12::u32				meshletBoundCount_ = 0;
+	int						vsmSimulationErrors_ = -1;
+	int						prefixScanErrors_ = -1;
+	int						softwareVrsErrors_ = -1;
+	int						materialClassifyErrors_ = -1;
+	int						meshletAlphaErrors_ = -1;
+	int						meshletAlphaBakeCount_ = -1;
+	bool					bMeshletAlphaBaking_ = false;
+	int						renderGraphSimErrors_ = -1;
+	ClassifyMemoryStats		materialClassifyStats_{};
+
+	// prefix scan benchmark.
+	struct PrefixScanBenchmarkResult
+	{
+		sl12::u32	elementCount;
+		double		gpuMilliSec;
+		sl12::u32	checkedFrames;
+		sl12::u32	mismatchCount;
+		double		cpuMicroSec;
+	};	// struct PrefixScanBenchmarkResult
+	int						prefixScanType_ = 0;
+	bool					bPrefixScanInclusive_ = false;
+	int						prefixScanStep_ = -1;		// -1なら計測していない
+	int						prefixScanFrame_ = 0;
+	double					prefixScanTimeSum_ = 0.0;
+	std::vector<PrefixScanBenchmarkResult>	prefixScanResults_;
+
+	// runtime instance edit.
+	struct DebugInstance
+	{
+		std::shared_ptr<sl12::SceneMesh>	mesh;
+		DirectX::XMFLOAT4X4					mtxBase;
+		float								amplitude;		// 移動量
+	};
+	std::vector<DebugInstance>	debugInstances_;
+	bool						bMoveDebugInstances_ = false;
+	float						debugInstanceTime_ = 0.0f;
+	int							instanceEditErrors_ = -1;
+
+	// GPU meshlet culling validation.
+	// 要求したフレームのカリング入力を保持し、読み戻しが届いたら検証する
+	int							meshletCullValidateStep_ = -1;	// -1:なし, 0:入力を取得する, 1:読み戻し待ち
+	MeshletCullData				meshletCullValidateData_;
+	MeshletCullInput			meshletCullValidateInput_;
+	MeshletCullValidation		meshletCullValidation_{};
+	int							meshletCullErrors_ = -1;
+
+	// GPU material classify validation.
+	// 要求したフレームのDrawCallとマテリアルの対応を保持し、読み戻したVisibility/Depthバッファで分類し直して比較する
+	int							classifyValidateStep_ = -1;		// -1:なし, 0:入力を取得する, 1:読み戻し待ち
+	MeshletCullData				classifyValidateData_;
+	sl12::u32					classifyValidateMaterialCount_ = 0;
+	ClassifyValidation			classifyValidation_{};
+	int							gpuClassifyErrors_ = -1;
+
+	// render graph simulation.
+	struct RenderGraphSimSummary
+	{
+		sl12::u32	simulatedCount;
+		sl12::u32	cycleCount;
+		sl12::u32	hazardSetupCount;
+		sl12::u32	missingProducerSetupCount;
+		sl12::u32	maxCrossQueueWaits;
+		sl12::u32	issueLogCount;
+		float		maxCriticalPath;
+		float		minOverlap;
+		float		maxOverlap;
+		sl12::u64	maxPeakTransientMemory;
+		sl12::u64	sumFirstFit;		// トランジェントの配置 (Tier1)
+		sl12::u64	sumBestFit;
+		sl12::u64	maxFirstFit;
+		sl12::u64	maxBestFit;
+	};	// struct RenderGraphSimSummary
+	int								renderGraphSimIndex_ = -1;		// -1ならシミュレートしていない
+	RenderPassSetupDesc				renderGraphSimBase_{};
+	std::map<std::string, float>	renderGraphSimCosts_;
+	RenderGraphSimSummary			renderGraphSimSummary_{};
+
+	// transient aliasing report.
+	bool					bTransientAliasReport_ = false;
+	TransientAliasReport	transientAliasReports_[2]{};	// Tier1, Tier2
+	int						transientAliasErrors_ = -1;
+
+	// frame arena.
+	static const int		kHeapAllocBenchFrames = 64;		// 設定ごとの計測フレーム数
+	static const int		kHeapAllocBenchWarmup = 4;		// 切り替え直後に計測しないフレーム数
+	bool					bEnableFrameArena_ = true;
+	sl12::u64				heapAllocCountPrev_ = 0;
+	sl12::u64				heapAllocsLastFrame_ = 0;
+	int						heapAllocBenchFrame_ = -1;		// -1なら計測していない
+	sl12::u64				heapAllocBenchSums_[2]{};		// アリーナ無効、有効
+	double					heapAllocBenchResults_[2] = {-1.0, -1.0};
+	int						frameArenaErrors_ = -1;
 
 	int	displayWidth_, displayHeight_;
 	int meshType_;
+	int meshGridWidth_;
 
 	std::string				captureFileName_;
 };	// class SampleApplication
@@ -1,4 +1,6 @@
 ﻿#include "scene.h"
+#include "meshlet_alpha.h"
+#include "meshlet_bound.h"
 #include "shader_types.h"
 #include "sl12/resource_texture.h"
 #include "sl12/descriptor_set.h"
@@ -14,27 +16,21 @@
 
 #define NOMINMAX
 #include <windowsx.h>
+#include <algorithm>
+#include <cassert>
+#include <chrono>
+#include <execution>
 #include <memory>
+#include <numeric>
 #include <random>
+#include <unordered_map>
+#include <unordered_set>
 
 #define USE_IN_CPP
 #include "../shaders/cbuffer.hlsli"
 #include "pass/raytracing_pass.h"
 #include "pass/render_resource_settings.h"
 
-namespace
-{
-	struct MeshletBound
-	{
-		DirectX::XMFLOAT3		aabbMin;
-		DirectX::XMFLOAT3		aabbMax;
-		DirectX::XMFLOAT3		coneApex;
-		DirectX::XMFLOAT3		coneAxis;
-		float					coneCutoff;
-		sl12::u32				pad[3];
-	};	// struct MeshletBound
-}
-
 //----------------
 //----
 RenderSystem::RenderSystem(sl12::Device* pDev, const std::string& resDir, const ShaderInitDesc& shaderDesc)
@@ -149,6 +145,112 @@ namespace
 		return cbvMan->GetTemporal(&cbMesh, sizeof(cbMesh));
 	}
 
+	//----
+	// グラフの接続を記録するノード
+	// sl12::RenderGraph::Nodeと同じく、空のノードからのAddChildは接続を作らずに子を返す
+	struct PassEdgeNode
+	{
+		std::vector<std::pair<AppPassType, AppPassType>>*	pEdges = nullptr;
+		AppPassType											type = AppPassType::Invalid;
+
+		PassEdgeNode AddChild(const PassEdgeNode& child)
+		{
+			if (type != AppPassType::Invalid)
+			{
+				pEdges->push_back(std::make_pair(type, child.type));
+			}
+			return child;
+		}
+	};	// struct PassEdgeNode
+
+	//----
+	// レンダーグラフのシミュレーションで列挙する設定項目の値の数
+	static const sl12::u32 kRenderPassSetupRadix[] = {
+		2,	// bUseVisibilityBuffer
+		2,	// bUseMeshShader
+		2,	// bUseOcclusionCulling
+		2,	// bUseBindlessMasked
+		4,	// visToGBufferType
+		2,	// bUseVRS
+		3,	// ssaoType
+		2,	// bNeedDeinterleave
+		2,	// bUseRaytracing
+		3,	// raytracingTech
+		2,	// bDebugDdgi
+		2,	// bShadowBlur
+		2,	// bUseShadowCulling
+		2,	// bUseShadowOcclusionCulling
+		2,	// bUseShadowCache
+		2,	// bUseVirtualShadow
+		2,	// bUseWater
+		4,	// waterMethod
+		2,	// debugMode (0とそれ以外でグラフが変わる)
+	};
+
+	// シミュレーション用のテクスチャの1ピクセルのサイズ
+	sl12::u32 GetSimFormatSize(DXGI_FORMAT format)
+	{
+		switch (format)
+		{
+		case DXGI_FORMAT_R8_UNORM:
+		case DXGI_FORMAT_R8_UINT:
+			return 1;
+		case DXGI_FORMAT_R8G8_UNORM:
+		case DXGI_FORMAT_R8G8_UINT:
+		case DXGI_FORMAT_R16_FLOAT:
+		case DXGI_FORMAT_R16_UINT:
+			return 2;
+		case DXGI_FORMAT_R16G16B16A16_FLOAT:
+		case DXGI_FORMAT_R32G32_FLOAT:
+		case DXGI_FORMAT_R32G32_UINT:
+			return 8;
+		case DXGI_FORMAT_R32G32B32A32_FLOAT:
+		case DXGI_FORMAT_R32G32B32A32_UINT:
+			return 16;
+		default:
+			return 4;
+		}
+	}
+
+	// サイズはミップとアレイを含まない推定値
+	sl12::u32 AddSimResource(RenderGraphSimGraph& graph, const sl12::TransientResource& res)
+	{
+		// ヒストリーは現在のフレームとは別のリソースとして扱う
+		std::string name = res.id.name;
+		if (res.id.history > 0)
+		{
+			name += "@" + std::to_string(res.id.history);
+		}
+		bool bPersistent = (res.id.history > 0) || (res.desc.historyFrame > 0) || (res.id.name == kSwapchainID.name);
+
+		sl12::u64 size = 0;
+		sl12::u32 heapKind = kRenderGraphSimHeapBuffer;
+		if (res.desc.bIsTexture)
+		{
+			size = (sl12::u64)res.desc.textureDesc.width * res.desc.textureDesc.height * GetSimFormatSize(res.desc.textureDesc.format);
+			// レンダーターゲットと深度は別のヒープに配置される
+			bool bRTDS = (res.state == sl12::TransientState::RenderTarget) || (res.state == sl12::TransientState::DepthStencil);
+			heapKind = bRTDS ? kRenderGraphSimHeapRTDS : kRenderGraphSimHeapTexture;
+		}
+		else
+		{
+			size = res.desc.bufferDesc.size;
+		}
+		return graph.FindOrAddResource(name, size, bPersistent, heapKind);
+	}
+
+	sl12::u32 GetSimQueue(sl12::HardwareQueue::Value queue)
+	{
+		switch (queue)
+		{
+		case sl12::HardwareQueue::Compute:
+			return 1;
+		case sl12::HardwareQueue::Copy:
+			return 2;
+		default:
+			return 0;
+		}
+	}
 }
 
 //----
@@ -211,6 +313,24 @@ void Scene::Finalize()
 	miplevelReadbacks_[0].Reset();
 	miplevelReadbacks_[1].Reset();
 
+	vsmPool_.Reset();
+	vsmPoolSRV_.Reset();
+	vsmPoolDSV_.Reset();
+	vsmRequestBuffer_.Reset();
+	vsmRequestClear_.Reset();
+	vsmRequestUAV_.Reset();
+	vsmRequestReadbacks_[0].Reset();
+	vsmRequestReadbacks_[1].Reset();
+	vsmPageTableBuffer_.Reset();
+	ReleaseMeshletCullReadback();
+	ReleaseClassifyReadback();
+	ReleaseMeshletAlphaBake();
+	vsmPageTableSRV_.Reset();
+	vsmCompactArg_.Reset();
+	vsmDrawCount_.Reset();
+	vsmCompactArgUAV_.Reset();
+	vsmDrawCountUAV_.Reset();
+
 	bvhManager_.Reset();
 	rtxgiComponent_.Reset();
 }
@@ -229,9 +349,9 @@ bool Scene::CreateSceneMeshes(int meshType)
 
 	if (meshType == 0)
 	{
-		static const int kMeshWidth = 32;
+		const int kMeshWidth = meshGridWidth_;
 		static const float kMeshInter = 100.0f;
-		static const float kMeshOrigin = -(kMeshWidth - 1) * kMeshInter * 0.5f;
+		const float kMeshOrigin = -(kMeshWidth - 1) * kMeshInter * 0.5f;
 		std::random_device seed_gen;
 		std::mt19937 rnd(seed_gen());
 		auto RandRange = [&rnd](float minV, float maxV)
@@ -240,6 +360,7 @@ bool Scene::CreateSceneMeshes(int meshType)
 			float v0_1 = (float)val / (float)0xffffffff;
 			return minV + (maxV - minV) * v0_1;
 		};
+		sceneMeshes_.reserve(kMeshWidth * kMeshWidth);
 		for (int x = 0; x < kMeshWidth; x++)
 		{
 			for (int y = 0; y < kMeshWidth; y++)
@@ -284,107 +405,1001 @@ bool Scene::CreateSceneMeshes(int meshType)
 			DirectX::XMStoreFloat4x4(&mat, m);
 			mesh->SetMtxLocalToWorld(mat);
 
-			sceneMeshes_.push_back(mesh);
-			sceneRoot_->AttachNode(mesh);
-		}
+			sceneMeshes_.push_back(mesh);
+			sceneRoot_->AttachNode(mesh);
+		}
+	}
+	else if (meshType == 2)
+	{
+		// sponza
+		{
+			auto mesh = std::make_shared<sl12::SceneMesh>(pDevice_, hSponzaMesh_.GetItem<sl12::ResourceItemMesh>());
+			DirectX::XMFLOAT3 pos(0.0f, 100.0f, 0.0f);
+			DirectX::XMFLOAT3 scl(100.0f, 100.0f, 100.0f);
+			DirectX::XMFLOAT4X4 mat;
+			DirectX::XMMATRIX m = DirectX::XMMatrixScaling(scl.x, scl.y, scl.z)
+									* DirectX::XMMatrixTranslation(pos.x, pos.y, pos.z);
+			DirectX::XMStoreFloat4x4(&mat, m);
+			mesh->SetMtxLocalToWorld(mat);
+
+			sceneMeshes_.push_back(mesh);
+			sceneRoot_->AttachNode(mesh);
+		}
+		// curtain
+		{
+			auto mesh = std::make_shared<sl12::SceneMesh>(pDevice_, hCurtainMesh_.GetItem<sl12::ResourceItemMesh>());
+			DirectX::XMFLOAT3 pos(0.0f, 100.0f, 0.0f);
+			DirectX::XMFLOAT3 scl(100.0f, 100.0f, 100.0f);
+			DirectX::XMFLOAT4X4 mat;
+			DirectX::XMMATRIX m = DirectX::XMMatrixScaling(scl.x, scl.y, scl.z)
+									* DirectX::XMMatrixTranslation(pos.x, pos.y, pos.z);
+			DirectX::XMStoreFloat4x4(&mat, m);
+			mesh->SetMtxLocalToWorld(mat);
+
+			sceneMeshes_.push_back(mesh);
+			sceneRoot_->AttachNode(mesh);
+		}
+	}
+	else if (meshType == 3)
+	{
+		// Bistro
+		{
+			auto mesh = std::make_shared<sl12::SceneMesh>(pDevice_, hBistroMesh_.GetItem<sl12::ResourceItemMesh>());
+			DirectX::XMFLOAT3 pos(1240.0f, 920.0f, -20.0f);
+			DirectX::XMFLOAT3 scl(20.0f, 20.0f, 20.0f);
+			DirectX::XMFLOAT4X4 mat;
+			DirectX::XMMATRIX m = DirectX::XMMatrixScaling(scl.x, scl.y, scl.z)
+									* DirectX::XMMatrixTranslation(pos.x, pos.y, pos.z);
+			DirectX::XMStoreFloat4x4(&mat, m);
+			mesh->SetMtxLocalToWorld(mat);
+
+			sceneMeshes_.push_back(mesh);
+			sceneRoot_->AttachNode(mesh);
+		}
+	}
+
+	// create BVH manager.
+	bvhManager_ = sl12::MakeUnique<sl12::BvhManager>(pDevice_, pDevice_);
+	resMeshInstanceCounts_.clear();
+	for (auto&& mesh : sceneMeshes_)
+	{
+		bvhManager_->AddGeometry(mesh->GetParentResource());
+		resMeshInstanceCounts_[mesh->GetParentResource()]++;
+	}
+
+	ComputeSceneAABB();
+	CreateMeshletResource();
+	CreateMiplevelFeedback();
+
+	return true;
+}
+
+//----
+void Scene::AddSceneMesh(const std::shared_ptr<sl12::SceneMesh>& mesh)
+{
+	size_t materialCount = meshletResource_->GetWorldMaterials().size();
+
+	sceneMeshes_.push_back(mesh);
+	sceneRoot_->AttachNode(mesh);
+	bvhManager_->AddGeometry(mesh->GetParentResource());
+	resMeshInstanceCounts_[mesh->GetParentResource()]++;
+	UpdateInstanceBound((sl12::u32)sceneMeshes_.size() - 1);
+
+	// MeshletResourceのインスタンス順はsceneMeshes_と一致させる
+	sl12::u32 instanceIndex = meshletResource_->AddInstance(mesh);
+	assert(instanceIndex == sceneMeshes_.size() - 1);
+
+	// マテリアルが増えた場合はフィードバックバッファを作り直す
+	if (meshletResource_->GetWorldMaterials().size() != materialCount)
+	{
+		CreateMiplevelFeedback();
+	}
+}
+
+//----
+bool Scene::RemoveSceneMesh(const std::shared_ptr<sl12::SceneMesh>& mesh)
+{
+	int instanceIndex = meshletResource_->GetInstanceIndex(mesh.get());
+	if (instanceIndex < 0)
+	{
+		return false;
+	}
+
+	// MeshletResourceと同様に、末尾のメッシュを削除位置に移動する
+	sl12::u32 lastIndex = (sl12::u32)sceneMeshes_.size() - 1;
+	meshletResource_->RemoveInstance(mesh.get());
+	sceneMeshes_[instanceIndex] = sceneMeshes_.back();
+	sceneMeshes_.pop_back();
+
+	// 移動したインスタンスと空いた末尾のAABBのみ更新する
+	instanceBounds_.Clear(lastIndex);
+	if ((sl12::u32)instanceIndex != lastIndex)
+	{
+		UpdateInstanceBound((sl12::u32)instanceIndex);
+	}
+	else
+	{
+		instanceBounds_.GetRoot(sceneAABBMin_, sceneAABBMax_);
+	}
+
+	// BVHのジオメトリはリソース単位なので、他のインスタンスが使っている場合は残す
+	auto resMesh = mesh->GetParentResource();
+	auto countIt = resMeshInstanceCounts_.find(resMesh);
+	if (countIt != resMeshInstanceCounts_.end() && --countIt->second == 0)
+	{
+		resMeshInstanceCounts_.erase(countIt);
+		bvhManager_->RemoveGeometry(resMesh);
+	}
+
+	// SceneRootはノード単位の切り離しを持たないので、次のGatherRenderCommandsで作り直す
+	// 同じフレームの削除は1回の作り直しにまとまる
+	bSceneRootDirty_ = true;
+	return true;
+}
+
+//----
+void Scene::UpdateSceneMeshTransform(const std::shared_ptr<sl12::SceneMesh>& mesh, const DirectX::XMFLOAT4X4& mtxLocalToWorld)
+{
+	mesh->SetMtxLocalToWorld(mtxLocalToWorld);
+	meshletResource_->UpdateTransform(mesh.get());
+	int instanceIndex = meshletResource_->GetInstanceIndex(mesh.get());
+	if (instanceIndex >= 0)
+	{
+		UpdateInstanceBound((sl12::u32)instanceIndex);
+	}
+}
+
+//----
+sl12::u64 Scene::CalcShadowCasterHash() const
+{
+	// FNV-1a
+	const sl12::u64 kPrime = 1099511628211ull;
+	sl12::u64 hash = 14695981039346656037ull;
+	auto Hash = [&](const void* p, size_t size)
+	{
+		auto bytes = static_cast<const sl12::u8*>(p);
+		for (size_t i = 0; i < size; i++)
+		{
+			hash = (hash ^ bytes[i]) * kPrime;
+		}
+	};
+
+	// メッシュの追加/削除と移動を検出する
+	sl12::u64 count = sceneMeshes_.size();
+	Hash(&count, sizeof(count));
+	for (auto&& mesh : sceneMeshes_)
+	{
+		const sl12::SceneMesh* pMesh = mesh.get();
+		Hash(&pMesh, sizeof(pMesh));
+		Hash(&mesh->GetMtxLocalToWorld(), sizeof(DirectX::XMFLOAT4X4));
+	}
+	return hash;
+}
+
+//----
+void Scene::UpdateShadowHistory(const DirectX::XMFLOAT4X4* mtxWorldToShadows, sl12::u32 cascadeCount, bool bUseCache)
+{
+	sl12::u64 casterHash = CalcShadowCasterHash();
+	bool bCasterChanged = casterHash != shadowCacheStats_.casterHash;
+
+	// カスケード数が変わるとアトラスの配置が変わる
+	bool bLayoutChanged = cascadeCount != prevShadowCascadeCount_;
+	shadowCacheStats_.renderedCascades = 0;
+	shadowCacheStats_.reusedCascades = 0;
+	for (sl12::u32 i = 0; i < kShadowCascadeMax; i++)
+	{
+		bShadowHistoryValid_[i] = (i < cascadeCount) && !bCasterChanged && !bLayoutChanged
+			&& memcmp(&mtxPrevWorldToShadows_[i], &mtxWorldToShadows[i], sizeof(DirectX::XMFLOAT4X4)) == 0;
+		if (i < cascadeCount)
+		{
+			mtxPrevWorldToShadows_[i] = mtxWorldToShadows[i];
+
+			// 前フレームと同じ内容になるカスケードはシャドウマップを再利用できる
+			bShadowCascadeCached_[i] = bUseCache && bShadowHistoryValid_[i];
+			if (bShadowCascadeCached_[i])
+			{
+				shadowCacheStats_.reusedCascades++;
+			}
+			else
+			{
+				shadowCacheStats_.renderedCascades++;
+			}
+		}
+		else
+		{
+			bShadowCascadeCached_[i] = false;
+		}
+	}
+	prevShadowCascadeCount_ = cascadeCount;
+	shadowCacheStats_.casterHash = casterHash;
+	if (shadowCacheStats_.renderedCascades == 0)
+	{
+		shadowCacheStats_.reusedFrames++;
+	}
+	else
+	{
+		shadowCacheStats_.renderedFrames++;
+	}
+}
+
+//----
+void Scene::CreateVirtualShadowResources(sl12::CommandList* pCmdList)
+{
+	const sl12::u32 kPageCount = VSM_PAGE_COUNT_X * VSM_PAGE_COUNT_X;
+
+	// physical page pool.
+	{
+		sl12::TextureDesc desc;
+		desc.Initialize2D(kShadowMapFormat, VSM_PHYSICAL_SIZE, VSM_PHYSICAL_SIZE, 1, 1, sl12::ResourceUsage::ShaderResource | sl12::ResourceUsage::DepthStencil);
+		desc.clearDepth = 0.0f;
+		vsmPool_ = sl12::MakeUnique<sl12::Texture>(pDevice_);
+		vsmPool_->Initialize(pDevice_, desc);
+		vsmPoolSRV_ = sl12::MakeUnique<sl12::TextureView>(pDevice_);
+		vsmPoolSRV_->Initialize(pDevice_, &vsmPool_);
+		vsmPoolDSV_ = sl12::MakeUnique<sl12::DepthStencilView>(pDevice_);
+		vsmPoolDSV_->Initialize(pDevice_, &vsmPool_);
+
+		// 深度テクスチャはDEPTH_WRITEで生成される
+		pCmdList->GetLatestCommandList()->ClearDepthStencilView(vsmPoolDSV_->GetDescInfo().cpuHandle, D3D12_CLEAR_FLAG_DEPTH, 0.0f, 0, 0, nullptr);
+		pCmdList->TransitionBarrier(&vsmPool_, D3D12_RESOURCE_STATE_DEPTH_WRITE, D3D12_RESOURCE_STATE_ALL_SHADER_RESOURCE);
+	}
+
+	// page request bits.
+	{
+		sl12::BufferDesc desc{};
+		desc.heap = sl12::BufferHeap::Default;
+		desc.size = kPageCount / 8;
+		desc.stride = 0;
+		desc.usage = sl12::ResourceUsage::UnorderedAccess;
+		desc.initialState = D3D12_RESOURCE_STATE_GENERIC_READ;
+
+		vsmRequestBuffer_ = sl12::MakeUnique<sl12::Buffer>(pDevice_);
+		vsmRequestBuffer_->Initialize(pDevice_, desc);
+		vsmRequestUAV_ = sl12::MakeUnique<sl12::UnorderedAccessView>(pDevice_);
+		vsmRequestUAV_->Initialize(pDevice_, &vsmRequestBuffer_, 0, 0, 0, 0);
+
+		desc.heap = sl12::BufferHeap::Dynamic;
+		desc.usage = sl12::ResourceUsage::Unknown;
+		desc.initialState = D3D12_RESOURCE_STATE_COMMON;
+		vsmRequestClear_ = sl12::MakeUnique<sl12::Buffer>(pDevice_);
+		vsmRequestClear_->Initialize(pDevice_, desc);
+
+		void* p = vsmRequestClear_->Map();
+		memset(p, 0, desc.size);
+		vsmRequestClear_->Unmap();
+	}
+
+	// page table.
+	{
+		sl12::BufferDesc desc{};
+		desc.heap = sl12::BufferHeap::Default;
+		desc.size = sizeof(sl12::u32) * kPageCount;
+		desc.stride = 0;
+		desc.usage = sl12::ResourceUsage::ShaderResource;
+		desc.initialState = D3D12_RESOURCE_STATE_GENERIC_READ;
+
+		vsmPageTableBuffer_ = sl12::MakeUnique<sl12::Buffer>(pDevice_);
+		vsmPageTableBuffer_->Initialize(pDevice_, desc);
+		vsmPageTableSRV_ = sl12::MakeUnique<sl12::BufferView>(pDevice_);
+		vsmPageTableSRV_->Initialize(pDevice_, &vsmPageTableBuffer_, 0, 0, 0);
+	}
+
+	vsmPageTable_.Initialize(VSM_PAGE_COUNT_X, VSM_PHYSICAL_PAGE_COUNT_X * VSM_PHYSICAL_PAGE_COUNT_X);
+	vsmGpuPageTable_.clear();
+	vsmRequestReadbacks_[0].Reset();
+	vsmRequestReadbacks_[1].Reset();
+}
+
+//----
+void Scene::UpdateVirtualShadowMap(sl12::CommandList* pCmdList, const DirectX::XMFLOAT4X4& mtxWorldToVirtual, sl12::u32 renderBudget)
+{
+	if (!vsmPool_.IsValid())
+	{
+		CreateVirtualShadowResources(pCmdList);
+	}
+
+	// ページごとのカリング結果のバッファ
+	// メッシュレットの総数が変わったら作り直す
+	auto pArgBuffer = meshletResource_->GetMeshletIndirectArgBuffer();
+	if (!vsmCompactArg_.IsValid() || vsmCompactArg_->GetBufferDesc().size != pArgBuffer->GetBufferDesc().size)
+	{
+		sl12::BufferDesc desc = pArgBuffer->GetBufferDesc();
+		desc.heap = sl12::BufferHeap::Default;
+		desc.usage = sl12::ResourceUsage::UnorderedAccess;
+		desc.initialState = D3D12_RESOURCE_STATE_INDIRECT_ARGUMENT;
+		vsmCompactArg_ = sl12::MakeUnique<sl12::Buffer>(pDevice_);
+		vsmCompactArg_->Initialize(pDevice_, desc);
+		vsmCompactArgUAV_ = sl12::MakeUnique<sl12::UnorderedAccessView>(pDevice_);
+		vsmCompactArgUAV_->Initialize(pDevice_, &vsmCompactArg_, 0, 0, 0, 0);
+
+		desc = meshletResource_->GetDrawCountClearUpload()->GetBufferDesc();
+		desc.heap = sl12::BufferHeap::Default;
+		desc.usage = sl12::ResourceUsage::UnorderedAccess;
+		desc.initialState = D3D12_RESOURCE_STATE_INDIRECT_ARGUMENT;
+		vsmDrawCount_ = sl12::MakeUnique<sl12::Buffer>(pDevice_);
+		vsmDrawCount_->Initialize(pDevice_, desc);
+		vsmDrawCountUAV_ = sl12::MakeUnique<sl12::UnorderedAccessView>(pDevice_);
+		vsmDrawCountUAV_->Initialize(pDevice_, &vsmDrawCount_, 0, 0, 0, 0);
+	}
+
+	// ライト行列かキャスターが変わったら割り当て済みのページを全て描画し直す
+	sl12::u64 casterHash = CalcShadowCasterHash();
+	if (casterHash != vsmCasterHash_ || memcmp(&mtxPrevWorldToVirtual_, &mtxWorldToVirtual, sizeof(DirectX::XMFLOAT4X4)) != 0)
+	{
+		vsmPageTable_.InvalidateAll();
+		vsmCasterHash_ = casterHash;
+		mtxPrevWorldToVirtual_ = mtxWorldToVirtual;
+	}
+
+	// 2フレーム前の要求でページを割り当てる
+	const sl12::u32 kPageCount = VSM_PAGE_COUNT_X * VSM_PAGE_COUNT_X;
+	if (vsmRequestReadbacks_[1].IsValid())
+	{
+		const sl12::u32* bits = static_cast<const sl12::u32*>(vsmRequestReadbacks_[0]->Map());
+		VirtualShadowPageTable::CompactRequests(bits, kPageCount, vsmRequestedPages_);
+		vsmRequestReadbacks_[0]->Unmap();
+		vsmRequestReadbacks_[0] = std::move(vsmRequestReadbacks_[1]);
+
+		vsmPageTable_.Update(vsmRequestedPages_, frameIndex_);
+	}
+
+	// 描画するページの定数バッファ
+	vsmPageTable_.TakeDirtyPages(renderBudget, vsmRenderPages_);
+	tempCBs_.hVsmPageCBs.clear();
+	tempCBs_.hVsmPageFrustumCBs.clear();
+	auto cbvMan = pRenderSystem_->GetCbvManager();
+	for (auto&& page : vsmRenderPages_)
+	{
+		ShadowCB cbPage{};
+		FrustumCB cbFrustum{};
+		CalcVirtualShadowPageProjection(mtxWorldToVirtual, page.virtualPage, VSM_PAGE_COUNT_X, cbPage.mtxWorldToProj, cbFrustum.frustumPlanes);
+		cbPage.cascadeCount = 1;
+		cbPage.atlasRect = DirectX::XMFLOAT4(0.0f, 0.0f, 1.0f, 1.0f);
+		cbPage.mtxWorldToVirtual = mtxWorldToVirtual;
+		tempCBs_.hVsmPageCBs.push_back(cbvMan->GetTemporal(&cbPage, sizeof(cbPage)));
+		tempCBs_.hVsmPageFrustumCBs.push_back(cbvMan->GetTemporal(&cbFrustum, sizeof(cbFrustum)));
+	}
+
+	// ページテーブルは変化したときだけ転送する
+	// 描画はこのフレームのシャドウパスで終わるので、描画するページもここで有効になる
+	std::vector<sl12::u32> table;
+	vsmPageTable_.BuildGpuPageTable(table);
+	if (table != vsmGpuPageTable_)
+	{
+		sl12::BufferDesc desc = vsmPageTableBuffer_->GetBufferDesc();
+		desc.heap = sl12::BufferHeap::Dynamic;
+		desc.usage = sl12::ResourceUsage::Unknown;
+		desc.initialState = D3D12_RESOURCE_STATE_COMMON;
+		UniqueHandle<sl12::Buffer> UploadB = sl12::MakeUnique<sl12::Buffer>(pDevice_);
+		UploadB->Initialize(pDevice_, desc);
+
+		void* p = UploadB->Map();
+		memcpy(p, table.data(), sizeof(sl12::u32) * table.size());
+		UploadB->Unmap();
+
+		pCmdList->TransitionBarrier(&vsmPageTableBuffer_, D3D12_RESOURCE_STATE_GENERIC_READ, D3D12_RESOURCE_STATE_COPY_DEST);
+		pCmdList->GetLatestCommandList()->CopyResource(vsmPageTableBuffer_->GetResourceDep(), UploadB->GetResourceDep());
+		pCmdList->TransitionBarrier(&vsmPageTableBuffer_, D3D12_RESOURCE_STATE_COPY_DEST, D3D12_RESOURCE_STATE_GENERIC_READ);
+
+		vsmGpuPageTable_ = std::move(table);
+	}
+}
+
+//----
+void Scene::ReadbackVirtualShadowRequests(sl12::CommandList* pCmdList)
+{
+	if (!vsmRequestBuffer_.IsValid())
+	{
+		return;
+	}
+
+	UniqueHandle<sl12::Buffer> readback = sl12::MakeUnique<sl12::Buffer>(pDevice_);
+	sl12::BufferDesc desc{};
+	desc.heap = sl12::BufferHeap::ReadBack;
+	desc.size = vsmRequestBuffer_->GetBufferDesc().size;
+	desc.usage = sl12::ResourceUsage::Unknown;
+	readback->Initialize(pDevice_, desc);
+	pCmdList->TransitionBarrier(&vsmRequestBuffer_, D3D12_RESOURCE_STATE_UNORDERED_ACCESS, D3D12_RESOURCE_STATE_GENERIC_READ);
+	pCmdList->GetLatestCommandList()->CopyResource(readback->GetResourceDep(), vsmRequestBuffer_->GetResourceDep());
+	if (!vsmRequestReadbacks_[0].IsValid())
+	{
+		vsmRequestReadbacks_[0] = std::move(readback);
+	}
+	else
+	{
+		vsmRequestReadbacks_[1] = std::move(readback);
+	}
+}
+
+//----
+void Scene::RequestMeshletCullReadback()
+{
+	ReleaseMeshletCullReadback();
+	meshletCullReadback_.frameIndex = frameIndex_;
+	bMeshletCullReadbackRequest_ = true;
+}
+
+//----
+void Scene::ReadbackMeshletCull(sl12::CommandList* pCmdList, bool b2nd, sl12::Buffer* pArgs, sl12::Buffer* pCounts, sl12::Buffer* pDrawFlags, sl12::u32 drawCallCount)
+{
+	// UAVのままパスを終えるので、コピーの後に戻す
+	auto CopyToReadback = [this, pCmdList](sl12::Buffer* pSrc)
+	{
+		UniqueHandle<sl12::Buffer> readback = sl12::MakeUnique<sl12::Buffer>(pDevice_);
+		sl12::BufferDesc desc{};
+		desc.heap = sl12::BufferHeap::ReadBack;
+		desc.size = pSrc->GetBufferDesc().size;
+		desc.usage = sl12::ResourceUsage::Unknown;
+		readback->Initialize(pDevice_, desc);
+		pCmdList->TransitionBarrier(pSrc, D3D12_RESOURCE_STATE_UNORDERED_ACCESS, D3D12_RESOURCE_STATE_COPY_SOURCE);
+		pCmdList->GetLatestCommandList()->CopyBufferRegion(readback->GetResourceDep(), 0, pSrc->GetResourceDep(), 0, desc.size);
+		pCmdList->TransitionBarrier(pSrc, D3D12_RESOURCE_STATE_COPY_SOURCE, D3D12_RESOURCE_STATE_UNORDERED_ACCESS);
+		return readback;
+	};
+
+	int phase = b2nd ? 1 : 0;
+	meshletCullReadback_.args[phase] = CopyToReadback(pArgs);
+	meshletCullReadback_.counts[phase] = CopyToReadback(pCounts);
+	if (pDrawFlags)
+	{
+		meshletCullReadback_.drawFlags = CopyToReadback(pDrawFlags);
+	}
+	if (!b2nd)
+	{
+		meshletCullReadback_.drawCallCount = drawCallCount;
+	}
+}
+
+//----
+Scene::MeshletCullReadback* Scene::GetMeshletCullReadback()
+{
+	if (bMeshletCullReadbackRequest_ || frameIndex_ < meshletCullReadback_.frameIndex + 2)
+	{
+		return nullptr;
+	}
+	return &meshletCullReadback_;
+}
+
+//----
+void Scene::ReleaseMeshletCullReadback()
+{
+	for (int phase = 0; phase < 2; phase++)
+	{
+		meshletCullReadback_.args[phase].Reset();
+		meshletCullReadback_.counts[phase].Reset();
+	}
+	meshletCullReadback_.drawFlags.Reset();
+	meshletCullReadback_.drawCallCount = 0;
+}
+
+//----
+void Scene::RequestClassifyReadback()
+{
+	ReleaseClassifyReadback();
+	classifyReadback_.frameIndex = frameIndex_;
+	bClassifyReadbackRequest_ = true;
+}
+
+//----
+void Scene::ReadbackClassify(sl12::CommandList* pCmdList, sl12::Texture* pVis, sl12::Texture* pDepth,
+	sl12::Buffer* pTileMaterialCount, sl12::Buffer* pTileMaterialList, sl12::Buffer* pDrawArgs, sl12::Buffer* pTileOffset, sl12::Buffer* pTileIndex)
+{
+	auto CreateReadback = [this](UINT64 size)
+	{
+		UniqueHandle<sl12::Buffer> readback = sl12::MakeUnique<sl12::Buffer>(pDevice_);
+		sl12::BufferDesc desc{};
+		desc.heap = sl12::BufferHeap::ReadBack;
+		desc.size = size;
+		desc.usage = sl12::ResourceUsage::Unknown;
+		readback->Initialize(pDevice_, desc);
+		return readback;
+	};
+
+	// 出力はUAVのままパスを終えるので、コピーの後に戻す
+	auto CopyBuffer = [&](sl12::Buffer* pSrc)
+	{
+		auto readback = CreateReadback(pSrc->GetBufferDesc().size);
+		pCmdList->TransitionBarrier(pSrc, D3D12_RESOURCE_STATE_UNORDERED_ACCESS, D3D12_RESOURCE_STATE_COPY_SOURCE);
+		pCmdList->GetLatestCommandList()->CopyBufferRegion(readback->GetResourceDep(), 0, pSrc->GetResourceDep(), 0, pSrc->GetBufferDesc().size);
+		pCmdList->TransitionBarrier(pSrc, D3D12_RESOURCE_STATE_COPY_SOURCE, D3D12_RESOURCE_STATE_UNORDERED_ACCESS);
+		return readback;
+	};
+
+	// 入力のテクスチャはRenderGraphがシェーダリソースにしている
+	auto CopyTexture = [&](sl12::Texture* pSrc, sl12::u32& outRowPitch)
+	{
+		D3D12_RESOURCE_DESC texDesc = pSrc->GetResourceDesc();
+		D3D12_PLACED_SUBRESOURCE_FOOTPRINT footprint;
+		UINT64 totalBytes;
+		pDevice_->GetDeviceDep()->GetCopyableFootprints(&texDesc, 0, 1, 0, &footprint, nullptr, nullptr, &totalBytes);
+		auto readback = CreateReadback(totalBytes);
+
+		D3D12_TEXTURE_COPY_LOCATION dst{}, src{};
+		dst.pResource = readback->GetResourceDep();
+		dst.Type = D3D12_TEXTURE_COPY_TYPE_PLACED_FOOTPRINT;
+		dst.PlacedFootprint = footprint;
+		src.pResource = pSrc->GetResourceDep();
+		src.Type = D3D12_TEXTURE_COPY_TYPE_SUBRESOURCE_INDEX;
+		src.SubresourceIndex = 0;
+		pCmdList->TransitionBarrier(pSrc, D3D12_RESOURCE_STATE_ALL_SHADER_RESOURCE, D3D12_RESOURCE_STATE_COPY_SOURCE);
+		pCmdList->GetLatestCommandList()->CopyTextureRegion(&dst, 0, 0, 0, &src, nullptr);
+		pCmdList->TransitionBarrier(pSrc, D3D12_RESOURCE_STATE_COPY_SOURCE, D3D12_RESOURCE_STATE_ALL_SHADER_RESOURCE);
+		outRowPitch = footprint.Footprint.RowPitch;
+		return readback;
+	};
+
+	classifyReadback_.visibility = CopyTexture(pVis, classifyReadback_.visRowPitch);
+	classifyReadback_.depth = CopyTexture(pDepth, classifyReadback_.depthRowPitch);
+	classifyReadback_.tileMaterialCount = CopyBuffer(pTileMaterialCount);
+	classifyReadback_.tileMaterialList = CopyBuffer(pTileMaterialList);
+	classifyReadback_.drawArgs = CopyBuffer(pDrawArgs);
+	classifyReadback_.tileOffset = CopyBuffer(pTileOffset);
+	classifyReadback_.tileIndex = CopyBuffer(pTileIndex);
+	classifyReadback_.width = screenWidth_;
+	classifyReadback_.height = screenHeight_;
+}
+
+//----
+Scene::ClassifyReadback* Scene::GetClassifyReadback()
+{
+	if (bClassifyReadbackRequest_ || frameIndex_ < classifyReadback_.frameIndex + 2)
+	{
+		return nullptr;
+	}
+	return &classifyReadback_;
+}
+
+//----
+void Scene::ReleaseClassifyReadback()
+{
+	classifyReadback_.visibility.Reset();
+	classifyReadback_.depth.Reset();
+	classifyReadback_.tileMaterialCount.Reset();
+	classifyReadback_.tileMaterialList.Reset();
+	classifyReadback_.drawArgs.Reset();
+	classifyReadback_.tileOffset.Reset();
+	classifyReadback_.tileIndex.Reset();
+	classifyReadback_.width = classifyReadback_.height = 0;
+}
+
+//----
+void Scene::RecordMeshletAlphaBake(sl12::CommandList* pCmdList)
+{
+	if (!bMeshletAlphaBakeRequest_)
+	{
+		return;
+	}
+	bMeshletAlphaBakeRequest_ = false;
+	ReleaseMeshletAlphaBake();
+
+	UniqueHandle<sl12::RootSignature> rsTexcoord = sl12::MakeUnique<sl12::RootSignature>(pDevice_);
+	UniqueHandle<sl12::RootSignature> rsTexel = sl12::MakeUnique<sl12::RootSignature>(pDevice_);
+	UniqueHandle<sl12::ComputePipelineState> psoTexcoord = sl12::MakeUnique<sl12::ComputePipelineState>(pDevice_);
+	UniqueHandle<sl12::ComputePipelineState> psoTexel = sl12::MakeUnique<sl12::ComputePipelineState>(pDevice_);
+	rsTexcoord->Initialize(pDevice_, pRenderSystem_->GetShader(MeshletAlphaTexcoordC));
+	rsTexel->Initialize(pDevice_, pRenderSystem_->GetShader(MeshletAlphaTexelC));
+	{
+		sl12::ComputePipelineStateDesc psoDesc;
+		psoDesc.pRootSignature = &rsTexcoord;
+		psoDesc.pCS = pRenderSystem_->GetShader(MeshletAlphaTexcoordC);
+		psoTexcoord->Initialize(pDevice_, psoDesc);
+
+		psoDesc.pRootSignature = &rsTexel;
+		psoDesc.pCS = pRenderSystem_->GetShader(MeshletAlphaTexelC);
+		psoTexel->Initialize(pDevice_, psoDesc);
+	}
+
+	struct CB
+	{
+		sl12::u32 IndexOffset;
+		sl12::u32 UVOffset;
+		sl12::u32 IndexCount;
+		sl12::u32 RowPitch;
+	};
+
+	// UAVに書き出してから読み戻しバッファにコピーする
+	// 作業用のバッファとビューはDeviceの破棄キューで遅延解放される
+	auto Gather = [&](size_t size, sl12::RootSignature* pRS, sl12::DescriptorSet& descSet, UINT x, UINT y)
+	{
+		sl12::BufferDesc desc{};
+		desc.heap = sl12::BufferHeap::Default;
+		desc.size = size;
+		desc.stride = 0;
+		desc.usage = sl12::ResourceUsage::UnorderedAccess;
+		desc.initialState = D3D12_RESOURCE_STATE_UNORDERED_ACCESS;
+		UniqueHandle<sl12::Buffer> buffer = sl12::MakeUnique<sl12::Buffer>(pDevice_);
+		buffer->Initialize(pDevice_, desc);
+		UniqueHandle<sl12::UnorderedAccessView> uav = sl12::MakeUnique<sl12::UnorderedAccessView>(pDevice_);
+		uav->Initialize(pDevice_, &buffer, 0, 0, 0, 0);
+
+		descSet.SetCsUav(0, uav->GetDescInfo().cpuHandle);
+		pCmdList->SetComputeRootSignatureAndDescriptorSet(pRS, &descSet);
+		pCmdList->GetLatestCommandList()->Dispatch(x, y, 1);
+
+		desc.heap = sl12::BufferHeap::ReadBack;
+		desc.usage = sl12::ResourceUsage::Unknown;
+		UniqueHandle<sl12::Buffer> readback = sl12::MakeUnique<sl12::Buffer>(pDevice_);
+		readback->Initialize(pDevice_, desc);
+		pCmdList->TransitionBarrier(&buffer, D3D12_RESOURCE_STATE_UNORDERED_ACCESS, D3D12_RESOURCE_STATE_COPY_SOURCE);
+		pCmdList->GetLatestCommandList()->CopyBufferRegion(readback->GetResourceDep(), 0, buffer->GetResourceDep(), 0, size);
+		return readback;
+	};
+
+	auto meshMan = pRenderSystem_->GetMeshManager();
+	std::unordered_map<const sl12::ResourceItemTextureBase*, sl12::u32> texelIndices;
+	std::unordered_set<const sl12::ResourceItemMesh*> bakedMeshes;
+	for (auto&& mesh : sceneMeshes_)
+	{
+		auto resMesh = mesh->GetParentResource();
+		if (!bakedMeshes.insert(resMesh).second)
+		{
+			continue;
+		}
+
+		auto&& submeshes = resMesh->GetSubmeshes();
+		auto&& materials = resMesh->GetMaterials();
+		for (sl12::u32 submeshIndex = 0; submeshIndex < (sl12::u32)submeshes.size(); submeshIndex++)
+		{
+			auto&& submesh = submeshes[submeshIndex];
+			auto&& material = materials[submesh.materialIndex];
+			if (material.blendType != sl12::ResourceMeshMaterialBlendType::Masked)
+			{
+				continue;
+			}
+			auto resTex = material.baseColorTex.GetItem<sl12::ResourceItemTextureBase>();
+			if (!resTex)
+			{
+				continue;
+			}
+
+			// ベースカラーのアルファ (テクスチャごとに1回)
+			auto itTexel = texelIndices.find(resTex);
+			if (itTexel == texelIndices.end())
+			{
+				// ストリーミング中のテクスチャは小さいミップで分類すると保守的にならないので除外する
+				if (resTex->IsSameSubType(sl12::ResourceItemStreamingTexture::kSubType)
+					&& material.baseColorTex.GetItem<sl12::ResourceItemStreamingTexture>()->GetCurrMipLevel() > 0)
+				{
+					sl12::ConsolePrint("Warning: skip meshlet alpha bake, texture is not fully streamed in. (%s)\n", resTex->GetFilePath().c_str());
+					texelIndices[resTex] = ~0u;
+					continue;
+				}
+
+				auto pTex = const_cast<sl12::ResourceItemTextureBase*>(resTex);
+				MeshletAlphaBakeTexel texel;
+				texel.width = pTex->GetTexture().GetTextureDesc().width;
+				texel.height = pTex->GetTexture().GetTextureDesc().height;
+				texel.rowPitch = (texel.width + 3) / 4;
+
+				CB cbData = { 0, 0, 0, texel.rowPitch };
+				auto hCBV = pRenderSystem_->GetCbvManager()->GetTemporal(&cbData, sizeof(cbData));
+				sl12::DescriptorSet descSet;
+				descSet.Reset();
+				descSet.SetCsCbv(0, hCBV.GetCBV()->GetDescInfo().cpuHandle);
+				descSet.SetCsSrv(2, pTex->GetTextureView().GetDescInfo().cpuHandle);
+				pCmdList->GetLatestCommandList()->SetPipelineState(psoTexel->GetPSO());
+				texel.readback = Gather(sizeof(sl12::u32) * texel.rowPitch * texel.height, &rsTexel, descSet, (texel.rowPitch + 7) / 8, (texel.height + 7) / 8);
+
+				itTexel = texelIndices.emplace(resTex, (sl12::u32)meshletAlphaBake_.texels.size()).first;
+				meshletAlphaBake_.texels.push_back(std::move(texel));
+			}
+			if (itTexel->second == ~0u)
+			{
+				continue;
+			}
+
+			// インデックスごとのUV
+			MeshletAlphaBakeSubmesh job;
+			job.resMesh = resMesh;
+			job.submeshIndex = submeshIndex;
+			job.texelIndex = itTexel->second;
+			for (auto&& meshlet : submesh.meshlets)
+			{
+				job.indexCount = std::max(job.indexCount, (sl12::u32)(meshlet.indexOffset + meshlet.indexCount));
+			}
+			if (job.indexCount == 0)
+			{
+				continue;
+			}
+
+			CB cbData = {
+				(sl12::u32)(resMesh->GetIndexHandle().offset + submesh.indexOffsetBytes),
+				(sl12::u32)(resMesh->GetTexcoordHandle().offset + submesh.texcoordOffsetBytes),
+				job.indexCount,
+				0 };
+			auto hCBV = pRenderSystem_->GetCbvManager()->GetTemporal(&cbData, sizeof(cbData));
+			sl12::DescriptorSet descSet;
+			descSet.Reset();
+			descSet.SetCsCbv(0, hCBV.GetCBV()->GetDescInfo().cpuHandle);
+			descSet.SetCsSrv(0, meshMan->GetVertexBufferSRV()->GetDescInfo().cpuHandle);
+			descSet.SetCsSrv(1, meshMan->GetIndexBufferSRV()->GetDescInfo().cpuHandle);
+			pCmdList->GetLatestCommandList()->SetPipelineState(psoTexcoord->GetPSO());
+			job.readback = Gather(sizeof(DirectX::XMFLOAT2) * job.indexCount, &rsTexcoord, descSet, (job.indexCount + 63) / 64, 1);
+
+			meshletAlphaBake_.submeshes.push_back(std::move(job));
+		}
+	}
+
+	meshletAlphaBake_.frameIndex = frameIndex_;
+	meshletAlphaBake_.bRecorded = true;
+}
+
+//----
+int Scene::FinishMeshletAlphaBake()
+{
+	if (!meshletAlphaBake_.bRecorded || frameIndex_ < meshletAlphaBake_.frameIndex + 2)
+	{
+		return -1;
+	}
+
+	// 8bitアルファを展開してミップチェーンを作る
+	std::vector<MeshletAlphaImage> images(meshletAlphaBake_.texels.size());
+	for (size_t i = 0; i < images.size(); i++)
+	{
+		auto&& texel = meshletAlphaBake_.texels[i];
+		std::vector<sl12::u8> alpha(texel.width * texel.height);
+		const sl12::u32* pPacked = static_cast<const sl12::u32*>(texel.readback->Map());
+		for (sl12::u32 y = 0; y < texel.height; y++)
+		{
+			for (sl12::u32 x = 0; x < texel.width; x++)
+			{
+				alpha[y * texel.width + x] = (sl12::u8)(pPacked[y * texel.rowPitch + x / 4] >> ((x % 4) * 8));
+			}
+		}
+		texel.readback->Unmap();
+		InitMeshletAlphaImage(texel.width, texel.height, alpha.data(), kMeshletAlphaBakeLevels, images[i]);
+	}
+
+	// メッシュごとのベイク結果 (マスクでないサブメッシュは空のまま)
+	std::unordered_map<const sl12::ResourceItemMesh*, MeshletAlphaBake> bakes;
+	for (auto&& job : meshletAlphaBake_.submeshes)
+	{
+		auto&& bake = bakes[job.resMesh];
+		bake.submeshClasses.resize(job.resMesh->GetSubmeshes().size());
+	}
+
+	// サブメッシュ単位で並列に分類する (書き込み先はサブメッシュごとに別)
+	std::for_each(std::execution::par, meshletAlphaBake_.submeshes.begin(), meshletAlphaBake_.submeshes.end(),
+		[&](MeshletAlphaBakeSubmesh& job)
+		{
+			std::vector<DirectX::XMFLOAT2> texcoords(job.indexCount);
+			memcpy(texcoords.data(), job.readback->Map(), sizeof(DirectX::XMFLOAT2) * job.indexCount);
+			job.readback->Unmap();
+
+			// UVはインデックス順に展開済みなので、インデックスは連番になる
+			std::vector<sl12::u32> indices(job.indexCount);
+			std::iota(indices.begin(), indices.end(), 0u);
+
+			auto&& submesh = job.resMesh->GetSubmeshes()[job.submeshIndex];
+			std::vector<MeshletAlphaRange> ranges;
+			ranges.reserve(submesh.meshlets.size());
+			for (auto&& meshlet : submesh.meshlets)
+			{
+				ranges.push_back({(sl12::u32)meshlet.indexOffset, (sl12::u32)meshlet.indexCount});
+			}
+
+			auto&& classes = bakes.at(job.resMesh).submeshClasses[job.submeshIndex];
+			BakeMeshletAlpha(images[job.texelIndex], texcoords.data(), indices.data(), ranges, kMeshletAlphaThreshold, classes);
+		});
+
+	int savedCount = 0;
+	for (auto&& it : bakes)
+	{
+		std::string bakeFile = it.first->GetFilePath() + ".malpha";
+		if (SaveMeshletAlphaBake(bakeFile, it.second))
+		{
+			meshletResource_->ReloadMeshletAlphaClasses(it.first);
+			savedCount++;
+		}
+	}
+
+	ReleaseMeshletAlphaBake();
+	if (savedCount > 0)
+	{
+		// マスクのサブメッシュのヒットグループが変わるので、シェーダテーブルを作り直す
+		rtTableGeneration_++;
+	}
+	return savedCount;
+}
+
+//----
+void Scene::ReleaseMeshletAlphaBake()
+{
+	meshletAlphaBake_.texels.clear();
+	meshletAlphaBake_.submeshes.clear();
+	meshletAlphaBake_.bRecorded = false;
+}
+
+//----
+InstanceBoundTree::Node InstanceBoundTree::EmptyNode()
+{
+	Node ret;
+	ret.aabbMin = DirectX::XMFLOAT3(FLT_MAX, FLT_MAX, FLT_MAX);
+	ret.aabbMax = DirectX::XMFLOAT3(-FLT_MAX, -FLT_MAX, -FLT_MAX);
+	return ret;
+}
+
+InstanceBoundTree::Node InstanceBoundTree::MergeNode(const Node& a, const Node& b)
+{
+	Node ret;
+	ret.aabbMin.x = std::min(a.aabbMin.x, b.aabbMin.x);
+	ret.aabbMin.y = std::min(a.aabbMin.y, b.aabbMin.y);
+	ret.aabbMin.z = std::min(a.aabbMin.z, b.aabbMin.z);
+	ret.aabbMax.x = std::max(a.aabbMax.x, b.aabbMax.x);
+	ret.aabbMax.y = std::max(a.aabbMax.y, b.aabbMax.y);
+	ret.aabbMax.z = std::max(a.aabbMax.z, b.aabbMax.z);
+	return ret;
+}
+
+void InstanceBoundTree::Reset(sl12::u32 count)
+{
+	leafCount_ = 1;
+	while (leafCount_ < count)
+	{
+		leafCount_ *= 2;
+	}
+	nodes_.assign(leafCount_ * 2, EmptyNode());
+}
+
+void InstanceBoundTree::Grow(sl12::u32 count)
+{
+	// 葉を引き継いで、内部ノードを下から作り直す
+	std::vector<Node> oldNodes = std::move(nodes_);
+	sl12::u32 oldLeafCount = leafCount_;
+	Reset(count);
+	for (sl12::u32 i = 0; i < oldLeafCount; i++)
+	{
+		nodes_[leafCount_ + i] = oldNodes[oldLeafCount + i];
 	}
-	else if (meshType == 2)
+	for (sl12::u32 n = leafCount_ - 1; n >= 1; n--)
 	{
-		// sponza
-		{
-			auto mesh = std::make_shared<sl12::SceneMesh>(pDevice_, hSponzaMesh_.GetItem<sl12::ResourceItemMesh>());
-			DirectX::XMFLOAT3 pos(0.0f, 100.0f, 0.0f);
-			DirectX::XMFLOAT3 scl(100.0f, 100.0f, 100.0f);
-			DirectX::XMFLOAT4X4 mat;
-			DirectX::XMMATRIX m = DirectX::XMMatrixScaling(scl.x, scl.y, scl.z)
-									* DirectX::XMMatrixTranslation(pos.x, pos.y, pos.z);
-			DirectX::XMStoreFloat4x4(&mat, m);
-			mesh->SetMtxLocalToWorld(mat);
-
-			sceneMeshes_.push_back(mesh);
-			sceneRoot_->AttachNode(mesh);
-		}
-		// curtain
-		{
-			auto mesh = std::make_shared<sl12::SceneMesh>(pDevice_, hCurtainMesh_.GetItem<sl12::ResourceItemMesh>());
-			DirectX::XMFLOAT3 pos(0.0f, 100.0f, 0.0f);
-			DirectX::XMFLOAT3 scl(100.0f, 100.0f, 100.0f);
-			DirectX::XMFLOAT4X4 mat;
-			DirectX::XMMATRIX m = DirectX::XMMatrixScaling(scl.x, scl.y, scl.z)
-									* DirectX::XMMatrixTranslation(pos.x, pos.y, pos.z);
-			DirectX::XMStoreFloat4x4(&mat, m);
-			mesh->SetMtxLocalToWorld(mat);
+		nodes_[n] = MergeNode(nodes_[n * 2], nodes_[n * 2 + 1]);
+	}
+}
 
-			sceneMeshes_.push_back(mesh);
-			sceneRoot_->AttachNode(mesh);
-		}
+void InstanceBoundTree::Set(sl12::u32 index, const DirectX::XMFLOAT3& aabbMin, const DirectX::XMFLOAT3& aabbMax)
+{
+	if (index >= leafCount_)
+	{
+		Grow(std::max(index + 1, leafCount_ * 2));
 	}
-	else if (meshType == 3)
+	sl12::u32 n = leafCount_ + index;
+	nodes_[n].aabbMin = aabbMin;
+	nodes_[n].aabbMax = aabbMax;
+	for (n /= 2; n >= 1; n /= 2)
 	{
-		// Bistro
-		{
-			auto mesh = std::make_shared<sl12::SceneMesh>(pDevice_, hBistroMesh_.GetItem<sl12::ResourceItemMesh>());
-			DirectX::XMFLOAT3 pos(1240.0f, 920.0f, -20.0f);
-			DirectX::XMFLOAT3 scl(20.0f, 20.0f, 20.0f);
-			DirectX::XMFLOAT4X4 mat;
-			DirectX::XMMATRIX m = DirectX::XMMatrixScaling(scl.x, scl.y, scl.z)
-									* DirectX::XMMatrixTranslation(pos.x, pos.y, pos.z);
-			DirectX::XMStoreFloat4x4(&mat, m);
-			mesh->SetMtxLocalToWorld(mat);
+		nodes_[n] = MergeNode(nodes_[n * 2], nodes_[n * 2 + 1]);
+	}
+}
 
-			sceneMeshes_.push_back(mesh);
-			sceneRoot_->AttachNode(mesh);
-		}
+void InstanceBoundTree::Clear(sl12::u32 index)
+{
+	Node empty = EmptyNode();
+	Set(index, empty.aabbMin, empty.aabbMax);
+}
+
+void InstanceBoundTree::GetRoot(DirectX::XMFLOAT3& aabbMin, DirectX::XMFLOAT3& aabbMax) const
+{
+	if (nodes_.size() < 2)
+	{
+		Node empty = EmptyNode();
+		aabbMin = empty.aabbMin;
+		aabbMax = empty.aabbMax;
+		return;
 	}
+	aabbMin = nodes_[1].aabbMin;
+	aabbMax = nodes_[1].aabbMax;
+}
 
-	// create BVH manager.
-	bvhManager_ = sl12::MakeUnique<sl12::BvhManager>(pDevice_, pDevice_);
-	for (auto&& mesh : sceneMeshes_)
+//----
+void Scene::ComputeSceneAABB()
+{
+	instanceBounds_.Reset((sl12::u32)sceneMeshes_.size());
+	for (sl12::u32 i = 0; i < (sl12::u32)sceneMeshes_.size(); i++)
 	{
-		bvhManager_->AddGeometry(mesh->GetParentResource());
+		DirectX::XMFLOAT3 aabbMin, aabbMax;
+		CalcMeshWorldAABB(sceneMeshes_[i].get(), aabbMin, aabbMax);
+		instanceBounds_.Set(i, aabbMin, aabbMax);
 	}
+	instanceBounds_.GetRoot(sceneAABBMin_, sceneAABBMax_);
+}
 
-	ComputeSceneAABB();
-	CreateMeshletResource();
-	CreateMiplevelFeedback();
+//----
+void Scene::UpdateInstanceBound(sl12::u32 index)
+{
+	// 移動や削除でも縮むよう、インスタンス単位の木から全体を求め直す
+	DirectX::XMFLOAT3 aabbMin, aabbMax;
+	CalcMeshWorldAABB(sceneMeshes_[index].get(), aabbMin, aabbMax);
+	instanceBounds_.Set(index, aabbMin, aabbMax);
+	instanceBounds_.GetRoot(sceneAABBMin_, sceneAABBMax_);
+}
 
-	return true;
+//----
+void Scene::CalcMeshWorldAABB(const sl12::SceneMesh* mesh, DirectX::XMFLOAT3& aabbMin, DirectX::XMFLOAT3& aabbMax) const
+{
+	aabbMax = DirectX::XMFLOAT3(-FLT_MAX, -FLT_MAX, -FLT_MAX);
+	aabbMin = DirectX::XMFLOAT3(FLT_MAX, FLT_MAX, FLT_MAX);
+	auto mtx = DirectX::XMLoadFloat4x4(&mesh->GetMtxLocalToWorld());
+	auto&& bound = mesh->GetParentResource()->GetBoundingInfo();
+	DirectX::XMFLOAT3 pnts[] = {
+		DirectX::XMFLOAT3(bound.box.aabbMax.x, bound.box.aabbMax.y, bound.box.aabbMax.z),
+		DirectX::XMFLOAT3(bound.box.aabbMax.x, bound.box.aabbMax.y, bound.box.aabbMin.z),
+		DirectX::XMFLOAT3(bound.box.aabbMax.x, bound.box.aabbMin.y, bound.box.aabbMax.z),
+		DirectX::XMFLOAT3(bound.box.aabbMax.x, bound.box.aabbMin.y, bound.box.aabbMin.z),
+		DirectX::XMFLOAT3(bound.box.aabbMin.x, bound.box.aabbMax.y, bound.box.aabbMax.z),
+		DirectX::XMFLOAT3(bound.box.aabbMin.x, bound.box.aabbMax.y, bound.box.aabbMin.z),
+		DirectX::XMFLOAT3(bound.box.aabbMin.x, bound.box.aabbMin.y, bound.box.aabbMax.z),
+		DirectX::XMFLOAT3(bound.box.aabbMin.x, bound.box.aabbMin.y, bound.box.aabbMin.z),
+	};
+	for (auto pnt : pnts)
+	{
+		auto p = DirectX::XMLoadFloat3(&pnt);
+		p = DirectX::XMVector3TransformCoord(p, mtx);
+		DirectX::XMStoreFloat3(&pnt, p);
+
+		aabbMax.x = std::max(pnt.x, aabbMax.x);
+		aabbMax.y = std::max(pnt.y, aabbMax.y);
+		aabbMax.z = std::max(pnt.z, aabbMax.z);
+		aabbMin.x = std::min(pnt.x, aabbMin.x);
+		aabbMin.y = std::min(pnt.y, aabbMin.y);
+		aabbMin.z = std::min(pnt.z, aabbMin.z);
+	}
 }
 
 //----
-void Scene::ComputeSceneAABB()
+void Scene::CullSoftwareOcclusion(const DirectX::XMMATRIX& mtxWorldToClip, float nearZ)
 {
-	DirectX::XMFLOAT3 aabbMax(-FLT_MAX, -FLT_MAX, -FLT_MAX), aabbMin(FLT_MAX, FLT_MAX, FLT_MAX);
+	// 画面と同じアスペクトの低解像度バッファ
+	static const sl12::u32 kOcclusionBufferWidth = 256;
+	static const sl12::u32 kTileHeight = SoftwareOcclusionBuffer::kTileHeight;
+	sl12::u32 height = std::max(kOcclusionBufferWidth * screenHeight_ / std::max(screenWidth_, 1u), 1u);
+	height = (height + kTileHeight - 1) / kTileHeight * kTileHeight;
+	if (swOcclusion_.GetWidth() != kOcclusionBufferWidth || swOcclusion_.GetHeight() != height)
+	{
+		swOcclusion_.Initialize(kOcclusionBufferWidth, height);
+	}
+	swOcclusion_.Clear();
+
+	auto start = std::chrono::high_resolution_clock::now();
+
+	// render occluders.
 	for (auto&& mesh : sceneMeshes_)
 	{
-		auto mtx = DirectX::XMLoadFloat4x4(&mesh->GetMtxLocalToWorld());
-		auto&& bound = mesh->GetParentResource()->GetBoundingInfo();
-		DirectX::XMFLOAT3 pnts[] = {
-			DirectX::XMFLOAT3(bound.box.aabbMax.x, bound.box.aabbMax.y, bound.box.aabbMax.z),
-			DirectX::XMFLOAT3(bound.box.aabbMax.x, bound.box.aabbMax.y, bound.box.aabbMin.z),
-			DirectX::XMFLOAT3(bound.box.aabbMax.x, bound.box.aabbMin.y, bound.box.aabbMax.z),
-			DirectX::XMFLOAT3(bound.box.aabbMax.x, bound.box.aabbMin.y, bound.box.aabbMin.z),
-			DirectX::XMFLOAT3(bound.box.aabbMin.x, bound.box.aabbMax.y, bound.box.aabbMax.z),
-			DirectX::XMFLOAT3(bound.box.aabbMin.x, bound.box.aabbMax.y, bound.box.aabbMin.z),
-			DirectX::XMFLOAT3(bound.box.aabbMin.x, bound.box.aabbMin.y, bound.box.aabbMax.z),
-			DirectX::XMFLOAT3(bound.box.aabbMin.x, bound.box.aabbMin.y, bound.box.aabbMin.z),
-		};
-		for (auto pnt : pnts)
+		auto resMesh = mesh->GetParentResource();
+		auto it = occluderProxies_.find(resMesh);
+		if (it == occluderProxies_.end())
 		{
-			auto p = DirectX::XMLoadFloat3(&pnt);
-			p = DirectX::XMVector3TransformCoord(p, mtx);
-			DirectX::XMStoreFloat3(&pnt, p);
-
-			aabbMax.x = std::max(pnt.x, aabbMax.x);
-			aabbMax.y = std::max(pnt.y, aabbMax.y);
-			aabbMax.z = std::max(pnt.z, aabbMax.z);
-			aabbMin.x = std::min(pnt.x, aabbMin.x);
-			aabbMin.y = std::min(pnt.y, aabbMin.y);
-			aabbMin.z = std::min(pnt.z, aabbMin.z);
+			// 代理メッシュは不透明サブメッシュのみから作る
+			std::vector<sl12::u32> submeshIndices;
+			auto resInfo = meshletResource_->GetMeshResInfo(resMesh);
+			if (resInfo)
+			{
+				for (sl12::u32 i = 0; i < resInfo->submeshCount[0]; i++)
+				{
+					submeshIndices.push_back(resInfo->nonXluSubmeshInfos[i].submeshIndex);
+				}
+			}
+			it = occluderProxies_.emplace(resMesh, OccluderMesh()).first;
+			BuildMeshletOccluderProxy(resMesh, submeshIndices, it->second);
 		}
+
+		auto mtxLocalToProj = DirectX::XMLoadFloat4x4(&mesh->GetMtxLocalToWorld()) * mtxWorldToClip;
+		swOcclusion_.RenderOccluder(it->second, mtxLocalToProj);
+	}
+
+	// test instances.
+	swOccluded_.resize(sceneMeshes_.size());
+	for (size_t i = 0; i < sceneMeshes_.size(); i++)
+	{
+		auto&& mesh = sceneMeshes_[i];
+		auto&& bound = mesh->GetParentResource()->GetBoundingInfo();
+		auto mtxLocalToProj = DirectX::XMLoadFloat4x4(&mesh->GetMtxLocalToWorld()) * mtxWorldToClip;
+		swOccluded_[i] = swOcclusion_.IsOccluded(bound.box.aabbMin, bound.box.aabbMax, mtxLocalToProj, nearZ);
+		meshletResource_->SetInstanceOccluded((sl12::u32)i, swOccluded_[i]);
 	}
-	sceneAABBMax_ = aabbMax;
-	sceneAABBMin_ = aabbMin;
+
+	auto end = std::chrono::high_resolution_clock::now();
+	swOcclusionMicroSec_ = std::chrono::duration<double, std::micro>(end - start).count();
 }
 
 //----
@@ -450,7 +1465,7 @@ void Scene::CreateMeshletBounds(sl12::CommandList* pCmdList)
 		
 		sl12::BufferDesc desc{};
 		desc.heap = sl12::BufferHeap::Default;
-		desc.stride = sizeof(MeshletBound);
+		desc.stride = sizeof(MeshletBoundData);
 		desc.size = desc.stride * meshletTotal;
 		desc.usage = sl12::ResourceUsage::ShaderResource;
 		desc.initialState = D3D12_RESOURCE_STATE_COMMON;
@@ -462,16 +1477,19 @@ void Scene::CreateMeshletBounds(sl12::CommandList* pCmdList)
 		UploadB->Initialize(pDevice_, desc);
 
 		// fill upload buffer.
-		MeshletBound* pBound = static_cast<MeshletBound*>(UploadB->Map());
+		const DirectX::XMFLOAT4X4& mtxBoxToLocal = resMesh->GetMtxBoxToLocal();
+		MeshletBoundData* pBound = static_cast<MeshletBoundData*>(UploadB->Map());
 		for (auto&& submesh : submeshes)
 		{
 			for (auto&& meshlet : submesh.meshlets)
 			{
-				pBound->aabbMin = meshlet.boundingInfo.box.aabbMin;
-				pBound->aabbMax = meshlet.boundingInfo.box.aabbMax;
-				pBound->coneAxis = meshlet.boundingInfo.cone.axis;
-				pBound->coneApex = meshlet.boundingInfo.cone.apex;
-				pBound->coneCutoff = meshlet.boundingInfo.cone.cutoff;
+				MeshletBound bound{};
+				bound.aabbMin = meshlet.boundingInfo.box.aabbMin;
+				bound.aabbMax = meshlet.boundingInfo.box.aabbMax;
+				bound.coneAxis = meshlet.boundingInfo.cone.axis;
+				bound.coneApex = meshlet.boundingInfo.cone.apex;
+				bound.coneCutoff = meshlet.boundingInfo.cone.cutoff;
+				StoreMeshletBoundData(pBound, bound, mtxBoxToLocal);
 				pBound++;
 			}
 		}
@@ -505,245 +1523,263 @@ bool Scene::InitRenderPass()
 
 	{
 		auto pass = std::make_unique<MeshletArgCopyPass>(pDevice_, pRenderSystem_, this);
-		passNodes_[AppPassType::MeshletArgCopy] = renderGraph_->AddPass(kMeshletArgCopyPass, pass.get());
+		AddAppPass(AppPassType::MeshletArgCopy, kMeshletArgCopyPass, pass.get());
 		passes_.push_back(std::move(pass));
 	}
 	{
 		auto pass = std::make_unique<MeshletCullingPass>(pDevice_, pRenderSystem_, this);
-		passNodes_[AppPassType::MeshletCulling] = renderGraph_->AddPass(kMeshletCullingPass, pass.get());
+		AddAppPass(AppPassType::MeshletCulling, kMeshletCullingPass, pass.get());
+		AddAppPass(AppPassType::MeshletCulling2nd, kMeshletCulling2ndPass, pass.get());
 		passes_.push_back(std::move(pass));
 	}
 	{
 		auto pass = std::make_unique<ClearMiplevelPass>(pDevice_, pRenderSystem_, this);
-		passNodes_[AppPassType::ClearMiplevel] = renderGraph_->AddPass(kClearMiplevelPass, pass.get());
+		AddAppPass(AppPassType::ClearMiplevel, kClearMiplevelPass, pass.get());
 		passes_.push_back(std::move(pass));
 	}
 	{
 		auto pass = std::make_unique<FeedbackMiplevelPass>(pDevice_, pRenderSystem_, this);
-		passNodes_[AppPassType::FeedbackMiplevel] = renderGraph_->AddPass(kFeedbackMiplevelPass, pass.get());
+		AddAppPass(AppPassType::FeedbackMiplevel, kFeedbackMiplevelPass, pass.get());
 		passes_.push_back(std::move(pass));
 	}
 	{
 		auto pass = std::make_unique<DepthPrePass>(pDevice_, pRenderSystem_, this);
-		passNodes_[AppPassType::DepthPre] = renderGraph_->AddPass(kDepthPrePass, pass.get());
+		AddAppPass(AppPassType::DepthPre, kDepthPrePass, pass.get());
 		passes_.push_back(std::move(pass));
 	}
 	{
 		auto pass = std::make_unique<GBufferPass>(pDevice_, pRenderSystem_, this);
-		passNodes_[AppPassType::GBuffer] = renderGraph_->AddPass(kGBufferPass, pass.get());
+		AddAppPass(AppPassType::GBuffer, kGBufferPass, pass.get());
 		passes_.push_back(std::move(pass));
 	}
 	{
 		auto pass = std::make_unique<MotionVectorPass>(pDevice_, pRenderSystem_, this);
-		passNodes_[AppPassType::MotionVector] = renderGraph_->AddPass(kMotionVectorPass, pass.get());
+		AddAppPass(AppPassType::MotionVector, kMotionVectorPass, pass.get());
+		passes_.push_back(std::move(pass));
+	}
+	{
+		auto pass = std::make_unique<ShadowCullingPass>(pDevice_, pRenderSystem_, this);
+		AddAppPass(AppPassType::ShadowCulling, kShadowCullingPass, pass.get());
+		passes_.push_back(std::move(pass));
+	}
+	{
+		auto pass = std::make_unique<ShadowCacheCopyPass>(pDevice_, pRenderSystem_, this);
+		AddAppPass(AppPassType::ShadowCacheCopy, kShadowCacheCopyPass, pass.get());
 		passes_.push_back(std::move(pass));
 	}
 	{
 		auto pass = std::make_unique<ShadowMapPass>(pDevice_, pRenderSystem_, this);
-		passNodes_[AppPassType::ShadowMap] = renderGraph_->AddPass(kShadowMapPass, pass.get());
+		AddAppPass(AppPassType::ShadowMap, kShadowMapPass, pass.get());
+		passes_.push_back(std::move(pass));
+	}
+	{
+		auto pass = std::make_unique<VirtualShadowRequestPass>(pDevice_, pRenderSystem_, this);
+		AddAppPass(AppPassType::VirtualShadowRequest, kVirtualShadowRequestPass, pass.get());
 		passes_.push_back(std::move(pass));
 	}
 	{
 		auto pass = std::make_unique<ShadowExpPass>(pDevice_, pRenderSystem_, this);
-		passNodes_[AppPassType::ShadowExp] = renderGraph_->AddPass(kShadowExpPass, pass.get());
+		AddAppPass(AppPassType::ShadowExp, kShadowExpPass, pass.get());
 		passes_.push_back(std::move(pass));
 	}
 	{
 		auto pass = std::make_unique<ShadowExpBlurPass>(pDevice_, pRenderSystem_, this);
-		passNodes_[AppPassType::ShadowBlurX] = renderGraph_->AddPass(kShadowBlurXPass, pass.get());
-		passNodes_[AppPassType::ShadowBlurY] = renderGraph_->AddPass(kShadowBlurYPass, pass.get());
+		AddAppPass(AppPassType::ShadowBlurX, kShadowBlurXPass, pass.get());
+		AddAppPass(AppPassType::ShadowBlurY, kShadowBlurYPass, pass.get());
 		passes_.push_back(std::move(pass));
 	}
 	{
 		auto pass = std::make_unique<LightingPass>(pDevice_, pRenderSystem_, this);
-		passNodes_[AppPassType::Lighting] = renderGraph_->AddPass(kLightingPass, pass.get());
+		AddAppPass(AppPassType::Lighting, kLightingPass, pass.get());
 		passes_.push_back(std::move(pass));
 	}
 	{
 		auto pass = std::make_unique<HiZPass>(pDevice_, pRenderSystem_, this);
-		passNodes_[AppPassType::HiZ] = renderGraph_->AddPass(kHiZPass, pass.get());
-		passNodes_[AppPassType::HiZafterFirstCull] = renderGraph_->AddPass(kHiZafterFirstCullPass, pass.get());
+		AddAppPass(AppPassType::HiZ, kHiZPass, pass.get());
+		AddAppPass(AppPassType::HiZafterFirstCull, kHiZafterFirstCullPass, pass.get());
+		AddAppPass(AppPassType::ShadowHiZ, kShadowHiZPass, pass.get());
 		passes_.push_back(std::move(pass));
 	}
 	{
 		auto pass = std::make_unique<TonemapPass>(pDevice_, pRenderSystem_, this);
-		passNodes_[AppPassType::Tonemap] = renderGraph_->AddPass(kTonemapPass, pass.get());
+		AddAppPass(AppPassType::Tonemap, kTonemapPass, pass.get());
 		passes_.push_back(std::move(pass));
 	}
 	{
 		auto pass = std::make_unique<DeinterleavePass>(pDevice_, pRenderSystem_, this);
-		passNodes_[AppPassType::Deinterleave] = renderGraph_->AddPass(kDeinterleavePass, pass.get());
+		AddAppPass(AppPassType::Deinterleave, kDeinterleavePass, pass.get());
 		passes_.push_back(std::move(pass));
 	}
 	{
 		auto pass = std::make_unique<ScreenSpaceAOPass>(pDevice_, pRenderSystem_, this);
-		passNodes_[AppPassType::SSAO] = renderGraph_->AddPass(kScreenSpaceAOPass, pass.get());
+		AddAppPass(AppPassType::SSAO, kScreenSpaceAOPass, pass.get());
 		passes_.push_back(std::move(pass));
 	}
 	{
 		auto pass = std::make_unique<DenoisePass>(pDevice_, pRenderSystem_, this);
-		passNodes_[AppPassType::Denoise] = renderGraph_->AddPass(kDenoisePass, pass.get());
+		AddAppPass(AppPassType::Denoise, kDenoisePass, pass.get());
 		passes_.push_back(std::move(pass));
 	}
 	{
 		auto pass = std::make_unique<IndirectLightPass>(pDevice_, pRenderSystem_, this);
-		passNodes_[AppPassType::IndirectLight] = renderGraph_->AddPass(kIndirectLightPass, pass.get());
+		AddAppPass(AppPassType::IndirectLight, kIndirectLightPass, pass.get());
 		passes_.push_back(std::move(pass));
 	}
 	{
 		auto pass = std::make_unique<BufferReadyPass>(pDevice_, pRenderSystem_, this);
-		passNodes_[AppPassType::BufferReady] = renderGraph_->AddPass(kBufferReadyPass, pass.get());
+		AddAppPass(AppPassType::BufferReady, kBufferReadyPass, pass.get());
 		passes_.push_back(std::move(pass));
 	}
 	{
 		auto pass = std::make_unique<VisibilityVsPass>(pDevice_, pRenderSystem_, this);
-		passNodes_[AppPassType::VisibilityVs] = renderGraph_->AddPass(kVisibilityVsPass, pass.get());
+		AddAppPass(AppPassType::VisibilityVs, kVisibilityVsPass, pass.get());
+		AddAppPass(AppPassType::VisibilityVs2nd, kVisibilityVs2ndPass, pass.get());
 		passes_.push_back(std::move(pass));
 	}
 	{
 		auto pass = std::make_unique<VisibilityMsPass>(pDevice_, pRenderSystem_, this);
-		passNodes_[AppPassType::VisibilityMs1st] = renderGraph_->AddPass(kVisibilityMs1stPass, pass.get());
-		passNodes_[AppPassType::VisibilityMs2nd] = renderGraph_->AddPass(kVisibilityMs2ndPass, pass.get());
+		AddAppPass(AppPassType::VisibilityMs1st, kVisibilityMs1stPass, pass.get());
+		AddAppPass(AppPassType::VisibilityMs2nd, kVisibilityMs2ndPass, pass.get());
 		passes_.push_back(std::move(pass));
 	}
 	{
 		auto pass = std::make_unique<MaterialDepthPass>(pDevice_, pRenderSystem_, this);
-		passNodes_[AppPassType::MaterialDepth] = renderGraph_->AddPass(kMaterialDepthPass, pass.get());
+		AddAppPass(AppPassType::MaterialDepth, kMaterialDepthPass, pass.get());
 		passes_.push_back(std::move(pass));
 	}
 	{
 		auto pass = std::make_unique<ClassifyPass>(pDevice_, pRenderSystem_, this);
-		passNodes_[AppPassType::Classify] = renderGraph_->AddPass(kClassifyPass, pass.get());
+		AddAppPass(AppPassType::Classify, kClassifyPass, pass.get());
 		passes_.push_back(std::move(pass));
 	}
 	{
 		auto pass = std::make_unique<MaterialTilePass>(pDevice_, pRenderSystem_, this);
-		passNodes_[AppPassType::MaterialTile] = renderGraph_->AddPass(kMaterialTilePass, pass.get());
+		AddAppPass(AppPassType::MaterialTile, kMaterialTilePass, pass.get());
 		passes_.push_back(std::move(pass));
 	}
 	{
 		auto pass = std::make_unique<MaterialResolvePass>(pDevice_, pRenderSystem_, this);
-		passNodes_[AppPassType::MaterialResolve] = renderGraph_->AddPass(kMaterialResolvePass, pass.get());
+		AddAppPass(AppPassType::MaterialResolve, kMaterialResolvePass, pass.get());
 		passes_.push_back(std::move(pass));
 	}
 	{
 		auto pass = std::make_unique<MaterialComputeBinningPass>(pDevice_, pRenderSystem_, this);
-		passNodes_[AppPassType::MaterialComputeBinning] = renderGraph_->AddPass(sl12::RenderPassID("MaterialComputeBinningPass"), pass.get());
+		AddAppPass(AppPassType::MaterialComputeBinning, sl12::RenderPassID("MaterialComputeBinningPass"), pass.get());
 		passes_.push_back(std::move(pass));
 	}
 	{
 		auto pass = std::make_unique<MaterialComputeGBufferPass>(pDevice_, pRenderSystem_, this);
-		passNodes_[AppPassType::MaterialComputeGBuffer] = renderGraph_->AddPass(sl12::RenderPassID("MaterialComputeGBufferPass"), pass.get());
+		AddAppPass(AppPassType::MaterialComputeGBuffer, sl12::RenderPassID("MaterialComputeGBufferPass"), pass.get());
 		passes_.push_back(std::move(pass));
 	}
 	{
 		auto pass = std::make_unique<MaterialTileBinningPass>(pDevice_, pRenderSystem_, this);
-		passNodes_[AppPassType::MaterialTileBinning] = renderGraph_->AddPass(sl12::RenderPassID("MaterialTileBinningPass"), pass.get());
+		AddAppPass(AppPassType::MaterialTileBinning, sl12::RenderPassID("MaterialTileBinningPass"), pass.get());
 		passes_.push_back(std::move(pass));
 	}
 	{
 		auto pass = std::make_unique<MaterialTileGBufferPass>(pDevice_, pRenderSystem_, this);
-		passNodes_[AppPassType::MaterialTileGBuffer] = renderGraph_->AddPass(sl12::RenderPassID("MaterialTileGBufferPass"), pass.get());
+		AddAppPass(AppPassType::MaterialTileGBuffer, sl12::RenderPassID("MaterialTileGBufferPass"), pass.get());
 		passes_.push_back(std::move(pass));
 	}
 	{
 		auto pass = std::make_unique<GenerateVrsPass>(pDevice_, pRenderSystem_, this);
-		passNodes_[AppPassType::GenerateVRS] = renderGraph_->AddPass(sl12::RenderPassID("GenerateVrsPass"), pass.get());
+		AddAppPass(AppPassType::GenerateVRS, sl12::RenderPassID("GenerateVrsPass"), pass.get());
 		passes_.push_back(std::move(pass));
 	}
 	{
 		auto pass = std::make_unique<ReprojectVrsPass>(pDevice_, pRenderSystem_, this);
-		passNodes_[AppPassType::ReprojectVRS] = renderGraph_->AddPass(sl12::RenderPassID("ReprojectVrsPass"), pass.get());
+		AddAppPass(AppPassType::ReprojectVRS, sl12::RenderPassID("ReprojectVrsPass"), pass.get());
 		passes_.push_back(std::move(pass));
 	}
 	{
 		auto pass = std::make_unique<PrefixSumTestPass>(pDevice_, pRenderSystem_, this);
-		passNodes_[AppPassType::PrefixSumTest] = renderGraph_->AddPass(sl12::RenderPassID("PrefixSumTest"), pass.get());
+		AddAppPass(AppPassType::PrefixSumTest, sl12::RenderPassID("PrefixSumTest"), pass.get());
 		passes_.push_back(std::move(pass));
 	}
 	{
 		auto pass = std::make_unique<XluPass>(pDevice_, pRenderSystem_, this);
-		passNodes_[AppPassType::Xlu] = renderGraph_->AddPass(sl12::RenderPassID("Xlu"), pass.get());
+		AddAppPass(AppPassType::Xlu, sl12::RenderPassID("Xlu"), pass.get());
 		passes_.push_back(std::move(pass));
 	}
 	{
 		auto pass = std::make_unique<WaterLightAccumCopyPass>(pDevice_, pRenderSystem_, this);
-		passNodes_[AppPassType::WaterLightAccumCopy] = renderGraph_->AddPass(sl12::RenderPassID("WaterLightAccumCopy"), pass.get());
+		AddAppPass(AppPassType::WaterLightAccumCopy, sl12::RenderPassID("WaterLightAccumCopy"), pass.get());
 		passes_.push_back(std::move(pass));
 	}
 	{
 		auto pass = std::make_unique<WaterMipmapPass>(pDevice_, pRenderSystem_, this);
-		passNodes_[AppPassType::WaterMipmap] = renderGraph_->AddPass(sl12::RenderPassID("WaterMipmap"), pass.get());
+		AddAppPass(AppPassType::WaterMipmap, sl12::RenderPassID("WaterMipmap"), pass.get());
 		passes_.push_back(std::move(pass));
 	}
 	{
 		auto pass = std::make_unique<WaterPass>(pDevice_, pRenderSystem_, this);
-		passNodes_[AppPassType::Water] = renderGraph_->AddPass(sl12::RenderPassID("Water"), pass.get());
+		AddAppPass(AppPassType::Water, sl12::RenderPassID("Water"), pass.get());
 		passes_.push_back(std::move(pass));
 	}
 	{
 		auto pass = std::make_unique<BuildBvhPass>(pDevice_, pRenderSystem_, this);
-		passNodes_[AppPassType::BuildBvh] = renderGraph_->AddPass(sl12::RenderPassID("BuildBvh"), pass.get());
+		AddAppPass(AppPassType::BuildBvh, sl12::RenderPassID("BuildBvh"), pass.get());
 		passes_.push_back(std::move(pass));
 	}
 	{
 		auto pass = std::make_unique<TestRayTracingPass>(pDevice_, pRenderSystem_, this);
-		passNodes_[AppPassType::TestRayTracing] = renderGraph_->AddPass(sl12::RenderPassID("TestRaytracing"), pass.get());
+		AddAppPass(AppPassType::TestRayTracing, sl12::RenderPassID("TestRaytracing"), pass.get());
 		passes_.push_back(std::move(pass));
 	}
 	{
 		auto pass = std::make_unique<ReadyRtxgiPass>(pDevice_, pRenderSystem_, this);
-		passNodes_[AppPassType::ReadyRtxgi] = renderGraph_->AddPass(sl12::RenderPassID("ReadyRtxgi"), pass.get());
+		AddAppPass(AppPassType::ReadyRtxgi, sl12::RenderPassID("ReadyRtxgi"), pass.get());
 		passes_.push_back(std::move(pass));
 	}
 	{
 		auto pass = std::make_unique<ProbeTracePass>(pDevice_, pRenderSystem_, this);
-		passNodes_[AppPassType::ProbeTrace] = renderGraph_->AddPass(sl12::RenderPassID("ProbeTrace"), pass.get());
+		AddAppPass(AppPassType::ProbeTrace, sl12::RenderPassID("ProbeTrace"), pass.get());
 		passes_.push_back(std::move(pass));
 	}
 	{
 		auto pass = std::make_unique<UpdateRtxgiPass>(pDevice_, pRenderSystem_, this);
-		passNodes_[AppPassType::UpdateRtxgi] = renderGraph_->AddPass(sl12::RenderPassID("UpdateRtxgi"), pass.get());
+		AddAppPass(AppPassType::UpdateRtxgi, sl12::RenderPassID("UpdateRtxgi"), pass.get());
 		passes_.push_back(std::move(pass));
 	}
 	{
 		auto pass = std::make_unique<ApplyRtxgiPass>(pDevice_, pRenderSystem_, this);
-		passNodes_[AppPassType::ApplyRtxgi] = renderGraph_->AddPass(sl12::RenderPassID("RaytracingGI"), pass.get());
+		AddAppPass(AppPassType::ApplyRtxgi, sl12::RenderPassID("RaytracingGI"), pass.get());
 		passes_.push_back(std::move(pass));
 	}
 	{
 		auto pass = std::make_unique<MonteCarloGIPass>(pDevice_, pRenderSystem_, this);
-		passNodes_[AppPassType::MonteCarloGI] = renderGraph_->AddPass(sl12::RenderPassID("MonteCarloGI"), pass.get());
+		AddAppPass(AppPassType::MonteCarloGI, sl12::RenderPassID("MonteCarloGI"), pass.get());
 		passes_.push_back(std::move(pass));
 	}
 	{
 		auto pass = std::make_unique<InitialSamplePass>(pDevice_, pRenderSystem_, this);
-		passNodes_[AppPassType::InitialSample] = renderGraph_->AddPass(sl12::RenderPassID("InitialSample"), pass.get());
+		AddAppPass(AppPassType::InitialSample, sl12::RenderPassID("InitialSample"), pass.get());
 		passes_.push_back(std::move(pass));
 	}
 	{
 		auto pass = std::make_unique<SpatialReusePass>(pDevice_, pRenderSystem_, this);
-		passNodes_[AppPassType::SpatialReuse] = renderGraph_->AddPass(sl12::RenderPassID("SpatialReuse"), pass.get());
+		AddAppPass(AppPassType::SpatialReuse, sl12::RenderPassID("SpatialReuse"), pass.get());
 		passes_.push_back(std::move(pass));
 	}
 	{
 		auto pass = std::make_unique<ReSTIRResolvePass>(pDevice_, pRenderSystem_, this);
-		passNodes_[AppPassType::ReSTIRResolve] = renderGraph_->AddPass(sl12::RenderPassID("ReSTIRResolve"), pass.get());
+		AddAppPass(AppPassType::ReSTIRResolve, sl12::RenderPassID("ReSTIRResolve"), pass.get());
 		passes_.push_back(std::move(pass));
 	}
 	{
 		auto pass = std::make_unique<RayTracingDenoisePass>(pDevice_, pRenderSystem_, this);
-		passNodes_[AppPassType::RayTracingDenoise] = renderGraph_->AddPass(sl12::RenderPassID("RayTracingDenoise"), pass.get());
+		AddAppPass(AppPassType::RayTracingDenoise, sl12::RenderPassID("RayTracingDenoise"), pass.get());
 		passes_.push_back(std::move(pass));
 	}
 	{
 		auto pass = std::make_unique<DebugPass>(pDevice_, pRenderSystem_, this);
-		passNodes_[AppPassType::Debug] = renderGraph_->AddPass(sl12::RenderPassID("Debug"), pass.get());
+		AddAppPass(AppPassType::Debug, sl12::RenderPassID("Debug"), pass.get());
 		passes_.push_back(std::move(pass));
 	}
 	{
 		auto pass = std::make_unique<DebugDdgiPass>(pDevice_, pRenderSystem_, this);
-		passNodes_[AppPassType::DebugDDGI] = renderGraph_->AddPass(sl12::RenderPassID("DebugDDGI"), pass.get());
+		AddAppPass(AppPassType::DebugDDGI, sl12::RenderPassID("DebugDDGI"), pass.get());
 		passes_.push_back(std::move(pass));
 	}
 
@@ -756,15 +1792,65 @@ bool Scene::InitRenderPass()
 //----
 void Scene::SetupRenderPassGraph(const RenderPassSetupDesc& desc)
 {
-	bool bNeedDeinterleave = desc.ssaoType == 2 && desc.bNeedDeinterleave;
+	// グラフを作り直すとシャドウの履歴が引き継がれる保証がないので、次のフレームは全カスケードを描画する
+	prevShadowCascadeCount_ = 0;
+	// 接続が変わるので、コンパイルキャッシュを無効にする
+	renderGraphGeneration_++;
 
 	// setting.
 	for (auto&& pass : passes_)
 	{
 		pass->SetPassSettings(desc);
+		pass->ResetHistory();
+	}
+
+	std::vector<std::pair<AppPassType, AppPassType>> edges;
+	BuildRenderPassEdges(desc, edges);
+
+	renderGraph_->ClearAllGraphEdges();
+	for (auto&& edge : edges)
+	{
+		passNodes_[edge.first].AddChild(passNodes_[edge.second]);
+	}
+
+	// 接続されたパスのみ実行される
+	passRecordStats_.passes.clear();
+	for (auto&& edge : edges)
+	{
+		for (auto type : {edge.first, edge.second})
+		{
+			auto&& passes = passRecordStats_.passes;
+			if (std::find_if(passes.begin(), passes.end(), [type](const PassRecordTime& t) { return t.type == type; }) == passes.end())
+			{
+				PassRecordTime time;
+				time.type = type;
+				time.name = passInfos_.at(type).ID.name;
+				passes.push_back(time);
+			}
+		}
+	}
+
+	lastRenderPassDesc_ = desc;
+}
+
+//----
+void Scene::BuildRenderPassEdges(const RenderPassSetupDesc& desc, std::vector<std::pair<AppPassType, AppPassType>>& outEdges) const
+{
+	bool bNeedDeinterleave = desc.ssaoType == 2 && desc.bNeedDeinterleave;
+
+	outEdges.clear();
+	std::map<AppPassType, PassEdgeNode> nodes;
+	for (auto&& info : passInfos_)
+	{
+		nodes[info.first].pEdges = &outEdges;
+		nodes[info.first].type = info.first;
 	}
 
 	bool bEnableMeshletCulling = !desc.bUseVisibilityBuffer || !desc.bUseMeshShader;
+	bool bEnableVsOcclusionCulling = desc.bUseVisibilityBuffer && !desc.bUseMeshShader && desc.bUseOcclusionCulling;
+	bool bEnableVirtualShadow = desc.bUseVirtualShadow;
+	bool bEnableShadowCulling = desc.bUseShadowCulling && !bEnableVirtualShadow;
+	bool bEnableShadowOcclusionCulling = bEnableShadowCulling && desc.bUseShadowOcclusionCulling;
 	bool bDirectGBufferRender = !desc.bUseVisibilityBuffer;
 	bool bEnableVRS = desc.bUseVRS && desc.bUseVisibilityBuffer;
 	bool bEnableRaytracing = desc.bUseRaytracing;
@@ -772,166 +1858,206 @@ void Scene::SetupRenderPassGraph(const RenderPassSetupDesc& desc)
 	bool bEnableMonteCarlo = bEnableRaytracing && desc.raytracingTech == 1;
 	bool bEnableReSTIR = bEnableRaytracing && desc.raytracingTech == 2;
 
-	sl12::RenderGraph::Node node;
+	PassEdgeNode node;
 
-	renderGraph_->ClearAllGraphEdges();
 	// graphics queue.
-	// node = node.AddChild(passNodes_[AppPassType::PrefixSumTest]); // TEST: Prefux Sum Test Pass.
-	if (bEnableMeshletCulling)
+	if (desc.prefixScanBenchmarkCount > 0)
+	{
+		node = node.AddChild(nodes[AppPassType::PrefixSumTest]);
+	}
+	if (bEnableMeshletCulling || bEnableShadowCulling || bEnableVirtualShadow)
 	{
-		node = node.AddChild(passNodes_[AppPassType::MeshletArgCopy]);
+		node = node.AddChild(nodes[AppPassType::MeshletArgCopy]);
 	}
 
-	node = node.AddChild(passNodes_[AppPassType::ClearMiplevel]);
+	node = node.AddChild(nodes[AppPassType::ClearMiplevel]);
 	if (bEnableDDGI)
 	{
-		node = node.AddChild(passNodes_[AppPassType::ReadyRtxgi]);
+		node = node.AddChild(nodes[AppPassType::ReadyRtxgi]);
 	}
 
 	if (bDirectGBufferRender)
 	{
 	 	// direct gbuffer redering.
-		node = node.AddChild(passNodes_[AppPassType::DepthPre])
-			.AddChild(passNodes_[AppPassType::GBuffer]);
+		node = node.AddChild(nodes[AppPassType::DepthPre])
+			.AddChild(nodes[AppPassType::GBuffer]);
 	}
 	else
 	{
 	 	// visibility rendering.
 	 	if (!desc.bUseMeshShader)
 	 	{
-	 		node = node.AddChild(passNodes_[AppPassType::VisibilityVs]);
+	 		node = node.AddChild(nodes[AppPassType::VisibilityVs]);
+	 		if (bEnableVsOcclusionCulling)
+	 		{
+	 			// 1st passの深度からHiZを作成し、HiZでカリングされたメッシュレットを再テストして描画する
+	 			node = node.AddChild(nodes[AppPassType::HiZafterFirstCull])
+	 				.AddChild(nodes[AppPassType::VisibilityVs2nd]);
+	 		}
 	 	}
 	    else
 	    {
-	    	node = node.AddChild(passNodes_[AppPassType::VisibilityMs1st])
-	    		.AddChild(passNodes_[AppPassType::HiZafterFirstCull])
-	    		.AddChild(passNodes_[AppPassType::VisibilityMs2nd]);
+	    	node = node.AddChild(nodes[AppPassType::VisibilityMs1st])
+	    		.AddChild(nodes[AppPassType::HiZafterFirstCull])
+	    		.AddChild(nodes[AppPassType::VisibilityMs2nd]);
 	    }
 		// VRS reprojection.
 		if (bEnableVRS)
 		{
-			node = node.AddChild(passNodes_[AppPassType::ReprojectVRS]);
+			node = node.AddChild(nodes[AppPassType::ReprojectVRS]);
 		}
 		// visibility to gbuffer.
 		if (desc.visToGBufferType == 0)
 		{
 			// Depth & Tile
-			node = node.AddChild(passNodes_[AppPassType::MaterialDepth])
-				.AddChild(passNodes_[AppPassType::Classify])
-				.AddChild(passNodes_[AppPassType::MaterialTile]);
+			node = node.AddChild(nodes[AppPassType::MaterialDepth])
+				.AddChild(nodes[AppPassType::Classify])
+				.AddChild(nodes[AppPassType::MaterialTile]);
 		}
 		else if (desc.visToGBufferType == 1)
 		{
 			// Compute Pixel
-			node = node.AddChild(passNodes_[AppPassType::MaterialComputeBinning])
-				.AddChild(passNodes_[AppPassType::MaterialComputeGBuffer]);
+			node = node.AddChild(nodes[AppPassType::MaterialComputeBinning])
+				.AddChild(nodes[AppPassType::MaterialComputeGBuffer]);
 		}
 		else if (desc.visToGBufferType == 2)
 		{
 			// Compute Tile
-			node = node.AddChild(passNodes_[AppPassType::MaterialTileBinning])
-				.AddChild(passNodes_[AppPassType::MaterialTileGBuffer]);
+			node = node.AddChild(nodes[AppPassType::MaterialTileBinning])
+				.AddChild(nodes[AppPassType::MaterialTileGBuffer]);
 		}
 		else
 		{
 			// Work Graph
-			node = node.AddChild(passNodes_[AppPassType::MaterialResolve]);
+			node = node.AddChild(nodes[AppPassType::MaterialResolve]);
 		}
 	}
-	node = node.AddChild(passNodes_[AppPassType::FeedbackMiplevel])
-		.AddChild(passNodes_[AppPassType::MotionVector])
-		.AddChild(passNodes_[AppPassType::ShadowMap]);
-	if (desc.bShadowBlur)
+	node = node.AddChild(nodes[AppPassType::FeedbackMiplevel])
+		.AddChild(nodes[AppPassType::MotionVector]);
+	if (bEnableVirtualShadow)
 	{
-		node = node.AddChild(passNodes_[AppPassType::ShadowExp])
-			.AddChild(passNodes_[AppPassType::ShadowBlurX])
-			.AddChild(passNodes_[AppPassType::ShadowBlurY]);
+		// ページ要求を出して、前フレームまでの要求で割り当てたページを描画する
+		node = node.AddChild(nodes[AppPassType::VirtualShadowRequest])
+			.AddChild(nodes[AppPassType::ShadowMap]);
+	}
+	else
+	{
+		if (desc.bUseShadowCache)
+		{
+			// 再利用するカスケードを前フレームのシャドウマップからコピーする
+			node = node.AddChild(nodes[AppPassType::ShadowCacheCopy]);
+		}
+		node = node.AddChild(nodes[AppPassType::ShadowMap]);
+		if (bEnableShadowOcclusionCulling)
+		{
+			// 次フレームのシャドウカリング用
+			node = node.AddChild(nodes[AppPassType::ShadowHiZ]);
+		}
+		if (desc.bShadowBlur)
+		{
+			node = node.AddChild(nodes[AppPassType::ShadowExp])
+				.AddChild(nodes[AppPassType::ShadowBlurX])
+				.AddChild(nodes[AppPassType::ShadowBlurY]);
+		}
 	}
-	node = node.AddChild(passNodes_[AppPassType::Lighting])
-		.AddChild(passNodes_[AppPassType::HiZ]);
+	node = node.AddChild(nodes[AppPassType::Lighting])
+		.AddChild(nodes[AppPassType::HiZ]);
 	if (bEnableDDGI)
 	{
 		// DDGIが有効な場合、DenoiseパスのあとにDDGI適用パスを実行する
 		// DenoiseGIバッファがDenoiseパスでクリアされてしまうため
-		node = node.AddChild(passNodes_[AppPassType::ApplyRtxgi]);
-		passNodes_[AppPassType::Denoise].AddChild(passNodes_[AppPassType::ApplyRtxgi]);
+		node = node.AddChild(nodes[AppPassType::ApplyRtxgi]);
+		nodes[AppPassType::Denoise].AddChild(nodes[AppPassType::ApplyRtxgi]);
 	}
-	node = node.AddChild(passNodes_[AppPassType::IndirectLight])
-		.AddChild(passNodes_[AppPassType::Xlu]);
+	node = node.AddChild(nodes[AppPassType::IndirectLight])
+		.AddChild(nodes[AppPassType::Xlu]);
 	if (desc.bUseWater)
 	{
-		node = node.AddChild(passNodes_[AppPassType::WaterLightAccumCopy]);
+		node = node.AddChild(nodes[AppPassType::WaterLightAccumCopy]);
 		if (desc.waterMethod == 1)
 		{
-			node = node.AddChild(passNodes_[AppPassType::WaterMipmap]);
+			node = node.AddChild(nodes[AppPassType::WaterMipmap]);
 		}
-		node = node.AddChild(passNodes_[AppPassType::Water]);
+		node = node.AddChild(nodes[AppPassType::Water]);
 	}
 	if (bEnableVRS)
 	{
-		node = node.AddChild(passNodes_[AppPassType::GenerateVRS]);
+		node = node.AddChild(nodes[AppPassType::GenerateVRS]);
 	}
 	if (bEnableDDGI && desc.bDebugDdgi)
 	{
-		node = node.AddChild(passNodes_[AppPassType::DebugDDGI]);
+		node = node.AddChild(nodes[AppPassType::DebugDDGI]);
 	}
-	node = node.AddChild(passNodes_[AppPassType::Tonemap]);
+	node = node.AddChild(nodes[AppPassType::Tonemap]);
 	if (desc.debugMode != 0)
 	{
-		node = node.AddChild(passNodes_[AppPassType::Debug]);
+		node = node.AddChild(nodes[AppPassType::Debug]);
 	}
 
 	// compute queue.
-	node = sl12::RenderGraph::Node();
+	node = PassEdgeNode();
 	if (bEnableMeshletCulling)
 	{
-		node = node.AddChild(passNodes_[AppPassType::MeshletCulling]);
-		passNodes_[AppPassType::MeshletArgCopy].AddChild(node);
+		node = node.AddChild(nodes[AppPassType::MeshletCulling]);
+		nodes[AppPassType::MeshletArgCopy].AddChild(node);
 		if (bDirectGBufferRender)
 		{
-			node.AddChild(passNodes_[AppPassType::DepthPre]);
+			node.AddChild(nodes[AppPassType::DepthPre]);
 		}
 		else
 		{
-			node.AddChild(passNodes_[AppPassType::VisibilityVs]);
+			node.AddChild(nodes[AppPassType::VisibilityVs]);
 		}
 	}
+	if (bEnableShadowCulling)
+	{
+		// メインビューの描画中にシャドウのカリングを行う
+		node = node.AddChild(nodes[AppPassType::ShadowCulling]);
+		nodes[AppPassType::MeshletArgCopy].AddChild(node);
+		node.AddChild(nodes[AppPassType::ShadowMap]);
+	}
+	if (bEnableVsOcclusionCulling)
+	{
+		node = node.AddChild(nodes[AppPassType::MeshletCulling2nd]);
+		nodes[AppPassType::HiZafterFirstCull].AddChild(node);
+		node.AddChild(nodes[AppPassType::VisibilityVs2nd]);
+	}
 
 	if (bEnableRaytracing)
 	{
 		// Raytracing
-		passNodes_[AppPassType::FeedbackMiplevel].AddChild(passNodes_[AppPassType::BuildBvh]);
-		node = node.AddChild(passNodes_[AppPassType::BuildBvh]);
+		nodes[AppPassType::FeedbackMiplevel].AddChild(nodes[AppPassType::BuildBvh]);
+		node = node.AddChild(nodes[AppPassType::BuildBvh]);
 		if (bEnableDDGI)
 		{
-			node = node.AddChild(passNodes_[AppPassType::ProbeTrace]);
+			node = node.AddChild(nodes[AppPassType::ProbeTrace]);
 
-			passNodes_[AppPassType::ReadyRtxgi].AddChild(passNodes_[AppPassType::BuildBvh]);
-			passNodes_[AppPassType::ProbeTrace].AddChild(passNodes_[AppPassType::UpdateRtxgi]);
+			nodes[AppPassType::ReadyRtxgi].AddChild(nodes[AppPassType::BuildBvh]);
+			nodes[AppPassType::ProbeTrace].AddChild(nodes[AppPassType::UpdateRtxgi]);
 		}
 		else if (bEnableMonteCarlo)
 		{
-			node = node.AddChild(passNodes_[AppPassType::MonteCarloGI]);
+			node = node.AddChild(nodes[AppPassType::MonteCarloGI]);
 		}
 		else if (bEnableReSTIR)
 		{
-			node = node.AddChild(passNodes_[AppPassType::InitialSample])
-				.AddChild(passNodes_[AppPassType::SpatialReuse])
-				.AddChild(passNodes_[AppPassType::ReSTIRResolve]);
+			node = node.AddChild(nodes[AppPassType::InitialSample])
+				.AddChild(nodes[AppPassType::SpatialReuse])
+				.AddChild(nodes[AppPassType::ReSTIRResolve]);
 		}
 	}
 
 	{
 		// ssao.
-		std::vector<sl12::RenderGraph::Node*> ssaoNodes;
+		std::vector<PassEdgeNode*> ssaoNodes;
 		if (bNeedDeinterleave)
 		{
-			ssaoNodes.push_back(&passNodes_[AppPassType::Deinterleave]);
+			ssaoNodes.push_back(&nodes[AppPassType::Deinterleave]);
 		}
-		ssaoNodes.push_back(&passNodes_[AppPassType::SSAO]);
-		ssaoNodes.push_back(&passNodes_[AppPassType::Denoise]);
+		ssaoNodes.push_back(&nodes[AppPassType::SSAO]);
+		ssaoNodes.push_back(&nodes[AppPassType::Denoise]);
 
-		passNodes_[AppPassType::FeedbackMiplevel].AddChild(*ssaoNodes[0]);
+		nodes[AppPassType::FeedbackMiplevel].AddChild(*ssaoNodes[0]);
 
 		for (auto ssaoNode : ssaoNodes)
 		{
@@ -942,42 +2068,319 @@ void Scene::SetupRenderPassGraph(const RenderPassSetupDesc& desc)
 	if (bEnableRaytracing && (bEnableMonteCarlo || bEnableReSTIR))
 	{
 		// ray tracing denoise.
-		node = node.AddChild(passNodes_[AppPassType::RayTracingDenoise]);
+		node = node.AddChild(nodes[AppPassType::RayTracingDenoise]);
 	}
 
-	node.AddChild(passNodes_[AppPassType::IndirectLight]);
+	node.AddChild(nodes[AppPassType::IndirectLight]);
 
 	// copy queue.
+	if (bEnableVirtualShadow)
+	{
+		// virtual shadow culls each page inside the pass and reads the persistent arg table.
+		nodes[AppPassType::BufferReady].AddChild(nodes[AppPassType::ShadowMap]);
+	}
+	if (bEnableMeshletCulling)
+	{
+		// meshlet culling reads instance, draw call and bounds tables.
+		nodes[AppPassType::BufferReady].AddChild(nodes[AppPassType::MeshletCulling]);
+	}
+	if (bEnableShadowCulling)
+	{
+		nodes[AppPassType::BufferReady].AddChild(nodes[AppPassType::ShadowCulling]);
+	}
 	if (!bDirectGBufferRender)
 	{
 	 	if (!desc.bUseMeshShader)
 	 	{
-	 		passNodes_[AppPassType::BufferReady].AddChild(passNodes_[AppPassType::VisibilityVs]);
+	 		nodes[AppPassType::BufferReady].AddChild(nodes[AppPassType::VisibilityVs]);
 	 	}
 	    else
 	    {
-	    	passNodes_[AppPassType::BufferReady].AddChild(passNodes_[AppPassType::VisibilityMs1st]);
+	    	nodes[AppPassType::BufferReady].AddChild(nodes[AppPassType::VisibilityMs1st]);
 	    }
 	}
+}
 
-	lastRenderPassDesc_ = desc;
+//----
+sl12::u64 Scene::CalcRenderGraphCacheKey(const sl12::Texture* pSwapchainTarget) const
+{
+	// FNV-1a
+	const sl12::u64 kPrime = 1099511628211ull;
+	sl12::u64 hash = 14695981039346656037ull;
+	auto Hash = [&](const void* p, size_t size)
+	{
+		auto bytes = static_cast<const sl12::u8*>(p);
+		for (size_t i = 0; i < size; i++)
+		{
+			hash = (hash ^ bytes[i]) * kPrime;
+		}
+	};
+
+	// パスの設定とグラフの接続はRenderPassSetupDescで決まり、変わればrenderGraphGeneration_が進む
+	Hash(&renderGraphGeneration_, sizeof(renderGraphGeneration_));
+	// 解像度
+	// スワップチェインはバッファごとにアドレスが変わるので、サイズのみ含める
+	sl12::u32 sizes[] = {
+		screenWidth_, screenHeight_,
+		pSwapchainTarget->GetTextureDesc().width, pSwapchainTarget->GetTextureDesc().height,
+	};
+	Hash(sizes, sizeof(sizes));
+	// パスのリソースサイズが依存するシーンの状態 (インスタンスの追加で変わる)
+	sl12::u32 sceneSizes[] = {
+		meshletResource_->GetDrawCallCapacity(),
+		(sl12::u32)meshletResource_->GetWorldMaterials().size(),
+	};
+	Hash(sceneSizes, sizeof(sceneSizes));
+	return hash;
 }
 
 //----
 void Scene::SetupRenderPass(sl12::Texture* pSwapchainTarget, const RenderPassSetupDesc& desc)
 {
+	auto setupStart = std::chrono::high_resolution_clock::now();
+
 	if (lastRenderPassDesc_ != desc)
 	{
 		SetupRenderPassGraph(desc);
 	}
 
+	// スワップチェインのバッファは毎フレーム変わるので、外部テクスチャは常に登録し直す
 	renderGraph_->AddExternalTexture(kSwapchainID, pSwapchainTarget, sl12::TransientState::Present);
-	renderGraph_->Compile();
+
+	// キーが前回のコンパイルと同じなら、バリア、キューの割り当て、トランジェントリソースの配置はそのまま使える
+	sl12::u64 key = CalcRenderGraphCacheKey(pSwapchainTarget);
+	bool bHit = bRenderGraphCacheEnable_ && bRenderGraphCompiled_ && (key == renderGraphCacheKey_);
+	if (!bHit)
+	{
+		renderGraph_->Compile();
+		renderGraphCacheKey_ = key;
+		bRenderGraphCompiled_ = true;
+	}
+
+	auto setupEnd = std::chrono::high_resolution_clock::now();
+	// キャッシュヒットは1us未満になるので小数で計測する
+	double setupMicroSec = std::chrono::duration<double, std::micro>(setupEnd - setupStart).count();
+	if (bHit)
+	{
+		renderGraphCompileStats_.hitCount++;
+		renderGraphCompileStats_.lastHitMicroSec = setupMicroSec;
+	}
+	else
+	{
+		renderGraphCompileStats_.compileCount++;
+		renderGraphCompileStats_.lastCompileMicroSec = setupMicroSec;
+	}
+}
+
+//----
+void Scene::AddAppPass(AppPassType type, const sl12::RenderPassID& ID, AppPassBase* pPass)
+{
+	// 記録時間を計測するため、ラッパーを登録する
+	auto recorder = std::make_unique<AppPassRecorder>(pPass);
+	passNodes_[type] = renderGraph_->AddPass(ID, recorder.get());
+	passInfos_.emplace(type, AppPassInfo{ID, pPass, recorder.get()});
+	passRecorders_.push_back(std::move(recorder));
+}
+
+//----
+void Scene::BuildRenderGraphSim(const RenderPassSetupDesc& desc, const std::map<std::string, float>& passCosts, RenderGraphSimGraph& outGraph)
+{
+	outGraph = RenderGraphSimGraph();
+
+	// 入出力リソースを得るために設定を一時的に差し替える
+	// SetPassSettingsは設定値しか変えないので、履歴 (ResetHistory) には影響しない
+	for (auto&& pass : passes_)
+	{
+		pass->SetPassSettings(desc);
+	}
+
+	std::vector<std::pair<AppPassType, AppPassType>> edges;
+	BuildRenderPassEdges(desc, edges);
+
+	// 接続されたパスのみ実行される
+	std::map<AppPassType, sl12::u32> simPassIndices;
+	auto AddSimPass = [&](AppPassType type)
+	{
+		auto findIt = simPassIndices.find(type);
+		if (findIt != simPassIndices.end())
+		{
+			return findIt->second;
+		}
+
+		auto&& info = passInfos_.at(type);
+		RenderGraphSimPass simPass;
+		simPass.name = info.ID.name;
+		simPass.queue = GetSimQueue(info.pPass->GetExecuteQueue());
+		auto costIt = passCosts.find(simPass.name);
+		if (costIt != passCosts.end())
+		{
+			simPass.cost = costIt->second;
+		}
+		for (auto&& res : info.pPass->GetInputResources(info.ID))
+		{
+			simPass.inputs.push_back(AddSimResource(outGraph, res));
+		}
+		for (auto&& res : info.pPass->GetOutputResources(info.ID))
+		{
+			simPass.outputs.push_back(AddSimResource(outGraph, res));
+		}
+
+		sl12::u32 index = (sl12::u32)outGraph.passes.size();
+		outGraph.passes.push_back(simPass);
+		simPassIndices[type] = index;
+		return index;
+	};
+	for (auto&& edge : edges)
+	{
+		sl12::u32 parent = AddSimPass(edge.first);
+		sl12::u32 child = AddSimPass(edge.second);
+		outGraph.edges.push_back(std::make_pair(parent, child));
+	}
+
+	// 実行中のグラフの設定に戻す
+	for (auto&& pass : passes_)
+	{
+		pass->SetPassSettings(lastRenderPassDesc_);
+	}
+}
+
+//----
+sl12::u32 GetRenderPassSetupCombinationCount()
+{
+	sl12::u32 count = 1;
+	for (auto radix : kRenderPassSetupRadix)
+	{
+		count *= radix;
+	}
+	return count;
+}
+
+//----
+bool GetRenderPassSetupCombination(const RenderPassSetupDesc& base, sl12::u32 index, RenderPassSetupDesc& outDesc)
+{
+	int digits[ARRAYSIZE(kRenderPassSetupRadix)];
+	for (size_t i = 0; i < ARRAYSIZE(kRenderPassSetupRadix); i++)
+	{
+		digits[i] = (int)(index % kRenderPassSetupRadix[i]);
+		index /= kRenderPassSetupRadix[i];
+	}
+
+	// 列挙しない項目はbaseの値を使う
+	outDesc = base;
+	int d = 0;
+	outDesc.bUseVisibilityBuffer = digits[d++] != 0;
+	outDesc.bUseMeshShader = digits[d++] != 0;
+	outDesc.bUseOcclusionCulling = digits[d++] != 0;
+	outDesc.bUseBindlessMasked = digits[d++] != 0;
+	outDesc.visToGBufferType = digits[d++];
+	outDesc.bUseVRS = digits[d++] != 0;
+	outDesc.ssaoType = digits[d++];
+	outDesc.bNeedDeinterleave = digits[d++] != 0;
+	outDesc.bUseRaytracing = digits[d++] != 0;
+	outDesc.raytracingTech = digits[d++];
+	outDesc.bDebugDdgi = digits[d++] != 0;
+	outDesc.bShadowBlur = digits[d++] != 0;
+	outDesc.bUseShadowCulling = digits[d++] != 0;
+	outDesc.bUseShadowOcclusionCulling = digits[d++] != 0;
+	outDesc.bUseShadowCache = digits[d++] != 0;
+	outDesc.bUseVirtualShadow = digits[d++] != 0;
+	outDesc.bUseWater = digits[d++] != 0;
+	outDesc.waterMethod = digits[d++];
+	outDesc.debugMode = digits[d++];
+	outDesc.prefixScanBenchmarkCount = 0;
+
+	// パスの設定とグラフの接続に影響しない項目は1つの値にまとめる
+	RenderPassSetupDesc canonical = outDesc;
+	if (!canonical.bUseVisibilityBuffer)
+	{
+		canonical.bUseMeshShader = false;
+		canonical.bUseOcclusionCulling = false;
+		canonical.visToGBufferType = 0;
+		canonical.bUseVRS = false;
+	}
+	else if (canonical.bUseMeshShader)
+	{
+		canonical.bUseOcclusionCulling = false;
+		canonical.bUseBindlessMasked = false;
+	}
+	if (canonical.ssaoType != 2)
+	{
+		canonical.bNeedDeinterleave = false;
+	}
+	if (!canonical.bUseRaytracing)
+	{
+		canonical.raytracingTech = 0;
+	}
+	if (!canonical.bUseRaytracing || canonical.raytracingTech != 0)
+	{
+		canonical.bDebugDdgi = false;
+	}
+	if (canonical.bUseVirtualShadow)
+	{
+		canonical.bUseShadowCulling = false;
+		canonical.bUseShadowCache = false;
+	}
+	if (!canonical.bUseShadowCulling)
+	{
+		canonical.bUseShadowOcclusionCulling = false;
+	}
+	if (!canonical.bUseWater)
+	{
+		canonical.waterMethod = 0;
+	}
+	return canonical == outDesc;
 }
 
 void Scene::LoadRenderGraphCommand()
 {
+	// 描画リストとバインドレステクスチャはPrepareExecuteやコマンド記録で各パスが参照するので、並列実行の前に更新する
+	meshletResource_->UpdateDrawBuckets();
+	meshletResource_->UpdateBindlessTextures(pDevice_);
+	for (auto&& time : passRecordStats_.passes)
+	{
+		auto&& info = passInfos_.at(time.type);
+		info.pPass->PrepareSerial(info.ID);
+	}
+
+	// コマンドリストを使わないCPU処理を、パス間で並列に実行する
+	auto prepareStart = std::chrono::high_resolution_clock::now();
+	auto PrepareFunc = [this](PassRecordTime& time)
+	{
+		auto&& info = passInfos_.at(time.type);
+		auto start = std::chrono::high_resolution_clock::now();
+		info.pPass->PrepareExecute(info.ID);
+		auto end = std::chrono::high_resolution_clock::now();
+		time.prepareMicroSec = std::chrono::duration<double, std::micro>(end - start).count();
+	};
+	auto&& passes = passRecordStats_.passes;
+	if (bParallelPrepare_)
+	{
+		std::for_each(std::execution::par, passes.begin(), passes.end(), PrepareFunc);
+	}
+	else
+	{
+		std::for_each(passes.begin(), passes.end(), PrepareFunc);
+	}
+	auto prepareEnd = std::chrono::high_resolution_clock::now();
+
+	// 記録は依存関係の順にレンダーグラフが行う
+	// コマンドリストはレンダーグラフが管理するので、記録はメインスレッドで直列に行い、並列化するのはPrepareExecuteのみ
+	// パスごとのコマンドリストへの並列記録は、sl12::RenderGraph::LoadCommand側の対応が必要
+	for (auto&& recorder : passRecorders_)
+	{
+		recorder->ResetRecordMicroSec();
+	}
 	renderGraph_->LoadCommand();
+	bMeshletCullReadbackRequest_ = false;
+	bClassifyReadbackRequest_ = false;
+	auto recordEnd = std::chrono::high_resolution_clock::now();
+
+	for (auto&& time : passes)
+	{
+		time.recordMicroSec = passInfos_.at(time.type).pRecorder->GetRecordMicroSec();
+	}
+	passRecordStats_.prepareWallMicroSec = std::chrono::duration<double, std::micro>(prepareEnd - prepareStart).count();
+	passRecordStats_.recordWallMicroSec = std::chrono::duration<double, std::micro>(recordEnd - prepareEnd).count();
 }
 
 void Scene::ExecuteRenderGraphCommand()
@@ -1062,6 +2465,17 @@ void Scene::CreateMeshletResource()
 
 void Scene::GatherRenderCommands()
 {
+	// 削除されたメッシュを外すため作り直す
+	// 収集自体が全ノードを走査するので、作り直しのコストも同程度で済む
+	if (bSceneRootDirty_)
+	{
+		sceneRoot_ = sl12::MakeUnique<sl12::SceneRoot>(pDevice_);
+		for (auto&& m : sceneMeshes_)
+		{
+			sceneRoot_->AttachNode(m);
+		}
+		bSceneRootDirty_ = false;
+	}
 	sceneRoot_->GatherRenderCommands(pRenderSystem_->GetCbvManager(), sceneRenderCommands_);
 }
 
@@ -2,11 +2,19 @@
 
 #include <memory>
 #include <queue>
+#include <unordered_map>
 #include <vector>
 
 #include "app_pass_base.h"
+#include "draw_sort.h"
+#include "frame_arena.h"
 #include "meshlet_resource.h"
+#include "prefix_scan.h"
+#include "render_graph_sim.h"
 #include "rt_pipeline_manager.h"
+#include "shadow_cascade.h"
+#include "software_occlusion.h"
+#include "virtual_shadow_map.h"
 
 #include "sl12/resource_loader.h"
 #include "sl12/shader_manager.h"
@@ -70,6 +78,30 @@ struct WorkMaterial
 	}
 };	// struct WorkMaterial
 
+//----
+// インスタンスのワールドAABBを葉に持つ完全二分木
+// 葉の更新はO(log N)で、根がシーン全体のAABBになる
+class InstanceBoundTree
+{
+public:
+	void Reset(sl12::u32 count);
+	void Set(sl12::u32 index, const DirectX::XMFLOAT3& aabbMin, const DirectX::XMFLOAT3& aabbMax);
+	void Clear(sl12::u32 index);
+	void GetRoot(DirectX::XMFLOAT3& aabbMin, DirectX::XMFLOAT3& aabbMax) const;
+
+private:
+	struct Node
+	{
+		DirectX::XMFLOAT3	aabbMin, aabbMax;
+	};
+	static Node EmptyNode();
+	static Node MergeNode(const Node& a, const Node& b);
+	void Grow(sl12::u32 count);
+
+	std::vector<Node>	nodes_;			// [1]が根、[leafCount_ + i]がインスタンスi
+	sl12::u32			leafCount_ = 0;
+};	// class InstanceBoundTree
+
 //----
 struct NeededMiplevel
 {
@@ -160,6 +192,8 @@ struct TemporalCBs
 {
 	sl12::CbvHandle hSceneCB, hFrustumCB;
 	sl12::CbvHandle hLightCB, hShadowCB;
+	sl12::CbvHandle hShadowCascadeCBs[kShadowCascadeMax], hShadowFrustumCBs[kShadowCascadeMax];
+	std::vector<sl12::CbvHandle> hVsmPageCBs, hVsmPageFrustumCBs;
 	sl12::CbvHandle hDetailCB;
 	sl12::CbvHandle hBlurXCB, hBlurYCB;
 	sl12::CbvHandle hAmbOccCB;
@@ -176,6 +210,13 @@ struct TemporalCBs
 		hFrustumCB.Reset();
 		hLightCB.Reset();
 		hShadowCB.Reset();
+		for (sl12::u32 i = 0; i < kShadowCascadeMax; i++)
+		{
+			hShadowCascadeCBs[i].Reset();
+			hShadowFrustumCBs[i].Reset();
+		}
+		hVsmPageCBs.clear();
+		hVsmPageFrustumCBs.clear();
 		hDetailCB.Reset();
 		hBlurXCB.Reset();
 		hBlurYCB.Reset();
@@ -193,6 +234,8 @@ struct RenderPassSetupDesc
 {
 	bool bUseVisibilityBuffer = false;
 	bool bUseMeshShader = false;
+	bool bUseOcclusionCulling = false;
+	bool bUseBindlessMasked = false;
 	int visToGBufferType = 0;
 	int ssaoType = 0;
 	bool bNeedDeinterleave = false;
@@ -203,6 +246,14 @@ struct RenderPassSetupDesc
 	int raytracingTech = 0;
 	int atrousIterations = 4;
 	bool bShadowBlur = false;
+	bool bUseShadowCulling = false;
+	bool bUseShadowOcclusionCulling = false;
+	int shadowCascadeCount = 1;
+	bool bUseShadowCache = false;
+	bool bUseVirtualShadow = false;
+	int prefixScanBenchmarkCount = 0;
+	int prefixScanBenchmarkType = 0;
+	bool bPrefixScanInclusive = false;
 	bool bDebugDdgi = false;
 	bool bUseWater = false;
 	int waterMethod = 1;
@@ -212,6 +263,8 @@ struct RenderPassSetupDesc
 	{
 		return (bUseVisibilityBuffer == rhs.bUseVisibilityBuffer)
 			&& (bUseMeshShader == rhs.bUseMeshShader)
+			&& (bUseOcclusionCulling == rhs.bUseOcclusionCulling)
+			&& (bUseBindlessMasked == rhs.bUseBindlessMasked)
 			&& (visToGBufferType == rhs.visToGBufferType)
 			&& (ssaoType == rhs.ssaoType)
 			&& (bNeedDeinterleave == rhs.bNeedDeinterleave)
@@ -222,6 +275,14 @@ struct RenderPassSetupDesc
 			&& (raytracingTech == rhs.raytracingTech)
 			&& (atrousIterations == rhs.atrousIterations)
 			&& (bShadowBlur == rhs.bShadowBlur)
+			&& (bUseShadowCulling == rhs.bUseShadowCulling)
+			&& (bUseShadowOcclusionCulling == rhs.bUseShadowOcclusionCulling)
+			&& (shadowCascadeCount == rhs.shadowCascadeCount)
+			&& (bUseShadowCache == rhs.bUseShadowCache)
+			&& (bUseVirtualShadow == rhs.bUseVirtualShadow)
+			&& (prefixScanBenchmarkCount == rhs.prefixScanBenchmarkCount)
+			&& (prefixScanBenchmarkType == rhs.prefixScanBenchmarkType)
+			&& (bPrefixScanInclusive == rhs.bPrefixScanInclusive)
 			&& (bDebugDdgi == rhs.bDebugDdgi)
 			&& (bUseWater == rhs.bUseWater)
 			&& (waterMethod == rhs.waterMethod)
@@ -233,6 +294,13 @@ struct RenderPassSetupDesc
 	}
 };
 
+// レンダーグラフのシミュレーション用に設定の組み合わせを列挙する
+// indexは0からGetRenderPassSetupCombinationCount()未満
+// パスの設定とグラフの接続が他の組み合わせと同じになる場合はfalseを返す
+// 解像度やしきい値などの列挙しない項目はbaseの値を使う
+sl12::u32 GetRenderPassSetupCombinationCount();
+bool GetRenderPassSetupCombination(const RenderPassSetupDesc& base, sl12::u32 index, RenderPassSetupDesc& outDesc);
+
 //----
 class Scene
 {
@@ -266,7 +334,16 @@ public:
 	void Finalize();
 
 	void SetViewportResolution(sl12::u32 width, sl12::u32 height);
+	void SetMeshGridWidth(int width)
+	{
+		meshGridWidth_ = width;
+	}
 	bool CreateSceneMeshes(int meshType);
+	// 実行時のメッシュインスタンス追加/削除
+	// 削除時はsceneMeshes_の末尾要素が削除位置に移動する
+	void AddSceneMesh(const std::shared_ptr<sl12::SceneMesh>& mesh);
+	bool RemoveSceneMesh(const std::shared_ptr<sl12::SceneMesh>& mesh);
+	void UpdateSceneMeshTransform(const std::shared_ptr<sl12::SceneMesh>& mesh, const DirectX::XMFLOAT4X4& mtxLocalToWorld);
 	void CreateMiplevelFeedback();
 	void CreateMeshletBounds(sl12::CommandList* pCmdList);
 	void CreateIrradianceMap(sl12::CommandList* pCmdList);
@@ -411,6 +488,280 @@ public:
 		return rtMeshOffsetCBs_;
 	}
 
+	// ソフトウェアオクルージョンカリング (実験的な機能、オクルーダーが保守的でない)
+	// 結果はsceneMeshes_と同じ順序で、次の呼び出しかクリアまで有効
+	// GPUカリングにはInstanceData.flagsで反映する (メッシュシェーダと半透明の描画はIsSoftwareOccludedを参照する)
+	void CullSoftwareOcclusion(const DirectX::XMMATRIX& mtxWorldToClip, float nearZ);
+	void ClearSoftwareOcclusion()
+	{
+		swOccluded_.clear();
+		meshletResource_->ClearInstanceOcclusion();
+	}
+	bool IsSoftwareOccluded(sl12::u32 meshIndex) const
+	{
+		return meshIndex < swOccluded_.size() && swOccluded_[meshIndex];
+	}
+	SoftwareOcclusionBuffer* GetSoftwareOcclusionBuffer()
+	{
+		return &swOcclusion_;
+	}
+	double GetSoftwareOcclusionMicroSec() const
+	{
+		return swOcclusionMicroSec_;
+	}
+
+	// シャドウHiZとシャドウマップの履歴が使えるかをカスケードごとに更新する
+	// ライト行列が変わったカスケードとキャスターのハッシュが変わったフレームは履歴を使わない
+	// bUseCacheが有効なら、履歴が使えるカスケードはシャドウマップを再描画しない
+	void UpdateShadowHistory(const DirectX::XMFLOAT4X4* mtxWorldToShadows, sl12::u32 cascadeCount, bool bUseCache);
+	bool IsShadowHistoryValid(sl12::u32 cascadeIndex) const
+	{
+		return bShadowHistoryValid_[cascadeIndex];
+	}
+	bool IsShadowCascadeCached(sl12::u32 cascadeIndex) const
+	{
+		return bShadowCascadeCached_[cascadeIndex];
+	}
+
+	// シャドウキャッシュの統計
+	struct ShadowCacheStats
+	{
+		sl12::u32	renderedCascades = 0;	// このフレームで描画したカスケード数
+		sl12::u32	reusedCascades = 0;		// このフレームで再利用したカスケード数
+		sl12::u64	renderedFrames = 0;		// 1つ以上のカスケードを描画したフレーム数
+		sl12::u64	reusedFrames = 0;		// 全カスケードを再利用したフレーム数
+		sl12::u64	casterHash = 0;
+	};
+	const ShadowCacheStats& GetShadowCacheStats() const
+	{
+		return shadowCacheStats_;
+	}
+
+	// 仮想シャドウマップ
+	// 前フレームまでのページ要求で物理ページを割り当て、描画するページをrenderBudget個まで選ぶ
+	// ライト行列かキャスターが変わったら全ページを描画し直す
+	void UpdateVirtualShadowMap(sl12::CommandList* pCmdList, const DirectX::XMFLOAT4X4& mtxWorldToVirtual, sl12::u32 renderBudget);
+	void ReadbackVirtualShadowRequests(sl12::CommandList* pCmdList);
+
+	// メッシュレットカリング結果の読み戻し (検証用)
+	// 要求したフレームの MeshletCullingPass の出力をコピーし、2フレーム後に参照できる
+	struct MeshletCullReadback
+	{
+		UniqueHandle<sl12::Buffer>	args[2];		// [0]:1st pass, [1]:2nd pass
+		UniqueHandle<sl12::Buffer>	counts[2];
+		UniqueHandle<sl12::Buffer>	drawFlags;		// オクルージョンカリング時のみ
+		sl12::u32					drawCallCount = 0;
+		sl12::u64					frameIndex = 0;
+	};
+	void RequestMeshletCullReadback();
+	bool IsMeshletCullReadbackRequested() const
+	{
+		return bMeshletCullReadbackRequest_;
+	}
+	void ReadbackMeshletCull(sl12::CommandList* pCmdList, bool b2nd, sl12::Buffer* pArgs, sl12::Buffer* pCounts, sl12::Buffer* pDrawFlags, sl12::u32 drawCallCount);
+	// コピーしたフレームのGPU処理が終わっていなければnullptr
+	MeshletCullReadback* GetMeshletCullReadback();
+	void ReleaseMeshletCullReadback();
+
+	// マテリアル分類の読み戻し (検証用)
+	// 要求したフレームの ClassifyPass の入力と出力をコピーし、2フレーム後に参照できる
+	struct ClassifyReadback
+	{
+		UniqueHandle<sl12::Buffer>	visibility, depth;		// テクスチャの行はrowPitchごとに並ぶ
+		UniqueHandle<sl12::Buffer>	tileMaterialCount, tileMaterialList;
+		UniqueHandle<sl12::Buffer>	drawArgs, tileOffset, tileIndex;
+		sl12::u32					width = 0, height = 0;
+		sl12::u32					visRowPitch = 0, depthRowPitch = 0;
+		sl12::u64					frameIndex = 0;
+	};
+	void RequestClassifyReadback();
+	bool IsClassifyReadbackRequested() const
+	{
+		return bClassifyReadbackRequest_;
+	}
+	void ReadbackClassify(sl12::CommandList* pCmdList, sl12::Texture* pVis, sl12::Texture* pDepth,
+		sl12::Buffer* pTileMaterialCount, sl12::Buffer* pTileMaterialList, sl12::Buffer* pDrawArgs, sl12::Buffer* pTileOffset, sl12::Buffer* pTileIndex);
+	// コピーしたフレームのGPU処理が終わっていなければnullptr
+	ClassifyReadback* GetClassifyReadback();
+	void ReleaseClassifyReadback();
+
+	// メッシュレットのアルファ分類のベイク (meshlet_alpha.h)
+	// 読み込み後のUVとベースカラーのアルファはGPUにしかないので、GPUでバッファにコピーして読み戻し、
+	// 2フレーム後にCPUで分類して "<mesh file>.malpha" に保存する
+	void RequestMeshletAlphaBake()
+	{
+		bMeshletAlphaBakeRequest_ = true;
+	}
+	void RecordMeshletAlphaBake(sl12::CommandList* pCmdList);
+	// 保存したメッシュ数を返す。読み戻しが終わっていなければ-1
+	int FinishMeshletAlphaBake();
+	void ReleaseMeshletAlphaBake();
+	const VirtualShadowPageTable& GetVsmPageTable() const
+	{
+		return vsmPageTable_;
+	}
+	const std::vector<VirtualShadowPageTable::RenderPage>& GetVsmRenderPages() const
+	{
+		return vsmRenderPages_;
+	}
+	sl12::Texture* GetVsmPool()
+	{
+		return &vsmPool_;
+	}
+	sl12::TextureView* GetVsmPoolSRV()
+	{
+		return &vsmPoolSRV_;
+	}
+	sl12::DepthStencilView* GetVsmPoolDSV()
+	{
+		return &vsmPoolDSV_;
+	}
+	sl12::Buffer* GetVsmRequestBuffer()
+	{
+		return &vsmRequestBuffer_;
+	}
+	sl12::Buffer* GetVsmRequestClear()
+	{
+		return &vsmRequestClear_;
+	}
+	sl12::UnorderedAccessView* GetVsmRequestUAV()
+	{
+		return &vsmRequestUAV_;
+	}
+	sl12::BufferView* GetVsmPageTableSRV()
+	{
+		return &vsmPageTableSRV_;
+	}
+	sl12::Buffer* GetVsmCompactArg()
+	{
+		return &vsmCompactArg_;
+	}
+	sl12::Buffer* GetVsmDrawCount()
+	{
+		return &vsmDrawCount_;
+	}
+	sl12::UnorderedAccessView* GetVsmCompactArgUAV()
+	{
+		return &vsmCompactArgUAV_;
+	}
+	sl12::UnorderedAccessView* GetVsmDrawCountUAV()
+	{
+		return &vsmDrawCountUAV_;
+	}
+
+	// プレフィックススキャンのベンチマーク結果
+	// GPUの結果をリードバックしてCPU版と比較する
+	struct PrefixScanStats
+	{
+		sl12::u32	elementCount = 0;
+		sl12::u32	checkedFrames = 0;		// 比較したフレーム数
+		sl12::u32	mismatchCount = 0;		// 一致しなかった要素数の合計
+		double		cpuMicroSec = 0.0;		// CPU版の処理時間
+	};
+	PrefixScanStats& GetPrefixScanStats()
+	{
+		return prefixScanStats_;
+	}
+
+	// ソートキーによる描画順の統計 (1フレーム分)
+	// instanceOrderは以前のインスタンス順で描画した場合の数
+	struct DrawSortStats
+	{
+		DrawStateStats	visibilityInstanceOrder;
+		DrawStateStats	visibilitySorted;
+		DrawStateStats	gbufferInstanceOrder;
+		DrawStateStats	gbufferSorted;
+	};
+	DrawSortStats& GetDrawSortStats()
+	{
+		return drawSortStats_;
+	}
+
+	// 描画コマンド記録のCPU時間のベンチマーク
+	// kAverageFramesフレームごとに平均を更新する (2ndパスは同じフレームに加算する)
+	struct DrawRecordTime
+	{
+		static const sl12::u32 kAverageFrames = 60;
+
+		double		averageMicroSec = 0.0;
+		double		accumMicroSec = 0.0;
+		sl12::u32	frameCount = 0;
+		sl12::u32	executeCount = 0;	// 直近のフレームのExecuteIndirect数
+
+		void Add(double microSec, sl12::u32 executes, bool bNewFrame)
+		{
+			if (bNewFrame)
+			{
+				if (frameCount >= kAverageFrames)
+				{
+					averageMicroSec = accumMicroSec / (double)frameCount;
+					accumMicroSec = 0.0;
+					frameCount = 0;
+				}
+				frameCount++;
+				executeCount = 0;
+			}
+			accumMicroSec += microSec;
+			executeCount += executes;
+		}
+	};
+	struct DrawRecordStats
+	{
+		DrawRecordTime	visibility;
+		DrawRecordTime	depthPre;
+	};
+	DrawRecordStats& GetDrawRecordStats()
+	{
+		return drawRecordStats_;
+	}
+
+	// レンダーグラフのコンパイルキャッシュ
+	// 無効にすると毎フレームコンパイルする
+	struct RenderGraphCompileStats
+	{
+		sl12::u64	compileCount = 0;
+		sl12::u64	hitCount = 0;
+		double		lastCompileMicroSec = 0.0;	// 直近のコンパイル (キーの計算を含む)
+		double		lastHitMicroSec = 0.0;		// 直近のキャッシュヒット (キーの計算と外部テクスチャの登録)
+	};
+	const RenderGraphCompileStats& GetRenderGraphCompileStats() const
+	{
+		return renderGraphCompileStats_;
+	}
+	void SetRenderGraphCacheEnable(bool bEnable)
+	{
+		bRenderGraphCacheEnable_ = bEnable;
+	}
+
+	// パスごとのCPU時間 (直近のフレーム)
+	// prepareはパス間で並列に実行するので、合計はprepareWallMicroSecより大きくなる
+	struct PassRecordTime
+	{
+		AppPassType	type;
+		std::string	name;
+		double		prepareMicroSec = 0.0;
+		double		recordMicroSec = 0.0;
+	};
+	struct PassRecordStats
+	{
+		std::vector<PassRecordTime>	passes;			// 接続されたパスのみ
+		double						prepareWallMicroSec = 0.0;
+		double						recordWallMicroSec = 0.0;
+	};
+	const PassRecordStats& GetPassRecordStats() const
+	{
+		return passRecordStats_;
+	}
+	void SetParallelPrepareEnable(bool bEnable)
+	{
+		bParallelPrepare_ = bEnable;
+	}
+
+	// descで組んだ場合のパスの入出力と接続をシミュレーション用のグラフにする
+	// passCostsはパス名ごとの推定実行時間 (見つからないパスは1)
+	// 実行中のグラフは変更しない
+	void BuildRenderGraphSim(const RenderPassSetupDesc& desc, const std::map<std::string, float>& passCosts, RenderGraphSimGraph& outGraph);
+
 	sl12::u64 GetFrameIndex() const
 	{
 		return frameIndex_;
@@ -420,10 +771,24 @@ public:
 		frameIndex_++;
 	}
 
+	// 1フレームの間だけ使う作業用メモリ
+	// フレームの先頭でリセットする
+	FrameArena& GetFrameArena()
+	{
+		return frameArena_;
+	}
+
 private:
 	void ComputeSceneAABB();
+	void CalcMeshWorldAABB(const sl12::SceneMesh* mesh, DirectX::XMFLOAT3& aabbMin, DirectX::XMFLOAT3& aabbMax) const;
+	void UpdateInstanceBound(sl12::u32 index);
+	sl12::u64 CalcShadowCasterHash() const;
+	sl12::u64 CalcRenderGraphCacheKey(const sl12::Texture* pSwapchainTarget) const;
 	void SetupRenderPassGraph(const RenderPassSetupDesc& desc);
+	void BuildRenderPassEdges(const RenderPassSetupDesc& desc, std::vector<std::pair<AppPassType, AppPassType>>& outEdges) const;
+	void AddAppPass(AppPassType type, const sl12::RenderPassID& ID, AppPassBase* pPass);
 	void CreateMeshletResource();
+	void CreateVirtualShadowResources(sl12::CommandList* pCmdList);
 
 private:
 	static const int kBufferCount = sl12::Swapchain::kMaxBuffer;
@@ -456,9 +821,13 @@ private:
 	std::map<sl12::u64, UniqueHandle<sl12::BufferView>>	meshletBoundsSRVs_;
 
 	// scene meshes.
+	int												meshGridWidth_ = 32;	// meshType 0 のグリッド幅
 	UniqueHandle<sl12::SceneRoot>					sceneRoot_;
 	std::vector<std::shared_ptr<sl12::SceneMesh>>	sceneMeshes_;
 	DirectX::XMFLOAT3								sceneAABBMax_, sceneAABBMin_;
+	InstanceBoundTree								instanceBounds_;		// sceneMeshes_と同じ順序のワールドAABB
+	std::unordered_map<const sl12::ResourceItemMesh*, sl12::u32>	resMeshInstanceCounts_;	// BVHジオメトリを使うインスタンス数
+	bool											bSceneRootDirty_ = false;	// 次のGatherRenderCommandsで作り直す
 	sl12::RenderCommandsList						sceneRenderCommands_;
 
 	// miplevel feedback resources.
@@ -478,7 +847,22 @@ private:
 	UniqueHandle<sl12::RenderGraph>						renderGraph_;
 	std::vector<std::unique_ptr<AppPassBase>>			passes_;
 	std::map<AppPassType, sl12::RenderGraph::Node>		passNodes_;
+	struct AppPassInfo
+	{
+		sl12::RenderPassID	ID;
+		AppPassBase*		pPass;
+		AppPassRecorder*	pRecorder;
+	};
+	std::map<AppPassType, AppPassInfo>					passInfos_;
+	std::vector<std::unique_ptr<AppPassRecorder>>		passRecorders_;
+	PassRecordStats										passRecordStats_;
+	bool												bParallelPrepare_ = true;
 	RenderPassSetupDesc									lastRenderPassDesc_;
+	sl12::u32											renderGraphGeneration_ = 0;		// グラフの接続を作り直した回数
+	sl12::u64											renderGraphCacheKey_ = 0;
+	bool												bRenderGraphCompiled_ = false;
+	bool												bRenderGraphCacheEnable_ = true;
+	RenderGraphCompileStats								renderGraphCompileStats_;
 
 	// ray tracing.
 	UniqueHandle<sl12::BvhManager>			bvhManager_;
@@ -490,7 +874,73 @@ private:
 	sl12::u32								rtTableGeneration_ = 0;
 	bool									bResetProbes_ = false;
 
+	// software occlusion.
+	SoftwareOcclusionBuffer									swOcclusion_;
+	std::map<const sl12::ResourceItemMesh*, OccluderMesh>	occluderProxies_;
+	std::vector<bool>										swOccluded_;
+	double													swOcclusionMicroSec_ = 0.0;
+
+	// shadow culling.
+	DirectX::XMFLOAT4X4		mtxPrevWorldToShadows_[kShadowCascadeMax]{};
+	sl12::u32				prevShadowCascadeCount_ = 0;
+	bool					bShadowHistoryValid_[kShadowCascadeMax]{};
+	bool					bShadowCascadeCached_[kShadowCascadeMax]{};
+	ShadowCacheStats		shadowCacheStats_;
+
+	// virtual shadow map.
+	VirtualShadowPageTable							vsmPageTable_;
+	UniqueHandle<sl12::Texture>						vsmPool_;
+	UniqueHandle<sl12::TextureView>					vsmPoolSRV_;
+	UniqueHandle<sl12::DepthStencilView>			vsmPoolDSV_;
+	UniqueHandle<sl12::Buffer>						vsmRequestBuffer_, vsmRequestClear_;
+	UniqueHandle<sl12::UnorderedAccessView>			vsmRequestUAV_;
+	UniqueHandle<sl12::Buffer>						vsmRequestReadbacks_[2];
+	UniqueHandle<sl12::Buffer>						vsmPageTableBuffer_;
+	UniqueHandle<sl12::BufferView>					vsmPageTableSRV_;
+	UniqueHandle<sl12::Buffer>						vsmCompactArg_, vsmDrawCount_;
+	UniqueHandle<sl12::UnorderedAccessView>			vsmCompactArgUAV_, vsmDrawCountUAV_;
+	std::vector<VirtualShadowPageTable::RenderPage>	vsmRenderPages_;
+	std::vector<sl12::u32>							vsmRequestedPages_;
+	std::vector<sl12::u32>							vsmGpuPageTable_;
+	DirectX::XMFLOAT4X4								mtxPrevWorldToVirtual_{};
+	sl12::u64										vsmCasterHash_ = 0;
+
+	MeshletCullReadback	meshletCullReadback_;
+	bool				bMeshletCullReadbackRequest_ = false;
+	ClassifyReadback	classifyReadback_;
+	bool				bClassifyReadbackRequest_ = false;
+
+	struct MeshletAlphaBakeTexel
+	{
+		UniqueHandle<sl12::Buffer>	readback;
+		sl12::u32					width = 0;
+		sl12::u32					height = 0;
+		sl12::u32					rowPitch = 0;	// u32単位 (1要素に4テクセル)
+	};
+	struct MeshletAlphaBakeSubmesh
+	{
+		const sl12::ResourceItemMesh*	resMesh = nullptr;
+		sl12::u32						submeshIndex = 0;
+		sl12::u32						texelIndex = 0;	// texelsのインデックス
+		sl12::u32						indexCount = 0;
+		UniqueHandle<sl12::Buffer>		readback;		// インデックスごとのUV
+	};
+	struct MeshletAlphaBakeJob
+	{
+		std::vector<MeshletAlphaBakeTexel>		texels;
+		std::vector<MeshletAlphaBakeSubmesh>	submeshes;
+		sl12::u64								frameIndex = 0;
+		bool									bRecorded = false;
+	};
+	MeshletAlphaBakeJob	meshletAlphaBake_;
+	bool				bMeshletAlphaBakeRequest_ = false;
+
+	PrefixScanStats		prefixScanStats_;
+	DrawSortStats		drawSortStats_;
+	DrawRecordStats		drawRecordStats_;
+
 	sl12::u64		frameIndex_ = 0;
+	FrameArena		frameArena_;
 };	// class Scene
 
 //	EOF
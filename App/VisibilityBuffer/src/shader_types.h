@@ -12,14 +12,21 @@ enum ShaderName
 	VisibilityOpaqueP,
 	VisibilityMaskedVV,
 	VisibilityMaskedP,
+	MaskedBindlessVV,
+	MaskedBindlessVisP,
+	MaskedBindlessVisOpaqueP,
+	MaskedBindlessDepthP,
 	LightingSMC,
 	LightingEVSMC,
+	LightingVSMC,
 	IndirectC,
 	FullscreenVV,
 	TonemapP,
 	ClassifyC,
+	ClassifyInitC,
+	ClassifyScanC,
+	ClassifyScatterC,
 	MatDepthP,
-	ClearArgC,
 	MaterialTileVV,
 	MaterialTileP,
 	ShadowOpaqueVV,
@@ -39,8 +46,13 @@ enum ShaderName
 	DenoiseWithGIC,
 	DeinterleaveC,
 	MeshletCullC,
+	MeshletCull1stC,
+	MeshletCull2ndC,
+	MeshletCullShadowC,
+	MeshletCullShadowOccC,
 	ClearMipC,
 	FeedbackMipC,
+	VsmPageRequestC,
 	VisibilityMesh1stA,
 	VisibilityMesh2ndA,
 	VisibilityMeshOpaqueM,
@@ -52,6 +64,8 @@ enum ShaderName
 	MaterialResolveLib,
 	PrefixSumInitCS,
 	PrefixSumC,
+	PrefixSumU64C,
+	PrefixSumSegmentedC,
 	InitCountC,
 	CountC,
 	CountSumC,
@@ -61,6 +75,8 @@ enum ShaderName
 	MatGBTriplanarC,
 	InitBinningTileC,
 	BinningTileC,
+	BinningTileScanC,
+	BinningTileScatterC,
 	TileStandardC,
 	TileTriplanarC,
 	GenVrsC,
@@ -68,6 +84,8 @@ enum ShaderName
 	ReprojectVrsC,
 	MotionVectorC,
 	MakeIrradianceC,
+	MeshletAlphaTexcoordC,
+	MeshletAlphaTexelC,
 	MeshXluVV,
 	MeshXluP,
 	WaterVV,
@@ -105,14 +123,21 @@ static const char* kShaderFileAndEntry[] = {
 	"visibility_opaque.p.hlsl",			"main",
 	"visibility_masked.vv.hlsl",		"main",
 	"visibility_masked.p.hlsl",			"main",
+	"masked_bindless.vv.hlsl",			"main",
+	"masked_bindless.p.hlsl",			"VisibilityPS",
+	"masked_bindless.p.hlsl",			"VisibilityOpaquePS",
+	"masked_bindless.p.hlsl",			"DepthPS",
 	"lighting_sm.c.hlsl",				"main",
 	"lighting_evsm.c.hlsl",				"main",
+	"lighting_vsm.c.hlsl",				"main",
 	"indirect_lighting.c.hlsl",			"main",
 	"fullscreen.vv.hlsl",				"main",
 	"tonemap.p.hlsl",					"main",
 	"classify.c.hlsl",					"main",
+	"classify.c.hlsl",					"InitCS",
+	"classify.c.hlsl",					"ScanCS",
+	"classify.c.hlsl",					"ScatterCS",
 	"material_depth.p.hlsl",			"main",
-	"clear_arg.c.hlsl",					"main",
 	"material_tile.vv.hlsl",			"main",
 	"material_tile.p.hlsl",				"main",
 	"shadow_opaque.vv.hlsl",			"main",
@@ -132,8 +157,13 @@ static const char* kShaderFileAndEntry[] = {
 	"denoise_with_gi.c.hlsl",			"main",
 	"deinterleave.c.hlsl",				"main",
 	"meshlet_cull.c.hlsl",				"main",
+	"meshlet_cull_1st.c.hlsl",			"main",
+	"meshlet_cull_2nd.c.hlsl",			"main",
+	"meshlet_cull_shadow.c.hlsl",		"main",
+	"meshlet_cull_shadow_occ.c.hlsl",	"main",
 	"miplevel_feedback.c.hlsl",			"ClearCS",
 	"miplevel_feedback.c.hlsl",			"FeedbackCS",
+	"vsm_page_request.c.hlsl",			"main",
 	"visibility_mesh_1st.a.hlsl",		"main",
 	"visibility_mesh_2nd.a.hlsl",		"main",
 	"visibility_mesh_opaque.m.hlsl",	"main",
@@ -145,6 +175,8 @@ static const char* kShaderFileAndEntry[] = {
 	"material_resolve.lib.hlsl",		"main",
 	"prefix_sum.c.hlsl",				"InitBufferCS",
 	"prefix_sum.c.hlsl",				"PrefixScanCS",
+	"prefix_sum_u64.c.hlsl",			"PrefixScanCS",
+	"prefix_sum_segmented.c.hlsl",		"PrefixScanCS",
 	"material_binning.c.hlsl",			"InitCountCS",
 	"material_binning.c.hlsl",			"CountCS",
 	"material_binning.c.hlsl",			"CountSumCS",
@@ -152,8 +184,10 @@ static const char* kShaderFileAndEntry[] = {
 	"material_binning.c.hlsl",			"FinalizeCS",
 	"material_gbuffer.c.hlsl",			"StandardCS",
 	"material_gbuffer.c.hlsl",			"TriplanarCS",
-	"material_binning.c.hlsl",			"InitBinningTileCS",
-	"material_binning.c.hlsl",			"BinningTileCS",
+	"material_binning_tile.c.hlsl",		"InitBinningTileCS",
+	"material_binning_tile.c.hlsl",		"BinningTileCS",
+	"material_binning_tile.c.hlsl",		"BinningTileScanCS",
+	"material_binning_tile.c.hlsl",		"BinningTileScatterCS",
 	"material_tile.c.hlsl",				"StandardCS",
 	"material_tile.c.hlsl",				"TriplanarCS",
 	"vrs.c.hlsl",						"GenerateVrsCS",
@@ -161,6 +195,8 @@ static const char* kShaderFileAndEntry[] = {
 	"vrs.c.hlsl",						"ReprojectionCS",
 	"motion_vector.c.hlsl",				"main",
 	"make_irradiance.c.hlsl",			"main",
+	"meshlet_alpha_bake.c.hlsl",		"TexcoordCS",
+	"meshlet_alpha_bake.c.hlsl",		"TexelCS",
 	"mesh_xlu.vv.hlsl",					"main",
 	"mesh_xlu.p.hlsl",					"main",
 	"water.vv.hlsl",					"main",
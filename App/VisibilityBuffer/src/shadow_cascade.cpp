@@ -0,0 +1,269 @@
+﻿#include "shadow_cascade.h"
+
+#include "sl12/string_util.h"
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+
+
+namespace
+{
+	// ライト空間の基底
+	// カメラに依存しないので、カメラが動いても基底は変わらない
+	void CalcLightBasis(const DirectX::XMFLOAT3& lightDir, DirectX::XMVECTOR& outRight, DirectX::XMVECTOR& outUp, DirectX::XMVECTOR& outFront)
+	{
+		auto front = DirectX::XMVector3Normalize(DirectX::XMLoadFloat3(&lightDir));
+		auto up = DirectX::XMVectorSet(0.0f, 1.0f, 0.0f, 0.0f);
+		auto right = DirectX::XMVector3Cross(front, up);
+		float len;
+		DirectX::XMStoreFloat(&len, DirectX::XMVector3Length(right));
+		if (len < 1e-4f)
+		{
+			up = DirectX::XMVectorSet(1.0f, 0.0f, 0.0f, 0.0f);
+			right = DirectX::XMVector3Cross(front, up);
+		}
+		outRight = DirectX::XMVector3Normalize(right);
+		outUp = DirectX::XMVector3Normalize(DirectX::XMVector3Cross(outRight, front));
+		outFront = front;
+	}
+
+	float Dot(const DirectX::XMVECTOR& a, const DirectX::XMVECTOR& b)
+	{
+		float ret;
+		DirectX::XMStoreFloat(&ret, DirectX::XMVector3Dot(a, b));
+		return ret;
+	}
+
+	// 角から内側が正の平面を作る
+	DirectX::XMFLOAT4 CalcPlane(const DirectX::XMFLOAT3& a, const DirectX::XMFLOAT3& b, const DirectX::XMFLOAT3& c, const DirectX::XMVECTOR& inside)
+	{
+		auto va = DirectX::XMLoadFloat3(&a);
+		auto n = DirectX::XMVector3Normalize(DirectX::XMVector3Cross(
+			DirectX::XMVectorSubtract(DirectX::XMLoadFloat3(&b), va),
+			DirectX::XMVectorSubtract(DirectX::XMLoadFloat3(&c), va)));
+		float d = -Dot(n, va);
+		if (Dot(n, inside) + d < 0.0f)
+		{
+			n = DirectX::XMVectorNegate(n);
+			d = -d;
+		}
+		DirectX::XMFLOAT4 ret;
+		DirectX::XMStoreFloat4(&ret, n);
+		ret.w = d;
+		return ret;
+	}
+
+	// ワールド座標のシャドウマップ上のテクセル座標の小数部
+	DirectX::XMFLOAT2 GetTexelFraction(const ShadowCascade& cascade, const DirectX::XMFLOAT3& pos, sl12::u32 mapSize)
+	{
+		auto p = DirectX::XMVector3TransformCoord(DirectX::XMLoadFloat3(&pos), DirectX::XMLoadFloat4x4(&cascade.mtxWorldToClip));
+		DirectX::XMFLOAT3 ndc;
+		DirectX::XMStoreFloat3(&ndc, p);
+		float tx = (ndc.x * 0.5f + 0.5f) * (float)mapSize;
+		float ty = (ndc.y * -0.5f + 0.5f) * (float)mapSize;
+		return DirectX::XMFLOAT2(tx - std::floor(tx), ty - std::floor(ty));
+	}
+
+	// 小数部の差 (0と1は同じ位置として扱う)
+	float FractionDiff(float a, float b)
+	{
+		float d = std::fabs(a - b);
+		return std::min(d, 1.0f - d);
+	}
+}
+
+//----
+void CalcShadowCascadeSplits(sl12::u32 cascadeCount, float nearZ, float farZ, float lambda, float* outSplits)
+{
+	for (sl12::u32 i = 0; i <= cascadeCount; i++)
+	{
+		float t = (float)i / (float)cascadeCount;
+		float logSplit = nearZ * std::pow(farZ / nearZ, t);
+		float uniformSplit = nearZ + (farZ - nearZ) * t;
+		outSplits[i] = lambda * logSplit + (1.0f - lambda) * uniformSplit;
+	}
+	// 端は誤差なく一致させる
+	outSplits[0] = nearZ;
+	outSplits[cascadeCount] = farZ;
+}
+
+//----
+void FitShadowCascade(const ShadowCascadeCamera& camera, float splitNear, float splitFar, const DirectX::XMFLOAT3& lightDir,
+	const DirectX::XMFLOAT3& sceneAABBMin, const DirectX::XMFLOAT3& sceneAABBMax, sl12::u32 mapSize, ShadowCascade& outCascade)
+{
+	auto mtxViewToWorld = DirectX::XMLoadFloat4x4(&camera.mtxViewToWorld);
+	float tanY = std::tan(camera.fovY * 0.5f);
+	float tanX = tanY * camera.aspect;
+
+	outCascade.splitNear = splitNear;
+	outCascade.splitFar = splitFar;
+
+	// スライスの角
+	auto centroid = DirectX::XMVectorZero();
+	for (int i = 0; i < 8; i++)
+	{
+		float z = (i & 0x04) ? splitFar : splitNear;
+		auto p = DirectX::XMVectorSet(
+			((i & 0x01) ? 1.0f : -1.0f) * z * tanX,
+			((i & 0x02) ? 1.0f : -1.0f) * z * tanY,
+			-z, 1.0f);
+		p = DirectX::XMVector3TransformCoord(p, mtxViewToWorld);
+		DirectX::XMStoreFloat3(&outCascade.sliceCorners[i], p);
+		centroid = DirectX::XMVectorAdd(centroid, p);
+	}
+	centroid = DirectX::XMVectorScale(centroid, 1.0f / 8.0f);
+
+	// スライスの平面
+	static const int kFaces[6][3] = {
+		{0, 2, 1},	// near
+		{4, 5, 6},	// far
+		{0, 4, 2},	// left
+		{1, 3, 5},	// right
+		{0, 1, 4},	// bottom
+		{2, 6, 3},	// top
+	};
+	for (int i = 0; i < 6; i++)
+	{
+		auto&& c = outCascade.sliceCorners;
+		outCascade.slicePlanes[i] = CalcPlane(c[kFaces[i][0]], c[kFaces[i][1]], c[kFaces[i][2]], centroid);
+	}
+
+	// スライスを囲む球
+	// 中心はカメラの視線上で、near面とfar面の角から等距離の位置 (far面を越える場合はfar面の中心)
+	float k = tanX * tanX + tanY * tanY;
+	float zc = std::min(splitFar, 0.5f * (splitNear + splitFar) * (1.0f + k));
+	float rNear = std::sqrt((zc - splitNear) * (zc - splitNear) + splitNear * splitNear * k);
+	float rFar = std::sqrt((splitFar - zc) * (splitFar - zc) + splitFar * splitFar * k);
+	float radius = std::max(rNear, rFar);
+	// 浮動小数の誤差で半径が揺れないように切り上げる
+	radius = std::ceil(radius * 16.0f) / 16.0f;
+	auto center = DirectX::XMVector3TransformCoord(DirectX::XMVectorSet(0.0f, 0.0f, -zc, 1.0f), mtxViewToWorld);
+
+	DirectX::XMVECTOR right, up, front;
+	CalcLightBasis(lightDir, right, up, front);
+
+	// ライト空間で中心をテクセル単位にスナップする
+	float texelWorldSize = radius * 2.0f / (float)mapSize;
+	float cx = std::floor(Dot(right, center) / texelWorldSize) * texelWorldSize;
+	float cy = std::floor(Dot(up, center) / texelWorldSize) * texelWorldSize;
+
+	// 奥行はシーン全体のキャスターを含める
+	float zMin = FLT_MAX, zMax = -FLT_MAX;
+	for (int i = 0; i < 8; i++)
+	{
+		auto p = DirectX::XMVectorSet(
+			(i & 0x01) ? sceneAABBMax.x : sceneAABBMin.x,
+			(i & 0x02) ? sceneAABBMax.y : sceneAABBMin.y,
+			(i & 0x04) ? sceneAABBMax.z : sceneAABBMin.z,
+			1.0f);
+		float z = Dot(front, p);
+		zMin = std::min(zMin, z);
+		zMax = std::max(zMax, z);
+	}
+	float depth = std::max(zMax - zMin, 1e-3f);
+
+	auto eye = DirectX::XMVectorAdd(DirectX::XMVectorScale(right, cx), DirectX::XMVectorScale(up, cy));
+	eye = DirectX::XMVectorAdd(eye, DirectX::XMVectorScale(front, zMin));
+	auto mtxWorldToView = DirectX::XMMatrixLookAtRH(eye, DirectX::XMVectorAdd(eye, front), up);
+
+	// Reversed-Zの平行投影 (ライトに近い側が1)
+	DirectX::XMMATRIX mtxViewToClip(
+		1.0f / radius, 0.0f, 0.0f, 0.0f,
+		0.0f, 1.0f / radius, 0.0f, 0.0f,
+		0.0f, 0.0f, 1.0f / depth, 0.0f,
+		0.0f, 0.0f, 1.0f, 1.0f);
+
+	outCascade.radius = radius;
+	outCascade.texelWorldSize = texelWorldSize;
+	DirectX::XMStoreFloat4x4(&outCascade.mtxWorldToView, mtxWorldToView);
+	DirectX::XMStoreFloat4x4(&outCascade.mtxViewToClip, mtxViewToClip);
+	DirectX::XMStoreFloat4x4(&outCascade.mtxWorldToClip, mtxWorldToView * mtxViewToClip);
+}
+
+//----
+DirectX::XMFLOAT4 GetShadowCascadeAtlasRect(sl12::u32 cascadeIndex, sl12::u32 cascadeCount)
+{
+	if (cascadeCount <= 1)
+	{
+		return DirectX::XMFLOAT4(0.0f, 0.0f, 1.0f, 1.0f);
+	}
+	return DirectX::XMFLOAT4((float)(cascadeIndex % 2) * 0.5f, (float)(cascadeIndex / 2) * 0.5f, 0.5f, 0.5f);
+}
+
+//----
+sl12::u32 ValidateShadowCascadeStability(const ShadowCascadeCamera& camera, float splitNear, float splitFar, const DirectX::XMFLOAT3& lightDir,
+	const DirectX::XMFLOAT3& sceneAABBMin, const DirectX::XMFLOAT3& sceneAABBMax, sl12::u32 mapSize)
+{
+	const float kFractionEpsilon = 1e-2f;
+
+	ShadowCascade base;
+	FitShadowCascade(camera, splitNear, splitFar, lightDir, sceneAABBMin, sceneAABBMax, mapSize, base);
+
+	// スライスの中心付近の固定点を観測する
+	DirectX::XMFLOAT3 probe(0.0f, 0.0f, 0.0f);
+	for (auto&& c : base.sliceCorners)
+	{
+		probe.x += c.x * 0.125f;
+		probe.y += c.y * 0.125f;
+		probe.z += c.z * 0.125f;
+	}
+	DirectX::XMFLOAT2 baseFrac = GetTexelFraction(base, probe, mapSize);
+
+	sl12::u32 errorCount = 0;
+	auto Check = [&](const ShadowCascadeCamera& moved, const char* label, float amount)
+	{
+		ShadowCascade cascade;
+		FitShadowCascade(moved, splitNear, splitFar, lightDir, sceneAABBMin, sceneAABBMax, mapSize, cascade);
+		DirectX::XMFLOAT2 frac = GetTexelFraction(cascade, probe, mapSize);
+		if (cascade.radius != base.radius
+			|| FractionDiff(frac.x, baseFrac.x) > kFractionEpsilon
+			|| FractionDiff(frac.y, baseFrac.y) > kFractionEpsilon)
+		{
+			if (errorCount == 0)
+			{
+				sl12::ConsolePrint("Error: shadow cascade is not stable. (%s %f : radius %f/%f, frac (%f, %f)/(%f, %f))\n",
+					label, amount, cascade.radius, base.radius, frac.x, frac.y, baseFrac.x, baseFrac.y);
+			}
+			errorCount++;
+		}
+	};
+
+	// テクセル未満の平行移動
+	static const float kTexelOffsets[] = {0.1f, 0.25f, 0.5f, 0.9f};
+	static const DirectX::XMFLOAT3 kDirections[] = {
+		DirectX::XMFLOAT3(1.0f, 0.0f, 0.0f),
+		DirectX::XMFLOAT3(0.0f, 1.0f, 0.0f),
+		DirectX::XMFLOAT3(0.0f, 0.0f, 1.0f),
+		DirectX::XMFLOAT3(0.577f, -0.577f, 0.577f),
+	};
+	for (auto&& dir : kDirections)
+	{
+		for (auto offset : kTexelOffsets)
+		{
+			ShadowCascadeCamera moved = camera;
+			float d = offset * base.texelWorldSize;
+			moved.mtxViewToWorld._41 += dir.x * d;
+			moved.mtxViewToWorld._42 += dir.y * d;
+			moved.mtxViewToWorld._43 += dir.z * d;
+			Check(moved, "translate", offset);
+		}
+	}
+
+	// 回転では半径が変わらないこと (中心の移動はスナップで吸収される)
+	static const float kAngles[] = {0.5f, 5.0f, 45.0f};
+	for (auto angle : kAngles)
+	{
+		ShadowCascadeCamera moved = camera;
+		auto mtx = DirectX::XMLoadFloat4x4(&camera.mtxViewToWorld);
+		auto pos = mtx.r[3];
+		mtx.r[3] = DirectX::XMVectorSet(0.0f, 0.0f, 0.0f, 1.0f);
+		mtx = mtx * DirectX::XMMatrixRotationY(DirectX::XMConvertToRadians(angle));
+		mtx.r[3] = pos;
+		DirectX::XMStoreFloat4x4(&moved.mtxViewToWorld, mtx);
+		Check(moved, "rotate", angle);
+	}
+
+	return errorCount;
+}
+
+//	EOF
@@ -0,0 +1,62 @@
+﻿#pragma once
+
+#include "sl12/types.h"
+#include <DirectXMath.h>
+
+
+static const sl12::u32 kShadowCascadeMax = 4;
+
+//----
+// カスケードの分割と平行投影のフィッティング
+// D3D12に依存しないので、アプリケーション外でも実行できる
+
+// カスケードを計算するカメラ
+// mtxViewToWorldはRH (カメラは-Z方向を向く)
+struct ShadowCascadeCamera
+{
+	DirectX::XMFLOAT4X4		mtxViewToWorld;
+	float					fovY;		// radian
+	float					aspect;		// width / height
+};	// struct ShadowCascadeCamera
+
+//----
+struct ShadowCascade
+{
+	float					splitNear;
+	float					splitFar;
+	float					radius;				// スライスを囲む球の半径 (カメラの回転で変化しない)
+	float					texelWorldSize;		// シャドウマップ1テクセルのワールドサイズ
+	DirectX::XMFLOAT4X4		mtxWorldToView;
+	DirectX::XMFLOAT4X4		mtxViewToClip;
+	DirectX::XMFLOAT4X4		mtxWorldToClip;
+	DirectX::XMFLOAT3		sliceCorners[8];	// bit0:x, bit1:y, bit2:far
+	DirectX::XMFLOAT4		slicePlanes[6];		// 内側が正のスライスの平面
+};	// struct ShadowCascade
+
+// 分割位置を計算する
+//   lambda = 0 : 均等分割
+//   lambda = 1 : 対数分割
+//   その間は2つの線形補間 (practical split scheme)
+// outSplitsにはcascadeCount + 1個の値が入る (先頭がnearZ、末尾がfarZ)
+void CalcShadowCascadeSplits(sl12::u32 cascadeCount, float nearZ, float farZ, float lambda, float* outSplits);
+
+// カメラのスライスにシャドウの平行投影を合わせる
+// スライスを囲む球に合わせるのでサイズはカメラの向きに依存せず、中心をテクセル単位にスナップする
+// これにより、カメラが動いてもシャドウマップ上のワールド座標はテクセル単位でしか動かない
+// 奥行はキャスターを含めるためにシーンAABB全体を覆う
+// lightDirは光の進行方向
+void FitShadowCascade(const ShadowCascadeCamera& camera, float splitNear, float splitFar, const DirectX::XMFLOAT3& lightDir,
+	const DirectX::XMFLOAT3& sceneAABBMin, const DirectX::XMFLOAT3& sceneAABBMax, sl12::u32 mapSize, ShadowCascade& outCascade);
+
+// アトラス内のカスケードの範囲 (xy : UVオフセット、zw : UVスケール)
+// 1カスケードならシャドウマップ全体、それ以上は2x2に分割する
+DirectX::XMFLOAT4 GetShadowCascadeAtlasRect(sl12::u32 cascadeIndex, sl12::u32 cascadeCount);
+
+// カスケードのフィッティングがカメラのテクセル未満の移動と回転で揺れないことを検証する
+//   ・半径が変わらない
+//   ・固定したワールド座標のシャドウマップ上の小数部が変わらない (テクセル単位でしか動かない)
+// 戻り値は失敗したケース数 (0なら安定)
+sl12::u32 ValidateShadowCascadeStability(const ShadowCascadeCamera& camera, float splitNear, float splitFar, const DirectX::XMFLOAT3& lightDir,
+	const DirectX::XMFLOAT3& sceneAABBMin, const DirectX::XMFLOAT3& sceneAABBMax, sl12::u32 mapSize);
+
+//	EOF
@@ -0,0 +1,352 @@
+﻿#include "software_occlusion.h"
+
+#include "sl12/string_util.h"
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <fstream>
+
+
+namespace
+{
+	// 薄いmeshletの判定: 最も薄い軸が他の軸のこの割合以下
+	static const float kThinRatio = 0.02f;
+	// 大きいmeshletの判定: メッシュのAABB対角線長に対する割合
+	static const float kMinExtentRatio = 0.01f;
+	// 代理四角形の縮小率
+	static const float kProxyScale = 0.5f;
+	// culling.hlsli の IsOcclusionCull と同じ許容値
+	static const float kDepthEpsilon = 1e-7f;
+}
+
+//----
+void BuildMeshletOccluderProxy(const sl12::ResourceItemMesh* pResMesh, const std::vector<sl12::u32>& submeshIndices, OccluderMesh& outMesh)
+{
+	outMesh.positions.clear();
+	outMesh.indices.clear();
+
+	auto&& meshBox = pResMesh->GetBoundingInfo().box;
+	DirectX::XMVECTOR meshDiag = DirectX::XMVectorSubtract(DirectX::XMLoadFloat3(&meshBox.aabbMax), DirectX::XMLoadFloat3(&meshBox.aabbMin));
+	float minExtent = DirectX::XMVectorGetX(DirectX::XMVector3Length(meshDiag)) * kMinExtentRatio;
+
+	auto&& submeshes = pResMesh->GetSubmeshes();
+	for (auto submeshIndex : submeshIndices)
+	{
+		for (auto&& meshlet : submeshes[submeshIndex].meshlets)
+		{
+			const DirectX::XMFLOAT3& aabbMin = meshlet.boundingInfo.box.aabbMin;
+			const DirectX::XMFLOAT3& aabbMax = meshlet.boundingInfo.box.aabbMax;
+			float extent[3] = {aabbMax.x - aabbMin.x, aabbMax.y - aabbMin.y, aabbMax.z - aabbMin.z};
+
+			// 最も薄い軸を法線とする四角形にする
+			int thin = (extent[0] < extent[1]) ? ((extent[0] < extent[2]) ? 0 : 2) : ((extent[1] < extent[2]) ? 1 : 2);
+			int a = (thin + 1) % 3, b = (thin + 2) % 3;
+			float minSide = std::min(extent[a], extent[b]);
+			if (minSide < minExtent || extent[thin] > minSide * kThinRatio)
+			{
+				continue;
+			}
+
+			float center[3] = {(aabbMin.x + aabbMax.x) * 0.5f, (aabbMin.y + aabbMax.y) * 0.5f, (aabbMin.z + aabbMax.z) * 0.5f};
+			float halfA = extent[a] * 0.5f * kProxyScale;
+			float halfB = extent[b] * 0.5f * kProxyScale;
+			static const float kSigns[4][2] = {{-1.0f, -1.0f}, {1.0f, -1.0f}, {1.0f, 1.0f}, {-1.0f, 1.0f}};
+
+			sl12::u32 base = (sl12::u32)outMesh.positions.size();
+			for (auto&& sign : kSigns)
+			{
+				float p[3] = {center[0], center[1], center[2]};
+				p[a] += halfA * sign[0];
+				p[b] += halfB * sign[1];
+				outMesh.positions.push_back(DirectX::XMFLOAT3(p[0], p[1], p[2]));
+			}
+			static const sl12::u32 kQuadIndices[] = {0, 1, 2, 0, 2, 3};
+			for (auto index : kQuadIndices)
+			{
+				outMesh.indices.push_back(base + index);
+			}
+		}
+	}
+}
+
+
+//----
+void SoftwareOcclusionBuffer::Initialize(sl12::u32 width, sl12::u32 height)
+{
+	tileCountX_ = (width + kTileWidth - 1) / kTileWidth;
+	tileCountY_ = (height + kTileHeight - 1) / kTileHeight;
+	width_ = tileCountX_ * kTileWidth;
+	height_ = tileCountY_ * kTileHeight;
+	depth_.resize(width_ * height_);
+	tileFarZ_.resize(tileCountX_ * tileCountY_);
+	tileDirty_.resize(tileCountX_ * tileCountY_);
+	Clear();
+}
+
+//----
+void SoftwareOcclusionBuffer::Clear()
+{
+	std::fill(depth_.begin(), depth_.end(), 0.0f);
+	std::fill(tileFarZ_.begin(), tileFarZ_.end(), 0.0f);
+	std::fill(tileDirty_.begin(), tileDirty_.end(), false);
+	bTilesDirty_ = false;
+	stats_ = Stats();
+}
+
+//----
+void SoftwareOcclusionBuffer::RenderOccluder(const OccluderMesh& mesh, const DirectX::XMMATRIX& mtxLocalToProj)
+{
+	if (mesh.IsEmpty() || width_ == 0)
+	{
+		return;
+	}
+	stats_.occluderCount++;
+
+	std::vector<DirectX::XMFLOAT4> clipPositions(mesh.positions.size());
+	for (size_t i = 0; i < mesh.positions.size(); i++)
+	{
+		DirectX::XMStoreFloat4(&clipPositions[i], DirectX::XMVector3Transform(DirectX::XMLoadFloat3(&mesh.positions[i]), mtxLocalToProj));
+	}
+	for (size_t i = 0; i + 2 < mesh.indices.size(); i += 3)
+	{
+		RasterizeTriangle(clipPositions[mesh.indices[i + 0]], clipPositions[mesh.indices[i + 1]], clipPositions[mesh.indices[i + 2]]);
+	}
+}
+
+//----
+void SoftwareOcclusionBuffer::RasterizeTriangle(const DirectX::XMFLOAT4& c0, const DirectX::XMFLOAT4& c1, const DirectX::XMFLOAT4& c2)
+{
+	// near面と交差する三角形はクリップせずに捨てる (オクルーダーが減るだけなので安全側)
+	const DirectX::XMFLOAT4* clips[3] = {&c0, &c1, &c2};
+	float px[3], py[3], pz[3];
+	for (int i = 0; i < 3; i++)
+	{
+		if (clips[i]->w <= FLT_EPSILON)
+		{
+			return;
+		}
+		float invW = 1.0f / clips[i]->w;
+		px[i] = (clips[i]->x * invW * 0.5f + 0.5f) * (float)width_;
+		py[i] = (clips[i]->y * invW * -0.5f + 0.5f) * (float)height_;
+		pz[i] = clips[i]->z * invW;
+	}
+
+	// 両面描画とし、面積が正になるように頂点を並べ替える
+	float area = (px[1] - px[0]) * (py[2] - py[0]) - (py[1] - py[0]) * (px[2] - px[0]);
+	if (std::abs(area) < FLT_EPSILON)
+	{
+		return;
+	}
+	if (area < 0.0f)
+	{
+		std::swap(px[1], px[2]);
+		std::swap(py[1], py[2]);
+		std::swap(pz[1], pz[2]);
+		area = -area;
+	}
+
+	int minX = std::max((int)std::floor(std::min({px[0], px[1], px[2]})), 0);
+	int maxX = std::min((int)std::ceil(std::max({px[0], px[1], px[2]})), (int)width_) - 1;
+	int minY = std::max((int)std::floor(std::min({py[0], py[1], py[2]})), 0);
+	int maxY = std::min((int)std::ceil(std::max({py[0], py[1], py[2]})), (int)height_) - 1;
+	if (minX > maxX || minY > maxY)
+	{
+		return;
+	}
+	stats_.triangleCount++;
+
+	// エッジ関数 E(x, y) = A * x + B * y + C、三角形の内側で正
+	// 対辺のエッジ関数を面積で割ったものが重心座標になる
+	float edgeA[3], edgeB[3], edgeC[3];
+	for (int i = 0; i < 3; i++)
+	{
+		int j = (i + 1) % 3;
+		edgeA[i] = py[i] - py[j];
+		edgeB[i] = px[j] - px[i];
+		edgeC[i] = -(edgeA[i] * px[i] + edgeB[i] * py[i]);
+	}
+	float invArea = 1.0f / area;
+	float dzdx = (edgeA[1] * pz[0] + edgeA[2] * pz[1] + edgeA[0] * pz[2]) * invArea;
+	float dzdy = (edgeB[1] * pz[0] + edgeB[2] * pz[1] + edgeB[0] * pz[2]) * invArea;
+	float z0 = (edgeC[1] * pz[0] + edgeC[2] * pz[1] + edgeC[0] * pz[2]) * invArea;
+	// ピクセル中心の深度をピクセル内で最も遠い深度まで下げる
+	z0 -= (std::abs(dzdx) + std::abs(dzdy)) * 0.5f;
+
+	// 横4ピクセルをまとめて処理する
+	// 幅はタイル幅の倍数なので、4ピクセル単位で読み書きしても範囲外にならない
+	const DirectX::XMVECTOR kLaneOffset = DirectX::XMVectorSet(0.5f, 1.5f, 2.5f, 3.5f);
+	const DirectX::XMVECTOR kZero = DirectX::XMVectorZero();
+	const DirectX::XMVECTOR kOne = DirectX::XMVectorSplatOne();
+	DirectX::XMVECTOR vA[3], vDzdx = DirectX::XMVectorReplicate(dzdx);
+	for (int i = 0; i < 3; i++)
+	{
+		vA[i] = DirectX::XMVectorReplicate(edgeA[i]);
+	}
+
+	int startX = minX & ~3;
+	for (int y = minY; y <= maxY; y++)
+	{
+		float cy = (float)y + 0.5f;
+		DirectX::XMVECTOR rowE[3];
+		for (int i = 0; i < 3; i++)
+		{
+			rowE[i] = DirectX::XMVectorReplicate(edgeB[i] * cy + edgeC[i]);
+		}
+		DirectX::XMVECTOR rowZ = DirectX::XMVectorReplicate(dzdy * cy + z0);
+
+		float* pRow = depth_.data() + y * width_;
+		for (int x = startX; x <= maxX; x += 4)
+		{
+			DirectX::XMVECTOR vx = DirectX::XMVectorAdd(DirectX::XMVectorReplicate((float)x), kLaneOffset);
+			DirectX::XMVECTOR inside = DirectX::XMVectorTrueInt();
+			for (int i = 0; i < 3; i++)
+			{
+				DirectX::XMVECTOR e = DirectX::XMVectorMultiplyAdd(vA[i], vx, rowE[i]);
+				inside = DirectX::XMVectorAndInt(inside, DirectX::XMVectorGreaterOrEqual(e, kZero));
+			}
+			if (DirectX::XMVector4EqualInt(inside, DirectX::XMVectorFalseInt()))
+			{
+				continue;
+			}
+
+			DirectX::XMVECTOR z = DirectX::XMVectorClamp(DirectX::XMVectorMultiplyAdd(vDzdx, vx, rowZ), kZero, kOne);
+			DirectX::XMVECTOR old = DirectX::XMLoadFloat4((const DirectX::XMFLOAT4*)(pRow + x));
+			DirectX::XMVECTOR result = DirectX::XMVectorSelect(old, DirectX::XMVectorMax(old, z), inside);
+			DirectX::XMStoreFloat4((DirectX::XMFLOAT4*)(pRow + x), result);
+		}
+	}
+
+	for (int ty = minY / (int)kTileHeight; ty <= maxY / (int)kTileHeight; ty++)
+	{
+		for (int tx = minX / (int)kTileWidth; tx <= maxX / (int)kTileWidth; tx++)
+		{
+			tileDirty_[ty * tileCountX_ + tx] = true;
+		}
+	}
+	bTilesDirty_ = true;
+}
+
+//----
+void SoftwareOcclusionBuffer::UpdateTiles()
+{
+	for (sl12::u32 ty = 0; ty < tileCountY_; ty++)
+	{
+		for (sl12::u32 tx = 0; tx < tileCountX_; tx++)
+		{
+			sl12::u32 tileIndex = ty * tileCountX_ + tx;
+			if (!tileDirty_[tileIndex])
+			{
+				continue;
+			}
+
+			float farZ = 1.0f;
+			for (sl12::u32 y = ty * kTileHeight; y < (ty + 1) * kTileHeight; y++)
+			{
+				const float* pRow = depth_.data() + y * width_ + tx * kTileWidth;
+				farZ = std::min(farZ, *std::min_element(pRow, pRow + kTileWidth));
+			}
+			tileFarZ_[tileIndex] = farZ;
+			tileDirty_[tileIndex] = false;
+		}
+	}
+	bTilesDirty_ = false;
+}
+
+//----
+bool SoftwareOcclusionBuffer::IsOccluded(const DirectX::XMFLOAT3& aabbMin, const DirectX::XMFLOAT3& aabbMax, const DirectX::XMMATRIX& mtxLocalToProj, float nearZ)
+{
+	if (width_ == 0)
+	{
+		return false;
+	}
+	stats_.testCount++;
+
+	// culling.hlsli の ToScreenAABB
+	DirectX::XMFLOAT3 rectMin(FLT_MAX, FLT_MAX, FLT_MAX), rectMax(-FLT_MAX, -FLT_MAX, -FLT_MAX);
+	for (int pointID = 0; pointID < 8; pointID++)
+	{
+		DirectX::XMVECTOR p = DirectX::XMVectorSet(
+			(pointID & 0x04) ? aabbMax.x : aabbMin.x,
+			(pointID & 0x02) ? aabbMax.y : aabbMin.y,
+			(pointID & 0x01) ? aabbMax.z : aabbMin.z,
+			1.0f);
+		DirectX::XMFLOAT4 clip;
+		DirectX::XMStoreFloat4(&clip, DirectX::XMVector4Transform(p, mtxLocalToProj));
+		if (clip.w <= nearZ)
+		{
+			return false;
+		}
+
+		float invW = 1.0f / clip.w;
+		DirectX::XMFLOAT3 sp(clip.x * invW * 0.5f + 0.5f, clip.y * invW * -0.5f + 0.5f, clip.z * invW);
+		rectMin = DirectX::XMFLOAT3(std::min(rectMin.x, sp.x), std::min(rectMin.y, sp.y), std::min(rectMin.z, sp.z));
+		rectMax = DirectX::XMFLOAT3(std::max(rectMax.x, sp.x), std::max(rectMax.y, sp.y), std::max(rectMax.z, sp.z));
+	}
+	if (rectMax.x <= 0.0f || rectMax.y <= 0.0f || rectMin.x >= 1.0f || rectMin.y >= 1.0f)
+	{
+		// 画面外はフラスタムカリングに任せる
+		return false;
+	}
+
+	if (bTilesDirty_)
+	{
+		UpdateTiles();
+	}
+
+	// Reversed-Zなので最も手前の深度はmax
+	float rectZ = std::min(rectMax.z, 1.0f);
+	int px0 = std::clamp((int)std::floor(rectMin.x * (float)width_), 0, (int)width_ - 1);
+	int px1 = std::clamp((int)std::ceil(rectMax.x * (float)width_) - 1, px0, (int)width_ - 1);
+	int py0 = std::clamp((int)std::floor(rectMin.y * (float)height_), 0, (int)height_ - 1);
+	int py1 = std::clamp((int)std::ceil(rectMax.y * (float)height_) - 1, py0, (int)height_ - 1);
+	for (int ty = py0 / (int)kTileHeight; ty <= py1 / (int)kTileHeight; ty++)
+	{
+		for (int tx = px0 / (int)kTileWidth; tx <= px1 / (int)kTileWidth; tx++)
+		{
+			// タイル全体がAABBより手前ならピクセル単位の判定は不要
+			if (rectZ <= tileFarZ_[ty * tileCountX_ + tx] - kDepthEpsilon)
+			{
+				continue;
+			}
+
+			int x0 = std::max(px0, tx * (int)kTileWidth), x1 = std::min(px1, (tx + 1) * (int)kTileWidth - 1);
+			int y0 = std::max(py0, ty * (int)kTileHeight), y1 = std::min(py1, (ty + 1) * (int)kTileHeight - 1);
+			for (int y = y0; y <= y1; y++)
+			{
+				const float* pRow = depth_.data() + y * width_;
+				for (int x = x0; x <= x1; x++)
+				{
+					if (rectZ > pRow[x] - kDepthEpsilon)
+					{
+						return false;
+					}
+				}
+			}
+		}
+	}
+
+	stats_.culledCount++;
+	return true;
+}
+
+//----
+bool SoftwareOcclusionBuffer::DumpDepth(const std::string& filename) const
+{
+	std::ofstream ofs(filename, std::ios::binary);
+	if (!ofs)
+	{
+		sl12::ConsolePrint("Error: failed to open occlusion depth dump file. (%s)\n", filename.c_str());
+		return false;
+	}
+
+	// PFMはリトルエンディアンを負のスケールで表し、下の行から格納する
+	std::string header = "Pf\n" + std::to_string(width_) + " " + std::to_string(height_) + "\n-1.0\n";
+	ofs.write(header.data(), header.size());
+	for (sl12::u32 y = height_; y > 0; y--)
+	{
+		ofs.write((const char*)(depth_.data() + (y - 1) * width_), sizeof(float) * width_);
+	}
+	return true;
+}
+
+//	EOF
@@ -0,0 +1,98 @@
+﻿#pragma once
+
+#include "sl12/resource_mesh.h"
+#include <DirectXMath.h>
+#include <string>
+#include <vector>
+
+
+//----
+// オクルーダーの代理メッシュ (ローカル空間の三角形リスト)
+struct OccluderMesh
+{
+	std::vector<DirectX::XMFLOAT3>	positions;
+	std::vector<sl12::u32>			indices;
+
+	bool IsEmpty() const
+	{
+		return indices.empty();
+	}
+};	// struct OccluderMesh
+
+// ResourceItemMeshのmeshletから代理メッシュを作る
+// CPU側に頂点は残っていないので、薄くて大きなmeshletのAABBを中央平面の四角形として扱う
+// 四角形は穴の影響を減らすために縮小するが、ジオメトリの内側にある保証はなく保守的ではない
+// 実際の三角形から作るまでは実験的な機能として扱い、デフォルトでは無効にする
+// submeshIndicesは不透明なサブメッシュのみを指定する (マスクや半透明は穴があるので対象外)
+void BuildMeshletOccluderProxy(const sl12::ResourceItemMesh* pResMesh, const std::vector<sl12::u32>& submeshIndices, OccluderMesh& outMesh);
+
+//----
+// CPUのソフトウェアオクルージョンバッファ (実験的な機能)
+// 低解像度の深度バッファにオクルーダーをラスタライズし、タイルごとに最も遠い深度を保持する
+// 深度はReversed-Z (0がfar) で、スクリーン座標は culling.hlsli の ToScreenAABB と同じ
+// D3D12に依存しないので、アプリケーション外でも実行できる
+class SoftwareOcclusionBuffer
+{
+public:
+	static const sl12::u32 kTileWidth = 8;
+	static const sl12::u32 kTileHeight = 4;
+
+	struct Stats
+	{
+		sl12::u32	occluderCount = 0;
+		sl12::u32	triangleCount = 0;		// ラスタライズした三角形数
+		sl12::u32	testCount = 0;
+		sl12::u32	culledCount = 0;
+	};	// struct Stats
+
+public:
+	SoftwareOcclusionBuffer()
+	{}
+	~SoftwareOcclusionBuffer()
+	{}
+
+	// サイズはタイルサイズに切り上げる
+	void Initialize(sl12::u32 width, sl12::u32 height);
+	void Clear();
+
+	void RenderOccluder(const OccluderMesh& mesh, const DirectX::XMMATRIX& mtxLocalToProj);
+
+	// ローカル空間のAABBが完全に隠れているならtrue
+	// near面と交差するAABBは隠れていない扱い
+	bool IsOccluded(const DirectX::XMFLOAT3& aabbMin, const DirectX::XMFLOAT3& aabbMax, const DirectX::XMMATRIX& mtxLocalToProj, float nearZ);
+
+	// 深度バッファをPFM形式で出力する
+	bool DumpDepth(const std::string& filename) const;
+
+	sl12::u32 GetWidth() const
+	{
+		return width_;
+	}
+	sl12::u32 GetHeight() const
+	{
+		return height_;
+	}
+	const std::vector<float>& GetDepth() const
+	{
+		return depth_;
+	}
+	const Stats& GetStats() const
+	{
+		return stats_;
+	}
+
+private:
+	void RasterizeTriangle(const DirectX::XMFLOAT4& c0, const DirectX::XMFLOAT4& c1, const DirectX::XMFLOAT4& c2);
+	void UpdateTiles();
+
+private:
+	sl12::u32			width_ = 0, height_ = 0;
+	sl12::u32			tileCountX_ = 0, tileCountY_ = 0;
+	std::vector<float>	depth_;			// ピクセルごとの深度
+	std::vector<float>	tileFarZ_;		// タイル内で最も遠い深度
+	std::vector<bool>	tileDirty_;
+	bool				bTilesDirty_ = false;
+	Stats				stats_;
+};	// class SoftwareOcclusionBuffer
+
+//	EOF
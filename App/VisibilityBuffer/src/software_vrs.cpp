@@ -0,0 +1,175 @@
+﻿#include "software_vrs.h"
+
+#include <random>
+
+
+//----
+sl12::u32 EncodePixelPos(sl12::u32 x, sl12::u32 y, sl12::u32 vrsType)
+{
+	return (vrsType << 28) | (x << 14) | (y << 0);
+}
+
+//----
+void DecodePixelPos(sl12::u32 value, sl12::u32& x, sl12::u32& y, sl12::u32& vrsType)
+{
+	x = (value >> 14) & 0x3FFF;
+	y = value & 0x3FFF;
+	vrsType = (value >> 28) & 0x7;
+}
+
+//----
+sl12::u32 GetSoftwareVrsPixelType(sl12::u32 quadVrsType, sl12::u32 x, sl12::u32 y, const bool* quadValid)
+{
+	sl12::u32 repX = (quadVrsType & kVrs2x1) ? 0 : x;
+	sl12::u32 repY = (quadVrsType & kVrs1x2) ? 0 : y;
+	if (repX == x && repY == y)
+	{
+		return quadVrsType;
+	}
+	// 代表ピクセルが背景なら自分でシェーディングする
+	return quadValid[repY * PIXEL_QUAD_WIDTH + repX] ? kVrsInvalid : kVrs1x1;
+}
+
+//----
+void BinSoftwareVrsQuad(const SoftwareVrsScene& scene, sl12::u32 quadX, sl12::u32 quadY, std::vector<sl12::u32>& outPixelInfos)
+{
+	sl12::u32 leftX = quadX * PIXEL_QUAD_WIDTH;
+	sl12::u32 topY = quadY * PIXEL_QUAD_WIDTH;
+
+	// クアッドは1つのVRSの値を共有する
+	sl12::u32 quadVrsType = scene.vrsImage[quadY * ((scene.width + 1) / 2) + quadX];
+	if (quadVrsType == kVrsInvalid)
+	{
+		quadVrsType = kVrs1x1;
+	}
+
+	bool quadValid[PIXEL_QUAD_WIDTH * PIXEL_QUAD_WIDTH];
+	for (sl12::u32 i = 0; i < PIXEL_QUAD_WIDTH * PIXEL_QUAD_WIDTH; i++)
+	{
+		sl12::u32 x = leftX + i % PIXEL_QUAD_WIDTH;
+		sl12::u32 y = topY + i / PIXEL_QUAD_WIDTH;
+		quadValid[i] = x < scene.width && y < scene.height && scene.depth[y * scene.width + x] > 0.0f;
+	}
+
+	for (sl12::u32 y = 0; y < PIXEL_QUAD_WIDTH; y++)
+	{
+		for (sl12::u32 x = 0; x < PIXEL_QUAD_WIDTH; x++)
+		{
+			if (!quadValid[y * PIXEL_QUAD_WIDTH + x])
+			{
+				continue;
+			}
+			sl12::u32 vrsType = GetSoftwareVrsPixelType(quadVrsType, x, y, quadValid);
+			if (vrsType != kVrsInvalid)
+			{
+				outPixelInfos.push_back(EncodePixelPos(leftX + x, topY + y, vrsType));
+			}
+		}
+	}
+}
+
+//----
+sl12::u32 BroadcastSoftwareVrsPixel(const SoftwareVrsScene& scene, sl12::u32 pixelInfo, sl12::u32* outPixels)
+{
+	sl12::u32 pixelX, pixelY, vrsType;
+	DecodePixelPos(pixelInfo, pixelX, pixelY, vrsType);
+
+	sl12::u32 count = 0;
+	for (sl12::u32 i = 0; i < 4; i++)
+	{
+		sl12::u32 offsetX = i & 0x1;
+		sl12::u32 offsetY = i >> 1;
+		if (offsetX > 0 && !(vrsType & kVrs2x1))
+			continue;
+		if (offsetY > 0 && !(vrsType & kVrs1x2))
+			continue;
+
+		// 画面外と背景には書き込まない
+		sl12::u32 x = pixelX + offsetX;
+		sl12::u32 y = pixelY + offsetY;
+		if (i > 0 && (x >= scene.width || y >= scene.height || scene.depth[y * scene.width + x] <= 0.0f))
+			continue;
+
+		outPixels[count++] = y * scene.width + x;
+	}
+	return count;
+}
+
+//----
+sl12::u32 ValidateSoftwareVrs()
+{
+	const sl12::u32 kSizes[][2] = {
+		{16, 16},
+		{37, 23},
+		{128, 72},
+		{255, 129},
+	};
+	const sl12::u32 kVrsTypes[] = {kVrs1x1, kVrs1x2, kVrs2x1, kVrs2x2, kVrsInvalid};
+
+	std::mt19937 rnd(0x5678);
+	sl12::u32 errorCount = 0;
+	for (auto&& size : kSizes)
+	{
+		// 背景の割合を変える
+		for (sl12::u32 bgRate = 0; bgRate <= 4; bgRate += 2)
+		{
+			SoftwareVrsScene scene;
+			scene.width = size[0];
+			scene.height = size[1];
+			scene.depth.resize(scene.width * scene.height);
+			for (auto&& d : scene.depth)
+			{
+				d = (rnd() % 8 < bgRate) ? 0.0f : 0.5f;
+			}
+			sl12::u32 vrsWidth = (scene.width + 1) / 2;
+			sl12::u32 vrsHeight = (scene.height + 1) / 2;
+			scene.vrsImage.resize(vrsWidth * vrsHeight);
+			for (auto&& v : scene.vrsImage)
+			{
+				v = kVrsTypes[rnd() % (sizeof(kVrsTypes) / sizeof(kVrsTypes[0]))];
+			}
+
+			// binning.
+			std::vector<sl12::u32> pixelInfos;
+			for (sl12::u32 qy = 0; qy < vrsHeight; qy++)
+			{
+				for (sl12::u32 qx = 0; qx < vrsWidth; qx++)
+				{
+					BinSoftwareVrsQuad(scene, qx, qy, pixelInfos);
+				}
+			}
+
+			// broadcast.
+			std::vector<sl12::u32> writeCounts(scene.width * scene.height, 0);
+			for (auto&& info : pixelInfos)
+			{
+				sl12::u32 x, y, vrsType;
+				DecodePixelPos(info, x, y, vrsType);
+				if (EncodePixelPos(x, y, vrsType) != info || vrsType == kVrsInvalid)
+				{
+					errorCount++;
+					continue;
+				}
+
+				sl12::u32 pixels[4];
+				sl12::u32 count = BroadcastSoftwareVrsPixel(scene, info, pixels);
+				for (sl12::u32 i = 0; i < count; i++)
+				{
+					writeCounts[pixels[i]]++;
+				}
+			}
+
+			for (size_t i = 0; i < writeCounts.size(); i++)
+			{
+				sl12::u32 expected = scene.depth[i] > 0.0f ? 1 : 0;
+				if (writeCounts[i] != expected)
+				{
+					errorCount++;
+				}
+			}
+		}
+	}
+	return errorCount;
+}
+
+//	EOF
@@ -0,0 +1,53 @@
+﻿#pragma once
+
+#include "sl12/types.h"
+#include <vector>
+
+#include "../shaders/constant_defs.h"
+
+
+//----
+// タイルビニングのソフトウェアVRS (material_binning.c.hlsl の ProcessPixel と material_tile.c.hlsl の WriteGBuffer のモデル)
+// D3D12に依存しないので、アプリケーション外でも実行できる
+
+// VRSの種類 (vrs.hlsliと合わせる)
+static const sl12::u32 kVrs1x1 = 0x00;
+static const sl12::u32 kVrs1x2 = 0x01;
+static const sl12::u32 kVrs2x1 = 0x04;
+static const sl12::u32 kVrs2x2 = 0x05;
+static const sl12::u32 kVrsInvalid = 0x08;
+
+// ピクセル位置とVRSの種類のエンコード (visibility_buffer.hlsliと合わせる)
+sl12::u32 EncodePixelPos(sl12::u32 x, sl12::u32 y, sl12::u32 vrsType);
+void DecodePixelPos(sl12::u32 value, sl12::u32& x, sl12::u32& y, sl12::u32& vrsType);
+
+// クアッド内のピクセルをシェーディングするときのVRSの種類
+// 代表ピクセルに含まれる場合はkVrsInvalidを返す
+// quadValidはクアッド内のピクセルが背景でないか (y * 2 + x の順)
+sl12::u32 GetSoftwareVrsPixelType(sl12::u32 quadVrsType, sl12::u32 x, sl12::u32 y, const bool* quadValid);
+
+// VRSの間引きを行うシーン
+// depthはwidth * height、vrsImageは1/2解像度 (kVrsInvalidも含む)
+struct SoftwareVrsScene
+{
+	sl12::u32				width = 0;
+	sl12::u32				height = 0;
+	std::vector<float>		depth;
+	std::vector<sl12::u32>	vrsImage;
+};	// struct SoftwareVrsScene
+
+// 1クアッドを処理して、シェーディングするピクセルの情報をoutPixelInfosに追加する
+void BinSoftwareVrsQuad(const SoftwareVrsScene& scene, sl12::u32 quadX, sl12::u32 quadY, std::vector<sl12::u32>& outPixelInfos);
+
+// シェーディング結果を書き込むピクセルを列挙する
+// 戻り値は書き込むピクセル数、outPixelsは y * width + x
+sl12::u32 BroadcastSoftwareVrsPixel(const SoftwareVrsScene& scene, sl12::u32 pixelInfo, sl12::u32* outPixels);
+
+// ランダムなシーンで間引きとブロードキャストを検証する
+//   ・背景でないピクセルにちょうど1回書き込まれる
+//   ・背景のピクセルには書き込まれない
+//   ・ピクセル情報のエンコードとデコードが一致する
+// 戻り値は失敗したピクセル数
+sl12::u32 ValidateSoftwareVrs();
+
+//	EOF
@@ -0,0 +1,416 @@
+﻿#include "transient_alias.h"
+
+#include "sl12/string_util.h"
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <random>
+
+
+namespace
+{
+	static const sl12::u32 kTransientAliasMagic = 0x41544256;	// 'VBTA'
+
+	sl12::u64 AlignTransientSize(sl12::u64 size)
+	{
+		return (size + kTransientAliasAlignment - 1) / kTransientAliasAlignment * kTransientAliasAlignment;
+	}
+
+	sl12::u32 GetTransientHeap(const TransientAliasResource& res, sl12::u32 heapTier)
+	{
+		return (heapTier == 1) ? std::min(res.heapKind, kRenderGraphSimHeapKindCount - 1) : 0;
+	}
+
+	bool IsTransientLifetimeOverlap(const TransientAliasResource& a, const TransientAliasResource& b)
+	{
+		return (a.begin < b.end) && (b.begin < a.end);
+	}
+
+	//----
+	// orderの順番に配置する
+	// bBestFitがtrueなら収まる空きのうち最小のもの、falseなら最も低いオフセットの空きを選ぶ
+	void PlaceTransientInOrder(const TransientAliasTrace& trace, sl12::u32 heapTier, const std::vector<sl12::u32>& order, bool bBestFit, TransientAliasPlacement& outPlacement)
+	{
+		outPlacement = TransientAliasPlacement();
+		outPlacement.offsets.assign(trace.resources.size(), 0);
+
+		std::vector<sl12::u32> placed;
+		std::vector<std::pair<sl12::u64, sl12::u64>> used;
+		placed.reserve(order.size());
+		for (auto index : order)
+		{
+			auto&& res = trace.resources[index];
+			sl12::u64 size = AlignTransientSize(res.size);
+			if (size == 0)
+				continue;
+			sl12::u32 heap = GetTransientHeap(res, heapTier);
+
+			// 生存期間が重なる配置済みリソースが使っている範囲
+			used.clear();
+			for (auto p : placed)
+			{
+				auto&& other = trace.resources[p];
+				if (GetTransientHeap(other, heapTier) == heap && IsTransientLifetimeOverlap(res, other))
+				{
+					sl12::u64 offset = outPlacement.offsets[p];
+					used.push_back(std::make_pair(offset, offset + AlignTransientSize(other.size)));
+				}
+			}
+			std::sort(used.begin(), used.end());
+
+			// 範囲の間の空きを探し、なければ末尾に置く
+			sl12::u64 bestOffset = UINT64_MAX;
+			sl12::u64 bestGap = UINT64_MAX;
+			sl12::u64 cursor = 0;
+			for (auto&& range : used)
+			{
+				if (range.first > cursor)
+				{
+					sl12::u64 gap = range.first - cursor;
+					if (gap >= size && gap < bestGap)
+					{
+						bestOffset = cursor;
+						bestGap = gap;
+						if (!bBestFit)
+							break;
+					}
+				}
+				cursor = std::max(cursor, range.second);
+			}
+			if (bestOffset == UINT64_MAX)
+			{
+				bestOffset = cursor;
+			}
+
+			outPlacement.offsets[index] = bestOffset;
+			outPlacement.heapSizes[heap] = std::max(outPlacement.heapSizes[heap], bestOffset + size);
+			placed.push_back(index);
+		}
+
+		for (auto heapSize : outPlacement.heapSizes)
+		{
+			outPlacement.totalSize += heapSize;
+		}
+	}
+}
+
+//----
+void BuildTransientAliasTrace(const RenderGraphSimGraph& graph, const RenderGraphSimReport& report, TransientAliasTrace& outTrace)
+{
+	outTrace.resources.clear();
+	if (report.resourceBegin.size() != graph.resources.size())
+		return;
+
+	for (size_t r = 0; r < graph.resources.size(); r++)
+	{
+		auto&& simRes = graph.resources[r];
+		if (simRes.bPersistent || simRes.size == 0 || report.resourceBegin[r] >= report.resourceEnd[r])
+			continue;
+
+		TransientAliasResource res;
+		res.name = simRes.name;
+		res.begin = report.resourceBegin[r];
+		res.end = report.resourceEnd[r];
+		res.size = simRes.size;
+		res.heapKind = simRes.heapKind;
+		outTrace.resources.push_back(res);
+	}
+}
+
+//----
+void PlaceTransientFirstFit(const TransientAliasTrace& trace, sl12::u32 heapTier, TransientAliasPlacement& outPlacement)
+{
+	std::vector<sl12::u32> order(trace.resources.size());
+	for (sl12::u32 i = 0; i < (sl12::u32)order.size(); i++)
+		order[i] = i;
+	std::stable_sort(order.begin(), order.end(), [&](sl12::u32 a, sl12::u32 b)
+	{
+		return trace.resources[a].begin < trace.resources[b].begin;
+	});
+	PlaceTransientInOrder(trace, heapTier, order, false, outPlacement);
+}
+
+//----
+void PlaceTransientBestFit(const TransientAliasTrace& trace, sl12::u32 heapTier, TransientAliasPlacement& outPlacement)
+{
+	// 大きいリソースから置くと、小さいリソースが大きいリソースの間の空きに収まる
+	// 同じサイズなら生存期間の長いものを先に置く
+	std::vector<sl12::u32> order(trace.resources.size());
+	for (sl12::u32 i = 0; i < (sl12::u32)order.size(); i++)
+		order[i] = i;
+	std::stable_sort(order.begin(), order.end(), [&](sl12::u32 a, sl12::u32 b)
+	{
+		auto&& ra = trace.resources[a];
+		auto&& rb = trace.resources[b];
+		sl12::u64 sa = AlignTransientSize(ra.size);
+		sl12::u64 sb = AlignTransientSize(rb.size);
+		if (sa != sb)
+			return sa > sb;
+		float la = ra.end - ra.begin;
+		float lb = rb.end - rb.begin;
+		if (la != lb)
+			return la > lb;
+		return ra.begin < rb.begin;
+	});
+	PlaceTransientInOrder(trace, heapTier, order, true, outPlacement);
+}
+
+//----
+sl12::u64 CalcTransientAliasLowerBound(const TransientAliasTrace& trace, sl12::u32 heapTier, sl12::u64* outHeapSizes)
+{
+	sl12::u64 heapSizes[kRenderGraphSimHeapKindCount] = {};
+	for (auto&& res : trace.resources)
+	{
+		// 生存期間の開始時点で同時に生存しているリソースの合計
+		sl12::u32 heap = GetTransientHeap(res, heapTier);
+		sl12::u64 live = 0;
+		for (auto&& other : trace.resources)
+		{
+			if (GetTransientHeap(other, heapTier) == heap && other.begin <= res.begin && res.begin < other.end)
+				live += AlignTransientSize(other.size);
+		}
+		heapSizes[heap] = std::max(heapSizes[heap], live);
+	}
+
+	sl12::u64 total = 0;
+	for (sl12::u32 i = 0; i < kRenderGraphSimHeapKindCount; i++)
+	{
+		total += heapSizes[i];
+		if (outHeapSizes)
+			outHeapSizes[i] = heapSizes[i];
+	}
+	return total;
+}
+
+//----
+sl12::u32 CountTransientAliasConflicts(const TransientAliasTrace& trace, sl12::u32 heapTier, const TransientAliasPlacement& placement)
+{
+	if (placement.offsets.size() != trace.resources.size())
+		return (sl12::u32)trace.resources.size();
+
+	sl12::u32 conflicts = 0;
+	const size_t count = trace.resources.size();
+	for (size_t i = 0; i < count; i++)
+	{
+		auto&& a = trace.resources[i];
+		sl12::u64 sizeA = AlignTransientSize(a.size);
+		if (sizeA == 0)
+			continue;
+		sl12::u32 heap = GetTransientHeap(a, heapTier);
+		sl12::u64 beginA = placement.offsets[i];
+		if (beginA % kTransientAliasAlignment != 0 || beginA + sizeA > placement.heapSizes[heap])
+			conflicts++;
+
+		for (size_t j = i + 1; j < count; j++)
+		{
+			auto&& b = trace.resources[j];
+			sl12::u64 sizeB = AlignTransientSize(b.size);
+			if (sizeB == 0 || GetTransientHeap(b, heapTier) != heap || !IsTransientLifetimeOverlap(a, b))
+				continue;
+			sl12::u64 beginB = placement.offsets[j];
+			if (beginA < beginB + sizeB && beginB < beginA + sizeA)
+				conflicts++;
+		}
+	}
+	return conflicts;
+}
+
+//----
+void ReportTransientAlias(const TransientAliasTrace& trace, sl12::u32 heapTier, TransientAliasReport& outReport)
+{
+	TransientAliasPlacement placement;
+	PlaceTransientFirstFit(trace, heapTier, placement);
+	outReport.firstFit = placement.totalSize;
+	PlaceTransientBestFit(trace, heapTier, placement);
+	outReport.bestFit = placement.totalSize;
+	outReport.lowerBound = CalcTransientAliasLowerBound(trace, heapTier);
+	outReport.resourceCount = (sl12::u32)trace.resources.size();
+}
+
+//----
+bool SaveTransientAliasTrace(const std::string& filename, const TransientAliasTrace& trace)
+{
+	std::ofstream ofs(filename, std::ios::binary);
+	if (!ofs)
+	{
+		sl12::ConsolePrint("Error: failed to open transient trace file. (%s)\n", filename.c_str());
+		return false;
+	}
+
+	sl12::u32 header[] = {kTransientAliasMagic, (sl12::u32)trace.resources.size()};
+	ofs.write((const char*)header, sizeof(header));
+	for (auto&& res : trace.resources)
+	{
+		sl12::u32 nameLength = (sl12::u32)res.name.size();
+		ofs.write((const char*)&nameLength, sizeof(nameLength));
+		ofs.write(res.name.data(), nameLength);
+		ofs.write((const char*)&res.begin, sizeof(res.begin));
+		ofs.write((const char*)&res.end, sizeof(res.end));
+		ofs.write((const char*)&res.size, sizeof(res.size));
+		ofs.write((const char*)&res.heapKind, sizeof(res.heapKind));
+	}
+	return true;
+}
+
+//----
+bool LoadTransientAliasTrace(const std::string& filename, TransientAliasTrace& outTrace)
+{
+	std::ifstream ifs(filename, std::ios::binary);
+	if (!ifs)
+	{
+		return false;
+	}
+
+	sl12::u32 header[2];
+	ifs.read((char*)header, sizeof(header));
+	if (!ifs || header[0] != kTransientAliasMagic)
+	{
+		sl12::ConsolePrint("Error: invalid transient trace file. (%s)\n", filename.c_str());
+		return false;
+	}
+
+	outTrace.resources.resize(header[1]);
+	for (auto&& res : outTrace.resources)
+	{
+		sl12::u32 nameLength = 0;
+		ifs.read((char*)&nameLength, sizeof(nameLength));
+		if (!ifs)
+		{
+			break;
+		}
+		res.name.resize(nameLength);
+		ifs.read(&res.name[0], nameLength);
+		ifs.read((char*)&res.begin, sizeof(res.begin));
+		ifs.read((char*)&res.end, sizeof(res.end));
+		ifs.read((char*)&res.size, sizeof(res.size));
+		ifs.read((char*)&res.heapKind, sizeof(res.heapKind));
+	}
+	if (!ifs)
+	{
+		sl12::ConsolePrint("Error: transient trace file is truncated. (%s)\n", filename.c_str());
+		return false;
+	}
+	return true;
+}
+
+//----
+sl12::u32 ValidateTransientAlias(const std::string& traceFile)
+{
+	sl12::u32 errorCount = 0;
+	const sl12::u64 kUnit = kTransientAliasAlignment;
+	auto AddResource = [](TransientAliasTrace& trace, const char* name, float begin, float end, sl12::u64 size, sl12::u32 heapKind)
+	{
+		TransientAliasResource res;
+		res.name = name;
+		res.begin = begin;
+		res.end = end;
+		res.size = size;
+		res.heapKind = heapKind;
+		trace.resources.push_back(res);
+	};
+
+	// 先着順では小さい空きが残って使えなくなる
+	{
+		TransientAliasTrace trace;
+		AddResource(trace, "X", 0.0f, 1.0f, kUnit, kRenderGraphSimHeapTexture);
+		AddResource(trace, "Y", 0.0f, 3.0f, kUnit, kRenderGraphSimHeapTexture);
+		AddResource(trace, "Z", 1.0f, 3.0f, kUnit * 2, kRenderGraphSimHeapTexture);
+		TransientAliasPlacement first, best;
+		PlaceTransientFirstFit(trace, 1, first);
+		PlaceTransientBestFit(trace, 1, best);
+		if (first.totalSize != kUnit * 4 || best.totalSize != kUnit * 3 || CalcTransientAliasLowerBound(trace, 1) != kUnit * 3)
+			errorCount++;
+		if (CountTransientAliasConflicts(trace, 1, first) != 0 || CountTransientAliasConflicts(trace, 1, best) != 0)
+			errorCount++;
+	}
+
+	// Tier1では種類の異なるリソースはエイリアスできない
+	// サイズはアライメントに切り上げる
+	{
+		TransientAliasTrace trace;
+		AddResource(trace, "Buffer", 0.0f, 1.0f, kUnit * 2 - 16, kRenderGraphSimHeapBuffer);
+		AddResource(trace, "Texture", 1.0f, 2.0f, kUnit * 3, kRenderGraphSimHeapTexture);
+		TransientAliasPlacement tier1, tier2;
+		PlaceTransientBestFit(trace, 1, tier1);
+		PlaceTransientBestFit(trace, 2, tier2);
+		if (tier1.totalSize != kUnit * 5 || tier1.heapSizes[kRenderGraphSimHeapBuffer] != kUnit * 2 || tier2.totalSize != kUnit * 3)
+			errorCount++;
+	}
+
+	// ランダムなトレース
+	{
+		std::mt19937 rng(1234);
+		std::uniform_real_distribution<float> timeDist(0.0f, 100.0f);
+		std::uniform_int_distribution<sl12::u32> sizeDist(1, 64 * 1024 * 1024);
+		std::uniform_int_distribution<sl12::u32> kindDist(0, kRenderGraphSimHeapKindCount - 1);
+		for (int t = 0; t < 8; t++)
+		{
+			TransientAliasTrace trace;
+			for (int i = 0; i < 200; i++)
+			{
+				float a = timeDist(rng);
+				float b = timeDist(rng);
+				AddResource(trace, "R", std::min(a, b), std::max(a, b) + 0.5f, sizeDist(rng), kindDist(rng));
+			}
+			for (sl12::u32 tier = 1; tier <= 2; tier++)
+			{
+				TransientAliasPlacement first, best;
+				PlaceTransientFirstFit(trace, tier, first);
+				PlaceTransientBestFit(trace, tier, best);
+				sl12::u64 bound = CalcTransientAliasLowerBound(trace, tier);
+				if (CountTransientAliasConflicts(trace, tier, first) != 0 || CountTransientAliasConflicts(trace, tier, best) != 0)
+					errorCount++;
+				if (first.totalSize < bound || best.totalSize < bound)
+					errorCount++;
+			}
+		}
+	}
+
+	// 保存と読み込み
+	{
+		TransientAliasTrace trace, loaded;
+		AddResource(trace, "GBufferA", 1.0f, 5.0f, kUnit * 3, kRenderGraphSimHeapRTDS);
+		AddResource(trace, "DrawFlag", 0.0f, 2.0f, 1024, kRenderGraphSimHeapBuffer);
+		const char* kTempFile = "transient_trace_validate.bin";
+		if (!SaveTransientAliasTrace(kTempFile, trace) || !LoadTransientAliasTrace(kTempFile, loaded) || loaded.resources.size() != trace.resources.size())
+		{
+			errorCount++;
+		}
+		else
+		{
+			for (size_t i = 0; i < trace.resources.size(); i++)
+			{
+				auto&& a = trace.resources[i];
+				auto&& b = loaded.resources[i];
+				if (a.name != b.name || a.begin != b.begin || a.end != b.end || a.size != b.size || a.heapKind != b.heapKind)
+					errorCount++;
+			}
+		}
+		std::remove(kTempFile);
+	}
+
+	// 記録したトレース
+	TransientAliasTrace recorded;
+	if (!traceFile.empty() && LoadTransientAliasTrace(traceFile, recorded))
+	{
+		for (sl12::u32 tier = 1; tier <= 2; tier++)
+		{
+			TransientAliasPlacement first, best;
+			PlaceTransientFirstFit(recorded, tier, first);
+			PlaceTransientBestFit(recorded, tier, best);
+			sl12::u64 bound = CalcTransientAliasLowerBound(recorded, tier);
+			if (CountTransientAliasConflicts(recorded, tier, first) != 0 || CountTransientAliasConflicts(recorded, tier, best) != 0)
+				errorCount++;
+			if (best.totalSize < bound)
+				errorCount++;
+			sl12::ConsolePrint("Transient trace (tier %u, %u resources) : first fit %.2f MB, best fit %.2f MB, lower bound %.2f MB\n",
+				tier, (sl12::u32)recorded.resources.size(),
+				(double)first.totalSize / 1024.0 / 1024.0, (double)best.totalSize / 1024.0 / 1024.0, (double)bound / 1024.0 / 1024.0);
+		}
+	}
+
+	return errorCount;
+}
+
+//	EOF
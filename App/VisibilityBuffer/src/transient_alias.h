@@ -0,0 +1,80 @@
+﻿#pragma once
+
+#include "render_graph_sim.h"
+#include <string>
+#include <vector>
+
+
+//----
+// トランジェントリソースの配置
+// 生存期間の区間が重ならないリソースは同じメモリを使えるので、
+// 区間グラフの上でヒープ内のオフセットを決めてピークのヒープサイズを小さくする
+// D3D12に依存しないので、アプリケーション外でも実行できる
+
+// 配置済みリソースのアライメント (D3D12のデフォルトの配置アライメント)
+static const sl12::u64 kTransientAliasAlignment = 64 * 1024;
+
+struct TransientAliasResource
+{
+	std::string		name;
+	float			begin = 0.0f;		// 生存期間 [begin, end)
+	float			end = 0.0f;
+	sl12::u64		size = 0;
+	sl12::u32		heapKind = kRenderGraphSimHeapBuffer;
+};	// struct TransientAliasResource
+
+// 1フレーム分のトランジェントリソースの生存期間
+struct TransientAliasTrace
+{
+	std::vector<TransientAliasResource>	resources;
+};	// struct TransientAliasTrace
+
+// heapTier
+//   1 : ヒープの種類 (バッファ、テクスチャ、RT/DS) ごとに別のヒープに配置する
+//   2 : 全てのリソースを1つのヒープに配置する (heapSizes[0]のみ使う)
+struct TransientAliasPlacement
+{
+	std::vector<sl12::u64>	offsets;		// リソースごとのヒープ内オフセット
+	sl12::u64				heapSizes[kRenderGraphSimHeapKindCount] = {};
+	sl12::u64				totalSize = 0;
+};	// struct TransientAliasPlacement
+
+// シミュレーション結果の生存期間からトレースを作る
+// 永続リソース、未使用のリソース、サイズ0のリソースは含めない
+void BuildTransientAliasTrace(const RenderGraphSimGraph& graph, const RenderGraphSimReport& report, TransientAliasTrace& outTrace);
+
+// 生存期間の開始順に、最も低いオフセットの空きに配置する (要求順に確保するアロケータ相当)
+void PlaceTransientFirstFit(const TransientAliasTrace& trace, sl12::u32 heapTier, TransientAliasPlacement& outPlacement);
+// サイズの大きい順に、生存期間が重なるリソースの間の最も小さい空きに配置する
+void PlaceTransientBestFit(const TransientAliasTrace& trace, sl12::u32 heapTier, TransientAliasPlacement& outPlacement);
+
+// 同時に生存するリソースのサイズの合計の最大 (どの配置でもこれより小さくならない)
+sl12::u64 CalcTransientAliasLowerBound(const TransientAliasTrace& trace, sl12::u32 heapTier, sl12::u64* outHeapSizes = nullptr);
+
+// 生存期間とメモリが両方重なるリソースの組と、ヒープからはみ出すリソースの数
+sl12::u32 CountTransientAliasConflicts(const TransientAliasTrace& trace, sl12::u32 heapTier, const TransientAliasPlacement& placement);
+
+// 配置前後のピークサイズ
+struct TransientAliasReport
+{
+	sl12::u64	firstFit = 0;
+	sl12::u64	bestFit = 0;
+	sl12::u64	lowerBound = 0;
+	sl12::u32	resourceCount = 0;
+};	// struct TransientAliasReport
+
+void ReportTransientAlias(const TransientAliasTrace& trace, sl12::u32 heapTier, TransientAliasReport& outReport);
+
+bool SaveTransientAliasTrace(const std::string& filename, const TransientAliasTrace& trace);
+bool LoadTransientAliasTrace(const std::string& filename, TransientAliasTrace& outTrace);
+
+// 配置を検証する
+//   ・断片化で先着順の配置が下限を超えるケース
+//   ・ヒープTierによる配置の違い
+//   ・ランダムなトレースで重なりがなく、下限以上であること
+//   ・トレースの保存と読み込み
+//   ・traceFileが読み込めれば、記録したトレースで重なりがないこと
+// 戻り値は失敗したケース数
+sl12::u32 ValidateTransientAlias(const std::string& traceFile);
+
+//	EOF
@@ -0,0 +1,644 @@
+﻿#include "virtual_shadow_map.h"
+
+#include "sl12/string_util.h"
+#include <algorithm>
+#include <cmath>
+
+
+namespace
+{
+	DirectX::XMFLOAT4 NormalizePlane(float x, float y, float z, float w)
+	{
+		float len = std::sqrt(x * x + y * y + z * z);
+		float inv = (len > 0.0f) ? 1.0f / len : 0.0f;
+		return DirectX::XMFLOAT4(x * inv, y * inv, z * inv, w * inv);
+	}
+}
+
+//----
+void VirtualShadowPageTable::Initialize(sl12::u32 pageCountX, sl12::u32 physicalPageCount)
+{
+	pageCountX_ = pageCountX;
+	virtualToPhysical_.assign(pageCountX * pageCountX, kVsmInvalidPage);
+	physicalToVirtual_.assign(physicalPageCount, kVsmInvalidPage);
+	lastUsedFrame_.assign(physicalPageCount, 0);
+	dirty_.assign(physicalPageCount, 0);
+	rendered_.assign(physicalPageCount, 0);
+	dirtySerial_.assign(physicalPageCount, 0);
+	dirtySerialCounter_ = 0;
+	lruPrev_.assign(physicalPageCount, kVsmInvalidPage);
+	lruNext_.assign(physicalPageCount, kVsmInvalidPage);
+	lruHead_ = lruTail_ = kVsmInvalidPage;
+
+	// 0番から使われるように逆順に積む
+	freePages_.resize(physicalPageCount);
+	for (sl12::u32 i = 0; i < physicalPageCount; i++)
+	{
+		freePages_[i] = physicalPageCount - 1 - i;
+	}
+
+	frameIndex_ = 0;
+	stats_ = Stats();
+}
+
+//----
+void VirtualShadowPageTable::CompactRequests(const sl12::u32* requestBits, sl12::u32 pageCount, std::vector<sl12::u32>& outPages)
+{
+	outPages.clear();
+	sl12::u32 wordCount = (pageCount + 31) / 32;
+	for (sl12::u32 w = 0; w < wordCount; w++)
+	{
+		sl12::u32 bits = requestBits[w];
+		for (sl12::u32 b = 0; bits != 0; b++, bits >>= 1)
+		{
+			sl12::u32 page = w * 32 + b;
+			if ((bits & 0x01) && page < pageCount)
+			{
+				outPages.push_back(page);
+			}
+		}
+	}
+}
+
+//----
+void VirtualShadowPageTable::Update(const std::vector<sl12::u32>& requestedPages, sl12::u64 frameIndex)
+{
+	frameIndex_ = frameIndex;
+	stats_.requestedPages = (sl12::u32)requestedPages.size();
+	stats_.allocatedPages = 0;
+	stats_.evictedPages = 0;
+	stats_.overflowPages = 0;
+	stats_.renderedPages = 0;
+
+	// 割り当て済みのページを先にLRUの末尾に移動し、このフレームで追い出されないようにする
+	for (auto page : requestedPages)
+	{
+		sl12::u32 phys = virtualToPhysical_[page];
+		if (phys != kVsmInvalidPage)
+		{
+			lastUsedFrame_[phys] = frameIndex;
+			LruRemove(phys);
+			LruPushBack(phys);
+		}
+	}
+
+	for (auto page : requestedPages)
+	{
+		if (virtualToPhysical_[page] != kVsmInvalidPage)
+		{
+			continue;
+		}
+
+		sl12::u32 phys;
+		if (!freePages_.empty())
+		{
+			phys = freePages_.back();
+			freePages_.pop_back();
+		}
+		else
+		{
+			// 最も古いページがこのフレームで使われているなら、全ての物理ページが使用中
+			phys = lruHead_;
+			if (phys == kVsmInvalidPage || lastUsedFrame_[phys] == frameIndex)
+			{
+				stats_.overflowPages++;
+				continue;
+			}
+			LruRemove(phys);
+			virtualToPhysical_[physicalToVirtual_[phys]] = kVsmInvalidPage;
+			stats_.evictedPages++;
+		}
+
+		virtualToPhysical_[page] = phys;
+		physicalToVirtual_[phys] = page;
+		lastUsedFrame_[phys] = frameIndex;
+		// 追い出したページが描画待ちでも、新しいページとして順番を付け直す
+		dirty_[phys] = 1;
+		dirtySerial_[phys] = dirtySerialCounter_++;
+		rendered_[phys] = 0;
+		LruPushBack(phys);
+		stats_.allocatedPages++;
+	}
+
+	stats_.residentPages = GetPhysicalPageCount() - (sl12::u32)freePages_.size();
+	stats_.dirtyPages = (sl12::u32)std::count(dirty_.begin(), dirty_.end(), (sl12::u8)1);
+}
+
+//----
+void VirtualShadowPageTable::InvalidateAll()
+{
+	for (sl12::u32 phys = 0; phys < GetPhysicalPageCount(); phys++)
+	{
+		if (physicalToVirtual_[phys] != kVsmInvalidPage)
+		{
+			MarkDirty(phys);
+		}
+	}
+	stats_.dirtyPages = stats_.residentPages;
+}
+
+//----
+void VirtualShadowPageTable::InvalidateRect(sl12::u32 x0, sl12::u32 y0, sl12::u32 x1, sl12::u32 y1)
+{
+	x1 = std::min(x1, pageCountX_ - 1);
+	y1 = std::min(y1, pageCountX_ - 1);
+	for (sl12::u32 y = y0; y <= y1; y++)
+	{
+		for (sl12::u32 x = x0; x <= x1; x++)
+		{
+			sl12::u32 phys = virtualToPhysical_[y * pageCountX_ + x];
+			if (phys != kVsmInvalidPage && !dirty_[phys])
+			{
+				MarkDirty(phys);
+				stats_.dirtyPages++;
+			}
+		}
+	}
+}
+
+//----
+void VirtualShadowPageTable::Reset()
+{
+	Initialize(pageCountX_, GetPhysicalPageCount());
+}
+
+//----
+sl12::u32 VirtualShadowPageTable::TakeDirtyPages(sl12::u32 maxCount, std::vector<RenderPage>& outPages)
+{
+	outPages.clear();
+
+	// 描画待ちになった順に並べる
+	// 同じページばかりが選ばれると、予算を超えた分のページがいつまでも描画されない
+	dirtyPages_.clear();
+	for (sl12::u32 phys = 0; phys < GetPhysicalPageCount(); phys++)
+	{
+		if (dirty_[phys])
+		{
+			dirtyPages_.push_back(phys);
+		}
+	}
+	size_t takeCount = std::min((size_t)maxCount, dirtyPages_.size());
+	std::partial_sort(dirtyPages_.begin(), dirtyPages_.begin() + takeCount, dirtyPages_.end(),
+		[this](sl12::u32 a, sl12::u32 b) { return dirtySerial_[a] < dirtySerial_[b]; });
+
+	for (size_t i = 0; i < takeCount; i++)
+	{
+		sl12::u32 phys = dirtyPages_[i];
+		outPages.push_back({physicalToVirtual_[phys], phys});
+		dirty_[phys] = 0;
+		rendered_[phys] = 1;
+	}
+	stats_.renderedPages = (sl12::u32)outPages.size();
+	stats_.dirtyPages -= stats_.renderedPages;
+	return stats_.renderedPages;
+}
+
+//----
+void VirtualShadowPageTable::BuildGpuPageTable(std::vector<sl12::u32>& outTable) const
+{
+	outTable.assign(virtualToPhysical_.size(), 0);
+	for (sl12::u32 phys = 0; phys < GetPhysicalPageCount(); phys++)
+	{
+		sl12::u32 page = physicalToVirtual_[phys];
+		if (page != kVsmInvalidPage && rendered_[phys])
+		{
+			outTable[page] = phys | VSM_PAGE_VALID_BIT;
+		}
+	}
+}
+
+//----
+sl12::u32 VirtualShadowPageTable::Validate() const
+{
+	sl12::u32 errorCount = 0;
+	sl12::u32 physicalCount = GetPhysicalPageCount();
+
+	// 一対一の対応
+	for (sl12::u32 page = 0; page < (sl12::u32)virtualToPhysical_.size(); page++)
+	{
+		sl12::u32 phys = virtualToPhysical_[page];
+		if (phys != kVsmInvalidPage && (phys >= physicalCount || physicalToVirtual_[phys] != page))
+		{
+			errorCount++;
+		}
+	}
+	for (sl12::u32 phys = 0; phys < physicalCount; phys++)
+	{
+		sl12::u32 page = physicalToVirtual_[phys];
+		if (page != kVsmInvalidPage && (page >= (sl12::u32)virtualToPhysical_.size() || virtualToPhysical_[page] != phys))
+		{
+			errorCount++;
+		}
+	}
+
+	// LRUリストは割り当て済みのページ、空きリストは未割り当てのページ
+	std::vector<sl12::u8> visited(physicalCount, 0);
+	sl12::u32 prev = kVsmInvalidPage;
+	for (sl12::u32 phys = lruHead_; phys != kVsmInvalidPage; phys = lruNext_[phys])
+	{
+		if (phys >= physicalCount || visited[phys] || lruPrev_[phys] != prev || physicalToVirtual_[phys] == kVsmInvalidPage)
+		{
+			errorCount++;
+			break;
+		}
+		visited[phys] = 1;
+		prev = phys;
+	}
+	if (prev != lruTail_)
+	{
+		errorCount++;
+	}
+	for (auto phys : freePages_)
+	{
+		if (phys >= physicalCount || visited[phys] || physicalToVirtual_[phys] != kVsmInvalidPage)
+		{
+			errorCount++;
+			continue;
+		}
+		visited[phys] = 1;
+	}
+	if (std::count(visited.begin(), visited.end(), (sl12::u8)1) != (ptrdiff_t)physicalCount)
+	{
+		errorCount++;
+	}
+
+	return errorCount;
+}
+
+//----
+void VirtualShadowPageTable::MarkDirty(sl12::u32 physicalPage)
+{
+	// 描画待ちのページは順番を変えない
+	if (!dirty_[physicalPage])
+	{
+		dirty_[physicalPage] = 1;
+		dirtySerial_[physicalPage] = dirtySerialCounter_++;
+	}
+}
+
+//----
+void VirtualShadowPageTable::LruRemove(sl12::u32 physicalPage)
+{
+	sl12::u32 prev = lruPrev_[physicalPage];
+	sl12::u32 next = lruNext_[physicalPage];
+	if (prev != kVsmInvalidPage)
+	{
+		lruNext_[prev] = next;
+	}
+	else if (lruHead_ == physicalPage)
+	{
+		lruHead_ = next;
+	}
+	if (next != kVsmInvalidPage)
+	{
+		lruPrev_[next] = prev;
+	}
+	else if (lruTail_ == physicalPage)
+	{
+		lruTail_ = prev;
+	}
+	lruPrev_[physicalPage] = lruNext_[physicalPage] = kVsmInvalidPage;
+}
+
+//----
+void VirtualShadowPageTable::LruPushBack(sl12::u32 physicalPage)
+{
+	lruPrev_[physicalPage] = lruTail_;
+	lruNext_[physicalPage] = kVsmInvalidPage;
+	if (lruTail_ != kVsmInvalidPage)
+	{
+		lruNext_[lruTail_] = physicalPage;
+	}
+	else
+	{
+		lruHead_ = physicalPage;
+	}
+	lruTail_ = physicalPage;
+}
+
+//----
+void CalcVirtualShadowProjection(const DirectX::XMFLOAT3& lightDir, const DirectX::XMFLOAT3& sceneAABBMin, const DirectX::XMFLOAT3& sceneAABBMax,
+	DirectX::XMFLOAT4X4& outWorldToClip)
+{
+	// シーンAABBを囲む球に合わせるので、ライトの向きでサイズが変わらない
+	auto aabbMin = DirectX::XMLoadFloat3(&sceneAABBMin);
+	auto aabbMax = DirectX::XMLoadFloat3(&sceneAABBMax);
+	auto center = DirectX::XMVectorScale(DirectX::XMVectorAdd(aabbMin, aabbMax), 0.5f);
+	float radius;
+	DirectX::XMStoreFloat(&radius, DirectX::XMVector3Length(DirectX::XMVectorSubtract(aabbMax, center)));
+	radius = std::max(radius, 1e-3f);
+
+	auto front = DirectX::XMVector3Normalize(DirectX::XMLoadFloat3(&lightDir));
+	auto up = DirectX::XMVectorSet(0.0f, 1.0f, 0.0f, 0.0f);
+	float len;
+	DirectX::XMStoreFloat(&len, DirectX::XMVector3Length(DirectX::XMVector3Cross(front, up)));
+	if (len < 1e-4f)
+	{
+		up = DirectX::XMVectorSet(1.0f, 0.0f, 0.0f, 0.0f);
+	}
+
+	auto eye = DirectX::XMVectorSubtract(center, DirectX::XMVectorScale(front, radius));
+	auto mtxWorldToView = DirectX::XMMatrixLookAtRH(eye, center, up);
+
+	// Reversed-Zの平行投影 (ライトに近い側が1)
+	float depth = radius * 2.0f;
+	DirectX::XMMATRIX mtxViewToClip(
+		1.0f / radius, 0.0f, 0.0f, 0.0f,
+		0.0f, 1.0f / radius, 0.0f, 0.0f,
+		0.0f, 0.0f, 1.0f / depth, 0.0f,
+		0.0f, 0.0f, 1.0f, 1.0f);
+
+	DirectX::XMStoreFloat4x4(&outWorldToClip, mtxWorldToView * mtxViewToClip);
+}
+
+//----
+void CalcVirtualShadowPageProjection(const DirectX::XMFLOAT4X4& mtxWorldToVirtual, sl12::u32 virtualPage, sl12::u32 pageCountX,
+	DirectX::XMFLOAT4X4& outWorldToClip, DirectX::XMFLOAT4 outPlanes[6])
+{
+	float n = (float)pageCountX;
+	// 物理ページのスロットはページの周囲にガードバンドを持つので、その分だけ広く描画する
+	float s = n * (float)VSM_PAGE_SIZE / (float)VSM_PHYSICAL_PAGE_STRIDE;
+	float px = (float)(virtualPage % pageCountX);
+	float py = (float)(virtualPage / pageCountX);
+
+	// ページの中心のクリップ座標 (UVのyは下向き)
+	float cx = -1.0f + (2.0f * px + 1.0f) / n;
+	float cy = 1.0f - (2.0f * py + 1.0f) / n;
+	DirectX::XMMATRIX mtxVirtualToPage(
+		s, 0.0f, 0.0f, 0.0f,
+		0.0f, s, 0.0f, 0.0f,
+		0.0f, 0.0f, 1.0f, 0.0f,
+		-cx * s, -cy * s, 0.0f, 1.0f);
+
+	auto mtx = DirectX::XMLoadFloat4x4(&mtxWorldToVirtual) * mtxVirtualToPage;
+	DirectX::XMStoreFloat4x4(&outWorldToClip, mtx);
+
+	// 平行投影なのでw列は(0, 0, 0, 1)
+	// 奥行はシーン全体を覆うので、near/farではカリングしない
+	auto&& m = outWorldToClip;
+	outPlanes[0] = NormalizePlane(m._14 + m._11, m._24 + m._21, m._34 + m._31, m._44 + m._41);	// left
+	outPlanes[1] = NormalizePlane(m._14 - m._11, m._24 - m._21, m._34 - m._31, m._44 - m._41);	// right
+	outPlanes[2] = NormalizePlane(m._14 + m._12, m._24 + m._22, m._34 + m._32, m._44 + m._42);	// bottom
+	outPlanes[3] = NormalizePlane(m._14 - m._12, m._24 - m._22, m._34 - m._32, m._44 - m._42);	// top
+	outPlanes[4] = DirectX::XMFLOAT4(0.0f, 0.0f, 0.0f, 1.0f);
+	outPlanes[5] = DirectX::XMFLOAT4(0.0f, 0.0f, 0.0f, 1.0f);
+}
+
+//----
+void MarkVirtualShadowRequests(const float* depth, sl12::u32 width, sl12::u32 height,
+	const DirectX::XMFLOAT4X4& mtxClipToWorld, const DirectX::XMFLOAT4X4& mtxWorldToVirtual, sl12::u32 pageCountX,
+	std::vector<sl12::u32>& outRequestBits)
+{
+	outRequestBits.assign((pageCountX * pageCountX + 31) / 32, 0);
+
+	auto mtxC2W = DirectX::XMLoadFloat4x4(&mtxClipToWorld);
+	auto mtxW2V = DirectX::XMLoadFloat4x4(&mtxWorldToVirtual);
+	for (sl12::u32 y = 0; y < height; y++)
+	{
+		for (sl12::u32 x = 0; x < width; x++)
+		{
+			float d = depth[y * width + x];
+			if (d <= 0.0f)
+			{
+				continue;
+			}
+
+			float clipX = ((float)x + 0.5f) / (float)width * 2.0f - 1.0f;
+			float clipY = 1.0f - ((float)y + 0.5f) / (float)height * 2.0f;
+			auto worldPos = DirectX::XMVector3TransformCoord(DirectX::XMVectorSet(clipX, clipY, d, 1.0f), mtxC2W);
+			DirectX::XMFLOAT3 vsmPos;
+			DirectX::XMStoreFloat3(&vsmPos, DirectX::XMVector3TransformCoord(worldPos, mtxW2V));
+
+			float u = vsmPos.x * 0.5f + 0.5f;
+			float v = vsmPos.y * -0.5f + 0.5f;
+			if (u < 0.0f || u >= 1.0f || v < 0.0f || v >= 1.0f)
+			{
+				continue;
+			}
+			sl12::u32 page = (sl12::u32)(v * (float)pageCountX) * pageCountX + (sl12::u32)(u * (float)pageCountX);
+			outRequestBits[page / 32] |= 0x1 << (page % 32);
+		}
+	}
+}
+
+//----
+sl12::u32 SimulateVirtualShadowMap(sl12::u32 frameCount, sl12::u32 physicalPageCount, sl12::u32 renderBudget)
+{
+	const sl12::u32 kPageCountX = VSM_PAGE_COUNT_X;
+	const sl12::u32 kPageCount = kPageCountX * kPageCountX;
+	const sl12::u32 kWidth = 160;
+	const sl12::u32 kHeight = 90;
+	const float kGroundSize = 1000.0f;
+	const float kNearZ = 1.0f;
+	const float kTanY = std::tan(DirectX::XMConvertToRadians(30.0f));
+	const float kTanX = kTanY * (float)kWidth / (float)kHeight;
+
+	DirectX::XMFLOAT3 aabbMin(-kGroundSize, -10.0f, -kGroundSize);
+	DirectX::XMFLOAT3 aabbMax(kGroundSize, 100.0f, kGroundSize);
+	DirectX::XMFLOAT3 lightDir(0.3f, -1.0f, 0.2f);
+	DirectX::XMFLOAT4X4 mtxWorldToVirtual;
+	CalcVirtualShadowProjection(lightDir, aabbMin, aabbMax, mtxWorldToVirtual);
+
+	VirtualShadowPageTable table;
+	table.Initialize(kPageCountX, physicalPageCount);
+
+	// 描画待ちのページ (新しく割り当てたか無効化した仮想ページ)
+	std::vector<sl12::u8> pending(kPageCount, 0);
+	// 割り当て後に未描画のページ
+	std::vector<sl12::u8> neverRendered(kPageCount, 0);
+	// 描画待ちになったフレーム
+	std::vector<sl12::u32> pendingSince(kPageCount, 0);
+
+	sl12::u32 errorCount = 0;
+	auto Fail = [&](const char* label, sl12::u32 frame, sl12::u32 value)
+	{
+		if (errorCount == 0)
+		{
+			sl12::ConsolePrint("Error: virtual shadow map simulation failed. (%s : frame %u, value %u)\n", label, frame, value);
+		}
+		errorCount++;
+	};
+
+	std::vector<float> depth(kWidth * kHeight);
+	std::vector<sl12::u32> requestBits, requestedPages, prevPhysical, gpuTable;
+	std::vector<VirtualShadowPageTable::RenderPage> renderPages;
+	for (sl12::u32 frame = 0; frame < frameCount; frame++)
+	{
+		// 途中でライトを変えて全ページを無効化する
+		if (frame == frameCount / 2)
+		{
+			lightDir = DirectX::XMFLOAT3(-0.4f, -1.0f, 0.1f);
+			CalcVirtualShadowProjection(lightDir, aabbMin, aabbMax, mtxWorldToVirtual);
+			table.InvalidateAll();
+			for (sl12::u32 page = 0; page < kPageCount; page++)
+			{
+				if (table.GetPhysicalPage(page) != kVsmInvalidPage && !pending[page])
+				{
+					pending[page] = 1;
+					pendingSince[page] = frame;
+				}
+			}
+		}
+
+		// 地面の上を円を描いて移動するカメラ
+		float angle = (float)frame * 0.05f;
+		auto eye = DirectX::XMVectorSet(std::cos(angle) * 400.0f, 30.0f, std::sin(angle) * 400.0f, 1.0f);
+		auto focus = DirectX::XMVectorAdd(eye, DirectX::XMVectorSet(-std::sin(angle), -0.35f, std::cos(angle), 0.0f));
+		auto mtxWorldToView = DirectX::XMMatrixLookAtRH(eye, focus, DirectX::XMVectorSet(0.0f, 1.0f, 0.0f, 0.0f));
+		auto mtxViewToWorld = DirectX::XMMatrixInverse(nullptr, mtxWorldToView);
+		DirectX::XMMATRIX mtxViewToClip(
+			1.0f / kTanX, 0.0f, 0.0f, 0.0f,
+			0.0f, 1.0f / kTanY, 0.0f, 0.0f,
+			0.0f, 0.0f, 0.0f, -1.0f,
+			0.0f, 0.0f, kNearZ, 0.0f);
+		DirectX::XMFLOAT4X4 mtxClipToWorld;
+		DirectX::XMStoreFloat4x4(&mtxClipToWorld, DirectX::XMMatrixInverse(nullptr, mtxWorldToView * mtxViewToClip));
+
+		// 地面 (y = 0) との交差から深度を作る
+		DirectX::XMFLOAT3 eyePos;
+		DirectX::XMStoreFloat3(&eyePos, eye);
+		for (sl12::u32 y = 0; y < kHeight; y++)
+		{
+			for (sl12::u32 x = 0; x < kWidth; x++)
+			{
+				float clipX = ((float)x + 0.5f) / (float)kWidth * 2.0f - 1.0f;
+				float clipY = 1.0f - ((float)y + 0.5f) / (float)kHeight * 2.0f;
+				DirectX::XMFLOAT3 dir;
+				DirectX::XMStoreFloat3(&dir, DirectX::XMVector3TransformNormal(DirectX::XMVectorSet(clipX * kTanX, clipY * kTanY, -1.0f, 0.0f), mtxViewToWorld));
+				float d = 0.0f;
+				if (dir.y < 0.0f)
+				{
+					// 視線方向の距離が1になる向きなので、tがビュー空間の奥行になる
+					float t = -eyePos.y / dir.y;
+					float hx = eyePos.x + dir.x * t;
+					float hz = eyePos.z + dir.z * t;
+					if (std::fabs(hx) <= kGroundSize && std::fabs(hz) <= kGroundSize && t > kNearZ)
+					{
+						d = kNearZ / t;
+					}
+				}
+				depth[y * kWidth + x] = d;
+			}
+		}
+
+		// 要求ページ
+		MarkVirtualShadowRequests(depth.data(), kWidth, kHeight, mtxClipToWorld, mtxWorldToVirtual, kPageCountX, requestBits);
+		VirtualShadowPageTable::CompactRequests(requestBits.data(), kPageCount, requestedPages);
+		sl12::u32 bitCount = 0;
+		for (auto bits : requestBits)
+		{
+			for (; bits != 0; bits &= bits - 1)
+			{
+				bitCount++;
+			}
+		}
+		if (bitCount != (sl12::u32)requestedPages.size() || !std::is_sorted(requestedPages.begin(), requestedPages.end()))
+		{
+			Fail("compaction", frame, bitCount);
+		}
+		if (requestedPages.empty())
+		{
+			Fail("no request", frame, 0);
+		}
+
+		// 割り当て
+		prevPhysical.resize(requestedPages.size());
+		for (size_t i = 0; i < requestedPages.size(); i++)
+		{
+			prevPhysical[i] = table.GetPhysicalPage(requestedPages[i]);
+		}
+		table.Update(requestedPages, frame);
+		auto&& stats = table.GetStats();
+
+		sl12::u32 missing = 0;
+		for (size_t i = 0; i < requestedPages.size(); i++)
+		{
+			sl12::u32 page = requestedPages[i];
+			sl12::u32 phys = table.GetPhysicalPage(page);
+			if (phys == kVsmInvalidPage)
+			{
+				missing++;
+			}
+			else if (prevPhysical[i] == kVsmInvalidPage)
+			{
+				pending[page] = 1;
+				pendingSince[page] = frame;
+				neverRendered[page] = 1;
+			}
+			else if (prevPhysical[i] != phys)
+			{
+				Fail("requested page moved", frame, page);
+			}
+		}
+		sl12::u32 expectedOverflow = (requestedPages.size() > physicalPageCount) ? (sl12::u32)requestedPages.size() - physicalPageCount : 0;
+		if (missing != stats.overflowPages || missing != expectedOverflow)
+		{
+			Fail("overflow", frame, missing);
+		}
+
+		// 追い出されたページは描画待ちから外す
+		for (sl12::u32 page = 0; page < kPageCount; page++)
+		{
+			if (pending[page] && table.GetPhysicalPage(page) == kVsmInvalidPage)
+			{
+				pending[page] = 0;
+				neverRendered[page] = 0;
+			}
+		}
+
+		// 描画するページ
+		table.TakeDirtyPages(renderBudget, renderPages);
+		if (renderPages.size() > renderBudget)
+		{
+			Fail("render budget", frame, (sl12::u32)renderPages.size());
+		}
+		sl12::u32 renderedNewest = 0;
+		for (auto&& rp : renderPages)
+		{
+			if (!pending[rp.virtualPage] || table.GetPhysicalPage(rp.virtualPage) != rp.physicalPage)
+			{
+				Fail("unexpected render page", frame, rp.virtualPage);
+			}
+			renderedNewest = std::max(renderedNewest, pendingSince[rp.virtualPage]);
+			pending[rp.virtualPage] = 0;
+			neverRendered[rp.virtualPage] = 0;
+		}
+
+		// 描画待ちのまま残ったページは、描画したページより後に描画待ちになっている
+		for (sl12::u32 page = 0; page < kPageCount; page++)
+		{
+			if (pending[page] && pendingSince[page] < renderedNewest)
+			{
+				Fail("render order", frame, page);
+			}
+		}
+		sl12::u32 pendingCount = (sl12::u32)std::count(pending.begin(), pending.end(), (sl12::u8)1);
+		if (pendingCount != stats.dirtyPages)
+		{
+			Fail("dirty count", frame, pendingCount);
+		}
+
+		// GPUのページテーブルは描画済みのページのみ有効
+		table.BuildGpuPageTable(gpuTable);
+		for (sl12::u32 page = 0; page < kPageCount; page++)
+		{
+			sl12::u32 phys = table.GetPhysicalPage(page);
+			bool bExpectValid = phys != kVsmInvalidPage && !neverRendered[page];
+			bool bValid = (gpuTable[page] & VSM_PAGE_VALID_BIT) != 0;
+			if (bValid != bExpectValid || (bValid && (gpuTable[page] & ~VSM_PAGE_VALID_BIT) != phys))
+			{
+				Fail("gpu page table", frame, page);
+			}
+		}
+
+		sl12::u32 tableErrors = table.Validate();
+		if (tableErrors > 0)
+		{
+			Fail("page table", frame, tableErrors);
+		}
+	}
+
+	return errorCount;
+}
+
+//	EOF
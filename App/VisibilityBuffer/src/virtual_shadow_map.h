@@ -0,0 +1,153 @@
+﻿#pragma once
+
+#include "sl12/types.h"
+#include <DirectXMath.h>
+#include <vector>
+
+#include "../shaders/constant_defs.h"
+
+
+static const sl12::u32 kVsmInvalidPage = 0xffffffff;
+
+//----
+// 仮想シャドウマップのページテーブル
+// 仮想ページから物理プールのページへの割り当てとLRUによる追い出しを管理する
+// D3D12に依存しないので、アプリケーション外でも実行できる
+class VirtualShadowPageTable
+{
+public:
+	struct Stats
+	{
+		sl12::u32	requestedPages = 0;		// このフレームで要求されたページ数
+		sl12::u32	residentPages = 0;		// 割り当て済みのページ数
+		sl12::u32	allocatedPages = 0;		// このフレームで新しく割り当てたページ数
+		sl12::u32	evictedPages = 0;		// このフレームで追い出したページ数
+		sl12::u32	overflowPages = 0;		// 物理ページが足りずに割り当てられなかったページ数
+		sl12::u32	renderedPages = 0;		// このフレームで描画するページ数
+		sl12::u32	dirtyPages = 0;			// 描画待ちのページ数
+	};	// struct Stats
+
+	struct RenderPage
+	{
+		sl12::u32	virtualPage;
+		sl12::u32	physicalPage;
+	};	// struct RenderPage
+
+public:
+	VirtualShadowPageTable()
+	{}
+	~VirtualShadowPageTable()
+	{}
+
+	// 仮想ページはpageCountX * pageCountXの正方形
+	void Initialize(sl12::u32 pageCountX, sl12::u32 physicalPageCount);
+
+	// 要求ビット (1ページ1bit) から要求ページのリストを作る
+	// リストは仮想ページ番号の昇順になる
+	static void CompactRequests(const sl12::u32* requestBits, sl12::u32 pageCount, std::vector<sl12::u32>& outPages);
+
+	// 要求されたページを割り当てる
+	// 割り当て済みのページは使用フレームを更新し、未割り当てのページは空きページかLRUのページを使う
+	// このフレームで要求されたページは追い出さない
+	void Update(const std::vector<sl12::u32>& requestedPages, sl12::u64 frameIndex);
+
+	// ライトやキャスターが変わった場合に割り当て済みのページを描画待ちにする
+	void InvalidateAll();
+	// 仮想ページの矩形 (両端を含む) を描画待ちにする
+	void InvalidateRect(sl12::u32 x0, sl12::u32 y0, sl12::u32 x1, sl12::u32 y1);
+	// 全てのページの割り当てを解除する
+	void Reset();
+
+	// 描画待ちのページを最大maxCount個取り出す
+	// 描画待ちになった順に取り出すので、予算を超えて描画待ちが続いても全てのページがいずれ描画される
+	sl12::u32 TakeDirtyPages(sl12::u32 maxCount, std::vector<RenderPage>& outPages);
+
+	// GPUに転送するページテーブル
+	// 描画済みのページのみ 物理ページ番号 | VSM_PAGE_VALID_BIT が入り、それ以外は0
+	void BuildGpuPageTable(std::vector<sl12::u32>& outTable) const;
+
+	sl12::u32 GetPhysicalPage(sl12::u32 virtualPage) const
+	{
+		return virtualToPhysical_[virtualPage];
+	}
+	sl12::u32 GetVirtualPage(sl12::u32 physicalPage) const
+	{
+		return physicalToVirtual_[physicalPage];
+	}
+	bool IsDirty(sl12::u32 physicalPage) const
+	{
+		return dirty_[physicalPage] != 0;
+	}
+	sl12::u32 GetPageCountX() const
+	{
+		return pageCountX_;
+	}
+	sl12::u32 GetPhysicalPageCount() const
+	{
+		return (sl12::u32)physicalToVirtual_.size();
+	}
+	const Stats& GetStats() const
+	{
+		return stats_;
+	}
+
+	// 内部の整合性を検証する
+	//   ・仮想ページと物理ページの対応が一対一
+	//   ・LRUリストと空きリストで全物理ページを1回ずつ含む
+	// 戻り値はエラー数
+	sl12::u32 Validate() const;
+
+private:
+	void MarkDirty(sl12::u32 physicalPage);
+	void LruRemove(sl12::u32 physicalPage);
+	void LruPushBack(sl12::u32 physicalPage);
+
+private:
+	sl12::u32				pageCountX_ = 0;
+	std::vector<sl12::u32>	virtualToPhysical_;
+	std::vector<sl12::u32>	physicalToVirtual_;
+	std::vector<sl12::u64>	lastUsedFrame_;
+	std::vector<sl12::u8>	dirty_;
+	std::vector<sl12::u8>	rendered_;			// 割り当て後に1回以上描画したか
+	std::vector<sl12::u64>	dirtySerial_;		// 描画待ちになった順番
+	std::vector<sl12::u32>	dirtyPages_;		// TakeDirtyPagesの作業用
+	sl12::u64				dirtySerialCounter_ = 0;
+	std::vector<sl12::u32>	freePages_;
+
+	// LRUリスト (先頭が最も古い)
+	std::vector<sl12::u32>	lruPrev_, lruNext_;
+	sl12::u32				lruHead_ = kVsmInvalidPage;
+	sl12::u32				lruTail_ = kVsmInvalidPage;
+
+	sl12::u64				frameIndex_ = 0;
+	Stats					stats_;
+};	// class VirtualShadowPageTable
+
+//----
+// シーン全体をライト方向から覆う仮想シャドウマップの平行投影
+// ライトとシーンAABBが変わらなければ変わらないので、描画済みのページを使い続けられる
+// 深度はReversed-Z (ライトに近い側が1)
+void CalcVirtualShadowProjection(const DirectX::XMFLOAT3& lightDir, const DirectX::XMFLOAT3& sceneAABBMin, const DirectX::XMFLOAT3& sceneAABBMax,
+	DirectX::XMFLOAT4X4& outWorldToClip);
+
+// 仮想ページを描画する行列と、キャスターのカリング平面 (内側が正)
+// ページの範囲と周囲のガードバンドをクリップ空間全体に拡大するので、物理ページのスロットにそのまま描画できる
+void CalcVirtualShadowPageProjection(const DirectX::XMFLOAT4X4& mtxWorldToVirtual, sl12::u32 virtualPage, sl12::u32 pageCountX,
+	DirectX::XMFLOAT4X4& outWorldToClip, DirectX::XMFLOAT4 outPlanes[6]);
+
+// 深度バッファから要求ページのビットを立てる (vsm_page_request.c.hlsl のCPU版)
+// 深度はReversed-Zで、0の画素 (空) は要求しない
+void MarkVirtualShadowRequests(const float* depth, sl12::u32 width, sl12::u32 height,
+	const DirectX::XMFLOAT4X4& mtxClipToWorld, const DirectX::XMFLOAT4X4& mtxWorldToVirtual, sl12::u32 pageCountX,
+	std::vector<sl12::u32>& outRequestBits);
+
+// 合成した深度バッファで移動するカメラをシミュレーションし、ページテーブルを検証する
+//   ・物理ページが足りる限り、要求されたページは全て割り当てられる
+//   ・このフレームで要求されたページは追い出されない
+//   ・描画するページは新しく割り当てたページか無効化したページのみ
+//   ・描画待ちのページは描画待ちになった順に描画される
+//   ・ページテーブルの内部の整合性
+// 戻り値は失敗したケース数 (0なら成功)
+sl12::u32 SimulateVirtualShadowMap(sl12::u32 frameCount, sl12::u32 physicalPageCount, sl12::u32 renderBudget);
+
+//	EOF